@@ -176,6 +176,8 @@ struct DHCPv6Client {
     DHCPDUIDRef				server_id; /* points to saved */
     DHCPv6OptionIA_NARef		ia_na;	   /* points to saved */	
     DHCPv6OptionIAADDRRef		ia_addr;   /* points to saved */
+    const uint8_t *			reconfigure_key; /* points to saved */
+    uint64_t				reconfigure_replay;
     lease_info_t			lease;
     bool				private_address;
     CFDataRef				duid;
@@ -854,6 +856,7 @@ DHCPv6ClientClearPacket(DHCPv6ClientRef client)
     client->server_id = NULL;
     client->ia_na = NULL;
     client->ia_addr = NULL;
+    client->reconfigure_key = NULL;
     client->saved_verified = false;
     client->saved.pkt_len = 0;
     return;
@@ -956,6 +959,10 @@ DHCPv6ClientSavePacket(DHCPv6ClientRef client, DHCPv6SocketReceiveDataRef data)
 					       &option_len, NULL);
     client->ia_na = get_ia_na_addr(client, client->saved.pkt->msg_type,
 				   client->saved.options,  &client->ia_addr);
+    client->reconfigure_key
+	= DHCPv6OptionListGetReconfigureKey(client->saved.options,
+					    kDHCPv6ReconfigureKeyTypeKey,
+					    &client->reconfigure_replay);
     if (client->ia_na != NULL) {
 	t1 = DHCPv6OptionIA_NAGetT1(client->ia_na);
 	t2 = DHCPv6OptionIA_NAGetT2(client->ia_na);
@@ -1036,6 +1043,7 @@ STATIC void
 DHCPv6ClientSendInform(DHCPv6ClientRef client)
 {
     char			buf[1500];
+    DHCPv6OptionErrorString 	err;
     int				error;
     interface_t *		if_p = DHCPv6ClientGetInterface(client);
     DHCPv6OptionArea		oa;
@@ -1046,6 +1054,13 @@ DHCPv6ClientSendInform(DHCPv6ClientRef client)
     if (pkt == NULL) {
 	return;
     }
+    /* let the server push configuration changes with RECONFIGURE */
+    if (!DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_RECONF_ACCEPT,
+				   0, NULL, &err)) {
+	my_log(LOG_NOTICE, "DHCPv6Client: failed to add RECONF_ACCEPT, %s",
+	       err.str);
+	return;
+    }
     error = DHCPv6SocketTransmit(client->sock, pkt,
 				 DHCPV6_PACKET_HEADER_LENGTH 
 				 + DHCPv6OptionAreaGetUsedLength(&oa));
@@ -1185,6 +1200,73 @@ DHCPv6ClientSendPacket(DHCPv6ClientRef client)
     return;
 }
 
+STATIC void
+DHCPv6Client_Inform(DHCPv6ClientRef client, IFEventID_t event_id, 
+		   void * event_data);
+
+/*
+ * Function: DHCPv6ClientReconfigureIsValid
+ * Purpose:
+ *   Check that a RECONFIGURE is addressed to us, comes from the server
+ *   that answered our Information-request, asks for an Information-request,
+ *   and carries a valid HMAC computed with the key that server gave us.
+ */
+STATIC bool
+DHCPv6ClientReconfigureIsValid(DHCPv6ClientRef client,
+			       DHCPv6SocketReceiveDataRef data)
+{
+    interface_t *	if_p = DHCPv6ClientGetInterface(client);
+    const uint8_t *	msg_type;
+    int			option_len;
+    uint64_t		replay;
+    DHCPDUIDRef		server_id;
+    int			server_id_len;
+
+    if (data->pkt->msg_type != kDHCPv6MessageRECONFIGURE
+	|| client->reconfigure_key == NULL
+	|| client->server_id == NULL
+	|| !S_duid_matches(client, data->options)) {
+	return (false);
+    }
+    (void)DHCPv6OptionListGetOptionDataAndLength(client->saved.options,
+						 kDHCPv6OPTION_SERVERID,
+						 &server_id_len, NULL);
+    server_id = (DHCPDUIDRef)
+	DHCPv6OptionListGetOptionDataAndLength(data->options,
+					       kDHCPv6OPTION_SERVERID,
+					       &option_len, NULL);
+    if (server_id == NULL
+	|| option_len != server_id_len
+	|| bcmp(server_id, client->server_id, option_len) != 0) {
+	my_log(LOG_INFO, "DHCPv6 %s: Reconfigure from unknown server",
+	       if_name(if_p));
+	return (false);
+    }
+    msg_type = DHCPv6OptionListGetOptionDataAndLength(data->options,
+						      kDHCPv6OPTION_RECONF_MSG,
+						      &option_len, NULL);
+    if (msg_type == NULL || option_len != 1
+	|| *msg_type != kDHCPv6MessageINFORMATION_REQUEST) {
+	my_log(LOG_INFO, "DHCPv6 %s: Reconfigure with unsupported message",
+	       if_name(if_p));
+	return (false);
+    }
+    if (!DHCPv6PacketVerifyReconfigure(data->pkt, data->pkt_len,
+				       data->options,
+				       client->reconfigure_key, &replay)) {
+	my_log(LOG_NOTICE, "DHCPv6 %s: Reconfigure authentication failed",
+	       if_name(if_p));
+	return (false);
+    }
+    if (replay <= client->reconfigure_replay) {
+	my_log(LOG_NOTICE, "DHCPv6 %s: Reconfigure replay detected",
+	       if_name(if_p));
+	return (false);
+    }
+    client->reconfigure_replay = replay;
+    return (true);
+}
+
 STATIC void
 DHCPv6Client_InformComplete(DHCPv6ClientRef client, IFEventID_t event_id,
 			    void * event_data)
@@ -1193,6 +1275,23 @@ DHCPv6Client_InformComplete(DHCPv6ClientRef client, IFEventID_t event_id,
     case IFEventID_start_e:
 	DHCPv6ClientSetState(client, kDHCPv6ClientStateInformComplete);
 	DHCPv6ClientCancelPendingEvents(client);
+	if (client->reconfigure_key != NULL) {
+	    /* the server can tell us when to ask again */
+	    DHCPv6SocketEnableReceive(client->sock,
+				      (DHCPv6SocketReceiveFuncPtr)
+				      DHCPv6Client_InformComplete,
+				      client, (void *)IFEventID_data_e);
+	}
+	break;
+    case IFEventID_data_e:
+	if (!DHCPv6ClientReconfigureIsValid(client,
+					    (DHCPv6SocketReceiveDataRef)
+					    event_data)) {
+	    break;
+	}
+	my_log(LOG_INFO, "DHCPv6 %s: Reconfigure Received",
+	       if_name(DHCPv6ClientGetInterface(client)));
+	DHCPv6Client_Inform(client, IFEventID_start_e, NULL);
 	break;
     default:
 	break;
@@ -1357,7 +1357,7 @@ dhcp_cancel_pending_events(ServiceRef service_p)
 	return;
     timer_cancel(dhcp->timer);
     bootp_client_disable_receive(dhcp->client);
-    arp_client_cancel(dhcp->arp);
+    service_resolve_router_cancel(service_p, dhcp->arp);
     return;
 }
 
@@ -243,6 +243,12 @@ typedef struct {
     uint32_t			flags;
     struct in_addr		iaddr;
     uint8_t			hwaddr[MAX_LINK_ADDR_LEN];
+    /* neighbor cache lookup/watch */
+    int				lookup_seq;
+    int				watch_id;
+    arp_client_t *		arp;
+    service_resolve_router_callback_t * callback_func;
+    struct in_addr		our_ip;
 } router_info_t;
 
 STATIC void service_router_clear_arp_verified(ServiceRef service_p);
@@ -252,6 +258,9 @@ STATIC boolean_t service_router_resolve_in_progress(ServiceRef service_p);
 STATIC void service_router_set_resolve_timed_out(ServiceRef service_p);
 STATIC void service_router_clear_resolve_timed_out(ServiceRef service_p);
 STATIC boolean_t service_router_resolve_timed_out(ServiceRef service_p);
+STATIC void service_router_neighbor_cancel(ServiceRef service_p);
+STATIC void service_router_watch_neighbor(ServiceRef service_p);
+STATIC void service_additional_routes_clear(ServiceRef service_p);
 
 
 typedef struct IFState * IFStateRef;
@@ -269,6 +278,8 @@ typedef struct {
     absolute_time_t	ip_assigned_time;
     absolute_time_t	ip_conflict_time;
     int			ip_conflict_count;
+    CFDataRef		routes_data;	/* last published AdditionalRoutes */
+    CFArrayRef		routes_array;
 } ServiceIPv4, * ServiceIPv4Ref;
 
 typedef struct {
@@ -1327,6 +1338,12 @@ computer_name_update(SCDynamicStoreRef session)
 PRIVATE_EXTERN void
 service_resolve_router_cancel(ServiceRef service_p, arp_client_t * arp)
 {
+    if (ServiceIsIPv4(service_p)) {
+	router_info_t *	router = &service_p->u.v4.router;
+
+	route_request_cancel(router->lookup_seq);
+	router->lookup_seq = 0;
+    }
     if (arp != NULL) {
 	arp_client_cancel(arp);
     }
@@ -1334,6 +1351,20 @@ service_resolve_router_cancel(ServiceRef service_p, arp_client_t * arp)
     return;
 }
 
+STATIC void
+service_router_neighbor_cancel(ServiceRef service_p)
+{
+    if (ServiceIsIPv4(service_p)) {
+	router_info_t *	router = &service_p->u.v4.router;
+
+	route_request_cancel(router->lookup_seq);
+	router->lookup_seq = 0;
+	route_request_watch_cancel(router->watch_id);
+	router->watch_id = 0;
+    }
+    return;
+}
+
 static void
 service_resolve_router_complete(void * arg1, void * arg2, 
 				const arp_result_t * result)
@@ -1361,6 +1392,7 @@ service_resolve_router_complete(void * arg1, void * arg2,
 	my_log(LOG_INFO, "service_resolve_router_complete %s: ARP "
 	       IP_FORMAT ": response received", if_name(if_p),
 	       IP_LIST(&service_p->u.v4.router.iaddr));
+	service_router_watch_neighbor(service_p);
 	status = router_arp_status_success_e;
     }
     else {
@@ -1374,13 +1406,120 @@ service_resolve_router_complete(void * arg1, void * arg2,
     return;
 }
 
+STATIC void
+service_resolve_router_probe(ServiceRef service_p)
+{
+    interface_t *	if_p = service_interface(service_p);
+    router_info_t *	router = &service_p->u.v4.router;
+
+    my_log(LOG_INFO, "service_resolve_router %s: sender " IP_FORMAT 
+	   " target " IP_FORMAT " started", 
+	   if_name(if_p), IP_LIST(&router->our_ip), IP_LIST(&router->iaddr));
+    arp_client_resolve(router->arp, service_resolve_router_complete,
+		       service_p, router->callback_func, router->our_ip,
+		       router->iaddr, S_discover_router_mac_address_secs);
+    return;
+}
+
+/*
+ * Function: service_router_neighbor_changed
+ * Purpose:
+ *   Called when the kernel's ARP entry for the router changes. If the
+ *   router's hardware address is different, remember the new one and let
+ *   the method republish.
+ */
+STATIC void
+service_router_neighbor_changed(void * arg1, void * arg2, int status,
+				route_msg * msg_p)
+{
+    uint8_t		hwaddr[MAX_LINK_ADDR_LEN];
+    int			hwaddr_length;
+    interface_t *	if_p;
+    router_info_t *	router;
+    ServiceRef		service_p = (ServiceRef)arg1;
+
+    if (status != ARP_RETURN_SUCCESS) {
+	/* entry expired or was flushed, the kernel will re-resolve it */
+	return;
+    }
+    if_p = service_interface(service_p);
+    router = &service_p->u.v4.router;
+    hwaddr_length = arp_get_reply_link_address(msg_p, hwaddr, sizeof(hwaddr));
+    if (hwaddr_length != if_link_length(if_p)
+	|| !service_router_all_valid(service_p)
+	|| bcmp(hwaddr, router->hwaddr, hwaddr_length) == 0) {
+	return;
+    }
+    my_log(LOG_NOTICE, "%s: router " IP_FORMAT " hardware address changed",
+	   if_name(if_p), IP_LIST(&router->iaddr));
+    bcopy(hwaddr, router->hwaddr, hwaddr_length);
+    if (router->callback_func != NULL) {
+	(*router->callback_func)(service_p, router_arp_status_success_e);
+    }
+    return;
+}
+
+STATIC void
+service_router_watch_neighbor(ServiceRef service_p)
+{
+    interface_t *	if_p = service_interface(service_p);
+    router_info_t *	router = &service_p->u.v4.router;
+
+    if (router->watch_id > 0) {
+	return;
+    }
+    router->watch_id
+	= route_request_watch_neighbor(router->iaddr, if_link_index(if_p),
+				       service_router_neighbor_changed,
+				       service_p, NULL);
+    return;
+}
+
+/*
+ * Function: service_resolve_router_lookup_complete
+ * Purpose:
+ *   Use the kernel's ARP entry for the router if it's complete and
+ *   hasn't expired, otherwise fall back to ARP'ing for it.
+ */
+STATIC void
+service_resolve_router_lookup_complete(void * arg1, void * arg2, int status,
+				       route_msg * msg_p)
+{
+    uint8_t		hwaddr[MAX_LINK_ADDR_LEN];
+    int			hwaddr_length = 0;
+    interface_t *	if_p;
+    router_info_t *	router;
+    ServiceRef		service_p = (ServiceRef)arg1;
+
+    if_p = service_interface(service_p);
+    router = &service_p->u.v4.router;
+    router->lookup_seq = 0;
+    if (status == ARP_RETURN_SUCCESS
+	&& msg_p->m_rtm.rtm_index == if_link_index(if_p)) {
+	hwaddr_length = arp_get_reply_link_address(msg_p, hwaddr,
+						   sizeof(hwaddr));
+    }
+    if (hwaddr_length == 0 || hwaddr_length != if_link_length(if_p)) {
+	service_resolve_router_probe(service_p);
+	return;
+    }
+    bcopy(hwaddr, router->hwaddr, hwaddr_length);
+    service_router_clear_resolve_in_progress(service_p);
+    service_router_set_all_valid(service_p);
+    my_log(LOG_INFO, "service_resolve_router %s: " IP_FORMAT
+	   " found in neighbor cache", if_name(if_p), IP_LIST(&router->iaddr));
+    service_router_watch_neighbor(service_p);
+    (*router->callback_func)(service_p, router_arp_status_success_e);
+    return;
+}
+
 PRIVATE_EXTERN boolean_t
 service_resolve_router(ServiceRef service_p, arp_client_t * arp,
 		       service_resolve_router_callback_t * callback_func,
 		       struct in_addr our_ip)
 {
     interface_t *	if_p = service_interface(service_p);
-    struct in_addr	router_ip;
+    router_info_t *	router;
 
     if (G_discover_and_publish_router_mac_address == FALSE) {
 	/* don't bother */
@@ -1395,13 +1534,21 @@ service_resolve_router(ServiceRef service_p, arp_client_t * arp,
     }
     service_router_set_resolve_in_progress(service_p);
     service_router_clear_resolve_timed_out(service_p);
-    router_ip = service_router_iaddr(service_p);
-    my_log(LOG_INFO, "service_resolve_router %s: sender " IP_FORMAT 
-	   " target " IP_FORMAT " started", 
-	   if_name(if_p), IP_LIST(&our_ip), IP_LIST(&router_ip));
-    arp_client_resolve(arp, service_resolve_router_complete,
-		       service_p, callback_func, our_ip, router_ip,
-		       S_discover_router_mac_address_secs);
+    router = &service_p->u.v4.router;
+    router->arp = arp;
+    router->callback_func = callback_func;
+    router->our_ip = our_ip;
+
+    /* consult the neighbor cache before ARP'ing */
+    route_request_cancel(router->lookup_seq);
+    router->lookup_seq
+	= route_request_arp_get(router->iaddr, if_link_index(if_p),
+				service_resolve_router_lookup_complete,
+				service_p, NULL);
+    if (router->lookup_seq < 0) {
+	router->lookup_seq = 0;
+	service_resolve_router_probe(service_p);
+    }
     return (TRUE);
 }
 
@@ -1699,11 +1846,13 @@ ServiceFree(void * arg)
     if (ifstate != NULL && ifstate->linklocal_service_p == service_p) {
 	ifstate->linklocal_service_p = NULL;
     }
+    service_router_neighbor_cancel(service_p);
     config_method_stop(service_p);
     service_publish_clear(service_p, ipconfig_status_success_e);
 #if TARGET_OS_OSX
     ServiceRemoveAddressConflict(service_p);
 #endif /* TARGET_OS_OSX */
+    service_additional_routes_clear(service_p);
     my_CFRelease(&service_p->serviceID);
     my_CFRelease(&service_p->parent_serviceID);
     my_CFRelease(&service_p->child_serviceID);
@@ -3153,58 +3302,131 @@ ServiceIPv4CopyMergedDNSAndCaptive(ServiceRef service_p,
 #define kSCPropConfirmedInterfaceName CFSTR("ConfirmedInterfaceName")
 #endif /* kSCPropConfirmedInterfaceName */
 
-STATIC void
-dict_insert_additional_routes(CFMutableDictionaryRef dict,
-			      struct in_addr addr,
+#ifndef kSCPropNetIPv4AdditionalRoutesData
+#define kSCPropNetIPv4AdditionalRoutesData CFSTR("AdditionalRoutesData")
+#endif /* kSCPropNetIPv4AdditionalRoutesData */
+
+/*
+ * Function: additional_routes_create_data
+ * Purpose:
+ *   Return the compact encoding of the AdditionalRoutes for the service:
+ *   the interface address route, the IPv4 link-local (169.254/16) route,
+ *   followed by the classless routes.
+ */
+STATIC CFDataRef
+additional_routes_create_data(struct in_addr addr,
 			      IPv4ClasslessRouteRef list,
 			      int list_count)
 {
-    struct in_addr	linklocal_mask = { htonl(IN_CLASSB_NET) };
-    struct in_addr	linklocal_network = { htonl(IN_LINKLOCALNETNUM) };
-    CFDictionaryRef	route_dict;
-    CFMutableArrayRef	routes;
+    int				count = 0;
+    CFDataRef			data;
+    struct in_addr		linklocal_mask = { htonl(IN_CLASSB_NET) };
+    struct in_addr		linklocal_network = { htonl(IN_LINKLOCALNETNUM) };
+    IPv4ClasslessRouteRef	routes;
 
-    routes = CFArrayCreateMutable(NULL,
-				  list_count + 2,
-				  &kCFTypeArrayCallBacks);
+    routes = (IPv4ClasslessRouteRef)malloc(sizeof(*routes) * (list_count + 2));
 
     /* add interface address route */
-    route_dict = route_dict_create(&addr, &G_ip_broadcast, NULL);
-    CFArrayAppendValue(routes, route_dict);
-    CFRelease(route_dict);
+    routes[count].dest = addr;
+    routes[count].prefix_length = 32;
+    routes[count].gate.s_addr = 0;
+    count++;
 
     /* add IPv4 link-local (169.254/16) route */
     if (!in_subnet(linklocal_network, linklocal_mask, addr)) {
-	    /* add IPv4LL route */
-	    route_dict = route_dict_create(&linklocal_network,
-					   &linklocal_mask, NULL);
-	    CFArrayAppendValue(routes, route_dict);
-	    CFRelease(route_dict);
+	routes[count].dest = linklocal_network;
+	routes[count].prefix_length = 16;
+	routes[count].gate.s_addr = 0;
+	count++;
     }
 
     /* add classless routes */
     if (list != NULL) {
-	int		i;
+	bcopy(list, routes + count, sizeof(*list) * list_count);
+	count += list_count;
+    }
+    data = IPv4ClasslessRouteListCreateData(routes, count);
+    free(routes);
+    return (data);
+}
 
-	for (i = 0; i < list_count; i++) {
-	    struct in_addr	dest;
-	    struct in_addr	mask;
-	    struct in_addr *	gateway_p;
+STATIC CFArrayRef
+additional_routes_create_array(CFDataRef data)
+{
+    int				i;
+    IPv4ClasslessRouteRef	list;
+    int				list_count;
+    CFMutableArrayRef		routes;
+
+    list = IPv4ClasslessRouteListCreateWithData(data, &list_count);
+    routes = CFArrayCreateMutable(NULL, list_count, &kCFTypeArrayCallBacks);
+    for (i = 0; i < list_count; i++) {
+	struct in_addr		mask;
+	struct in_addr *	gateway_p;
+	CFDictionaryRef		route_dict;
+
+	gateway_p = &list[i].gate;
+	if (gateway_p->s_addr == 0) {
+	    gateway_p = NULL;
+	}
+	mask.s_addr = htonl(prefix_to_mask32(list[i].prefix_length));
+	route_dict = route_dict_create(&list[i].dest, &mask, gateway_p);
+	CFArrayAppendValue(routes, route_dict);
+	CFRelease(route_dict);
+    }
+    if (list != NULL) {
+	free(list);
+    }
+    return (routes);
+}
 
-	    gateway_p = &list[i].gate;
-	    if (gateway_p->s_addr == 0) {
-		gateway_p = NULL;
-	    }
-	    mask.s_addr = htonl(prefix_to_mask32(list[i].prefix_length));
-	    dest = list[i].dest;
-	    dest.s_addr &= mask.s_addr;
-	    route_dict = route_dict_create(&dest, &mask, gateway_p);
-	    CFArrayAppendValue(routes, route_dict);
-	    CFRelease(route_dict);
-	}
+STATIC void
+service_additional_routes_clear(ServiceRef service_p)
+{
+    if (ServiceIsIPv4(service_p)) {
+	my_CFRelease(&service_p->u.v4.routes_data);
+	my_CFRelease(&service_p->u.v4.routes_array);
     }
-    CFDictionarySetValue(dict, kSCPropNetIPv4AdditionalRoutes, routes);
-    CFRelease(routes);
+    return;
+}
+
+/*
+ * Function: dict_insert_additional_routes
+ * Purpose:
+ *   Insert the AdditionalRoutes array and its compact encoding.
+ *
+ *   The encoding carries a digest of the routes; when it matches the
+ *   one last published, the previously built array is re-used, so that
+ *   a renew with an unchanged (possibly very large) route list costs a
+ *   single digest comparison, and the subsequent CFEqual() against the
+ *   store value is a pointer comparison.
+ */
+STATIC void
+dict_insert_additional_routes(ServiceRef service_p,
+			      CFMutableDictionaryRef dict,
+			      struct in_addr addr,
+			      IPv4ClasslessRouteRef list,
+			      int list_count)
+{
+    CFDataRef		data;
+    ServiceIPv4Ref	v4_p = &service_p->u.v4;
+
+    data = additional_routes_create_data(addr, list, list_count);
+    if (data == NULL) {
+	return;
+    }
+    if (v4_p->routes_array == NULL
+	|| !IPv4ClasslessRouteListDataEqual(data, v4_p->routes_data)) {
+	my_CFRelease(&v4_p->routes_array);
+	v4_p->routes_array = additional_routes_create_array(data);
+	my_CFRelease(&v4_p->routes_data);
+	v4_p->routes_data = CFRetain(data);
+    }
+    CFDictionarySetValue(dict, kSCPropNetIPv4AdditionalRoutes,
+			 v4_p->routes_array);
+    CFDictionarySetValue(dict, kSCPropNetIPv4AdditionalRoutesData,
+			 v4_p->routes_data);
+    CFRelease(data);
     return;
 }
 
@@ -3447,7 +3669,7 @@ ServicePublishSuccessIPv4(ServiceRef service_p, dhcp_info_t * dhcp_info_p)
 	dict_insert_router_info(service_p, ipv4_dict);
 	
 	/* AdditionalRoutes */
-	dict_insert_additional_routes(ipv4_dict, info_p->addr,
+	dict_insert_additional_routes(service_p, ipv4_dict, info_p->addr,
 				      routes, routes_count);
 
 	/* ConfirmedInterfaceName */
@@ -4924,6 +5146,7 @@ service_router_clear(ServiceRef service_p)
 
 	v4_p->router.flags = 0;
     }
+    service_router_neighbor_cancel(service_p);
     return;
 }
 
@@ -38,6 +38,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <string.h>
 #include <syslog.h>
@@ -57,6 +58,8 @@
 #include "arp.h"
 #include "mylog.h"
 #include "globals.h"
+#include "timer.h"
+#include "FDSet.h"
 
 STATIC void
 set_sockaddr_in(struct sockaddr_in * sin_p, struct in_addr iaddr)
@@ -216,6 +219,28 @@ flush_dynamic_routes(int s)
     return (0);
 }
 
+/*
+ * Function: arp_entry_delete
+ * Purpose:
+ *   Remove the ARP entry for the address by writing an RTM_DELETE for it
+ *   straight away, instead of looking it up first. There is nothing to
+ *   read, so the entry is gone by the time this returns.
+ */
+STATIC void
+arp_entry_delete(int s, struct in_addr iaddr)
+{
+    route_msg		msg;
+    int			len;
+
+    len = arp_get_request_init(&msg, iaddr, 0);
+    msg.m_rtm.rtm_type = RTM_DELETE;
+    if (write(s, &msg, len) < 0 && errno != ESRCH) {
+	my_log(LOG_INFO, "IPConfiguration: removing arp entry for "
+	       IP_FORMAT " failed, %s", IP_LIST(&iaddr), strerror(errno));
+    }
+    return;
+}
+
 PRIVATE_EXTERN void
 flush_routes(int if_index, const struct in_addr ip,
 	     const struct in_addr broadcast) 
@@ -228,14 +253,15 @@ flush_routes(int if_index, const struct in_addr ip,
     }
 
     /* remove permanent arp entries for the IP and IP broadcast.
-     * - do these first because they require reading from the routing socket
-     * - flushing only requires writing to the routing socket
+     * - do these first, and synchronously, so that the caller can
+     *   re-add them as soon as we return
+     * - neither these nor flushing require reading from the routing socket
      */
     if (ip.s_addr) { 
-	(void)arp_delete(s, ip, 0);
+	arp_entry_delete(s, ip);
     }
     if (broadcast.s_addr) { 
-	(void)arp_delete(s, broadcast, 0);
+	arp_entry_delete(s, broadcast);
     }
 
     /* blow away all non-permanent arp entries */
@@ -245,3 +271,561 @@ flush_routes(int if_index, const struct in_addr ip,
     close(s);
     return;
 }
+
+/**
+ ** Routing socket request multiplexer
+ ** - RTM_GET requests share one non-blocking routing socket; replies are
+ **   matched to outstanding requests by sequence number when the socket
+ **   is readable, so no caller waits in read() for its reply
+ **/
+#define ROUTE_REQUEST_MAX		64	/* must be a power of 2 */
+#define ROUTE_REQUEST_TIMEOUT_SECS	1.0
+#define ROUTE_REQUEST_RETRY_SECS	0.1
+#define ROUTE_REQUEST_IDLE_SECS		5.0
+#define ROUTE_WATCH_MAX			16
+
+typedef struct {
+    int				seq;		/* 0 if the slot is free */
+    struct in_addr		iaddr;
+    int				if_index;
+    boolean_t			delete;
+    boolean_t			written;
+    CFAbsoluteTime		deadline;
+    route_request_func_t *	func;
+    void *			arg1;
+    void *			arg2;
+} route_request_t;
+
+typedef struct {
+    int				id;		/* 0 if the slot is free */
+    struct in_addr		iaddr;
+    int				if_index;
+    route_request_func_t *	func;
+    void *			arg1;
+    void *			arg2;
+} route_watch_t;
+
+typedef struct {
+    FDCalloutRef		read_fd;
+    timer_callout_t *		timer;
+    pid_t			pid;
+    int				count;
+    route_request_t		list[ROUTE_REQUEST_MAX];
+    int				watch_count;
+    int				watch_last_id;
+    route_watch_t		watches[ROUTE_WATCH_MAX];
+} route_requests_t;
+
+STATIC route_requests_t *	S_route_requests;
+
+STATIC void
+route_requests_read(void * arg1, void * arg2);
+
+STATIC void
+route_requests_timer(void * arg1, void * arg2, void * arg3);
+
+STATIC route_requests_t *
+route_requests_get(void)
+{
+    if (S_route_requests == NULL) {
+	S_route_requests = malloc(sizeof(*S_route_requests));
+	bzero(S_route_requests, sizeof(*S_route_requests));
+	S_route_requests->timer = timer_callout_init("route_requests");
+	S_route_requests->pid = getpid();
+    }
+    return (S_route_requests);
+}
+
+STATIC boolean_t
+route_requests_open(route_requests_t * requests)
+{
+    int		s;
+
+    if (requests->read_fd != NULL) {
+	return (TRUE);
+    }
+    s = arp_open_routing_socket();
+    if (s < 0) {
+	my_log(LOG_NOTICE, "route_requests: open routing socket failed, %s",
+	       strerror(errno));
+	return (FALSE);
+    }
+    requests->read_fd = FDCalloutCreate(s, route_requests_read, NULL, NULL);
+    return (TRUE);
+}
+
+STATIC void
+route_requests_schedule(route_requests_t * requests)
+{
+    CFAbsoluteTime	next = 0;
+
+    if (requests->count == 0 && requests->watch_count != 0) {
+	/* the socket stays open for the watchers */
+	timer_cancel(requests->timer);
+	return;
+    }
+    if (requests->count == 0) {
+	/* keep the socket around briefly for the next burst */
+	timer_callout_set(requests->timer, ROUTE_REQUEST_IDLE_SECS,
+			  route_requests_timer, NULL, NULL, NULL);
+	return;
+    }
+    for (int i = 0; i < ROUTE_REQUEST_MAX; i++) {
+	route_request_t *	req = requests->list + i;
+	CFAbsoluteTime		when;
+
+	if (req->seq == 0) {
+	    continue;
+	}
+	when = req->deadline;
+	if (!req->written) {
+	    when = timer_get_current_time() + ROUTE_REQUEST_RETRY_SECS;
+	}
+	if (next == 0 || when < next) {
+	    next = when;
+	}
+    }
+    timer_callout_set_absolute(requests->timer, next,
+			       route_requests_timer, NULL, NULL, NULL);
+    return;
+}
+
+STATIC boolean_t
+route_request_write(route_requests_t * requests, route_request_t * req)
+{
+    route_msg		msg;
+    int			len;
+
+    len = arp_get_request_init(&msg, req->iaddr, req->if_index);
+    msg.m_rtm.rtm_seq = req->seq;
+    if (write(FDCalloutGetFD(requests->read_fd), &msg, len) == len) {
+	req->written = TRUE;
+	return (TRUE);
+    }
+    switch (errno) {
+    case ENOBUFS:
+    case EAGAIN:
+	/* try again from the timer */
+	return (TRUE);
+    default:
+	break;
+    }
+    my_log(LOG_NOTICE, "route_requests: write failed, %s", strerror(errno));
+    return (FALSE);
+}
+
+STATIC void
+route_request_complete(route_requests_t * requests, route_request_t * req,
+		       int status, route_msg * msg_p)
+{
+    route_request_t	done = *req;
+
+    /* free the slot first so that the callback can issue new requests */
+    bzero(req, sizeof(*req));
+    requests->count--;
+    if (done.delete && status == ARP_RETURN_SUCCESS) {
+	struct rt_msghdr *	rtm = &msg_p->m_rtm;
+
+	/* turn the RTM_GET into an RTM_DELETE */
+	rtm->rtm_seq = arp_get_next_seq();
+	rtm->rtm_type = RTM_DELETE;
+	if (write(FDCalloutGetFD(requests->read_fd), rtm,
+		  rtm->rtm_msglen) < 0) {
+	    status = ARP_RETURN_FAILURE;
+	}
+    }
+    if (done.func != NULL) {
+	(*done.func)(done.arg1, done.arg2, status, msg_p);
+    }
+    return;
+}
+
+STATIC void
+route_watch_notify(route_requests_t * requests, route_msg * msg_p)
+{
+    struct rt_msghdr *		rtm = &msg_p->m_rtm;
+    struct sockaddr_in *	sin;
+
+    if ((rtm->rtm_flags & RTF_LLINFO) == 0
+	|| (rtm->rtm_addrs & RTA_DST) == 0) {
+	return;
+    }
+    /* ALIGN: m_space is aligned sufficiently */
+    sin = (struct sockaddr_in *)(void *)msg_p->m_space;
+    if (sin->sin_family != AF_INET) {
+	return;
+    }
+    for (int i = 0; i < ROUTE_WATCH_MAX; i++) {
+	route_watch_t *	watch = requests->watches + i;
+	int		status;
+
+	if (watch->id == 0
+	    || watch->iaddr.s_addr != sin->sin_addr.s_addr
+	    || (watch->if_index != 0 && watch->if_index != rtm->rtm_index)) {
+	    continue;
+	}
+	if (rtm->rtm_type == RTM_DELETE) {
+	    status = ARP_RETURN_HOST_NOT_FOUND;
+	}
+	else {
+	    status = arp_get_reply_check(msg_p, watch->iaddr);
+	}
+	(*watch->func)(watch->arg1, watch->arg2, status, msg_p);
+    }
+    return;
+}
+
+STATIC void
+route_requests_read(void * arg1, void * arg2)
+{
+    route_msg		msg;
+    ssize_t		n;
+    route_requests_t *	requests = S_route_requests;
+
+    /* drain everything that is queued, then go back to the runloop */
+    while ((n = read(FDCalloutGetFD(requests->read_fd), &msg, sizeof(msg)))
+	   > 0) {
+	route_request_t *	req;
+	struct rt_msghdr *	rtm = &msg.m_rtm;
+	int			status;
+
+	if (n < sizeof(*rtm) || rtm->rtm_version != RTM_VERSION) {
+	    continue;
+	}
+	switch (rtm->rtm_type) {
+	case RTM_ADD:
+	case RTM_CHANGE:
+	case RTM_DELETE:
+	    if (requests->watch_count != 0) {
+		route_watch_notify(requests, &msg);
+	    }
+	    continue;
+	default:
+	    break;
+	}
+	if (rtm->rtm_type != RTM_GET
+	    || rtm->rtm_pid != requests->pid
+	    || rtm->rtm_seq == 0) {
+	    continue;
+	}
+	req = requests->list + (rtm->rtm_seq & (ROUTE_REQUEST_MAX - 1));
+	if (req->seq != rtm->rtm_seq) {
+	    /* not ours, or the request timed out */
+	    continue;
+	}
+	if (rtm->rtm_errno != 0) {
+	    status = ARP_RETURN_HOST_NOT_FOUND;
+	}
+	else {
+	    status = arp_get_reply_check(&msg, req->iaddr);
+	}
+	route_request_complete(requests, req, status, &msg);
+    }
+    if (requests->read_fd != NULL) {
+	route_requests_schedule(requests);
+    }
+    return;
+}
+
+STATIC void
+route_requests_timer(void * arg1, void * arg2, void * arg3)
+{
+    CFAbsoluteTime	now = timer_get_current_time();
+    route_requests_t *	requests = S_route_requests;
+
+    if (requests->count == 0) {
+	if (requests->watch_count == 0) {
+	    FDCalloutRelease(&requests->read_fd);
+	}
+	return;
+    }
+    for (int i = 0; i < ROUTE_REQUEST_MAX; i++) {
+	route_request_t *	req = requests->list + i;
+
+	if (req->seq == 0) {
+	    continue;
+	}
+	if (req->deadline <= now) {
+	    route_request_complete(requests, req, ARP_RETURN_READ_FAILED,
+				   NULL);
+	    continue;
+	}
+	if (!req->written && !route_request_write(requests, req)) {
+	    route_request_complete(requests, req, ARP_RETURN_WRITE_FAILED,
+				   NULL);
+	}
+    }
+    route_requests_schedule(requests);
+    return;
+}
+
+STATIC int
+route_request_start(struct in_addr iaddr, int if_index, boolean_t delete,
+		    route_request_func_t * func, void * arg1, void * arg2)
+{
+    route_request_t *	req = NULL;
+    route_requests_t *	requests = route_requests_get();
+    int			seq = 0;
+
+    if (requests->count == ROUTE_REQUEST_MAX
+	|| !route_requests_open(requests)) {
+	return (-1);
+    }
+    /* choose a sequence number whose slot is free */
+    for (int i = 0; i < ROUTE_REQUEST_MAX; i++) {
+	seq = arp_get_next_seq();
+	if (seq == 0) {
+	    continue;
+	}
+	req = requests->list + (seq & (ROUTE_REQUEST_MAX - 1));
+	if (req->seq == 0) {
+	    break;
+	}
+	req = NULL;
+    }
+    if (req == NULL) {
+	return (-1);
+    }
+    req->seq = seq;
+    req->iaddr = iaddr;
+    req->if_index = if_index;
+    req->delete = delete;
+    req->written = FALSE;
+    req->deadline = timer_get_current_time() + ROUTE_REQUEST_TIMEOUT_SECS;
+    req->func = func;
+    req->arg1 = arg1;
+    req->arg2 = arg2;
+    requests->count++;
+    if (!route_request_write(requests, req)) {
+	bzero(req, sizeof(*req));
+	requests->count--;
+	return (-1);
+    }
+    route_requests_schedule(requests);
+    return (seq);
+}
+
+/*
+ * Function: route_request_arp_get
+ * Purpose:
+ *   Look up the ARP entry for iaddr without blocking. The callback is
+ *   invoked from the runloop with the arp_get() status, and the reply
+ *   when there is one. Returns the request's sequence number, or -1.
+ */
+PRIVATE_EXTERN int
+route_request_arp_get(struct in_addr iaddr, int if_index,
+		      route_request_func_t * func, void * arg1, void * arg2)
+{
+    return (route_request_start(iaddr, if_index, FALSE, func, arg1, arg2));
+}
+
+/*
+ * Function: route_request_arp_delete
+ * Purpose:
+ *   Non-blocking equivalent of arp_delete(); func may be NULL.
+ */
+PRIVATE_EXTERN int
+route_request_arp_delete(struct in_addr iaddr, int if_index,
+			 route_request_func_t * func, void * arg1, void * arg2)
+{
+    return (route_request_start(iaddr, if_index, TRUE, func, arg1, arg2));
+}
+
+PRIVATE_EXTERN void
+route_request_cancel(int seq)
+{
+    route_request_t *	req;
+    route_requests_t *	requests = S_route_requests;
+
+    if (requests == NULL || seq <= 0) {
+	return;
+    }
+    req = requests->list + (seq & (ROUTE_REQUEST_MAX - 1));
+    if (req->seq == seq) {
+	bzero(req, sizeof(*req));
+	requests->count--;
+	/* re-arm for the remaining requests, or the idle timeout */
+	route_requests_schedule(requests);
+    }
+    return;
+}
+
+typedef struct {
+    int				remaining;
+    int				count;
+    route_request_list_func_t *	func;
+    void *			arg1;
+    void *			arg2;
+    int				status[1];	/* variable length */
+} route_request_list_t;
+
+STATIC void
+route_request_list_callback(void * arg1, void * arg2, int status,
+			    route_msg * msg_p)
+{
+    route_request_list_t *	list = (route_request_list_t *)arg1;
+
+    list->status[(uintptr_t)arg2] = status;
+    if (--list->remaining == 0) {
+	(*list->func)(list->arg1, list->arg2, list->status, list->count);
+	free(list);
+    }
+    return;
+}
+
+/*
+ * Function: route_request_arp_get_list
+ * Purpose:
+ *   Issue independent ARP lookups back-to-back on the shared socket, and
+ *   invoke func once with every status when the last one completes.
+ *   Returns the number of lookups started; if none could be started, func
+ *   is never called.
+ */
+PRIVATE_EXTERN int
+route_request_arp_get_list(const struct in_addr * iaddrs, int count,
+			   int if_index, route_request_list_func_t * func,
+			   void * arg1, void * arg2)
+{
+    route_request_list_t *	list;
+    int				started = 0;
+
+    if (count <= 0) {
+	return (0);
+    }
+    list = malloc(offsetof(route_request_list_t, status)
+		  + sizeof(list->status[0]) * count);
+    list->count = count;
+    list->remaining = count + 1;	/* held until all are started */
+    list->func = func;
+    list->arg1 = arg1;
+    list->arg2 = arg2;
+    for (int i = 0; i < count; i++) {
+	if (route_request_arp_get(iaddrs[i], if_index,
+				  route_request_list_callback,
+				  list, (void *)(uintptr_t)i) < 0) {
+	    list->status[i] = ARP_RETURN_INTERNAL_ERROR;
+	    list->remaining--;
+	}
+	else {
+	    started++;
+	}
+    }
+    if (started == 0) {
+	free(list);
+    }
+    else if (--list->remaining == 0) {
+	/* not reached: replies are delivered from the runloop */
+	(*list->func)(list->arg1, list->arg2, list->status, list->count);
+	free(list);
+    }
+    return (started);
+}
+
+/*
+ * Function: route_request_watch_neighbor
+ * Purpose:
+ *   Invoke func whenever the kernel adds, changes, or removes the ARP
+ *   entry for iaddr. status is ARP_RETURN_SUCCESS if the message
+ *   carries a complete entry, ARP_RETURN_HOST_NOT_FOUND if the entry
+ *   went away. Returns an identifier for route_request_watch_cancel(),
+ *   or -1.
+ */
+PRIVATE_EXTERN int
+route_request_watch_neighbor(struct in_addr iaddr, int if_index,
+			     route_request_func_t * func,
+			     void * arg1, void * arg2)
+{
+    route_requests_t *	requests = route_requests_get();
+
+    if (requests->watch_count == ROUTE_WATCH_MAX
+	|| !route_requests_open(requests)) {
+	return (-1);
+    }
+    for (int i = 0; i < ROUTE_WATCH_MAX; i++) {
+	route_watch_t *	watch = requests->watches + i;
+
+	if (watch->id != 0) {
+	    continue;
+	}
+	if (++requests->watch_last_id <= 0) {
+	    requests->watch_last_id = 1;
+	}
+	watch->id = requests->watch_last_id;
+	watch->iaddr = iaddr;
+	watch->if_index = if_index;
+	watch->func = func;
+	watch->arg1 = arg1;
+	watch->arg2 = arg2;
+	requests->watch_count++;
+	route_requests_schedule(requests);
+	return (watch->id);
+    }
+    return (-1);
+}
+
+PRIVATE_EXTERN void
+route_request_watch_cancel(int id)
+{
+    route_requests_t *	requests = S_route_requests;
+
+    if (requests == NULL || id <= 0) {
+	return;
+    }
+    for (int i = 0; i < ROUTE_WATCH_MAX; i++) {
+	route_watch_t *	watch = requests->watches + i;
+
+	if (watch->id == id) {
+	    bzero(watch, sizeof(*watch));
+	    requests->watch_count--;
+	    if (requests->watch_count == 0 && requests->count == 0) {
+		/* start the idle timer */
+		route_requests_schedule(requests);
+	    }
+	    break;
+	}
+    }
+    return;
+}
+
+#if TEST_ROUTE_REQUEST
+#include <arpa/inet.h>
+
+STATIC void
+test_list_callback(void * arg1, void * arg2, const int * status, int count)
+{
+    const struct in_addr *	iaddrs = (const struct in_addr *)arg1;
+
+    for (int i = 0; i < count; i++) {
+	printf(IP_FORMAT ": %s\n", IP_LIST(iaddrs + i),
+	       arp_strerror(status[i]));
+    }
+    exit(0);
+}
+
+int
+main(int argc, char * argv[])
+{
+    int			count = argc - 1;
+    struct in_addr *	iaddrs;
+
+    if (count == 0) {
+	fprintf(stderr, "usage: %s <ip> [ <ip> ... ]\n", argv[0]);
+	exit(1);
+    }
+    iaddrs = malloc(sizeof(*iaddrs) * count);
+    for (int i = 0; i < count; i++) {
+	if (inet_aton(argv[i + 1], iaddrs + i) == 0) {
+	    fprintf(stderr, "invalid IP address %s\n", argv[i + 1]);
+	    exit(1);
+	}
+    }
+    if (route_request_arp_get_list(iaddrs, count, 0, test_list_callback,
+				   iaddrs, NULL) == 0) {
+	fprintf(stderr, "failed to start requests\n");
+	exit(1);
+    }
+    CFRunLoopRun();
+    exit(0);
+    return (0);
+}
+#endif /* TEST_ROUTE_REQUEST */
@@ -39,6 +39,7 @@
 #include <net/route.h>
 #include <netinet/in.h>
 #include <mach/boolean.h>
+#include "arp.h"
 
 boolean_t
 subnet_route_add(struct in_addr gateway, struct in_addr netaddr, 
@@ -48,4 +49,41 @@ void
 flush_routes(int if_index, const struct in_addr ip,
 	     const struct in_addr broadcast);
 
+/*
+ * Type: route_request_func_t
+ * Purpose:
+ *   Called when an asynchronous routing socket request completes.
+ *   status is one of the ARP_RETURN_* values; msg_p is the reply, or NULL
+ *   if there wasn't one.
+ */
+typedef void (route_request_func_t)(void * arg1, void * arg2, int status,
+				    route_msg * msg_p);
+
+typedef void (route_request_list_func_t)(void * arg1, void * arg2,
+					 const int * status, int count);
+
+int
+route_request_arp_get(struct in_addr iaddr, int if_index,
+		      route_request_func_t * func, void * arg1, void * arg2);
+
+int
+route_request_arp_delete(struct in_addr iaddr, int if_index,
+			 route_request_func_t * func, void * arg1, void * arg2);
+
+int
+route_request_arp_get_list(const struct in_addr * iaddrs, int count,
+			   int if_index, route_request_list_func_t * func,
+			   void * arg1, void * arg2);
+
+void
+route_request_cancel(int seq);
+
+int
+route_request_watch_neighbor(struct in_addr iaddr, int if_index,
+			     route_request_func_t * func,
+			     void * arg1, void * arg2);
+
+void
+route_request_watch_cancel(int id);
+
 #endif /* _S_RTUTIL_H */
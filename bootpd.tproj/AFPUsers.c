@@ -34,45 +34,43 @@
 #include <pwd.h>
 #include <grp.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include <CoreFoundation/CoreFoundation.h>
+#include <dispatch/dispatch.h>
+#if !NO_OPEN_DIRECTORY
 #include <SystemConfiguration/SCPrivate.h>	// for _SC_cfstring_to_cstring
 #include <OpenDirectory/OpenDirectory.h>
+#endif /* !NO_OPEN_DIRECTORY */
 
 #include "netinfo.h"
 #include "NICache.h"
 #include "NICachePrivate.h"
 #include "AFPUsers.h"
+#include "afp.h"
 #include "NetBootServer.h"
 #include "cfutil.h"
+#include "memaccount.h"
 #include "mylog.h"
 
-static ODRecordRef
-groupRecordCopy(ODNodeRef node, const char * group)
-{
-    CFArrayRef 		attribs;
-    CFStringRef		group_cf;
-    ODRecordRef		group_record = NULL;
-
-    attribs = CFArrayCreate(NULL,
-			    (CFTypeRef *)&kODAttributeTypeStandardOnly,
-			    1,
-			    &kCFTypeArrayCallBacks);
-    group_cf = CFStringCreateWithCString(NULL, group, kCFStringEncodingUTF8);
-    group_record = ODNodeCopyRecord(node, kODRecordTypeGroups,
-				    group_cf, attribs, NULL);
-    CFRelease(group_cf);
-    CFRelease(attribs);
-    return (group_record);
-}
-
 #define kAFPUserODRecord		CFSTR("record")
+#define kAFPUserName			CFSTR("name")
 #define kAFPUserUID			CFSTR("uid")
 #define kAFPUserPassword		CFSTR("passwd")
 #define kAFPUserDatePasswordLastSet	CFSTR("setdate")
+#define kAFPUserPasswordHandedOut	CFSTR("handedout")
+#define kAFPUserPasswordFresh		CFSTR("fresh")
+#define kAFPUserPasswordPending		CFSTR("pending")
+#define kAFPUserPendingHandedOut	CFSTR("pendinghandedout")
 
 #define	BSDPD_CREATOR		"bsdpd"
 #define MAX_RETRY		5
 
+/* how far past the start uid to look for free uids */
+#define AFP_UID_SCAN_LIMIT	65536
+
+/* how many users to create per call to create_users */
+#define AFP_USER_CREATE_BATCH	32
+
 #define CHARSET_LOWERCASE		"abcdefghijklmnopqrstuvwxyz"
 #define CHARSET_LOWERCASE_LENGTH	(sizeof(CHARSET_LOWERCASE) - 1)
 #define CHARSET_UPPERCASE		"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -124,80 +122,186 @@ generate_random_password(char * passwd, size_t passwd_len)
     }
 }
 
-static uid_t
-uid_from_odrecord(ODRecordRef record)
+/*
+ * Function: AFPUser_allocator
+ * Purpose:
+ *   The allocator for the user dictionaries, which counts them under
+ *   kMemAccountDirectory.  The users are created, changed and released
+ *   on the owning queue only.
+ */
+static void *
+AFPUser_allocate(CFIndex size, CFOptionFlags hint, void * info)
 {
-    uid_t		uid = -2;
-    CFArrayRef		values	= NULL;
+    return (memaccount_malloc(kMemAccountDirectory, size));
+}
 
-    values = ODRecordCopyValues(record, CFSTR(kDS1AttrUniqueID), NULL);
-    if ((values != NULL) && (CFArrayGetCount(values) > 0)) {
-	char		buf[64];
-	char *		end;
-	CFStringRef	uidStr;
-	unsigned long	val;
+static void *
+AFPUser_reallocate(void * ptr, CFIndex size, CFOptionFlags hint, void * info)
+{
+    return (memaccount_realloc(kMemAccountDirectory, ptr, size));
+}
 
-	uidStr = CFArrayGetValueAtIndex(values, 0);
-	(void) _SC_cfstring_to_cstring(uidStr, buf, sizeof(buf),
-				       kCFStringEncodingASCII);
-	errno = 0;
-	val = strtoul(buf, &end, 0);
-	if ((buf[0] != '\0') && (*end == '\0') && (errno == 0)) {
-	    uid = (uid_t)val;
-	}
+static void
+AFPUser_deallocate(void * ptr, void * info)
+{
+    memaccount_free(kMemAccountDirectory, ptr);
+    return;
+}
+
+static CFAllocatorRef
+AFPUser_allocator(void)
+{
+    static CFAllocatorRef	allocator;
+
+    if (allocator == NULL) {
+	CFAllocatorContext	context;
+
+	bzero(&context, sizeof(context));
+	context.allocate = AFPUser_allocate;
+	context.reallocate = AFPUser_reallocate;
+	context.deallocate = AFPUser_deallocate;
+	allocator = CFAllocatorCreate(NULL, &context);
     }
-    my_CFRelease(&values);
-    return (uid);
+    return (allocator);
 }
 
 static AFPUserRef
-AFPUser_create(ODRecordRef record)
+AFPUser_create(CFTypeRef record, CFStringRef name, uid_t uid)
 {
     AFPUserRef		user;
-    uid_t		uid;
     CFNumberRef 	uid_cf;
 
-    user = CFDictionaryCreateMutable(NULL, 0,
+    user = CFDictionaryCreateMutable(AFPUser_allocator(), 0,
 				     &kCFTypeDictionaryKeyCallBacks,
 				     &kCFTypeDictionaryValueCallBacks);
     CFDictionarySetValue(user, kAFPUserODRecord, record);
-    uid = uid_from_odrecord(record);
-    uid_cf = CFNumberCreate(NULL, kCFNumberSInt32Type, &uid);
+    CFDictionarySetValue(user, kAFPUserName, name);
+    uid_cf = CFNumberCreate(AFPUser_allocator(), kCFNumberSInt32Type, &uid);
     CFDictionarySetValue(user, kAFPUserUID, uid_cf);
     CFRelease(uid_cf);
     return (user);
 }
 
+static uid_t
+uid_from_string(CFStringRef str)
+{
+    char		buf[64];
+    char *		end;
+    uid_t		uid = -2;
+    unsigned long	val;
+
+    if (CFStringGetCString(str, buf, sizeof(buf), kCFStringEncodingASCII)) {
+	errno = 0;
+	val = strtoul(buf, &end, 0);
+	if ((buf[0] != '\0') && (*end == '\0') && (errno == 0)) {
+	    uid = (uid_t)val;
+	}
+    }
+    return (uid);
+}
+
+static void
+mark_taken_uid(uid_t uid, uid_t start, uint32_t count, uint8_t * taken)
+{
+    if (uid >= start && (uid - start) < count) {
+	taken[uid - start] = 1;
+    }
+    return;
+}
+
 void
-AFPUserList_free(AFPUserListRef users)
+AFPDirectoryFree(AFPDirectoryRef * dir_p)
 {
-    my_CFRelease(&users->node);
-    my_CFRelease(&users->list);
-    my_CFRelease(&users->afp_access_group);
-    bzero(users, sizeof(*users));
+    AFPDirectoryRef	dir = *dir_p;
+
+    if (dir != NULL) {
+	(*dir->ops->free)(dir);
+	*dir_p = NULL;
+    }
+    return;
 }
 
-Boolean
-AFPUserList_init(AFPUserListRef users)
+#if !NO_OPEN_DIRECTORY
+
+/**
+ ** Open Directory backend
+ **/
+typedef struct {
+    struct AFPDirectory		dir;
+    ODNodeRef			node;
+    ODRecordRef			afp_access_group;
+} AFPDirectoryOD, * AFPDirectoryODRef;
+
+#define AFP_ACCESS_GROUP	"com.apple.access_afp"
+
+static ODRecordRef
+groupRecordCopy(ODNodeRef node, const char * group)
 {
-    CFErrorRef	error = NULL;
-    int		i;
-    int		n;
-    CFArrayRef	results;
-    ODQueryRef	query;
+    CFArrayRef 		attribs;
+    CFStringRef		group_cf;
+    ODRecordRef		group_record = NULL;
 
-    bzero(users, sizeof(*users));
+    attribs = CFArrayCreate(NULL,
+			    (CFTypeRef *)&kODAttributeTypeStandardOnly,
+			    1,
+			    &kCFTypeArrayCallBacks);
+    group_cf = CFStringCreateWithCString(NULL, group, kCFStringEncodingUTF8);
+    group_record = ODNodeCopyRecord(node, kODRecordTypeGroups,
+				    group_cf, attribs, NULL);
+    CFRelease(group_cf);
+    CFRelease(attribs);
+    return (group_record);
+}
+
+static uid_t
+uid_from_odrecord(ODRecordRef record)
+{
+    uid_t		uid = -2;
+    CFArrayRef		values	= NULL;
+
+    values = ODRecordCopyValues(record, CFSTR(kDS1AttrUniqueID), NULL);
+    if ((values != NULL) && (CFArrayGetCount(values) > 0)) {
+	CFStringRef	uidStr;
+
+	uidStr = CFArrayGetValueAtIndex(values, 0);
+	if (isA_CFString(uidStr) != NULL) {
+	    uid = uid_from_string(uidStr);
+	}
+    }
+    my_CFRelease(&values);
+    return (uid);
+}
+
+static void
+S_od_add_to_access_group(AFPDirectoryODRef od, ODRecordRef record)
+{
+    CFErrorRef	error = NULL;
 
-    users->node = ODNodeCreateWithNodeType(NULL, kODSessionDefault, 
-					   kODNodeTypeLocalNodes, &error);
-    if (users->node == NULL) {
+    if (od->afp_access_group == NULL) {
+	return;
+    }
+    if (!ODRecordAddMember(od->afp_access_group, record, &error)) {
 	my_log(LOG_NOTICE,
-	       "AFPUserList_init: ODNodeCreateWithNodeType() failed");
-	goto failed;
+	       "AFPUsers: failed to add user to group %s, %ld",
+	       AFP_ACCESS_GROUP, CFErrorGetCode(error));
+	my_CFRelease(&error);
     }
+    return;
+}
+
+static CFArrayRef
+S_od_copy_users(AFPDirectoryRef dir)
+{
+    CFErrorRef		error = NULL;
+    int			i;
+    CFMutableArrayRef	list;
+    int			n;
+    AFPDirectoryODRef	od = (AFPDirectoryODRef)dir;
+    ODQueryRef		query;
+    CFArrayRef		results;
 
     query = ODQueryCreateWithNode(NULL,
-				  users->node,			// inNode
+				  od->node,			// inNode
 				  CFSTR(kDSStdRecordTypeUsers),	// inRecordTypeOrList
 				  CFSTR(NIPROP__CREATOR),	// inAttribute
 				  kODMatchEqualTo,		// inMatchType
@@ -208,90 +312,82 @@ AFPUserList_init(AFPUserListRef users)
     if (query == NULL) {
 	my_log(LOG_NOTICE, "AFPUserList_init: ODQueryCreateWithNode() failed");
 	my_CFRelease(&error);
-	goto failed;
+	return (NULL);
     }
-
+    dir->round_trips++;
     results = ODQueryCopyResults(query, FALSE, &error);
     CFRelease(query);
     if (results == NULL) {
 	my_log(LOG_NOTICE, "AFPUserList_init: ODQueryCopyResults() failed");
 	my_CFRelease(&error);
-	goto failed;
+	return (NULL);
     }
-#define AFP_ACCESS_GROUP	"com.apple.access_afp"
-    users->afp_access_group = groupRecordCopy(users->node, AFP_ACCESS_GROUP);
-    if (users->afp_access_group == NULL) {
-	my_log(LOG_NOTICE, "AFPUserList_init: group %s does not exist",
-	       AFP_ACCESS_GROUP);
-    }
-
-    users->list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
-    n = CFArrayGetCount(results);
+    list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    n = (int)CFArrayGetCount(results);
     for (i = 0; i < n; i++) {
 	ODRecordRef		record;
 	AFPUserRef		user;
 
 	record = (ODRecordRef)CFArrayGetValueAtIndex(results, i);
-	user = AFPUser_create(record);
-	if (users->afp_access_group != NULL) {
-	    if (!ODRecordAddMember(users->afp_access_group,
-				   record, &error)) {
-		my_log(LOG_NOTICE,
-		       "AFPUsers: failed to add user to group %s, %ld",
-		       AFP_ACCESS_GROUP, CFErrorGetCode(error));
-		my_CFRelease(&error);
-	    }
-	}
-
-	CFArrayAppendValue(users->list, user);
+	user = AFPUser_create(record, ODRecordGetRecordName(record),
+			      uid_from_odrecord(record));
+	S_od_add_to_access_group(od, record);
+	CFArrayAppendValue(list, user);
 	CFRelease(user);
     }
     CFRelease(results);
-    return (TRUE);
-
- failed:
-    AFPUserList_free(users);
-    return (FALSE);
+    return (list);
 }
 
-static __inline__ Boolean
-S_uid_taken(AFPUserListRef users, CFStringRef uid)
+/*
+ * Function: S_od_get_taken_uids
+ * Purpose:
+ *   Retrieve the UniqueID of every user record in a single query, and
+ *   mark the ones that fall in the requested range.
+ */
+static Boolean
+S_od_get_taken_uids(AFPDirectoryRef dir, uid_t start, uint32_t count,
+		    uint8_t * taken)
 {
-    CFErrorRef	error = NULL;
-    Boolean	taken	= FALSE;
-    ODQueryRef	query;
-    CFArrayRef	results;
+    CFErrorRef		error = NULL;
+    int			i;
+    int			n;
+    AFPDirectoryODRef	od = (AFPDirectoryODRef)dir;
+    ODQueryRef		query;
+    CFArrayRef		results;
 
     query = ODQueryCreateWithNode(NULL,
-				  users->node,			// inNode
+				  od->node,			// inNode
 				  CFSTR(kDSStdRecordTypeUsers),	// inRecordTypeOrList
-				  CFSTR(kDS1AttrUniqueID),	// inAttribute
-				  kODMatchEqualTo,		// inMatchType
-				  uid,				// inQueryValueOrList
-				  NULL,				// inReturnAttributeOrList
+				  NULL,				// inAttribute
+				  kODMatchAny,			// inMatchType
+				  NULL,				// inQueryValueOrList
+				  CFSTR(kDS1AttrUniqueID),	// inReturnAttributeOrList
 				  0,				// inMaxResults
 				  &error);
     if (query == NULL) {
-	my_log(LOG_NOTICE, "S_uid_taken: ODQueryCreateWithNode() failed");
+	my_log(LOG_NOTICE,
+	       "S_od_get_taken_uids: ODQueryCreateWithNode() failed");
 	my_CFRelease(&error);
-	goto failed;
+	return (FALSE);
     }
-
+    dir->round_trips++;
     results = ODQueryCopyResults(query, FALSE, &error);
     CFRelease(query);
     if (results == NULL) {
-	my_log(LOG_NOTICE, "S_uid_taken: ODQueryCopyResults() failed");
+	my_log(LOG_NOTICE, "S_od_get_taken_uids: ODQueryCopyResults() failed");
 	my_CFRelease(&error);
-	goto failed;
+	return (FALSE);
     }
+    n = (int)CFArrayGetCount(results);
+    for (i = 0; i < n; i++) {
+	ODRecordRef	record;
 
-    if (CFArrayGetCount(results) > 0) {
-	taken = TRUE;
+	record = (ODRecordRef)CFArrayGetValueAtIndex(results, i);
+	mark_taken_uid(uid_from_odrecord(record), start, count, taken);
     }
     CFRelease(results);
-
- failed:
-    return (taken);
+    return (TRUE);
 }
 
 static void
@@ -307,21 +403,24 @@ _myCFDictionarySetStringValueAsArray(CFMutableDictionaryRef dict,
     return;
 }
 
-Boolean
-AFPUserList_create(AFPUserListRef users, gid_t gid,
-		   uid_t start, int count)
+/*
+ * Function: S_od_create_users
+ * Purpose:
+ *   Create the batch of user records back-to-back. The record returned by
+ *   ODNodeCreateRecord() already carries the attributes we supplied, so
+ *   there's no need to synchronize it before using it.
+ */
+static int
+S_od_create_users(AFPDirectoryRef dir, gid_t gid,
+		  const AFPUserSpec * specs, int count,
+		  CFMutableArrayRef created)
 {
     CFMutableDictionaryRef	attributes;
-    char			buf[256];
+    char			buf[64];
     CFStringRef			gidStr;
-    int				need;
-    Boolean			ret = FALSE;
-    uid_t			scan;
-
-    need = count - CFArrayGetCount(users->list);
-    if (need <= 0) {
-	return (TRUE);
-    }
+    int				i;
+    int				n_created = 0;
+    AFPDirectoryODRef		od = (AFPDirectoryODRef)dir;
 
     attributes = CFDictionaryCreateMutable(NULL, 0,
 					   &kCFTypeDictionaryKeyCallBacks,
@@ -329,7 +428,6 @@ AFPUserList_create(AFPUserListRef users, gid_t gid,
     _myCFDictionarySetStringValueAsArray(attributes,
 					 CFSTR(kDS1AttrUserShell),
 					 CFSTR("/usr/bin/false"));
-
     snprintf(buf, sizeof(buf), "%d", gid);
     gidStr = CFStringCreateWithCString(NULL, buf, kCFStringEncodingASCII);
     _myCFDictionarySetStringValueAsArray(attributes,
@@ -342,141 +440,881 @@ AFPUserList_create(AFPUserListRef users, gid_t gid,
     _myCFDictionarySetStringValueAsArray(attributes,
 					 CFSTR(NIPROP__CREATOR),
 					 CFSTR(BSDPD_CREATOR));
-
-    for (scan = start; need > 0; scan++) {
-	CFErrorRef	error	= NULL;
-	ODRecordRef	record	= NULL;
+    for (i = 0; i < count; i++) {
+	CFErrorRef	error = NULL;
+	ODRecordRef	record;
 	CFStringRef	uidStr;
-	CFDictionaryRef	user;
-	CFStringRef	userStr	= NULL;
+	AFPUserRef	user;
 
-	snprintf(buf, sizeof(buf), "%d", scan);
+	snprintf(buf, sizeof(buf), "%d", specs[i].uid);
 	uidStr = CFStringCreateWithCString(NULL, buf, kCFStringEncodingASCII);
-	if (S_uid_taken(users, uidStr)) {
-	    goto nextUid;
-	}
 	_myCFDictionarySetStringValueAsArray(attributes,
 					     CFSTR(kDS1AttrUniqueID),
 					     uidStr);
-	snprintf(buf, sizeof(buf), NETBOOT_USER_PREFIX "%03d", scan);
-	userStr = CFStringCreateWithCString(NULL, buf, kCFStringEncodingASCII);
-
+	CFRelease(uidStr);
 	_myCFDictionarySetStringValueAsArray(attributes,
 					     CFSTR(kDS1AttrDistinguishedName),
-					     userStr);
-	record = ODNodeCreateRecord(users->node,
+					     specs[i].name);
+	dir->round_trips++;
+	record = ODNodeCreateRecord(od->node,
 				    CFSTR(kDSStdRecordTypeUsers),
-				    userStr,
+				    specs[i].name,
 				    attributes,
 				    &error);
 	if (record == NULL) {
 	    my_log(LOG_NOTICE,
 		   "AFPUserList_create: ODNodeCreateRecord() failed");
-	    goto nextUid;
-	}
-
-	if (!ODRecordSynchronize(record, &error)) {
-	    my_log(LOG_NOTICE,
-		   "AFPUserList_create: ODRecordSynchronize() failed");
-	    goto nextUid;
-	}
-	user = AFPUser_create(record);
-	if (users->afp_access_group != NULL) {
-	    if (!ODRecordAddMember(users->afp_access_group,
-				   record, &error)) {
-		my_log(LOG_NOTICE,
-		       "AFPUsers: failed to add user to group %s, %ld",
-		       AFP_ACCESS_GROUP, CFErrorGetCode(error));
-	    }
 	    my_CFRelease(&error);
+	    continue;
 	}
-	CFArrayAppendValue(users->list, user);
+	S_od_add_to_access_group(od, record);
+	user = AFPUser_create(record, specs[i].name, specs[i].uid);
+	CFArrayAppendValue(created, user);
 	CFRelease(user);
-	need--;
-
-     nextUid:
-	my_CFRelease(&record);
-	my_CFRelease(&uidStr);
-	my_CFRelease(&userStr);
-	if (error != NULL) {
-	    my_CFRelease(&error);
-	    goto done;
-	}
+	CFRelease(record);
+	n_created++;
     }
+    CFRelease(attributes);
+    return (n_created);
+}
 
-    ret = TRUE;
+static Boolean
+S_od_set_password(AFPDirectoryRef dir, CFTypeRef record, CFStringRef password)
+{
+    dir->round_trips++;
+    return (ODRecordChangePassword((ODRecordRef)record, NULL, password, NULL));
+}
 
- done:
-    my_CFRelease(&attributes);
-    return (ret);
+static void
+S_od_free(AFPDirectoryRef dir)
+{
+    AFPDirectoryODRef	od = (AFPDirectoryODRef)dir;
+
+    my_CFRelease(&od->node);
+    my_CFRelease(&od->afp_access_group);
+    free(od);
+    return;
 }
 
-AFPUserRef
-AFPUserList_lookup(AFPUserListRef users, CFStringRef afp_user)
+static const AFPDirectoryOps	S_od_ops = {
+    S_od_copy_users,
+    S_od_get_taken_uids,
+    S_od_create_users,
+    S_od_set_password,
+    S_od_free,
+};
+
+AFPDirectoryRef
+AFPDirectoryCreateOpenDirectory(void)
 {
-    int		i;
-    int		n;
+    CFErrorRef		error = NULL;
+    AFPDirectoryODRef	od;
+
+    od = (AFPDirectoryODRef)calloc(1, sizeof(*od));
+    od->dir.ops = &S_od_ops;
+    od->node = ODNodeCreateWithNodeType(NULL, kODSessionDefault, 
+					kODNodeTypeLocalNodes, &error);
+    if (od->node == NULL) {
+	my_log(LOG_NOTICE,
+	       "AFPUserList_init: ODNodeCreateWithNodeType() failed");
+	my_CFRelease(&error);
+	free(od);
+	return (NULL);
+    }
+    od->afp_access_group = groupRecordCopy(od->node, AFP_ACCESS_GROUP);
+    if (od->afp_access_group == NULL) {
+	my_log(LOG_NOTICE, "AFPUserList_init: group %s does not exist",
+	       AFP_ACCESS_GROUP);
+    }
+    return (&od->dir);
+}
 
-    n = CFArrayGetCount(users->list);
-    for (i = 0; i < n; i++) {
-	CFStringRef	name;
-	AFPUserRef	user;
-	ODRecordRef	record;
+#endif /* !NO_OPEN_DIRECTORY */
 
-	user = (AFPUserRef)CFArrayGetValueAtIndex(users->list, i);
-	record = (ODRecordRef)CFDictionaryGetValue(user, kAFPUserODRecord);
-	name = ODRecordGetRecordName(record);
-	if (CFEqual(name, afp_user)) {
-		return (user);
-	}
+/**
+ ** In-memory backend
+ ** - a stand-in for the directory, used for testing
+ ** - each operation optionally sleeps to simulate the round-trip latency
+ **/
+typedef struct {
+    struct AFPDirectory		dir;
+    pthread_mutex_t		lock;
+    CFMutableDictionaryRef	records;	/* name -> record */
+    useconds_t			latency;
+} AFPDirectoryMemory, * AFPDirectoryMemoryRef;
+
+static void
+S_memory_round_trip(AFPDirectoryMemoryRef mem)
+{
+    mem->dir.round_trips++;
+    if (mem->latency != 0) {
+	usleep(mem->latency);
     }
+    return;
+}
+
+static CFMutableDictionaryRef
+S_memory_record_create(CFStringRef name, uid_t uid, Boolean netboot_user)
+{
+    CFMutableDictionaryRef	record;
+    CFNumberRef			uid_cf;
 
-    return (NULL);
+    record = CFDictionaryCreateMutable(NULL, 0,
+				       &kCFTypeDictionaryKeyCallBacks,
+				       &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(record, kAFPUserName, name);
+    uid_cf = CFNumberCreate(NULL, kCFNumberSInt32Type, &uid);
+    CFDictionarySetValue(record, kAFPUserUID, uid_cf);
+    CFRelease(uid_cf);
+    if (netboot_user) {
+	CFDictionarySetValue(record, CFSTR(NIPROP__CREATOR),
+			     CFSTR(BSDPD_CREATOR));
+    }
+    return (record);
 }
 
-uid_t
-AFPUser_get_uid(AFPUserRef user)
+static uid_t
+S_memory_record_get_uid(CFDictionaryRef record)
 {
     uid_t	uid = -2;
 
-    CFNumberGetValue(CFDictionaryGetValue(user, kAFPUserUID),
+    CFNumberGetValue(CFDictionaryGetValue(record, kAFPUserUID),
 		     kCFNumberSInt32Type, &uid);
     return (uid);
 }
 
-char *
-AFPUser_get_user(AFPUserRef user, char *buf, size_t buf_len)
+static CFArrayRef
+S_memory_copy_users(AFPDirectoryRef dir)
 {
-    CFStringRef	name;
-    ODRecordRef	record;
+    CFIndex			count;
+    int				i;
+    CFMutableArrayRef		list;
+    AFPDirectoryMemoryRef	mem = (AFPDirectoryMemoryRef)dir;
+    CFDictionaryRef *		values;
+
+    S_memory_round_trip(mem);
+    list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    count = CFDictionaryGetCount(mem->records);
+    values = (CFDictionaryRef *)malloc(sizeof(*values) * (count + 1));
+    CFDictionaryGetKeysAndValues(mem->records, NULL, (const void * *)values);
+    for (i = 0; i < count; i++) {
+	CFDictionaryRef		record = values[i];
+	AFPUserRef		user;
 
-    record = (ODRecordRef)CFDictionaryGetValue(user, kAFPUserODRecord);
-    name = ODRecordGetRecordName(record);
-    (void) _SC_cfstring_to_cstring(name, buf, buf_len, kCFStringEncodingASCII);
-    return buf;
+	if (CFDictionaryContainsKey(record, CFSTR(NIPROP__CREATOR)) == FALSE) {
+	    continue;
+	}
+	user = AFPUser_create(record,
+			      CFDictionaryGetValue(record, kAFPUserName),
+			      S_memory_record_get_uid(record));
+	CFArrayAppendValue(list, user);
+	CFRelease(user);
+    }
+    free(values);
+    return (list);
 }
 
-#define AFPUSER_PASSWORD_CHANGE_INTERVAL	((int)8)
-/*
- * Function: AFPUser_set_random_password
- * Purpose:
- *   Set a random password for the user and returns it in passwd.
- *   Do not change the password again until AFPUSER_PASSWORD_CHANGE_INTERVAL
- *   has elapsed.  This overcomes the problem where every client
- *   request packet is duplicated. In that case, the client tries to use
- *   a password that subsequently gets changed when the duplicate arrives.
- */
-Boolean
-AFPUser_set_random_password(AFPUserRef user,
-			    char * passwd, size_t passwd_len)
+static Boolean
+S_memory_get_taken_uids(AFPDirectoryRef dir, uid_t start, uint32_t count,
+			uint8_t * taken)
 {
-    CFDateRef		last_set;
-    Boolean		ok = TRUE;
+    CFIndex			n;
+    int				i;
+    AFPDirectoryMemoryRef	mem = (AFPDirectoryMemoryRef)dir;
+    CFDictionaryRef *		values;
+
+    S_memory_round_trip(mem);
+    n = CFDictionaryGetCount(mem->records);
+    values = (CFDictionaryRef *)malloc(sizeof(*values) * (n + 1));
+    CFDictionaryGetKeysAndValues(mem->records, NULL, (const void * *)values);
+    for (i = 0; i < n; i++) {
+	mark_taken_uid(S_memory_record_get_uid(values[i]), start, count,
+		       taken);
+    }
+    free(values);
+    return (TRUE);
+}
+
+static int
+S_memory_create_users(AFPDirectoryRef dir, gid_t gid,
+		      const AFPUserSpec * specs, int count,
+		      CFMutableArrayRef created)
+{
+    int				i;
+    AFPDirectoryMemoryRef	mem = (AFPDirectoryMemoryRef)dir;
+    int				n_created = 0;
+
+    /* the whole batch is submitted at once */
+    S_memory_round_trip(mem);
+    for (i = 0; i < count; i++) {
+	CFMutableDictionaryRef	record;
+	AFPUserRef		user;
+
+	if (CFDictionaryContainsKey(mem->records, specs[i].name)) {
+	    continue;
+	}
+	record = S_memory_record_create(specs[i].name, specs[i].uid, TRUE);
+	CFDictionarySetValue(mem->records, specs[i].name, record);
+	user = AFPUser_create(record, specs[i].name, specs[i].uid);
+	CFArrayAppendValue(created, user);
+	CFRelease(user);
+	CFRelease(record);
+	n_created++;
+    }
+    return (n_created);
+}
+
+/*
+ * Function: S_memory_set_password
+ * Purpose:
+ *   Called from the rotation queue, so serialize access to the record
+ *   against the test code inspecting it.
+ */
+static Boolean
+S_memory_set_password(AFPDirectoryRef dir, CFTypeRef record,
+		      CFStringRef password)
+{
+    AFPDirectoryMemoryRef	mem = (AFPDirectoryMemoryRef)dir;
+
+    S_memory_round_trip(mem);
+    pthread_mutex_lock(&mem->lock);
+    CFDictionarySetValue((CFMutableDictionaryRef)record, kAFPUserPassword,
+			 password);
+    pthread_mutex_unlock(&mem->lock);
+    return (TRUE);
+}
+
+static void
+S_memory_free(AFPDirectoryRef dir)
+{
+    AFPDirectoryMemoryRef	mem = (AFPDirectoryMemoryRef)dir;
+
+    my_CFRelease(&mem->records);
+    pthread_mutex_destroy(&mem->lock);
+    free(mem);
+    return;
+}
+
+static const AFPDirectoryOps	S_memory_ops = {
+    S_memory_copy_users,
+    S_memory_get_taken_uids,
+    S_memory_create_users,
+    S_memory_set_password,
+    S_memory_free,
+};
+
+AFPDirectoryRef
+AFPDirectoryCreateMemory(void)
+{
+    AFPDirectoryMemoryRef	mem;
+
+    mem = (AFPDirectoryMemoryRef)calloc(1, sizeof(*mem));
+    mem->dir.ops = &S_memory_ops;
+    pthread_mutex_init(&mem->lock, NULL);
+    mem->records = CFDictionaryCreateMutable(NULL, 0,
+					     &kCFTypeDictionaryKeyCallBacks,
+					     &kCFTypeDictionaryValueCallBacks);
+    return (&mem->dir);
+}
+
+void
+AFPDirectoryMemorySetLatency(AFPDirectoryRef dir, useconds_t latency)
+{
+    ((AFPDirectoryMemoryRef)dir)->latency = latency;
+    return;
+}
+
+Boolean
+AFPDirectoryMemoryAddUser(AFPDirectoryRef dir, CFStringRef name, uid_t uid,
+			  Boolean netboot_user)
+{
+    AFPDirectoryMemoryRef	mem = (AFPDirectoryMemoryRef)dir;
+    CFMutableDictionaryRef	record;
+
+    if (CFDictionaryContainsKey(mem->records, name)) {
+	return (FALSE);
+    }
+    record = S_memory_record_create(name, uid, netboot_user);
+    CFDictionarySetValue(mem->records, name, record);
+    CFRelease(record);
+    return (TRUE);
+}
+
+/**
+ ** AFPUserList
+ **/
+static void
+S_user_list_add(AFPUserListRef users, AFPUserRef user)
+{
+    CFArrayAppendValue(users->list, user);
+    CFDictionarySetValue(users->by_name,
+			 CFDictionaryGetValue(user, kAFPUserName), user);
+    CFDictionarySetValue(users->by_uid,
+			 CFDictionaryGetValue(user, kAFPUserUID), user);
+    return;
+}
+
+static void
+S_stop_password_rotation(AFPUserListRef users);
+
+void
+AFPUserList_free(AFPUserListRef users)
+{
+    S_stop_password_rotation(users);
+    AFPDirectoryFree(&users->dir);
+    my_CFRelease(&users->list);
+    my_CFRelease(&users->by_name);
+    my_CFRelease(&users->by_uid);
+    bzero(users, sizeof(*users));
+}
+
+Boolean
+AFPUserList_init_with_directory(AFPUserListRef users, AFPDirectoryRef dir)
+{
+    int		i;
+    int		n;
+    CFArrayRef	results;
+
+    bzero(users, sizeof(*users));
+    if (dir == NULL) {
+	return (FALSE);
+    }
+    users->dir = dir;
+    results = (*dir->ops->copy_users)(dir);
+    if (results == NULL) {
+	goto failed;
+    }
+    users->list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    users->by_name
+	= CFDictionaryCreateMutable(NULL, 0,
+				    &kCFTypeDictionaryKeyCallBacks,
+				    &kCFTypeDictionaryValueCallBacks);
+    users->by_uid
+	= CFDictionaryCreateMutable(NULL, 0,
+				    &kCFTypeDictionaryKeyCallBacks,
+				    &kCFTypeDictionaryValueCallBacks);
+    n = (int)CFArrayGetCount(results);
+    for (i = 0; i < n; i++) {
+	S_user_list_add(users,
+			(AFPUserRef)CFArrayGetValueAtIndex(results, i));
+    }
+    CFRelease(results);
+    return (TRUE);
+
+ failed:
+    AFPUserList_free(users);
+    return (FALSE);
+}
+
+Boolean
+AFPUserList_init(AFPUserListRef users)
+{
+#if NO_OPEN_DIRECTORY
+    return (AFPUserList_init_with_directory(users,
+					    AFPDirectoryCreateMemory()));
+#else /* NO_OPEN_DIRECTORY */
+    return (AFPUserList_init_with_directory(users,
+					    AFPDirectoryCreateOpenDirectory()));
+#endif /* NO_OPEN_DIRECTORY */
+}
+
+/*
+ * Function: AFPUserList_create
+ * Purpose:
+ *   Make sure there are at least count users. The uids in use are
+ *   retrieved with a single query, then the missing users are created
+ *   in batches of AFP_USER_CREATE_BATCH.
+ */
+Boolean
+AFPUserList_create(AFPUserListRef users, gid_t gid,
+		   uid_t start, int count)
+{
+    int			batch_count = 0;
+    char		buf[256];
+    CFMutableArrayRef	created;
+    AFPDirectoryRef	dir = users->dir;
+    int			i;
+    int			need;
+    Boolean		ret = FALSE;
+    uint32_t		scan;
+    AFPUserSpec		specs[AFP_USER_CREATE_BATCH];
+    uint8_t *		taken;
+
+    need = count - (int)CFArrayGetCount(users->list);
+    if (need <= 0) {
+	return (TRUE);
+    }
+    taken = (uint8_t *)calloc(AFP_UID_SCAN_LIMIT, sizeof(*taken));
+    if ((*dir->ops->get_taken_uids)(dir, start, AFP_UID_SCAN_LIMIT, taken)
+	== FALSE) {
+	free(taken);
+	return (FALSE);
+    }
+    created = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    for (scan = 0; need > 0; scan++) {
+	if (scan < AFP_UID_SCAN_LIMIT) {
+	    if (taken[scan]) {
+		continue;
+	    }
+	    snprintf(buf, sizeof(buf), NETBOOT_USER_PREFIX "%03d",
+		     start + scan);
+	    specs[batch_count].uid = start + scan;
+	    specs[batch_count].name
+		= CFStringCreateWithCString(NULL, buf,
+					    kCFStringEncodingASCII);
+	    batch_count++;
+	}
+	if (batch_count == 0) {
+	    my_log(LOG_NOTICE,
+		   "AFPUserList_create: no free uids in %d..%d",
+		   start, start + AFP_UID_SCAN_LIMIT - 1);
+	    goto done;
+	}
+	if (batch_count < need && batch_count < AFP_USER_CREATE_BATCH
+	    && scan < AFP_UID_SCAN_LIMIT) {
+	    continue;
+	}
+	CFArrayRemoveAllValues(created);
+	(void)(*dir->ops->create_users)(dir, gid, specs, batch_count,
+					created);
+	for (i = 0; i < batch_count; i++) {
+	    CFRelease(specs[i].name);
+	}
+	batch_count = 0;
+	for (i = 0; i < CFArrayGetCount(created) && need > 0; i++) {
+	    S_user_list_add(users,
+			    (AFPUserRef)CFArrayGetValueAtIndex(created, i));
+	    need--;
+	}
+	if (CFArrayGetCount(created) == 0) {
+	    my_log(LOG_NOTICE, "AFPUserList_create: failed to create users");
+	    goto done;
+	}
+    }
+    ret = TRUE;
+
+ done:
+    for (i = 0; i < batch_count; i++) {
+	CFRelease(specs[i].name);
+    }
+    CFRelease(created);
+    free(taken);
+    return (ret);
+}
+
+AFPUserRef
+AFPUserList_lookup(AFPUserListRef users, CFStringRef afp_user)
+{
+    return ((AFPUserRef)CFDictionaryGetValue(users->by_name, afp_user));
+}
+
+AFPUserRef
+AFPUserList_lookup_uid(AFPUserListRef users, uid_t uid)
+{
+    CFNumberRef		uid_cf;
+    AFPUserRef		user;
+
+    uid_cf = CFNumberCreate(NULL, kCFNumberSInt32Type, &uid);
+    user = (AFPUserRef)CFDictionaryGetValue(users->by_uid, uid_cf);
+    CFRelease(uid_cf);
+    return (user);
+}
+
+uid_t
+AFPUser_get_uid(AFPUserRef user)
+{
+    uid_t	uid = -2;
+
+    CFNumberGetValue(CFDictionaryGetValue(user, kAFPUserUID),
+		     kCFNumberSInt32Type, &uid);
+    return (uid);
+}
+
+char *
+AFPUser_get_user(AFPUserRef user, char *buf, size_t buf_len)
+{
+    CFStringRef	name;
+
+    name = CFDictionaryGetValue(user, kAFPUserName);
+    (void)CFStringGetCString(name, buf, buf_len, kCFStringEncodingASCII);
+    return buf;
+}
+
+#define AFPUSER_PASSWORD_CHANGE_INTERVAL	((int)8)
+
+/*
+ * AFPUSER_PASSWORD_IDLE_SECS
+ * - don't rotate a password that was handed out more recently than this,
+ *   the client may not have logged in with it yet
+ * AFPUSER_ROTATION_SCAN_SECS
+ * - how often to look for users that need a new password
+ */
+#ifdef TEST_AFPUSERS
+#define AFPUSER_PASSWORD_IDLE_SECS		((int)2)
+#define AFPUSER_ROTATION_SCAN_SECS		((int)1)
+#else /* TEST_AFPUSERS */
+#define AFPUSER_PASSWORD_IDLE_SECS		((int)120)
+#define AFPUSER_ROTATION_SCAN_SECS		((int)15)
+#endif /* TEST_AFPUSERS */
+
+static Boolean
+S_user_is_fresh(AFPUserRef user)
+{
+    return (CFDictionaryContainsKey(user, kAFPUserPasswordFresh));
+}
+
+static Boolean
+S_user_is_idle(AFPUserRef user, CFDateRef now)
+{
+    CFDateRef	last_set;
+
+    last_set = CFDictionaryGetValue(user, kAFPUserDatePasswordLastSet);
+    return (last_set == NULL
+	    || (CFDateGetTimeIntervalSinceDate(now, last_set)
+		>= AFPUSER_PASSWORD_IDLE_SECS));
+}
+
+/*
+ * Function: S_rotation_complete
+ * Purpose:
+ *   Called on the owning queue once the directory write finishes.
+ *   If the pending password was handed out while the write was in
+ *   progress, it's no longer fresh.
+ */
+static void
+S_rotation_complete(AFPUserListRef users, uint32_t generation,
+		    AFPUserRef user, Boolean ok)
+{
+    CFStringRef		pw;
+
+    if (generation != users->generation) {
+	/* the list was re-initialized, ignore */
+	return;
+    }
+    pw = CFDictionaryGetValue(user, kAFPUserPasswordPending);
+    if (ok) {
+	users->stats.rotations++;
+	CFDictionarySetValue(user, kAFPUserPassword, pw);
+	if (CFDictionaryContainsKey(user, kAFPUserPendingHandedOut)) {
+	    CFDictionaryRemoveValue(user, kAFPUserPasswordFresh);
+	}
+	else {
+	    CFDictionarySetValue(user, kAFPUserPasswordFresh, kCFBooleanTrue);
+	}
+    }
+    else {
+	char	name[256];
+
+	users->stats.rotation_failures++;
+	AFPUser_get_user(user, name, sizeof(name));
+	my_log(LOG_NOTICE, "AFPUsers: failed to change password for %s%s",
+	       name,
+	       CFDictionaryContainsKey(user, kAFPUserPendingHandedOut)
+	       ? ", client login will fail" : "");
+	if (CFDictionaryContainsKey(user, kAFPUserPendingHandedOut)) {
+	    /* the handed out password isn't valid, force a new one */
+	    CFDictionaryRemoveValue(user, kAFPUserPasswordHandedOut);
+	    CFDictionaryRemoveValue(user, kAFPUserDatePasswordLastSet);
+	}
+    }
+    CFDictionaryRemoveValue(user, kAFPUserPasswordPending);
+    CFDictionaryRemoveValue(user, kAFPUserPendingHandedOut);
+    return;
+}
+
+/*
+ * Function: S_rotate_password
+ * Purpose:
+ *   Generate a new password for the user, and queue the directory write
+ *   on the rotation queue. The result is applied on the owning queue.
+ */
+static void
+S_rotate_password(AFPUserListRef users, AFPUserRef user)
+{
+    AFPDirectoryRef	dir = users->dir;
+    uint32_t		generation = users->generation;
+    char		passwd[AFP_PASSWORD_LEN + 1];
+    CFStringRef		pw;
+    dispatch_queue_t	queue = users->queue;
+    CFTypeRef		record;
+
+    generate_random_password(passwd, sizeof(passwd));
+    pw = CFStringCreateWithCString(NULL, passwd, kCFStringEncodingASCII);
+    CFDictionarySetValue(user, kAFPUserPasswordPending, pw);
+    record = CFDictionaryGetValue(user, kAFPUserODRecord);
+    CFRetain(record);
+    CFRetain(user);
+    dispatch_async(users->rotation_queue, ^{
+	    Boolean	ok;
+
+	    ok = (*dir->ops->set_password)(dir, record, pw);
+	    CFRelease(record);
+	    CFRelease(pw);
+	    dispatch_async(queue, ^{
+		    S_rotation_complete(users, generation, user, ok);
+		    CFRelease(user);
+		});
+	});
+    return;
+}
+
+/*
+ * Function: S_user_is_bound
+ * Purpose:
+ *   Returns whether a client may still be using the user's password.
+ */
+static Boolean
+S_user_is_bound(AFPUserListRef users, AFPUserRef user)
+{
+    if (users->bound_func == NULL) {
+	return (FALSE);
+    }
+    return ((*users->bound_func)(users->bound_arg, user));
+}
+
+/*
+ * Function: S_rotate_idle_passwords
+ * Purpose:
+ *   Fill the pool of fresh credentials: rotate the password of every
+ *   user that has been idle long enough, doesn't have a fresh one, and
+ *   is no longer bound to a client.  Rotating the password of a bound
+ *   user would lock its client out.
+ */
+static void
+S_rotate_idle_passwords(AFPUserListRef users)
+{
+    int		i;
+    int		n;
+    CFDateRef	now;
+
+    now = CFDateCreate(NULL, CFAbsoluteTimeGetCurrent());
+    n = (int)CFArrayGetCount(users->list);
+    for (i = 0; i < n; i++) {
+	AFPUserRef	user;
+
+	user = (AFPUserRef)CFArrayGetValueAtIndex(users->list, i);
+	if (S_user_is_fresh(user)
+	    || CFDictionaryContainsKey(user, kAFPUserPasswordPending)
+	    || S_user_is_idle(user, now) == FALSE
+	    || S_user_is_bound(users, user)) {
+	    continue;
+	}
+	S_rotate_password(users, user);
+    }
+    CFRelease(now);
+    return;
+}
+
+/*
+ * Function: AFPUserList_start_password_rotation
+ * Purpose:
+ *   Rotate passwords in the background. The list must only be accessed
+ *   from the given queue from now on.  func is called on that queue to
+ *   find out whether a user is still bound to a client; if it's NULL,
+ *   users are never considered bound.
+ */
+void
+AFPUserList_start_password_rotation(AFPUserListRef users,
+				    dispatch_queue_t queue,
+				    AFPUserBoundFunc * func, void * arg)
+{
+    static uint32_t	S_generation;
+    dispatch_source_t	timer;
+
+    if (users->rotation_queue != NULL) {
+	return;
+    }
+    users->generation = ++S_generation;
+    users->queue = queue;
+    users->bound_func = func;
+    users->bound_arg = arg;
+    users->rotation_queue
+	= dispatch_queue_create("com.apple.bootpd.afpusers", NULL);
+    timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+    dispatch_source_set_event_handler(timer, ^{
+	    S_rotate_idle_passwords(users);
+	});
+    dispatch_source_set_timer(timer, DISPATCH_TIME_NOW,
+			      AFPUSER_ROTATION_SCAN_SECS * NSEC_PER_SEC,
+			      NSEC_PER_SEC);
+    users->rotation_timer = timer;
+    dispatch_resume(timer);
+    return;
+}
+
+/*
+ * Function: S_stop_password_rotation
+ * Purpose:
+ *   Stop the timer and wait for directory writes in progress to finish,
+ *   so that the directory can be released. Completions still queued to
+ *   the owning queue are ignored because the generation won't match.
+ */
+static void
+S_stop_password_rotation(AFPUserListRef users)
+{
+    if (users->rotation_queue != NULL) {
+	my_log(LOG_INFO, "AFPUsers: %u password rotations (%u failed), "
+	       "pool hits %u misses %u, %u pending handed out",
+	       users->stats.rotations, users->stats.rotation_failures,
+	       users->stats.pool_hits, users->stats.pool_misses,
+	       users->stats.pending_handouts);
+    }
+    if (users->rotation_timer != NULL) {
+	dispatch_source_cancel(users->rotation_timer);
+	dispatch_release(users->rotation_timer);
+	users->rotation_timer = NULL;
+    }
+    if (users->rotation_queue != NULL) {
+	dispatch_sync(users->rotation_queue, ^{});
+	dispatch_release(users->rotation_queue);
+	users->rotation_queue = NULL;
+    }
+    users->generation = 0;
+    users->queue = NULL;
+    users->bound_func = NULL;
+    users->bound_arg = NULL;
+    return;
+}
+
+int
+AFPUserList_fresh_password_count(AFPUserListRef users)
+{
+    int		count = 0;
+    int		i;
+    int		n;
+
+    n = (int)CFArrayGetCount(users->list);
+    for (i = 0; i < n; i++) {
+	if (S_user_is_fresh((AFPUserRef)CFArrayGetValueAtIndex(users->list,
+							      i))) {
+	    count++;
+	}
+    }
+    return (count);
+}
+
+/*
+ * Function: S_set_password_now
+ * Purpose:
+ *   Write a new password for the user to the directory, and wait for the
+ *   write to finish.  The write goes through the rotation queue so that
+ *   it doesn't overlap with background rotations.
+ */
+static CFStringRef
+S_set_password_now(AFPUserListRef users, AFPUserRef user)
+{
+    AFPDirectoryRef	dir = users->dir;
+    __block Boolean	ok;
+    char		passwd[AFP_PASSWORD_LEN + 1];
+    CFStringRef		pw;
+    CFTypeRef		record;
+
+    generate_random_password(passwd, sizeof(passwd));
+    pw = CFStringCreateWithCString(NULL, passwd, kCFStringEncodingASCII);
+    record = CFDictionaryGetValue(user, kAFPUserODRecord);
+    dispatch_sync(users->rotation_queue, ^{
+	    ok = (*dir->ops->set_password)(dir, record, pw);
+	});
+    if (ok) {
+	CFDictionarySetValue(user, kAFPUserPassword, pw);
+    }
+    else {
+	my_log(LOG_NOTICE, "AFPUserList_set_random_password:"
+	       " set_password() failed");
+	CFDictionaryRemoveValue(user, kAFPUserPassword);
+    }
+    CFRelease(pw);
+    return (ok ? CFDictionaryGetValue(user, kAFPUserPassword) : NULL);
+}
+
+/*
+ * Function: S_hand_out_password
+ * Purpose:
+ *   Return a password for the user, without touching the directory
+ *   unless the pool has nothing to offer.  In order of preference:
+ *   - the password most recently handed out, if it was handed out less
+ *     than AFPUSER_PASSWORD_CHANGE_INTERVAL ago (duplicate request)
+ *   - a password being written by the rotation queue
+ *   - a pre-rotated (fresh) password
+ *   If the user has no password at all, start a rotation and hand out
+ *   the pending password.  Otherwise the existing password may be known
+ *   to a previous client, so write a new one and wait for it.
+ */
+static Boolean
+S_hand_out_password(AFPUserListRef users, AFPUserRef user, CFDateRef now,
+		    char * passwd, size_t passwd_len)
+{
+    CFDateRef		last_set;
+    CFStringRef		pw;
+
+    pw = CFDictionaryGetValue(user, kAFPUserPasswordHandedOut);
+    last_set = CFDictionaryGetValue(user, kAFPUserDatePasswordLastSet);
+    if (pw != NULL && last_set != NULL
+	&& (CFDateGetTimeIntervalSinceDate(now, last_set) 
+	    < AFPUSER_PASSWORD_CHANGE_INTERVAL)) {
+	/* return what we have */
+    }
+    else if ((pw = CFDictionaryGetValue(user, kAFPUserPasswordPending))
+	     != NULL) {
+	users->stats.pending_handouts++;
+	CFDictionarySetValue(user, kAFPUserPendingHandedOut, kCFBooleanTrue);
+    }
+    else if ((pw = CFDictionaryGetValue(user, kAFPUserPassword)) != NULL) {
+	if (S_user_is_fresh(user)) {
+	    users->stats.pool_hits++;
+	    CFDictionaryRemoveValue(user, kAFPUserPasswordFresh);
+	}
+	else {
+	    users->stats.pool_misses++;
+	    pw = S_set_password_now(users, user);
+	    if (pw == NULL) {
+		CFDictionaryRemoveValue(user, kAFPUserPasswordHandedOut);
+		CFDictionaryRemoveValue(user, kAFPUserDatePasswordLastSet);
+		return (FALSE);
+	    }
+	}
+    }
+    else {
+	S_rotate_password(users, user);
+	pw = CFDictionaryGetValue(user, kAFPUserPasswordPending);
+	users->stats.pending_handouts++;
+	CFDictionarySetValue(user, kAFPUserPendingHandedOut, kCFBooleanTrue);
+    }
+    CFDictionarySetValue(user, kAFPUserPasswordHandedOut, pw);
+    CFDictionarySetValue(user, kAFPUserDatePasswordLastSet, now);
+    (void)CFStringGetCString(pw, passwd, passwd_len, kCFStringEncodingASCII);
+    return (TRUE);
+}
+
+/*
+ * Function: AFPUserList_set_random_password
+ * Purpose:
+ *   Set a random password for the user and returns it in passwd.
+ *   Do not change the password again until AFPUSER_PASSWORD_CHANGE_INTERVAL
+ *   has elapsed.  This overcomes the problem where every client
+ *   request packet is duplicated. In that case, the client tries to use
+ *   a password that subsequently gets changed when the duplicate arrives.
+ *
+ *   If background rotation was started, the password comes from the pool
+ *   and this only waits on the directory when the pool is empty.
+ */
+Boolean
+AFPUserList_set_random_password(AFPUserListRef users, AFPUserRef user,
+				char * passwd, size_t passwd_len)
+{
+    AFPDirectoryRef	dir = users->dir;
+    CFDateRef		last_set;
+    Boolean		ok = TRUE;
     CFDateRef		now;
     CFStringRef		pw;
-    ODRecordRef		record;
+    CFTypeRef		record;
 
     now = CFDateCreate(NULL, CFAbsoluteTimeGetCurrent());
+    if (users->rotation_queue != NULL) {
+	ok = S_hand_out_password(users, user, now, passwd, passwd_len);
+	CFRelease(now);
+	return (ok);
+    }
     pw = CFDictionaryGetValue(user, kAFPUserPassword);
     last_set = CFDictionaryGetValue(user, kAFPUserDatePasswordLastSet);
     if (pw != NULL && last_set != NULL
@@ -488,23 +1326,23 @@ AFPUser_set_random_password(AFPUserRef user,
 	       (int)CFDateGetTimeIntervalSinceDate(now, last_set),
 	       AFPUSER_PASSWORD_CHANGE_INTERVAL);
 #endif /* TEST_AFPUSERS */
-	(void)_SC_cfstring_to_cstring(pw, passwd, passwd_len,
-				      kCFStringEncodingASCII);
+	(void)CFStringGetCString(pw, passwd, passwd_len,
+				 kCFStringEncodingASCII);
 	CFDictionarySetValue(user, kAFPUserDatePasswordLastSet, now);
     }
     else {
 	generate_random_password(passwd, passwd_len);
 
-	record = (ODRecordRef)CFDictionaryGetValue(user, kAFPUserODRecord);
+	record = CFDictionaryGetValue(user, kAFPUserODRecord);
 	pw = CFStringCreateWithCString(NULL, passwd, kCFStringEncodingASCII);
-	ok = ODRecordChangePassword(record, NULL, pw, NULL);
+	ok = (*dir->ops->set_password)(dir, record, pw);
 	if (ok) {
 	    CFDictionarySetValue(user, kAFPUserPassword, pw);
 	    CFDictionarySetValue(user, kAFPUserDatePasswordLastSet, now);
 	}
 	else {
-	    my_log(LOG_NOTICE, "AFPUser_set_random_password:"
-		   " ODRecordChangePassword() failed");
+	    my_log(LOG_NOTICE, "AFPUserList_set_random_password:"
+		   " set_password() failed");
 	    CFDictionaryRemoveValue(user, kAFPUserPassword);
 	    CFDictionaryRemoveValue(user, kAFPUserDatePasswordLastSet);
 	}
@@ -516,8 +1354,6 @@ AFPUser_set_random_password(AFPUserRef user,
 
 #ifdef TEST_AFPUSERS
 
-#include "afp.h"
-
 #define USECS_PER_SEC	1000000
 /*
  * Function: timeval_subtract
@@ -567,29 +1403,351 @@ AFPUserList_print(AFPUserListRef users)
     CFShow(users->list);
 }
 
+#define AFP_TEST_USERS_MAX	1000
+
+#if NO_OPEN_DIRECTORY
+#define NETBOOT_TEST_GID	120
+
+/*
+ * Function: S_memory_directory_create
+ * Purpose:
+ *   Populate an in-memory directory with a few netboot users, and
+ *   scatter some unrelated users through the uid range so that
+ *   AFPUserList_create() has to skip over them.
+ */
+static AFPDirectoryRef
+S_memory_directory_create(uid_t start, int count)
+{
+    char		buf[64];
+    AFPDirectoryRef	dir;
+    int			i;
+
+    dir = AFPDirectoryCreateMemory();
+    for (i = 0; i < 3; i++) {
+	CFStringRef	name;
+
+	snprintf(buf, sizeof(buf), NETBOOT_USER_PREFIX "%03d", start + i);
+	name = CFStringCreateWithCString(NULL, buf, kCFStringEncodingASCII);
+	AFPDirectoryMemoryAddUser(dir, name, start + i, TRUE);
+	CFRelease(name);
+    }
+    for (i = 3; i < count * 2; i += 7) {
+	CFStringRef	name;
+
+	snprintf(buf, sizeof(buf), "user%d", start + i);
+	name = CFStringCreateWithCString(NULL, buf, kCFStringEncodingASCII);
+	AFPDirectoryMemoryAddUser(dir, name, start + i, FALSE);
+	CFRelease(name);
+    }
+    /* simulate a directory round-trip */
+    AFPDirectoryMemorySetLatency(dir, 1000);
+    return (dir);
+}
+#endif /* NO_OPEN_DIRECTORY */
+
+#if NO_OPEN_DIRECTORY
+#define ROTATION_TEST_LATENCY	(200 * 1000)	/* 200 ms per round-trip */
+#define HANDOUT_MAX_USECS	5000
+
+static CFStringRef
+S_memory_copy_password(AFPDirectoryRef dir, AFPUserRef user)
+{
+    AFPDirectoryMemoryRef	mem = (AFPDirectoryMemoryRef)dir;
+    CFStringRef			pw;
+    CFDictionaryRef		record;
+
+    record = CFDictionaryGetValue(user, kAFPUserODRecord);
+    pthread_mutex_lock(&mem->lock);
+    pw = CFDictionaryGetValue(record, kAFPUserPassword);
+    if (pw != NULL) {
+	CFRetain(pw);
+    }
+    pthread_mutex_unlock(&mem->lock);
+    return (pw);
+}
+
+/*
+ * Function: S_hand_out_all
+ * Purpose:
+ *   Hand out a password for every user on the owning queue, verifying
+ *   that none of the calls waits on the directory.
+ */
+static Boolean
+S_hand_out_all(AFPUserListRef users, dispatch_queue_t queue,
+	       CFMutableArrayRef passwords)
+{
+    __block Boolean	ok = TRUE;
+
+    dispatch_sync(queue, ^{
+	    CFIndex	i;
+	    CFIndex	n;
+
+	    n = CFArrayGetCount(users->list);
+	    for (i = 0; i < n; i++) {
+		char 		pass_buf[AFP_PASSWORD_LEN + 1];
+		struct timeval	end;
+		struct timeval	result;
+		struct timeval	start;
+		CFStringRef	str;
+		AFPUserRef	user;
+
+		user = (AFPUserRef)CFArrayGetValueAtIndex(users->list, i);
+		gettimeofday(&start, 0);
+		AFPUserList_set_random_password(users, user, pass_buf,
+						sizeof(pass_buf));
+		gettimeofday(&end, 0);
+		timeval_subtract(end, start, &result);
+		if (result.tv_sec != 0 || result.tv_usec > HANDOUT_MAX_USECS) {
+		    printf("hand out took %d.%06d seconds\n",
+			   (int)result.tv_sec, (int)result.tv_usec);
+		    ok = FALSE;
+		}
+		str = CFStringCreateWithCString(NULL, pass_buf,
+						kCFStringEncodingASCII);
+		CFArrayAppendValue(passwords, str);
+		CFRelease(str);
+	    }
+	});
+    return (ok);
+}
+
+static Boolean
+S_verify_passwords(AFPUserListRef users, CFArrayRef passwords)
+{
+    CFIndex	i;
+    CFIndex	n;
+
+    n = CFArrayGetCount(users->list);
+    for (i = 0; i < n; i++) {
+	CFStringRef	pw;
+	AFPUserRef	user;
+
+	user = (AFPUserRef)CFArrayGetValueAtIndex(users->list, i);
+	pw = S_memory_copy_password(users->dir, user);
+	if (pw == NULL
+	    || !CFEqual(pw, CFArrayGetValueAtIndex(passwords, i))) {
+	    printf("directory password doesn't match the one handed out\n");
+	    my_CFRelease(&pw);
+	    return (FALSE);
+	}
+	CFRelease(pw);
+    }
+    return (TRUE);
+}
+
+/* users bound to a (simulated) client */
+static CFMutableSetRef	S_test_bound;
+
+static Boolean
+S_test_user_is_bound(void * arg, AFPUserRef user)
+{
+    return (CFSetContainsValue(S_test_bound, user));
+}
+
+static void
+S_print_rotation_stats(AFPUserListRef users, dispatch_queue_t queue)
+{
+    dispatch_sync(queue, ^{
+	    printf("rotations %u failures %u pool hits %u misses %u "
+		   "pending %u fresh %d\n",
+		   users->stats.rotations,
+		   users->stats.rotation_failures,
+		   users->stats.pool_hits,
+		   users->stats.pool_misses,
+		   users->stats.pending_handouts,
+		   AFPUserList_fresh_password_count(users));
+	});
+    return;
+}
+
+/*
+ * Function: S_test_rotation
+ * Purpose:
+ *   With a slow directory, verify that handing out passwords doesn't
+ *   wait on the directory while the pool has passwords, that the
+ *   passwords handed out end up in the directory, that idle users get a
+ *   fresh password ahead of time unless their client is still bound, and
+ *   that a pool miss gets a new password rather than the previous one.
+ */
+static Boolean
+S_test_rotation(AFPUserListRef users)
+{
+    __block int		fresh;
+    __block uint32_t	misses;
+    int			n;
+    CFMutableArrayRef	passwords;
+    __block CFStringRef	pw = NULL;
+    dispatch_queue_t	queue;
+    Boolean		ret = FALSE;
+    __block Boolean	set_ok;
+    AFPUserRef		user0;
+
+    n = (int)CFArrayGetCount(users->list);
+    if (n < 2) {
+	printf("password rotation test needs at least 2 users\n");
+	return (TRUE);
+    }
+    user0 = (AFPUserRef)CFArrayGetValueAtIndex(users->list, 0);
+    S_test_bound = CFSetCreateMutable(NULL, 0, NULL);
+    AFPDirectoryMemorySetLatency(users->dir, ROTATION_TEST_LATENCY);
+    queue = dispatch_queue_create("AFPUsers test", NULL);
+    dispatch_sync(queue, ^{
+	    /* start from scratch */
+	    CFIndex	i;
+
+	    for (i = 0; i < n; i++) {
+		AFPUserRef	user;
+
+		user = (AFPUserRef)CFArrayGetValueAtIndex(users->list, i);
+		CFDictionaryRemoveValue(user, kAFPUserPassword);
+		CFDictionaryRemoveValue(user, kAFPUserPasswordHandedOut);
+		CFDictionaryRemoveValue(user, kAFPUserDatePasswordLastSet);
+	    }
+	    AFPUserList_start_password_rotation(users, queue,
+						S_test_user_is_bound, NULL);
+	});
+
+    /* nothing has been written yet, passwords are all pending */
+    timestamp_printf("before handing out pending passwords");
+    passwords = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    if (S_hand_out_all(users, queue, passwords) == FALSE) {
+	goto done;
+    }
+    timestamp_printf("after handing out pending passwords");
+    usleep((n + 1) * ROTATION_TEST_LATENCY);
+    if (S_verify_passwords(users, passwords) == FALSE) {
+	goto done;
+    }
+    S_print_rotation_stats(users, queue);
+
+    /* every client but the first one goes away */
+    dispatch_sync(queue, ^{
+	    CFSetAddValue(S_test_bound, user0);
+	});
+
+    /* wait for the users to go idle and for the pool to fill */
+    sleep(AFPUSER_PASSWORD_IDLE_SECS + AFPUSER_ROTATION_SCAN_SECS);
+    usleep((n + 1) * ROTATION_TEST_LATENCY);
+    dispatch_sync(queue, ^{
+	    fresh = AFPUserList_fresh_password_count(users);
+	});
+    S_print_rotation_stats(users, queue);
+    if (fresh != n - 1) {
+	printf("pool has %d fresh passwords, expected %d\n", fresh, n - 1);
+	goto done;
+    }
+    pw = S_memory_copy_password(users->dir, user0);
+    if (pw == NULL || !CFEqual(pw, CFArrayGetValueAtIndex(passwords, 0))) {
+	printf("password of a bound user was rotated\n");
+	goto done;
+    }
+    my_CFRelease(&pw);
+
+    /* the first client goes away too, and its user is handed out again
+     * after AFPUSER_PASSWORD_CHANGE_INTERVAL without a fresh password */
+    dispatch_sync(queue, ^{
+	    char 	pass_buf[AFP_PASSWORD_LEN + 1];
+
+	    CFSetRemoveValue(S_test_bound, user0);
+	    CFDictionaryRemoveValue(user0, kAFPUserDatePasswordLastSet);
+	    misses = users->stats.pool_misses;
+	    set_ok = AFPUserList_set_random_password(users, user0, pass_buf,
+						     sizeof(pass_buf));
+	    misses = users->stats.pool_misses - misses;
+	    pw = CFStringCreateWithCString(NULL, pass_buf,
+					   kCFStringEncodingASCII);
+	});
+    if (set_ok == FALSE || misses != 1) {
+	printf("pool miss not handled\n");
+	goto done;
+    }
+    if (CFEqual(pw, CFArrayGetValueAtIndex(passwords, 0))) {
+	printf("pool miss handed out the previous password\n");
+	goto done;
+    }
+    CFArraySetValueAtIndex(passwords, 0, pw);
+    if (S_verify_passwords(users, passwords) == FALSE) {
+	goto done;
+    }
+    my_CFRelease(&pw);
+    timestamp_printf("before handing out pooled passwords");
+    CFArrayRemoveAllValues(passwords);
+    if (S_hand_out_all(users, queue, passwords) == FALSE) {
+	goto done;
+    }
+    timestamp_printf("after handing out pooled passwords");
+    if (S_verify_passwords(users, passwords) == FALSE) {
+	goto done;
+    }
+    S_print_rotation_stats(users, queue);
+    printf("password rotation verified\n");
+    ret = TRUE;
+
+ done:
+    my_CFRelease(&pw);
+    CFRelease(passwords);
+    dispatch_sync(queue, ^{
+	    AFPUserList_free(users);
+	});
+    dispatch_release(queue);
+    my_CFRelease(&S_test_bound);
+    return (ret);
+}
+#endif /* NO_OPEN_DIRECTORY */
+
+static Boolean
+S_verify_lookups(AFPUserListRef users)
+{
+    CFIndex	i;
+    CFIndex	n;
+
+    n = CFArrayGetCount(users->list);
+    for (i = 0; i < n; i++) {
+	char		name[256];
+	CFStringRef	name_cf;
+	AFPUserRef	user;
+
+	user = (AFPUserRef)CFArrayGetValueAtIndex(users->list, i);
+	if (AFPUserList_lookup_uid(users, AFPUser_get_uid(user)) != user) {
+	    printf("lookup of uid %d failed\n", AFPUser_get_uid(user));
+	    return (FALSE);
+	}
+	AFPUser_get_user(user, name, sizeof(name));
+	name_cf = CFStringCreateWithCString(NULL, name,
+					    kCFStringEncodingASCII);
+	if (AFPUserList_lookup(users, name_cf) != user) {
+	    printf("lookup of %s failed\n", name);
+	    CFRelease(name_cf);
+	    return (FALSE);
+	}
+	CFRelease(name_cf);
+    }
+    printf("lookups by name and uid verified\n");
+    return (TRUE);
+}
+
 int 
 main(int argc, char * argv[])
 {
+    int			count;
+    AFPDirectoryRef	dir;
+    gid_t		gid;
+#if !NO_OPEN_DIRECTORY
+    struct group *	group_ent_p;
+#endif /* !NO_OPEN_DIRECTORY */
     CFIndex		i;
     CFIndex		n;
-    AFPUserList 	users;
-    struct group *	group_ent_p;
-    int			count;
+    uint32_t		round_trips;
     int			start;
+    AFPUserList 	users;
 
     if (argc < 3) {
 	printf("usage: AFPUsers user_count start\n");
 	exit(1);
     }
 
-    group_ent_p = getgrnam(NETBOOT_GROUP);
-    if (group_ent_p == NULL) {
-        printf("Group '%s' missing\n", NETBOOT_GROUP);
-        exit(1);
-    }
-
     count = strtol(argv[1], NULL, 0);
-    if (count < 0 || count > 100) {
+    if (count < 0 || count > AFP_TEST_USERS_MAX) {
 	printf("invalid user_count\n");
 	exit(1);
     }
@@ -598,15 +1756,39 @@ main(int argc, char * argv[])
 	printf("invalid start\n");
 	exit(1);
     }
+#if NO_OPEN_DIRECTORY
+    gid = NETBOOT_TEST_GID;
+    timestamp_printf("before processing existing users");
+    dir = S_memory_directory_create(start, count);
+    AFPUserList_init_with_directory(&users, dir);
+    timestamp_printf("after processing existing users");
+#else /* NO_OPEN_DIRECTORY */
+    group_ent_p = getgrnam(NETBOOT_GROUP);
+    if (group_ent_p == NULL) {
+        printf("Group '%s' missing\n", NETBOOT_GROUP);
+        exit(1);
+    }
+    gid = group_ent_p->gr_gid;
     timestamp_printf("before processing existing users");
     AFPUserList_init(&users);
     timestamp_printf("after processing existing users");
+    dir = users.dir;
+#endif /* NO_OPEN_DIRECTORY */
     //AFPUserList_print(&users);
 
+    round_trips = dir->round_trips;
     timestamp_printf("before creating new users");
-    AFPUserList_create(&users, group_ent_p->gr_gid, start, count);
+    if (AFPUserList_create(&users, gid, start, count) == FALSE) {
+	printf("AFPUserList_create failed\n");
+	exit(1);
+    }
     timestamp_printf("after creating new users");
+    printf("%d users, %u directory round-trips\n",
+	   (int)CFArrayGetCount(users.list), dir->round_trips - round_trips);
     //AFPUserList_print(&users);
+    if (S_verify_lookups(&users) == FALSE) {
+	exit(1);
+    }
 
     timestamp_printf("before setting passwords");
     n = CFArrayGetCount(users.list);
@@ -615,7 +1797,8 @@ main(int argc, char * argv[])
 	AFPUserRef	user;
 
 	user = (AFPUserRef)CFArrayGetValueAtIndex(users.list, i);
-	AFPUser_set_random_password(user, pass_buf, sizeof(pass_buf));
+	AFPUserList_set_random_password(&users, user, pass_buf,
+					sizeof(pass_buf));
     }
     timestamp_printf("after setting passwords");
 
@@ -628,7 +1811,8 @@ main(int argc, char * argv[])
 	AFPUserRef	user;
 
 	user = (AFPUserRef)CFArrayGetValueAtIndex(users.list, i);
-	AFPUser_set_random_password(user, pass_buf, sizeof(pass_buf));
+	AFPUserList_set_random_password(&users, user, pass_buf,
+					sizeof(pass_buf));
     }
     timestamp_printf("after setting passwords again");
 
@@ -641,7 +1825,8 @@ main(int argc, char * argv[])
 	AFPUserRef	user;
 
 	user = (AFPUserRef)CFArrayGetValueAtIndex(users.list, i);
-	AFPUser_set_random_password(user, pass_buf, sizeof(pass_buf));
+	AFPUserList_set_random_password(&users, user, pass_buf,
+					sizeof(pass_buf));
     }
     timestamp_printf("after setting passwords for 3rd time");
 
@@ -654,10 +1839,16 @@ main(int argc, char * argv[])
 	AFPUserRef	user;
 
 	user = (AFPUserRef)CFArrayGetValueAtIndex(users.list, i);
-	AFPUser_set_random_password(user, pass_buf, sizeof(pass_buf));
+	AFPUserList_set_random_password(&users, user, pass_buf,
+					sizeof(pass_buf));
     }
     timestamp_printf("after setting passwords for second time");
 
+#if NO_OPEN_DIRECTORY
+    if (S_test_rotation(&users) == FALSE) {
+	exit(1);
+    }
+#endif /* NO_OPEN_DIRECTORY */
     AFPUserList_free(&users);
     printf("sleeping for 60 seconds, run leaks on %d\n", getpid());
     sleep(60);
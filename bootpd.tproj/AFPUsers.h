@@ -29,29 +29,126 @@
 #include <CoreFoundation/CFArray.h>
 #include <CoreFoundation/CFString.h>
 #include <CoreFoundation/CFDictionary.h>
+#include <dispatch/dispatch.h>
+#if !NO_OPEN_DIRECTORY
 #include <OpenDirectory/OpenDirectory.h>
 #include <DirectoryService/DirectoryService.h>
+#endif /* !NO_OPEN_DIRECTORY */
 
 #define CHARSET_SYMBOLS			"-,./[]\\;'!@#%&*()_{}:\"?"
 #define CHARSET_SYMBOLS_LENGTH		(sizeof(CHARSET_SYMBOLS) - 1)
 
 typedef CFMutableDictionaryRef	AFPUserRef;
 
+/*
+ * Type: AFPDirectory
+ * Purpose:
+ *   The directory operations needed to maintain the NetBoot AFP users.
+ *   Records are opaque to everything but the backend that created them.
+ *   Each operation is a single round-trip to the directory.
+ */
+typedef struct AFPDirectory * AFPDirectoryRef;
+
 typedef struct {
-    ODNodeRef		node;
-    CFMutableArrayRef	list;
-    ODRecordRef		afp_access_group;
+    CFStringRef		name;
+    uid_t		uid;
+} AFPUserSpec;
+
+typedef struct {
+    /* return the AFPUserRef's for the users previously created by bsdpd */
+    CFArrayRef	(*copy_users)(AFPDirectoryRef dir);
+
+    /* set taken[i] for each uid (start + i) in use, i < count */
+    Boolean	(*get_taken_uids)(AFPDirectoryRef dir, uid_t start,
+				  uint32_t count, uint8_t * taken);
+
+    /* create the users, append an AFPUserRef to created for each success */
+    int		(*create_users)(AFPDirectoryRef dir, gid_t gid,
+				const AFPUserSpec * specs, int count,
+				CFMutableArrayRef created);
+
+    Boolean	(*set_password)(AFPDirectoryRef dir, CFTypeRef record,
+				CFStringRef password);
+
+    void	(*free)(AFPDirectoryRef dir);
+} AFPDirectoryOps;
+
+struct AFPDirectory {
+    const AFPDirectoryOps *	ops;
+    uint32_t			round_trips;
+};
+
+#if !NO_OPEN_DIRECTORY
+AFPDirectoryRef	AFPDirectoryCreateOpenDirectory(void);
+#endif /* !NO_OPEN_DIRECTORY */
+AFPDirectoryRef	AFPDirectoryCreateMemory(void);
+void		AFPDirectoryMemorySetLatency(AFPDirectoryRef dir,
+					     useconds_t latency);
+Boolean		AFPDirectoryMemoryAddUser(AFPDirectoryRef dir,
+					  CFStringRef name, uid_t uid,
+					  Boolean netboot_user);
+void		AFPDirectoryFree(AFPDirectoryRef * dir_p);
+
+/*
+ * Type: AFPUserBoundFunc
+ * Purpose:
+ *   Returns whether the user is bound to a client, which may still be
+ *   logged in with the password it was handed.
+ */
+typedef Boolean (AFPUserBoundFunc)(void * arg, AFPUserRef user);
+
+/*
+ * Type: AFPPasswordRotationStats
+ * Purpose:
+ *   Counters for the background password rotation.
+ *   pool_hits: handed out a pre-rotated password
+ *   pool_misses: no pre-rotated password, wrote a new one while the
+ *     request waited
+ *   pending_handouts: handed out a password still being written
+ */
+typedef struct {
+    uint32_t		rotations;
+    uint32_t		rotation_failures;
+    uint32_t		pool_hits;
+    uint32_t		pool_misses;
+    uint32_t		pending_handouts;
+} AFPPasswordRotationStats;
+
+typedef struct {
+    AFPDirectoryRef		dir;
+    CFMutableArrayRef		list;
+    CFMutableDictionaryRef	by_name;	/* CFString -> AFPUserRef */
+    CFMutableDictionaryRef	by_uid;		/* CFNumber -> AFPUserRef */
+
+    /* background password rotation */
+    dispatch_queue_t		queue;		/* the queue that owns list */
+    dispatch_queue_t		rotation_queue;	/* directory writes */
+    dispatch_source_t		rotation_timer;
+    AFPUserBoundFunc *		bound_func;
+    void *			bound_arg;
+    uint32_t			generation;
+    AFPPasswordRotationStats	stats;
 } AFPUserList, *AFPUserListRef;
 
 void		AFPUserList_free(AFPUserListRef users);
 Boolean		AFPUserList_init(AFPUserListRef users);
+Boolean		AFPUserList_init_with_directory(AFPUserListRef users,
+						AFPDirectoryRef dir);
 Boolean		AFPUserList_create(AFPUserListRef users, gid_t gid,
 				   uid_t start, int count);
 AFPUserRef	AFPUserList_lookup(AFPUserListRef users, CFStringRef afp_user);
+AFPUserRef	AFPUserList_lookup_uid(AFPUserListRef users, uid_t uid);
+Boolean		AFPUserList_set_random_password(AFPUserListRef users,
+						AFPUserRef user,
+						char * passwd,
+						size_t passwd_len);
+void		AFPUserList_start_password_rotation(AFPUserListRef users,
+						    dispatch_queue_t queue,
+						    AFPUserBoundFunc * func,
+						    void * arg);
+int		AFPUserList_fresh_password_count(AFPUserListRef users);
 
 uid_t		AFPUser_get_uid(AFPUserRef user);
 char *		AFPUser_get_user(AFPUserRef user, char *buf, size_t buf_len);
-Boolean		AFPUser_set_random_password(AFPUserRef user, 
-					    char * passwd, size_t passwd_len);
 
 #endif	// _S_AFPUSERS_H
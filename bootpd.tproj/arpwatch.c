@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * arpwatch.c
+ * - map of IP addresses observed in use in ARP traffic
+ *
+ * bootpd watches ARP traffic on the interfaces it serves, and records
+ * the sender of each ARP request and reply.  An address that was used
+ * recently by some host is not offered to a new client, which would
+ * otherwise find the conflict itself and DECLINE the address.
+ *
+ * The map is a fixed-size open addressing hash table of 16-byte entries.
+ * An entry is only examined within a short probe window from its hash
+ * slot, so both recording and lookup cost a bounded number of compares.
+ * Entries older than the lifetime are free to be reused; when the window
+ * has no free entry, the oldest entry in it is replaced.
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include "arpwatch.h"
+
+#define ARP_MAP_PROBE_MAX	8
+#define ARP_MAP_CAPACITY_MIN	64
+
+#define ETHER_HDR_LEN		14
+#define ETHER_ADDR_LEN		6
+#define ETHERTYPE_IP_		0x0800
+#define ETHERTYPE_ARP_		0x0806
+#define ETHERTYPE_VLAN_		0x8100
+#define ARP_PKT_LEN		28
+#define ARPHRD_ETHER_		1
+
+typedef struct {
+    uint32_t		ip;		/* network byte order, 0 if unused */
+    uint32_t		seen;
+    uint8_t		hwaddr[ETHER_ADDR_LEN];
+    uint16_t		pad;
+} ARPObservation;
+
+struct ARPObservationMap {
+    ARPObservation *	entries;
+    uint32_t		mask;		/* capacity - 1 */
+    int			shift;		/* 32 - log2(capacity) */
+    uint32_t		lifetime;
+    ARPObservationStats	stats;
+};
+
+static inline uint32_t
+S_ip_hash(ARPObservationMapRef map, uint32_t ip)
+{
+    /* Fibonacci hashing: the high bits spread sequential addresses */
+    return ((uint32_t)(ntohl(ip) * 2654435761U) >> map->shift);
+}
+
+static inline bool
+S_entry_is_current(ARPObservationMapRef map, ARPObservation * entry,
+		   uint32_t now)
+{
+    return (entry->ip != 0 && (now - entry->seen) <= map->lifetime);
+}
+
+ARPObservationMapRef
+ARPObservationMapCreate(uint32_t capacity, uint32_t lifetime_secs)
+{
+    ARPObservationMapRef	map;
+    int				shift = 32 - 6;
+    uint32_t			size = ARP_MAP_CAPACITY_MIN;
+
+    while (size < capacity && size < (1U << 24)) {
+	size <<= 1;
+	shift--;
+    }
+    map = (ARPObservationMapRef)malloc(sizeof(*map));
+    if (map == NULL) {
+	return (NULL);
+    }
+    bzero(map, sizeof(*map));
+    map->entries = calloc(size, sizeof(*map->entries));
+    if (map->entries == NULL) {
+	free(map);
+	return (NULL);
+    }
+    map->mask = size - 1;
+    map->shift = shift;
+    map->lifetime = lifetime_secs;
+    map->stats.capacity = size;
+    return (map);
+}
+
+void
+ARPObservationMapFree(ARPObservationMapRef * map_p)
+{
+    ARPObservationMapRef	map = *map_p;
+
+    if (map == NULL) {
+	return;
+    }
+    free(map->entries);
+    free(map);
+    *map_p = NULL;
+    return;
+}
+
+void
+ARPObservationMapSetLifetime(ARPObservationMapRef map, uint32_t lifetime_secs)
+{
+    map->lifetime = lifetime_secs;
+    return;
+}
+
+void
+ARPObservationMapRecord(ARPObservationMapRef map, struct in_addr ip,
+			const uint8_t * hwaddr, uint32_t now)
+{
+    ARPObservation *	entry;
+    ARPObservation *	free_entry = NULL;
+    int			i;
+    uint32_t		slot;
+    ARPObservation *	oldest = NULL;
+
+    if (ip.s_addr == 0) {
+	return;
+    }
+    slot = S_ip_hash(map, ip.s_addr);
+    for (i = 0; i < ARP_MAP_PROBE_MAX; i++) {
+	entry = map->entries + ((slot + i) & map->mask);
+	if (entry->ip == ip.s_addr) {
+	    goto found;
+	}
+	if (entry->ip == 0) {
+	    /* never used, so the address isn't any further along */
+	    if (free_entry == NULL) {
+		free_entry = entry;
+	    }
+	    break;
+	}
+	if (free_entry == NULL && S_entry_is_current(map, entry, now) == false) {
+	    free_entry = entry;
+	}
+	if (oldest == NULL || (now - entry->seen) > (now - oldest->seen)) {
+	    oldest = entry;
+	}
+    }
+    if (free_entry != NULL) {
+	entry = free_entry;
+    }
+    else {
+	entry = oldest;
+	map->stats.evicted++;
+    }
+    entry->ip = ip.s_addr;
+
+ found:
+    entry->seen = now;
+    bcopy(hwaddr, entry->hwaddr, sizeof(entry->hwaddr));
+    map->stats.recorded++;
+    return;
+}
+
+static bool
+S_process_arp(ARPObservationMapRef map, const uint8_t * arp, int length,
+	      uint32_t now)
+{
+    static const uint8_t	zero_hw[ETHER_ADDR_LEN];
+    struct in_addr		sender_ip;
+    const uint8_t *		sender_hw;
+
+    map->stats.frames++;
+    if (length < ARP_PKT_LEN
+	|| ((arp[0] << 8) | arp[1]) != ARPHRD_ETHER_
+	|| ((arp[2] << 8) | arp[3]) != ETHERTYPE_IP_
+	|| arp[4] != ETHER_ADDR_LEN || arp[5] != sizeof(struct in_addr)) {
+	map->stats.ignored++;
+	return (false);
+    }
+    sender_hw = arp + 8;
+    bcopy(arp + 14, &sender_ip, sizeof(sender_ip));
+    if (sender_ip.s_addr == 0
+	|| sender_ip.s_addr == INADDR_BROADCAST
+	|| bcmp(sender_hw, zero_hw, sizeof(zero_hw)) == 0
+	|| (sender_hw[0] & 0x01) != 0) {
+	/* a probe, or not a usable sender */
+	map->stats.ignored++;
+	return (false);
+    }
+    ARPObservationMapRecord(map, sender_ip, sender_hw, now);
+    return (true);
+}
+
+bool
+ARPObservationMapProcessFrame(ARPObservationMapRef map, const void * frame,
+			      int frame_length, uint32_t now)
+{
+    const uint8_t *	scan = (const uint8_t *)frame;
+    int			type;
+
+    if (frame_length < ETHER_HDR_LEN) {
+	map->stats.frames++;
+	map->stats.ignored++;
+	return (false);
+    }
+    type = (scan[12] << 8) | scan[13];
+    scan += ETHER_HDR_LEN;
+    frame_length -= ETHER_HDR_LEN;
+    if (type == ETHERTYPE_VLAN_ && frame_length >= 4) {
+	type = (scan[2] << 8) | scan[3];
+	scan += 4;
+	frame_length -= 4;
+    }
+    if (type != ETHERTYPE_ARP_) {
+	map->stats.frames++;
+	map->stats.ignored++;
+	return (false);
+    }
+    return (S_process_arp(map, scan, frame_length, now));
+}
+
+bool
+ARPObservationMapLookup(ARPObservationMapRef map, struct in_addr ip,
+			uint32_t now, uint8_t * hwaddr)
+{
+    int		i;
+    uint32_t	slot;
+
+    slot = S_ip_hash(map, ip.s_addr);
+    for (i = 0; i < ARP_MAP_PROBE_MAX; i++) {
+	ARPObservation *	entry;
+
+	entry = map->entries + ((slot + i) & map->mask);
+	if (entry->ip == 0) {
+	    break;
+	}
+	if (entry->ip == ip.s_addr) {
+	    if (S_entry_is_current(map, entry, now) == false) {
+		break;
+	    }
+	    if (hwaddr != NULL) {
+		bcopy(entry->hwaddr, hwaddr, sizeof(entry->hwaddr));
+	    }
+	    map->stats.conflicts++;
+	    return (true);
+	}
+    }
+    return (false);
+}
+
+void
+ARPObservationMapGetStats(ARPObservationMapRef map, uint32_t now,
+			  ARPObservationStats * stats)
+{
+    uint32_t	count = 0;
+    uint32_t	i;
+
+    for (i = 0; i <= map->mask; i++) {
+	if (S_entry_is_current(map, map->entries + i, now)) {
+	    count++;
+	}
+    }
+    *stats = map->stats;
+    stats->entries = count;
+    return;
+}
+
+#ifdef TEST_ARPWATCH
+
+#include <sys/time.h>
+
+/*
+ * Replay a capture file (classic pcap format, Ethernet or Linux cooked
+ * link type) through the map, using the packet timestamps as the time,
+ * then look up the addresses given on the command line.
+ */
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define DLT_EN10MB_		1
+#define DLT_LINUX_SLL_		113
+#define SLL_HDR_LEN		16
+
+typedef struct {
+    uint32_t	magic;
+    uint16_t	version_major;
+    uint16_t	version_minor;
+    int32_t	thiszone;
+    uint32_t	sigfigs;
+    uint32_t	snaplen;
+    uint32_t	linktype;
+} pcap_file_header_t;
+
+typedef struct {
+    uint32_t	ts_sec;
+    uint32_t	ts_frac;
+    uint32_t	caplen;
+    uint32_t	len;
+} pcap_record_header_t;
+
+static uint32_t
+swap32(uint32_t val, bool swap)
+{
+    if (swap == false) {
+	return (val);
+    }
+    return (((val & 0xff) << 24) | ((val & 0xff00) << 8)
+	    | ((val >> 8) & 0xff00) | (val >> 24));
+}
+
+static bool
+replay(ARPObservationMapRef map, const char * path, uint32_t * last_time)
+{
+    uint8_t			buf[65536];
+    FILE *			f;
+    pcap_file_header_t		fh;
+    uint32_t			linktype;
+    uint32_t			magic;
+    int				records = 0;
+    bool			swap;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+	perror(path);
+	return (false);
+    }
+    if (fread(&fh, sizeof(fh), 1, f) != 1) {
+	fprintf(stderr, "%s: short file\n", path);
+	goto failed;
+    }
+    magic = fh.magic;
+    swap = (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC);
+    magic = swap32(magic, swap);
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC) {
+	fprintf(stderr, "%s: not a pcap file\n", path);
+	goto failed;
+    }
+    linktype = swap32(fh.linktype, swap);
+    if (linktype != DLT_EN10MB_ && linktype != DLT_LINUX_SLL_) {
+	fprintf(stderr, "%s: unsupported link type %u\n", path, linktype);
+	goto failed;
+    }
+    while (true) {
+	uint32_t		caplen;
+	pcap_record_header_t	rh;
+
+	if (fread(&rh, sizeof(rh), 1, f) != 1) {
+	    break;
+	}
+	caplen = swap32(rh.caplen, swap);
+	if (caplen > sizeof(buf) || fread(buf, caplen, 1, f) != 1) {
+	    fprintf(stderr, "%s: truncated record\n", path);
+	    break;
+	}
+	*last_time = swap32(rh.ts_sec, swap);
+	records++;
+	if (linktype == DLT_EN10MB_) {
+	    ARPObservationMapProcessFrame(map, buf, caplen, *last_time);
+	}
+	else if (caplen >= SLL_HDR_LEN
+		 && ((buf[14] << 8) | buf[15]) == ETHERTYPE_ARP_) {
+	    S_process_arp(map, buf + SLL_HDR_LEN, caplen - SLL_HDR_LEN,
+			  *last_time);
+	}
+	else {
+	    map->stats.frames++;
+	    map->stats.ignored++;
+	}
+    }
+    fclose(f);
+    printf("%s: %d records\n", path, records);
+    return (true);
+
+ failed:
+    fclose(f);
+    return (false);
+}
+
+static void
+print_stats(ARPObservationMapRef map, uint32_t now)
+{
+    ARPObservationStats	stats;
+
+    ARPObservationMapGetStats(map, now, &stats);
+    printf("frames %llu ignored %llu recorded %llu evicted %llu"
+	   " conflicts %llu entries %u/%u\n",
+	   (unsigned long long)stats.frames,
+	   (unsigned long long)stats.ignored,
+	   (unsigned long long)stats.recorded,
+	   (unsigned long long)stats.evicted,
+	   (unsigned long long)stats.conflicts,
+	   stats.entries, stats.capacity);
+    return;
+}
+
+static void
+bench(uint32_t count)
+{
+    uint8_t			hw[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 0 };
+    uint32_t			i;
+    struct in_addr		ip;
+    ARPObservationMapRef	map;
+    uint32_t			hits = 0;
+    struct timeval		start;
+    struct timeval		end;
+    double			secs;
+
+    map = ARPObservationMapCreate(count * 2, ARP_OBSERVATION_LIFETIME_DEFAULT);
+    for (i = 0; i < count; i++) {
+	ip.s_addr = htonl(0x0a000000 + i * 2);
+	hw[5] = (uint8_t)i;
+	ARPObservationMapRecord(map, ip, hw, 1000);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count * 2; i++) {
+	ip.s_addr = htonl(0x0a000000 + i);
+	if (ARPObservationMapLookup(map, ip, 1000, NULL)) {
+	    hits++;
+	}
+    }
+    gettimeofday(&end, NULL);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    printf("%u entries, %u lookups, %u in use, %.1f ns/lookup\n",
+	   count, count * 2, hits, secs * 1e9 / (count * 2));
+    print_stats(map, 1000);
+    ARPObservationMapFree(&map);
+    return;
+}
+
+int
+main(int argc, char * argv[])
+{
+    int				i;
+    uint32_t			last_time = 0;
+    ARPObservationMapRef	map;
+    uint32_t			lifetime = ARP_OBSERVATION_LIFETIME_DEFAULT;
+
+    if (argc >= 2 && strcmp(argv[1], "-bench") == 0) {
+	bench((argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 100000);
+	exit(0);
+    }
+    if (argc >= 3 && strcmp(argv[1], "-l") == 0) {
+	lifetime = (uint32_t)strtoul(argv[2], NULL, 0);
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc < 2) {
+	fprintf(stderr, "usage: arpwatch [ -l <lifetime> ] <pcap> [ <ip> ... ]\n"
+		"       arpwatch -bench [ <count> ]\n");
+	exit(1);
+    }
+    map = ARPObservationMapCreate(4096, lifetime);
+    if (replay(map, argv[1], &last_time) == false) {
+	exit(1);
+    }
+    for (i = 2; i < argc; i++) {
+	uint8_t		hw[ETHER_ADDR_LEN];
+	struct in_addr	ip;
+
+	if (inet_aton(argv[i], &ip) == 0) {
+	    fprintf(stderr, "invalid IP address %s\n", argv[i]);
+	    exit(1);
+	}
+	if (ARPObservationMapLookup(map, ip, last_time, hw)) {
+	    printf("%s in use by %02x:%02x:%02x:%02x:%02x:%02x\n",
+		   inet_ntoa(ip), hw[0], hw[1], hw[2], hw[3], hw[4], hw[5]);
+	}
+	else {
+	    printf("%s not in use\n", inet_ntoa(ip));
+	}
+    }
+    print_stats(map, last_time);
+    ARPObservationMapFree(&map);
+    exit(0);
+}
+
+#endif /* TEST_ARPWATCH */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * arpwatch.h
+ * - map of IP addresses observed in use in ARP traffic
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_ARPWATCH_H
+#define _S_ARPWATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define ARP_OBSERVATION_LIFETIME_DEFAULT	(20 * 60)
+
+typedef struct ARPObservationMap * ARPObservationMapRef;
+
+typedef struct {
+    uint64_t		frames;		/* ARP frames processed */
+    uint64_t		ignored;	/* malformed frames and probes */
+    uint64_t		recorded;	/* sender addresses recorded */
+    uint64_t		evicted;	/* current entries displaced */
+    uint64_t		conflicts;	/* lookups finding an address in use */
+    uint32_t		entries;	/* current entries */
+    uint32_t		capacity;
+} ARPObservationStats;
+
+ARPObservationMapRef
+ARPObservationMapCreate(uint32_t capacity, uint32_t lifetime_secs);
+
+void
+ARPObservationMapFree(ARPObservationMapRef * map_p);
+
+void
+ARPObservationMapSetLifetime(ARPObservationMapRef map, uint32_t lifetime_secs);
+
+/*
+ * Function: ARPObservationMapRecord
+ * Purpose:
+ *   Note that hwaddr (6 bytes) was seen using ip at time now.
+ */
+void
+ARPObservationMapRecord(ARPObservationMapRef map, struct in_addr ip,
+			const uint8_t * hwaddr, uint32_t now);
+
+/*
+ * Function: ARPObservationMapProcessFrame
+ * Purpose:
+ *   Record the sender of an Ethernet ARP frame.  Returns false if the
+ *   frame isn't an IPv4 over Ethernet ARP packet, or is an address
+ *   probe (sender address 0.0.0.0), which says nothing about use.
+ */
+bool
+ARPObservationMapProcessFrame(ARPObservationMapRef map, const void * frame,
+			      int frame_length, uint32_t now);
+
+/*
+ * Function: ARPObservationMapLookup
+ * Purpose:
+ *   Returns true if ip was observed in use within the lifetime, and
+ *   if hwaddr is not NULL, returns the hardware address using it.
+ *   A true return is counted as a conflict.
+ */
+bool
+ARPObservationMapLookup(ARPObservationMapRef map, struct in_addr ip,
+			uint32_t now, uint8_t * hwaddr);
+
+void
+ARPObservationMapGetStats(ARPObservationMapRef map, uint32_t now,
+			  ARPObservationStats * stats);
+
+#endif /* _S_ARPWATCH_H */
@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * bootarch.c
+ * - choose a network boot file by the client's system architecture
+ * - the table is a short list searched in order, so that the first entry
+ *   naming an architecture wins, as it reads in bootpd.plist
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <syslog.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include "bootarch.h"
+#include "cfutil.h"
+
+#ifdef TEST_BOOT_ARCH
+#define my_log(level, format, ...)					\
+    do {								\
+	if (S_test_verbose) {						\
+	    fprintf(stderr, format "\n", ## __VA_ARGS__);		\
+	}								\
+    } while (0)
+static bool	S_test_verbose;
+#else /* TEST_BOOT_ARCH */
+#include "mylog.h"
+#endif /* TEST_BOOT_ARCH */
+
+#define BOOT_ARCH_VENDOR_ARCH	":Arch:"
+
+/*
+ * Function: S_vendor_class_match
+ * Purpose:
+ *   Returns true if the vendor class is prefix, alone or followed by ':'.
+ */
+static bool
+S_vendor_class_match(const char * vendor_class, int length,
+		     const char * prefix)
+{
+    int		prefix_length = (int)strlen(prefix);
+
+    if (length < prefix_length
+	|| strncmp(vendor_class, prefix, prefix_length) != 0) {
+	return (false);
+    }
+    return (length == prefix_length || vendor_class[prefix_length] == ':');
+}
+
+/*
+ * Function: S_vendor_class_arch
+ * Purpose:
+ *   Get the architecture from a vendor class of the form
+ *   "PXEClient:Arch:xxxxx:UNDI:yyyzzz".
+ */
+static bool
+S_vendor_class_arch(const char * vendor_class, int length, uint16_t * arch)
+{
+    int		arch_length = (int)strlen(BOOT_ARCH_VENDOR_ARCH);
+    const char *	colon;
+    int		i;
+    uint32_t	val = 0;
+
+    colon = memchr(vendor_class, ':', length);
+    if (colon == NULL) {
+	return (false);
+    }
+    length -= (colon - vendor_class);
+    if (length <= arch_length
+	|| strncmp(colon, BOOT_ARCH_VENDOR_ARCH, arch_length) != 0) {
+	return (false);
+    }
+    for (i = arch_length; i < length && colon[i] != ':'; i++) {
+	if (colon[i] < '0' || colon[i] > '9' || val > UINT16_MAX) {
+	    return (false);
+	}
+	val = val * 10 + (colon[i] - '0');
+    }
+    if (i == arch_length || val > UINT16_MAX) {
+	return (false);
+    }
+    *arch = (uint16_t)val;
+    return (true);
+}
+
+bool
+BootArchClientInit(BootArchClient * client, dhcpol_t * options)
+{
+    const uint8_t *	arch_list;
+    int			length;
+    const char *	vendor_class;
+
+    bzero(client, sizeof(*client));
+    vendor_class = (const char *)
+	dhcpol_find(options, dhcptag_vendor_class_identifier_e, &length, NULL);
+    if (vendor_class == NULL) {
+	return (false);
+    }
+    if (S_vendor_class_match(vendor_class, length, BOOT_ARCH_PXE_CLIENT)) {
+	client->pxe = true;
+    }
+    else if (S_vendor_class_match(vendor_class, length,
+				  BOOT_ARCH_HTTP_CLIENT)) {
+	client->http = true;
+    }
+    else {
+	return (false);
+    }
+    arch_list = (const uint8_t *)
+	dhcpol_find_with_length(options,
+				dhcptag_client_system_architecture_e,
+				sizeof(uint16_t));
+    if (arch_list != NULL) {
+	client->arch = (uint16_t)((arch_list[0] << 8) | arch_list[1]);
+	client->arch_present = true;
+    }
+    else {
+	client->arch_present
+	    = S_vendor_class_arch(vendor_class, length, &client->arch);
+    }
+    return (client->arch_present);
+}
+
+const char *
+BootArchGetName(uint16_t arch)
+{
+    switch (arch) {
+    case BOOT_ARCH_X86_BIOS:
+	return ("x86 BIOS");
+    case BOOT_ARCH_X86_UEFI:
+	return ("x86 UEFI");
+    case BOOT_ARCH_X64_UEFI:
+	return ("x64 UEFI");
+    case BOOT_ARCH_EBC:
+	return ("EBC");
+    case BOOT_ARCH_ARM32_UEFI:
+	return ("ARM 32-bit UEFI");
+    case BOOT_ARCH_ARM64_UEFI:
+	return ("ARM 64-bit UEFI");
+    case BOOT_ARCH_X86_UEFI_HTTP:
+	return ("x86 UEFI HTTP");
+    case BOOT_ARCH_X64_UEFI_HTTP:
+	return ("x64 UEFI HTTP");
+    case BOOT_ARCH_EBC_HTTP:
+	return ("EBC HTTP");
+    case BOOT_ARCH_ARM32_UEFI_HTTP:
+	return ("ARM 32-bit UEFI HTTP");
+    case BOOT_ARCH_ARM64_UEFI_HTTP:
+	return ("ARM 64-bit UEFI HTTP");
+    default:
+	break;
+    }
+    return ("unknown");
+}
+
+typedef struct {
+    uint16_t		arch;
+    char *		bootfile;
+} BootArchEntry;
+
+struct BootArchTable {
+    int			count;
+    BootArchEntry	list[1];
+};
+
+static bool
+S_get_arch(CFNumberRef num, uint16_t * arch)
+{
+    int		val;
+
+    if (isA_CFNumber(num) == NULL
+	|| CFNumberGetValue(num, kCFNumberIntType, &val) == FALSE
+	|| val < 0 || val > UINT16_MAX) {
+	return (false);
+    }
+    *arch = (uint16_t)val;
+    return (true);
+}
+
+static void
+S_table_add(BootArchTableRef table, uint16_t arch, const char * bootfile)
+{
+    BootArchEntry *	entry = table->list + table->count;
+
+    entry->arch = arch;
+    entry->bootfile = strdup(bootfile);
+    table->count++;
+    return;
+}
+
+BootArchTableRef
+BootArchTableCreate(CFArrayRef list)
+{
+    int			count;
+    int			i;
+    int			n_archs = 0;
+    BootArchTableRef	table;
+
+    count = (int)CFArrayGetCount(list);
+    for (i = 0; i < count; i++) {
+	CFDictionaryRef	dict = CFArrayGetValueAtIndex(list, i);
+	CFTypeRef	prop;
+
+	if (isA_CFDictionary(dict) == NULL) {
+	    continue;
+	}
+	prop = CFDictionaryGetValue(dict,
+				    CFSTR(CFGPROP_BOOT_ARCH_ARCHITECTURE));
+	if (isA_CFArray(prop) != NULL) {
+	    n_archs += (int)CFArrayGetCount(prop);
+	}
+	else {
+	    n_archs++;
+	}
+    }
+    if (n_archs == 0) {
+	return (NULL);
+    }
+    table = (BootArchTableRef)malloc(sizeof(*table)
+				     + sizeof(table->list[0]) * n_archs);
+    table->count = 0;
+    for (i = 0; i < count; i++) {
+	uint16_t	arch;
+	CFTypeRef	archs;
+	char		bootfile[PATH_MAX];
+	CFStringRef	bootfile_cf;
+	CFDictionaryRef	dict = CFArrayGetValueAtIndex(list, i);
+	int		j;
+
+	if (isA_CFDictionary(dict) == NULL) {
+	    my_log(LOG_NOTICE, "boot_architectures: entry %d invalid", i);
+	    continue;
+	}
+	bootfile_cf = CFDictionaryGetValue(dict,
+					   CFSTR(CFGPROP_BOOT_ARCH_BOOTFILE));
+	bootfile[0] = '\0';
+	if (isA_CFString(bootfile_cf) != NULL) {
+	    my_CFStringToCStringAndLength(bootfile_cf, bootfile,
+					  sizeof(bootfile));
+	}
+	if (bootfile[0] == '\0') {
+	    my_log(LOG_NOTICE, "boot_architectures: entry %d missing %s",
+		   i, CFGPROP_BOOT_ARCH_BOOTFILE);
+	    continue;
+	}
+	archs = CFDictionaryGetValue(dict,
+				     CFSTR(CFGPROP_BOOT_ARCH_ARCHITECTURE));
+	if (isA_CFArray(archs) == NULL) {
+	    if (S_get_arch(archs, &arch) == false) {
+		my_log(LOG_NOTICE, "boot_architectures: entry %d invalid %s",
+		       i, CFGPROP_BOOT_ARCH_ARCHITECTURE);
+		continue;
+	    }
+	    S_table_add(table, arch, bootfile);
+	    continue;
+	}
+	for (j = 0; j < CFArrayGetCount(archs); j++) {
+	    if (S_get_arch(CFArrayGetValueAtIndex(archs, j), &arch) == false) {
+		my_log(LOG_NOTICE,
+		       "boot_architectures: entry %d invalid %s at %d",
+		       i, CFGPROP_BOOT_ARCH_ARCHITECTURE, j);
+		continue;
+	    }
+	    S_table_add(table, arch, bootfile);
+	}
+    }
+    if (table->count == 0) {
+	free(table);
+	return (NULL);
+    }
+    return (table);
+}
+
+void
+BootArchTableFree(BootArchTableRef * table_p)
+{
+    int			i;
+    BootArchTableRef	table = *table_p;
+
+    if (table == NULL) {
+	return;
+    }
+    for (i = 0; i < table->count; i++) {
+	free(table->list[i].bootfile);
+    }
+    free(table);
+    *table_p = NULL;
+    return;
+}
+
+int
+BootArchTableGetCount(BootArchTableRef table)
+{
+    return (table->count);
+}
+
+const char *
+BootArchTableLookup(BootArchTableRef table, uint16_t arch)
+{
+    int		i;
+
+    for (i = 0; i < table->count; i++) {
+	if (table->list[i].arch == arch) {
+	    return (table->list[i].bootfile);
+	}
+    }
+    return (NULL);
+}
+
+bool
+BootArchFileIsURL(const char * bootfile)
+{
+    return (strncasecmp(bootfile, "http://", 7) == 0
+	    || strncasecmp(bootfile, "https://", 8) == 0);
+}
+
+int
+BootArchRemoveBootOptions(const uint8_t * params, int count,
+			  uint8_t * params_buf)
+{
+    int		i;
+    int		n = 0;
+
+    for (i = 0; i < count; i++) {
+	switch (params[i]) {
+	case dhcptag_vendor_class_identifier_e:
+	case dhcptag_bootfile_name_e:
+	    break;
+	default:
+	    params_buf[n++] = params[i];
+	    break;
+	}
+    }
+    return (n);
+}
+
+#ifdef TEST_BOOT_ARCH
+
+static int	S_failures;
+
+static void
+check(bool ok, const char * what)
+{
+    if (ok == false) {
+	fprintf(stderr, "FAIL: %s\n", what);
+	S_failures++;
+    }
+    else if (S_test_verbose) {
+	printf("ok: %s\n", what);
+    }
+    return;
+}
+
+static bool
+client_init(BootArchClient * client, const char * vendor_class,
+	    const uint16_t * archs, int n_archs)
+{
+    uint8_t		arch_buf[8];
+    uint8_t		buf[256];
+    int			i;
+    dhcpoa_t		oa;
+    dhcpol_t		options;
+    bool		ret;
+
+    dhcpoa_init(&oa, buf, sizeof(buf));
+    if (vendor_class != NULL) {
+	dhcpoa_add(&oa, dhcptag_vendor_class_identifier_e,
+		   (int)strlen(vendor_class), vendor_class);
+    }
+    for (i = 0; i < n_archs; i++) {
+	arch_buf[i * 2] = archs[i] >> 8;
+	arch_buf[i * 2 + 1] = archs[i] & 0xff;
+    }
+    if (n_archs > 0) {
+	dhcpoa_add(&oa, dhcptag_client_system_architecture_e,
+		   n_archs * 2, arch_buf);
+    }
+    dhcpoa_add(&oa, dhcptag_end_e, 0, NULL);
+    dhcpol_init(&options);
+    dhcpol_parse_buffer(&options, buf, dhcpoa_used(&oa), NULL);
+    ret = BootArchClientInit(client, &options);
+    dhcpol_free(&options);
+    return (ret);
+}
+
+static CFDictionaryRef
+entry_create(const int * archs, int n_archs, const char * bootfile)
+{
+    CFMutableDictionaryRef	dict;
+    int				i;
+
+    dict = CFDictionaryCreateMutable(NULL, 0,
+				     &kCFTypeDictionaryKeyCallBacks,
+				     &kCFTypeDictionaryValueCallBacks);
+    if (n_archs == 1) {
+	CFNumberRef	num;
+
+	num = CFNumberCreate(NULL, kCFNumberIntType, archs);
+	CFDictionarySetValue(dict, CFSTR(CFGPROP_BOOT_ARCH_ARCHITECTURE), num);
+	CFRelease(num);
+    }
+    else {
+	CFMutableArrayRef	list;
+
+	list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+	for (i = 0; i < n_archs; i++) {
+	    CFNumberRef	num;
+
+	    num = CFNumberCreate(NULL, kCFNumberIntType, archs + i);
+	    CFArrayAppendValue(list, num);
+	    CFRelease(num);
+	}
+	CFDictionarySetValue(dict, CFSTR(CFGPROP_BOOT_ARCH_ARCHITECTURE),
+			     list);
+	CFRelease(list);
+    }
+    if (bootfile != NULL) {
+	CFStringRef	str;
+
+	str = CFStringCreateWithCString(NULL, bootfile,
+					kCFStringEncodingUTF8);
+	CFDictionarySetValue(dict, CFSTR(CFGPROP_BOOT_ARCH_BOOTFILE), str);
+	CFRelease(str);
+    }
+    return (dict);
+}
+
+int
+main(int argc, char * argv[])
+{
+    static const int	bios[] = { BOOT_ARCH_X86_BIOS };
+    BootArchClient	client;
+    CFDictionaryRef	dict;
+    static const int	http[] = { BOOT_ARCH_X64_UEFI_HTTP,
+				   BOOT_ARCH_ARM64_UEFI_HTTP };
+    CFMutableArrayRef	list;
+    static const int	overlap[] = { BOOT_ARCH_X64_UEFI };
+    BootArchTableRef	table;
+    uint8_t		params[] = { 1, 3, 60, 66, 67, 6, 67 };
+    uint8_t		params_buf[sizeof(params)];
+    static const int	uefi[] = { BOOT_ARCH_X64_UEFI,
+				   BOOT_ARCH_ARM64_UEFI };
+    uint16_t		x64 = BOOT_ARCH_X64_UEFI;
+    uint16_t		two[2] = { BOOT_ARCH_ARM64_UEFI, BOOT_ARCH_X64_UEFI };
+
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+	S_test_verbose = true;
+    }
+
+    /* client identification */
+    check(client_init(&client, "PXEClient:Arch:00007:UNDI:003016", NULL, 0)
+	  && client.pxe && !client.http && client.arch == 7,
+	  "PXE architecture from the vendor class");
+    check(client_init(&client, "HTTPClient:Arch:00016:UNDI:003001", NULL, 0)
+	  && client.http && !client.pxe && client.arch == 16,
+	  "HTTP architecture from the vendor class");
+    check(client_init(&client, "PXEClient:Arch:00000:UNDI:002001", &x64, 1)
+	  && client.arch == BOOT_ARCH_X64_UEFI,
+	  "option 93 takes precedence over the vendor class");
+    check(client_init(&client, "PXEClient", two, 2)
+	  && client.arch == BOOT_ARCH_ARM64_UEFI,
+	  "first architecture in option 93");
+    check(client_init(&client, "PXEClient", NULL, 0) == false
+	  && client.pxe,
+	  "PXE client without an architecture");
+    check(client_init(&client, "PXEClientX:Arch:00007", NULL, 0) == false
+	  && !client.pxe,
+	  "vendor class that only starts with PXEClient");
+    check(client_init(&client, "MSFT 5.0", &x64, 1) == false,
+	  "not a network boot client");
+    check(client_init(&client, NULL, &x64, 1) == false,
+	  "no vendor class");
+    check(client_init(&client, "PXEClient:Arch:99999:UNDI", NULL, 0)
+	  == false,
+	  "architecture out of range");
+
+    /* table */
+    list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    dict = entry_create(bios, 1, "pxelinux.0");
+    CFArrayAppendValue(list, dict);
+    CFRelease(dict);
+    dict = entry_create(uefi, 2, "grubnet.efi");
+    CFArrayAppendValue(list, dict);
+    CFRelease(dict);
+    dict = entry_create(overlap, 1, "shadowed.efi");
+    CFArrayAppendValue(list, dict);
+    CFRelease(dict);
+    dict = entry_create(http, 2, "http://images.example.com/boot.efi");
+    CFArrayAppendValue(list, dict);
+    CFRelease(dict);
+    dict = entry_create(bios, 1, NULL);
+    CFArrayAppendValue(list, dict);
+    CFRelease(dict);
+    table = BootArchTableCreate(list);
+    CFRelease(list);
+    check(table != NULL && BootArchTableGetCount(table) == 6,
+	  "table skips the entry without a bootfile");
+    check(strcmp(BootArchTableLookup(table, BOOT_ARCH_X86_BIOS),
+		 "pxelinux.0") == 0,
+	  "BIOS lookup");
+    check(strcmp(BootArchTableLookup(table, BOOT_ARCH_X64_UEFI),
+		 "grubnet.efi") == 0,
+	  "first entry wins");
+    check(strcmp(BootArchTableLookup(table, BOOT_ARCH_ARM64_UEFI),
+		 "grubnet.efi") == 0,
+	  "architecture array");
+    check(BootArchFileIsURL(BootArchTableLookup(table,
+						BOOT_ARCH_ARM64_UEFI_HTTP)),
+	  "URL boot file");
+    check(BootArchTableLookup(table, BOOT_ARCH_EBC) == NULL,
+	  "unknown architecture");
+    BootArchTableFree(&table);
+    check(table == NULL, "table freed");
+
+    /* parameter request list */
+    check(BootArchRemoveBootOptions(params, sizeof(params), params_buf) == 4
+	  && params_buf[2] == 66 && params_buf[3] == 6,
+	  "boot options removed from the parameter request list");
+
+    if (S_failures != 0) {
+	fprintf(stderr, "%d failures\n", S_failures);
+	exit(1);
+    }
+    printf("all tests passed\n");
+    exit(0);
+    return (0);
+}
+
+#endif /* TEST_BOOT_ARCH */
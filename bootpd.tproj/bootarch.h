@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * bootarch.h
+ * - choose a network boot file by the client's system architecture
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_BOOTARCH_H
+#define _S_BOOTARCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <CoreFoundation/CFArray.h>
+#include "dhcp_options.h"
+
+/*
+ * The vendor class identifiers (option 60) sent by PXE and UEFI HTTP Boot
+ * clients, e.g. "PXEClient:Arch:00007:UNDI:003016".  The server returns
+ * the prefix alone in its reply.
+ */
+#define BOOT_ARCH_PXE_CLIENT		"PXEClient"
+#define BOOT_ARCH_HTTP_CLIENT		"HTTPClient"
+
+/*
+ * Client system architecture types (RFC 4578, IANA registry)
+ */
+#define BOOT_ARCH_X86_BIOS		0
+#define BOOT_ARCH_X86_UEFI		6
+#define BOOT_ARCH_X64_UEFI		7
+#define BOOT_ARCH_EBC			9
+#define BOOT_ARCH_ARM32_UEFI		10
+#define BOOT_ARCH_ARM64_UEFI		11
+#define BOOT_ARCH_X86_UEFI_HTTP		15
+#define BOOT_ARCH_X64_UEFI_HTTP		16
+#define BOOT_ARCH_EBC_HTTP		17
+#define BOOT_ARCH_ARM32_UEFI_HTTP	18
+#define BOOT_ARCH_ARM64_UEFI_HTTP	19
+
+typedef struct {
+    bool		pxe;		/* vendor class is PXEClient */
+    bool		http;		/* vendor class is HTTPClient */
+    bool		arch_present;
+    uint16_t		arch;
+} BootArchClient;
+
+/*
+ * Function: BootArchClientInit
+ * Purpose:
+ *   Find out whether the request comes from a PXE or HTTP Boot client, and
+ *   its architecture.  The architecture is the first one in option 93, or
+ *   the one in the vendor class if option 93 is missing.
+ *   Returns true if the client is a PXE or HTTP Boot client that gave its
+ *   architecture.
+ */
+bool
+BootArchClientInit(BootArchClient * client, dhcpol_t * options);
+
+/*
+ * Function: BootArchGetName
+ * Purpose:
+ *   Return a name for the architecture, for logging.
+ */
+const char *
+BootArchGetName(uint16_t arch);
+
+/*
+ * Type: BootArchTableRef
+ * Purpose:
+ *   The boot file for each architecture, from the boot_architectures
+ *   property: an array of dictionaries, each with
+ *	architecture	an integer, or an array of integers
+ *	bootfile	a string
+ *   For a PXE client, bootfile is found like a bootptab boot file, in the
+ *   tftp directory.  For an HTTP Boot client it's a path in the HTTP boot
+ *   root, or a complete http:// or https:// URL.  The first entry that
+ *   lists the architecture is used.
+ */
+typedef struct BootArchTable * BootArchTableRef;
+
+#define CFGPROP_BOOT_ARCH_ARCHITECTURE	"architecture"
+#define CFGPROP_BOOT_ARCH_BOOTFILE	"bootfile"
+
+/*
+ * Function: BootArchTableCreate
+ * Purpose:
+ *   Create the table from the property.  Invalid entries are logged and
+ *   skipped.  Returns NULL if there are no valid entries.
+ */
+BootArchTableRef
+BootArchTableCreate(CFArrayRef list);
+
+void
+BootArchTableFree(BootArchTableRef * table_p);
+
+int
+BootArchTableGetCount(BootArchTableRef table);
+
+/*
+ * Function: BootArchTableLookup
+ * Purpose:
+ *   Return the boot file for the architecture, or NULL if there isn't one.
+ */
+const char *
+BootArchTableLookup(BootArchTableRef table, uint16_t arch);
+
+/*
+ * Function: BootArchFileIsURL
+ * Purpose:
+ *   Returns true if the boot file is a complete http:// or https:// URL.
+ */
+bool
+BootArchFileIsURL(const char * bootfile);
+
+/*
+ * Function: BootArchRemoveBootOptions
+ * Purpose:
+ *   Copy the parameter request list into params_buf without the vendor
+ *   class and boot file name, which the table supplies in place of the
+ *   subnet's values.  params_buf has room for count entries.  Returns the
+ *   number copied.
+ */
+int
+BootArchRemoveBootOptions(const uint8_t * params, int count,
+			  uint8_t * params_buf);
+
+#endif /* _S_BOOTARCH_H */
@@ -78,6 +78,7 @@
 #include <netinet/bootp.h>
 #include <netinet/if_ether.h>
 #include <net/if_arp.h>
+#include <net/bpf.h>
 #include <mach/boolean.h>
 #include <signal.h>
 #include <stdio.h>
@@ -90,11 +91,13 @@
 #include <arpa/inet.h>
 #include <arpa/nameser.h>
 #include <sys/uio.h>
+#include <sys/un.h>
 #include <resolv.h>
 #include <CoreFoundation/CFString.h>
 #include <CoreFoundation/CFNumber.h>
 #include <CoreFoundation/CFArray.h>
 #include <CoreFoundation/CFDictionary.h>
+#include <CoreFoundation/CFSet.h>
 #include <TargetConditionals.h>
 #include "cfutil.h"
 
@@ -119,10 +122,17 @@
 #include "bootpd-plist.h"
 #include "bootpdfile.h"
 #include "bootplookup.h"
-
-/* services */
-#define CFGPROP_BOOTP_ENABLED		"bootp_enabled"
-#define CFGPROP_DHCP_ENABLED		"dhcp_enabled"
+#include "configcache.h"
+#include "bpflib.h"
+#include "arpwatch.h"
+#include "relaytarget.h"
+#include "memaccount.h"
+#include "bootpdcontrol.h"
+#include "shadowconfig.h"
+#include "bootarch.h"
+#include "httpserver.h"
+
+/* services (see also shadowconfig.h) */
 #if NETBOOT_SERVER_SUPPORT
 #define CFGPROP_OLD_NETBOOT_ENABLED	"old_netboot_enabled"
 #define CFGPROP_NETBOOT_ENABLED		"netboot_enabled"
@@ -131,15 +141,23 @@
 #define CFGPROP_RELAY_ENABLED		"relay_enabled"
 #define CFGPROP_DHCP_IGNORE_CLIENT_IDENTIFIER	"dhcp_ignore_client_identifier"
 #define CFGPROP_DETECT_OTHER_DHCP_SERVER	"detect_other_dhcp_server"
-#define CFGPROP_IGNORE_ALLOW_DENY	"ignore_allow_deny"
 #define CFGPROP_IPV6_ONLY_PREFERRED	"ipv6_only_preferred"
 
-#define CFGPROP_ALLOW			"allow"
-#define CFGPROP_DENY			"deny"
-#define CFGPROP_REPLY_THRESHOLD_SECONDS	"reply_threshold_seconds"
 #define CFGPROP_RELAY_IP_LIST		"relay_ip_list"
-#define CFGPROP_USE_SERVER_CONFIG_FOR_DHCP_OPTIONS "use_server_config_for_dhcp_options"
+#define CFGPROP_RELAY_POLICY		"relay_policy"
 #define CFGPROP_IPV6_ONLY_WAIT		"ipv6_only_wait"
+#define CFGPROP_PER_INTERFACE_RECEIVE	"per_interface_receive"
+#define CFGPROP_LEASE_HISTORY_DAYS	"lease_history_days"
+#define CFGPROP_SUPERNET_ALLOCATION_POLICY "supernet_allocation_policy"
+#define CFGPROP_RANDOMIZED_MAC_LEASE	"randomized_mac_lease"
+#define CFGPROP_RANDOMIZED_MAC_USE_CLIENT_IDENTIFIER "randomized_mac_use_client_identifier"
+#define CFGPROP_ARP_OBSERVATION		"arp_observation"
+#define CFGPROP_ARP_OBSERVATION_LIFETIME "arp_observation_lifetime"
+#define CFGPROP_CONTROL_SOCKET		"control_socket"
+#define CFGPROP_SHADOW_CONFIG		"shadow_config"
+#define CFGPROP_BOOT_ARCHITECTURES	"boot_architectures"
+#define CFGPROP_HTTP_BOOT_ROOT		"http_boot_root"
+#define CFGPROP_HTTP_BOOT_PORT		"http_boot_port"
 #define CFGPROP_VERBOSE			"verbose"
 #define CFGPROP_DEBUG			"debug"
 
@@ -175,10 +193,14 @@
 #define SERVICE_DHCP_DISABLED			0x80000000
 
 /* global variables: */
+ARPObservationMapRef arp_observations;
 char		boot_tftp_dir[128] = "/private/tftpboot";
 int		bootp_socket = -1;
 bool		debug;
 bool		dhcp_ignore_client_identifier = FALSE;
+uint32_t	dhcp_lease_history_days = DHCP_LEASE_HISTORY_DAYS_DEFAULT;
+uint32_t	dhcp_randomized_mac_lease = 0;
+bool		dhcp_randomized_mac_use_client_identifier = FALSE;
 int		quiet = 0;
 uint32_t	reply_threshold_seconds = 0;
 unsigned short	server_priority = BSDP_PRIORITY_BASE;
@@ -202,7 +224,14 @@ bool		use_open_directory = USE_OPEN_DIRECTORY_DEFAULT;
 /* local types */
 
 /* local variables */
+static boolean_t		S_arp_observation;
+static uint32_t			S_arp_observation_lifetime
+					= ARP_OBSERVATION_LIFETIME_DEFAULT;
+static ptrlist_t		S_arp_watchers;	/* arp_watcher_t */
+static BootArchTableRef		S_boot_archs;
 static boolean_t		S_bootfile_noexist_reply = TRUE;
+static boolean_t		S_control_socket;
+static dispatch_source_t	S_control_source;
 static bool			S_debug;
 static u_int32_t		S_do_services = 0;
 static struct in_addr *		S_dns_servers = NULL;
@@ -210,7 +239,15 @@ static int			S_dns_servers_count = 0;
 static char *			S_domain_name = NULL;
 static uint8_t *		S_domain_search = NULL;
 static int			S_domain_search_size = 0;
+static uint32_t			S_http_boot_port = HTTP_SERVER_PORT_DEFAULT;
+static char *			S_http_boot_root;
+static ptrlist_t		S_http_clients;	/* http_client_t */
+static dispatch_source_t	S_http_idle_timer;
+static HTTPServerRef		S_http_server;
+static dispatch_source_t	S_http_source;
+static uint16_t			S_http_source_port;
 static ptrlist_t		S_if_list;
+static ptrlist_t		S_receivers;	/* receiver_t */
 static interface_list_t *	S_interfaces;
 static inetroute_list_t *	S_inetroutes = NULL;
 static u_short			S_ipport_client = IPPORT_BOOTPC;
@@ -220,7 +257,10 @@ static uint32_t			S_ipv6_only_wait;
 static struct timeval		S_lastmsgtime;
 /* ALIGN: S_rxpkt is aligned to at least sizeof(uint32_t) bytes */
 static uint32_t 		S_rxpkt[2048/(sizeof(uint32_t))];/* receive packet buffer */
+static ShadowEvalRef		S_shadow;
+static char *			S_shadow_config;
 static boolean_t		S_sighup = TRUE; /* fake the 1st sighup */
+static CFMutableSetRef		S_ipv4_changed_ifnames;
 static u_int32_t		S_which_services = 0;
 static struct ether_addr *	S_allow = NULL;
 static int			S_allow_count = 0;
@@ -229,16 +269,50 @@ static int			S_deny_count = 0;
 static int			S_persist = 0;
 static struct in_addr *		S_relay_ip_list = NULL;
 static int			S_relay_ip_list_count = 0;
+static RelayTargetSetRef	S_relay_targets = NULL;
+static int *			S_relay_target_indices = NULL;
 static int			S_max_hops = 4;
 static boolean_t		S_use_server_config_for_dhcp_options = TRUE;
 static boolean_t		S_verbose;
+static boolean_t		S_per_interface_receive = TRUE;
+static boolean_t		S_receivers_supported = TRUE;
+
+/*
+ * S_reconfig_stats
+ * - full_reloads: SIGHUP, startup, or a change we can't apply in place
+ * - scoped_updates: IPv4 address changes applied to a single interface
+ * - ignored_changes: IPv4 changes on interfaces we don't serve, or
+ *   that left the interface's addresses unchanged
+ */
+static struct {
+    uint32_t	full_reloads;
+    uint32_t	scoped_updates;
+    uint32_t	ignored_changes;
+} S_reconfig_stats;
 
 /* forward function declarations */
 static int 		issock(int fd);
 static void		bootp_request(request_t * request);
 static void		S_receive_packet(void);
+static void		S_receivers_update(void);
+static void		S_arp_watchers_update(void);
+static void		S_control_socket_update(void);
+static void		S_shadow_update(void);
+static void		S_http_server_update(void);
+static void		S_shadow_queue(interface_t * if_p, struct dhcp * pkt,
+				       dhcpol_t * options,
+				       dhcp_msgtype_t msgtype);
+static void		S_log_receive_stats(void);
+static void		S_log_arp_observation_stats(void);
+static void		S_log_relay_stats(void);
+static void		S_log_allocation_stats(void);
+static void		S_log_memory_stats(void);
+static void		S_log_shadow_stats(void);
+static void		S_log_http_boot_stats(void);
 static void		S_publish_disabled_interfaces(boolean_t publish);
 static void		S_add_ip_change_notifications();
+static void		S_reload_configuration(void);
+static void		S_apply_ipv4_changes(void);
 
 #define PID_FILE "/var/run/bootpd.pid"
 static void
@@ -587,53 +661,6 @@ S_disable_netboot()
 
 typedef int (*qsort_compare_func_t)(const void *, const void *);
 
-static struct ether_addr *
-S_make_ether_list(CFArrayRef array, int * count_p)
-{
-    CFIndex		array_count = CFArrayGetCount(array);
-    int			count = 0;
-    int			i;
-    struct ether_addr * list;
-
-    list = (struct ether_addr *)malloc(sizeof(*list) * array_count);
-    for (i = 0; i < array_count; i++) {
-	struct ether_addr * 	eaddr;
-	CFStringRef		str = CFArrayGetValueAtIndex(array, i);
-	char			val[64];
-
-	if (isA_CFString(str) == NULL) {
-	    continue;
-	}
-	if (CFStringGetCString(str, val, sizeof(val), kCFStringEncodingASCII)
-	    == FALSE) {
-	    continue;
-	}
-	if (strlen(val) < 2) {
-	    continue;
-	}
-	/* ignore ethernet hardware type, if present */
-	if (strncmp(val, "1,", 2) == 0) {
-	    eaddr = ether_aton(val + 2);
-	}
-	else {
-	    eaddr = ether_aton((char *)val);
-	}
-	if (eaddr == NULL) {
-	    continue;
-	}
-	list[count++] = *eaddr;
-    }
-    if (count == 0) {
-	free(list);
-	list = NULL;
-    }
-    else {
-	qsort(list, count, sizeof(*list), (qsort_compare_func_t)ether_cmp);
-    }
-    *count_p = count;
-    return (list);
-}
-
 static __inline__ boolean_t
 ignore_allow_deny(interface_t * if_p)
 {
@@ -698,10 +725,8 @@ S_ok_to_respond(interface_t * if_p, int hwtype, void * hwaddr, int hwlen)
 }
 
 static void
-S_refresh_allow_deny(CFDictionaryRef plist)
+S_refresh_allow_deny(ConfigCacheContentsRef config)
 {
-    CFArrayRef		prop;
-
     if (S_allow != NULL) {
 	free(S_allow);
 	S_allow = NULL;
@@ -710,23 +735,16 @@ S_refresh_allow_deny(CFDictionaryRef plist)
 	free(S_deny);
 	S_deny = NULL;
     }
-    S_allow_count = 0;
-    S_deny_count = 0;
-
-    if (plist == NULL) {
-	return;
-    }
 
-    /* allow */
-    prop = CFDictionaryGetValue(plist, CFSTR(CFGPROP_ALLOW));
-    if (isA_CFArray(prop) != NULL && CFArrayGetCount(prop) > 0) {
-	S_allow = S_make_ether_list(prop, &S_allow_count);
-    }
-    /* deny */
-    prop = CFDictionaryGetValue(plist, CFSTR(CFGPROP_DENY));
-    if (isA_CFArray(prop) != NULL && CFArrayGetCount(prop) > 0) {
-	S_deny = S_make_ether_list(prop, &S_deny_count);
-    }
+    /* take ownership of the already sorted lists */
+    S_allow = config->allow;
+    S_allow_count = config->allow_count;
+    config->allow = NULL;
+    config->allow_count = 0;
+    S_deny = config->deny;
+    S_deny_count = config->deny_count;
+    config->deny = NULL;
+    config->deny_count = 0;
     return;
 }
 
@@ -882,20 +900,179 @@ S_get_plist_uint32(CFDictionaryRef plist, CFStringRef prop_name_cf,
     return (ret);
 }
 
+static SubnetAllocationPolicy
+S_get_allocation_policy(CFDictionaryRef plist)
+{
+    CFStringRef		prop = NULL;
+
+    if (plist != NULL) {
+	prop = CFDictionaryGetValue(plist,
+				    CFSTR(CFGPROP_SUPERNET_ALLOCATION_POLICY));
+    }
+    if (isA_CFString(prop) == NULL) {
+	if (prop != NULL) {
+	    my_log(LOG_NOTICE, "Invalid '%s' property",
+		   CFGPROP_SUPERNET_ALLOCATION_POLICY);
+	}
+    }
+    else if (CFEqual(prop, CFSTR("least_utilized"))) {
+	return (kSubnetAllocationPolicyLeastUtilized);
+    }
+    else if (CFEqual(prop, CFSTR("weighted"))) {
+	return (kSubnetAllocationPolicyWeighted);
+    }
+    else if (CFEqual(prop, CFSTR("ordered")) == FALSE) {
+	my_log(LOG_NOTICE, "Unknown '%s' value '%@'",
+	       CFGPROP_SUPERNET_ALLOCATION_POLICY, prop);
+    }
+    return (kSubnetAllocationPolicyOrdered);
+}
+
+static RelayPolicy
+S_get_relay_policy(CFDictionaryRef plist)
+{
+    CFStringRef		prop = NULL;
+
+    if (plist != NULL) {
+	prop = CFDictionaryGetValue(plist, CFSTR(CFGPROP_RELAY_POLICY));
+    }
+    if (isA_CFString(prop) == NULL) {
+	if (prop != NULL) {
+	    my_log(LOG_NOTICE, "Invalid '%s' property",
+		   CFGPROP_RELAY_POLICY);
+	}
+    }
+    else if (CFEqual(prop, CFSTR("failover"))) {
+	return (kRelayPolicyFailover);
+    }
+    else if (CFEqual(prop, CFSTR("hash"))) {
+	return (kRelayPolicyHash);
+    }
+    else if (CFEqual(prop, CFSTR("all")) == FALSE) {
+	my_log(LOG_NOTICE, "Unknown '%s' value '%@'",
+	       CFGPROP_RELAY_POLICY, prop);
+    }
+    return (kRelayPolicyAll);
+}
+
+#define GET_PLIST_PATH(plist, prop_name)			\
+    S_get_path_property(plist, CFSTR(prop_name), prop_name)
+
+/*
+ * Function: S_get_path_property
+ * Purpose:
+ *   Return a copy of the path in the string property, or NULL if it
+ *   isn't set.
+ */
+static char *
+S_get_path_property(CFDictionaryRef plist, CFStringRef prop_name_cf,
+		    const char * prop_name)
+{
+    char		path[MAXPATHLEN];
+    CFStringRef		prop = NULL;
+
+    if (plist != NULL) {
+	prop = CFDictionaryGetValue(plist, prop_name_cf);
+    }
+    if (isA_CFString(prop) == NULL) {
+	if (prop != NULL) {
+	    my_log(LOG_NOTICE, "Invalid '%s' property", prop_name);
+	}
+	return (NULL);
+    }
+    my_CFStringToCStringAndLength(prop, path, sizeof(path));
+    if (path[0] == '\0') {
+	return (NULL);
+    }
+    return (strdup(path));
+}
+
+static BootArchTableRef
+S_get_boot_architectures(CFDictionaryRef plist)
+{
+    CFArrayRef		prop = NULL;
+    BootArchTableRef	table;
+
+    if (plist != NULL) {
+	prop = CFDictionaryGetValue(plist, CFSTR(CFGPROP_BOOT_ARCHITECTURES));
+    }
+    if (isA_CFArray(prop) == NULL) {
+	if (prop != NULL) {
+	    my_log(LOG_NOTICE, "Invalid '%s' property",
+		   CFGPROP_BOOT_ARCHITECTURES);
+	}
+	return (NULL);
+    }
+    table = BootArchTableCreate(prop);
+    if (table != NULL) {
+	my_log(LOG_INFO, "%s: %d architectures", CFGPROP_BOOT_ARCHITECTURES,
+	       BootArchTableGetCount(table));
+    }
+    return (table);
+}
+
+/*
+ * Function: S_relay_targets_update
+ * Purpose:
+ *   Make the relay target set match the relay server list.  If the list
+ *   is unchanged, keep the targets' state and statistics.
+ */
+static void
+S_relay_targets_update(RelayPolicy policy)
+{
+    int			i;
+    RelayTargetParams	params;
+
+    RelayTargetParamsInit(&params);
+    params.policy = policy;
+    if (S_relay_targets != NULL
+	&& RelayTargetSetGetCount(S_relay_targets) == S_relay_ip_list_count) {
+	for (i = 0; i < S_relay_ip_list_count; i++) {
+	    struct in_addr	addr;
+
+	    addr = RelayTargetSetGetAddress(S_relay_targets, i);
+	    if (addr.s_addr != S_relay_ip_list[i].s_addr) {
+		break;
+	    }
+	}
+	if (i == S_relay_ip_list_count) {
+	    RelayTargetSetSetParams(S_relay_targets, &params);
+	    return;
+	}
+    }
+    RelayTargetSetFree(&S_relay_targets);
+    if (S_relay_target_indices != NULL) {
+	free(S_relay_target_indices);
+	S_relay_target_indices = NULL;
+    }
+    if (S_relay_ip_list_count == 0) {
+	return;
+    }
+    S_relay_targets = RelayTargetSetCreate(S_relay_ip_list,
+					   S_relay_ip_list_count, &params);
+    if (S_relay_targets == NULL) {
+	my_log(LOG_NOTICE, "RelayTargetSetCreate failed");
+	return;
+    }
+    S_relay_target_indices
+	= (int *)malloc(sizeof(*S_relay_target_indices)
+			* S_relay_ip_list_count);
+    return;
+}
+
 static void
 S_update_services()
 {
+    ConfigCacheContents	config;
     uint32_t		num;
     CFDictionaryRef	plist = NULL;
     CFTypeRef		prop;
 
-    plist = my_CFPropertyListCreateFromFile(BOOTPD_PLIST_PATH);
-    if (plist != NULL) {
-	if (isA_CFDictionary(plist) == NULL) {
-	    CFRelease(plist);
-	    plist = NULL;
-	}
-    }
+    ConfigCacheLoad(BOOTPD_PLIST_PATH, BOOTPD_CONFIG_CACHE_PATH, &config);
+    my_log(LOG_INFO, "bootpd: configuration %s in %u usecs",
+	   config.from_cache ? "loaded from cache" : "parsed",
+	   config.load_usecs);
+    plist = config.plist;
     /* start with the set specified via command-line flags */
     S_which_services = S_do_services;
     verbose = S_verbose;
@@ -966,7 +1143,7 @@ S_update_services()
 			 SERVICE_IPV6_ONLY_PREFERRED);
     }
     /* allow/deny list */
-    S_refresh_allow_deny(plist);
+    S_refresh_allow_deny(&config);
 
     /* reply threshold */
     reply_threshold_seconds = 0;
@@ -974,6 +1151,11 @@ S_update_services()
 			  CFGPROP_REPLY_THRESHOLD_SECONDS,
 			  &reply_threshold_seconds);
 
+    /* number of days of lease history to keep, 0 to disable */
+    dhcp_lease_history_days = DHCP_LEASE_HISTORY_DAYS_DEFAULT;
+    SET_NUMBER_FROM_PLIST(plist,
+			  CFGPROP_LEASE_HISTORY_DAYS,
+			  &dhcp_lease_history_days);
 
     /* ignore the DHCP client identifier */
     dhcp_ignore_client_identifier = FALSE;
@@ -984,6 +1166,53 @@ S_update_services()
     if (num != 0) {
 	dhcp_ignore_client_identifier = TRUE;
     }
+
+    /* initial lease for clients with randomized addresses, 0 to disable */
+    dhcp_randomized_mac_lease = 0;
+    SET_NUMBER_FROM_PLIST(plist,
+			  CFGPROP_RANDOMIZED_MAC_LEASE,
+			  &dhcp_randomized_mac_lease);
+    dhcp_randomized_mac_use_client_identifier
+	= GET_PLIST_BOOLEAN(plist,
+			    CFGPROP_RANDOMIZED_MAC_USE_CLIENT_IDENTIFIER,
+			    FALSE);
+
+    /* don't offer addresses seen in use in ARP traffic */
+    S_arp_observation
+	= GET_PLIST_BOOLEAN(plist, CFGPROP_ARP_OBSERVATION, FALSE);
+    S_arp_observation_lifetime = ARP_OBSERVATION_LIFETIME_DEFAULT;
+    SET_NUMBER_FROM_PLIST(plist,
+			  CFGPROP_ARP_OBSERVATION_LIFETIME,
+			  &S_arp_observation_lifetime);
+
+    /* answer queries on the control socket */
+    S_control_socket
+	= GET_PLIST_BOOLEAN(plist, CFGPROP_CONTROL_SOCKET, FALSE);
+
+    /* candidate configuration to evaluate against live requests */
+    if (S_shadow_config != NULL) {
+	free(S_shadow_config);
+    }
+    S_shadow_config = GET_PLIST_PATH(plist, CFGPROP_SHADOW_CONFIG);
+
+    /* boot files chosen by the client's architecture */
+    BootArchTableFree(&S_boot_archs);
+    S_boot_archs = S_get_boot_architectures(plist);
+
+    /* serve files over HTTP to UEFI HTTP Boot clients */
+    if (S_http_boot_root != NULL) {
+	free(S_http_boot_root);
+    }
+    S_http_boot_root = GET_PLIST_PATH(plist, CFGPROP_HTTP_BOOT_ROOT);
+    S_http_boot_port = HTTP_SERVER_PORT_DEFAULT;
+    SET_NUMBER_FROM_PLIST(plist, CFGPROP_HTTP_BOOT_PORT, &S_http_boot_port);
+    if (S_http_boot_port == 0 || S_http_boot_port > UINT16_MAX) {
+	my_log(LOG_NOTICE, "Invalid '%s' property", CFGPROP_HTTP_BOOT_PORT);
+	S_http_boot_port = HTTP_SERVER_PORT_DEFAULT;
+    }
+
+    /* how relayed requests are spread across the relay servers */
+    S_relay_targets_update(S_get_relay_policy(plist));
 #if USE_OPEN_DIRECTORY
     /* use open directory [for bootpent queries] */
     use_open_directory
@@ -993,6 +1222,10 @@ S_update_services()
 	   use_open_directory ? "TRUE" : "FALSE");
 #endif /* USE_OPEN_DIRECTORY */
 
+    /* receive on a separate socket for each interface */
+    S_per_interface_receive
+	= GET_PLIST_BOOLEAN(plist, CFGPROP_PER_INTERFACE_RECEIVE, TRUE);
+
     /* check whether to supply our own configuration for missing dhcp options */
     S_use_server_config_for_dhcp_options
 	= GET_PLIST_BOOLEAN(plist, CFGPROP_USE_SERVER_CONFIG_FOR_DHCP_OPTIONS,
@@ -1000,21 +1233,18 @@ S_update_services()
 
     /* get the new list of subnets */
     SubnetListFree(&subnets);
-    if (plist != NULL) {
-	prop = CFDictionaryGetValue(plist, BOOTPD_PLIST_SUBNETS);
-	if (isA_CFArray(prop) != NULL) {
-	    subnets = SubnetListCreateWithArray(prop);
-	    if (subnets != NULL) {
-		if (verbose) {
-		    CFMutableStringRef	str;
-
-		    str = CFStringCreateMutable(NULL, 0);
-		    SubnetListPrintCFString(str, subnets);
-		    my_log(~LOG_DEBUG, "%@", str);
-		    CFRelease(str);
-		}
-	    }
-	}
+    subnets = config.subnets;
+    config.subnets = NULL;
+    if (subnets != NULL) {
+	SubnetListSetAllocationPolicy(subnets, S_get_allocation_policy(plist));
+    }
+    if (subnets != NULL && verbose) {
+	CFMutableStringRef	str;
+
+	str = CFStringCreateMutable(NULL, 0);
+	SubnetListPrintCFString(str, subnets);
+	my_log(~LOG_DEBUG, "%@", str);
+	CFRelease(str);
     }
 
     dhcp_init();
@@ -1026,9 +1256,7 @@ S_update_services()
 	}
     }
 #endif /* NETBOOT_SERVER_SUPPORT */
-    if (plist != NULL) {
-	CFRelease(plist);
-    }
+    ConfigCacheContentsFree(&config);
     return;
 }
 
@@ -1123,11 +1351,40 @@ install_sighup_handler(void)
     return;
 }
 
+static void
+install_siginfo_handler(void)
+{
+    dispatch_block_t	signal_block;
+    dispatch_source_t	signal_source;
+
+    signal_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL,
+					   SIGINFO,
+					   0,
+					   dispatch_get_main_queue());
+    signal_block = ^{
+	S_log_receive_stats();
+	S_log_allocation_stats();
+	S_log_arp_observation_stats();
+	S_log_relay_stats();
+	S_log_memory_stats();
+	S_log_shadow_stats();
+	S_log_http_boot_stats();
+    };
+    dispatch_source_set_event_handler(signal_source, signal_block);
+    dispatch_resume(signal_source);
+    signal(SIGINFO, SIG_IGN);
+    return;
+}
+
 static void
 idle_exit(void)
 {
     struct timeval tv;
 
+    if (ptrlist_count(&S_http_clients) != 0) {
+	/* don't cut off a boot file download */
+	return;
+    }
     gettimeofday(&tv, 0);
     if ((tv.tv_sec - S_lastmsgtime.tv_sec) >= MAXIDLE) {
 	my_log(LOG_NOTICE, "idle, exiting");
@@ -1173,6 +1430,13 @@ main(int argc, char * argv[])
     verbose = FALSE;		/* don't print extra information */
 
     ptrlist_init(&S_if_list);
+    ptrlist_init(&S_receivers);
+    ptrlist_init(&S_arp_watchers);
+    ptrlist_init(&S_reply_batch);
+    ptrlist_init(&S_http_clients);
+
+    /* keep the BPF descriptors used for replies open */
+    udpv4_transmit_set_bpf_cache(1);
 
     S_get_interfaces();
 
@@ -1341,6 +1605,13 @@ main(int argc, char * argv[])
 	    my_log(LOG_NOTICE, "setsockopt(SO_REUSEADDR) failed");
 	    exit(1);
 	}
+	/* allow the per-interface receive sockets to share the port */
+	if (setsockopt(bootp_socket, SOL_SOCKET, SO_REUSEPORT, (caddr_t)&opt,
+		       sizeof(opt)) < 0) {
+	    my_log(LOG_NOTICE, "setsockopt(SO_REUSEPORT) failed, %s",
+		   strerror(errno));
+	    S_receivers_supported = FALSE;
+	}
 #if defined(SO_TRAFFIC_CLASS)
 	opt = SO_TC_CTL;
 	/* set traffic class */
@@ -1379,6 +1650,9 @@ main(int argc, char * argv[])
     /* install our sighup handler */
     install_sighup_handler();
 
+    /* SIGINFO logs the receive statistics */
+    install_siginfo_handler();
+
     if (ip_change_notifications) {
 	S_add_ip_change_notifications();
     }
@@ -1528,6 +1802,81 @@ bootp_add_bootfile(const char * request_file, const char * hostname,
     return (TRUE);
 }
 
+/*
+ * Function: add_boot_arch_options
+ *
+ * Purpose:
+ *   If the request comes from a PXE or UEFI HTTP Boot client whose
+ *   architecture is listed in boot_architectures, add the vendor class
+ *   and boot file name options that tell it what to boot.  A PXE client
+ *   gets a TFTP path, found like a bootptab boot file.  An HTTP Boot
+ *   client gets a URL, on this server if http_boot_root is set.
+ *   Returns TRUE if the options were added.
+ */
+boolean_t
+add_boot_arch_options(request_t * request, const char * hostname,
+		      struct dhcp * reply, dhcpoa_t * options)
+{
+    const char *	bootfile;
+    BootArchClient	client;
+    char		file[DHCP_OPTION_SIZE_MAX + 1];
+    const char *	vendor_class;
+
+    if (S_boot_archs == NULL
+	|| BootArchClientInit(&client, request->options_p) == FALSE) {
+	return (FALSE);
+    }
+    bootfile = BootArchTableLookup(S_boot_archs, client.arch);
+    if (bootfile == NULL) {
+	my_log(LOG_DEBUG, "no boot file for architecture %d (%s)",
+	       client.arch, BootArchGetName(client.arch));
+	return (FALSE);
+    }
+    if (client.http) {
+	vendor_class = BOOT_ARCH_HTTP_CLIENT;
+	if (BootArchFileIsURL(bootfile)) {
+	    strlcpy(file, bootfile, sizeof(file));
+	}
+	else if (S_http_source == NULL) {
+	    my_log(LOG_INFO, "HTTP boot file %s needs %s", bootfile,
+		   CFGPROP_HTTP_BOOT_ROOT);
+	    return (FALSE);
+	}
+	else {
+	    char	port[8];
+
+	    port[0] = '\0';
+	    if (S_http_source_port != HTTP_SERVER_PORT_DEFAULT) {
+		snprintf(port, sizeof(port), ":%d", S_http_source_port);
+	    }
+	    snprintf(file, sizeof(file), "http://%s%s%s%s",
+		     inet_ntoa(reply->dp_siaddr), port,
+		     (bootfile[0] == '/') ? "" : "/", bootfile);
+	}
+    }
+    else {
+	vendor_class = BOOT_ARCH_PXE_CLIENT;
+	file[0] = '\0';
+	if (bootp_add_bootfile(NULL, hostname, bootfile, file,
+			       sizeof(file)) == FALSE
+	    || file[0] == '\0') {
+	    return (FALSE);
+	}
+    }
+    if (dhcpoa_add(options, dhcptag_vendor_class_identifier_e,
+		   (int)strlen(vendor_class), vendor_class)
+	!= dhcpoa_success_e
+	|| dhcpoa_add(options, dhcptag_bootfile_name_e,
+		      (int)strlen(file), file) != dhcpoa_success_e) {
+	my_log(LOG_NOTICE, "couldn't add boot file: %s",
+	       dhcpoa_err(options));
+	return (FALSE);
+    }
+    my_log(LOG_INFO, "%s %s boot file %s", vendor_class,
+	   BootArchGetName(client.arch), file);
+    return (TRUE);
+}
+
 #define NIPROP_IP_ADDRESS	"ip_address"
 
 /*
@@ -1716,11 +2065,122 @@ bootp_request(request_t * request)
 }
 
 
+/**
+ ** Reply batches
+ **
+ ** The packets handled in one turn of the main queue form a batch.
+ ** Replies sent during a batch are queued, and when the batch ends,
+ ** the lease file is written once for all of the batch's new bindings
+ ** before the replies are transmitted.  A burst of clients then costs a
+ ** single lease file write instead of one per ACK, and no client sees an
+ ** ACK for a binding that hasn't been written.
+ **/
+
+typedef struct {
+    char		ifname[IFNAMSIZ + 1];
+    int			hwtype;
+    boolean_t		hwaddr_valid;
+    uint8_t		hwaddr[16];
+    struct in_addr	dst;
+    struct in_addr	src;
+    u_short		dest_port;
+    u_short		src_port;
+    int			length;
+    /* ALIGN: pkt follows the aligned fields above */
+    uint32_t		pkt[];
+} queued_reply_t;
+
+static boolean_t	S_reply_batch_active;
+static ptrlist_t	S_reply_batch;		/* queued_reply_t */
+
+boolean_t
+reply_batch_active(void)
+{
+    return (S_reply_batch_active);
+}
+
+static void
+S_reply_batch_begin(void)
+{
+    S_reply_batch_active = TRUE;
+    return;
+}
+
+/*
+ * Function: S_reply_batch_queue
+ * Purpose:
+ *   Queue the reply to be sent when the batch ends.  Returns FALSE if
+ *   it couldn't be queued.
+ */
+static boolean_t
+S_reply_batch_queue(interface_t * if_p, const void * hwaddr,
+		    struct in_addr dst, u_short dest_port, u_short src_port,
+		    struct bootp * bp, int n)
+{
+    queued_reply_t *	q;
+
+    q = (queued_reply_t *)malloc(sizeof(*q) + n);
+    if (q == NULL) {
+	return (FALSE);
+    }
+    strlcpy(q->ifname, if_name(if_p), sizeof(q->ifname));
+    q->hwtype = if_link_arptype(if_p);
+    q->hwaddr_valid = (hwaddr != NULL);
+    if (hwaddr != NULL) {
+	bcopy(hwaddr, q->hwaddr, sizeof(q->hwaddr));
+    }
+    q->dst = dst;
+    q->src = if_inet_addr(if_p);
+    q->dest_port = dest_port;
+    q->src_port = src_port;
+    q->length = n;
+    bcopy(bp, q->pkt, n);
+    ptrlist_add(&S_reply_batch, q);
+    return (TRUE);
+}
+
+/*
+ * Function: S_reply_batch_end
+ * Purpose:
+ *   Write the lease file if the batch changed it, then transmit the
+ *   queued replies in order.  If the lease file can't be written, the
+ *   replies are dropped, as they would have been without batching.
+ */
+static void
+S_reply_batch_end(void)
+{
+    int		count;
+    boolean_t	committed;
+    int		i;
+
+    S_reply_batch_active = FALSE;
+    count = ptrlist_count(&S_reply_batch);
+    committed = dhcp_commit_pending();
+    if (committed == FALSE && count != 0) {
+	my_log(LOG_NOTICE, "lease commit failed, dropping %d replies", count);
+    }
+    for (i = 0; i < count; i++) {
+	queued_reply_t *	q = ptrlist_element(&S_reply_batch, i);
+
+	if (committed
+	    && bootp_transmit(bootp_socket, transmit_buffer, q->ifname,
+			      q->hwtype, q->hwaddr_valid ? q->hwaddr : NULL,
+			      q->dst, q->src, q->dest_port, q->src_port,
+			      q->pkt, q->length) < 0) {
+	    my_log(LOG_INFO, "transmit failed, %m");
+	}
+	free(q);
+    }
+    ptrlist_free(&S_reply_batch);
+    return;
+}
+
 /*
  * Function: sendreply
  *
  * Purpose:
- *   Send a reply packet to the client.
+ *   Send a reply packet to the client.  During a batch, the reply is
+ *   queued and sent when the batch ends.
  */
 boolean_t
 sendreply(interface_t * if_p, struct bootp * bp, int n, 
@@ -1729,6 +2189,7 @@ sendreply(interface_t * if_p, struct bootp * bp, int n,
     struct in_addr 		dst;
     u_short			dest_port = S_ipport_client;
     void *			hwaddr = NULL;
+    boolean_t			queued = FALSE;
     u_short			src_port = S_ipport_server;
 
     /*
@@ -1763,12 +2224,25 @@ sendreply(interface_t * if_p, struct bootp * bp, int n,
 	}
 	my_log(LOG_DEBUG, "replying to %s", inet_ntoa(dst));
     }
-    if (bootp_transmit(bootp_socket, transmit_buffer, if_name(if_p),
-		       if_link_arptype(if_p),
-		       hwaddr,
-		       dst, if_inet_addr(if_p),
-		       dest_port, src_port,
-		       bp, n) < 0) {
+    if (S_reply_batch_active) {
+	queued = S_reply_batch_queue(if_p, hwaddr, dst, dest_port, src_port,
+				     bp, n);
+	if (queued == FALSE) {
+	    /* send it now, but not before the binding it carries is written */
+	    my_log(LOG_NOTICE, "can't queue reply, sending it now");
+	    if (dhcp_commit_pending() == FALSE) {
+		my_log(LOG_NOTICE, "lease commit failed, dropping reply");
+		return (FALSE);
+	    }
+	}
+    }
+    if (queued == FALSE
+	&& bootp_transmit(bootp_socket, transmit_buffer, if_name(if_p),
+			  if_link_arptype(if_p),
+			  hwaddr,
+			  dst, if_inet_addr(if_p),
+			  dest_port, src_port,
+			  bp, n) < 0) {
 	my_log(LOG_INFO, "transmit failed, %m");
 	return (FALSE);
     }
@@ -1988,48 +2462,177 @@ static struct iovec  	iov;
 static struct msghdr 	msg;
 
 static void
-S_init_msg()
+S_init_msg_with_buffers(struct msghdr * msg_p, struct iovec * iov_p,
+			void * pkt, size_t pkt_size,
+			void * control_buf, size_t control_size)
 {
-    msg.msg_name = 0;
-    msg.msg_namelen = 0;
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = control;
-    msg.msg_controllen = sizeof(control);
-    msg.msg_flags = 0;
-    iov.iov_base = (caddr_t)S_rxpkt;
-    iov.iov_len = sizeof(S_rxpkt);
+    msg_p->msg_name = 0;
+    msg_p->msg_namelen = 0;
+    msg_p->msg_iov = iov_p;
+    msg_p->msg_iovlen = 1;
+    msg_p->msg_control = control_buf;
+    msg_p->msg_controllen = (socklen_t)control_size;
+    msg_p->msg_flags = 0;
+    iov_p->iov_base = (caddr_t)pkt;
+    iov_p->iov_len = pkt_size;
     return;
 }
 
 static void
-S_relay_packet(struct bootp * bp, int n, interface_t * if_p)
+S_init_msg()
 {
-    boolean_t	clear_giaddr = FALSE;
-    int		i;
-    boolean_t	printed = FALSE;
-    u_int16_t	secs;
-
-    if (n < sizeof(struct bootp))
-	return;
+    S_init_msg_with_buffers(&msg, &iov, S_rxpkt, sizeof(S_rxpkt),
+			    control, sizeof(control));
+    return;
+}
 
-    switch (bp->bp_op) {
-    case BOOTREQUEST:
-	if (bp->bp_hops >= S_max_hops)
-	    return;
-	secs = (u_int16_t)ntohs(bp->bp_secs);
-	if (secs < reply_threshold_seconds) {
-	    /* don't bother yet */
-	    break;
-	}
-	if (bp->bp_giaddr.s_addr == 0) {
-	    /* fill it in with our interface address */
-	    bp->bp_giaddr = if_inet_addr(if_p);
+/*
+ * Function: S_relay_select_targets
+ * Purpose:
+ *   Choose the relay servers to send the request to, and return the
+ *   count.  Set *expect_reply to TRUE if a server that receives the
+ *   request is expected to answer it: a DHCPREQUEST without a server
+ *   identifier, DHCPDECLINE, and DHCPRELEASE may go unanswered.
+ *   Set *server_id_p to the request's server identifier, if any; only
+ *   that server is expected to answer.
+ */
+static int
+S_relay_select_targets(struct bootp * bp, int n, boolean_t * expect_reply,
+		       struct in_addr * server_id_p)
+{
+    int			count;
+    boolean_t		expect = TRUE;
+    const void *	key = bp->bp_chaddr;
+    int			key_length;
+    dhcp_msgtype_t	msgtype = dhcp_msgtype_none_e;
+    dhcpol_t		options;
+    struct in_addr	server_id = { 0 };
+
+    key_length = (bp->bp_hlen > sizeof(bp->bp_chaddr))
+	? sizeof(bp->bp_chaddr) : bp->bp_hlen;
+    dhcpol_init(&options);
+    if (dhcpol_parse_packet(&options, (struct dhcp *)bp, n, NULL)
+	&& is_dhcp_packet(&options, &msgtype)) {
+	const void *	opt;
+	int		opt_length;
+
+	opt = dhcpol_find(&options, dhcptag_client_identifier_e,
+			  &opt_length, NULL);
+	if (opt != NULL && opt_length > 0) {
+	    key = opt;
+	    key_length = opt_length;
+	}
+	opt = dhcpol_find(&options, dhcptag_server_identifier_e,
+			  &opt_length, NULL);
+	if (opt != NULL && opt_length == sizeof(server_id)) {
+	    bcopy(opt, &server_id, sizeof(server_id));
+	}
+	switch (msgtype) {
+	case dhcp_msgtype_discover_e:
+	case dhcp_msgtype_inform_e:
+	    break;
+	case dhcp_msgtype_request_e:
+	    expect = (server_id.s_addr != 0);
+	    break;
+	default:
+	    expect = FALSE;
+	    break;
+	}
+    }
+    count = RelayTargetSetSelect(S_relay_targets, key, key_length,
+				 server_id, expect, &S_lastmsgtime,
+				 S_relay_target_indices);
+    dhcpol_free(&options);
+    *expect_reply = expect;
+    *server_id_p = server_id;
+    return (count);
+}
+
+static struct in_addr
+S_packet_server_id(struct bootp * bp, int n)
+{
+    dhcpol_t		options;
+    struct in_addr	server_id = { 0 };
+
+    dhcpol_init(&options);
+    if (dhcpol_parse_packet(&options, (struct dhcp *)bp, n, NULL)) {
+	const void *	opt;
+	int		opt_length;
+
+	opt = dhcpol_find(&options, dhcptag_server_identifier_e,
+			  &opt_length, NULL);
+	if (opt != NULL && opt_length == sizeof(server_id)) {
+	    bcopy(opt, &server_id, sizeof(server_id));
+	}
+    }
+    dhcpol_free(&options);
+    return (server_id);
+}
+
+static void
+S_log_relay_stats(void)
+{
+    int			i;
+    struct timeval	now;
+
+    if (S_relay_targets == NULL) {
+	return;
+    }
+    gettimeofday(&now, NULL);
+    RelayTargetSetExpire(S_relay_targets, &now);
+    for (i = 0; i < RelayTargetSetGetCount(S_relay_targets); i++) {
+	RelayTargetStats	stats;
+
+	RelayTargetSetGetStats(S_relay_targets, i, &stats);
+	my_log(LOG_NOTICE, "relay %s %s: %llu forwarded, %llu replies,"
+	       " %llu lost, %llu probes, latency avg %u min %u max %u usecs",
+	       inet_ntoa(stats.addr), stats.up ? "up" : "down",
+	       (unsigned long long)stats.forwarded,
+	       (unsigned long long)stats.replies,
+	       (unsigned long long)stats.lost,
+	       (unsigned long long)stats.probes,
+	       stats.latency_avg_usecs, stats.latency_min_usecs,
+	       stats.latency_max_usecs);
+    }
+    return;
+}
+
+static void
+S_relay_packet(struct bootp * bp, int n, interface_t * if_p,
+	       const struct sockaddr_in * from_p)
+{
+    boolean_t	clear_giaddr = FALSE;
+    int		count;
+    boolean_t	expect_reply;
+    int		i;
+    boolean_t	printed = FALSE;
+    u_int16_t	secs;
+    struct in_addr	server_id;
+
+    if (n < sizeof(struct bootp))
+	return;
+
+    switch (bp->bp_op) {
+    case BOOTREQUEST:
+	if (bp->bp_hops >= S_max_hops)
+	    return;
+	secs = (u_int16_t)ntohs(bp->bp_secs);
+	if (secs < reply_threshold_seconds) {
+	    /* don't bother yet */
+	    break;
+	}
+	if (bp->bp_giaddr.s_addr == 0) {
+	    /* fill it in with our interface address */
+	    bp->bp_giaddr = if_inet_addr(if_p);
 	    clear_giaddr = TRUE;
 	}
 	bp->bp_hops++;
-	for (i = 0; i < S_relay_ip_list_count; i++) {
-	    struct in_addr relay = S_relay_ip_list[i];
+	count = S_relay_select_targets(bp, n, &expect_reply, &server_id);
+	for (i = 0; i < count; i++) {
+	    int			index = S_relay_target_indices[i];
+	    struct in_addr	relay;
+
+	    relay = RelayTargetSetGetAddress(S_relay_targets, index);
 	    if (relay.s_addr == if_inet_broadcast(if_p).s_addr) {
 		continue; /* don't rebroadcast */
 	    }
@@ -2051,6 +2654,13 @@ S_relay_packet(struct bootp * bp, int n, interface_t * if_p)
 		my_log(LOG_NOTICE, "send to %s failed, %m", inet_ntoa(relay));
 	    }
 	    else {
+		boolean_t	expect;
+
+		expect = expect_reply
+		    && (server_id.s_addr == 0
+			|| server_id.s_addr == relay.s_addr);
+		RelayTargetSetNoteForward(S_relay_targets, index, bp->bp_xid,
+					  expect, &S_lastmsgtime);
 		my_log(LOG_INFO,
 		       "Relayed Request [%s] to %s", if_name(if_p),
 		       inet_ntoa(relay));
@@ -2072,6 +2682,11 @@ S_relay_packet(struct bootp * bp, int n, interface_t * if_p)
 	if (if_p == NULL) { /* we aren't the gateway - discard */
 	    break;
 	}
+	if (from_p != NULL) {
+	    RelayTargetSetNoteReply(S_relay_targets, from_p->sin_addr,
+				    S_packet_server_id(bp, n), bp->bp_xid,
+				    &S_lastmsgtime);
+	}
 	
 	if ((ntohs(bp->bp_unused) & DHCP_FLAGS_BROADCAST)) {
 	    my_log(LOG_DEBUG, "replying using broadcast IP address");
@@ -2116,7 +2731,8 @@ S_relay_packet(struct bootp * bp, int n, interface_t * if_p)
  */
 static void
 S_dispatch_request(struct bootp * bp, int n, interface_t * if_p,
-		   struct in_addr * dstaddr_p)
+		   struct in_addr * dstaddr_p,
+		   const struct sockaddr_in * from_p)
 {
 #if NETBOOT_SERVER_SUPPORT
     boolean_t		bsdp_pkt = FALSE;
@@ -2208,6 +2824,10 @@ S_dispatch_request(struct bootp * bp, int n, interface_t * if_p,
 	if (handled == FALSE && bootp_enabled(if_p)) {
 	    bootp_request(&request);
 	}
+	if (S_shadow != NULL) {
+	    S_shadow_queue(if_p, request.pkt, request.options_p,
+			   dhcp_msgtype);
+	}
       request_done:
 	dhcpol_free(&options);
 	break;
@@ -2220,9 +2840,8 @@ S_dispatch_request(struct bootp * bp, int n, interface_t * if_p,
 	break;
     }
 
-    if (S_relay_ip_list != NULL && relay_enabled(if_p)) {
-	/* ALIGN: S_rxpkt is aligned to uint32, cast safe */
-	S_relay_packet((struct bootp *)(void *)S_rxpkt, n, if_p);
+    if (S_relay_targets != NULL && relay_enabled(if_p)) {
+	S_relay_packet(bp, n, if_p, from_p);
     }
 
     if (verbose) {
@@ -2238,12 +2857,12 @@ S_dispatch_request(struct bootp * bp, int n, interface_t * if_p,
 }
 
 static void *
-S_parse_control(int level, int type, int * len)
+S_parse_control(struct msghdr * msg_p, int level, int type, int * len)
 {
     struct cmsghdr *	cmsg;
 
     *len = 0;
-    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    for (cmsg = CMSG_FIRSTHDR(msg_p); cmsg; cmsg = CMSG_NXTHDR(msg_p, cmsg)) {
 	if (cmsg->cmsg_level == level 
 	    && cmsg->cmsg_type == type) {
 	    if (cmsg->cmsg_len < sizeof(*cmsg))
@@ -2255,21 +2874,27 @@ S_parse_control(int level, int type, int * len)
     return (NULL);
 }
 
-static interface_t *
-S_which_interface()
+static boolean_t
+S_which_ifname(struct msghdr * msg_p, char * ifname, int ifname_size)
 {
     struct sockaddr_dl *dl_p;
-    char		ifname[IFNAMSIZ + 1];
-    interface_t *	if_p = NULL;
     int 		len = 0;
 
-    dl_p = (struct sockaddr_dl *)S_parse_control(IPPROTO_IP, IP_RECVIF, &len);
-    if (dl_p == NULL || len == 0 || dl_p->sdl_nlen >= sizeof(ifname)) {
-	return (NULL);
+    dl_p = (struct sockaddr_dl *)S_parse_control(msg_p, IPPROTO_IP, IP_RECVIF,
+						 &len);
+    if (dl_p == NULL || len == 0 || dl_p->sdl_nlen >= ifname_size) {
+	return (FALSE);
     }
-    
     bcopy(dl_p->sdl_data, ifname, dl_p->sdl_nlen);
     ifname[dl_p->sdl_nlen] = '\0';
+    return (TRUE);
+}
+
+static interface_t *
+S_which_interface(const char * ifname)
+{
+    interface_t *	if_p = NULL;
+
     if_p = ifl_find_name(S_interfaces, ifname);
     if (if_p == NULL) {
 	if (verbose)
@@ -2301,67 +2926,419 @@ S_which_interface()
 }
 
 static struct in_addr *
-S_which_dstaddr()
+S_which_dstaddr(struct msghdr * msg_p)
 {
     void *	data;
     int		len = 0;
     
-    data = S_parse_control(IPPROTO_IP, IP_RECVDSTADDR, &len);
+    data = S_parse_control(msg_p, IPPROTO_IP, IP_RECVDSTADDR, &len);
     if (data && len == sizeof(struct in_addr))
 	return ((struct in_addr *)data);
     return (NULL);
 }
 
+static void
+S_log_reconfig_stats(void)
+{
+    my_log(LOG_INFO, "reconfiguration: %u full reload(s), "
+	   "%u scoped update(s), %u ignored change(s)",
+	   S_reconfig_stats.full_reloads,
+	   S_reconfig_stats.scoped_updates,
+	   S_reconfig_stats.ignored_changes);
+    return;
+}
+
 /*
- * Function: S_receive_packet
+ * Function: S_reload_configuration
  * Purpose:
- *   Receive event handler for BOOTP/DHCP server port.
+ *   Re-read everything: bootptab, interfaces, routes, the configuration
+ *   plist, and DNS.
  */
 static void
-S_receive_packet()
+S_reload_configuration(void)
 {
-    struct in_addr * 	dstaddr_p = NULL;
-    struct sockaddr_in 	from = { sizeof(from), AF_INET };
-    interface_t *	if_p = NULL;
-    ssize_t		n;
-    /* ALIGN: S_rxpkt is aligned to uint32, hence cast safe */
-    struct dhcp *	request = (struct dhcp *)(void *)S_rxpkt;
+    bootp_readtab(NULL);
 
-    S_init_msg();
-    msg.msg_name = (caddr_t)&from;
-    msg.msg_namelen = sizeof(from);
-    n = recvmsg(bootp_socket, &msg, 0);
-    if (n < 0) {
-	my_log(LOG_DEBUG, "recvmsg failed, %m");
-	goto no_reply;
+    if (gethostname(server_name, sizeof(server_name) - 1)) {
+	server_name[0] = '\0';
+	my_log(LOG_INFO, "gethostname() failed, %m");
     }
-    if (S_sighup) {
-	bootp_readtab(NULL);
+    else {
+	my_log(LOG_INFO, "server name %s", server_name);
+    }
+
+    udpv4_transmit_flush_bpf_cache();
+    S_get_interfaces();
+    S_log_interfaces();
+    S_get_network_routes();
+    S_publish_disabled_interfaces(FALSE);
+    S_update_services();
+    S_receivers_update();
+    S_arp_watchers_update();
+    S_control_socket_update();
+    S_shadow_update();
+    S_http_server_update();
+    S_get_dns();
+    S_sighup = FALSE;
+    if (S_ipv4_changed_ifnames != NULL) {
+	/* the full reload subsumes any pending address changes */
+	CFSetRemoveAllValues(S_ipv4_changed_ifnames);
+    }
+    S_reconfig_stats.full_reloads++;
+    if (verbose) {
+	S_log_reconfig_stats();
+	S_log_receive_stats();
+    }
+    return;
+}
+
+typedef enum {
+    ipv4_change_ignore_e = 0,
+    ipv4_change_scoped_e,
+    ipv4_change_full_e,
+} ipv4_change_t;
+
+/*
+ * Function: S_classify_ipv4_change
+ * Purpose:
+ *   Decide how to handle an IPv4 address change on the named interface,
+ *   given the current and newly retrieved interface lists.
+ *
+ *   An interface that appeared or disappeared requires a full reload
+ *   since per-interface service configuration is resolved against the
+ *   interface list. An interface we don't serve, or whose addresses
+ *   didn't actually change, is ignored.
+ */
+static ipv4_change_t
+S_classify_ipv4_change(const char * ifname, interface_list_t * new_list,
+		       interface_t * * old_if_p_p, interface_t * * new_if_p_p)
+{
+    interface_t *	new_if_p;
+    interface_t *	old_if_p;
+
+    *old_if_p_p = old_if_p = ifl_find_name(S_interfaces, ifname);
+    *new_if_p_p = new_if_p = ifl_find_name(new_list, ifname);
+    if (ptrlist_count(&S_if_list) > 0
+	&& S_string_in_list(&S_if_list, ifname) == FALSE) {
+	return (ipv4_change_ignore_e);
+    }
+    if (old_if_p == NULL && new_if_p == NULL) {
+	return (ipv4_change_ignore_e);
+    }
+    if (old_if_p == NULL || new_if_p == NULL) {
+	return (ipv4_change_full_e);
+    }
+    if ((if_flags(new_if_p) & IFF_LOOPBACK) != 0) {
+	return (ipv4_change_ignore_e);
+    }
+    if (if_inet_equal(old_if_p, new_if_p)) {
+	return (ipv4_change_ignore_e);
+    }
+    return (ipv4_change_scoped_e);
+}
+
+/*
+ * Function: S_apply_ipv4_changes
+ * Purpose:
+ *   Apply the pending IPv4 address changes. Only the addresses of the
+ *   affected interfaces and the routes used to determine on-link subnets
+ *   are refreshed; the server identifier is derived from the interface
+ *   addresses, so it follows automatically. The configuration plist,
+ *   bootptab, subnets, allow/deny lists, and NetBoot images are left alone.
+ *
+ *   Falls back to a full reload if any change can't be applied in place.
+ */
+static void
+S_apply_ipv4_changes(void)
+{
+    CFIndex		count;
+    int			i;
+    CFStringRef *	names;
+    interface_list_t *	new_list;
+    int			scoped = 0;
+
+    new_list = ifl_init();
+    if (new_list == NULL) {
+	my_log(LOG_NOTICE, "interface list initialization failed");
+	S_reload_configuration();
+	return;
+    }
+    count = CFSetGetCount(S_ipv4_changed_ifnames);
+    names = (CFStringRef *)malloc(sizeof(*names) * count);
+    CFSetGetValues(S_ipv4_changed_ifnames, (const void * *)names);
+
+    /* classify everything first so a full reload doesn't mix with updates */
+    for (i = 0; i < count; i++) {
+	char		ifname[IFNAMSIZ + 1];
+	interface_t *	new_if_p;
+	interface_t *	old_if_p;
 
-	if (gethostname(server_name, sizeof(server_name) - 1)) {
-	    server_name[0] = '\0';
-	    my_log(LOG_INFO, "gethostname() failed, %m");
+	if (CFStringGetCString(names[i], ifname, sizeof(ifname),
+			       kCFStringEncodingASCII) == FALSE) {
+	    continue;
 	}
-	else {
-	    my_log(LOG_INFO, "server name %s", server_name);
+	if (S_classify_ipv4_change(ifname, new_list, &old_if_p, &new_if_p)
+	    == ipv4_change_full_e) {
+	    my_log(LOG_INFO, "interface %s %s, reloading configuration",
+		   ifname, (old_if_p == NULL) ? "appeared" : "disappeared");
+	    free(names);
+	    ifl_free(&new_list);
+	    S_reload_configuration();
+	    return;
+	}
+    }
+    for (i = 0; i < count; i++) {
+	char		ifname[IFNAMSIZ + 1];
+	int		j;
+	interface_t *	new_if_p;
+	interface_t *	old_if_p;
+
+	if (CFStringGetCString(names[i], ifname, sizeof(ifname),
+			       kCFStringEncodingASCII) == FALSE) {
+	    continue;
+	}
+	if (S_classify_ipv4_change(ifname, new_list, &old_if_p, &new_if_p)
+	    != ipv4_change_scoped_e) {
+	    S_reconfig_stats.ignored_changes++;
+	    continue;
 	}
+	/* keep user_defined (service) flags, replace only the addresses */
+	if_inet_copy(old_if_p, new_if_p);
+	for (j = 0; j < if_inet_count(old_if_p); j++) {
+	    inet_addrinfo_t *	info = if_inet_addr_at(old_if_p, j);
+	    char 		ip[32];
 
-	S_get_interfaces();
-	S_log_interfaces();
+	    strlcpy(ip, inet_ntoa(info->addr), sizeof(ip));
+	    my_log(LOG_INFO, "interface %s: ip %s mask %s",
+		   ifname, ip, inet_ntoa(info->mask));
+	}
+	if (if_inet_count(old_if_p) == 0) {
+	    my_log(LOG_INFO, "interface %s: no IP address", ifname);
+	}
+	S_reconfig_stats.scoped_updates++;
+	scoped++;
+    }
+    free(names);
+    ifl_free(&new_list);
+    CFSetRemoveAllValues(S_ipv4_changed_ifnames);
+    if (scoped != 0) {
+	/* on-link subnet routes may have moved with the addresses */
 	S_get_network_routes();
-	S_publish_disabled_interfaces(FALSE);
-	S_update_services();
-	S_get_dns();
-	S_sighup = FALSE;
+    }
+    if (verbose) {
+	S_log_reconfig_stats();
+    }
+    return;
+}
+
+/**
+ ** Per-interface receive sockets
+ **
+ ** Each served interface gets its own socket bound to it with IP_BOUND_IF,
+ ** with its own receive buffer and dispatch source, so that a flood on
+ ** one segment can only fill that segment's socket buffer. The ingress
+ ** interface is implied by the socket.
+ **
+ ** When a receiver's socket becomes readable, its source is suspended and
+ ** the receiver is put on the ready list. The ready list is serviced
+ ** round-robin, one packet per receiver per turn; a receiver with more
+ ** data queued goes to the back of the list, and its source is resumed
+ ** once its socket has been drained.
+ **
+ ** The wildcard socket (bootp_socket) is used for transmit, and serves
+ ** as the fallback for interfaces without a receiver. The kernel still
+ ** delivers it a copy of every broadcast, so broadcasts that arrive on an
+ ** interface with its own receiver are discarded right after recvmsg(),
+ ** before any other processing, and don't count against the wildcard
+ ** socket's RECEIVE_ROUND_MAX; a flood on a segment with a receiver is
+ ** drained from the wildcard socket quickly, and doesn't crowd out the
+ ** interfaces that depend on it.
+ **/
+
+#define RECEIVER_RCVBUF_SIZE	(64 * 1024)
+#define RECEIVE_ROUND_MAX	64	/* packets per main queue turn */
+#define RECEIVE_DISCARD_MAX	1024	/* discards per main queue turn */
+
+typedef struct {
+    uint32_t	packets;	/* packets received */
+    uint32_t	dropped;	/* packets received but not processed */
+    uint32_t	discarded;	/* copies left to the interface's receiver */
+    uint32_t	deferred;	/* turns yielded with data still queued */
+    uint32_t	queue_depth;	/* bytes queued after the last receive */
+    uint32_t	queue_depth_max;
+} receive_stats_t;
+
+typedef struct receiver {
+    char		ifname[IFNAMSIZ + 1];
+    int			if_index;
+    int			fd;
+    dispatch_source_t	source;
+    boolean_t		ready;		/* on ready list, source suspended */
+    boolean_t		closing;
+    struct receiver *	ready_next;
+    receive_stats_t	stats;
+    char		control[512];
+    /* ALIGN: rxpkt is aligned to at least sizeof(uint32_t) bytes */
+    uint32_t		rxpkt[2048/(sizeof(uint32_t))];
+} receiver_t;
+
+static receiver_t *	S_receivers_ready_head;
+static receiver_t *	S_receivers_ready_tail;
+static boolean_t	S_receivers_scheduled;
+static receive_stats_t	S_receive_stats;	/* wildcard socket */
+
+static void
+S_receive_stats_update_queue_depth(receive_stats_t * stats, int fd)
+{
+    int		depth = 0;
+
+    if (ioctl(fd, FIONREAD, &depth) < 0 || depth < 0) {
+	depth = 0;
+    }
+    stats->queue_depth = depth;
+    if (stats->queue_depth > stats->queue_depth_max) {
+	stats->queue_depth_max = stats->queue_depth;
+    }
+    return;
+}
+
+static void
+S_receive_stats_log(const char * name, receive_stats_t * stats)
+{
+    my_log(LOG_NOTICE, "receive %s: %u packet(s), %u dropped,"
+	   " %u discarded, %u deferred, queue %u (max %u) bytes", name,
+	   stats->packets, stats->dropped, stats->discarded, stats->deferred,
+	   stats->queue_depth, stats->queue_depth_max);
+    return;
+}
+
+static void
+S_log_receive_stats(void)
+{
+    int		i;
+
+    S_receive_stats_log("*", &S_receive_stats);
+    for (i = 0; i < ptrlist_count(&S_receivers); i++) {
+	receiver_t *	r = ptrlist_element(&S_receivers, i);
+
+	S_receive_stats_log(r->ifname, &r->stats);
+    }
+    return;
+}
+
+static void
+S_log_allocation_stats(void)
+{
+    CFMutableStringRef	str;
+
+    if (subnets == NULL) {
+	return;
+    }
+    str = CFStringCreateMutable(NULL, 0);
+    SubnetListPrintAllocationStatsCFString(str, subnets);
+    if (CFStringGetLength(str) != 0) {
+	my_log(LOG_NOTICE, "%@", str);
+    }
+    CFRelease(str);
+    return;
+}
+
+static receiver_t *
+S_receiver_lookup(const char * ifname)
+{
+    int		i;
+
+    for (i = 0; i < ptrlist_count(&S_receivers); i++) {
+	receiver_t *	r = ptrlist_element(&S_receivers, i);
+
+	if (strcmp(r->ifname, ifname) == 0) {
+	    return (r);
+	}
+    }
+    return (NULL);
+}
+
+/*
+ * Function: S_is_broadcast
+ * Purpose:
+ *   Returns whether the packet was sent to a broadcast address on
+ *   the interface, and would therefore also be delivered to the
+ *   interface's receiver.
+ */
+static boolean_t
+S_is_broadcast(struct in_addr * dstaddr_p, interface_t * if_p)
+{
+    int		i;
+
+    if (dstaddr_p == NULL) {
+	return (FALSE);
+    }
+    if (dstaddr_p->s_addr == INADDR_BROADCAST) {
+	return (TRUE);
+    }
+    for (i = 0; i < if_inet_count(if_p); i++) {
+	inet_addrinfo_t *	info = if_inet_addr_at(if_p, i);
+
+	if (dstaddr_p->s_addr == info->broadcast.s_addr) {
+	    return (TRUE);
+	}
+    }
+    return (FALSE);
+}
+
+/*
+ * Function: S_wildcard_should_handle
+ * Purpose:
+ *   Returns whether the wildcard socket should handle a packet received
+ *   on the interface named "ifname", or discard it because the
+ *   interface's receiver gets its own copy.
+ */
+static boolean_t
+S_wildcard_should_handle(struct msghdr * msg_p, const char * ifname)
+{
+    interface_t *	if_p;
+
+    if (ifname == NULL || S_receiver_lookup(ifname) == NULL) {
+	/* S_handle_packet() drops it if it's not for us */
+	return (TRUE);
+    }
+    if_p = S_which_interface(ifname);
+    if (if_p == NULL) {
+	return (TRUE);
+    }
+    /* the receiver gets broadcasts, unicasts only arrive here */
+    return (S_is_broadcast(S_which_dstaddr(msg_p), if_p) == FALSE);
+}
+
+/*
+ * Function: S_handle_packet
+ * Purpose:
+ *   Validate and dispatch a packet received on the interface named
+ *   "ifname".
+ */
+static void
+S_handle_packet(struct msghdr * msg_p, void * pkt, ssize_t n,
+		const char * ifname, receive_stats_t * stats)
+{
+    struct in_addr * 	dstaddr_p = NULL;
+    interface_t *	if_p = NULL;
+    struct dhcp *	request = (struct dhcp *)pkt;
+
+    if (S_sighup) {
+	S_reload_configuration();
+    }
+    else if (S_ipv4_changed_ifnames != NULL
+	     && CFSetGetCount(S_ipv4_changed_ifnames) != 0) {
+	S_apply_ipv4_changes();
     }
 
     if (n < sizeof(struct dhcp)) {
-	goto no_reply;
+	goto drop;
     }
     if (request->dp_hlen > sizeof(request->dp_chaddr)) {
-	goto no_reply;
+	goto drop;
     }
-    dstaddr_p = S_which_dstaddr();
+    dstaddr_p = S_which_dstaddr(msg_p);
     if (debug) {
 	if (dstaddr_p == NULL) {
 	    my_log(LOG_DEBUG, "no destination address");
@@ -2372,33 +3349,1248 @@ S_receive_packet()
 	}
     }
 
-    if_p = S_which_interface();
+    if (ifname == NULL) {
+	goto drop;
+    }
+    if_p = S_which_interface(ifname);
     if (if_p == NULL) {
-	goto no_reply;
+	goto drop;
     }
     if (S_ok_to_respond(if_p, request->dp_htype, request->dp_chaddr,
 			request->dp_hlen) == FALSE) {
-	goto no_reply;
+	goto drop;
     }
 
     gettimeofday(&S_lastmsgtime, 0);
-    /* ALIGN: S_rxpkt is aligned, cast ok. */
-    S_dispatch_request((struct bootp *)(void *)S_rxpkt, (int)n,
-		       if_p, dstaddr_p);
- no_reply:
+    S_dispatch_request((struct bootp *)pkt, (int)n, if_p, dstaddr_p,
+		       (const struct sockaddr_in *)msg_p->msg_name);
+    return;
+
+ drop:
+    stats->dropped++;
     return;
 }
 
-#if NO_SYSTEMCONFIGURATION
+static void S_receivers_service(void);
+
 static void
-S_publish_disabled_interfaces(boolean_t publish)
+S_receivers_schedule(void)
 {
+    if (S_receivers_scheduled) {
+	return;
+    }
+    S_receivers_scheduled = TRUE;
+    dispatch_async(dispatch_get_main_queue(), ^{ S_receivers_service(); });
+    return;
 }
 
 static void
-S_add_ip_change_notifications()
+S_receivers_ready_append(receiver_t * r)
 {
-}
+    r->ready_next = NULL;
+    if (S_receivers_ready_tail == NULL) {
+	S_receivers_ready_head = r;
+    }
+    else {
+	S_receivers_ready_tail->ready_next = r;
+    }
+    S_receivers_ready_tail = r;
+    return;
+}
+
+static receiver_t *
+S_receivers_ready_remove_head(void)
+{
+    receiver_t *	r = S_receivers_ready_head;
+
+    if (r != NULL) {
+	S_receivers_ready_head = r->ready_next;
+	if (S_receivers_ready_head == NULL) {
+	    S_receivers_ready_tail = NULL;
+	}
+	r->ready_next = NULL;
+    }
+    return (r);
+}
+
+static void
+S_receivers_ready_remove(receiver_t * r)
+{
+    receiver_t *	prev = NULL;
+    receiver_t *	scan;
+
+    for (scan = S_receivers_ready_head; scan != NULL;
+	 prev = scan, scan = scan->ready_next) {
+	if (scan != r) {
+	    continue;
+	}
+	if (prev == NULL) {
+	    S_receivers_ready_head = r->ready_next;
+	}
+	else {
+	    prev->ready_next = r->ready_next;
+	}
+	if (S_receivers_ready_tail == r) {
+	    S_receivers_ready_tail = prev;
+	}
+	r->ready_next = NULL;
+	break;
+    }
+    return;
+}
+
+/*
+ * Function: S_receiver_readable
+ * Purpose:
+ *   The receiver's socket has data: stop listening to it and queue
+ *   the receiver to be serviced in turn.
+ */
+static void
+S_receiver_readable(receiver_t * r)
+{
+    if (r->ready || r->closing) {
+	return;
+    }
+    dispatch_suspend(r->source);
+    r->ready = TRUE;
+    S_receivers_ready_append(r);
+    S_receivers_schedule();
+    return;
+}
+
+/*
+ * Function: S_receiver_receive
+ * Purpose:
+ *   Receive and handle a single packet on the receiver's socket.
+ *   Returns TRUE if there is more data queued on the socket.
+ */
+static boolean_t
+S_receiver_receive(receiver_t * r)
+{
+    struct sockaddr_in 	from = { sizeof(from), AF_INET };
+    struct iovec	r_iov;
+    struct msghdr	r_msg;
+    ssize_t		n;
+
+    S_init_msg_with_buffers(&r_msg, &r_iov, r->rxpkt, sizeof(r->rxpkt),
+			    r->control, sizeof(r->control));
+    r_msg.msg_name = (caddr_t)&from;
+    r_msg.msg_namelen = sizeof(from);
+    n = recvmsg(r->fd, &r_msg, 0);
+    if (n < 0) {
+	if (errno != EWOULDBLOCK && errno != EAGAIN) {
+	    my_log(LOG_DEBUG, "recvmsg(%s) failed, %m", r->ifname);
+	}
+	r->stats.queue_depth = 0;
+	return (FALSE);
+    }
+    r->stats.packets++;
+    S_receive_stats_update_queue_depth(&r->stats, r->fd);
+    /* ALIGN: rxpkt is aligned to uint32, cast safe */
+    S_handle_packet(&r_msg, (void *)r->rxpkt, n, r->ifname, &r->stats);
+    return (r->stats.queue_depth != 0);
+}
+
+/*
+ * Function: S_receivers_service
+ * Purpose:
+ *   Service the ready receivers round-robin, one packet at a time.
+ *   Yield the main queue after RECEIVE_ROUND_MAX packets.
+ */
+static void
+S_receivers_service(void)
+{
+    int		i;
+
+    S_receivers_scheduled = FALSE;
+    S_reply_batch_begin();
+    for (i = 0; i < RECEIVE_ROUND_MAX; i++) {
+	boolean_t	more;
+	receiver_t *	r;
+
+	r = S_receivers_ready_remove_head();
+	if (r == NULL) {
+	    break;
+	}
+	more = S_receiver_receive(r);
+	if (r->closing) {
+	    /* S_receiver_close() already resumed the source */
+	    continue;
+	}
+	if (more) {
+	    if (S_receivers_ready_head != NULL) {
+		r->stats.deferred++;
+	    }
+	    S_receivers_ready_append(r);
+	}
+	else {
+	    r->ready = FALSE;
+	    dispatch_resume(r->source);
+	}
+    }
+    S_reply_batch_end();
+    if (S_receivers_ready_head != NULL) {
+	S_receivers_schedule();
+    }
+    return;
+}
+
+static receiver_t *
+S_receiver_create(interface_t * if_p)
+{
+    int			fd;
+    int			if_index;
+    int			opt;
+    receiver_t *	r;
+    struct sockaddr_in	sin = { sizeof(sin), AF_INET };
+
+    if_index = if_link_index(if_p);
+    if (if_index == 0) {
+	return (NULL);
+    }
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+	my_log(LOG_NOTICE, "%s: socket failed, %s", if_name(if_p),
+	       strerror(errno));
+	return (NULL);
+    }
+    opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0
+	|| setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+	my_log(LOG_NOTICE, "%s: setsockopt(SO_REUSEPORT) failed, %s",
+	       if_name(if_p), strerror(errno));
+	goto failed;
+    }
+    if (setsockopt(fd, IPPROTO_IP, IP_BOUND_IF, &if_index,
+		   sizeof(if_index)) < 0) {
+	my_log(LOG_NOTICE, "%s: setsockopt(IP_BOUND_IF) failed, %s",
+	       if_name(if_p), strerror(errno));
+	goto failed;
+    }
+    if (setsockopt(fd, IPPROTO_IP, IP_RECVDSTADDR, &opt, sizeof(opt)) < 0) {
+	my_log(LOG_NOTICE, "%s: setsockopt(IP_RECVDSTADDR) failed, %s",
+	       if_name(if_p), strerror(errno));
+	goto failed;
+    }
+    (void)setsockopt(fd, SOL_SOCKET, SO_RECV_ANYIF, &opt, sizeof(opt));
+    opt = RECEIVER_RCVBUF_SIZE;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0) {
+	my_log(LOG_INFO, "%s: setsockopt(SO_RCVBUF) failed, %s",
+	       if_name(if_p), strerror(errno));
+    }
+#if defined(SO_TRAFFIC_CLASS)
+    opt = SO_TC_CTL;
+    (void)setsockopt(fd, SOL_SOCKET, SO_TRAFFIC_CLASS, &opt, sizeof(opt));
+#endif /* SO_TRAFFIC_CLASS */
+#if defined(SO_DEFUNCTOK)
+    opt = 0;
+    (void)setsockopt(fd, SOL_SOCKET, SO_DEFUNCTOK, &opt, sizeof(opt));
+#endif /* SO_DEFUNCTOK */
+    opt = 1;
+    if (ioctl(fd, FIONBIO, &opt) < 0) {
+	my_log(LOG_NOTICE, "%s: ioctl FIONBIO failed, %s",
+	       if_name(if_p), strerror(errno));
+	goto failed;
+    }
+    sin.sin_port = htons(S_ipport_server);
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+	my_log(LOG_NOTICE, "%s: bind failed, %s", if_name(if_p),
+	       strerror(errno));
+	goto failed;
+    }
+    r = (receiver_t *)malloc(sizeof(*r));
+    bzero(r, sizeof(*r));
+    strlcpy(r->ifname, if_name(if_p), sizeof(r->ifname));
+    r->if_index = if_index;
+    r->fd = fd;
+    r->source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0UL,
+				       dispatch_get_main_queue());
+    dispatch_source_set_event_handler(r->source,
+				      ^{ S_receiver_readable(r); });
+    dispatch_source_set_cancel_handler(r->source,
+				       ^{ close(r->fd); free(r); });
+    dispatch_resume(r->source);
+    my_log(LOG_INFO, "%s: receiving on separate socket", r->ifname);
+    return (r);
+
+ failed:
+    close(fd);
+    return (NULL);
+}
+
+/*
+ * Function: S_receiver_close
+ * Purpose:
+ *   Stop receiving on the receiver's socket. The socket is closed and
+ *   the receiver is freed by the cancel handler, which runs after any
+ *   work already in progress on the main queue.
+ */
+static void
+S_receiver_close(receiver_t * r)
+{
+    my_log(LOG_INFO, "%s: closing receive socket", r->ifname);
+    S_receivers_ready_remove(r);
+    r->closing = TRUE;
+    dispatch_source_cancel(r->source);
+    if (r->ready) {
+	/* a suspended source never runs its cancel handler */
+	r->ready = FALSE;
+	dispatch_resume(r->source);
+    }
+    dispatch_release(r->source);
+    r->source = NULL;
+    return;
+}
+
+static boolean_t
+S_interface_wants_receiver(interface_t * if_p)
+{
+    if ((if_flags(if_p) & (IFF_LOOPBACK | IFF_POINTOPOINT)) != 0
+	|| (if_flags(if_p) & IFF_BROADCAST) == 0) {
+	return (FALSE);
+    }
+    if (ptrlist_count(&S_if_list) > 0
+	&& S_string_in_list(&S_if_list, if_name(if_p)) == FALSE) {
+	return (FALSE);
+    }
+    return (is_service_enabled(if_p, SERVICE_ALL, 0));
+}
+
+/*
+ * Function: S_receivers_update
+ * Purpose:
+ *   Make the set of receivers match the interfaces we serve.
+ */
+static void
+S_receivers_update(void)
+{
+    boolean_t	enabled;
+    int		i;
+
+    enabled = (S_per_interface_receive && S_receivers_supported);
+
+    /* close receivers for interfaces that went away or changed */
+    for (i = 0; i < ptrlist_count(&S_receivers); ) {
+	interface_t *	if_p;
+	receiver_t *	r = ptrlist_element(&S_receivers, i);
+
+	if_p = ifl_find_name(S_interfaces, r->ifname);
+	if (enabled && if_p != NULL
+	    && if_link_index(if_p) == r->if_index
+	    && S_interface_wants_receiver(if_p)) {
+	    i++;
+	    continue;
+	}
+	ptrlist_remove(&S_receivers, i, NULL);
+	S_receiver_close(r);
+    }
+    if (enabled == FALSE) {
+	return;
+    }
+    for (i = 0; i < ifl_count(S_interfaces); i++) {
+	interface_t *	if_p = ifl_at_index(S_interfaces, i);
+	receiver_t *	r;
+
+	if (S_interface_wants_receiver(if_p) == FALSE
+	    || S_receiver_lookup(if_name(if_p)) != NULL) {
+	    continue;
+	}
+	r = S_receiver_create(if_p);
+	if (r != NULL) {
+	    ptrlist_add(&S_receivers, r);
+	}
+    }
+    return;
+}
+
+/**
+ ** ARP observation
+ **
+ ** When arp_observation is enabled, a BPF descriptor on each interface
+ ** we serve delivers the ARP traffic on that segment.  The sender of each
+ ** request and reply is recorded in arp_observations, and dhcpd won't
+ ** offer an address that some host used within arp_observation_lifetime
+ ** seconds.  The ARP traffic is only read, never answered.
+ **/
+
+#define ARP_OBSERVATION_CAPACITY	4096
+
+typedef struct {
+    char		ifname[IFNAMSIZ + 1];
+    int			if_index;
+    int			fd;
+    dispatch_source_t	source;
+    int			buf_size;
+    /* ALIGN: buf is malloc'd, bpf records are word aligned within it */
+    char *		buf;
+} arp_watcher_t;
+
+static void
+S_arp_watcher_readable(arp_watcher_t * w)
+{
+    ssize_t		n;
+    struct timeval	now;
+    char *		scan;
+
+    n = read(w->fd, w->buf, w->buf_size);
+    if (n <= 0) {
+	if (n < 0 && errno != EAGAIN && errno != EINTR) {
+	    my_log(LOG_NOTICE, "%s: ARP read failed, %s",
+		   w->ifname, strerror(errno));
+	}
+	return;
+    }
+    gettimeofday(&now, NULL);
+    for (scan = w->buf; n > 0; ) {
+	struct bpf_hdr *	bpf = (struct bpf_hdr *)(void *)scan;
+	ssize_t			skip;
+
+	if (n < (ssize_t)sizeof(*bpf)
+	    || (bpf->bh_hdrlen + bpf->bh_caplen) > n) {
+	    break;
+	}
+	ARPObservationMapProcessFrame(arp_observations,
+				      scan + bpf->bh_hdrlen,
+				      bpf->bh_caplen,
+				      (uint32_t)now.tv_sec);
+	skip = BPF_WORDALIGN(bpf->bh_hdrlen + bpf->bh_caplen);
+	if (skip == 0) {
+	    break;
+	}
+	scan += skip;
+	n -= skip;
+    }
+    return;
+}
+
+static arp_watcher_t *
+S_arp_watcher_create(interface_t * if_p)
+{
+    int			fd;
+    int			if_index;
+    int			opt;
+    arp_watcher_t *	w;
+    int			buf_size = 0;
+
+    if (if_link_type(if_p) != IFT_ETHER) {
+	return (NULL);
+    }
+    if_index = if_link_index(if_p);
+    if (if_index == 0) {
+	return (NULL);
+    }
+    fd = bpf_new();
+    if (fd < 0) {
+	my_log(LOG_NOTICE, "%s: bpf_new failed, %s", if_name(if_p),
+	       strerror(errno));
+	return (NULL);
+    }
+    if (bpf_arp_filter(fd, 12, ETHERTYPE_ARP,
+		       sizeof(struct ether_header)
+		       + sizeof(struct ether_arp)) < 0) {
+	my_log(LOG_NOTICE, "%s: bpf_arp_filter failed, %s", if_name(if_p),
+	       strerror(errno));
+	goto failed;
+    }
+    if (bpf_setif(fd, if_name(if_p)) < 0) {
+	my_log(LOG_NOTICE, "%s: bpf_setif failed, %s", if_name(if_p),
+	       strerror(errno));
+	goto failed;
+    }
+    bpf_set_immediate(fd, 1);
+    if (bpf_get_blen(fd, &buf_size) < 0 || buf_size <= 0) {
+	my_log(LOG_NOTICE, "%s: bpf_get_blen failed, %s", if_name(if_p),
+	       strerror(errno));
+	goto failed;
+    }
+    opt = 1;
+    if (ioctl(fd, FIONBIO, &opt) < 0) {
+	my_log(LOG_NOTICE, "%s: ioctl FIONBIO failed, %s",
+	       if_name(if_p), strerror(errno));
+	goto failed;
+    }
+    w = (arp_watcher_t *)malloc(sizeof(*w));
+    bzero(w, sizeof(*w));
+    strlcpy(w->ifname, if_name(if_p), sizeof(w->ifname));
+    w->if_index = if_index;
+    w->fd = fd;
+    w->buf_size = buf_size;
+    w->buf = malloc(buf_size);
+    w->source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0UL,
+				       dispatch_get_main_queue());
+    dispatch_source_set_event_handler(w->source,
+				      ^{ S_arp_watcher_readable(w); });
+    dispatch_source_set_cancel_handler(w->source,
+				       ^{
+					   close(w->fd);
+					   free(w->buf);
+					   free(w);
+				       });
+    dispatch_resume(w->source);
+    my_log(LOG_INFO, "%s: observing ARP", w->ifname);
+    return (w);
+
+ failed:
+    bpf_dispose(fd);
+    return (NULL);
+}
+
+static void
+S_arp_watcher_close(arp_watcher_t * w)
+{
+    my_log(LOG_INFO, "%s: no longer observing ARP", w->ifname);
+    dispatch_source_cancel(w->source);
+    dispatch_release(w->source);
+    w->source = NULL;
+    return;
+}
+
+static arp_watcher_t *
+S_arp_watcher_lookup(const char * ifname)
+{
+    int		i;
+
+    for (i = 0; i < ptrlist_count(&S_arp_watchers); i++) {
+	arp_watcher_t *	w = ptrlist_element(&S_arp_watchers, i);
+
+	if (strcmp(w->ifname, ifname) == 0) {
+	    return (w);
+	}
+    }
+    return (NULL);
+}
+
+/*
+ * Function: S_arp_watchers_update
+ * Purpose:
+ *   Make the set of ARP watchers match the interfaces we serve, and
+ *   create or free the observation map as arp_observation changes.
+ */
+static void
+S_arp_watchers_update(void)
+{
+    int		i;
+
+    /* close watchers for interfaces that went away or changed */
+    for (i = 0; i < ptrlist_count(&S_arp_watchers); ) {
+	interface_t *	if_p;
+	arp_watcher_t *	w = ptrlist_element(&S_arp_watchers, i);
+
+	if_p = ifl_find_name(S_interfaces, w->ifname);
+	if (S_arp_observation && if_p != NULL
+	    && if_link_index(if_p) == w->if_index
+	    && S_interface_wants_receiver(if_p)) {
+	    i++;
+	    continue;
+	}
+	ptrlist_remove(&S_arp_watchers, i, NULL);
+	S_arp_watcher_close(w);
+    }
+    if (S_arp_observation == FALSE) {
+	/* the cancel handlers no longer reference the map */
+	ARPObservationMapFree(&arp_observations);
+	return;
+    }
+    if (arp_observations == NULL) {
+	arp_observations
+	    = ARPObservationMapCreate(ARP_OBSERVATION_CAPACITY,
+				      S_arp_observation_lifetime);
+	if (arp_observations == NULL) {
+	    my_log(LOG_NOTICE, "ARPObservationMapCreate failed");
+	    return;
+	}
+    }
+    else {
+	ARPObservationMapSetLifetime(arp_observations,
+				     S_arp_observation_lifetime);
+    }
+    for (i = 0; i < ifl_count(S_interfaces); i++) {
+	interface_t *	if_p = ifl_at_index(S_interfaces, i);
+	arp_watcher_t *	w;
+
+	if (S_interface_wants_receiver(if_p) == FALSE
+	    || S_arp_watcher_lookup(if_name(if_p)) != NULL) {
+	    continue;
+	}
+	w = S_arp_watcher_create(if_p);
+	if (w != NULL) {
+	    ptrlist_add(&S_arp_watchers, w);
+	}
+    }
+    return;
+}
+
+static void
+S_log_arp_observation_stats(void)
+{
+    struct timeval	now;
+    ARPObservationStats	stats;
+
+    if (arp_observations == NULL) {
+	return;
+    }
+    gettimeofday(&now, NULL);
+    ARPObservationMapGetStats(arp_observations, (uint32_t)now.tv_sec,
+			      &stats);
+    my_log(LOG_NOTICE, "ARP observation: %d interface(s), %llu frame(s),"
+	   " %llu ignored, %llu recorded, %llu evicted, %llu conflict(s),"
+	   " %u/%u entries",
+	   ptrlist_count(&S_arp_watchers),
+	   (unsigned long long)stats.frames,
+	   (unsigned long long)stats.ignored,
+	   (unsigned long long)stats.recorded,
+	   (unsigned long long)stats.evicted,
+	   (unsigned long long)stats.conflicts,
+	   stats.entries, stats.capacity);
+    return;
+}
+
+/**
+ ** Control socket
+ **
+ ** When control_socket is enabled, bootpd answers queries from local
+ ** tools on BOOTPD_CONTROL_SOCKET_PATH, which only root can connect to.
+ ** Each connection carries one query and its reply (see bootpdcontrol.h).
+ **/
+
+typedef struct {
+    int			fd;
+    dispatch_source_t	source;
+    int			length;
+    char		query[BOOTPD_CONTROL_QUERY_MAX];
+} control_client_t;
+
+static void
+S_control_client_close(control_client_t * c)
+{
+    dispatch_source_cancel(c->source);
+    dispatch_release(c->source);
+    c->source = NULL;
+    return;
+}
+
+static void
+S_control_client_reply(control_client_t * c)
+{
+    char	reply[4096];
+    int		reply_length;
+
+    if (strcmp(c->query, BOOTPD_CONTROL_QUERY_MEMORY) == 0) {
+	reply_length = memaccount_report(reply, sizeof(reply));
+    }
+    else if (strcmp(c->query, BOOTPD_CONTROL_QUERY_SHADOW) == 0) {
+	if (S_shadow != NULL) {
+	    reply_length = ShadowEvalReport(S_shadow, reply, sizeof(reply));
+	}
+	else {
+	    reply_length = snprintf(reply, sizeof(reply),
+				    "%s is not set\n", CFGPROP_SHADOW_CONFIG);
+	}
+    }
+    else if (strcmp(c->query, BOOTPD_CONTROL_QUERY_HTTP_BOOT) == 0) {
+	if (S_http_server != NULL) {
+	    reply_length = HTTPServerReport(S_http_server, reply,
+					    sizeof(reply));
+	}
+	else {
+	    reply_length = snprintf(reply, sizeof(reply),
+				    "%s is not set\n", CFGPROP_HTTP_BOOT_ROOT);
+	}
+    }
+    else {
+	reply_length = snprintf(reply, sizeof(reply),
+				"unknown query '%s'\n", c->query);
+    }
+    /* the reply fits in the socket buffer, so a single write will do */
+    if (write(c->fd, reply, reply_length) < 0) {
+	my_log(LOG_INFO, "control socket write failed, %s",
+	       strerror(errno));
+    }
+    return;
+}
+
+static void
+S_control_client_readable(control_client_t * c)
+{
+    char *	newline;
+    ssize_t	n;
+
+    n = read(c->fd, c->query + c->length,
+	     sizeof(c->query) - 1 - c->length);
+    if (n < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+	return;
+    }
+    if (n <= 0) {
+	S_control_client_close(c);
+	return;
+    }
+    c->length += n;
+    c->query[c->length] = '\0';
+    newline = strchr(c->query, '\n');
+    if (newline == NULL) {
+	if (c->length < (sizeof(c->query) - 1)) {
+	    /* wait for the rest of the query */
+	    return;
+	}
+    }
+    else {
+	*newline = '\0';
+    }
+    S_control_client_reply(c);
+    S_control_client_close(c);
+    return;
+}
+
+static void
+S_control_accept(int listen_fd)
+{
+    control_client_t *	c;
+    int			fd;
+    int			opt;
+
+    fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+	return;
+    }
+    opt = 1;
+    if (ioctl(fd, FIONBIO, &opt) < 0) {
+	close(fd);
+	return;
+    }
+#ifdef SO_NOSIGPIPE
+    /* a client that goes away before reading the reply mustn't kill us */
+    (void)setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif /* SO_NOSIGPIPE */
+    c = (control_client_t *)malloc(sizeof(*c));
+    bzero(c, sizeof(*c));
+    c->fd = fd;
+    c->source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0UL,
+				       dispatch_get_main_queue());
+    dispatch_source_set_event_handler(c->source,
+				      ^{ S_control_client_readable(c); });
+    dispatch_source_set_cancel_handler(c->source,
+				       ^{
+					   close(c->fd);
+					   free(c);
+				       });
+    dispatch_resume(c->source);
+    return;
+}
+
+static int
+S_control_socket_open(void)
+{
+    int			fd;
+    mode_t		old_mask;
+    int			opt;
+    int			ret;
+    struct sockaddr_un	sun;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+	my_log(LOG_NOTICE, "control socket: socket failed, %s",
+	       strerror(errno));
+	return (-1);
+    }
+    bzero(&sun, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strlcpy(sun.sun_path, BOOTPD_CONTROL_SOCKET_PATH, sizeof(sun.sun_path));
+    (void)unlink(BOOTPD_CONTROL_SOCKET_PATH);
+    /* create the socket file owner-only, so it's never reachable by others */
+    old_mask = umask(S_IRWXG | S_IRWXO);
+    ret = bind(fd, (struct sockaddr *)&sun, sizeof(sun));
+    umask(old_mask);
+    if (ret < 0) {
+	my_log(LOG_NOTICE, "control socket: bind %s failed, %s",
+	       BOOTPD_CONTROL_SOCKET_PATH, strerror(errno));
+	goto failed;
+    }
+    if (chmod(BOOTPD_CONTROL_SOCKET_PATH, S_IRUSR | S_IWUSR) < 0) {
+	my_log(LOG_NOTICE, "control socket: chmod %s failed, %s",
+	       BOOTPD_CONTROL_SOCKET_PATH, strerror(errno));
+	goto failed;
+    }
+    opt = 1;
+    if (ioctl(fd, FIONBIO, &opt) < 0
+	|| listen(fd, 5) < 0) {
+	my_log(LOG_NOTICE, "control socket: listen failed, %s",
+	       strerror(errno));
+	goto failed;
+    }
+    return (fd);
+
+ failed:
+    close(fd);
+    (void)unlink(BOOTPD_CONTROL_SOCKET_PATH);
+    return (-1);
+}
+
+/*
+ * Function: S_control_socket_update
+ * Purpose:
+ *   Open or close the control socket as control_socket changes.
+ */
+static void
+S_control_socket_update(void)
+{
+    int		fd;
+
+    if (S_control_socket == FALSE) {
+	if (S_control_source != NULL) {
+	    dispatch_source_cancel(S_control_source);
+	    dispatch_release(S_control_source);
+	    S_control_source = NULL;
+	    (void)unlink(BOOTPD_CONTROL_SOCKET_PATH);
+	}
+	return;
+    }
+    if (S_control_source != NULL) {
+	return;
+    }
+    fd = S_control_socket_open();
+    if (fd < 0) {
+	return;
+    }
+    S_control_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,
+					      fd, 0UL,
+					      dispatch_get_main_queue());
+    dispatch_source_set_event_handler(S_control_source,
+				      ^{ S_control_accept(fd); });
+    dispatch_source_set_cancel_handler(S_control_source,
+				       ^{ close(fd); });
+    dispatch_resume(S_control_source);
+    my_log(LOG_INFO, "control socket %s", BOOTPD_CONTROL_SOCKET_PATH);
+    return;
+}
+
+static void
+S_log_memory_stats(void)
+{
+    char	report[2048];
+
+    memaccount_report(report, sizeof(report));
+    my_log(LOG_NOTICE, "memory:\n%s", report);
+    return;
+}
+
+/**
+ ** Shadow evaluation
+ **
+ ** When shadow_config names a candidate configuration, each request is
+ ** also evaluated against it and against the active configuration, to
+ ** find what would change if the candidate were put into service (see
+ ** shadowconfig.h).  The evaluation runs in its own main queue block,
+ ** after the replies of the current turn have been sent.
+ **/
+
+static void
+S_shadow_run(void)
+{
+    if (S_shadow == NULL) {
+	return;
+    }
+    if (ShadowEvalRun(S_shadow)) {
+	/* let other work in before continuing */
+	dispatch_async(dispatch_get_main_queue(), ^{ S_shadow_run(); });
+    }
+    return;
+}
+
+static void
+S_shadow_queue(interface_t * if_p, struct dhcp * pkt, dhcpol_t * options,
+	       dhcp_msgtype_t msgtype)
+{
+    if (ShadowEvalQueue(S_shadow, if_p, pkt, options, msgtype)) {
+	dispatch_async(dispatch_get_main_queue(), ^{ S_shadow_run(); });
+    }
+    return;
+}
+
+/*
+ * Function: S_shadow_update
+ * Purpose:
+ *   Start over with the current active configuration and the candidate
+ *   named by shadow_config, or stop if it isn't set.
+ */
+static void
+S_shadow_update(void)
+{
+    ShadowConfigRef	active;
+    ShadowConfigRef	candidate;
+    uint32_t		services = 0;
+
+    if (S_shadow != NULL) {
+	S_log_shadow_stats();
+	ShadowEvalFree(&S_shadow);
+    }
+    if (S_shadow_config == NULL) {
+	return;
+    }
+    if ((S_do_services & SERVICE_BOOTP) != 0) {
+	services |= SHADOW_SERVICE_BOOTP;
+    }
+    if ((S_do_services & SERVICE_DHCP) != 0) {
+	services |= SHADOW_SERVICE_DHCP;
+    }
+    candidate = ShadowConfigCreate(S_shadow_config, NULL, services);
+    if (candidate == NULL) {
+	return;
+    }
+    active = ShadowConfigCreate(BOOTPD_PLIST_PATH, BOOTPD_CONFIG_CACHE_PATH,
+				services);
+    if (active == NULL) {
+	ShadowConfigFree(&candidate);
+	return;
+    }
+    S_shadow = ShadowEvalCreate(active, candidate,
+				SHADOW_BUDGET_USECS_DEFAULT);
+    my_log(LOG_NOTICE, "shadow: evaluating %s", S_shadow_config);
+    return;
+}
+
+static void
+S_log_shadow_stats(void)
+{
+    char	report[4096];
+
+    if (S_shadow == NULL) {
+	return;
+    }
+    ShadowEvalReport(S_shadow, report, sizeof(report));
+    my_log(LOG_NOTICE, "shadow evaluation:\n%s", report);
+    return;
+}
+
+/**
+ ** HTTP boot server
+ **
+ ** When http_boot_root is set, bootpd serves the files below it over
+ ** HTTP to UEFI HTTP Boot clients, which boot_architectures points at
+ ** this server (see bootarch.h and httpserver.h).  Each connection has a
+ ** read and a write dispatch source, and only the one its state calls
+ ** for is resumed.  A connection that makes no progress for
+ ** HTTP_SERVER_IDLE_SECS_DEFAULT seconds is closed.
+ **/
+
+#define HTTP_IDLE_SWEEP_SECS	10
+
+typedef struct {
+    HTTPConnectionRef		conn;
+    HTTPConnectionStatus	status;
+    dispatch_source_t		read_source;
+    dispatch_source_t		write_source;
+    int				sources;	/* not yet cancelled */
+} http_client_t;
+
+static void
+S_http_client_release(http_client_t * c)
+{
+    /* free once neither source can refer to the socket */
+    if (--c->sources > 0) {
+	return;
+    }
+    HTTPConnectionFree(&c->conn);
+    free(c);
+    return;
+}
+
+static void
+S_http_client_close(http_client_t * c)
+{
+    int		i;
+
+    i = ptrlist_index(&S_http_clients, c);
+    if (i >= 0) {
+	ptrlist_remove(&S_http_clients, i, NULL);
+    }
+    dispatch_source_cancel(c->read_source);
+    dispatch_source_cancel(c->write_source);
+
+    /* a suspended source never runs its cancel handler */
+    if (c->status == kHTTPConnectionStatusWaitWrite) {
+	dispatch_resume(c->read_source);
+    }
+    else {
+	dispatch_resume(c->write_source);
+    }
+    dispatch_release(c->read_source);
+    dispatch_release(c->write_source);
+    c->status = kHTTPConnectionStatusClose;
+    return;
+}
+
+static void
+S_http_client_set_status(http_client_t * c, HTTPConnectionStatus status)
+{
+    if (status == c->status) {
+	return;
+    }
+    switch (status) {
+    case kHTTPConnectionStatusWaitRead:
+	dispatch_suspend(c->write_source);
+	dispatch_resume(c->read_source);
+	break;
+    case kHTTPConnectionStatusWaitWrite:
+	dispatch_suspend(c->read_source);
+	dispatch_resume(c->write_source);
+	break;
+    default:
+	S_http_client_close(c);
+	return;
+    }
+    c->status = status;
+    return;
+}
+
+static void
+S_http_accept(int listen_fd)
+{
+    http_client_t *	c;
+    int			fd;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+	if (ptrlist_count(&S_http_clients)
+	    >= HTTP_SERVER_CONNECTIONS_MAX_DEFAULT) {
+	    HTTPServerNoteRefused(S_http_server);
+	    close(fd);
+	    continue;
+	}
+	c = (http_client_t *)malloc(sizeof(*c));
+	bzero(c, sizeof(*c));
+	c->conn = HTTPConnectionCreate(S_http_server, fd);
+	c->status = kHTTPConnectionStatusWaitRead;
+	c->sources = 2;
+	c->read_source
+	    = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0UL,
+				     dispatch_get_main_queue());
+	c->write_source
+	    = dispatch_source_create(DISPATCH_SOURCE_TYPE_WRITE, fd, 0UL,
+				     dispatch_get_main_queue());
+	dispatch_source_set_event_handler(c->read_source, ^{
+		if (c->status == kHTTPConnectionStatusWaitRead) {
+		    S_http_client_set_status(c,
+					     HTTPConnectionReadable(c->conn));
+		}
+	    });
+	dispatch_source_set_event_handler(c->write_source, ^{
+		if (c->status == kHTTPConnectionStatusWaitWrite) {
+		    S_http_client_set_status(c,
+					     HTTPConnectionWritable(c->conn));
+		}
+	    });
+	dispatch_source_set_cancel_handler(c->read_source,
+					   ^{ S_http_client_release(c); });
+	dispatch_source_set_cancel_handler(c->write_source,
+					   ^{ S_http_client_release(c); });
+	/* the write source stays suspended until there's a response */
+	dispatch_resume(c->read_source);
+	ptrlist_add(&S_http_clients, c);
+    }
+    return;
+}
+
+static void
+S_http_idle_sweep(void)
+{
+    int		i;
+
+    for (i = ptrlist_count(&S_http_clients) - 1; i >= 0; i--) {
+	http_client_t *	c = ptrlist_element(&S_http_clients, i);
+
+	if (HTTPConnectionIsIdle(c->conn, HTTP_SERVER_IDLE_SECS_DEFAULT)) {
+	    HTTPServerNoteIdle(S_http_server);
+	    S_http_client_close(c);
+	}
+    }
+    return;
+}
+
+static void
+S_http_server_close(void)
+{
+    if (S_http_source == NULL) {
+	return;
+    }
+    dispatch_source_cancel(S_http_source);
+    dispatch_release(S_http_source);
+    S_http_source = NULL;
+    dispatch_source_cancel(S_http_idle_timer);
+    dispatch_release(S_http_idle_timer);
+    S_http_idle_timer = NULL;
+    while (ptrlist_count(&S_http_clients) > 0) {
+	S_http_client_close(ptrlist_element(&S_http_clients, 0));
+    }
+    my_log(LOG_NOTICE, "HTTP boot: stopped serving on port %d",
+	   S_http_source_port);
+    return;
+}
+
+/*
+ * Function: S_http_server_update
+ * Purpose:
+ *   Start, stop, or move the HTTP boot server as http_boot_root and
+ *   http_boot_port change.  The server's statistics are kept across
+ *   changes.
+ */
+static void
+S_http_server_update(void)
+{
+    struct in_addr	any;
+    int			fd;
+    uint16_t		port = (uint16_t)S_http_boot_port;
+
+    if (S_http_boot_root == NULL) {
+	S_http_server_close();
+	return;
+    }
+    if (S_http_server == NULL) {
+	S_http_server = HTTPServerCreate(S_http_boot_root);
+    }
+    else {
+	HTTPServerSetRoot(S_http_server, S_http_boot_root);
+    }
+    if (S_http_source != NULL && S_http_source_port == port) {
+	return;
+    }
+    S_http_server_close();
+    any.s_addr = htonl(INADDR_ANY);
+    fd = HTTPServerOpenSocket(any, port, SOMAXCONN);
+    if (fd < 0) {
+	my_log(LOG_NOTICE, "HTTP boot: can't listen on port %d, %s",
+	       port, strerror(errno));
+	return;
+    }
+    S_http_source_port = port;
+    S_http_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,
+					   fd, 0UL,
+					   dispatch_get_main_queue());
+    dispatch_source_set_event_handler(S_http_source,
+				      ^{ S_http_accept(fd); });
+    dispatch_source_set_cancel_handler(S_http_source,
+				       ^{ close(fd); });
+    dispatch_resume(S_http_source);
+    S_http_idle_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER,
+					       0, 0,
+					       dispatch_get_main_queue());
+    dispatch_source_set_event_handler(S_http_idle_timer,
+				      ^{ S_http_idle_sweep(); });
+    dispatch_source_set_timer(S_http_idle_timer,
+			      dispatch_time(DISPATCH_TIME_NOW,
+					    HTTP_IDLE_SWEEP_SECS
+					    * NSEC_PER_SEC),
+			      HTTP_IDLE_SWEEP_SECS * NSEC_PER_SEC,
+			      NSEC_PER_SEC);
+    dispatch_resume(S_http_idle_timer);
+    my_log(LOG_NOTICE, "HTTP boot: serving %s on port %d",
+	   S_http_boot_root, port);
+    return;
+}
+
+static void
+S_log_http_boot_stats(void)
+{
+    char	report[1024];
+
+    if (S_http_server == NULL) {
+	return;
+    }
+    HTTPServerReport(S_http_server, report, sizeof(report));
+    my_log(LOG_NOTICE, "HTTP boot:\n%s", report);
+    return;
+}
+
+/*
+ * Function: S_receive_one_packet
+ * Purpose:
+ *   Receive and handle a packet from the BOOTP/DHCP server port.
+ *   Returns FALSE if no packet was received.  Sets *handled to FALSE
+ *   if the packet was discarded because the receiver for its interface
+ *   handles it.
+ */
+static boolean_t
+S_receive_one_packet(int flags, boolean_t * handled)
+{
+    struct sockaddr_in 	from = { sizeof(from), AF_INET };
+    char		ifname[IFNAMSIZ + 1];
+    boolean_t		ifname_valid;
+    ssize_t		n;
+
+    S_init_msg();
+    msg.msg_name = (caddr_t)&from;
+    msg.msg_namelen = sizeof(from);
+    n = recvmsg(bootp_socket, &msg, flags);
+    if (n < 0) {
+	if (errno != EWOULDBLOCK && errno != EAGAIN) {
+	    my_log(LOG_DEBUG, "recvmsg failed, %m");
+	}
+	return (FALSE);
+    }
+    S_receive_stats.packets++;
+    S_receive_stats_update_queue_depth(&S_receive_stats, bootp_socket);
+    ifname_valid = S_which_ifname(&msg, ifname, sizeof(ifname));
+    *handled = S_wildcard_should_handle(&msg, ifname_valid ? ifname : NULL);
+    if (*handled == FALSE) {
+	S_receive_stats.discarded++;
+	return (TRUE);
+    }
+    /* ALIGN: S_rxpkt is aligned to uint32, hence cast safe */
+    S_handle_packet(&msg, (void *)S_rxpkt, n,
+		    ifname_valid ? ifname : NULL, &S_receive_stats);
+    return (TRUE);
+}
+
+/*
+ * Function: S_receive_packet
+ * Purpose:
+ *   Receive event handler for BOOTP/DHCP server port.
+ *   Handle the packets already queued on the socket as one batch, up to
+ *   RECEIVE_ROUND_MAX; the source fires again for any that remain.
+ *   Discarded packets are cheap, and only count against the larger
+ *   RECEIVE_DISCARD_MAX.
+ */
+static void
+S_receive_packet()
+{
+    int		discarded = 0;
+    int		handled = 0;
+
+    S_reply_batch_begin();
+    while (handled < RECEIVE_ROUND_MAX && discarded < RECEIVE_DISCARD_MAX) {
+	boolean_t	was_handled;
+
+	if (S_receive_one_packet((handled + discarded == 0)
+				 ? 0 : MSG_DONTWAIT,
+				 &was_handled) == FALSE) {
+	    break;
+	}
+	if (was_handled) {
+	    handled++;
+	}
+	else {
+	    discarded++;
+	}
+	if (S_receive_stats.queue_depth == 0) {
+	    break;
+	}
+    }
+    if (handled == RECEIVE_ROUND_MAX || discarded == RECEIVE_DISCARD_MAX) {
+	S_receive_stats.deferred++;
+    }
+    S_reply_batch_end();
+    return;
+}
+
+#if NO_SYSTEMCONFIGURATION
+static void
+S_publish_disabled_interfaces(boolean_t publish)
+{
+}
+
+static void
+S_add_ip_change_notifications()
+{
+}
 #else /* NO_SYSTEMCONFIGURATION */
 
 #include <SystemConfiguration/SystemConfiguration.h>
@@ -2407,11 +4599,65 @@ S_add_ip_change_notifications()
 
 static SCDynamicStoreRef	store;
 
+/*
+ * Function: S_ifname_from_ipv4_key
+ * Purpose:
+ *   Extract the interface name from a key of the form
+ *   State:/Network/Interface/<ifname>/IPv4.
+ */
+static CFStringRef
+S_ifname_from_ipv4_key(CFStringRef key)
+{
+    CFArrayRef		components;
+    CFStringRef		ifname = NULL;
+
+    components = CFStringCreateArrayBySeparatingStrings(NULL, key,
+							CFSTR("/"));
+    if (components == NULL) {
+	return (NULL);
+    }
+    if (CFArrayGetCount(components) == 5) {
+	ifname = CFArrayGetValueAtIndex(components, 3);
+	if (CFStringGetLength(ifname) == 0) {
+	    ifname = NULL;
+	}
+	else {
+	    CFRetain(ifname);
+	}
+    }
+    CFRelease(components);
+    return (ifname);
+}
+
 static void
 S_ipv4_address_changed(SCDynamicStoreRef session, CFArrayRef changes,
 		       void * info)
 {
-    S_sighup = TRUE;
+    CFIndex	count;
+    int		i;
+
+    if (S_ipv4_changed_ifnames == NULL) {
+	S_ipv4_changed_ifnames
+	    = CFSetCreateMutable(NULL, 0, &kCFTypeSetCallBacks);
+    }
+    count = (changes != NULL) ? CFArrayGetCount(changes) : 0;
+    if (count == 0) {
+	S_sighup = TRUE;
+	return;
+    }
+    for (i = 0; i < count; i++) {
+	CFStringRef	ifname;
+
+	ifname = S_ifname_from_ipv4_key(CFArrayGetValueAtIndex(changes, i));
+	if (ifname == NULL) {
+	    /* can't tell what changed, do it all */
+	    S_sighup = TRUE;
+	    continue;
+	}
+	CFSetAddValue(S_ipv4_changed_ifnames, ifname);
+	CFRelease(ifname);
+    }
+    return;
 }
 
 static void
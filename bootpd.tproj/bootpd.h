@@ -69,6 +69,9 @@ boolean_t
 bootp_add_bootfile(const char * request_file, const char * hostname, 
 		   const char * bootfile, char * reply_file,
 		   int reply_file_size);
+boolean_t
+add_boot_arch_options(request_t * request, const char * hostname,
+		      struct dhcp * reply, dhcpoa_t * options);
 void
 host_parms_from_proplist(ni_proplist * pl_p, int index, struct in_addr * ip, 
 			 char * * name, char * * bootfile);
@@ -83,6 +86,8 @@ boolean_t
 sendreply(interface_t * intf, struct bootp * bp, int n,
 	  boolean_t broadcast, struct in_addr * dest_p);
 boolean_t
+reply_batch_active(void);
+boolean_t
 ip_address_reachable(struct in_addr ip, struct in_addr giaddr, 
 		     interface_t * intface);
 
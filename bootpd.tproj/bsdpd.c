@@ -642,6 +642,23 @@ S_insert_image_list(const char * arch, const char * sysid,
     return (TRUE);
 }
 
+/*
+ * Function: S_afp_user_is_bound
+ * Purpose:
+ *   Returns whether a client is bound to the AFP user, and may still
+ *   be logged in with its password.
+ */
+static Boolean
+S_afp_user_is_bound(void * arg, AFPUserRef user)
+{
+    char *	afp_user;
+    char	afp_user_buf[256];
+
+    afp_user = AFPUser_get_user(user, afp_user_buf, sizeof(afp_user_buf));
+    return (PLCache_lookup_prop(&S_clients.list, NIPROP_NETBOOT_AFP_USER,
+				afp_user, FALSE) != NULL);
+}
+
 boolean_t
 bsdp_init(CFDictionaryRef plist)
 {
@@ -733,6 +750,10 @@ bsdp_init(CFDictionaryRef plist)
     }
     AFPUserList_create(&S_afp_users, S_netboot_gid, 
 		       S_afp_uid_start, S_afp_users_max);
+    /* keep directory writes off the request path */
+    AFPUserList_start_password_rotation(&S_afp_users,
+					dispatch_get_main_queue(),
+					S_afp_user_is_bound, NULL);
     S_next_host_number = S_host_number_max() + 1;
     return (TRUE);
 
@@ -1055,8 +1076,8 @@ S_client_update(struct in_addr * client_ip_p, const char * arch,
 
 	uid = AFPUser_get_uid(user_entry);
 
-	if (AFPUser_set_random_password(user_entry,
-					passwd, sizeof(passwd)) == FALSE) {
+	if (AFPUserList_set_random_password(&S_afp_users, user_entry,
+					    passwd, sizeof(passwd)) == FALSE) {
 	    my_log(LOG_INFO, "NetBoot: failed to set password for %s",
 		   hostname);
 	    return (FALSE);
@@ -1169,8 +1190,8 @@ S_client_create(struct in_addr client_ip,
 				    sizeof(afp_user_buf));
 	ni_proplist_addprop(&pl, NIPROP_NETBOOT_AFP_USER, afp_user);
 
-	if (AFPUser_set_random_password(user_entry,
-					passwd, sizeof(passwd)) == FALSE) {
+	if (AFPUserList_set_random_password(&S_afp_users, user_entry,
+					    passwd, sizeof(passwd)) == FALSE) {
 	    my_log(LOG_INFO, "NetBoot: failed to set password for %s",
 		   hostname);
 	    goto failed;
@@ -0,0 +1,744 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * configcache.c
+ * - compiled form of bootpd.plist, cached on disk and keyed by the
+ *   SHA-256 digest of the source file
+ *
+ * Parsing bootpd.plist means parsing XML, converting every subnet option
+ * through the DHCP option conversion table, and sorting the allow/deny
+ * lists.  With thousands of subnets and tens of thousands of allow/deny
+ * entries, that takes seconds, and it happens on every start and every
+ * SIGHUP.
+ *
+ * The cache file is a single image:
+ *   ConfigCacheHeader
+ *   plist:	the remaining top-level properties, as a binary plist
+ *   subnets:	SubnetListCopyImage()
+ *   allow:	sorted array of struct ether_addr
+ *   deny:	sorted array of struct ether_addr
+ *
+ * The header records the digest of the source file the image was compiled
+ * from, and a digest of the image itself.  The image is only used if both
+ * match; otherwise the source is parsed again and a new image written.
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/param.h>
+#include <net/ethernet.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include "configcache.h"
+#include "bootpd-plist.h"
+#include "cfutil.h"
+#include "util.h"
+
+#ifdef TEST_CONFIG_CACHE
+#define my_log(level, format, ...)					\
+    do {								\
+	fprintf(stderr, format "\n", ## __VA_ARGS__);			\
+    } while (0)
+#else /* TEST_CONFIG_CACHE */
+#include "mylog.h"
+#endif /* TEST_CONFIG_CACHE */
+
+#define CONFIG_CACHE_MAGIC	0x62706363	/* 'bpcc' */
+#define CONFIG_CACHE_VERSION	2
+
+typedef struct {
+    uint32_t		offset;
+    uint32_t		length;
+} ConfigCacheSection;
+
+typedef struct {
+    uint32_t		magic;
+    uint32_t		version;
+    uint32_t		size;		/* total size of the image */
+    uint32_t		reserved;
+    uint8_t		source_digest[CC_SHA256_DIGEST_LENGTH];
+    uint8_t		image_digest[CC_SHA256_DIGEST_LENGTH];
+    ConfigCacheSection	plist;
+    ConfigCacheSection	subnets;
+    ConfigCacheSection	allow;
+    ConfigCacheSection	deny;
+} ConfigCacheHeader, * ConfigCacheHeaderRef;
+
+typedef int (*qsort_compare_func_t)(const void *, const void *);
+
+static void *
+S_map_file(const char * path, size_t * ret_size)
+{
+    void *	addr = NULL;
+    int		fd;
+    struct stat	sb;
+
+    *ret_size = 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+	return (NULL);
+    }
+    if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+	goto done;
+    }
+    addr = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+	addr = NULL;
+	goto done;
+    }
+    *ret_size = (size_t)sb.st_size;
+ done:
+    close(fd);
+    return (addr);
+}
+
+static void
+S_unmap_file(void * addr, size_t size)
+{
+    if (addr != NULL) {
+	munmap(addr, size);
+    }
+    return;
+}
+
+static struct ether_addr *
+S_make_ether_list(CFArrayRef array, int * count_p)
+{
+    CFIndex		array_count = CFArrayGetCount(array);
+    int			count = 0;
+    int			i;
+    struct ether_addr * list;
+
+    list = (struct ether_addr *)malloc(sizeof(*list) * array_count);
+    for (i = 0; i < array_count; i++) {
+	struct ether_addr * 	eaddr;
+	CFStringRef		str = CFArrayGetValueAtIndex(array, i);
+	char			val[64];
+
+	if (isA_CFString(str) == NULL) {
+	    continue;
+	}
+	if (CFStringGetCString(str, val, sizeof(val), kCFStringEncodingASCII)
+	    == FALSE) {
+	    continue;
+	}
+	if (strlen(val) < 2) {
+	    continue;
+	}
+	/* ignore ethernet hardware type, if present */
+	if (strncmp(val, "1,", 2) == 0) {
+	    eaddr = ether_aton(val + 2);
+	}
+	else {
+	    eaddr = ether_aton((char *)val);
+	}
+	if (eaddr == NULL) {
+	    continue;
+	}
+	list[count++] = *eaddr;
+    }
+    if (count == 0) {
+	free(list);
+	list = NULL;
+    }
+    else {
+	qsort(list, count, sizeof(*list), (qsort_compare_func_t)ether_cmp);
+    }
+    *count_p = count;
+    return (list);
+}
+
+static struct ether_addr *
+S_copy_ether_list(const uint8_t * image, ConfigCacheSection * section,
+		  int * count_p)
+{
+    struct ether_addr *	list;
+
+    *count_p = 0;
+    if (section->length == 0) {
+	return (NULL);
+    }
+    list = (struct ether_addr *)malloc(section->length);
+    bcopy(image + section->offset, list, section->length);
+    *count_p = section->length / sizeof(*list);
+    return (list);
+}
+
+void
+ConfigCacheContentsFree(ConfigCacheContentsRef contents)
+{
+    my_CFRelease(&contents->plist);
+    SubnetListFree(&contents->subnets);
+    if (contents->allow != NULL) {
+	free(contents->allow);
+    }
+    if (contents->deny != NULL) {
+	free(contents->deny);
+    }
+    bzero(contents, sizeof(*contents));
+    return;
+}
+
+/**
+ ** Load from image
+ **/
+
+static bool
+S_section_is_valid(ConfigCacheSection * section, size_t image_size,
+		   size_t element_size)
+{
+    if (section->length == 0) {
+	return (true);
+    }
+    if (section->offset < sizeof(ConfigCacheHeader)
+	|| section->offset > image_size
+	|| section->length > (image_size - section->offset)) {
+	return (false);
+    }
+    if ((section->length % element_size) != 0) {
+	return (false);
+    }
+    return (true);
+}
+
+/*
+ * Function: S_load_image
+ * Purpose:
+ *   Validate the image and fill in contents from it.  Returns false
+ *   if the image is not usable; contents is left empty in that case.
+ */
+static bool
+S_load_image(const uint8_t * image, size_t image_size,
+	     const uint8_t * source_digest, ConfigCacheContentsRef contents)
+{
+    CFDataRef		data;
+    uint8_t		digest[CC_SHA256_DIGEST_LENGTH];
+    ConfigCacheHeader	header;
+
+    if (image_size < sizeof(header)) {
+	return (false);
+    }
+    bcopy(image, &header, sizeof(header));
+    if (header.magic != CONFIG_CACHE_MAGIC
+	|| header.version != CONFIG_CACHE_VERSION
+	|| header.size != image_size) {
+	return (false);
+    }
+    if (bcmp(header.source_digest, source_digest, sizeof(digest)) != 0) {
+	/* source has changed */
+	return (false);
+    }
+    CC_SHA256(image + sizeof(header),
+	      (CC_LONG)(image_size - sizeof(header)), digest);
+    if (bcmp(header.image_digest, digest, sizeof(digest)) != 0) {
+	my_log(LOG_NOTICE, "configcache: image digest mismatch");
+	return (false);
+    }
+    if (!S_section_is_valid(&header.plist, image_size, 1)
+	|| header.plist.length == 0
+	|| !S_section_is_valid(&header.subnets, image_size, 1)
+	|| !S_section_is_valid(&header.allow, image_size,
+			       sizeof(struct ether_addr))
+	|| !S_section_is_valid(&header.deny, image_size,
+			       sizeof(struct ether_addr))) {
+	my_log(LOG_NOTICE, "configcache: invalid image section");
+	return (false);
+    }
+
+    /* plist */
+    data = CFDataCreateWithBytesNoCopy(NULL, image + header.plist.offset,
+				       header.plist.length, kCFAllocatorNull);
+    contents->plist
+	= CFPropertyListCreateWithData(NULL, data, kCFPropertyListImmutable,
+				       NULL, NULL);
+    CFRelease(data);
+    if (isA_CFDictionary(contents->plist) == NULL) {
+	goto failed;
+    }
+
+    /* subnets */
+    if (header.subnets.length != 0) {
+	contents->subnets
+	    = SubnetListCreateWithImage(image + header.subnets.offset,
+					header.subnets.length);
+	if (contents->subnets == NULL) {
+	    goto failed;
+	}
+    }
+
+    /* allow/deny */
+    contents->allow = S_copy_ether_list(image, &header.allow,
+					&contents->allow_count);
+    contents->deny = S_copy_ether_list(image, &header.deny,
+				       &contents->deny_count);
+    return (true);
+
+ failed:
+    my_log(LOG_NOTICE, "configcache: failed to load image");
+    ConfigCacheContentsFree(contents);
+    return (false);
+}
+
+/**
+ ** Compile from source
+ **/
+
+/*
+ * Function: S_compile
+ * Purpose:
+ *   Parse the source plist and fill in contents.  Returns true if the
+ *   result is complete and may be cached, false if some part of the
+ *   configuration was rejected, so that it gets reported again the next
+ *   time it is loaded.
+ */
+static bool
+S_compile(const void * source, size_t source_size,
+	  ConfigCacheContentsRef contents)
+{
+    CFDataRef			data;
+    CFMutableDictionaryRef	dict;
+    CFPropertyListRef		plist;
+    CFArrayRef			prop;
+    bool			ret = true;
+
+    data = CFDataCreateWithBytesNoCopy(NULL, source, source_size,
+				       kCFAllocatorNull);
+    plist = CFPropertyListCreateWithData(NULL, data, kCFPropertyListImmutable,
+					 NULL, NULL);
+    CFRelease(data);
+    if (isA_CFDictionary(plist) == NULL) {
+	my_CFRelease(&plist);
+	return (false);
+    }
+
+    /* subnets */
+    prop = CFDictionaryGetValue(plist, BOOTPD_PLIST_SUBNETS);
+    if (isA_CFArray(prop) != NULL) {
+	contents->subnets = SubnetListCreateWithArray(prop);
+	if (contents->subnets == NULL) {
+	    ret = false;
+	}
+    }
+
+    /* allow */
+    prop = CFDictionaryGetValue(plist, CFSTR(CFGPROP_ALLOW));
+    if (isA_CFArray(prop) != NULL && CFArrayGetCount(prop) > 0) {
+	contents->allow = S_make_ether_list(prop, &contents->allow_count);
+    }
+
+    /* deny */
+    prop = CFDictionaryGetValue(plist, CFSTR(CFGPROP_DENY));
+    if (isA_CFArray(prop) != NULL && CFArrayGetCount(prop) > 0) {
+	contents->deny = S_make_ether_list(prop, &contents->deny_count);
+    }
+
+    /* everything else stays in the plist */
+    dict = CFDictionaryCreateMutableCopy(NULL, 0, plist);
+    CFDictionaryRemoveValue(dict, BOOTPD_PLIST_SUBNETS);
+    CFDictionaryRemoveValue(dict, CFSTR(CFGPROP_ALLOW));
+    CFDictionaryRemoveValue(dict, CFSTR(CFGPROP_DENY));
+    contents->plist = dict;
+    CFRelease(plist);
+    return (ret);
+}
+
+static void
+S_set_section(ConfigCacheSection * section, uint32_t * offset, size_t length)
+{
+    section->length = (uint32_t)length;
+    section->offset = (length != 0) ? *offset : 0;
+    *offset += roundup(length, sizeof(uint64_t));
+    return;
+}
+
+/*
+ * Function: S_write_image
+ * Purpose:
+ *   Write the compiled contents to cache_path.  The image is written to
+ *   a temporary file that is then renamed, so a reader never sees a
+ *   partial image.
+ */
+static void
+S_write_image(const char * cache_path, const uint8_t * source_digest,
+	      ConfigCacheContentsRef contents)
+{
+    uint8_t *		buf = NULL;
+    int			fd = -1;
+    ConfigCacheHeader	header;
+    size_t		allow_length;
+    size_t		deny_length;
+    uint32_t		offset;
+    CFDataRef		plist_data;
+    void *		subnets_image = NULL;
+    size_t		subnets_length = 0;
+    char		tmp_path[MAXPATHLEN];
+
+    plist_data = CFPropertyListCreateData(NULL, contents->plist,
+					  kCFPropertyListBinaryFormat_v1_0,
+					  0, NULL);
+    if (plist_data == NULL) {
+	my_log(LOG_NOTICE, "configcache: failed to serialize plist");
+	return;
+    }
+    if (contents->subnets != NULL) {
+	subnets_image = SubnetListCopyImage(contents->subnets,
+					    &subnets_length);
+    }
+    allow_length = contents->allow_count * sizeof(struct ether_addr);
+    deny_length = contents->deny_count * sizeof(struct ether_addr);
+
+    bzero(&header, sizeof(header));
+    header.magic = CONFIG_CACHE_MAGIC;
+    header.version = CONFIG_CACHE_VERSION;
+    bcopy(source_digest, header.source_digest, sizeof(header.source_digest));
+    offset = roundup(sizeof(header), sizeof(uint64_t));
+    S_set_section(&header.plist, &offset, CFDataGetLength(plist_data));
+    S_set_section(&header.subnets, &offset, subnets_length);
+    S_set_section(&header.allow, &offset, allow_length);
+    S_set_section(&header.deny, &offset, deny_length);
+    header.size = offset;
+
+    buf = calloc(1, header.size);
+    bcopy(CFDataGetBytePtr(plist_data), buf + header.plist.offset,
+	  header.plist.length);
+    if (subnets_length != 0) {
+	bcopy(subnets_image, buf + header.subnets.offset, subnets_length);
+    }
+    if (allow_length != 0) {
+	bcopy(contents->allow, buf + header.allow.offset, allow_length);
+    }
+    if (deny_length != 0) {
+	bcopy(contents->deny, buf + header.deny.offset, deny_length);
+    }
+    CC_SHA256(buf + sizeof(header), (CC_LONG)(header.size - sizeof(header)),
+	      header.image_digest);
+    bcopy(&header, buf, sizeof(header));
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+    fd = open(tmp_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+	my_log(LOG_NOTICE, "configcache: open(%s) failed, %s",
+	       tmp_path, strerror(errno));
+	goto done;
+    }
+    if (write(fd, buf, header.size) != header.size) {
+	my_log(LOG_NOTICE, "configcache: write(%s) failed, %s",
+	       tmp_path, strerror(errno));
+	unlink(tmp_path);
+	goto done;
+    }
+    if (rename(tmp_path, cache_path) < 0) {
+	my_log(LOG_NOTICE, "configcache: rename(%s) failed, %s",
+	       cache_path, strerror(errno));
+	unlink(tmp_path);
+	goto done;
+    }
+
+ done:
+    if (fd >= 0) {
+	close(fd);
+    }
+    if (buf != NULL) {
+	free(buf);
+    }
+    if (subnets_image != NULL) {
+	free(subnets_image);
+    }
+    CFRelease(plist_data);
+    return;
+}
+
+void
+ConfigCacheLoad(const char * config_path, const char * cache_path,
+		ConfigCacheContentsRef contents)
+{
+    void *		cache = NULL;
+    size_t		cache_size = 0;
+    uint8_t		digest[CC_SHA256_DIGEST_LENGTH];
+    struct timeval	delta;
+    struct timeval	end;
+    void *		source;
+    size_t		source_size;
+    struct timeval	start;
+
+    bzero(contents, sizeof(*contents));
+    gettimeofday(&start, NULL);
+    source = S_map_file(config_path, &source_size);
+    if (source == NULL) {
+	goto done;
+    }
+    CC_SHA256(source, (CC_LONG)source_size, digest);
+    if (cache_path != NULL) {
+	cache = S_map_file(cache_path, &cache_size);
+	if (cache != NULL
+	    && S_load_image(cache, cache_size, digest, contents)) {
+	    contents->from_cache = true;
+	    goto done;
+	}
+    }
+    if (S_compile(source, source_size, contents) && cache_path != NULL) {
+	S_write_image(cache_path, digest, contents);
+    }
+
+ done:
+    S_unmap_file(cache, cache_size);
+    S_unmap_file(source, source_size);
+    gettimeofday(&end, NULL);
+    timeval_subtract(end, start, &delta);
+    contents->load_usecs = (uint32_t)(delta.tv_sec * 1000000 + delta.tv_usec);
+    return;
+}
+
+#ifdef TEST_CONFIG_CACHE
+
+static void
+generate_config(const char * path, int subnet_count, int mac_count)
+{
+    CFMutableArrayRef		allow;
+    CFMutableDictionaryRef	config;
+    int				i;
+    CFMutableArrayRef		subnets;
+
+    config = CFDictionaryCreateMutable(NULL, 0,
+				       &kCFTypeDictionaryKeyCallBacks,
+				       &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(config, CFSTR("dhcp_enabled"), CFSTR("en0"));
+    subnets = CFArrayCreateMutable(NULL, subnet_count,
+				   &kCFTypeArrayCallBacks);
+    for (i = 0; i < subnet_count; i++) {
+	CFMutableArrayRef	array;
+	CFMutableDictionaryRef	dict;
+	char			str[64];
+	CFStringRef		val;
+
+	dict = CFDictionaryCreateMutable(NULL, 0,
+					 &kCFTypeDictionaryKeyCallBacks,
+					 &kCFTypeDictionaryValueCallBacks);
+	snprintf(str, sizeof(str), "subnet-%d", i);
+	my_CFDictionarySetCString(dict, CFSTR(SUBNET_PROP_NAME), str);
+	snprintf(str, sizeof(str), "10.%d.%d.0", i / 256, i % 256);
+	my_CFDictionarySetCString(dict, CFSTR(SUBNET_PROP_NET_ADDRESS), str);
+	my_CFDictionarySetCString(dict, CFSTR(SUBNET_PROP_NET_MASK),
+				  "255.255.255.0");
+	array = CFArrayCreateMutable(NULL, 2, &kCFTypeArrayCallBacks);
+	snprintf(str, sizeof(str), "10.%d.%d.10", i / 256, i % 256);
+	val = CFStringCreateWithCString(NULL, str, kCFStringEncodingASCII);
+	CFArrayAppendValue(array, val);
+	CFRelease(val);
+	snprintf(str, sizeof(str), "10.%d.%d.250", i / 256, i % 256);
+	val = CFStringCreateWithCString(NULL, str, kCFStringEncodingASCII);
+	CFArrayAppendValue(array, val);
+	CFRelease(val);
+	CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_RANGE), array);
+	CFRelease(array);
+	CFDictionarySetValue(dict, CFSTR("allocate"), kCFBooleanTrue);
+	snprintf(str, sizeof(str), "10.%d.%d.1", i / 256, i % 256);
+	my_CFDictionarySetCString(dict, CFSTR("dhcp_router"), str);
+	my_CFDictionarySetCString(dict, CFSTR("dhcp_domain_name"),
+				  "example.com");
+	array = CFArrayCreateMutable(NULL, 2, &kCFTypeArrayCallBacks);
+	CFArrayAppendValue(array, CFSTR("10.255.255.1"));
+	CFArrayAppendValue(array, CFSTR("10.255.255.2"));
+	CFDictionarySetValue(dict, CFSTR("dhcp_domain_name_server"), array);
+	CFRelease(array);
+	CFArrayAppendValue(subnets, dict);
+	CFRelease(dict);
+    }
+    CFDictionarySetValue(config, BOOTPD_PLIST_SUBNETS, subnets);
+    CFRelease(subnets);
+
+    allow = CFArrayCreateMutable(NULL, mac_count, &kCFTypeArrayCallBacks);
+    for (i = 0; i < mac_count; i++) {
+	char		str[64];
+	uint32_t	r = arc4random();
+	CFStringRef	val;
+
+	snprintf(str, sizeof(str), "1,2:0:%x:%x:%x:%x",
+		 (r >> 24) & 0xff, (r >> 16) & 0xff, (r >> 8) & 0xff,
+		 r & 0xff);
+	val = CFStringCreateWithCString(NULL, str, kCFStringEncodingASCII);
+	CFArrayAppendValue(allow, val);
+	CFRelease(val);
+    }
+    CFDictionarySetValue(config, CFSTR(CFGPROP_ALLOW), allow);
+    CFRelease(allow);
+    my_CFPropertyListWriteFile(config, path, 0644);
+    CFRelease(config);
+    return;
+}
+
+static void
+print_contents(const char * label, ConfigCacheContentsRef contents)
+{
+    printf("%-12s %8u usecs  from_cache %s  allow %d  deny %d\n",
+	   label, contents->load_usecs,
+	   contents->from_cache ? "yes" : "no ",
+	   contents->allow_count, contents->deny_count);
+    return;
+}
+
+static bool
+contents_equal(ConfigCacheContentsRef c1, ConfigCacheContentsRef c2)
+{
+    bool		equal;
+    CFMutableStringRef	str1;
+    CFMutableStringRef	str2;
+
+    if (CFEqual(c1->plist, c2->plist) == FALSE
+	|| c1->allow_count != c2->allow_count
+	|| c1->deny_count != c2->deny_count
+	|| (c1->allow_count != 0
+	    && bcmp(c1->allow, c2->allow,
+		    c1->allow_count * sizeof(*c1->allow)) != 0)
+	|| (c1->deny_count != 0
+	    && bcmp(c1->deny, c2->deny,
+		    c1->deny_count * sizeof(*c1->deny)) != 0)
+	|| (c1->subnets == NULL) != (c2->subnets == NULL)) {
+	return (false);
+    }
+    if (c1->subnets == NULL) {
+	return (true);
+    }
+    str1 = CFStringCreateMutable(NULL, 0);
+    str2 = CFStringCreateMutable(NULL, 0);
+    SubnetListPrintCFString(str1, c1->subnets);
+    SubnetListPrintCFString(str2, c2->subnets);
+    equal = CFEqual(str1, str2);
+    CFRelease(str1);
+    CFRelease(str2);
+    return (equal);
+}
+
+static void
+usage(const char * progname)
+{
+    fprintf(stderr,
+	    "usage: %s <bootpd.plist> [ <cache> ]\n"
+	    "       %s -bench [ <subnet_count> [ <mac_count> ] ]\n",
+	    progname, progname);
+    exit(1);
+}
+
+int
+main(int argc, char * argv[])
+{
+    char			cache_path[MAXPATHLEN];
+    ConfigCacheContents		cached;
+    char			config_path[MAXPATHLEN];
+    char			dir[] = "/tmp/configcache.XXXXXX";
+    int				mac_count = 50000;
+    ConfigCacheContents		parsed;
+    int				subnet_count = 5000;
+    ConfigCacheContents		uncached;
+
+    if (argc < 2) {
+	usage(argv[0]);
+    }
+    if (strcmp(argv[1], "-bench") != 0) {
+	ConfigCacheLoad(argv[1], (argc > 2) ? argv[2] : NULL, &cached);
+	print_contents("load", &cached);
+	if (cached.subnets != NULL) {
+	    SubnetListPrint(cached.subnets);
+	}
+	ConfigCacheContentsFree(&cached);
+	exit(0);
+    }
+    if (argc > 2) {
+	subnet_count = (int)strtol(argv[2], NULL, 0);
+    }
+    if (argc > 3) {
+	mac_count = (int)strtol(argv[3], NULL, 0);
+    }
+    if (subnet_count <= 0 || subnet_count > 65536 || mac_count < 0) {
+	usage(argv[0]);
+    }
+    if (mkdtemp(dir) == NULL) {
+	perror("mkdtemp");
+	exit(1);
+    }
+    snprintf(config_path, sizeof(config_path), "%s/bootpd.plist", dir);
+    snprintf(cache_path, sizeof(cache_path), "%s/cache", dir);
+    generate_config(config_path, subnet_count, mac_count);
+    printf("%d subnets, %d allow entries\n", subnet_count, mac_count);
+
+    /* parse only */
+    ConfigCacheLoad(config_path, NULL, &parsed);
+    print_contents("parse", &parsed);
+
+    /* parse and write the image */
+    ConfigCacheLoad(config_path, cache_path, &uncached);
+    print_contents("compile", &uncached);
+    if (uncached.from_cache) {
+	fprintf(stderr, "unexpected cache hit\n");
+	exit(1);
+    }
+
+    /* load the image */
+    ConfigCacheLoad(config_path, cache_path, &cached);
+    print_contents("cached", &cached);
+    if (cached.from_cache == false) {
+	fprintf(stderr, "cache miss\n");
+	exit(1);
+    }
+    if (contents_equal(&parsed, &cached) == false) {
+	fprintf(stderr, "cached contents differ\n");
+	exit(1);
+    }
+    ConfigCacheContentsFree(&parsed);
+    ConfigCacheContentsFree(&uncached);
+    ConfigCacheContentsFree(&cached);
+
+    /* changing the source invalidates the image */
+    generate_config(config_path, subnet_count, mac_count);
+    ConfigCacheLoad(config_path, cache_path, &cached);
+    print_contents("modified", &cached);
+    if (cached.from_cache) {
+	fprintf(stderr, "stale image used\n");
+	exit(1);
+    }
+    ConfigCacheContentsFree(&cached);
+
+    unlink(cache_path);
+    unlink(config_path);
+    rmdir(dir);
+    printf("test passed\n");
+    exit(0);
+}
+
+#endif /* TEST_CONFIG_CACHE */
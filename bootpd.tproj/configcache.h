@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * configcache.h
+ * - compiled form of bootpd.plist, cached on disk and keyed by the
+ *   SHA-256 digest of the source file
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_CONFIGCACHE_H
+#define _S_CONFIGCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <net/ethernet.h>
+#include <CoreFoundation/CFDictionary.h>
+#include "subnets.h"
+
+#define BOOTPD_CONFIG_CACHE_PATH	"/var/db/bootpd_config_cache"
+
+#define CFGPROP_ALLOW			"allow"
+#define CFGPROP_DENY			"deny"
+
+/*
+ * Type: ConfigCacheContents
+ * Purpose:
+ *   The configuration, ready to use.
+ *
+ *   plist contains every top-level property except Subnets, allow,
+ *   and deny, which are returned already compiled: subnets as a
+ *   SubnetListRef, allow and deny as sorted arrays of ethernet addresses
+ *   suitable for bsearch() with ether_cmp().
+ *
+ *   All of the fields are NULL/0 if the configuration file does not
+ *   exist or is invalid.
+ */
+typedef struct {
+    CFDictionaryRef	plist;
+    SubnetListRef	subnets;
+    struct ether_addr *	allow;
+    int			allow_count;
+    struct ether_addr *	deny;
+    int			deny_count;
+
+    /* statistics */
+    bool		from_cache;
+    uint32_t		load_usecs;	/* total time to produce contents */
+} ConfigCacheContents, * ConfigCacheContentsRef;
+
+/*
+ * Function: ConfigCacheLoad
+ * Purpose:
+ *   Load the configuration in config_path.  If cache_path holds an image
+ *   compiled from a file with the same content, use it, otherwise parse
+ *   config_path and write a new image to cache_path.
+ *   Pass NULL for cache_path to always parse the file.
+ */
+void
+ConfigCacheLoad(const char * config_path, const char * cache_path,
+		ConfigCacheContentsRef contents);
+
+void
+ConfigCacheContentsFree(ConfigCacheContentsRef contents);
+
+#endif /* _S_CONFIGCACHE_H */
@@ -37,6 +37,7 @@
 #include <sys/ioctl.h>
 #include <sys/file.h>
 #include <sys/time.h>
+#include <time.h>
 #include <errno.h>
 #include <net/if.h>
 #include <netinet/in.h>
@@ -66,17 +67,518 @@
 #include "bootpdfile.h"
 #include "bootplookup.h"
 #include "nbo.h"
+#include "DHCPLeaseHistory.h"
+#include "portbinding.h"
+#include "randmac.h"
+#include "bootarch.h"
 
 
 typedef long			dhcp_time_secs_t;
 #define DHCP_INFINITE_TIME	((dhcp_time_secs_t)-1)
 
+#define LEASE_FORMAT	"0x%lx"
+
 #define MAX_RETRY	5
 
 static boolean_t	S_extend_leases = TRUE;
 
+/**
+ ** Tombstones
+ **/
+
+/*
+ * A tombstone remembers an expired binding: the client, the address it
+ * had, and when its lease expired.  The address stays set aside for the
+ * client, so that if it comes back, it gets the same address.  When the
+ * pool runs out, the tombstone that expired first gives up its address.
+ *
+ * Tombstones are kept on a list ordered by lease expiration, oldest
+ * first, and are hashed by client identifier and by IP address.  Each
+ * tombstone whose address is in a subnet's range is also on that
+ * subnet's pool list, in the same order, so that reclaiming an address
+ * only looks at the head of each pool.  A pool keeps its provisional
+ * tombstones on a list of their own.
+ *
+ * A provisional tombstone is for a binding that was still on the short
+ * lease given to clients with randomized hardware addresses.  Its address
+ * is not set aside, and is reclaimed before any other.
+ */
+#define DHCP_TOMBSTONES_FILE		"/var/db/dhcpd_tombstones"
+#define DHCP_TOMBSTONE_PROVISIONAL	"provisional"
+
+/* how often to look for expired leases to turn into tombstones */
+#define DHCP_TOMBSTONE_SWEEP_SECS	60
+
+#define DHCP_TOMBSTONE_HASH_MIN		64
+
+typedef struct DHCPTombstone DHCPTombstone_t;
+
+typedef struct {
+    DHCPTombstone_t *	oldest;
+    DHCPTombstone_t *	newest;
+} DHCPTombstoneQueue_t;
+
+typedef struct {
+    SubnetRef			subnet;
+    DHCPTombstoneQueue_t	set_aside;
+    DHCPTombstoneQueue_t	provisional;
+} DHCPTombstonePool_t;
+
+struct DHCPTombstone {
+    DHCPTombstone_t *	older;
+    DHCPTombstone_t *	newer;
+    DHCPTombstone_t *	id_next;
+    DHCPTombstone_t *	ip_next;
+    DHCPTombstonePool_t * pool;
+    DHCPTombstone_t *	pool_older;
+    DHCPTombstone_t *	pool_newer;
+    struct in_addr	iaddr;
+    dhcp_time_secs_t	expiry;
+    boolean_t		provisional;
+    char		idstr[1];	/* variable length */
+};
+
+typedef struct {
+    DHCPTombstone_t *	oldest;
+    DHCPTombstone_t *	newest;
+    DHCPTombstone_t * *	id_hash;
+    DHCPTombstone_t * *	ip_hash;
+    int			hash_size;	/* power of 2 */
+    int			count;
+    ptrlist_t		pools;		/* DHCPTombstonePool_t */
+} DHCPTombstones_t;
+
+static uint32_t
+DHCPTombstone_id_hash(const char * idstr)
+{
+    uint32_t	hash = 2166136261U;
+
+    for (; *idstr != '\0'; idstr++) {
+	hash ^= (uint8_t)*idstr;
+	hash *= 16777619U;
+    }
+    return (hash);
+}
+
+static uint32_t
+DHCPTombstone_ip_hash(struct in_addr iaddr)
+{
+    return (ntohl(iaddr.s_addr) * 2654435761U);
+}
+
+static void
+DHCPTombstones_free_pools(DHCPTombstones_t * ts)
+{
+    int		i;
+
+    for (i = 0; i < ptrlist_count(&ts->pools); i++) {
+	free(ptrlist_element(&ts->pools, i));
+    }
+    ptrlist_free(&ts->pools);
+    return;
+}
+
+static void
+DHCPTombstones_free(DHCPTombstones_t * ts)
+{
+    DHCPTombstone_t *	scan;
+
+    scan = ts->oldest;
+    while (scan != NULL) {
+	DHCPTombstone_t *	next = scan->newer;
+
+	free(scan);
+	scan = next;
+    }
+    if (ts->id_hash != NULL) {
+	free(ts->id_hash);
+    }
+    if (ts->ip_hash != NULL) {
+	free(ts->ip_hash);
+    }
+    DHCPTombstones_free_pools(ts);
+    bzero(ts, sizeof(*ts));
+    return;
+}
+
+/*
+ * Function: DHCPTombstones_get_pool
+ * Purpose:
+ *   Return the pool for the subnet whose range holds the address,
+ *   creating it if necessary.  Returns NULL if the address isn't in the
+ *   range of any subnet, since it can't be reclaimed.
+ */
+static DHCPTombstonePool_t *
+DHCPTombstones_get_pool(DHCPTombstones_t * ts, struct in_addr iaddr)
+{
+    int				i;
+    DHCPTombstonePool_t *	pool;
+    SubnetRef			subnet;
+
+    if (subnets == NULL) {
+	return (NULL);
+    }
+    subnet = SubnetListGetSubnetForAddress(subnets, iaddr, TRUE);
+    if (subnet == NULL) {
+	return (NULL);
+    }
+    for (i = 0; i < ptrlist_count(&ts->pools); i++) {
+	pool = ptrlist_element(&ts->pools, i);
+	if (pool->subnet == subnet) {
+	    return (pool);
+	}
+    }
+    pool = malloc(sizeof(*pool));
+    if (pool == NULL) {
+	return (NULL);
+    }
+    bzero(pool, sizeof(*pool));
+    pool->subnet = subnet;
+    if (ptrlist_add(&ts->pools, pool) == FALSE) {
+	free(pool);
+	return (NULL);
+    }
+    return (pool);
+}
+
+static __inline__ DHCPTombstoneQueue_t *
+DHCPTombstonePool_queue(DHCPTombstonePool_t * pool, DHCPTombstone_t * t)
+{
+    return (t->provisional ? &pool->provisional : &pool->set_aside);
+}
+
+static void
+DHCPTombstonePool_insert(DHCPTombstonePool_t * pool, DHCPTombstone_t * t)
+{
+    DHCPTombstone_t *		older;
+    DHCPTombstoneQueue_t *	q = DHCPTombstonePool_queue(pool, t);
+
+    for (older = q->newest; older != NULL; older = older->pool_older) {
+	if (older->expiry <= t->expiry) {
+	    break;
+	}
+    }
+    t->pool = pool;
+    t->pool_older = older;
+    if (older != NULL) {
+	t->pool_newer = older->pool_newer;
+	older->pool_newer = t;
+    }
+    else {
+	t->pool_newer = q->oldest;
+	q->oldest = t;
+    }
+    if (t->pool_newer != NULL) {
+	t->pool_newer->pool_older = t;
+    }
+    else {
+	q->newest = t;
+    }
+    return;
+}
+
+static void
+DHCPTombstonePool_remove(DHCPTombstone_t * t)
+{
+    DHCPTombstoneQueue_t *	q;
+
+    if (t->pool == NULL) {
+	return;
+    }
+    q = DHCPTombstonePool_queue(t->pool, t);
+    if (t->pool_older != NULL) {
+	t->pool_older->pool_newer = t->pool_newer;
+    }
+    else {
+	q->oldest = t->pool_newer;
+    }
+    if (t->pool_newer != NULL) {
+	t->pool_newer->pool_older = t->pool_older;
+    }
+    else {
+	q->newest = t->pool_older;
+    }
+    t->pool = NULL;
+    t->pool_older = t->pool_newer = NULL;
+    return;
+}
+
+/*
+ * Function: DHCPTombstones_regroup
+ * Purpose:
+ *   Put the tombstones on the pools of the current subnet list.
+ */
+static void
+DHCPTombstones_regroup(DHCPTombstones_t * ts)
+{
+    DHCPTombstone_t *	scan;
+
+    DHCPTombstones_free_pools(ts);
+    for (scan = ts->oldest; scan != NULL; scan = scan->newer) {
+	DHCPTombstonePool_t *	pool;
+
+	scan->pool = NULL;
+	scan->pool_older = scan->pool_newer = NULL;
+	pool = DHCPTombstones_get_pool(ts, scan->iaddr);
+	if (pool != NULL) {
+	    DHCPTombstonePool_insert(pool, scan);
+	}
+    }
+    return;
+}
+
+static void
+DHCPTombstones_hash_insert(DHCPTombstones_t * ts, DHCPTombstone_t * t)
+{
+    int		i;
+
+    i = DHCPTombstone_id_hash(t->idstr) & (ts->hash_size - 1);
+    t->id_next = ts->id_hash[i];
+    ts->id_hash[i] = t;
+    i = DHCPTombstone_ip_hash(t->iaddr) & (ts->hash_size - 1);
+    t->ip_next = ts->ip_hash[i];
+    ts->ip_hash[i] = t;
+    return;
+}
+
+static boolean_t
+DHCPTombstones_rehash(DHCPTombstones_t * ts, int hash_size)
+{
+    DHCPTombstone_t * *	id_hash;
+    DHCPTombstone_t * *	ip_hash;
+    DHCPTombstone_t *	scan;
+
+    id_hash = calloc(hash_size, sizeof(*id_hash));
+    ip_hash = calloc(hash_size, sizeof(*ip_hash));
+    if (id_hash == NULL || ip_hash == NULL) {
+	if (id_hash != NULL) {
+	    free(id_hash);
+	}
+	if (ip_hash != NULL) {
+	    free(ip_hash);
+	}
+	return (FALSE);
+    }
+    if (ts->id_hash != NULL) {
+	free(ts->id_hash);
+    }
+    if (ts->ip_hash != NULL) {
+	free(ts->ip_hash);
+    }
+    ts->id_hash = id_hash;
+    ts->ip_hash = ip_hash;
+    ts->hash_size = hash_size;
+    for (scan = ts->oldest; scan != NULL; scan = scan->newer) {
+	DHCPTombstones_hash_insert(ts, scan);
+    }
+    return (TRUE);
+}
+
+static DHCPTombstone_t *
+DHCPTombstones_lookup_id(DHCPTombstones_t * ts, const char * idstr)
+{
+    DHCPTombstone_t *	scan;
+
+    if (ts->count == 0) {
+	return (NULL);
+    }
+    scan = ts->id_hash[DHCPTombstone_id_hash(idstr) & (ts->hash_size - 1)];
+    for (; scan != NULL; scan = scan->id_next) {
+	if (strcmp(scan->idstr, idstr) == 0) {
+	    return (scan);
+	}
+    }
+    return (NULL);
+}
+
+static DHCPTombstone_t *
+DHCPTombstones_lookup_ip(DHCPTombstones_t * ts, struct in_addr iaddr)
+{
+    DHCPTombstone_t *	scan;
+
+    if (ts->count == 0) {
+	return (NULL);
+    }
+    scan = ts->ip_hash[DHCPTombstone_ip_hash(iaddr) & (ts->hash_size - 1)];
+    for (; scan != NULL; scan = scan->ip_next) {
+	if (scan->iaddr.s_addr == iaddr.s_addr) {
+	    return (scan);
+	}
+    }
+    return (NULL);
+}
+
+static void
+DHCPTombstones_remove(DHCPTombstones_t * ts, DHCPTombstone_t * t)
+{
+    DHCPTombstone_t * *	scan;
+
+    scan = &ts->id_hash[DHCPTombstone_id_hash(t->idstr) & (ts->hash_size - 1)];
+    for (; *scan != NULL; scan = &(*scan)->id_next) {
+	if (*scan == t) {
+	    *scan = t->id_next;
+	    break;
+	}
+    }
+    scan = &ts->ip_hash[DHCPTombstone_ip_hash(t->iaddr) & (ts->hash_size - 1)];
+    for (; *scan != NULL; scan = &(*scan)->ip_next) {
+	if (*scan == t) {
+	    *scan = t->ip_next;
+	    break;
+	}
+    }
+    if (t->older != NULL) {
+	t->older->newer = t->newer;
+    }
+    else {
+	ts->oldest = t->newer;
+    }
+    if (t->newer != NULL) {
+	t->newer->older = t->older;
+    }
+    else {
+	ts->newest = t->older;
+    }
+    DHCPTombstonePool_remove(t);
+    ts->count--;
+    free(t);
+    return;
+}
+
+/*
+ * Function: DHCPTombstones_add
+ * Purpose:
+ *   Add a tombstone, replacing any existing tombstone for the same
+ *   client or IP address.  Tombstones are usually added in expiration
+ *   order, so finding the insertion point starting from the newest
+ *   is cheap.
+ */
+static void
+DHCPTombstones_add(DHCPTombstones_t * ts, const char * idstr,
+		   struct in_addr iaddr, dhcp_time_secs_t expiry,
+		   boolean_t provisional)
+{
+    DHCPTombstone_t *		older;
+    DHCPTombstonePool_t *	pool;
+    DHCPTombstone_t *		t;
+
+    t = DHCPTombstones_lookup_id(ts, idstr);
+    if (t != NULL) {
+	DHCPTombstones_remove(ts, t);
+    }
+    t = DHCPTombstones_lookup_ip(ts, iaddr);
+    if (t != NULL) {
+	DHCPTombstones_remove(ts, t);
+    }
+    if (ts->count >= ts->hash_size) {
+	int	hash_size;
+
+	hash_size = (ts->hash_size == 0)
+	    ? DHCP_TOMBSTONE_HASH_MIN : ts->hash_size * 2;
+	if (DHCPTombstones_rehash(ts, hash_size) == FALSE) {
+	    return;
+	}
+    }
+    t = malloc(sizeof(*t) + strlen(idstr));
+    if (t == NULL) {
+	return;
+    }
+    bzero(t, sizeof(*t));
+    strcpy(t->idstr, idstr);
+    t->iaddr = iaddr;
+    t->expiry = expiry;
+    t->provisional = provisional;
+    for (older = ts->newest; older != NULL; older = older->older) {
+	if (older->expiry <= expiry) {
+	    break;
+	}
+    }
+    t->older = older;
+    if (older != NULL) {
+	t->newer = older->newer;
+	older->newer = t;
+    }
+    else {
+	t->newer = ts->oldest;
+	ts->oldest = t;
+    }
+    if (t->newer != NULL) {
+	t->newer->older = t;
+    }
+    else {
+	ts->newest = t;
+    }
+    DHCPTombstones_hash_insert(ts, t);
+    pool = DHCPTombstones_get_pool(ts, iaddr);
+    if (pool != NULL) {
+	DHCPTombstonePool_insert(pool, t);
+    }
+    ts->count++;
+    return;
+}
+
+static boolean_t
+DHCPTombstones_write(DHCPTombstones_t * ts, const char * filename)
+{
+    FILE *		f;
+    char		path[PATH_MAX];
+    DHCPTombstone_t *	scan;
+
+    snprintf(path, sizeof(path), "%s-", filename);
+    f = fopen(path, "w");
+    if (f == NULL) {
+	my_log(LOG_NOTICE, "dhcp: fopen(%s) failed, %s",
+	       path, strerror(errno));
+	return (FALSE);
+    }
+    for (scan = ts->oldest; scan != NULL; scan = scan->newer) {
+	fprintf(f, "%s %s " LEASE_FORMAT "%s\n",
+		scan->idstr, inet_ntoa(scan->iaddr), scan->expiry,
+		scan->provisional ? " " DHCP_TOMBSTONE_PROVISIONAL : "");
+    }
+    if (fclose(f) != 0 || rename(path, filename) != 0) {
+	my_log(LOG_NOTICE, "dhcp: failed to write %s, %s",
+	       filename, strerror(errno));
+	unlink(path);
+	return (FALSE);
+    }
+    return (TRUE);
+}
+
+static void
+DHCPTombstones_read(DHCPTombstones_t * ts, const char * filename)
+{
+    FILE *	f;
+    char	line[512];
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+	return;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+	long		expiry;
+	char		flag[32];
+	char		idstr[256];
+	struct in_addr	iaddr;
+	char		ipstr[32];
+	int		n;
+
+	n = sscanf(line, "%255s %31s %li %31s", idstr, ipstr, &expiry, flag);
+	if (n < 3 || inet_aton(ipstr, &iaddr) == 0) {
+	    continue;
+	}
+	DHCPTombstones_add(ts, idstr, iaddr, (dhcp_time_secs_t)expiry,
+			   n == 4
+			   && strcmp(flag, DHCP_TOMBSTONE_PROVISIONAL) == 0);
+    }
+    fclose(f);
+    return;
+}
+
 typedef struct {
     PLCache_t		list;
+    DHCPTombstones_t	tombstones;
+    dhcp_time_secs_t	last_sweep;
 } DHCPLeases_t;
 
 static DHCPLeases_t	S_leases;
@@ -85,6 +587,7 @@ void
 DHCPLeases_free(DHCPLeases_t * leases)
 {
     PLCache_free(&leases->list);
+    DHCPTombstones_free(&leases->tombstones);
     bzero(leases, sizeof(*leases));
 }
 
@@ -99,44 +602,232 @@ DHCPLeases_init(DHCPLeases_t * leases)
     if (PLCache_read(&leases->list, DHCP_LEASES_FILE) == FALSE) {
 	goto failed;
     }
+    DHCPTombstones_read(&leases->tombstones, DHCP_TOMBSTONES_FILE);
     return (TRUE);
  failed:
     DHCPLeases_free(leases);
     return (FALSE);
 }
 
-static boolean_t S_remove_host(PLCacheEntry_t * * entry);
+/**
+ ** Lease history
+ **/
+static DHCPLeaseHistoryRef	S_lease_history;
+static dhcp_time_secs_t		S_lease_history_pruned;
+static boolean_t		S_lease_history_pending;
 
-boolean_t
-DHCPLeases_reclaim(DHCPLeases_t * leases, interface_t * if_p, 
-		   struct in_addr giaddr, struct timeval * time_in_p,
-		   struct in_addr * client_ip)
+static void
+S_lease_history_prune(dhcp_time_secs_t now)
+{
+    uint32_t	keep_secs;
+    int		removed;
+
+    keep_secs = dhcp_lease_history_days * DHCP_LEASE_HISTORY_SEGMENT_SECS;
+    S_lease_history_pruned = now;
+    if (now <= keep_secs) {
+	return;
+    }
+    removed = DHCPLeaseHistoryRemoveBefore(S_lease_history,
+					   (uint32_t)(now - keep_secs));
+    if (removed != 0) {
+	my_log(LOG_INFO, "dhcp: removed %d lease history segment%s",
+	       removed, (removed == 1) ? "" : "s");
+    }
+    return;
+}
+
+static void
+S_lease_history_init(void)
+{
+    if (dhcp_lease_history_days == 0) {
+	DHCPLeaseHistoryClose(&S_lease_history);
+	return;
+    }
+    if (S_lease_history == NULL) {
+	S_lease_history = DHCPLeaseHistoryOpen(DHCP_LEASE_HISTORY_DIR, TRUE,
+					       DHCP_LEASE_HISTORY_SEGMENT_SECS);
+	if (S_lease_history == NULL) {
+	    my_log(LOG_NOTICE, "dhcp: failed to open lease history %s",
+		   DHCP_LEASE_HISTORY_DIR);
+	    return;
+	}
+    }
+    S_lease_history_prune(time(NULL));
+    return;
+}
+
+/*
+ * Function: S_lease_history_append
+ * Purpose:
+ *   Record a lease event in the lease history, if it's enabled.
+ *   While a batch of packets is being handled, the event stays buffered
+ *   until dhcp_commit_pending() writes it with the lease file.
+ */
+static void
+S_lease_history_append(DHCPLeaseHistoryEvent event, struct in_addr iaddr,
+		       const char * idstr, dhcp_time_secs_t lease_time_expiry,
+		       dhcp_time_secs_t now)
 {
+    uint32_t	expiry;
+
+    if (S_lease_history == NULL) {
+	return;
+    }
+    if (lease_time_expiry == DHCP_INFINITE_TIME
+	|| lease_time_expiry >= DHCP_LEASE_HISTORY_INFINITE) {
+	expiry = DHCP_LEASE_HISTORY_INFINITE;
+    }
+    else if (lease_time_expiry < 0) {
+	expiry = 0;
+    }
+    else {
+	expiry = (uint32_t)lease_time_expiry;
+    }
+    if (now - S_lease_history_pruned >= DHCP_LEASE_HISTORY_SEGMENT_SECS) {
+	S_lease_history_prune(now);
+    }
+    if (DHCPLeaseHistoryAppend(S_lease_history, (uint32_t)now, event,
+			       iaddr, expiry, idstr) == FALSE) {
+	return;
+    }
+    if (reply_batch_active()) {
+	S_lease_history_pending = TRUE;
+	return;
+    }
+    DHCPLeaseHistorySynchronize(S_lease_history);
+    return;
+}
+
+/*
+ * Function: S_lease_history_append_entry
+ * Purpose:
+ *   Record a lease event for the lease entry, which is about to be
+ *   removed.
+ */
+static void
+S_lease_history_append_entry(DHCPLeaseHistoryEvent event,
+			     PLCacheEntry_t * entry, dhcp_time_secs_t now)
+{
+    struct in_addr	iaddr;
+    ni_name		ipstr;
+
+    if (S_lease_history == NULL) {
+	return;
+    }
+    ipstr = ni_valforprop(&entry->pl, NIPROP_IPADDR);
+    if (ipstr == NULL || inet_aton(ipstr, &iaddr) == 0) {
+	return;
+    }
+    S_lease_history_append(event, iaddr,
+			   ni_valforprop(&entry->pl, NIPROP_IDENTIFIER),
+			   now, now);
+    return;
+}
+
+/**
+ ** Port bindings
+ **/
+static PortBindingTableRef	S_port_bindings;
+
+static void
+S_port_bindings_init(void)
+{
+    struct timeval	delta;
+    struct timeval	end;
+    struct timeval	start;
+
+    PortBindingTableFree(&S_port_bindings);
+    gettimeofday(&start, NULL);
+    S_port_bindings = PortBindingTableCreateWithFile(PORT_BINDINGS_FILE);
+    if (S_port_bindings == NULL) {
+	return;
+    }
+    gettimeofday(&end, NULL);
+    timeval_subtract(end, start, &delta);
+    my_log(LOG_INFO, "dhcp: loaded %d port bindings in %d.%06d secs",
+	   PortBindingTableGetCount(S_port_bindings),
+	   (int)delta.tv_sec, (int)delta.tv_usec);
+    return;
+}
+
+/*
+ * Function: S_port_binding_lookup
+ * Purpose:
+ *   Find the port binding for a request forwarded by a relay agent that
+ *   inserted relay agent information (option 82).
+ */
+static PortBindingRef
+S_port_binding_lookup(struct dhcp * rq, dhcpol_t * options,
+		      const uint8_t * * opt_p, int * opt_len_p)
+{
+    const uint8_t *	opt;
+    int			opt_len;
+
+    *opt_p = NULL;
+    *opt_len_p = 0;
+    if (rq->dp_giaddr.s_addr == 0) {
+	return (NULL);
+    }
+    opt = dhcpol_find(options, dhcptag_relay_agent_information_e,
+		      &opt_len, NULL);
+    if (opt == NULL) {
+	return (NULL);
+    }
+    *opt_p = opt;
+    *opt_len_p = opt_len;
+    if (S_port_bindings == NULL) {
+	return (NULL);
+    }
+    return (PortBindingTableLookupRelayAgentInformation(S_port_bindings,
+							rq->dp_giaddr,
+							opt, opt_len));
+}
+
+static void S_generate_lease_change_notification(void);
+static bool S_ipinuse_common(struct timeval * time_in_p, struct in_addr ip);
+static boolean_t S_commit_mods(void);
+static void S_tombstones_commit(void);
+
+typedef struct {
+    PLCacheEntry_t *	entry;
+    dhcp_time_secs_t	expiry;
+} expired_lease_t;
+
+static int
+expired_lease_compare(const void * a, const void * b)
+{
+    const expired_lease_t *	l1 = (const expired_lease_t *)a;
+    const expired_lease_t *	l2 = (const expired_lease_t *)b;
+
+    if (l1->expiry == l2->expiry) {
+	return (0);
+    }
+    return ((l1->expiry < l2->expiry) ? -1 : 1);
+}
+
+/*
+ * Function: DHCPLeases_bury_expired
+ * Purpose:
+ *   Turn the expired leases into tombstones.  Leases without a client
+ *   identifier (declined addresses) are simply removed.
+ */
+static boolean_t
+DHCPLeases_bury_expired(DHCPLeases_t * leases, struct timeval * time_in_p)
+{
+    int			count = 0;
+    expired_lease_t *	expired;
+    int			i;
     PLCacheEntry_t *	scan;
 
+    leases->last_sweep = time_in_p->tv_sec;
+    expired = malloc(sizeof(*expired) * (leases->list.count + 1));
+    if (expired == NULL) {
+	return (FALSE);
+    }
     for (scan = leases->list.tail; scan; scan = scan->prev) {
 	dhcp_time_secs_t	expiry = 0;
-	struct in_addr		iaddr;
-	int			ip_index;
-	ni_namelist *		ip_nl_p;
 	int			lease_index;
 
-	/* check the IP address */
-	ip_index = (int)ni_proplist_match(scan->pl, NIPROP_IPADDR, NULL);
-	if (ip_index == NI_INDEX_NULL) {
-	    continue;
-	}
-	ip_nl_p = &scan->pl.nipl_val[ip_index].nip_val;
-	if (ip_nl_p->ninl_len == 0) {
-	    continue;
-	}
-	if (inet_aton(ip_nl_p->ninl_val[0], &iaddr) == 0) {
-	    continue;
-	}
-	if (!ip_address_reachable(iaddr, giaddr, if_p)) {
-	    /* not applicable to this network */
-	    continue;
-	}
 	/* check the lease expiration */
 	lease_index = (int)ni_proplist_match(scan->pl, NIPROP_DHCP_LEASE, NULL);
 	if (lease_index != NI_INDEX_NULL) {
@@ -154,15 +845,127 @@ DHCPLeases_reclaim(DHCPLeases_t * leases, interface_t * if_p,
 	    expiry = (dhcp_time_secs_t)val;
 	}
 	if (lease_index == NI_INDEX_NULL || time_in_p->tv_sec > expiry) {
-	    if (S_remove_host(&scan)) {
-		my_log(LOG_DEBUG, "dhcp: reclaimed address %s",
-		       inet_ntoa(iaddr));
-		*client_ip = iaddr;
-		return (TRUE);
+	    expired[count].entry = scan;
+	    expired[count].expiry = expiry;
+	    count++;
+	}
+    }
+    qsort(expired, count, sizeof(*expired), expired_lease_compare);
+    for (i = 0; i < count; i++) {
+	PLCacheEntry_t *	entry = expired[i].entry;
+	struct in_addr		iaddr;
+	ni_name			idstr;
+	ni_name			ipstr;
+
+	S_lease_history_append_entry(kDHCPLeaseHistoryEventExpire,
+				     entry, time_in_p->tv_sec);
+	idstr = ni_valforprop(&entry->pl, NIPROP_IDENTIFIER);
+	ipstr = ni_valforprop(&entry->pl, NIPROP_IPADDR);
+	if (ipstr != NULL && inet_aton(ipstr, &iaddr) != 0) {
+	    boolean_t	provisional = FALSE;
+
+	    if (idstr != NULL) {
+		provisional
+		    = (ni_valforprop(&entry->pl, NIPROP_DHCP_PROVISIONAL)
+		       != NULL);
+		DHCPTombstones_add(&leases->tombstones, idstr, iaddr,
+				   expired[i].expiry, provisional);
+	    }
+	    if (subnets != NULL) {
+		/* no longer bound, but a tombstone sets the address aside */
+		SubnetListReleaseAddress(subnets, iaddr);
+		if (idstr != NULL && provisional == FALSE) {
+		    SubnetListNoteAddressInUse(subnets, iaddr);
+		}
 	    }
 	}
+	PLCache_remove(&leases->list, entry);
+	PLCacheEntry_free(entry);
     }
-    return (FALSE);
+    free(expired);
+    if (count == 0) {
+	return (FALSE);
+    }
+    my_log(LOG_DEBUG, "dhcp: %d expired lease%s, %d tombstone%s",
+	   count, (count == 1) ? "" : "s",
+	   leases->tombstones.count,
+	   (leases->tombstones.count == 1) ? "" : "s");
+    S_tombstones_commit();
+    (void)S_commit_mods();
+    S_generate_lease_change_notification();
+    return (TRUE);
+}
+
+/*
+ * Function: DHCPLeases_reclaim_tombstone
+ * Purpose:
+ *   Take the address from the oldest tombstone usable on the client's
+ *   network, preferring provisional tombstones.  The address of a
+ *   provisional tombstone isn't set aside, so it may be in use again.
+ *
+ *   The tombstones in a pool share a network, so only the oldest
+ *   provisional and set aside tombstones in each pool need to be checked.
+ */
+static boolean_t
+DHCPLeases_reclaim_tombstone(DHCPLeases_t * leases, interface_t * if_p,
+			     struct in_addr giaddr, struct timeval * time_in_p,
+			     struct in_addr * client_ip)
+{
+    DHCPTombstone_t *	best = NULL;
+    int			i;
+    int			pass;
+    DHCPTombstone_t *	scan;
+    DHCPTombstones_t *	ts = &leases->tombstones;
+
+    for (pass = 0; pass < 2 && best == NULL; pass++) {
+	for (i = 0; i < ptrlist_count(&ts->pools); i++) {
+	    DHCPTombstonePool_t *	pool = ptrlist_element(&ts->pools, i);
+	    DHCPTombstoneQueue_t *	q;
+
+	    q = (pass == 0) ? &pool->provisional : &pool->set_aside;
+	    scan = q->oldest;
+	    while (scan != NULL && scan->provisional
+		   && S_ipinuse_common(time_in_p, scan->iaddr)) {
+		/* its address was taken again, so it can't be restored */
+		DHCPTombstones_remove(ts, scan);
+		S_tombstones_commit();
+		scan = q->oldest;
+	    }
+	    if (scan == NULL
+		|| (best != NULL && best->expiry <= scan->expiry)
+		|| ip_address_reachable(scan->iaddr, giaddr, if_p) == FALSE) {
+		continue;
+	    }
+	    best = scan;
+	}
+    }
+    if (best == NULL) {
+	return (FALSE);
+    }
+    *client_ip = best->iaddr;
+    my_log(LOG_DEBUG, "dhcp: reclaimed address %s from %s%s",
+	   inet_ntoa(best->iaddr), best->idstr,
+	   best->provisional ? " (provisional)" : "");
+    DHCPTombstones_remove(ts, best);
+    S_tombstones_commit();
+    return (TRUE);
+}
+
+boolean_t
+DHCPLeases_reclaim(DHCPLeases_t * leases, interface_t * if_p, 
+		   struct in_addr giaddr, struct timeval * time_in_p,
+		   struct in_addr * client_ip)
+{
+    if (DHCPLeases_reclaim_tombstone(leases, if_p, giaddr, time_in_p,
+				     client_ip)) {
+	return (TRUE);
+    }
+    if ((time_in_p->tv_sec - leases->last_sweep) < DHCP_TOMBSTONE_SWEEP_SECS
+	|| DHCPLeases_bury_expired(leases, time_in_p) == FALSE) {
+	return (FALSE);
+    }
+    return (DHCPLeases_reclaim_tombstone(leases, if_p, giaddr, time_in_p,
+					 client_ip));
 }
 
 
@@ -184,6 +987,46 @@ dhcp_max_message_size(dhcpol_t * options)
     return (val);
 }
 
+/*
+ * Function: S_note_addresses_in_use
+ * Purpose:
+ *   Tell the subnets about the addresses held by leases and tombstones,
+ *   so that pool selection starts out knowing how full each pool is.
+ *   Only leases count as bound: declined addresses and tombstones are
+ *   just skipped when allocating.
+ */
+static void
+S_note_addresses_in_use(void)
+{
+    PLCacheEntry_t *	entry;
+    DHCPTombstone_t *	t;
+
+    if (subnets == NULL) {
+	return;
+    }
+    for (entry = S_leases.list.head; entry != NULL; entry = entry->next) {
+	struct in_addr	iaddr;
+	ni_name		ipstr;
+
+	ipstr = ni_valforprop(&entry->pl, NIPROP_IPADDR);
+	if (ipstr == NULL || inet_aton(ipstr, &iaddr) == 0) {
+	    continue;
+	}
+	if (ni_valforprop(&entry->pl, NIPROP_IDENTIFIER) != NULL) {
+	    SubnetListNoteAddressBound(subnets, iaddr);
+	}
+	else {
+	    SubnetListNoteAddressInUse(subnets, iaddr);
+	}
+    }
+    for (t = S_leases.tombstones.oldest; t != NULL; t = t->newer) {
+	if (t->provisional == FALSE) {
+	    SubnetListNoteAddressInUse(subnets, t->iaddr);
+	}
+    }
+    return;
+}
+
 void
 dhcp_init()
 {
@@ -204,7 +1047,14 @@ dhcp_init()
 	    my_log(LOG_INFO, "dhcp: re-reading lease list (%d entries)",
 		   S_leases.list.count);
 	}
+	else {
+	    /* the pools refer to the previous subnet list */
+	    DHCPTombstones_regroup(&S_leases.tombstones);
+	}
     }
+    S_note_addresses_in_use();
+    S_lease_history_init();
+    S_port_bindings_init();
     return;
 }
 
@@ -226,18 +1076,78 @@ static boolean_t
 S_remove_host(PLCacheEntry_t * * entry)
 {
     PLCacheEntry_t *	ent = *entry;
+    ni_name		ipstr;
 
+    ipstr = ni_valforprop(&ent->pl, NIPROP_IPADDR);
+    if (subnets != NULL && ipstr != NULL) {
+	struct in_addr	iaddr;
+
+	if (inet_aton(ipstr, &iaddr) != 0) {
+	    SubnetListReleaseAddress(subnets, iaddr);
+	}
+    }
     PLCache_remove(&S_leases.list, ent);
     PLCacheEntry_free(ent);
     *entry = NULL;
-    PLCache_write(&S_leases.list, DHCP_LEASES_FILE);
+    (void)S_commit_mods();
     S_generate_lease_change_notification();
     return (TRUE);
 }
 
-static __inline__ boolean_t
-S_commit_mods()
+static boolean_t		S_commit_pending;
+static boolean_t		S_tombstones_pending;
+
+/*
+ * Function: S_commit_mods
+ * Purpose:
+ *   Write the lease file.  While a batch of packets is being handled,
+ *   just note that it needs writing: dhcp_commit_pending() writes it
+ *   once, before the batch's replies are sent.
+ */
+static boolean_t
+S_commit_mods(void)
 {
+    if (reply_batch_active()) {
+	S_commit_pending = TRUE;
+	return (TRUE);
+    }
+    return (PLCache_write(&S_leases.list, DHCP_LEASES_FILE));
+}
+
+/*
+ * Function: S_tombstones_commit
+ * Purpose:
+ *   Write the tombstone file, or during a batch, note that
+ *   dhcp_commit_pending() needs to write it.
+ */
+static void
+S_tombstones_commit(void)
+{
+    if (reply_batch_active()) {
+	S_tombstones_pending = TRUE;
+	return;
+    }
+    DHCPTombstones_write(&S_leases.tombstones, DHCP_TOMBSTONES_FILE);
+    return;
+}
+
+boolean_t
+dhcp_commit_pending(void)
+{
+    if (S_lease_history_pending) {
+	S_lease_history_pending = FALSE;
+	if (S_lease_history != NULL) {
+	    DHCPLeaseHistorySynchronize(S_lease_history);
+	}
+    }
+    if (S_tombstones_pending) {
+	S_tombstones_pending = FALSE;
+	DHCPTombstones_write(&S_leases.tombstones, DHCP_TOMBSTONES_FILE);
+    }
+    if (S_commit_pending == FALSE) {
+	return (TRUE);
+    }
+    S_commit_pending = FALSE;
     return (PLCache_write(&S_leases.list, DHCP_LEASES_FILE));
 }
 
@@ -247,8 +1157,6 @@ S_lease_propval(ni_proplist * pl_p)
     return (ni_valforprop(pl_p, NIPROP_DHCP_LEASE));
 }
 
-#define LEASE_FORMAT	"0x%lx"
-
 static void
 S_set_lease(ni_proplist * pl_p, dhcp_time_secs_t lease_time_expiry, 
 	    boolean_t * mod)
@@ -355,11 +1263,26 @@ static struct hosts *		S_pending_hosts = NULL;
 
 #define DEFAULT_PENDING_SECS	60
 
+/*
+ * Function: S_pending_host_free
+ * Purpose:
+ *   Drop an offer.  Its address stays in use only if the client has
+ *   since bound it.
+ */
+static void
+S_pending_host_free(struct hosts * hp)
+{
+    if (subnets != NULL) {
+	SubnetListClearAddressInUse(subnets, hp->iaddr);
+    }
+    hostfree(&S_pending_hosts, hp);
+    return;
+}
+
 static bool
-S_ipinuse(void * arg, struct in_addr ip)
+S_ipinuse_common(struct timeval * time_in_p, struct in_addr ip)
 {
     struct hosts * 	hp;
-    struct timeval * 	time_in_p = (struct timeval *)arg;
 
     if (bootp_getbyip_file(ip, NULL, NULL)
 #if USE_OPEN_DIRECTORY
@@ -382,13 +1305,53 @@ S_ipinuse(void * arg, struct in_addr ip)
 		   inet_ntoa(ip), (int)(DEFAULT_PENDING_SECS - pending_secs));
 	    return (TRUE);
 	}
-	hostfree(&S_pending_hosts, hp); /* remove it from the list */
+	S_pending_host_free(hp); /* remove it from the list */
 	return (FALSE);
     }
     
     return (FALSE);
 }
 
+/*
+ * Function: S_ip_observed_in_use
+ * Purpose:
+ *   Returns TRUE if some host used the address in ARP traffic recently,
+ *   so the address would only be DECLINEd if offered.
+ */
+static bool
+S_ip_observed_in_use(struct timeval * time_in_p, struct in_addr ip)
+{
+    uint8_t	hwaddr[6];
+
+    if (arp_observations == NULL
+	|| ARPObservationMapLookup(arp_observations, ip,
+				   (uint32_t)time_in_p->tv_sec,
+				   hwaddr) == FALSE) {
+	return (FALSE);
+    }
+    my_log(LOG_INFO, "dhcpd: %s observed in use by "
+	   "%02x:%02x:%02x:%02x:%02x:%02x, skipping",
+	   inet_ntoa(ip), hwaddr[0], hwaddr[1], hwaddr[2],
+	   hwaddr[3], hwaddr[4], hwaddr[5]);
+    return (TRUE);
+}
+
+static bool
+S_ipinuse(void * arg, struct in_addr ip)
+{
+    DHCPTombstone_t *	t;
+
+    if (S_ipinuse_common((struct timeval *)arg, ip)) {
+	return (TRUE);
+    }
+    /* set aside for a client that may come back */
+    t = DHCPTombstones_lookup_ip(&S_leases.tombstones, ip);
+    if (t != NULL && t->provisional == FALSE) {
+	return (TRUE);
+    }
+    return (S_ip_observed_in_use((struct timeval *)arg, ip));
+}
+
 #define DHCPD_CREATOR		"dhcpd"
 
 static char *
@@ -413,13 +1376,22 @@ S_get_hostname(void * hostname_opt, int hostname_opt_len)
     return (NULL);
 }
 
+/*
+ * Function: S_create_host
+ * Purpose:
+ *   Add a lease.  If provisional_since is non-zero, the lease is the
+ *   short lease given to a client with a randomized hardware address,
+ *   and provisional_since is when the binding was created.
+ */
 static boolean_t
 S_create_host(char * idstr, char * hwstr,
 	      struct in_addr iaddr, void * hostname_opt, int hostname_opt_len,
-	      dhcp_time_secs_t lease_time_expiry)
+	      dhcp_time_secs_t lease_time_expiry,
+	      dhcp_time_secs_t provisional_since)
 {
     char		lease_str[128];
     ni_proplist 	pl;
+    DHCPTombstone_t *	t;
 
 
     /* add DHCP-specific properties */
@@ -439,33 +1411,243 @@ S_create_host(char * idstr, char * hwstr,
 			(ni_name) idstr);
     snprintf(lease_str, sizeof(lease_str), LEASE_FORMAT, lease_time_expiry);
     ni_proplist_addprop(&pl, NIPROP_DHCP_LEASE, (ni_name)lease_str);
+    if (provisional_since != 0) {
+	snprintf(lease_str, sizeof(lease_str), LEASE_FORMAT,
+		 provisional_since);
+	ni_proplist_addprop(&pl, NIPROP_DHCP_PROVISIONAL, (ni_name)lease_str);
+    }
 
+    /* a provisional tombstone doesn't hold on to its address */
+    t = DHCPTombstones_lookup_ip(&S_leases.tombstones, iaddr);
+    if (t != NULL) {
+	DHCPTombstones_remove(&S_leases.tombstones, t);
+	S_tombstones_commit();
+    }
     PLCache_add(&S_leases.list, PLCacheEntry_create(pl));
-    PLCache_write(&S_leases.list, DHCP_LEASES_FILE);
+    if (subnets != NULL) {
+	SubnetListNoteAddressBound(subnets, iaddr);
+    }
+    (void)S_commit_mods();
     ni_proplist_free(&pl);
     S_generate_lease_change_notification();
     return (TRUE);
 }
 
+/*
+ * Function: S_lookup_tombstone
+ * Purpose:
+ *   Check whether the client has a tombstone for an address usable on
+ *   its network, and if the address is still free, restore the binding.
+ *   Returns the restored lease entry, NULL otherwise.
+ */
+static PLCacheEntry_t *
+S_lookup_tombstone(char * idstr, char * hwstr, subnet_match_args_t * match,
+		   struct timeval * time_in_p, struct in_addr * iaddr_p)
+{
+    DHCPTombstone_t *	t;
+    struct in_addr	iaddr;
+    dhcp_time_secs_t	expiry;
+    dhcp_time_secs_t	provisional_since = 0;
+
+    t = DHCPTombstones_lookup_id(&S_leases.tombstones, idstr);
+    if (t == NULL) {
+	return (NULL);
+    }
+    iaddr = t->iaddr;
+    expiry = t->expiry;
+    if (t->provisional) {
+	provisional_since = time_in_p->tv_sec;
+    }
+    if (subnet_match(match, iaddr) == FALSE) {
+	/* not applicable to this network, leave it */
+	return (NULL);
+    }
+    DHCPTombstones_remove(&S_leases.tombstones, t);
+    S_tombstones_commit();
+    if (S_ipinuse_common(time_in_p, iaddr)) {
+	my_log(LOG_DEBUG, "dhcp: %s previous address %s no longer available",
+	       idstr, inet_ntoa(iaddr));
+	return (NULL);
+    }
+    if (S_create_host(idstr, hwstr, iaddr, NULL, 0, expiry,
+		      provisional_since) == FALSE) {
+	return (NULL);
+    }
+    my_log(LOG_DEBUG, "dhcp: %s restored binding for %s",
+	   idstr, inet_ntoa(iaddr));
+    *iaddr_p = iaddr;
+    return (S_leases.list.head);
+}
+
+/*
+ * Function: S_provisional_lease_renew
+ * Purpose:
+ *   A client on the short lease for randomized hardware addresses is
+ *   renewing: give it a lease as long as it has held the binding, and
+ *   once that reaches the normal lease, make the binding a regular one.
+ */
+static void
+S_provisional_lease_renew(PLCacheEntry_t * entry, struct timeval * time_in_p,
+			  dhcp_lease_time_t * lease_p, boolean_t * modified)
+{
+    dhcp_time_secs_t	bound_secs;
+    dhcp_lease_time_t	lease;
+    ni_name		str;
+
+    str = ni_valforprop(&entry->pl, NIPROP_DHCP_PROVISIONAL);
+    if (str == NULL) {
+	return;
+    }
+    bound_secs = time_in_p->tv_sec - (dhcp_time_secs_t)strtol(str, NULL, 0);
+    if (bound_secs < 0) {
+	bound_secs = 0;
+    }
+    lease = RandomizedMACRenewalLease(*lease_p, dhcp_randomized_mac_lease,
+				      (uint32_t)bound_secs);
+    if (lease == *lease_p) {
+	ni_delete_prop(&entry->pl, NIPROP_DHCP_PROVISIONAL, modified);
+    }
+    *lease_p = lease;
+    return;
+}
+
 typedef enum {
     dhcp_binding_none_e = 0,
     dhcp_binding_permanent_e,
     dhcp_binding_temporary_e,
 } dhcp_binding_t;
 
+/*
+ * Function: S_port_binding_reclaim
+ * Purpose:
+ *   The port owns the address: take it back from any other client
+ *   that has a lease, an offer, or a tombstone for it.
+ */
+static void
+S_port_binding_reclaim(struct in_addr ip, const char * idstr,
+		       struct timeval * time_in_p)
+{
+    PLCacheEntry_t *	entry;
+    struct hosts *	hp;
+    DHCPTombstone_t *	t;
+
+    entry = PLCache_lookup_ip(&S_leases.list, ip);
+    if (entry != NULL) {
+	ni_name		id;
+
+	id = ni_valforprop(&entry->pl, NIPROP_IDENTIFIER);
+	if (id != NULL && strcmp(id, idstr) == 0) {
+	    return;
+	}
+	my_log(LOG_INFO, "dhcpd: port binding reassigns %s from %s to %s",
+	       inet_ntoa(ip), (id != NULL) ? id : "<unknown>", idstr);
+	S_lease_history_append_entry(kDHCPLeaseHistoryEventRelease, entry,
+				     time_in_p->tv_sec);
+	S_remove_host(&entry);
+    }
+    hp = hostbyip(S_pending_hosts, ip);
+    if (hp != NULL) {
+	S_pending_host_free(hp);
+    }
+    t = DHCPTombstones_lookup_ip(&S_leases.tombstones, ip);
+    if (t != NULL) {
+	DHCPTombstones_remove(&S_leases.tombstones, t);
+	S_tombstones_commit();
+    }
+    return;
+}
+
+/*
+ * Function: S_port_binding_acquire
+ * Purpose:
+ *   Choose an address for a client on a bound port.  A free address in
+ *   the port's range is preferred.  Otherwise, take back an address whose
+ *   lease has expired, or, for a port bound to a single address, the
+ *   address itself: the device on the port was replaced.
+ */
+static SubnetRef
+S_port_binding_acquire(PortBindingRef port, struct timeval * time_in_p,
+		       const char * idstr, struct in_addr * iaddr_p)
+{
+    in_addr_t		end = iptohl(port->end);
+    in_addr_t		i;
+    struct in_addr	ip;
+    SubnetRef		subnet;
+
+    for (i = iptohl(port->start); ; i++) {
+	ip = hltoip(i);
+	if (S_ipinuse_common(time_in_p, ip) == FALSE
+	    && S_ip_observed_in_use(time_in_p, ip) == FALSE) {
+	    goto found;
+	}
+	if (i == end) {
+	    break;
+	}
+    }
+    for (i = iptohl(port->start); ; i++) {
+	PLCacheEntry_t *	entry;
+
+	ip = hltoip(i);
+	if (bootp_getbyip_file(ip, NULL, NULL) == FALSE
+#if USE_OPEN_DIRECTORY
+	    && (use_open_directory == FALSE
+		|| bootp_getbyip_ds(ip, NULL, NULL) == FALSE)
+#endif /* USE_OPEN_DIRECTORY */
+	    ) {
+	    entry = PLCache_lookup_ip(&S_leases.list, ip);
+	    if (port->start.s_addr == port->end.s_addr
+		|| (entry != NULL
+		    && S_lease_time_expiry(&entry->pl) <= time_in_p->tv_sec)) {
+		goto found;
+	    }
+	}
+	if (i == end) {
+	    break;
+	}
+    }
+    my_log(LOG_NOTICE, "dhcpd: no address available for %s on bound port",
+	   idstr);
+    return (NULL);
+
+ found:
+    subnet = SubnetListGetSubnetForAddress(subnets, ip, TRUE);
+    if (subnet == NULL) {
+	subnet = SubnetListGetSubnetForAddress(subnets, ip, FALSE);
+    }
+    if (subnet == NULL) {
+	my_log(LOG_NOTICE, "dhcpd: port binding address %s is not on a"
+	       " configured subnet", inet_ntoa(ip));
+	return (NULL);
+    }
+    S_port_binding_reclaim(ip, idstr, time_in_p);
+    *iaddr_p = ip;
+    return (subnet);
+}
+
 static SubnetRef
 acquire_ip(struct in_addr giaddr, interface_t * if_p,
-	   struct timeval * time_in_p, struct in_addr * iaddr_p)
+	   struct timeval * time_in_p, const char * idstr,
+	   PortBindingRef port, struct in_addr * iaddr_p)
 {
-    SubnetRef 	subnet = NULL;
+    static time_t	S_in_use_forget_time;
+    SubnetRef 		subnet = NULL;
 
     if (subnets == NULL) {
 	return (NULL);
     }
+    if ((time_in_p->tv_sec - S_in_use_forget_time) >= DEFAULT_PENDING_SECS) {
+	/* addresses found in use by probes or offers may be free again */
+	SubnetListForgetAddressesInUse(subnets);
+	S_in_use_forget_time = time_in_p->tv_sec;
+    }
+    if (port != NULL) {
+	return (S_port_binding_acquire(port, time_in_p, idstr, iaddr_p));
+    }
     if (giaddr.s_addr) {
 	*iaddr_p = giaddr;
-	subnet = SubnetListAcquireAddress(subnets, iaddr_p, S_ipinuse,
-					  time_in_p);
+	subnet = SubnetListAcquireAddressForClient(subnets, iaddr_p,
+						   S_ipinuse, time_in_p,
+						   idstr);
     }
     else {
 	int 			i;
@@ -474,8 +1656,9 @@ acquire_ip(struct in_addr giaddr, interface_t * if_p,
 	for (i = 0; i < if_inet_count(if_p); i++) {
 	    info = if_inet_addr_at(if_p, i);
 	    *iaddr_p = info->netaddr;
-	    subnet = SubnetListAcquireAddress(subnets, iaddr_p, S_ipinuse,
-					      time_in_p);
+	    subnet = SubnetListAcquireAddressForClient(subnets, iaddr_p,
+						       S_ipinuse, time_in_p,
+						       idstr);
 	    if (subnet != NULL) {
 		break;
 	    }
@@ -529,6 +1712,9 @@ dhcp_bootp_allocate(char * idstr, char * hwstr, struct dhcp * rq,
     entry = PLCache_lookup_identifier(&S_leases.list, idstr,
 				      subnet_match, &match, &iaddr,
 				      NULL);
+    if (entry == NULL) {
+	entry = S_lookup_tombstone(idstr, hwstr, &match, time_in_p, &iaddr);
+    }
     if (entry != NULL) {
 	if (subnets != NULL) {
 	    subnet = SubnetListGetSubnetForAddress(subnets, iaddr, TRUE);
@@ -537,6 +1723,8 @@ dhcp_bootp_allocate(char * idstr, char * hwstr, struct dhcp * rq,
 	    max_lease = SubnetGetMaxLease(subnet);
 	    lease_time_expiry = max_lease + time_in_p->tv_sec;
 	    S_set_lease(&entry->pl, lease_time_expiry, &modified);
+	    S_lease_history_append(kDHCPLeaseHistoryEventRenew, iaddr, idstr,
+				   lease_time_expiry, time_in_p->tv_sec);
 
 	    PLCache_make_head(&S_leases.list, entry);
 	    *iaddr_p = iaddr;
@@ -552,7 +1740,7 @@ dhcp_bootp_allocate(char * idstr, char * hwstr, struct dhcp * rq,
 	entry = NULL;
     }
 
-    subnet = acquire_ip(rq->dp_giaddr, if_p, time_in_p, &iaddr);
+    subnet = acquire_ip(rq->dp_giaddr, if_p, time_in_p, idstr, NULL, &iaddr);
     if (subnet == NULL) {
 	if (DHCPLeases_reclaim(&S_leases, if_p, rq->dp_giaddr, 
 			       time_in_p, &iaddr)) {
@@ -573,9 +1761,11 @@ dhcp_bootp_allocate(char * idstr, char * hwstr, struct dhcp * rq,
     max_lease = SubnetGetMaxLease(subnet);
     lease_time_expiry = max_lease + time_in_p->tv_sec;
     if (S_create_host(idstr, hwstr,
-		      iaddr, NULL, 0, lease_time_expiry) == FALSE) {
+		      iaddr, NULL, 0, lease_time_expiry, 0) == FALSE) {
 	return (FALSE);
     }
+    S_lease_history_append(kDHCPLeaseHistoryEventBind, iaddr, idstr,
+			   lease_time_expiry, time_in_p->tv_sec);
     return (TRUE);
 }
 
@@ -633,6 +1823,11 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
     boolean_t		modified = FALSE;
     dhcpoa_t		options;
     boolean_t		orphan = FALSE;
+    PortBindingRef	port = NULL;
+    boolean_t		provisional = FALSE;
+    boolean_t		randomized_mac;
+    const uint8_t *	rai_opt = NULL;
+    int			rai_opt_len = 0;
     struct dhcp *	reply = NULL;
     dhcp_msgtype_t	reply_msgtype = dhcp_msgtype_none_e;
     struct dhcp *	rq = request->pkt;
@@ -666,8 +1861,13 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	    cid = NULL;
 	}
     }
+    randomized_mac = RandomizedMACAddressCheck(rq->dp_htype, rq->dp_chaddr,
+					       rq->dp_hlen);
+    provisional = (randomized_mac && dhcp_randomized_mac_lease != 0);
     if (cid == NULL
-	|| (dhcp_ignore_client_identifier && rq->dp_hlen != 0)) {
+	|| (dhcp_ignore_client_identifier && rq->dp_hlen != 0
+	    && (randomized_mac == FALSE
+		|| dhcp_randomized_mac_use_client_identifier == FALSE))) {
 	/* use the hardware address as the identifier */
 	cid = rq->dp_chaddr;
 	cid_type = rq->dp_htype;
@@ -749,6 +1949,10 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	entry = PLCache_lookup_identifier(&S_leases.list, idstr,
 					  subnet_match, &match, &iaddr,
 					  &some_binding);
+	if (entry == NULL) {
+	    entry = S_lookup_tombstone(idstr, hwstr, &match,
+				       request->time_in_p, &iaddr);
+	}
 	if (some_binding == TRUE) {
 	    has_binding = TRUE;
 	}
@@ -757,6 +1961,9 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 		subnet = SubnetListGetSubnetForAddress(subnets, iaddr, TRUE);
 	    }
 	    if (subnet == NULL || SubnetDoesAllocate(subnet) == FALSE) {
+		S_lease_history_append_entry(kDHCPLeaseHistoryEventExpire,
+					     entry,
+					     request->time_in_p->tv_sec);
 		S_remove_host(&entry);
 		my_log(LOG_INFO, "dhcpd: removing %s binding for %s",
 		       idstr, inet_ntoa(iaddr));
@@ -770,6 +1977,23 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	    }
 	}
     }
+    if (binding != dhcp_binding_permanent_e) {
+	/* the relay agent port may determine the address */
+	port = S_port_binding_lookup(rq, request->options_p,
+				     &rai_opt, &rai_opt_len);
+	if (port != NULL && binding == dhcp_binding_temporary_e
+	    && PortBindingContainsAddress(port, iaddr) == FALSE) {
+	    /* the client moved to another port, its address stays behind */
+	    my_log(LOG_INFO, "dhcpd: %s changed ports, releasing %s",
+		   idstr, inet_ntoa(iaddr));
+	    S_lease_history_append_entry(kDHCPLeaseHistoryEventRelease,
+					 entry, request->time_in_p->tv_sec);
+	    S_remove_host(&entry);
+	    binding = dhcp_binding_none_e;
+	    subnet = NULL;
+	    orphan = TRUE;
+	}
+    }
     if (binding != dhcp_binding_none_e) {
 	/* client is already bound on this subnet */
 	if (lease_time_expiry == DHCP_INFINITE_TIME) {
@@ -810,7 +2034,7 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	      hp = hostbyaddr(S_pending_hosts, cid_type, cid, cid_len,
 			      NULL, NULL);
 	      if (hp)
-		  hostfree(&S_pending_hosts, hp);
+		  S_pending_host_free(hp);
 	  }
 	  prefers_ipv6_only
 	      = client_prefers_ipv6_only(request->if_p, request->options_p);
@@ -820,11 +2044,13 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	  else if (dhcp_allocate || prefers_ipv6_only) {
 	      /* allocate a new ip address */
 	      subnet = acquire_ip(rq->dp_giaddr, 
-				  request->if_p, request->time_in_p, &iaddr);
+				  request->if_p, request->time_in_p, idstr,
+				  port, &iaddr);
 	      if (subnet == NULL) {
-		  if (DHCPLeases_reclaim(&S_leases, request->if_p, 
-					 rq->dp_giaddr, 
-					 request->time_in_p, &iaddr)) {
+		  if (port == NULL
+		      && DHCPLeases_reclaim(&S_leases, request->if_p, 
+					    rq->dp_giaddr, 
+					    request->time_in_p, &iaddr)) {
 		      if (subnets != NULL) {
 			  subnet = SubnetListGetSubnetForAddress(subnets, iaddr,
 								 TRUE);
@@ -855,6 +2081,11 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	      else {
 		  lease = min_lease;
 	      }
+	      if (provisional && lease != DHCP_INFINITE_LEASE) {
+		  /* randomized address: start with a short lease */
+		  lease = RandomizedMACInitialLease(lease,
+						    dhcp_randomized_mac_lease);
+	      }
 	  }
 	  else {
 	      /* NetBoot 1.0 enabled, but DHCP is not */
@@ -927,10 +2158,13 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 		  }
 		  /* clean up */
 		  if (hp) {
-		      hostfree(&S_pending_hosts, hp);
+		      S_pending_host_free(hp);
 		  }
 		  
 		  if (binding == dhcp_binding_temporary_e) {
+		      S_lease_history_append_entry(kDHCPLeaseHistoryEventRelease,
+						   entry,
+						   request->time_in_p->tv_sec);
 		      S_remove_host(&entry);
 		  }
 		  if (detect_other_dhcp_server(request->if_p)) {
@@ -1002,6 +2236,9 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 			  free(h);
 		      }
 		      S_set_lease(&entry->pl, lease_time_expiry, &modified);
+		      S_lease_history_append(kDHCPLeaseHistoryEventBind,
+					     iaddr, idstr, lease_time_expiry,
+					     request->time_in_p->tv_sec);
 		  }
 	      }
 	      else { /* create a new host entry */
@@ -1012,7 +2249,10 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 		  if (subnet == NULL
 		      || S_create_host(idstr, hwstr, iaddr, 
 				       hostname_opt, hostname_opt_len,
-				       lease_time_expiry) == FALSE) {
+				       lease_time_expiry,
+				       provisional
+				       ? request->time_in_p->tv_sec : 0)
+		      == FALSE) {
 		      reply = make_dhcp_nak((struct dhcp *)txbuf, 
 					    max_packet,
 					    our_ip,
@@ -1024,6 +2264,9 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 		      }
 		      goto no_reply;
 		  }
+		  S_lease_history_append(kDHCPLeaseHistoryEventBind,
+					 iaddr, idstr, lease_time_expiry,
+					 request->time_in_p->tv_sec);
 	      }
 	  } /* select */
 	  else /* init-reboot/renew/rebind */ {
@@ -1156,6 +2399,10 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 		      lease = (dhcp_lease_time_t)
 			  (lease_time_expiry - request->time_in_p->tv_sec);
 		  }
+		  if (lease != DHCP_INFINITE_LEASE) {
+		      S_provisional_lease_renew(entry, request->time_in_p,
+						&lease, &modified);
+		  }
 		  if (lease == DHCP_INFINITE_LEASE) {
 		      lease_time_expiry = DHCP_INFINITE_TIME;
 		  }
@@ -1163,6 +2410,9 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 		      lease_time_expiry = lease + request->time_in_p->tv_sec;
 		  }
 		  S_set_lease(&entry->pl, lease_time_expiry, &modified);
+		  S_lease_history_append(kDHCPLeaseHistoryEventRenew,
+					 iaddr, idstr, lease_time_expiry,
+					 request->time_in_p->tv_sec);
 	      }
 	  } /* init-reboot/renew/rebind */
       send_ack_or_nak:
@@ -1223,6 +2473,14 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 			  &modified);
 	      ni_set_prop(&entry->pl, NIPROP_DHCP_DECLINED, 
 			  idstr, &modified);
+	      if (subnets != NULL) {
+		  /* skipped until the decline expires, but not bound */
+		  SubnetListReleaseAddress(subnets, iaddr);
+		  SubnetListNoteAddressInUse(subnets, iaddr);
+	      }
+	      S_lease_history_append(kDHCPLeaseHistoryEventDecline,
+				     iaddr, idstr, request->time_in_p->tv_sec,
+				     request->time_in_p->tv_sec);
 	      my_log(LOG_INFO, "dhcpd: IP %s declined by %s",
 		     inet_ntoa(iaddr), idstr);
 	      if (debug) {
@@ -1241,6 +2499,9 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	      }
 	      /* set the lease expiration time to now */
 	      S_set_lease(&entry->pl, request->time_in_p->tv_sec, &modified);
+	      S_lease_history_append(kDHCPLeaseHistoryEventRelease,
+				     iaddr, idstr, request->time_in_p->tv_sec,
+				     request->time_in_p->tv_sec);
 	  }
 	  break;
       }
@@ -1293,21 +2554,51 @@ dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	    reply_msgtype == dhcp_msgtype_offer_e) {
 	    int			num_params;
 	    const uint8_t *	params;
+	    uint8_t		params_buf[DHCP_OPTION_SIZE_MAX];
 
 	    params = (const uint8_t *)
 		dhcpol_find(request->options_p, 
 			    dhcptag_parameter_request_list_e,
 			    &num_params, NULL);
 
-	    bzero(reply->dp_file, sizeof(reply->dp_file));
 	    strlcpy((char *)reply->dp_sname, server_name,
 		    sizeof(reply->dp_sname));
+	    /* options that don't fit within the client's maximum
+	     * message size spill into the (unused) file field */
+	    dhcpoa_set_overload(&options, reply, DHCP_OVERLOAD_FILE);
+
+	    /* the relay agent information must be last in the option
+	     * area (RFC 3046), so keep room for it there */
+	    if (rai_opt != NULL
+		&& dhcpoa_reserve_last(&options, rai_opt_len)
+		!= dhcpoa_success_e) {
+		my_log(LOG_INFO, "couldn't add relay agent information: %s",
+		       dhcpoa_err(&options));
+		goto no_reply;
+	    }
+
+	    /* boot file chosen by the client's architecture */
+	    if (add_boot_arch_options(request, hostname, reply, &options)
+		&& params != NULL) {
+		/* in place of the subnet's vendor class and boot file */
+		num_params = BootArchRemoveBootOptions(params, num_params,
+						       params_buf);
+		params = params_buf;
+	    }
 
 	    /* add the client-specified parameters */
 	    if (params != NULL)
 		(void)add_subnet_options(hostname, iaddr, 
 					 request->if_p, 
 					 &options, params, num_params);
+	    /* echo the relay agent information (RFC 3046) */
+	    if (rai_opt != NULL
+		&& dhcpoa_add_last(&options, dhcptag_relay_agent_information_e,
+				   rai_opt_len, rai_opt) != dhcpoa_success_e) {
+		my_log(LOG_INFO, "couldn't add relay agent information: %s",
+		       dhcpoa_err(&options));
+		goto no_reply;
+	    }
 	    /* terminate the options */
 	    if (dhcpoa_add(&options, dhcptag_end_e, 0, NULL)
 		!= dhcpoa_success_e) {
@@ -39,6 +39,9 @@ void
 dhcp_request(request_t * request, dhcp_msgtype_t msgtype,
 	     boolean_t dhcp_allocate);
 
+boolean_t
+dhcp_commit_pending(void);
+
 boolean_t
 dhcp_bootp_allocate(char * idstr, char * hwstr, struct dhcp * rq,
 		    interface_t * if_p, struct timeval * time_in_p,
@@ -51,6 +54,9 @@ dhcp_bootp_allocate(char * idstr, char * hwstr, struct dhcp * rq,
 
 #define DHCP_DECLINE_WAIT_SECS (60 * 10)		/* 10 minutes */
 
+/* default number of days of lease history to keep */
+#define DHCP_LEASE_HISTORY_DAYS_DEFAULT	90
+
 struct dhcp * 
 make_dhcp_reply(struct dhcp * reply, int pkt_size, 
 		struct in_addr server_id, dhcp_msgtype_t msg, 
@@ -25,10 +25,15 @@
 #define _S_GLOBALS_H
 
 #include "subnets.h"
+#include "arpwatch.h"
 
+extern ARPObservationMapRef arp_observations;
 extern int		bootp_socket;
 extern bool		debug;
 extern bool		dhcp_ignore_client_identifier;
+extern uint32_t		dhcp_lease_history_days;
+extern uint32_t		dhcp_randomized_mac_lease;
+extern bool		dhcp_randomized_mac_use_client_identifier;
 extern int		quiet;
 extern unsigned short	server_priority;
 extern uint32_t		reply_threshold_seconds;
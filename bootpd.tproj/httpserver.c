@@ -0,0 +1,1543 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * httpserver.c
+ * - serve boot files over HTTP/1.1 for UEFI HTTP Boot clients
+ * - a connection is a small state machine: read until the headers are
+ *   complete, format the response headers, then send the headers and
+ *   the file contents; pipelined requests already read are handled as
+ *   soon as the previous response is out
+ * - file contents go from the file to the socket with sendfile(), so
+ *   they're never copied through the server
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifndef __APPLE__
+#include <sys/sendfile.h>
+#endif /* __APPLE__ */
+#include "httpserver.h"
+
+#ifdef TEST_HTTP_SERVER
+#define my_log(level, format, ...)					\
+    do {								\
+	if (S_test_verbose) {						\
+	    fprintf(stderr, format "\n", ## __VA_ARGS__);		\
+	}								\
+    } while (0)
+static bool	S_test_verbose;
+#else /* TEST_HTTP_SERVER */
+#include "mylog.h"
+#endif /* TEST_HTTP_SERVER */
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS		MSG_NOSIGNAL
+#else /* MSG_NOSIGNAL */
+#define SEND_FLAGS		0
+#endif /* MSG_NOSIGNAL */
+
+#define HTTP_RESPONSE_HEADER_MAX	1024
+
+struct HTTPServer {
+    char *		root;
+    HTTPServerStats	stats;
+};
+
+struct HTTPConnection {
+    HTTPServerRef	server;
+    int			fd;
+    time_t		last_active;
+    uint32_t		requests;
+
+    /* the response being sent */
+    bool		sending;
+    bool		close_after;
+    int			out_length;
+    int			out_offset;
+    int			file_fd;
+    off_t		file_offset;
+    off_t		file_remaining;
+    char		out[HTTP_RESPONSE_HEADER_MAX];
+
+    /* requests read but not yet handled */
+    int			in_length;
+    char		in[HTTP_SERVER_HEADER_MAX];
+};
+
+typedef struct {
+    bool		head;
+    bool		keep_alive;
+    bool		http_1_0;
+} HTTPRequest;
+
+static time_t
+S_monotonic_secs(void)
+{
+    struct timespec	ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec);
+}
+
+/*
+ * Function: S_sendfile
+ * Purpose:
+ *   Send up to count bytes of the file starting at offset.  Returns the
+ *   number of bytes sent, or -1 with errno set if none were.
+ */
+static ssize_t
+S_sendfile(int file_fd, int s, off_t offset, size_t count)
+{
+#ifdef __APPLE__
+    off_t	len = (off_t)count;
+
+    if (sendfile(file_fd, s, offset, &len, NULL, 0) < 0) {
+	/* a non-blocking socket may take part of it */
+	if (len > 0 && (errno == EAGAIN || errno == EINTR)) {
+	    return ((ssize_t)len);
+	}
+	return (-1);
+    }
+    return ((ssize_t)len);
+#else /* __APPLE__ */
+    return (sendfile(s, file_fd, &offset, count));
+#endif /* __APPLE__ */
+}
+
+static void
+S_format_date(time_t t, char * buf, size_t buf_size)
+{
+    struct tm	tm;
+
+    gmtime_r(&t, &tm);
+    strftime(buf, buf_size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return;
+}
+
+/**
+ ** HTTPServer
+ **/
+
+HTTPServerRef
+HTTPServerCreate(const char * root)
+{
+    HTTPServerRef	server;
+
+    server = (HTTPServerRef)malloc(sizeof(*server));
+    bzero(server, sizeof(*server));
+    HTTPServerSetRoot(server, root);
+    return (server);
+}
+
+void
+HTTPServerFree(HTTPServerRef * server_p)
+{
+    HTTPServerRef	server = *server_p;
+
+    if (server == NULL) {
+	return;
+    }
+    free(server->root);
+    free(server);
+    *server_p = NULL;
+    return;
+}
+
+const char *
+HTTPServerGetRoot(HTTPServerRef server)
+{
+    return (server->root);
+}
+
+void
+HTTPServerSetRoot(HTTPServerRef server, const char * root)
+{
+    int		len;
+
+    if (server->root != NULL) {
+	free(server->root);
+    }
+    server->root = strdup(root);
+
+    /* paths from requests start with '/' */
+    len = (int)strlen(server->root);
+    while (len > 1 && server->root[len - 1] == '/') {
+	server->root[--len] = '\0';
+    }
+    return;
+}
+
+int
+HTTPServerOpenSocket(struct in_addr addr, uint16_t port, int backlog)
+{
+    int			fd;
+    int			opt;
+    int			save_errno;
+    struct sockaddr_in	sin;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+	return (-1);
+    }
+    opt = 1;
+    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    bzero(&sin, sizeof(sin));
+#ifdef __APPLE__
+    sin.sin_len = sizeof(sin);
+#endif /* __APPLE__ */
+    sin.sin_family = AF_INET;
+    sin.sin_addr = addr;
+    sin.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+	|| listen(fd, backlog) < 0
+	|| ioctl(fd, FIONBIO, &opt) < 0) {
+	save_errno = errno;
+	close(fd);
+	errno = save_errno;
+	return (-1);
+    }
+    return (fd);
+}
+
+void
+HTTPServerNoteRefused(HTTPServerRef server)
+{
+    server->stats.connections_refused++;
+    return;
+}
+
+void
+HTTPServerNoteIdle(HTTPServerRef server)
+{
+    server->stats.connections_idle++;
+    return;
+}
+
+void
+HTTPServerGetStats(HTTPServerRef server, HTTPServerStats * stats)
+{
+    *stats = server->stats;
+    return;
+}
+
+int
+HTTPServerReport(HTTPServerRef server, char * buf, int buf_size)
+{
+    int			len;
+    HTTPServerStats *	stats = &server->stats;
+
+    len = snprintf(buf, buf_size,
+		   "root %s\n"
+		   "connections %llu active %u max %u refused %llu idle %llu\n"
+		   "requests %llu reused connection %llu\n"
+		   "responses 200 %llu 206 %llu 404 %llu 416 %llu"
+		   " other errors %llu\n"
+		   "bytes sent %llu sendfile calls %llu\n",
+		   server->root,
+		   (unsigned long long)stats->connections,
+		   stats->active, stats->active_max,
+		   (unsigned long long)stats->connections_refused,
+		   (unsigned long long)stats->connections_idle,
+		   (unsigned long long)stats->requests,
+		   (unsigned long long)stats->requests_reused,
+		   (unsigned long long)stats->responses_ok,
+		   (unsigned long long)stats->responses_partial,
+		   (unsigned long long)stats->responses_not_found,
+		   (unsigned long long)stats->responses_range,
+		   (unsigned long long)stats->responses_error,
+		   (unsigned long long)stats->bytes_sent,
+		   (unsigned long long)stats->sendfile_calls);
+    if (len >= buf_size) {
+	len = buf_size - 1;
+    }
+    return (len);
+}
+
+static void
+S_server_count_status(HTTPServerRef server, int status)
+{
+    switch (status) {
+    case 200:
+	server->stats.responses_ok++;
+	break;
+    case 206:
+	server->stats.responses_partial++;
+	break;
+    case 404:
+	server->stats.responses_not_found++;
+	break;
+    case 416:
+	server->stats.responses_range++;
+	break;
+    default:
+	server->stats.responses_error++;
+	break;
+    }
+    return;
+}
+
+/**
+ ** HTTPConnection
+ **/
+
+HTTPConnectionRef
+HTTPConnectionCreate(HTTPServerRef server, int fd)
+{
+    HTTPConnectionRef	conn;
+    int			opt = 1;
+
+    (void)ioctl(fd, FIONBIO, &opt);
+#ifdef SO_NOSIGPIPE
+    (void)setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif /* SO_NOSIGPIPE */
+    /* the headers and the file contents are sent separately */
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    conn = (HTTPConnectionRef)malloc(sizeof(*conn));
+    bzero(conn, sizeof(*conn));
+    conn->server = server;
+    conn->fd = fd;
+    conn->file_fd = -1;
+    conn->last_active = S_monotonic_secs();
+    server->stats.connections++;
+    server->stats.active++;
+    if (server->stats.active > server->stats.active_max) {
+	server->stats.active_max = server->stats.active;
+    }
+    return (conn);
+}
+
+void
+HTTPConnectionFree(HTTPConnectionRef * conn_p)
+{
+    HTTPConnectionRef	conn = *conn_p;
+
+    if (conn == NULL) {
+	return;
+    }
+    if (conn->file_fd >= 0) {
+	close(conn->file_fd);
+    }
+    close(conn->fd);
+    conn->server->stats.active--;
+    free(conn);
+    *conn_p = NULL;
+    return;
+}
+
+int
+HTTPConnectionGetFD(HTTPConnectionRef conn)
+{
+    return (conn->fd);
+}
+
+bool
+HTTPConnectionIsIdle(HTTPConnectionRef conn, int idle_secs)
+{
+    return ((S_monotonic_secs() - conn->last_active) >= idle_secs);
+}
+
+/*
+ * Function: S_response_headers
+ * Purpose:
+ *   Start the response with the status line and the common headers.
+ *   extra is zero or more complete header lines.
+ */
+static void
+S_response_headers(HTTPConnectionRef conn, const HTTPRequest * req,
+		   int status, const char * reason, off_t content_length,
+		   const char * extra)
+{
+    char	date[64];
+    int		len;
+
+    S_format_date(time(NULL), date, sizeof(date));
+    len = snprintf(conn->out, sizeof(conn->out),
+		   "HTTP/1.1 %d %s\r\n"
+		   "Date: %s\r\n"
+		   "Server: bootpd\r\n"
+		   "Content-Length: %lld\r\n"
+		   "%s%s\r\n",
+		   status, reason, date, (long long)content_length,
+		   extra != NULL ? extra : "",
+		   conn->close_after
+		   ? "Connection: close\r\n"
+		   : (req->http_1_0 ? "Connection: keep-alive\r\n" : ""));
+    if (len >= (int)sizeof(conn->out)) {
+	/* can't happen: the headers are short and bounded */
+	len = sizeof(conn->out) - 1;
+    }
+    conn->out_length = len;
+    conn->out_offset = 0;
+    conn->sending = true;
+    S_server_count_status(conn->server, status);
+    return;
+}
+
+static void
+S_error_response(HTTPConnectionRef conn, const HTTPRequest * req,
+		 int status, const char * reason, const char * extra)
+{
+    char	body[64];
+    int		body_length;
+    char	headers[256];
+
+    body_length = snprintf(body, sizeof(body), "%d %s\n", status, reason);
+    snprintf(headers, sizeof(headers),
+	     "Content-Type: text/plain\r\n%s", extra != NULL ? extra : "");
+    S_response_headers(conn, req, status, reason, body_length, headers);
+    if (req->head == false
+	&& (conn->out_length + body_length) < (int)sizeof(conn->out)) {
+	memcpy(conn->out + conn->out_length, body, body_length);
+	conn->out_length += body_length;
+    }
+    my_log(LOG_DEBUG, "http: %d %s", status, reason);
+    return;
+}
+
+static int
+S_hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9') {
+	return (ch - '0');
+    }
+    if (ch >= 'a' && ch <= 'f') {
+	return (ch - 'a' + 10);
+    }
+    if (ch >= 'A' && ch <= 'F') {
+	return (ch - 'A' + 10);
+    }
+    return (-1);
+}
+
+/*
+ * Function: S_decode_path
+ * Purpose:
+ *   Percent-decode the path of the request target into path, dropping
+ *   the query.  Returns false if the path is malformed, or climbs out of
+ *   the root with a ".." component.
+ */
+static bool
+S_decode_path(const char * target, char * path, int path_size)
+{
+    const char *	component;
+    int			n = 0;
+    const char *	scan;
+
+    /* absolute-form: http://host/path */
+    if (strncasecmp(target, "http://", 7) == 0) {
+	target = strchr(target + 7, '/');
+	if (target == NULL) {
+	    return (false);
+	}
+    }
+    if (target[0] != '/') {
+	return (false);
+    }
+    for (scan = target; *scan != '\0' && *scan != '?' && *scan != '#';
+	 scan++) {
+	char	ch = *scan;
+
+	if (ch == '%') {
+	    int		hi = S_hex_value(scan[1]);
+	    int		lo = (hi < 0) ? -1 : S_hex_value(scan[2]);
+
+	    if (lo < 0) {
+		return (false);
+	    }
+	    ch = (char)((hi << 4) | lo);
+	    if (ch == '\0') {
+		return (false);
+	    }
+	    scan += 2;
+	}
+	if (n == path_size - 1) {
+	    return (false);
+	}
+	path[n++] = ch;
+    }
+    path[n] = '\0';
+
+    /* check each component of the decoded path */
+    for (component = path; component != NULL; ) {
+	const char *	slash;
+	int		len;
+
+	component++;
+	slash = strchr(component, '/');
+	len = (slash != NULL) ? (int)(slash - component)
+	    : (int)strlen(component);
+	if (len == 2 && component[0] == '.' && component[1] == '.') {
+	    return (false);
+	}
+	component = slash;
+    }
+    return (true);
+}
+
+static bool
+S_parse_offset(const char * * scan_p, off_t * val_p)
+{
+    const char *	scan = *scan_p;
+    uint64_t		val = 0;
+
+    if (*scan < '0' || *scan > '9') {
+	return (false);
+    }
+    for (; *scan >= '0' && *scan <= '9'; scan++) {
+	if (val > (INT64_MAX - 9) / 10) {
+	    return (false);
+	}
+	val = val * 10 + (*scan - '0');
+    }
+    *val_p = (off_t)val;
+    *scan_p = scan;
+    return (true);
+}
+
+typedef enum {
+    kRangeNone = 0,		/* send the whole file */
+    kRangeSatisfiable,
+    kRangeNotSatisfiable,
+} RangeResult;
+
+/*
+ * Function: S_parse_range
+ * Purpose:
+ *   Parse a Range header value against the file size.  Only a single
+ *   byte range is honored; a list of ranges or a value that doesn't
+ *   parse gets the whole file, which RFC 9110 allows.
+ */
+static RangeResult
+S_parse_range(const char * value, off_t size, off_t * start_p, off_t * end_p)
+{
+    off_t		end;
+    const char *	scan;
+    off_t		start;
+
+    if (strncasecmp(value, "bytes=", 6) != 0 || strchr(value, ',') != NULL) {
+	return (kRangeNone);
+    }
+    scan = value + 6;
+    while (*scan == ' ') {
+	scan++;
+    }
+    if (*scan == '-') {
+	off_t	suffix;
+
+	/* the last suffix bytes */
+	scan++;
+	if (S_parse_offset(&scan, &suffix) == false) {
+	    return (kRangeNone);
+	}
+	if (suffix == 0 || size == 0) {
+	    return (kRangeNotSatisfiable);
+	}
+	start = (suffix < size) ? (size - suffix) : 0;
+	end = size - 1;
+    }
+    else {
+	if (S_parse_offset(&scan, &start) == false || *scan != '-') {
+	    return (kRangeNone);
+	}
+	scan++;
+	if (*scan >= '0' && *scan <= '9') {
+	    if (S_parse_offset(&scan, &end) == false || end < start) {
+		return (kRangeNone);
+	    }
+	}
+	else {
+	    end = size - 1;
+	}
+	if (start >= size) {
+	    return (kRangeNotSatisfiable);
+	}
+	if (end >= size) {
+	    end = size - 1;
+	}
+    }
+    while (*scan == ' ') {
+	scan++;
+    }
+    if (*scan != '\0') {
+	return (kRangeNone);
+    }
+    *start_p = start;
+    *end_p = end;
+    return (kRangeSatisfiable);
+}
+
+static bool
+S_header_has_token(const char * value, const char * token)
+{
+    int		len = (int)strlen(token);
+
+    while (*value != '\0') {
+	while (*value == ' ' || *value == ',') {
+	    value++;
+	}
+	if (strncasecmp(value, token, len) == 0
+	    && (value[len] == '\0' || value[len] == ','
+		|| value[len] == ' ')) {
+	    return (true);
+	}
+	value = strchr(value, ',');
+	if (value == NULL) {
+	    break;
+	}
+    }
+    return (false);
+}
+
+/*
+ * Function: S_file_response
+ * Purpose:
+ *   Open the file named by the request and start the response.
+ */
+static void
+S_file_response(HTTPConnectionRef conn, const HTTPRequest * req,
+		const char * path, const char * range)
+{
+    off_t		end = 0;
+    char		extra[256];
+    int			fd;
+    char		full_path[PATH_MAX];
+    char		modified[64];
+    RangeResult		result = kRangeNone;
+    struct stat		sb;
+    off_t		start = 0;
+
+    if (snprintf(full_path, sizeof(full_path), "%s%s",
+		 conn->server->root, path) >= (int)sizeof(full_path)) {
+	S_error_response(conn, req, 404, "Not Found", NULL);
+	return;
+    }
+    /* O_NONBLOCK so that opening a FIFO doesn't wait for a writer */
+    fd = open(full_path, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+	S_error_response(conn, req, 404, "Not Found", NULL);
+	return;
+    }
+    if (fstat(fd, &sb) < 0 || S_ISREG(sb.st_mode) == 0) {
+	close(fd);
+	S_error_response(conn, req, 404, "Not Found", NULL);
+	return;
+    }
+    if (range != NULL) {
+	result = S_parse_range(range, sb.st_size, &start, &end);
+    }
+    if (result == kRangeNotSatisfiable) {
+	close(fd);
+	snprintf(extra, sizeof(extra), "Content-Range: bytes */%lld\r\n",
+		 (long long)sb.st_size);
+	S_error_response(conn, req, 416, "Range Not Satisfiable", extra);
+	return;
+    }
+    S_format_date(sb.st_mtime, modified, sizeof(modified));
+    if (result == kRangeSatisfiable) {
+	snprintf(extra, sizeof(extra),
+		 "Content-Type: application/octet-stream\r\n"
+		 "Accept-Ranges: bytes\r\n"
+		 "Last-Modified: %s\r\n"
+		 "Content-Range: bytes %lld-%lld/%lld\r\n",
+		 modified, (long long)start, (long long)end,
+		 (long long)sb.st_size);
+	S_response_headers(conn, req, 206, "Partial Content",
+			   end - start + 1, extra);
+    }
+    else {
+	start = 0;
+	end = sb.st_size - 1;
+	snprintf(extra, sizeof(extra),
+		 "Content-Type: application/octet-stream\r\n"
+		 "Accept-Ranges: bytes\r\n"
+		 "Last-Modified: %s\r\n",
+		 modified);
+	S_response_headers(conn, req, 200, "OK", sb.st_size, extra);
+    }
+    if (req->head || end < start) {
+	close(fd);
+	return;
+    }
+    conn->file_fd = fd;
+    conn->file_offset = start;
+    conn->file_remaining = end - start + 1;
+    my_log(LOG_DEBUG, "http: %s %lld-%lld", path, (long long)start,
+	   (long long)end);
+    return;
+}
+
+/*
+ * Function: S_handle_request
+ * Purpose:
+ *   Parse the request in the first header_length bytes of the input
+ *   and start its response.
+ */
+static void
+S_handle_request(HTTPConnectionRef conn, int header_length)
+{
+    bool		has_body = false;
+    char		headers[HTTP_SERVER_HEADER_MAX + 1];
+    char *		line;
+    bool		if_range = false;
+    char *		method;
+    char *		next;
+    char		path[PATH_MAX];
+    char *		range = NULL;
+    HTTPRequest		req;
+    char *		target;
+    char *		version;
+
+    bzero(&req, sizeof(req));
+    memcpy(headers, conn->in, header_length);
+    headers[header_length] = '\0';
+    conn->server->stats.requests++;
+    if (conn->requests++ > 0) {
+	conn->server->stats.requests_reused++;
+    }
+
+    /* request line */
+    line = headers;
+    next = strstr(line, "\r\n");
+    *next = '\0';
+    next += 2;
+    method = strsep(&line, " ");
+    target = strsep(&line, " ");
+    version = line;
+    if (target == NULL || version == NULL || target[0] == '\0'
+	|| strncmp(version, "HTTP/", 5) != 0) {
+	conn->close_after = true;
+	S_error_response(conn, &req, 400, "Bad Request", NULL);
+	return;
+    }
+    if (strcmp(version, "HTTP/1.1") == 0) {
+	req.keep_alive = true;
+    }
+    else if (strcmp(version, "HTTP/1.0") == 0) {
+	req.http_1_0 = true;
+    }
+    else {
+	conn->close_after = true;
+	S_error_response(conn, &req, 505, "HTTP Version Not Supported", NULL);
+	return;
+    }
+    req.head = (strcmp(method, "HEAD") == 0);
+
+    /* header fields */
+    for (line = next; *line != '\0'; line = next) {
+	char *	value;
+
+	next = strstr(line, "\r\n");
+	if (next == NULL) {
+	    break;
+	}
+	*next = '\0';
+	next += 2;
+	value = strchr(line, ':');
+	if (value == NULL) {
+	    continue;
+	}
+	*value++ = '\0';
+	while (*value == ' ' || *value == '\t') {
+	    value++;
+	}
+	if (strcasecmp(line, "Connection") == 0) {
+	    if (S_header_has_token(value, "close")) {
+		req.keep_alive = false;
+	    }
+	    else if (S_header_has_token(value, "keep-alive")) {
+		req.keep_alive = true;
+	    }
+	}
+	else if (strcasecmp(line, "Range") == 0) {
+	    range = value;
+	}
+	else if (strcasecmp(line, "If-Range") == 0) {
+	    if_range = true;
+	}
+	else if (strcasecmp(line, "Content-Length") == 0) {
+	    if (strcmp(value, "0") != 0) {
+		has_body = true;
+	    }
+	}
+	else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+	    has_body = true;
+	}
+    }
+    if (if_range) {
+	/* the whole file is always a valid answer */
+	range = NULL;
+    }
+
+    /* a request body isn't read, so the connection can't be reused */
+    if (has_body || req.keep_alive == false) {
+	conn->close_after = true;
+    }
+    if (req.head == false && strcmp(method, "GET") != 0) {
+	conn->close_after = true;
+	S_error_response(conn, &req, 405, "Method Not Allowed",
+			 "Allow: GET, HEAD\r\n");
+	return;
+    }
+    if (S_decode_path(target, path, sizeof(path)) == false) {
+	S_error_response(conn, &req, 403, "Forbidden", NULL);
+	return;
+    }
+    S_file_response(conn, &req, path, range);
+    return;
+}
+
+/*
+ * Function: S_send_response
+ * Purpose:
+ *   Send as much of the response as the socket and budget allow.
+ *   Returns 1 when it's all sent, 0 if there's more to send, or -1 if
+ *   the connection failed.
+ */
+static int
+S_send_response(HTTPConnectionRef conn, size_t * budget)
+{
+    ssize_t	n;
+
+    while (conn->out_offset < conn->out_length) {
+	n = send(conn->fd, conn->out + conn->out_offset,
+		 conn->out_length - conn->out_offset, SEND_FLAGS);
+	if (n < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		return (0);
+	    }
+	    my_log(LOG_DEBUG, "http: send failed, %s", strerror(errno));
+	    return (-1);
+	}
+	conn->out_offset += n;
+	conn->last_active = S_monotonic_secs();
+    }
+    while (conn->file_remaining > 0) {
+	size_t		count;
+
+	if (*budget == 0) {
+	    return (0);
+	}
+	count = *budget;
+	if ((off_t)count > conn->file_remaining) {
+	    count = (size_t)conn->file_remaining;
+	}
+	conn->server->stats.sendfile_calls++;
+	n = S_sendfile(conn->file_fd, conn->fd, conn->file_offset, count);
+	if (n < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		return (0);
+	    }
+	    my_log(LOG_DEBUG, "http: sendfile failed, %s", strerror(errno));
+	    return (-1);
+	}
+	if (n == 0) {
+	    /* the file got shorter */
+	    my_log(LOG_NOTICE, "http: file truncated while being sent");
+	    return (-1);
+	}
+	conn->file_offset += n;
+	conn->file_remaining -= n;
+	conn->server->stats.bytes_sent += n;
+	*budget -= n;
+	conn->last_active = S_monotonic_secs();
+    }
+    if (conn->file_fd >= 0) {
+	close(conn->file_fd);
+	conn->file_fd = -1;
+    }
+    return (1);
+}
+
+/*
+ * Function: S_header_length
+ * Purpose:
+ *   Returns the length of the request line and headers, including the
+ *   empty line that ends them, or 0 if they aren't all there yet.
+ */
+static int
+S_header_length(const char * buf, int length)
+{
+    int		i;
+
+    for (i = 3; i < length; i++) {
+	if (buf[i] == '\n' && buf[i - 1] == '\r'
+	    && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+	    return (i + 1);
+	}
+    }
+    return (0);
+}
+
+static HTTPConnectionStatus
+S_connection_run(HTTPConnectionRef conn)
+{
+    size_t	budget = HTTP_SERVER_SEND_MAX;
+    int		header_length;
+    HTTPRequest	req;
+
+    while (true) {
+	if (conn->sending) {
+	    switch (S_send_response(conn, &budget)) {
+	    case 0:
+		return (kHTTPConnectionStatusWaitWrite);
+	    case 1:
+		break;
+	    default:
+		return (kHTTPConnectionStatusClose);
+	    }
+	    conn->sending = false;
+	    if (conn->close_after) {
+		return (kHTTPConnectionStatusClose);
+	    }
+	}
+	if (conn->in_length > 0 && conn->in[0] == '\r') {
+	    /* tolerate a CRLF after a request (RFC 9112 section 2.2) */
+	    int		skip = (conn->in_length > 1 && conn->in[1] == '\n')
+		? 2 : 1;
+
+	    conn->in_length -= skip;
+	    memmove(conn->in, conn->in + skip, conn->in_length);
+	}
+	header_length = S_header_length(conn->in, conn->in_length);
+	if (header_length == 0) {
+	    if (conn->in_length < (int)sizeof(conn->in)) {
+		return (kHTTPConnectionStatusWaitRead);
+	    }
+	    bzero(&req, sizeof(req));
+	    conn->close_after = true;
+	    conn->server->stats.requests++;
+	    S_error_response(conn, &req, 431,
+			     "Request Header Fields Too Large", NULL);
+	    conn->in_length = 0;
+	    continue;
+	}
+	S_handle_request(conn, header_length);
+	conn->in_length -= header_length;
+	memmove(conn->in, conn->in + header_length, conn->in_length);
+    }
+}
+
+HTTPConnectionStatus
+HTTPConnectionReadable(HTTPConnectionRef conn)
+{
+    ssize_t	n;
+
+    n = recv(conn->fd, conn->in + conn->in_length,
+	     sizeof(conn->in) - conn->in_length, 0);
+    if (n < 0) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+	    return (kHTTPConnectionStatusWaitRead);
+	}
+	return (kHTTPConnectionStatusClose);
+    }
+    if (n == 0) {
+	return (kHTTPConnectionStatusClose);
+    }
+    conn->in_length += n;
+    conn->last_active = S_monotonic_secs();
+    return (S_connection_run(conn));
+}
+
+HTTPConnectionStatus
+HTTPConnectionWritable(HTTPConnectionRef conn)
+{
+    return (S_connection_run(conn));
+}
+
+#ifdef TEST_HTTP_SERVER
+
+/*
+ * Serve a directory of generated boot files on the loopback interface,
+ * check the responses a UEFI HTTP Boot client depends on, then measure
+ * throughput with many concurrent clients each downloading the image
+ * repeatedly over a single connection.
+ */
+
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#define IMAGE_NAME		"boot.efi"
+
+static uint8_t *	S_image;
+static off_t		S_image_size;
+static uint16_t		S_port;
+static int		S_failures;
+static volatile int	S_clients_done;
+
+static uint64_t
+S_usecs(void)
+{
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+static void
+check(bool ok, const char * what)
+{
+    if (ok == false) {
+	fprintf(stderr, "FAIL: %s\n", what);
+	__sync_fetch_and_add(&S_failures, 1);
+    }
+    else if (S_test_verbose) {
+	printf("ok: %s\n", what);
+    }
+    return;
+}
+
+static int
+client_connect(void)
+{
+    int			fd;
+    struct sockaddr_in	sin;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    bzero(&sin, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port = htons(S_port);
+    if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+	perror("connect");
+	exit(1);
+    }
+    return (fd);
+}
+
+typedef struct {
+    int		status;
+    off_t	content_length;
+    char	headers[HTTP_RESPONSE_HEADER_MAX + 1];
+    bool	closed;		/* server closed after the response */
+} Response;
+
+/* bytes read past the end of one response belong to the next */
+typedef struct {
+    int		fd;
+    int		length;
+    char	buf[HTTP_RESPONSE_HEADER_MAX];
+} Client;
+
+static ssize_t
+client_read(Client * c, void * buf, size_t size)
+{
+    if (c->length > 0) {
+	size_t	n = (size < (size_t)c->length) ? size : (size_t)c->length;
+
+	memcpy(buf, c->buf, n);
+	c->length -= n;
+	memmove(c->buf, c->buf + n, c->length);
+	return (n);
+    }
+    return (recv(c->fd, buf, size, 0));
+}
+
+/*
+ * Function: client_response
+ * Purpose:
+ *   Read a response.  The body is compared with expect if it's not NULL,
+ *   and skipped otherwise.  Returns false if the connection failed.
+ */
+static bool
+client_response(Client * c, bool head, const uint8_t * expect,
+		Response * resp)
+{
+    char *	cl;
+    char	chunk[64 * 1024];
+    int		header_length;
+    off_t	left;
+    ssize_t	n;
+    off_t	offset = 0;
+
+    bzero(resp, sizeof(*resp));
+    while ((header_length = S_header_length(c->buf, c->length)) == 0) {
+	if (c->length == sizeof(c->buf)) {
+	    return (false);
+	}
+	n = recv(c->fd, c->buf + c->length, sizeof(c->buf) - c->length, 0);
+	if (n <= 0) {
+	    return (false);
+	}
+	c->length += n;
+    }
+    memcpy(resp->headers, c->buf, header_length);
+    resp->headers[header_length] = '\0';
+    c->length -= header_length;
+    memmove(c->buf, c->buf + header_length, c->length);
+    resp->status = atoi(resp->headers + 9);
+    cl = strstr(resp->headers, "\r\nContent-Length: ");
+    if (cl != NULL) {
+	resp->content_length = strtoll(cl + 18, NULL, 10);
+    }
+    resp->closed = (strstr(resp->headers, "\r\nConnection: close")
+		    != NULL);
+    if (head) {
+	return (true);
+    }
+    for (left = resp->content_length; left > 0; left -= n) {
+	n = client_read(c, chunk,
+			(left < (off_t)sizeof(chunk)) ? left : sizeof(chunk));
+	if (n <= 0) {
+	    return (false);
+	}
+	if (expect != NULL && memcmp(chunk, expect + offset, n) != 0) {
+	    check(false, "response body matches the file");
+	    expect = NULL;
+	}
+	offset += n;
+    }
+    return (true);
+}
+
+static void
+client_send(Client * c, const char * request)
+{
+    size_t	len = strlen(request);
+
+    if (send(c->fd, request, len, 0) != (ssize_t)len) {
+	perror("send");
+	exit(1);
+    }
+    return;
+}
+
+static bool
+client_get(Client * c, const char * request, bool head,
+	   const uint8_t * expect, Response * resp)
+{
+    client_send(c, request);
+    return (client_response(c, head, expect, resp));
+}
+
+static void *
+conformance_thread(void * arg)
+{
+    char		big[HTTP_SERVER_HEADER_MAX];
+    Client		c;
+    char		ch;
+    char		request[256];
+    Response		resp;
+    off_t		size = S_image_size;
+
+    bzero(&c, sizeof(c));
+    c.fd = client_connect();
+
+    check(client_get(&c, "GET /" IMAGE_NAME " HTTP/1.1\r\n"
+		     "Host: 127.0.0.1\r\n\r\n", false, S_image, &resp)
+	  && resp.status == 200 && resp.content_length == size
+	  && resp.closed == false
+	  && strstr(resp.headers, "Accept-Ranges: bytes") != NULL
+	  && strstr(resp.headers, "Last-Modified: ") != NULL,
+	  "GET the whole image");
+    check(client_get(&c, "HEAD /" IMAGE_NAME " HTTP/1.1\r\n\r\n",
+		     true, NULL, &resp)
+	  && resp.status == 200 && resp.content_length == size,
+	  "HEAD on the same connection");
+    check(client_get(&c, "GET /" IMAGE_NAME " HTTP/1.1\r\n"
+		     "Range: bytes=1000-1999\r\n\r\n",
+		     false, S_image + 1000, &resp)
+	  && resp.status == 206 && resp.content_length == 1000
+	  && strstr(resp.headers, "Content-Range: bytes 1000-1999/") != NULL,
+	  "range");
+    check(client_get(&c, "GET /" IMAGE_NAME " HTTP/1.1\r\n"
+		     "Range: bytes=-500\r\n\r\n",
+		     false, S_image + size - 500, &resp)
+	  && resp.status == 206 && resp.content_length == 500,
+	  "suffix range");
+    snprintf(request, sizeof(request),
+	     "GET /" IMAGE_NAME " HTTP/1.1\r\nRange: bytes=%lld-\r\n\r\n",
+	     (long long)(size - 10));
+    check(client_get(&c, request, false, S_image + size - 10, &resp)
+	  && resp.status == 206 && resp.content_length == 10,
+	  "open-ended range");
+    snprintf(request, sizeof(request),
+	     "GET /" IMAGE_NAME " HTTP/1.1\r\nRange: bytes=%lld-\r\n\r\n",
+	     (long long)size);
+    check(client_get(&c, request, false, NULL, &resp)
+	  && resp.status == 416
+	  && strstr(resp.headers, "Content-Range: bytes */") != NULL,
+	  "range past the end");
+    check(client_get(&c, "GET /" IMAGE_NAME " HTTP/1.1\r\n"
+		     "Range: bytes=0-0,10-20\r\n\r\n", false, S_image, &resp)
+	  && resp.status == 200 && resp.content_length == size,
+	  "multiple ranges get the whole file");
+    check(client_get(&c, "GET /" IMAGE_NAME " HTTP/1.1\r\n"
+		     "Range: bytes=0-9\r\nIf-Range: \"x\"\r\n\r\n",
+		     false, S_image, &resp)
+	  && resp.status == 200,
+	  "If-Range gets the whole file");
+    check(client_get(&c, "GET /missing.efi HTTP/1.1\r\n\r\n",
+		     false, NULL, &resp)
+	  && resp.status == 404 && resp.closed == false,
+	  "missing file");
+    check(client_get(&c, "GET /sub/../../etc/passwd HTTP/1.1\r\n\r\n",
+		     false, NULL, &resp)
+	  && resp.status == 403,
+	  "path outside the root");
+    check(client_get(&c, "GET /%2e%2e/etc/passwd HTTP/1.1\r\n\r\n",
+		     false, NULL, &resp)
+	  && resp.status == 403,
+	  "encoded path outside the root");
+    check(client_get(&c, "GET /sub HTTP/1.1\r\n\r\n", false, NULL, &resp)
+	  && resp.status == 404,
+	  "directory");
+    check(client_get(&c, "GET /sub/grub%2Ecfg?x=1 HTTP/1.1\r\n\r\n",
+		     false, (const uint8_t *)"set timeout=0\n", &resp)
+	  && resp.status == 200 && resp.content_length == 14,
+	  "encoded path with a query");
+
+    /* pipelined: both requests go out before either response is read */
+    client_send(&c, "GET /sub/grub.cfg HTTP/1.1\r\n\r\n"
+		"GET /" IMAGE_NAME " HTTP/1.1\r\nRange: bytes=0-99\r\n\r\n");
+    check(client_response(&c, false, (const uint8_t *)"set timeout=0\n",
+			  &resp)
+	  && resp.status == 200
+	  && client_response(&c, false, S_image, &resp)
+	  && resp.status == 206 && resp.content_length == 100,
+	  "pipelined requests");
+
+    check(client_get(&c, "POST /" IMAGE_NAME " HTTP/1.1\r\n"
+		     "Content-Length: 0\r\n\r\n", false, NULL, &resp)
+	  && resp.status == 405 && resp.closed
+	  && recv(c.fd, &ch, 1, 0) == 0,
+	  "POST is refused and the connection closed");
+    close(c.fd);
+
+    /* HTTP/1.0 closes unless asked to keep the connection */
+    bzero(&c, sizeof(c));
+    c.fd = client_connect();
+    check(client_get(&c, "GET /sub/grub.cfg HTTP/1.0\r\n"
+		     "Connection: keep-alive\r\n\r\n", false, NULL, &resp)
+	  && resp.status == 200 && resp.closed == false
+	  && client_get(&c, "GET /sub/grub.cfg HTTP/1.0\r\n\r\n",
+			false, NULL, &resp)
+	  && resp.closed && recv(c.fd, &ch, 1, 0) == 0,
+	  "HTTP/1.0 keep-alive");
+    close(c.fd);
+
+    /* headers that never end */
+    bzero(&c, sizeof(c));
+    c.fd = client_connect();
+    memset(big, 'a', sizeof(big));
+    memcpy(big, "GET / HTTP/1.1\r\nX: ", 19);
+    send(c.fd, big, sizeof(big), 0);
+    check(client_response(&c, false, NULL, &resp) && resp.status == 431,
+	  "oversized headers");
+    close(c.fd);
+
+    __sync_fetch_and_add(&S_clients_done, 1);
+    return (NULL);
+}
+
+typedef struct {
+    int		downloads;
+    uint64_t	bytes;
+} LoadArgs;
+
+static void *
+load_thread(void * arg)
+{
+    LoadArgs *	args = (LoadArgs *)arg;
+    Client	c;
+    int		i;
+    Response	resp;
+
+    bzero(&c, sizeof(c));
+    c.fd = client_connect();
+    for (i = 0; i < args->downloads; i++) {
+	/* verify the first download, just time the rest */
+	if (client_get(&c, "GET /" IMAGE_NAME " HTTP/1.1\r\n"
+		       "Host: 127.0.0.1\r\n\r\n", false,
+		       (i == 0) ? S_image : NULL, &resp) == false
+	    || resp.status != 200 || resp.content_length != S_image_size) {
+	    check(false, "concurrent download");
+	    break;
+	}
+	args->bytes += resp.content_length;
+    }
+    close(c.fd);
+    __sync_fetch_and_add(&S_clients_done, 1);
+    return (NULL);
+}
+
+#define CONNECTIONS_MAX		1024
+
+/*
+ * Function: serve
+ * Purpose:
+ *   Run the server until clients_expected clients are done.
+ */
+static void
+serve(HTTPServerRef server, int listen_fd, int clients_expected)
+{
+    static HTTPConnectionRef	conns[CONNECTIONS_MAX];
+    static HTTPConnectionStatus	status[CONNECTIONS_MAX];
+    static int			count;
+    struct pollfd		fds[CONNECTIONS_MAX + 1];
+    int				i;
+
+    while (S_clients_done < clients_expected || count > 0) {
+	int	n;
+
+	fds[0].fd = listen_fd;
+	fds[0].events = POLLIN;
+	for (i = 0; i < count; i++) {
+	    fds[i + 1].fd = HTTPConnectionGetFD(conns[i]);
+	    fds[i + 1].events
+		= (status[i] == kHTTPConnectionStatusWaitWrite)
+		? POLLOUT : POLLIN;
+	    fds[i + 1].revents = 0;
+	}
+	n = poll(fds, count + 1, 100);
+	if (n < 0) {
+	    continue;
+	}
+	for (i = count - 1; i >= 0; i--) {
+	    HTTPConnectionStatus	s;
+
+	    if (fds[i + 1].revents == 0) {
+		if (HTTPConnectionIsIdle(conns[i],
+					 HTTP_SERVER_IDLE_SECS_DEFAULT)) {
+		    HTTPServerNoteIdle(server);
+		    s = kHTTPConnectionStatusClose;
+		}
+		else {
+		    continue;
+		}
+	    }
+	    else if (status[i] == kHTTPConnectionStatusWaitWrite) {
+		s = HTTPConnectionWritable(conns[i]);
+	    }
+	    else {
+		s = HTTPConnectionReadable(conns[i]);
+	    }
+	    if (s == kHTTPConnectionStatusClose) {
+		HTTPConnectionFree(&conns[i]);
+		count--;
+		conns[i] = conns[count];
+		status[i] = status[count];
+		continue;
+	    }
+	    status[i] = s;
+	}
+	if ((fds[0].revents & POLLIN) != 0) {
+	    int		fd;
+
+	    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		if (count == CONNECTIONS_MAX) {
+		    HTTPServerNoteRefused(server);
+		    close(fd);
+		    continue;
+		}
+		conns[count] = HTTPConnectionCreate(server, fd);
+		status[count] = kHTTPConnectionStatusWaitRead;
+		count++;
+	    }
+	}
+    }
+    return;
+}
+
+static void
+write_file(const char * path, const void * buf, size_t size)
+{
+    int		fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, buf, size) != (ssize_t)size) {
+	perror(path);
+	exit(1);
+    }
+    close(fd);
+    return;
+}
+
+static void
+usage(const char * progname)
+{
+    fprintf(stderr,
+	    "usage: %s [ -v ] [ -clients <count> ] [ -downloads <count> ]"
+	    " [ -size <megabytes> ]\n", progname);
+    exit(1);
+}
+
+int
+main(int argc, char * argv[])
+{
+    LoadArgs *		args;
+    int			clients = 64;
+    char		dir[] = "/tmp/httpserver.XXXXXX";
+    int			downloads = 4;
+    int			i;
+    struct in_addr	loopback;
+    int			listen_fd;
+    char		path[PATH_MAX];
+    char		report[1024];
+    HTTPServerRef	server;
+    int			size_mb = 16;
+    struct sockaddr_in	sin;
+    socklen_t		sin_len = sizeof(sin);
+    uint64_t		start;
+    HTTPServerStats	stats;
+    pthread_t *		threads;
+    uint64_t		total = 0;
+    uint64_t		usecs;
+
+    for (i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-v") == 0) {
+	    S_test_verbose = true;
+	}
+	else if (strcmp(argv[i], "-clients") == 0 && (i + 1) < argc) {
+	    clients = atoi(argv[++i]);
+	}
+	else if (strcmp(argv[i], "-downloads") == 0 && (i + 1) < argc) {
+	    downloads = atoi(argv[++i]);
+	}
+	else if (strcmp(argv[i], "-size") == 0 && (i + 1) < argc) {
+	    size_mb = atoi(argv[++i]);
+	}
+	else {
+	    usage(argv[0]);
+	}
+    }
+    if (clients <= 0 || clients > CONNECTIONS_MAX || downloads <= 0
+	|| size_mb <= 0) {
+	usage(argv[0]);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    /* the boot files */
+    if (mkdtemp(dir) == NULL) {
+	perror("mkdtemp");
+	exit(1);
+    }
+    S_image_size = (off_t)size_mb * 1024 * 1024;
+    S_image = malloc(S_image_size);
+    srandom(1);
+    for (i = 0; i < (int)(S_image_size / sizeof(long)); i++) {
+	((long *)S_image)[i] = random();
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, IMAGE_NAME);
+    write_file(path, S_image, S_image_size);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/grub.cfg", dir);
+    write_file(path, "set timeout=0\n", 14);
+
+    server = HTTPServerCreate(dir);
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    listen_fd = HTTPServerOpenSocket(loopback, 0, CONNECTIONS_MAX);
+    if (listen_fd < 0
+	|| getsockname(listen_fd, (struct sockaddr *)&sin, &sin_len) < 0) {
+	perror("HTTPServerOpenSocket");
+	exit(1);
+    }
+    S_port = ntohs(sin.sin_port);
+
+    /* conformance */
+    threads = malloc(sizeof(*threads) * clients);
+    pthread_create(threads, NULL, conformance_thread, NULL);
+    serve(server, listen_fd, 1);
+    pthread_join(threads[0], NULL);
+    printf("conformance: %s\n", (S_failures == 0) ? "passed" : "FAILED");
+
+    /* throughput */
+    S_clients_done = 0;
+    args = calloc(clients, sizeof(*args));
+    start = S_usecs();
+    for (i = 0; i < clients; i++) {
+	args[i].downloads = downloads;
+	pthread_create(threads + i, NULL, load_thread, args + i);
+    }
+    serve(server, listen_fd, clients);
+    for (i = 0; i < clients; i++) {
+	pthread_join(threads[i], NULL);
+	total += args[i].bytes;
+    }
+    usecs = S_usecs() - start;
+    HTTPServerGetStats(server, &stats);
+    printf("%d clients x %d downloads of %d MB: %llu bytes in %.3f s,"
+	   " %.1f MB/s, %.1f downloads/s\n",
+	   clients, downloads, size_mb, (unsigned long long)total,
+	   usecs / 1e6, (total / (1024.0 * 1024.0)) / (usecs / 1e6),
+	   (clients * downloads) / (usecs / 1e6));
+    HTTPServerReport(server, report, sizeof(report));
+    printf("%s", report);
+    if (stats.active != 0) {
+	check(false, "all connections released");
+    }
+
+    /* clean up */
+    close(listen_fd);
+    HTTPServerFree(&server);
+    snprintf(path, sizeof(path), "%s/sub/grub.cfg", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/%s", dir, IMAGE_NAME);
+    unlink(path);
+    rmdir(dir);
+    free(args);
+    free(threads);
+    free(S_image);
+    if (S_failures != 0) {
+	fprintf(stderr, "%d failures\n", S_failures);
+	exit(1);
+    }
+    printf("all tests passed\n");
+    exit(0);
+    return (0);
+}
+
+#endif /* TEST_HTTP_SERVER */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * httpserver.h
+ * - serve boot files over HTTP/1.1 for UEFI HTTP Boot clients
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_HTTPSERVER_H
+#define _S_HTTPSERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+
+/*
+ * The server answers GET and HEAD for regular files below its root
+ * directory.  It honors a single byte range, keeps connections open
+ * between requests, and sends file contents with sendfile().
+ *
+ * It doesn't do any I/O waiting of its own: the caller watches each
+ * connection's socket, and calls HTTPConnectionReadable() or
+ * HTTPConnectionWritable() as the status returned by the last call asks.
+ * Each call does a bounded amount of work so that one fast client can't
+ * hold up the rest.
+ */
+#define HTTP_SERVER_PORT_DEFAULT		80
+#define HTTP_SERVER_CONNECTIONS_MAX_DEFAULT	256
+#define HTTP_SERVER_IDLE_SECS_DEFAULT		30
+
+/* the largest request line and headers */
+#define HTTP_SERVER_HEADER_MAX			8192
+
+/* the most bytes sent to one connection per call */
+#define HTTP_SERVER_SEND_MAX			(256 * 1024)
+
+typedef struct {
+    uint64_t		connections;	/* accepted */
+    uint64_t		connections_refused; /* over the connection limit */
+    uint64_t		connections_idle; /* closed for being idle */
+    uint64_t		requests;
+    uint64_t		requests_reused; /* on an already used connection */
+    uint64_t		responses_ok;	/* 200 */
+    uint64_t		responses_partial; /* 206 */
+    uint64_t		responses_not_found; /* 404 */
+    uint64_t		responses_range;  /* 416 */
+    uint64_t		responses_error;  /* other 4xx and 5xx */
+    uint64_t		bytes_sent;	/* file contents */
+    uint64_t		sendfile_calls;
+    uint32_t		active;		/* connections currently open */
+    uint32_t		active_max;
+} HTTPServerStats;
+
+typedef struct HTTPServer * HTTPServerRef;
+
+/*
+ * Function: HTTPServerCreate
+ * Purpose:
+ *   Create a server for the files below root.
+ */
+HTTPServerRef
+HTTPServerCreate(const char * root);
+
+/*
+ * Function: HTTPServerFree
+ * Purpose:
+ *   Release the server.  Its connections must already be freed.
+ */
+void
+HTTPServerFree(HTTPServerRef * server_p);
+
+const char *
+HTTPServerGetRoot(HTTPServerRef server);
+
+/*
+ * Function: HTTPServerSetRoot
+ * Purpose:
+ *   Serve the files below root from now on.  Responses already started
+ *   are finished from the files they opened.
+ */
+void
+HTTPServerSetRoot(HTTPServerRef server, const char * root);
+
+/*
+ * Function: HTTPServerOpenSocket
+ * Purpose:
+ *   Open a non-blocking TCP socket listening on the address and port.
+ *   Returns -1 on failure, with errno set.
+ */
+int
+HTTPServerOpenSocket(struct in_addr addr, uint16_t port, int backlog);
+
+/*
+ * Function: HTTPServerNoteRefused, HTTPServerNoteIdle
+ * Purpose:
+ *   Count connections the caller closed without serving, or closed for
+ *   being idle.
+ */
+void
+HTTPServerNoteRefused(HTTPServerRef server);
+
+void
+HTTPServerNoteIdle(HTTPServerRef server);
+
+void
+HTTPServerGetStats(HTTPServerRef server, HTTPServerStats * stats);
+
+/*
+ * Function: HTTPServerReport
+ * Purpose:
+ *   Format the statistics into buf.  Returns the length of the report,
+ *   which is truncated if it doesn't fit in buf_size.
+ */
+int
+HTTPServerReport(HTTPServerRef server, char * buf, int buf_size);
+
+typedef struct HTTPConnection * HTTPConnectionRef;
+
+typedef enum {
+    kHTTPConnectionStatusWaitRead = 0,	/* call again when readable */
+    kHTTPConnectionStatusWaitWrite,	/* call again when writable */
+    kHTTPConnectionStatusClose,		/* free the connection */
+} HTTPConnectionStatus;
+
+/*
+ * Function: HTTPConnectionCreate
+ * Purpose:
+ *   Start serving an accepted connection, which starts out waiting to
+ *   read.  Takes ownership of fd and makes it non-blocking.
+ */
+HTTPConnectionRef
+HTTPConnectionCreate(HTTPServerRef server, int fd);
+
+/*
+ * Function: HTTPConnectionFree
+ * Purpose:
+ *   Close the connection and release it.
+ */
+void
+HTTPConnectionFree(HTTPConnectionRef * conn_p);
+
+int
+HTTPConnectionGetFD(HTTPConnectionRef conn);
+
+HTTPConnectionStatus
+HTTPConnectionReadable(HTTPConnectionRef conn);
+
+HTTPConnectionStatus
+HTTPConnectionWritable(HTTPConnectionRef conn);
+
+/*
+ * Function: HTTPConnectionIsIdle
+ * Purpose:
+ *   Returns true if nothing has been read or written on the connection
+ *   for idle_secs, as measured by the monotonic clock.
+ */
+bool
+HTTPConnectionIsIdle(HTTPConnectionRef conn, int idle_secs);
+
+#endif /* _S_HTTPSERVER_H */
@@ -0,0 +1,841 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * portbinding.c
+ * - table binding relay agent ports, identified by giaddr and the
+ *   option 82 circuit-id/remote-id, to fixed addresses or small pools
+ *
+ * The table is read from a text file, one binding per line:
+ *
+ *   # giaddr	circuit-id	remote-id		address[-address]
+ *   10.1.0.1	"Gi1/0/1"	00:11:22:33:44:55	10.1.0.50
+ *   10.1.0.1	"Gi1/0/2"	-			10.1.0.60-10.1.0.63
+ *   10.2.0.1	-		0x0a0b0c0d		10.2.0.10
+ *
+ * A circuit-id or remote-id is either a quoted string, hex bytes
+ * (colon-separated, or with a 0x prefix), or '-' to match any value.
+ *
+ * Bindings are stored in a flat array, with their circuit-id/remote-id
+ * bytes in a single key buffer, and indexed by an open addressing hash
+ * table, so a lookup costs one hash and usually a single key compare
+ * regardless of the number of ports.
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <syslog.h>
+#include <arpa/inet.h>
+#include "portbinding.h"
+
+#ifdef TEST_PORT_BINDING
+#include <sys/time.h>
+#define my_log(level, format, ...)					\
+    do {								\
+	fprintf(stderr, format "\n", ## __VA_ARGS__);			\
+    } while (0)
+#else /* TEST_PORT_BINDING */
+#include "mylog.h"
+#endif /* TEST_PORT_BINDING */
+
+/* keep the scan of a per-port pool short */
+#define PORT_BINDING_POOL_MAX	256
+
+#define PORT_BINDING_ID_MAX	255
+
+struct PortBindingTable {
+    PortBindingRef	bindings;
+    int			count;
+    int			size;
+    uint8_t *		keys;
+    uint32_t		keys_length;
+    uint32_t		keys_size;
+    uint32_t *		slots;		/* binding index + 1, 0 if empty */
+    uint32_t		slots_mask;
+};
+
+#define FNV_32_PRIME	0x01000193
+#define FNV_32_OFFSET	0x811c9dc5
+
+static __inline__ uint32_t
+fnv_add(uint32_t hash, const uint8_t * buf, int len)
+{
+    int		i;
+
+    for (i = 0; i < len; i++) {
+	hash ^= buf[i];
+	hash *= FNV_32_PRIME;
+    }
+    return (hash);
+}
+
+static uint32_t
+S_key_hash(struct in_addr giaddr,
+	   const uint8_t * circuit_id, int circuit_id_length,
+	   const uint8_t * remote_id, int remote_id_length)
+{
+    uint32_t	hash = FNV_32_OFFSET;
+    uint8_t	len;
+
+    hash = fnv_add(hash, (const uint8_t *)&giaddr, sizeof(giaddr));
+    len = (uint8_t)circuit_id_length;
+    hash = fnv_add(hash, &len, sizeof(len));
+    hash = fnv_add(hash, circuit_id, circuit_id_length);
+    len = (uint8_t)remote_id_length;
+    hash = fnv_add(hash, &len, sizeof(len));
+    hash = fnv_add(hash, remote_id, remote_id_length);
+    return (hash);
+}
+
+static PortBindingRef
+S_lookup(PortBindingTableRef table, struct in_addr giaddr,
+	 const uint8_t * circuit_id, int circuit_id_length,
+	 const uint8_t * remote_id, int remote_id_length)
+{
+    uint32_t		hash;
+    uint32_t		i;
+
+    hash = S_key_hash(giaddr, circuit_id, circuit_id_length,
+		      remote_id, remote_id_length);
+    for (i = hash & table->slots_mask; table->slots[i] != 0;
+	 i = (i + 1) & table->slots_mask) {
+	PortBindingRef	binding = table->bindings + table->slots[i] - 1;
+	const uint8_t *	key;
+
+	if (binding->hash != hash
+	    || binding->giaddr.s_addr != giaddr.s_addr
+	    || binding->circuit_id_length != circuit_id_length
+	    || binding->remote_id_length != remote_id_length) {
+	    continue;
+	}
+	key = table->keys + binding->key_offset;
+	if (bcmp(key, circuit_id, circuit_id_length) == 0
+	    && bcmp(key + circuit_id_length, remote_id,
+		    remote_id_length) == 0) {
+	    return (binding);
+	}
+    }
+    return (NULL);
+}
+
+static void
+S_build_index(PortBindingTableRef table)
+{
+    int		i;
+    uint32_t	slots_count = 16;
+
+    while (slots_count < (uint32_t)table->count * 2) {
+	slots_count <<= 1;
+    }
+    table->slots = calloc(slots_count, sizeof(*table->slots));
+    table->slots_mask = slots_count - 1;
+    for (i = 0; i < table->count; i++) {
+	uint32_t	slot;
+
+	slot = table->bindings[i].hash & table->slots_mask;
+	while (table->slots[slot] != 0) {
+	    slot = (slot + 1) & table->slots_mask;
+	}
+	table->slots[slot] = i + 1;
+    }
+    return;
+}
+
+static void
+S_add(PortBindingTableRef table, struct in_addr giaddr,
+      const uint8_t * circuit_id, int circuit_id_length,
+      const uint8_t * remote_id, int remote_id_length,
+      struct in_addr start, struct in_addr end)
+{
+    PortBindingRef	binding;
+    uint32_t		key_length;
+
+    if (table->count == table->size) {
+	table->size = (table->size == 0) ? 1024 : table->size * 2;
+	table->bindings = reallocf(table->bindings,
+				   table->size * sizeof(*table->bindings));
+    }
+    key_length = circuit_id_length + remote_id_length;
+    if (table->keys_length + key_length > table->keys_size) {
+	while (table->keys_length + key_length > table->keys_size) {
+	    table->keys_size = (table->keys_size == 0)
+		? 16384 : table->keys_size * 2;
+	}
+	table->keys = reallocf(table->keys, table->keys_size);
+    }
+    binding = table->bindings + table->count++;
+    binding->giaddr = giaddr;
+    binding->start = start;
+    binding->end = end;
+    binding->hash = S_key_hash(giaddr, circuit_id, circuit_id_length,
+			       remote_id, remote_id_length);
+    binding->key_offset = table->keys_length;
+    binding->circuit_id_length = circuit_id_length;
+    binding->remote_id_length = remote_id_length;
+    bcopy(circuit_id, table->keys + table->keys_length, circuit_id_length);
+    table->keys_length += circuit_id_length;
+    bcopy(remote_id, table->keys + table->keys_length, remote_id_length);
+    table->keys_length += remote_id_length;
+    return;
+}
+
+/**
+ ** File parsing
+ **/
+
+static char *
+S_next_token(char * * line_p)
+{
+    char *	scan = *line_p;
+    char *	token;
+
+    while (isspace((unsigned char)*scan)) {
+	scan++;
+    }
+    if (*scan == '\0' || *scan == '#') {
+	return (NULL);
+    }
+    token = scan;
+    if (*scan == '"') {
+	scan = strchr(scan + 1, '"');
+	if (scan == NULL) {
+	    return (NULL);
+	}
+	scan++;
+    }
+    else {
+	while (*scan != '\0' && !isspace((unsigned char)*scan)) {
+	    scan++;
+	}
+    }
+    if (*scan != '\0') {
+	*scan++ = '\0';
+    }
+    *line_p = scan;
+    return (token);
+}
+
+static int
+S_hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9') {
+	return (ch - '0');
+    }
+    if (ch >= 'a' && ch <= 'f') {
+	return (ch - 'a' + 10);
+    }
+    if (ch >= 'A' && ch <= 'F') {
+	return (ch - 'A' + 10);
+    }
+    return (-1);
+}
+
+/*
+ * Function: S_parse_id
+ * Purpose:
+ *   Parse a circuit-id or remote-id: "string", 0xhex, xx:xx:xx, or '-'.
+ *   Returns the length, or -1 if the value is invalid.
+ */
+static int
+S_parse_id(const char * token, uint8_t * buf)
+{
+    int		len = 0;
+    const char *scan;
+
+    if (strcmp(token, "-") == 0) {
+	return (0);
+    }
+    if (token[0] == '"') {
+	len = (int)strlen(token) - 2;
+	if (len <= 0 || len > PORT_BINDING_ID_MAX
+	    || token[len + 1] != '"') {
+	    return (-1);
+	}
+	bcopy(token + 1, buf, len);
+	return (len);
+    }
+    if (token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+	scan = token + 2;
+	if ((strlen(scan) % 2) != 0) {
+	    return (-1);
+	}
+	while (*scan != '\0') {
+	    int		hi = S_hex_value(scan[0]);
+	    int		lo = S_hex_value(scan[1]);
+
+	    if (hi < 0 || lo < 0 || len == PORT_BINDING_ID_MAX) {
+		return (-1);
+	    }
+	    buf[len++] = (uint8_t)((hi << 4) | lo);
+	    scan += 2;
+	}
+	return ((len == 0) ? -1 : len);
+    }
+    for (scan = token; *scan != '\0'; ) {
+	int		val = 0;
+	int		digits;
+
+	for (digits = 0; digits < 2 && S_hex_value(*scan) >= 0; digits++) {
+	    val = (val << 4) | S_hex_value(*scan);
+	    scan++;
+	}
+	if (digits == 0 || len == PORT_BINDING_ID_MAX) {
+	    return (-1);
+	}
+	buf[len++] = (uint8_t)val;
+	if (*scan == ':') {
+	    scan++;
+	    if (*scan == '\0') {
+		return (-1);
+	    }
+	}
+	else if (*scan != '\0') {
+	    return (-1);
+	}
+    }
+    return ((len == 0) ? -1 : len);
+}
+
+static bool
+S_parse_range(char * token, struct in_addr * start, struct in_addr * end)
+{
+    char *	dash;
+
+    dash = strchr(token, '-');
+    if (dash != NULL) {
+	*dash = '\0';
+    }
+    if (inet_aton(token, start) == 0) {
+	return (false);
+    }
+    if (dash == NULL) {
+	*end = *start;
+    }
+    else if (inet_aton(dash + 1, end) == 0) {
+	return (false);
+    }
+    if (ntohl(start->s_addr) > ntohl(end->s_addr)
+	|| (ntohl(end->s_addr) - ntohl(start->s_addr))
+	>= PORT_BINDING_POOL_MAX) {
+	return (false);
+    }
+    return (true);
+}
+
+PortBindingTableRef
+PortBindingTableCreateWithFile(const char * path)
+{
+    uint8_t		circuit_id[PORT_BINDING_ID_MAX];
+    int			circuit_id_length;
+    FILE *		f;
+    int			i;
+    char		line[1024];
+    int			line_number = 0;
+    uint8_t		remote_id[PORT_BINDING_ID_MAX];
+    int			remote_id_length;
+    PortBindingTableRef	table;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+	return (NULL);
+    }
+    table = calloc(1, sizeof(*table));
+    while (fgets(line, sizeof(line), f) != NULL) {
+	struct in_addr	end;
+	struct in_addr	giaddr;
+	char *		scan = line;
+	struct in_addr	start;
+	char *		tokens[4];
+
+	line_number++;
+	for (i = 0; i < 4; i++) {
+	    tokens[i] = S_next_token(&scan);
+	    if (tokens[i] == NULL) {
+		break;
+	    }
+	}
+	if (i == 0) {
+	    /* blank line or comment */
+	    continue;
+	}
+	if (i != 4 || S_next_token(&scan) != NULL) {
+	    my_log(LOG_NOTICE, "%s: line %d: expected 4 fields",
+		   path, line_number);
+	    continue;
+	}
+	if (inet_aton(tokens[0], &giaddr) == 0 || giaddr.s_addr == 0) {
+	    my_log(LOG_NOTICE, "%s: line %d: invalid giaddr '%s'",
+		   path, line_number, tokens[0]);
+	    continue;
+	}
+	circuit_id_length = S_parse_id(tokens[1], circuit_id);
+	remote_id_length = S_parse_id(tokens[2], remote_id);
+	if (circuit_id_length < 0 || remote_id_length < 0) {
+	    my_log(LOG_NOTICE, "%s: line %d: invalid circuit-id/remote-id",
+		   path, line_number);
+	    continue;
+	}
+	if (S_parse_range(tokens[3], &start, &end) == false) {
+	    my_log(LOG_NOTICE, "%s: line %d: invalid address '%s'",
+		   path, line_number, tokens[3]);
+	    continue;
+	}
+	S_add(table, giaddr, circuit_id, circuit_id_length,
+	      remote_id, remote_id_length, start, end);
+    }
+    fclose(f);
+
+    /* build the index, dropping duplicates */
+    S_build_index(table);
+    for (i = 0; i < table->count; i++) {
+	PortBindingRef	binding = table->bindings + i;
+	const uint8_t *	key = table->keys + binding->key_offset;
+
+	if (S_lookup(table, binding->giaddr,
+		     key, binding->circuit_id_length,
+		     key + binding->circuit_id_length,
+		     binding->remote_id_length) != binding) {
+	    my_log(LOG_NOTICE, "%s: duplicate binding for %s, ignored",
+		   path, inet_ntoa(binding->giaddr));
+	}
+    }
+    return (table);
+}
+
+void
+PortBindingTableFree(PortBindingTableRef * table_p)
+{
+    PortBindingTableRef	table = *table_p;
+
+    if (table == NULL) {
+	return;
+    }
+    if (table->bindings != NULL) {
+	free(table->bindings);
+    }
+    if (table->keys != NULL) {
+	free(table->keys);
+    }
+    if (table->slots != NULL) {
+	free(table->slots);
+    }
+    free(table);
+    *table_p = NULL;
+    return;
+}
+
+int
+PortBindingTableGetCount(PortBindingTableRef table)
+{
+    return (table->count);
+}
+
+/*
+ * Function: PortBindingTableLookup
+ * Purpose:
+ *   Find the binding for the port.  The most specific binding wins:
+ *   circuit-id and remote-id, then circuit-id only, then remote-id only,
+ *   then the relay agent as a whole.
+ */
+PortBindingRef
+PortBindingTableLookup(PortBindingTableRef table, struct in_addr giaddr,
+		       const uint8_t * circuit_id, int circuit_id_length,
+		       const uint8_t * remote_id, int remote_id_length)
+{
+    PortBindingRef	binding;
+
+    binding = S_lookup(table, giaddr, circuit_id, circuit_id_length,
+		       remote_id, remote_id_length);
+    if (binding != NULL) {
+	return (binding);
+    }
+    if (circuit_id_length != 0 && remote_id_length != 0) {
+	binding = S_lookup(table, giaddr, circuit_id, circuit_id_length,
+			   NULL, 0);
+	if (binding != NULL) {
+	    return (binding);
+	}
+	binding = S_lookup(table, giaddr, NULL, 0,
+			   remote_id, remote_id_length);
+	if (binding != NULL) {
+	    return (binding);
+	}
+    }
+    if (circuit_id_length != 0 || remote_id_length != 0) {
+	binding = S_lookup(table, giaddr, NULL, 0, NULL, 0);
+    }
+    return (binding);
+}
+
+PortBindingRef
+PortBindingTableLookupRelayAgentInformation(PortBindingTableRef table,
+					    struct in_addr giaddr,
+					    const uint8_t * option,
+					    int option_length)
+{
+    const uint8_t *	circuit_id = NULL;
+    int			circuit_id_length = 0;
+    const uint8_t *	remote_id = NULL;
+    int			remote_id_length = 0;
+    const uint8_t *	scan = option;
+    const uint8_t *	end = option + option_length;
+
+    while ((end - scan) >= 2) {
+	int	code = scan[0];
+	int	len = scan[1];
+
+	if ((end - scan - 2) < len) {
+	    /* truncated sub-option */
+	    return (NULL);
+	}
+	switch (code) {
+	case RAI_SUBOPT_CIRCUIT_ID:
+	    circuit_id = scan + 2;
+	    circuit_id_length = len;
+	    break;
+	case RAI_SUBOPT_REMOTE_ID:
+	    remote_id = scan + 2;
+	    remote_id_length = len;
+	    break;
+	default:
+	    break;
+	}
+	scan += 2 + len;
+    }
+    if (circuit_id_length == 0 && remote_id_length == 0) {
+	return (NULL);
+    }
+    return (PortBindingTableLookup(table, giaddr,
+				   circuit_id, circuit_id_length,
+				   remote_id, remote_id_length));
+}
+
+bool
+PortBindingContainsAddress(PortBindingRef binding, struct in_addr ip)
+{
+    uint32_t	val = ntohl(ip.s_addr);
+
+    return (val >= ntohl(binding->start.s_addr)
+	    && val <= ntohl(binding->end.s_addr));
+}
+
+#ifdef TEST_PORT_BINDING
+
+#define PORTS_PER_SWITCH	48
+
+static double
+elapsed_usecs(struct timeval * start)
+{
+    struct timeval	now;
+
+    gettimeofday(&now, NULL);
+    return ((now.tv_sec - start->tv_sec) * 1000000.0
+	    + (now.tv_usec - start->tv_usec));
+}
+
+static struct in_addr
+port_giaddr(uint32_t port)
+{
+    struct in_addr	giaddr;
+    uint32_t		sw = port / PORTS_PER_SWITCH;
+
+    giaddr.s_addr = htonl(0x0a000001 | (sw << 8));
+    return (giaddr);
+}
+
+static int
+port_circuit_id(uint32_t port, char * buf, int buf_size)
+{
+    return (snprintf(buf, buf_size, "Gi1/0/%u", port % PORTS_PER_SWITCH));
+}
+
+static void
+port_remote_id(uint32_t port, uint8_t remote_id[6])
+{
+    uint32_t	sw = port / PORTS_PER_SWITCH;
+
+    remote_id[0] = 0x00;
+    remote_id[1] = 0x1b;
+    remote_id[2] = (sw >> 24) & 0xff;
+    remote_id[3] = (sw >> 16) & 0xff;
+    remote_id[4] = (sw >> 8) & 0xff;
+    remote_id[5] = sw & 0xff;
+    return;
+}
+
+static struct in_addr
+port_address(uint32_t port)
+{
+    struct in_addr	ip;
+
+    ip.s_addr = htonl(0x64400000 + port);
+    return (ip);
+}
+
+static void
+generate_file(const char * path, uint32_t count)
+{
+    FILE *	f;
+    uint32_t	i;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+	perror(path);
+	exit(1);
+    }
+    fprintf(f, "# giaddr\tcircuit-id\tremote-id\taddress\n");
+    for (i = 0; i < count; i++) {
+	char		circuit_id[32];
+	struct in_addr	giaddr = port_giaddr(i);
+	uint8_t		r[6];
+
+	port_circuit_id(i, circuit_id, sizeof(circuit_id));
+	port_remote_id(i, r);
+	fprintf(f, "%s\t\"%s\"\t%02x:%02x:%02x:%02x:%02x:%02x\t",
+		inet_ntoa(giaddr), circuit_id,
+		r[0], r[1], r[2], r[3], r[4], r[5]);
+	fprintf(f, "%s\n", inet_ntoa(port_address(i)));
+    }
+    fclose(f);
+    return;
+}
+
+static void
+check(bool ok, const char * what)
+{
+    if (!ok) {
+	fprintf(stderr, "FAILED: %s\n", what);
+	exit(1);
+    }
+    return;
+}
+
+static void
+functional_test(const char * path)
+{
+    uint8_t		cid[] = "Gi1/0/2";
+    FILE *		f;
+    struct in_addr	giaddr;
+    struct in_addr	ip;
+    uint8_t		opt[64];
+    int			opt_len;
+    uint8_t		rid[] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    PortBindingRef	binding;
+    PortBindingTableRef	table;
+
+    f = fopen(path, "w");
+    fprintf(f,
+	    "# comment\n"
+	    "\n"
+	    "10.1.0.1\t\"Gi1/0/1\"\t00:11:22:33:44:55\t10.1.0.50\n"
+	    "10.1.0.1\t\"Gi1/0/2\"\t-\t10.1.0.60-10.1.0.63\n"
+	    "10.1.0.1\t-\t0x001122334455\t10.1.0.70\n"
+	    "10.2.0.1\t-\t-\t10.2.0.10-10.2.0.19\n"
+	    "10.1.0.1\t\"Gi1/0/1\"\t00:11:22:33:44:55\t10.1.0.51\n"
+	    "10.1.0.1\t\"unterminated\t-\t10.1.0.52\n"
+	    "10.1.0.1\t\"Gi1/0/3\"\t-\t10.1.0.80-10.1.0.10\n"
+	    "10.1.0.1\t\"Gi1/0/4\"\tzz\t10.1.0.81\n");
+    fclose(f);
+    table = PortBindingTableCreateWithFile(path);
+    check(table != NULL, "load");
+    check(PortBindingTableGetCount(table) == 5, "count");
+
+    inet_aton("10.1.0.1", &giaddr);
+    /* exact circuit-id + remote-id: first definition wins */
+    binding = PortBindingTableLookup(table, giaddr, (uint8_t *)"Gi1/0/1", 7,
+				     rid, sizeof(rid));
+    inet_aton("10.1.0.50", &ip);
+    check(binding != NULL && binding->start.s_addr == ip.s_addr, "exact");
+
+    /* circuit-id only binding, with any remote-id */
+    binding = PortBindingTableLookup(table, giaddr, cid, 7, rid, sizeof(rid));
+    inet_aton("10.1.0.62", &ip);
+    check(binding != NULL && PortBindingContainsAddress(binding, ip),
+	  "circuit-id wildcard");
+    inet_aton("10.1.0.64", &ip);
+    check(PortBindingContainsAddress(binding, ip) == false, "pool end");
+
+    /* remote-id only binding */
+    binding = PortBindingTableLookup(table, giaddr, (uint8_t *)"Gi9/9/9", 7,
+				     rid, sizeof(rid));
+    inet_aton("10.1.0.70", &ip);
+    check(binding != NULL && binding->start.s_addr == ip.s_addr,
+	  "remote-id wildcard");
+
+    /* relay agent wide binding */
+    inet_aton("10.2.0.1", &giaddr);
+    binding = PortBindingTableLookup(table, giaddr, cid, 7, NULL, 0);
+    inet_aton("10.2.0.10", &ip);
+    check(binding != NULL && binding->start.s_addr == ip.s_addr,
+	  "relay agent wildcard");
+
+    /* option 82 encoding */
+    inet_aton("10.1.0.1", &giaddr);
+    opt_len = 0;
+    opt[opt_len++] = RAI_SUBOPT_CIRCUIT_ID;
+    opt[opt_len++] = 7;
+    bcopy("Gi1/0/1", opt + opt_len, 7);
+    opt_len += 7;
+    opt[opt_len++] = 9;			/* unknown sub-option */
+    opt[opt_len++] = 1;
+    opt[opt_len++] = 0xff;
+    opt[opt_len++] = RAI_SUBOPT_REMOTE_ID;
+    opt[opt_len++] = sizeof(rid);
+    bcopy(rid, opt + opt_len, sizeof(rid));
+    opt_len += sizeof(rid);
+    binding = PortBindingTableLookupRelayAgentInformation(table, giaddr,
+							  opt, opt_len);
+    inet_aton("10.1.0.50", &ip);
+    check(binding != NULL && binding->start.s_addr == ip.s_addr, "option 82");
+    binding = PortBindingTableLookupRelayAgentInformation(table, giaddr,
+							  opt, opt_len - 1);
+    check(binding == NULL, "truncated option 82");
+
+    /* no match */
+    inet_aton("10.3.0.1", &giaddr);
+    binding = PortBindingTableLookup(table, giaddr, cid, 7, rid, sizeof(rid));
+    check(binding == NULL, "no match");
+    PortBindingTableFree(&table);
+    check(table == NULL, "free");
+    unlink(path);
+    printf("functional test passed\n");
+    return;
+}
+
+static void
+bench(const char * path, uint32_t count)
+{
+    uint32_t		found = 0;
+    uint32_t		i;
+    uint32_t *		order;
+    struct timeval	start;
+    PortBindingTableRef	table;
+    double		usecs;
+
+    generate_file(path, count);
+    gettimeofday(&start, NULL);
+    table = PortBindingTableCreateWithFile(path);
+    usecs = elapsed_usecs(&start);
+    check(table != NULL && PortBindingTableGetCount(table) == count,
+	  "bench load");
+    printf("%u ports: load %.1f ms\n", count, usecs / 1000);
+
+    /* look up every port in random order */
+    order = malloc(count * sizeof(*order));
+    for (i = 0; i < count; i++) {
+	order[i] = i;
+    }
+    for (i = count - 1; i > 0; i--) {
+	uint32_t	j = arc4random_uniform(i + 1);
+	uint32_t	t = order[i];
+
+	order[i] = order[j];
+	order[j] = t;
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+	char		circuit_id[32];
+	int		circuit_id_length;
+	uint32_t	port = order[i];
+	uint8_t		remote_id[6];
+	PortBindingRef	binding;
+
+	circuit_id_length = port_circuit_id(port, circuit_id,
+					    sizeof(circuit_id));
+	port_remote_id(port, remote_id);
+	binding = PortBindingTableLookup(table, port_giaddr(port),
+					 (uint8_t *)circuit_id,
+					 circuit_id_length,
+					 remote_id, sizeof(remote_id));
+	if (binding != NULL
+	    && binding->start.s_addr == port_address(port).s_addr) {
+	    found++;
+	}
+    }
+    usecs = elapsed_usecs(&start);
+    check(found == count, "bench lookup");
+    printf("hit:  %.0f ns/lookup\n", usecs * 1000 / count);
+
+    /* unknown ports fall through all four lookups */
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+	char		circuit_id[32];
+	int		circuit_id_length;
+	uint32_t	port = order[i];
+	uint8_t		remote_id[6];
+
+	circuit_id_length = snprintf(circuit_id, sizeof(circuit_id),
+				     "Te9/9/%u", port);
+	port_remote_id(port, remote_id);
+	if (PortBindingTableLookup(table, port_giaddr(port),
+				   (uint8_t *)circuit_id, circuit_id_length,
+				   remote_id, sizeof(remote_id)) != NULL) {
+	    found++;
+	}
+    }
+    usecs = elapsed_usecs(&start);
+    check(found == count, "bench miss");
+    printf("miss: %.0f ns/lookup\n", usecs * 1000 / count);
+    free(order);
+    PortBindingTableFree(&table);
+    unlink(path);
+    return;
+}
+
+int
+main(int argc, char * argv[])
+{
+    char	path[] = "/tmp/portbinding.XXXXXX";
+    int		fd;
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+	perror("mkstemp");
+	exit(1);
+    }
+    close(fd);
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0) {
+	uint32_t	count = 1000000;
+
+	if (argc > 2) {
+	    count = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+	bench(path, count);
+    }
+    else {
+	functional_test(path);
+    }
+    exit(0);
+}
+
+#endif /* TEST_PORT_BINDING */
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * portbinding.h
+ * - table binding relay agent ports, identified by giaddr and the
+ *   option 82 circuit-id/remote-id, to fixed addresses or small pools
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_PORTBINDING_H
+#define _S_PORTBINDING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define PORT_BINDINGS_FILE	"/etc/bootpd_port_bindings"
+
+/* relay agent information (option 82) sub-options */
+#define RAI_SUBOPT_CIRCUIT_ID	1
+#define RAI_SUBOPT_REMOTE_ID	2
+
+/*
+ * Type: PortBinding
+ * Purpose:
+ *   The addresses bound to a port: start == end for a fixed address.
+ */
+typedef struct {
+    struct in_addr	giaddr;
+    struct in_addr	start;
+    struct in_addr	end;
+    uint32_t		hash;
+    uint32_t		key_offset;	/* circuit-id, then remote-id */
+    uint8_t		circuit_id_length;
+    uint8_t		remote_id_length;
+} PortBinding, * PortBindingRef;
+
+typedef struct PortBindingTable * PortBindingTableRef;
+
+PortBindingTableRef
+PortBindingTableCreateWithFile(const char * path);
+
+void
+PortBindingTableFree(PortBindingTableRef * table_p);
+
+int
+PortBindingTableGetCount(PortBindingTableRef table);
+
+PortBindingRef
+PortBindingTableLookup(PortBindingTableRef table, struct in_addr giaddr,
+		       const uint8_t * circuit_id, int circuit_id_length,
+		       const uint8_t * remote_id, int remote_id_length);
+
+PortBindingRef
+PortBindingTableLookupRelayAgentInformation(PortBindingTableRef table,
+					    struct in_addr giaddr,
+					    const uint8_t * option,
+					    int option_length);
+
+bool
+PortBindingContainsAddress(PortBindingRef binding, struct in_addr ip);
+
+#endif /* _S_PORTBINDING_H */
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * randmac.c
+ * - lease policy for clients using randomized (locally administered)
+ *   hardware addresses
+ *
+ * A client that rotates its MAC address looks like a new client each
+ * time, and the binding for its previous address is never used again.
+ * New bindings for such clients get a short lease, and each renewal
+ * extends the lease to as long as the client has held the binding, up
+ * to the normal lease.  A binding outlives its client by about as long
+ * as the client stayed, and a binding that is never renewed expires
+ * quickly.  When the pool runs out, the addresses of bindings still on
+ * a short lease are reclaimed before any others.
+ *
+ * The TEST_RANDMAC program simulates the occupancy of a pool under a
+ * MAC rotation workload, with and without the policy.
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "randmac.h"
+
+#define ETHER_HTYPE		1	/* ARPHRD_ETHER */
+#define ETHER_ADDR_LEN		6
+
+#define ETHER_ADDR_GROUP	0x01	/* multicast bit */
+#define ETHER_ADDR_LOCAL	0x02	/* locally administered bit */
+
+bool
+RandomizedMACAddressCheck(int htype, const void * hwaddr, int hlen)
+{
+    const uint8_t *	addr = (const uint8_t *)hwaddr;
+
+    if (htype != ETHER_HTYPE || hlen != ETHER_ADDR_LEN || addr == NULL) {
+	return (false);
+    }
+    return ((addr[0] & (ETHER_ADDR_LOCAL | ETHER_ADDR_GROUP))
+	    == ETHER_ADDR_LOCAL);
+}
+
+uint32_t
+RandomizedMACInitialLease(uint32_t lease, uint32_t initial_lease)
+{
+    if (initial_lease != 0 && lease > initial_lease) {
+	return (initial_lease);
+    }
+    return (lease);
+}
+
+uint32_t
+RandomizedMACRenewalLease(uint32_t lease, uint32_t initial_lease,
+			  uint32_t bound_secs)
+{
+    uint32_t	val;
+
+    if (initial_lease == 0) {
+	return (lease);
+    }
+    val = (bound_secs > initial_lease) ? bound_secs : initial_lease;
+    return ((val < lease) ? val : lease);
+}
+
+#ifdef TEST_RANDMAC
+
+/*
+ * The simulation models a guest network pool the way dhcpd manages it:
+ * - a client that has a lease (even an expired one) gets it back
+ * - otherwise a tombstone for the client is restored if its address is
+ *   still free
+ * - otherwise a free address is allocated; addresses with a tombstone
+ *   are set aside, unless the binding was still on a short lease
+ * - when no address is free, expired leases are turned into tombstones
+ *   (at most once a minute) and the tombstone that expired first gives
+ *   up its address, those on a short lease first
+ *
+ * Devices arrive and leave at random.  Most rotate their MAC address
+ * once a day, some on every connection, and the rest keep a fixed
+ * address.  Devices renew at half the lease while present, and leave
+ * without releasing their lease.
+ */
+
+#define SIM_STEP_SECS		60
+#define SIM_SWEEP_SECS		60
+#define SIM_DAY_SECS		(24 * 60 * 60)
+
+typedef enum {
+    kAddrStateFree = 0,
+    kAddrStateLeased,
+    kAddrStateTombstone,
+} AddrState;
+
+typedef struct {
+    AddrState		state;
+    uint32_t		owner;		/* client identifier */
+    long		expiry;
+    long		bound_since;
+    bool		provisional;	/* on a short lease */
+} SimAddr;
+
+typedef enum {
+    kRotateDaily = 0,
+    kRotatePerConnection,
+    kRotateNever,
+} RotateMode;
+
+typedef struct {
+    RotateMode		mode;
+    uint32_t		id;		/* current identifier */
+    long		id_since;
+    bool		present;
+    long		leave_at;
+    double		visits_per_day;
+    int			addr;		/* bound address, -1 if none */
+    long		renew_at;
+} SimDevice;
+
+typedef struct {
+    int			pool_size;
+    int			device_count;
+    int			days;
+    uint32_t		lease;
+    uint32_t		initial_lease;	/* 0: policy disabled */
+} SimParams;
+
+typedef struct {
+    long		arrivals;
+    long		failures;
+    long		restored;	/* got a previous address back */
+    long		reclaimed;	/* took a tombstone's address */
+    long		reclaimed_renewed; /* ... of a client that renewed */
+    double		live_sum;	/* unexpired leases */
+    double		dead_sum;	/* expired leases and set-aside */
+    long		samples;
+    int			live_max;
+    int			dead_max;
+} SimStats;
+
+static double
+sim_random(void)
+{
+    return ((double)random() / ((double)RAND_MAX + 1.0));
+}
+
+static int
+sim_find_owner(SimAddr * pool, int pool_size, uint32_t id, AddrState state)
+{
+    int		i;
+
+    for (i = 0; i < pool_size; i++) {
+	if (pool[i].state == state && pool[i].owner == id) {
+	    return (i);
+	}
+    }
+    return (-1);
+}
+
+static int
+sim_find_free(SimAddr * pool, int pool_size)
+{
+    int		i;
+
+    for (i = 0; i < pool_size; i++) {
+	if (pool[i].state == kAddrStateFree
+	    || (pool[i].state == kAddrStateTombstone && pool[i].provisional)) {
+	    return (i);
+	}
+    }
+    return (-1);
+}
+
+static int
+sim_reclaim(SimAddr * pool, int pool_size, long now, long * last_sweep)
+{
+    int		i;
+    int		oldest = -1;
+    int		pass;
+
+    for (pass = 0; pass < 2; pass++) {
+	if (pass == 1) {
+	    if ((now - *last_sweep) < SIM_SWEEP_SECS) {
+		break;
+	    }
+	    *last_sweep = now;
+	    for (i = 0; i < pool_size; i++) {
+		if (pool[i].state == kAddrStateLeased
+		    && pool[i].expiry < now) {
+		    pool[i].state = kAddrStateTombstone;
+		}
+	    }
+	}
+	for (i = 0; i < pool_size; i++) {
+	    if (pool[i].state != kAddrStateTombstone) {
+		continue;
+	    }
+	    if (oldest < 0
+		|| (pool[i].provisional && pool[oldest].provisional == false)
+		|| (pool[i].provisional == pool[oldest].provisional
+		    && pool[i].expiry < pool[oldest].expiry)) {
+		oldest = i;
+	    }
+	}
+	if (oldest >= 0) {
+	    break;
+	}
+    }
+    return (oldest);
+}
+
+static void
+sim_bind(const SimParams * params, SimAddr * pool, SimDevice * dev,
+	 int addr, long now, bool is_new)
+{
+    uint32_t	lease = params->lease;
+    bool	randomized = (dev->mode != kRotateNever);
+
+    if (is_new && randomized) {
+	lease = RandomizedMACInitialLease(lease, params->initial_lease);
+    }
+    pool[addr].state = kAddrStateLeased;
+    pool[addr].owner = dev->id;
+    if (is_new) {
+	pool[addr].provisional = randomized && (params->initial_lease != 0);
+	pool[addr].expiry = now + lease;
+	pool[addr].bound_since = now;
+    }
+    else if (pool[addr].expiry < now) {
+	/* expired binding comes back with the default lease */
+	pool[addr].expiry = now + lease;
+    }
+    dev->addr = addr;
+    dev->renew_at = now + (pool[addr].expiry - now) / 2;
+    return;
+}
+
+static void
+sim_arrive(const SimParams * params, SimAddr * pool, SimDevice * dev,
+	   long now, long * last_sweep, SimStats * stats)
+{
+    int		addr;
+
+    stats->arrivals++;
+    if (dev->mode == kRotatePerConnection
+	|| (dev->mode == kRotateDaily
+	    && (now - dev->id_since) >= SIM_DAY_SECS)) {
+	static uint32_t	S_next_id = 1000000;
+
+	dev->id = S_next_id++;
+	dev->id_since = now;
+    }
+    addr = sim_find_owner(pool, params->pool_size, dev->id, kAddrStateLeased);
+    if (addr >= 0) {
+	stats->restored++;
+	sim_bind(params, pool, dev, addr, now, false);
+	return;
+    }
+    addr = sim_find_owner(pool, params->pool_size, dev->id,
+			  kAddrStateTombstone);
+    if (addr >= 0) {
+	stats->restored++;
+	sim_bind(params, pool, dev, addr, now, true);
+	return;
+    }
+    addr = sim_find_free(pool, params->pool_size);
+    if (addr < 0) {
+	addr = sim_reclaim(pool, params->pool_size, now, last_sweep);
+	if (addr >= 0) {
+	    stats->reclaimed++;
+	    if (pool[addr].provisional == false) {
+		stats->reclaimed_renewed++;
+	    }
+	}
+    }
+    if (addr < 0) {
+	stats->failures++;
+	dev->addr = -1;
+	return;
+    }
+    sim_bind(params, pool, dev, addr, now, true);
+    return;
+}
+
+static void
+sim_renew(const SimParams * params, SimAddr * pool, SimDevice * dev,
+	  long now)
+{
+    SimAddr *	a = pool + dev->addr;
+    uint32_t	lease = params->lease;
+
+    if (a->state != kAddrStateLeased || a->owner != dev->id) {
+	/* lost the binding */
+	dev->addr = -1;
+	return;
+    }
+    if (a->provisional) {
+	lease = RandomizedMACRenewalLease(lease, params->initial_lease,
+					  (uint32_t)(now - a->bound_since));
+	if (lease == params->lease) {
+	    a->provisional = false;
+	}
+    }
+    a->expiry = now + lease;
+    dev->renew_at = now + lease / 2;
+    return;
+}
+
+static void
+sim_run(const SimParams * params, SimStats * stats)
+{
+    SimDevice *	devices;
+    int		i;
+    long	last_sweep = -SIM_SWEEP_SECS;
+    long	now;
+    SimAddr *	pool;
+
+    bzero(stats, sizeof(*stats));
+    srandom(1);
+    pool = calloc(params->pool_size, sizeof(*pool));
+    devices = calloc(params->device_count, sizeof(*devices));
+    for (i = 0; i < params->device_count; i++) {
+	double		r = sim_random();
+	SimDevice *	dev = devices + i;
+
+	dev->mode = (r < 0.6) ? kRotateDaily
+	    : (r < 0.85) ? kRotatePerConnection : kRotateNever;
+	dev->id = i + 1;
+	dev->id_since = -(long)(sim_random() * SIM_DAY_SECS);
+	dev->addr = -1;
+	/* occasional visitors, regulars, and devices in and out all day */
+	r = sim_random();
+	dev->visits_per_day = (r < 0.5) ? 0.3 : (r < 0.85) ? 1.0 : 4.0;
+    }
+    for (now = 0; now < (long)params->days * SIM_DAY_SECS;
+	 now += SIM_STEP_SECS) {
+	int	dead = 0;
+	int	live = 0;
+
+	for (i = 0; i < params->device_count; i++) {
+	    SimDevice *	dev = devices + i;
+
+	    if (dev->present) {
+		if (now >= dev->leave_at) {
+		    dev->present = false;
+		    dev->addr = -1;
+		}
+		else if (dev->addr >= 0 && now >= dev->renew_at) {
+		    sim_renew(params, pool, dev, now);
+		}
+		continue;
+	    }
+	    if (sim_random() < (dev->visits_per_day * SIM_STEP_SECS
+				/ SIM_DAY_SECS)) {
+		/* stay between 10 minutes and 4 hours */
+		dev->present = true;
+		dev->leave_at = now + 600 + (long)(sim_random() * 14400);
+		sim_arrive(params, pool, dev, now, &last_sweep, stats);
+	    }
+	}
+	for (i = 0; i < params->pool_size; i++) {
+	    if (pool[i].state == kAddrStateLeased && pool[i].expiry >= now) {
+		live++;
+	    }
+	    else if (pool[i].state == kAddrStateLeased
+		     || (pool[i].state == kAddrStateTombstone
+			 && pool[i].provisional == false)) {
+		dead++;
+	    }
+	}
+	stats->live_sum += live;
+	stats->dead_sum += dead;
+	stats->samples++;
+	if (live > stats->live_max) {
+	    stats->live_max = live;
+	}
+	if (dead > stats->dead_max) {
+	    stats->dead_max = dead;
+	}
+    }
+    free(pool);
+    free(devices);
+    return;
+}
+
+static void
+sim_print(const char * label, const SimParams * params,
+	  const SimStats * stats)
+{
+    printf("%-22s arrivals %6ld failed %5ld (%5.2f%%) restored %5ld"
+	   " reclaimed %5ld (%ld renewed)\n"
+	   "%-22s leases avg %6.1f max %4d, expired/set aside avg %6.1f"
+	   " max %4d of %d\n",
+	   label, stats->arrivals, stats->failures,
+	   stats->arrivals ? (100.0 * stats->failures / stats->arrivals) : 0,
+	   stats->restored, stats->reclaimed, stats->reclaimed_renewed,
+	   "", stats->live_sum / stats->samples, stats->live_max,
+	   stats->dead_sum / stats->samples, stats->dead_max,
+	   params->pool_size);
+    return;
+}
+
+int
+main(int argc, char * argv[])
+{
+    static const uint32_t	initial_leases[] = { 0, 3600, 1800, 900 };
+    size_t			i;
+    SimParams			params;
+
+    params.pool_size = 254;
+    params.device_count = 600;
+    params.days = 7;
+    params.lease = SIM_DAY_SECS;
+    if (argc > 1) {
+	params.pool_size = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	params.device_count = atoi(argv[2]);
+    }
+    if (argc > 3) {
+	params.days = atoi(argv[3]);
+    }
+    if (params.pool_size <= 0 || params.device_count <= 0
+	|| params.days <= 0) {
+	fprintf(stderr, "usage: %s [ <pool_size> [ <devices> [ <days> ] ] ]\n",
+		argv[0]);
+	exit(1);
+    }
+    printf("pool %d, %d devices, %d days, lease %u secs\n",
+	   params.pool_size, params.device_count, params.days, params.lease);
+    for (i = 0; i < sizeof(initial_leases) / sizeof(initial_leases[0]); i++) {
+	char		label[64];
+	SimStats	stats;
+
+	params.initial_lease = initial_leases[i];
+	if (params.initial_lease == 0) {
+	    snprintf(label, sizeof(label), "no policy");
+	}
+	else {
+	    snprintf(label, sizeof(label), "initial lease %u",
+		     params.initial_lease);
+	}
+	sim_run(&params, &stats);
+	sim_print(label, &params, &stats);
+    }
+    exit(0);
+}
+
+#endif /* TEST_RANDMAC */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * randmac.h
+ * - lease policy for clients using randomized (locally administered)
+ *   hardware addresses
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_RANDMAC_H
+#define _S_RANDMAC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Function: RandomizedMACAddressCheck
+ * Purpose:
+ *   Returns true if the hardware address is a locally administered,
+ *   unicast Ethernet address, as used by clients that rotate their
+ *   MAC address for privacy.
+ */
+bool
+RandomizedMACAddressCheck(int htype, const void * hwaddr, int hlen);
+
+/*
+ * Function: RandomizedMACInitialLease
+ * Purpose:
+ *   Returns the lease to offer a new binding for a client using a
+ *   randomized address: at most initial_lease, unless initial_lease is
+ *   zero (policy disabled).
+ */
+uint32_t
+RandomizedMACInitialLease(uint32_t lease, uint32_t initial_lease);
+
+/*
+ * Function: RandomizedMACRenewalLease
+ * Purpose:
+ *   Returns the lease to give a client using a randomized address that
+ *   renews a binding it has held for bound_secs: as long as it has held
+ *   the binding, at least initial_lease, and at most lease.  Since
+ *   clients renew half way through the lease, the lease grows by half
+ *   at each renewal until it reaches the normal length.
+ */
+uint32_t
+RandomizedMACRenewalLease(uint32_t lease, uint32_t initial_lease,
+			  uint32_t bound_secs);
+
+#endif /* _S_RANDMAC_H */
@@ -0,0 +1,829 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * relaytarget.c
+ * - choose the servers a relayed request is sent to, and track whether
+ *   each server is answering
+ *
+ * Each request that should get a reply (DISCOVER, INFORM, BOOTP, or a
+ * REQUEST naming the server) is remembered in a ring, in the order it was
+ * sent.  A reply relayed back to the client is matched by xid and target,
+ * scanning back from the newest request since replies arrive quickly.
+ * Requests that reach the head of the ring unanswered after the reply
+ * timeout are counted as lost.
+ *
+ * After down_threshold consecutive losses a target is marked down, and
+ * only gets a request now and then as a probe, with the interval between
+ * probes doubling while they go unanswered.  Any matched reply marks the
+ * target up again.
+ *
+ * The hash policy uses rendezvous hashing: a client goes to the target
+ * with the highest hash of the client and target together, so when a
+ * target goes down, only its own clients move.
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <arpa/inet.h>
+#include "relaytarget.h"
+
+#ifdef TEST_RELAY_TARGET
+#define my_log(level, format, ...)					\
+    do {								\
+	if (S_test_verbose) {						\
+	    fprintf(stderr, format "\n", ## __VA_ARGS__);		\
+	}								\
+    } while (0)
+static bool	S_test_verbose;
+#else /* TEST_RELAY_TARGET */
+#include "mylog.h"
+#endif /* TEST_RELAY_TARGET */
+
+#define RELAY_PENDING_MAX	1024	/* power of 2 */
+
+#define USECS_PER_MSEC		1000ULL
+#define USECS_PER_SEC		1000000ULL
+
+typedef struct {
+    uint64_t		sent;		/* usecs */
+    uint32_t		xid;
+    uint16_t		target;
+    bool		answered;
+    bool		probe;
+} RelayPending;
+
+typedef struct {
+    struct in_addr	addr;
+    uint32_t		seed;
+    bool		up;
+    uint32_t		consecutive_losses;
+    uint64_t		backoff;	/* usecs */
+    uint64_t		backoff_until;
+    uint64_t		next_probe;
+    RelayTargetStats	stats;
+} RelayTarget;
+
+struct RelayTargetSet {
+    RelayTargetParams	params;
+    RelayTarget *	targets;
+    int			count;
+    RelayPending	pending[RELAY_PENDING_MAX];
+    uint32_t		pending_head;
+    uint32_t		pending_count;
+};
+
+#define FNV_32_PRIME	0x01000193
+#define FNV_32_OFFSET	0x811c9dc5
+
+static uint32_t
+fnv_hash(const void * buf, int len)
+{
+    const uint8_t *	scan = (const uint8_t *)buf;
+    uint32_t		hash = FNV_32_OFFSET;
+    int			i;
+
+    for (i = 0; i < len; i++) {
+	hash ^= scan[i];
+	hash *= FNV_32_PRIME;
+    }
+    return (hash);
+}
+
+static uint32_t
+mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return (h);
+}
+
+static __inline__ uint64_t
+timeval_usecs(const struct timeval * tv)
+{
+    return ((uint64_t)tv->tv_sec * USECS_PER_SEC + (uint64_t)tv->tv_usec);
+}
+
+static const char * S_policy_names[] = {
+    "all",
+    "failover",
+    "hash",
+};
+
+RelayPolicy
+RelayPolicyFromString(const char * str, bool * valid)
+{
+    int		i;
+
+    for (i = 0; i < sizeof(S_policy_names) / sizeof(S_policy_names[0]); i++) {
+	if (strcmp(str, S_policy_names[i]) == 0) {
+	    *valid = true;
+	    return ((RelayPolicy)i);
+	}
+    }
+    *valid = false;
+    return (kRelayPolicyAll);
+}
+
+const char *
+RelayPolicyGetString(RelayPolicy policy)
+{
+    if (policy < 0
+	|| policy >= sizeof(S_policy_names) / sizeof(S_policy_names[0])) {
+	return ("<unknown>");
+    }
+    return (S_policy_names[policy]);
+}
+
+void
+RelayTargetParamsInit(RelayTargetParams * params)
+{
+    params->policy = kRelayPolicyAll;
+    params->reply_timeout_msecs = RELAY_REPLY_TIMEOUT_MSECS_DEFAULT;
+    params->down_threshold = RELAY_DOWN_THRESHOLD_DEFAULT;
+    params->probe_backoff_msecs = RELAY_PROBE_BACKOFF_MSECS_DEFAULT;
+    params->probe_backoff_max_msecs = RELAY_PROBE_BACKOFF_MAX_MSECS_DEFAULT;
+    return;
+}
+
+RelayTargetSetRef
+RelayTargetSetCreate(const struct in_addr * list, int count,
+		     const RelayTargetParams * params)
+{
+    int			i;
+    RelayTargetSetRef	set;
+
+    if (count <= 0 || count > UINT16_MAX) {
+	return (NULL);
+    }
+    set = (RelayTargetSetRef)malloc(sizeof(*set));
+    if (set == NULL) {
+	return (NULL);
+    }
+    bzero(set, sizeof(*set));
+    set->targets = calloc(count, sizeof(*set->targets));
+    if (set->targets == NULL) {
+	free(set);
+	return (NULL);
+    }
+    RelayTargetSetSetParams(set, params);
+    set->count = count;
+    for (i = 0; i < count; i++) {
+	RelayTarget *	t = set->targets + i;
+
+	t->addr = list[i];
+	t->seed = mix32(fnv_hash(&t->addr, sizeof(t->addr)));
+	t->up = true;
+	t->stats.addr = t->addr;
+	t->stats.latency_min_usecs = UINT32_MAX;
+    }
+    return (set);
+}
+
+void
+RelayTargetSetSetParams(RelayTargetSetRef set,
+			const RelayTargetParams * params)
+{
+    set->params = *params;
+    if (set->params.down_threshold == 0) {
+	set->params.down_threshold = 1;
+    }
+    if (set->params.probe_backoff_max_msecs
+	< set->params.probe_backoff_msecs) {
+	set->params.probe_backoff_max_msecs = set->params.probe_backoff_msecs;
+    }
+    return;
+}
+
+void
+RelayTargetSetFree(RelayTargetSetRef * set_p)
+{
+    RelayTargetSetRef	set = *set_p;
+
+    if (set == NULL) {
+	return;
+    }
+    free(set->targets);
+    free(set);
+    *set_p = NULL;
+    return;
+}
+
+int
+RelayTargetSetGetCount(RelayTargetSetRef set)
+{
+    return (set->count);
+}
+
+struct in_addr
+RelayTargetSetGetAddress(RelayTargetSetRef set, int index)
+{
+    return (set->targets[index].addr);
+}
+
+static void
+S_target_lost(RelayTargetSetRef set, RelayTarget * t, bool probe,
+	      uint64_t now)
+{
+    uint64_t	backoff_max;
+
+    t->stats.lost++;
+    t->consecutive_losses++;
+    if (t->up) {
+	if (t->consecutive_losses < set->params.down_threshold) {
+	    return;
+	}
+	t->up = false;
+	t->stats.transitions++;
+	t->backoff = set->params.probe_backoff_msecs * USECS_PER_MSEC;
+	t->backoff_until = now + t->backoff;
+	t->next_probe = now + t->backoff;
+	my_log(LOG_NOTICE, "relay: %s not responding, marked down",
+	       inet_ntoa(t->addr));
+	return;
+    }
+    if (probe == false || now < t->backoff_until) {
+	/* already backed off for this probe interval */
+	return;
+    }
+    backoff_max = set->params.probe_backoff_max_msecs * USECS_PER_MSEC;
+    t->backoff *= 2;
+    if (t->backoff > backoff_max) {
+	t->backoff = backoff_max;
+    }
+    t->backoff_until = now + t->backoff;
+    t->next_probe = now + t->backoff;
+    return;
+}
+
+static void
+S_target_replied(RelayTarget * t, uint64_t latency)
+{
+    uint32_t	usecs;
+
+    usecs = (latency > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency;
+    t->stats.replies++;
+    if (t->stats.replies == 1) {
+	t->stats.latency_avg_usecs = usecs;
+    }
+    else {
+	/* exponentially weighted, 1/8 */
+	t->stats.latency_avg_usecs
+	    = (uint32_t)(((uint64_t)t->stats.latency_avg_usecs * 7 + usecs)
+			 / 8);
+    }
+    if (usecs < t->stats.latency_min_usecs) {
+	t->stats.latency_min_usecs = usecs;
+    }
+    if (usecs > t->stats.latency_max_usecs) {
+	t->stats.latency_max_usecs = usecs;
+    }
+    t->consecutive_losses = 0;
+    if (t->up == false) {
+	t->up = true;
+	t->stats.transitions++;
+	t->backoff = 0;
+	t->backoff_until = 0;
+	my_log(LOG_NOTICE, "relay: %s responding, marked up",
+	       inet_ntoa(t->addr));
+    }
+    return;
+}
+
+static void
+S_expire(RelayTargetSetRef set, uint64_t now)
+{
+    uint64_t	timeout;
+
+    timeout = set->params.reply_timeout_msecs * USECS_PER_MSEC;
+    while (set->pending_count > 0) {
+	RelayPending *	p = set->pending + set->pending_head;
+
+	if (p->sent + timeout > now) {
+	    break;
+	}
+	if (p->answered == false) {
+	    S_target_lost(set, set->targets + p->target, p->probe, now);
+	}
+	set->pending_head = (set->pending_head + 1) & (RELAY_PENDING_MAX - 1);
+	set->pending_count--;
+    }
+    return;
+}
+
+void
+RelayTargetSetExpire(RelayTargetSetRef set, const struct timeval * now)
+{
+    S_expire(set, timeval_usecs(now));
+    return;
+}
+
+static int
+S_lookup_target(RelayTargetSetRef set, struct in_addr addr)
+{
+    int		i;
+
+    if (addr.s_addr == 0) {
+	return (-1);
+    }
+    for (i = 0; i < set->count; i++) {
+	if (set->targets[i].addr.s_addr == addr.s_addr) {
+	    return (i);
+	}
+    }
+    return (-1);
+}
+
+int
+RelayTargetSetSelect(RelayTargetSetRef set, const void * key, int key_length,
+		     struct in_addr server_id, bool expect_reply,
+		     const struct timeval * now, int * indices)
+{
+    int		count = 0;
+    int		i;
+    int		named = -1;
+    uint64_t	now_usecs = timeval_usecs(now);
+    int		up_count = 0;
+
+    S_expire(set, now_usecs);
+    named = S_lookup_target(set, server_id);
+    if (named >= 0
+	&& (expect_reply == false || set->params.policy != kRelayPolicyAll)) {
+	indices[0] = named;
+	return (1);
+    }
+    for (i = 0; i < set->count; i++) {
+	if (set->targets[i].up) {
+	    up_count++;
+	}
+    }
+    if (up_count == 0) {
+	/* nothing is answering, so try everything */
+	for (i = 0; i < set->count; i++) {
+	    indices[i] = i;
+	}
+	return (set->count);
+    }
+    switch (set->params.policy) {
+    default:
+    case kRelayPolicyAll:
+	for (i = 0; i < set->count; i++) {
+	    if (set->targets[i].up) {
+		indices[count++] = i;
+	    }
+	}
+	break;
+    case kRelayPolicyFailover:
+	for (i = 0; i < set->count; i++) {
+	    if (set->targets[i].up) {
+		indices[count++] = i;
+		break;
+	    }
+	}
+	break;
+    case kRelayPolicyHash: {
+	uint32_t	best_weight = 0;
+	int		best = -1;
+	uint32_t	key_hash = fnv_hash(key, key_length);
+
+	for (i = 0; i < set->count; i++) {
+	    uint32_t	weight;
+
+	    if (set->targets[i].up == false) {
+		continue;
+	    }
+	    weight = mix32(key_hash ^ set->targets[i].seed);
+	    if (best < 0 || weight > best_weight) {
+		best = i;
+		best_weight = weight;
+	    }
+	}
+	indices[count++] = best;
+	break;
+    }
+    }
+    if (named >= 0) {
+	/* the client chose this server, make sure it hears the request */
+	if (set->targets[named].up == false) {
+	    indices[count++] = named;
+	}
+	return (count);
+    }
+    if (expect_reply == false) {
+	return (count);
+    }
+    for (i = 0; i < set->count; i++) {
+	RelayTarget *	t = set->targets + i;
+
+	if (t->up == false && now_usecs >= t->next_probe) {
+	    t->next_probe = now_usecs + t->backoff;
+	    t->stats.probes++;
+	    indices[count++] = i;
+	}
+    }
+    return (count);
+}
+
+void
+RelayTargetSetNoteForward(RelayTargetSetRef set, int index, uint32_t xid,
+			  bool expect_reply, const struct timeval * now)
+{
+    RelayPending *	p;
+    RelayTarget *	t = set->targets + index;
+
+    t->stats.forwarded++;
+    if (expect_reply == false) {
+	return;
+    }
+    t->stats.expected++;
+    if (set->pending_count == RELAY_PENDING_MAX) {
+	/* stop tracking the oldest request */
+	set->pending_head = (set->pending_head + 1) & (RELAY_PENDING_MAX - 1);
+	set->pending_count--;
+    }
+    p = set->pending
+	+ ((set->pending_head + set->pending_count) & (RELAY_PENDING_MAX - 1));
+    set->pending_count++;
+    p->sent = timeval_usecs(now);
+    p->xid = xid;
+    p->target = (uint16_t)index;
+    p->answered = false;
+    p->probe = (t->up == false);
+    return;
+}
+
+bool
+RelayTargetSetNoteReply(RelayTargetSetRef set, struct in_addr from,
+			struct in_addr server_id, uint32_t xid,
+			const struct timeval * now)
+{
+    uint32_t	i;
+    int		index;
+    uint64_t	now_usecs = timeval_usecs(now);
+
+    index = S_lookup_target(set, from);
+    if (index < 0) {
+	index = S_lookup_target(set, server_id);
+	if (index < 0) {
+	    return (false);
+	}
+    }
+    /* newest first: a reply usually follows its request closely */
+    for (i = set->pending_count; i > 0; i--) {
+	RelayPending *	p;
+
+	p = set->pending
+	    + ((set->pending_head + i - 1) & (RELAY_PENDING_MAX - 1));
+	if (p->xid == xid && p->target == index && p->answered == false) {
+	    p->answered = true;
+	    S_target_replied(set->targets + index,
+			     (now_usecs > p->sent) ? (now_usecs - p->sent) : 0);
+	    return (true);
+	}
+    }
+    return (false);
+}
+
+void
+RelayTargetSetGetStats(RelayTargetSetRef set, int index,
+		       RelayTargetStats * stats)
+{
+    RelayTarget *	t = set->targets + index;
+
+    *stats = t->stats;
+    stats->up = t->up;
+    if (stats->replies == 0) {
+	stats->latency_min_usecs = 0;
+    }
+    return;
+}
+
+#ifdef TEST_RELAY_TARGET
+
+/*
+ * Relay requests from simulated clients to stand-in servers on the
+ * loopback interface, and make the first server go silent for the
+ * middle third of the run.
+ */
+
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#define N_SERVERS		3
+#define N_CLIENTS		200
+#define N_REQUESTS		3000
+#define REQUEST_INTERVAL_USECS	1000
+
+typedef struct {
+    int			fd;
+    uint16_t		port;
+    int			delay_usecs;
+    volatile bool	silent;
+} StandIn;
+
+static StandIn	S_servers[N_SERVERS];
+
+static void *
+stand_in_thread(void * arg)
+{
+    StandIn *	s = (StandIn *)arg;
+
+    while (true) {
+	uint32_t		buf[2];
+	struct sockaddr_in	from;
+	socklen_t		from_len = sizeof(from);
+	ssize_t			n;
+
+	n = recvfrom(s->fd, buf, sizeof(buf), 0,
+		     (struct sockaddr *)&from, &from_len);
+	if (n != sizeof(buf)) {
+	    continue;
+	}
+	if (s->silent) {
+	    continue;
+	}
+	usleep(s->delay_usecs);
+	sendto(s->fd, buf, n, 0, (struct sockaddr *)&from, from_len);
+    }
+    return (NULL);
+}
+
+static int
+udp_socket(uint16_t * port_p)
+{
+    int			fd;
+    struct sockaddr_in	sin;
+    socklen_t		sin_len = sizeof(sin);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+	perror("socket");
+	exit(1);
+    }
+    bzero(&sin, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+	|| getsockname(fd, (struct sockaddr *)&sin, &sin_len) < 0) {
+	perror("bind");
+	exit(1);
+    }
+    *port_p = ntohs(sin.sin_port);
+    return (fd);
+}
+
+static void
+drain_replies(RelayTargetSetRef set, int fd, uint8_t * answered,
+	      uint64_t until)
+{
+    while (true) {
+	uint32_t		buf[2];
+	struct sockaddr_in	from;
+	socklen_t		from_len = sizeof(from);
+	int			i;
+	ssize_t			n;
+	struct timeval		now;
+	struct pollfd		pfd = { fd, POLLIN, 0 };
+	int			wait_msecs;
+
+	gettimeofday(&now, NULL);
+	if (timeval_usecs(&now) >= until) {
+	    break;
+	}
+	wait_msecs = (int)((until - timeval_usecs(&now) + 999) / 1000);
+	if (poll(&pfd, 1, wait_msecs) <= 0) {
+	    continue;
+	}
+	n = recvfrom(fd, buf, sizeof(buf), 0,
+		     (struct sockaddr *)&from, &from_len);
+	if (n != sizeof(buf)) {
+	    continue;
+	}
+	gettimeofday(&now, NULL);
+	for (i = 0; i < N_SERVERS; i++) {
+	    if (ntohs(from.sin_port) == S_servers[i].port) {
+		struct in_addr	zero = { 0 };
+
+		RelayTargetSetNoteReply(set, RelayTargetSetGetAddress(set, i),
+					zero, buf[0], &now);
+		answered[buf[0]] = 1;
+		break;
+	    }
+	}
+    }
+    return;
+}
+
+static void
+run(RelayPolicy policy)
+{
+    uint8_t		answered[N_REQUESTS + 1];
+    struct in_addr	addrs[N_SERVERS];
+    int			fd;
+    int			i;
+    RelayTargetParams	params;
+    uint16_t		port;
+    uint64_t		sent = 0;
+    RelayTargetSetRef	set;
+    int			success = 0;
+    uint64_t		next;
+    struct timeval	now;
+
+    RelayTargetParamsInit(&params);
+    params.policy = policy;
+    params.reply_timeout_msecs = 100;
+    params.probe_backoff_msecs = 100;
+    params.probe_backoff_max_msecs = 800;
+    for (i = 0; i < N_SERVERS; i++) {
+	addrs[i].s_addr = htonl(0x0a000001 + i);
+	S_servers[i].silent = false;
+    }
+    set = RelayTargetSetCreate(addrs, N_SERVERS, &params);
+    fd = udp_socket(&port);
+    bzero(answered, sizeof(answered));
+    gettimeofday(&now, NULL);
+    next = timeval_usecs(&now);
+    for (i = 1; i <= N_REQUESTS; i++) {
+	uint32_t		buf[2];
+	int			count;
+	int			indices[N_SERVERS * 2];
+	int			j;
+	uint32_t		key = i % N_CLIENTS;
+	struct in_addr		zero = { 0 };
+
+	if (i == N_REQUESTS / 3) {
+	    S_servers[0].silent = true;
+	}
+	else if (i == 2 * N_REQUESTS / 3) {
+	    S_servers[0].silent = false;
+	}
+	gettimeofday(&now, NULL);
+	count = RelayTargetSetSelect(set, &key, sizeof(key), zero, true,
+				     &now, indices);
+	buf[0] = i;
+	buf[1] = key;
+	for (j = 0; j < count; j++) {
+	    struct sockaddr_in	sin;
+
+	    bzero(&sin, sizeof(sin));
+	    sin.sin_family = AF_INET;
+	    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	    sin.sin_port = htons(S_servers[indices[j]].port);
+	    sendto(fd, buf, sizeof(buf), 0, (struct sockaddr *)&sin,
+		   sizeof(sin));
+	    RelayTargetSetNoteForward(set, indices[j], i, true, &now);
+	    sent++;
+	}
+	next += REQUEST_INTERVAL_USECS;
+	drain_replies(set, fd, answered, next);
+    }
+    drain_replies(set, fd, answered,
+		  next + params.reply_timeout_msecs * USECS_PER_MSEC * 2);
+    gettimeofday(&now, NULL);
+    RelayTargetSetExpire(set, &now);
+    for (i = 1; i <= N_REQUESTS; i++) {
+	success += answered[i];
+    }
+    printf("policy %s: %d requests, %llu packets sent, %.1f%% answered\n",
+	   RelayPolicyGetString(policy), N_REQUESTS,
+	   (unsigned long long)sent, 100.0 * success / N_REQUESTS);
+    for (i = 0; i < N_SERVERS; i++) {
+	RelayTargetStats	stats;
+
+	RelayTargetSetGetStats(set, i, &stats);
+	printf("  %s %s: forwarded %llu replies %llu lost %llu probes %llu"
+	       " transitions %u latency avg %u min %u max %u usecs\n",
+	       inet_ntoa(stats.addr), stats.up ? "up" : "down",
+	       (unsigned long long)stats.forwarded,
+	       (unsigned long long)stats.replies,
+	       (unsigned long long)stats.lost,
+	       (unsigned long long)stats.probes,
+	       stats.transitions, stats.latency_avg_usecs,
+	       stats.latency_min_usecs, stats.latency_max_usecs);
+    }
+    RelayTargetSetFree(&set);
+    close(fd);
+    return;
+}
+
+/*
+ * A DHCPREQUEST in SELECTING state goes to every target under the "all"
+ * policy, and only to the named target otherwise; a DHCPRELEASE always
+ * goes only to the named target.
+ */
+static void
+check_server_id(void)
+{
+    struct in_addr	addrs[N_SERVERS];
+    int			count;
+    int			i;
+    int			indices[N_SERVERS * 2];
+    uint32_t		key = 0;
+    struct timeval	now;
+    RelayTargetParams	params;
+    RelayTargetSetRef	set;
+
+    RelayTargetParamsInit(&params);
+    for (i = 0; i < N_SERVERS; i++) {
+	addrs[i].s_addr = htonl(0x0a000001 + i);
+    }
+    gettimeofday(&now, NULL);
+    set = RelayTargetSetCreate(addrs, N_SERVERS, &params);
+    count = RelayTargetSetSelect(set, &key, sizeof(key), addrs[1], true,
+				 &now, indices);
+    if (count != N_SERVERS) {
+	fprintf(stderr, "all: SELECTING request went to %d targets\n", count);
+	exit(1);
+    }
+    count = RelayTargetSetSelect(set, &key, sizeof(key), addrs[1], false,
+				 &now, indices);
+    if (count != 1 || indices[0] != 1) {
+	fprintf(stderr, "all: release not sent only to the named target\n");
+	exit(1);
+    }
+    params.policy = kRelayPolicyFailover;
+    RelayTargetSetSetParams(set, &params);
+    count = RelayTargetSetSelect(set, &key, sizeof(key), addrs[1], true,
+				 &now, indices);
+    if (count != 1 || indices[0] != 1) {
+	fprintf(stderr,
+		"failover: request not sent only to the named target\n");
+	exit(1);
+    }
+    RelayTargetSetFree(&set);
+    return;
+}
+
+int
+main(int argc, char * argv[])
+{
+    int		i;
+    bool	valid;
+
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+	S_test_verbose = true;
+	argc--;
+	argv++;
+    }
+    check_server_id();
+    for (i = 0; i < N_SERVERS; i++) {
+	pthread_t	thread;
+
+	S_servers[i].fd = udp_socket(&S_servers[i].port);
+	S_servers[i].delay_usecs = 100 * (i + 1);
+	pthread_create(&thread, NULL, stand_in_thread, S_servers + i);
+    }
+    if (argc > 1) {
+	RelayPolicy	policy = RelayPolicyFromString(argv[1], &valid);
+
+	if (valid == false) {
+	    fprintf(stderr, "usage: relaytarget [ -v ] [ all | failover | hash ]\n");
+	    exit(1);
+	}
+	run(policy);
+    }
+    else {
+	run(kRelayPolicyAll);
+	run(kRelayPolicyFailover);
+	run(kRelayPolicyHash);
+    }
+    exit(0);
+}
+
+#endif /* TEST_RELAY_TARGET */
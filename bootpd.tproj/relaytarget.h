@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * relaytarget.h
+ * - choose the servers a relayed request is sent to, and track whether
+ *   each server is answering
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_RELAYTARGET_H
+#define _S_RELAYTARGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+typedef enum {
+    kRelayPolicyAll = 0,	/* every target that is up */
+    kRelayPolicyFailover,	/* the first target that is up */
+    kRelayPolicyHash,		/* one target that is up, chosen by client */
+} RelayPolicy;
+
+#define RELAY_REPLY_TIMEOUT_MSECS_DEFAULT	3000
+#define RELAY_DOWN_THRESHOLD_DEFAULT		3
+#define RELAY_PROBE_BACKOFF_MSECS_DEFAULT	(5 * 1000)
+#define RELAY_PROBE_BACKOFF_MAX_MSECS_DEFAULT	(5 * 60 * 1000)
+
+typedef struct {
+    RelayPolicy		policy;
+    uint32_t		reply_timeout_msecs;
+    uint32_t		down_threshold;		/* consecutive losses */
+    uint32_t		probe_backoff_msecs;
+    uint32_t		probe_backoff_max_msecs;
+} RelayTargetParams;
+
+typedef struct {
+    struct in_addr	addr;
+    bool		up;
+    uint64_t		forwarded;	/* requests sent */
+    uint64_t		expected;	/* requests that should get a reply */
+    uint64_t		replies;	/* replies matched to a request */
+    uint64_t		lost;		/* expected replies that timed out */
+    uint64_t		probes;		/* requests sent while down */
+    uint32_t		transitions;	/* up/down changes */
+    uint32_t		latency_avg_usecs;
+    uint32_t		latency_min_usecs;
+    uint32_t		latency_max_usecs;
+} RelayTargetStats;
+
+typedef struct RelayTargetSet * RelayTargetSetRef;
+
+RelayPolicy
+RelayPolicyFromString(const char * str, bool * valid);
+
+const char *
+RelayPolicyGetString(RelayPolicy policy);
+
+void
+RelayTargetParamsInit(RelayTargetParams * params);
+
+RelayTargetSetRef
+RelayTargetSetCreate(const struct in_addr * list, int count,
+		     const RelayTargetParams * params);
+
+void
+RelayTargetSetFree(RelayTargetSetRef * set_p);
+
+/*
+ * Function: RelayTargetSetSetParams
+ * Purpose:
+ *   Change the policy and timers, keeping each target's state.
+ */
+void
+RelayTargetSetSetParams(RelayTargetSetRef set,
+			const RelayTargetParams * params);
+
+int
+RelayTargetSetGetCount(RelayTargetSetRef set);
+
+struct in_addr
+RelayTargetSetGetAddress(RelayTargetSetRef set, int index);
+
+/*
+ * Function: RelayTargetSetSelect
+ * Purpose:
+ *   Fill in the indices of the targets to send a request to, and return
+ *   the count.
+ *
+ *   A request naming a target as its server identifier goes only to that
+ *   target, except under the "all" policy when it expects a reply (a
+ *   DHCPREQUEST in SELECTING state): then it goes to every target that
+ *   is up so the others learn that their offers were declined, and to
+ *   the named target even if it is down.  Such a request is never used
+ *   to probe, since only the named target will answer it.
+ *   Otherwise the policy chooses among the targets that are up,
+ *   keyed by the client identifier (or hardware address) for the hash
+ *   policy.  If no target is up, the request goes to all of them.
+ *   A target that is down and due to be probed is added when the request
+ *   expects a reply.  indices must have room for every target.
+ */
+int
+RelayTargetSetSelect(RelayTargetSetRef set, const void * key, int key_length,
+		     struct in_addr server_id, bool expect_reply,
+		     const struct timeval * now, int * indices);
+
+/*
+ * Function: RelayTargetSetNoteForward
+ * Purpose:
+ *   Note that the request with the given xid was sent to the target.
+ *   If expect_reply is true, the request counts as lost if no reply
+ *   from that target is noted within the reply timeout.
+ */
+void
+RelayTargetSetNoteForward(RelayTargetSetRef set, int index, uint32_t xid,
+			  bool expect_reply, const struct timeval * now);
+
+/*
+ * Function: RelayTargetSetNoteReply
+ * Purpose:
+ *   Match a reply to a forwarded request.  The target is identified by
+ *   the reply's source address, or failing that, its server identifier.
+ *   Returns true if the reply matched.
+ */
+bool
+RelayTargetSetNoteReply(RelayTargetSetRef set, struct in_addr from,
+			struct in_addr server_id, uint32_t xid,
+			const struct timeval * now);
+
+/*
+ * Function: RelayTargetSetExpire
+ * Purpose:
+ *   Count forwarded requests whose reply timed out as lost, marking
+ *   targets down or backing off their probes.  Called by
+ *   RelayTargetSetSelect, and before reading the statistics.
+ */
+void
+RelayTargetSetExpire(RelayTargetSetRef set, const struct timeval * now);
+
+void
+RelayTargetSetGetStats(RelayTargetSetRef set, int index,
+		       RelayTargetStats * stats);
+
+#endif /* _S_RELAYTARGET_H */
@@ -0,0 +1,1134 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * shadowconfig.c
+ * - evaluate a candidate configuration against live requests, without
+ *   acting on it, and count where it differs from the active one
+ *
+ * Both configurations are loaded the same way and decided by the same
+ * code, so a candidate identical to the active configuration never
+ * differs, and every difference reported comes from the configuration
+ * rather than from the model.  The decision covers what bootpd.plist
+ * controls: the services on the interface, the allow and deny lists,
+ * the subnet for the client's network, whether a pool covers the
+ * client's address, and the options the subnet supplies.
+ *
+ * A request is copied into a fixed-size ring while it's handled, and
+ * evaluated from the main queue after the reply has been sent.  Each
+ * evaluation is timed, and evaluation stops for the rest of the second
+ * once the budget is spent.
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <time.h>
+#include <net/ethernet.h>
+#include <arpa/inet.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include "shadowconfig.h"
+#include "configcache.h"
+#include "subnets.h"
+#include "cfutil.h"
+#include "util.h"
+
+#ifdef TEST_SHADOW_CONFIG
+#define my_log(level, format, ...)					\
+    do {								\
+	if (S_test_verbose) {						\
+	    fprintf(stderr, format "\n", ## __VA_ARGS__);		\
+	}								\
+    } while (0)
+static bool	S_test_verbose;
+#else /* TEST_SHADOW_CONFIG */
+#include "mylog.h"
+#endif /* TEST_SHADOW_CONFIG */
+
+#define NSECS_PER_USEC		1000ULL
+#define NSECS_PER_SEC		1000000000ULL
+
+typedef int (*qsort_compare_func_t)(const void *, const void *);
+
+/*
+ * Type: ServiceSet
+ * Purpose:
+ *   The interfaces a service is enabled on: all of them, or those named.
+ */
+typedef struct {
+    bool		all;
+    int			count;
+    char		(*names)[IFNAMSIZ];
+} ServiceSet;
+
+struct ShadowConfig {
+    ConfigCacheContents	contents;
+    ServiceSet		bootp;
+    ServiceSet		dhcp;
+    ServiceSet		ignore_allow_deny;
+    uint32_t		reply_threshold_seconds;
+    bool		use_server_config;
+};
+
+#define SAMPLE_LENGTH		192
+
+struct ShadowEval {
+    ShadowConfigRef	active;
+    ShadowConfigRef	candidate;
+    uint32_t		budget_usecs;
+
+    /* ring of requests waiting to be evaluated */
+    ShadowRequest	queue[SHADOW_QUEUE_MAX];
+    int			head;
+    int			count;
+
+    /* CPU spent in the current second */
+    time_t		budget_second;
+    uint64_t		budget_used_nsecs;
+
+    /* the most recent differences */
+    char		samples[SHADOW_SAMPLES_MAX][SAMPLE_LENGTH];
+    int			samples_next;
+    int			samples_count;
+    time_t		sample_logged;
+
+    uint64_t		start_nsecs;
+    ShadowEvalStats	stats;
+};
+
+#define FNV_32_PRIME	0x01000193
+#define FNV_32_OFFSET	0x811c9dc5
+
+static __inline__ uint32_t
+fnv_hash_add(uint32_t h, const void * buf, int len)
+{
+    const uint8_t *	scan = (const uint8_t *)buf;
+
+    while (len-- > 0) {
+	h ^= *scan++;
+	h *= FNV_32_PRIME;
+    }
+    return (h);
+}
+
+static __inline__ uint64_t
+S_now_nsecs(void)
+{
+    struct timespec	ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec);
+}
+
+/**
+ ** ServiceSet
+ **/
+
+static void
+ServiceSetInit(ServiceSet * set, CFTypeRef prop, bool all)
+{
+    CFIndex	count;
+    int		i;
+
+    bzero(set, sizeof(*set));
+    set->all = all;
+    if (prop == NULL || all) {
+	return;
+    }
+    /* the same forms S_service_enable() in bootpd.c accepts */
+    if (isA_CFBoolean(prop) != NULL) {
+	set->all = CFEqual(prop, kCFBooleanTrue);
+	return;
+    }
+    if (isA_CFString(prop) != NULL) {
+	set->names = malloc(sizeof(*set->names));
+	my_CFStringToCStringAndLength(prop, set->names[0],
+				      sizeof(set->names[0]));
+	if (set->names[0][0] != '\0') {
+	    set->count = 1;
+	}
+	return;
+    }
+    if (isA_CFArray(prop) == NULL) {
+	return;
+    }
+    count = CFArrayGetCount(prop);
+    if (count == 0) {
+	set->all = true;
+	return;
+    }
+    set->names = malloc(sizeof(*set->names) * count);
+    for (i = 0; i < count; i++) {
+	CFStringRef	name = CFArrayGetValueAtIndex(prop, i);
+
+	if (isA_CFString(name) == NULL) {
+	    continue;
+	}
+	my_CFStringToCStringAndLength(name, set->names[set->count],
+				      sizeof(set->names[0]));
+	if (set->names[set->count][0] != '\0') {
+	    set->count++;
+	}
+    }
+    return;
+}
+
+static void
+ServiceSetFree(ServiceSet * set)
+{
+    if (set->names != NULL) {
+	free(set->names);
+    }
+    bzero(set, sizeof(*set));
+    return;
+}
+
+static bool
+ServiceSetContains(const ServiceSet * set, const char * if_name)
+{
+    int		i;
+
+    if (set->all) {
+	return (true);
+    }
+    for (i = 0; i < set->count; i++) {
+	if (strcmp(set->names[i], if_name) == 0) {
+	    return (true);
+	}
+    }
+    return (false);
+}
+
+/**
+ ** ShadowConfig
+ **/
+
+ShadowConfigRef
+ShadowConfigCreate(const char * path, const char * cache_path,
+		   uint32_t services)
+{
+    ShadowConfigRef	config;
+    CFDictionaryRef	plist;
+    uint32_t		val;
+
+    config = (ShadowConfigRef)malloc(sizeof(*config));
+    bzero(config, sizeof(*config));
+    ConfigCacheLoad(path, cache_path, &config->contents);
+    plist = config->contents.plist;
+    if (plist == NULL && config->contents.subnets == NULL) {
+	my_log(LOG_NOTICE, "shadow: can't load %s", path);
+	ShadowConfigFree(&config);
+	return (NULL);
+    }
+    ServiceSetInit(&config->bootp,
+		   (plist != NULL)
+		   ? CFDictionaryGetValue(plist, CFSTR(CFGPROP_BOOTP_ENABLED))
+		   : NULL,
+		   (services & SHADOW_SERVICE_BOOTP) != 0);
+    ServiceSetInit(&config->dhcp,
+		   (plist != NULL)
+		   ? CFDictionaryGetValue(plist, CFSTR(CFGPROP_DHCP_ENABLED))
+		   : NULL,
+		   (services & SHADOW_SERVICE_DHCP) != 0);
+    ServiceSetInit(&config->ignore_allow_deny,
+		   (plist != NULL)
+		   ? CFDictionaryGetValue(plist,
+					  CFSTR(CFGPROP_IGNORE_ALLOW_DENY))
+		   : NULL,
+		   (services & SHADOW_SERVICE_IGNORE_ALLOW_DENY) != 0);
+    config->use_server_config = true;
+    if (plist != NULL) {
+	CFTypeRef	prop;
+
+	prop = CFDictionaryGetValue(plist,
+				    CFSTR(CFGPROP_REPLY_THRESHOLD_SECONDS));
+	if (prop != NULL && my_CFTypeToNumber(prop, &val)) {
+	    config->reply_threshold_seconds = val;
+	}
+	prop = CFDictionaryGetValue(plist,
+		       CFSTR(CFGPROP_USE_SERVER_CONFIG_FOR_DHCP_OPTIONS));
+	if (prop != NULL && my_CFTypeToNumber(prop, &val)) {
+	    config->use_server_config = (val != 0);
+	}
+    }
+    return (config);
+}
+
+void
+ShadowConfigFree(ShadowConfigRef * config_p)
+{
+    ShadowConfigRef	config = *config_p;
+
+    if (config == NULL) {
+	return;
+    }
+    ConfigCacheContentsFree(&config->contents);
+    ServiceSetFree(&config->bootp);
+    ServiceSetFree(&config->dhcp);
+    ServiceSetFree(&config->ignore_allow_deny);
+    free(config);
+    *config_p = NULL;
+    return;
+}
+
+static bool
+S_ether_in_list(const struct ether_addr * list, int count,
+		const uint8_t * hwaddr)
+{
+    return (bsearch(hwaddr, list, count, sizeof(*list),
+		    (qsort_compare_func_t)ether_cmp) != NULL);
+}
+
+static bool
+S_allowed(ShadowConfigRef config, const ShadowRequest * request)
+{
+    ConfigCacheContentsRef	contents = &config->contents;
+
+    if (request->hwlen != ETHER_ADDR_LEN
+	|| ServiceSetContains(&config->ignore_allow_deny, request->if_name)) {
+	return (true);
+    }
+    if (contents->deny != NULL
+	&& S_ether_in_list(contents->deny, contents->deny_count,
+			   request->chaddr)) {
+	return (false);
+    }
+    if (contents->allow != NULL
+	&& !S_ether_in_list(contents->allow, contents->allow_count,
+			    request->chaddr)) {
+	return (false);
+    }
+    return (true);
+}
+
+/*
+ * Function: S_network_subnet
+ * Purpose:
+ *   Find the subnet for the network the client is on: the relay agent's,
+ *   or else the first of the interface's that is configured.
+ */
+static SubnetRef
+S_network_subnet(SubnetListRef subnets, const ShadowRequest * request,
+		 struct in_addr * net_addr)
+{
+    int		i;
+    SubnetRef	subnet;
+
+    net_addr->s_addr = 0;
+    if (subnets == NULL) {
+	return (NULL);
+    }
+    if (request->giaddr.s_addr != 0) {
+	*net_addr = request->giaddr;
+	return (SubnetListGetSubnetForAddress(subnets, request->giaddr,
+					      false));
+    }
+    for (i = 0; i < request->if_addrs_count; i++) {
+	subnet = SubnetListGetSubnetForAddress(subnets, request->if_addrs[i],
+					       false);
+	if (subnet != NULL) {
+	    *net_addr = request->if_addrs[i];
+	    return (subnet);
+	}
+    }
+    return (NULL);
+}
+
+static uint32_t
+S_options_hash(ShadowConfigRef config, SubnetRef subnet,
+	       const ShadowRequest * request)
+{
+    static const uint8_t default_tags[] = {
+	dhcptag_subnet_mask_e,
+	dhcptag_router_e,
+	dhcptag_domain_name_server_e,
+	dhcptag_domain_name_e,
+    };
+    uint32_t		h = FNV_32_OFFSET;
+    int			i;
+    int			n;
+    const uint8_t *	tags;
+    uint8_t		use_server_config = config->use_server_config;
+
+    /* options missing from the subnet may come from the server */
+    h = fnv_hash_add(h, &use_server_config, sizeof(use_server_config));
+    if (request->prl_present) {
+	tags = request->prl;
+	n = request->prl_count;
+    }
+    else {
+	tags = default_tags;
+	n = sizeof(default_tags) / sizeof(default_tags[0]);
+    }
+    for (i = 0; i < n; i++) {
+	const char *	opt = NULL;
+	int		opt_length = 0;
+	uint8_t		len;
+
+	switch (tags[i]) {
+	case dhcptag_end_e:
+	case dhcptag_pad_e:
+	case dhcptag_host_name_e:
+	case dhcptag_requested_ip_address_e:
+	case dhcptag_lease_time_e:
+	case dhcptag_option_overload_e:
+	case dhcptag_dhcp_message_type_e:
+	case dhcptag_server_identifier_e:
+	case dhcptag_parameter_request_list_e:
+	case dhcptag_message_e:
+	case dhcptag_max_dhcp_message_size_e:
+	case dhcptag_renewal_t1_time_value_e:
+	case dhcptag_rebinding_t2_time_value_e:
+	case dhcptag_client_identifier_e:
+	    /* not taken from the subnet, see add_subnet_options() */
+	    continue;
+	default:
+	    break;
+	}
+	if (subnet != NULL) {
+	    opt = SubnetGetOptionPtrAndLength(subnet, tags[i], &opt_length);
+	}
+	h = fnv_hash_add(h, &tags[i], 1);
+	if (opt == NULL) {
+	    len = 0xff;
+	    h = fnv_hash_add(h, &len, 1);
+	    continue;
+	}
+	len = opt_length;
+	h = fnv_hash_add(h, &len, 1);
+	h = fnv_hash_add(h, opt, opt_length);
+    }
+    return (h);
+}
+
+static void
+S_decision_set_subnet(ShadowDecision * decision, SubnetRef subnet,
+		      struct in_addr addr)
+{
+    if (subnet == NULL) {
+	return;
+    }
+    decision->subnet_name = SubnetGetName(subnet);
+    decision->subnet_mask = SubnetGetMask(subnet);
+    decision->subnet_net.s_addr
+	= addr.s_addr & decision->subnet_mask.s_addr;
+    return;
+}
+
+void
+ShadowConfigDecide(ShadowConfigRef config, const ShadowRequest * request,
+		   ShadowDecision * decision)
+{
+    struct in_addr	claimed;
+    struct in_addr	net_addr;
+    SubnetRef		options_subnet = NULL;
+    SubnetRef		subnet;
+    SubnetListRef	subnets = config->contents.subnets;
+
+    bzero(decision, sizeof(*decision));
+    if (request->msgtype == dhcp_msgtype_none_e) {
+	if (!ServiceSetContains(&config->bootp, request->if_name)
+	    || request->secs < config->reply_threshold_seconds) {
+	    return;
+	}
+    }
+    else if (!ServiceSetContains(&config->dhcp, request->if_name)) {
+	return;
+    }
+    if (!S_allowed(config, request)) {
+	return;
+    }
+    subnet = S_network_subnet(subnets, request, &net_addr);
+    S_decision_set_subnet(decision, subnet, net_addr);
+    switch (request->msgtype) {
+    case dhcp_msgtype_none_e:
+	decision->address_class = kShadowAddressStatic;
+	options_subnet = subnet;
+	break;
+    case dhcp_msgtype_inform_e:
+	decision->address_class = kShadowAddressInform;
+	options_subnet = subnet;
+	if (subnets != NULL && request->ciaddr.s_addr != 0) {
+	    SubnetRef	s;
+
+	    s = SubnetListGetSubnetForAddress(subnets, request->ciaddr, false);
+	    if (s != NULL) {
+		options_subnet = s;
+	    }
+	}
+	break;
+    default:
+	claimed = request->ciaddr;
+	if (claimed.s_addr == 0) {
+	    claimed = request->requested_ip;
+	}
+	if (subnets != NULL && claimed.s_addr != 0) {
+	    SubnetRef	s;
+
+	    s = SubnetListGetSubnetForAddress(subnets, claimed, true);
+	    if (s != NULL && SubnetDoesAllocate(s)
+		&& (net_addr.s_addr == 0 || s == subnet
+		    || SubnetListAreAddressesOnSameSupernet(subnets, claimed,
+							    net_addr))) {
+		decision->address_class = kShadowAddressKeep;
+		options_subnet = s;
+		S_decision_set_subnet(decision, s, claimed);
+		break;
+	    }
+	}
+	if (request->msgtype == dhcp_msgtype_request_e) {
+	    if (claimed.s_addr != 0 && subnet != NULL) {
+		decision->address_class = kShadowAddressNak;
+	    }
+	}
+	else if (subnet != NULL && SubnetDoesAllocate(subnet)) {
+	    decision->address_class = kShadowAddressPool;
+	    options_subnet = subnet;
+	}
+	break;
+    }
+    decision->respond = (decision->address_class != kShadowAddressNone);
+    if (decision->respond && decision->address_class != kShadowAddressNak) {
+	decision->options_hash = S_options_hash(config, options_subnet,
+						request);
+    }
+    return;
+}
+
+uint32_t
+ShadowDecisionCompare(const ShadowDecision * active,
+		      const ShadowDecision * candidate)
+{
+    uint32_t	diff = 0;
+
+    if (active->respond != candidate->respond) {
+	diff |= SHADOW_DIFF_RESPOND;
+    }
+    if (active->subnet_net.s_addr != candidate->subnet_net.s_addr
+	|| active->subnet_mask.s_addr != candidate->subnet_mask.s_addr
+	|| ((active->subnet_name == NULL) != (candidate->subnet_name == NULL))
+	|| (active->subnet_name != NULL
+	    && strcmp(active->subnet_name, candidate->subnet_name) != 0)) {
+	diff |= SHADOW_DIFF_SUBNET;
+    }
+    if (active->address_class != candidate->address_class) {
+	diff |= SHADOW_DIFF_ADDRESS;
+    }
+    if (active->options_hash != candidate->options_hash) {
+	diff |= SHADOW_DIFF_OPTIONS;
+    }
+    return (diff);
+}
+
+/**
+ ** ShadowRequest
+ **/
+
+bool
+ShadowRequestInit(ShadowRequest * request, interface_t * if_p,
+		  const struct dhcp * pkt, dhcpol_t * options,
+		  dhcp_msgtype_t msgtype)
+{
+    int			count;
+    int			i;
+    void *		opt;
+    int			opt_len;
+
+    switch (msgtype) {
+    case dhcp_msgtype_none_e:
+    case dhcp_msgtype_discover_e:
+    case dhcp_msgtype_request_e:
+    case dhcp_msgtype_inform_e:
+	break;
+    default:
+	return (false);
+    }
+    strlcpy(request->if_name, if_name(if_p), sizeof(request->if_name));
+    count = if_inet_count(if_p);
+    if (count > SHADOW_IF_ADDRS_MAX) {
+	count = SHADOW_IF_ADDRS_MAX;
+    }
+    for (i = 0; i < count; i++) {
+	request->if_addrs[i] = if_inet_addr_at(if_p, i)->addr;
+    }
+    request->if_addrs_count = count;
+    request->msgtype = msgtype;
+    request->hwtype = pkt->dp_htype;
+    request->hwlen = pkt->dp_hlen;
+    if (request->hwlen > sizeof(request->chaddr)) {
+	request->hwlen = sizeof(request->chaddr);
+    }
+    memcpy(request->chaddr, pkt->dp_chaddr, request->hwlen);
+    request->secs = ntohs(pkt->dp_secs);
+    request->ciaddr = pkt->dp_ciaddr;
+    request->giaddr = pkt->dp_giaddr;
+    request->requested_ip.s_addr = 0;
+    request->prl_present = false;
+    request->prl_count = 0;
+    if (options == NULL || msgtype == dhcp_msgtype_none_e) {
+	return (true);
+    }
+    opt = dhcpol_find(options, dhcptag_requested_ip_address_e, &opt_len,
+		      NULL);
+    if (opt != NULL && opt_len == sizeof(request->requested_ip)) {
+	memcpy(&request->requested_ip, opt, sizeof(request->requested_ip));
+    }
+    opt = dhcpol_find(options, dhcptag_parameter_request_list_e, &opt_len,
+		      NULL);
+    if (opt != NULL) {
+	if (opt_len > SHADOW_PRL_MAX) {
+	    opt_len = SHADOW_PRL_MAX;
+	}
+	request->prl_present = true;
+	request->prl_count = opt_len;
+	memcpy(request->prl, opt, opt_len);
+    }
+    return (true);
+}
+
+/**
+ ** ShadowEval
+ **/
+
+ShadowEvalRef
+ShadowEvalCreate(ShadowConfigRef active, ShadowConfigRef candidate,
+		 uint32_t budget_usecs)
+{
+    ShadowEvalRef	eval;
+
+    eval = (ShadowEvalRef)malloc(sizeof(*eval));
+    bzero(eval, sizeof(*eval));
+    eval->active = active;
+    eval->candidate = candidate;
+    eval->budget_usecs = budget_usecs;
+    eval->start_nsecs = S_now_nsecs();
+    return (eval);
+}
+
+void
+ShadowEvalFree(ShadowEvalRef * eval_p)
+{
+    ShadowEvalRef	eval = *eval_p;
+
+    if (eval == NULL) {
+	return;
+    }
+    ShadowConfigFree(&eval->active);
+    ShadowConfigFree(&eval->candidate);
+    free(eval);
+    *eval_p = NULL;
+    return;
+}
+
+static bool
+S_budget_spent(ShadowEvalRef eval, uint64_t now_nsecs)
+{
+    time_t	second = (time_t)(now_nsecs / NSECS_PER_SEC);
+
+    if (second != eval->budget_second) {
+	eval->budget_second = second;
+	eval->budget_used_nsecs = 0;
+    }
+    return (eval->budget_used_nsecs
+	    >= (uint64_t)eval->budget_usecs * NSECS_PER_USEC);
+}
+
+/*
+ * Function: S_queue_slot
+ * Purpose:
+ *   Return the next free slot in the ring, or NULL if the request has to
+ *   be dropped.
+ */
+static ShadowRequest *
+S_queue_slot(ShadowEvalRef eval, uint64_t now_nsecs)
+{
+    if (eval->count == SHADOW_QUEUE_MAX) {
+	eval->stats.dropped_full++;
+	return (NULL);
+    }
+    if (S_budget_spent(eval, now_nsecs)) {
+	eval->stats.dropped_budget++;
+	return (NULL);
+    }
+    return (eval->queue + ((eval->head + eval->count) % SHADOW_QUEUE_MAX));
+}
+
+bool
+ShadowEvalQueue(ShadowEvalRef eval, interface_t * if_p,
+		const struct dhcp * pkt, dhcpol_t * options,
+		dhcp_msgtype_t msgtype)
+{
+    uint64_t		start;
+    ShadowRequest *	slot;
+    bool		was_empty = false;
+
+    start = S_now_nsecs();
+    slot = S_queue_slot(eval, start);
+    if (slot != NULL
+	&& ShadowRequestInit(slot, if_p, pkt, options, msgtype)) {
+	was_empty = (eval->count == 0);
+	eval->count++;
+	eval->stats.queued++;
+    }
+    eval->stats.queue_nsecs += S_now_nsecs() - start;
+    return (was_empty);
+}
+
+static const char *
+S_address_class_name(ShadowAddressClass address_class)
+{
+    static const char * names[] = {
+	"none",
+	"keep",
+	"pool",
+	"nak",
+	"static",
+	"inform",
+    };
+
+    if (address_class < 0
+	|| address_class >= (sizeof(names) / sizeof(names[0]))) {
+	return ("<unknown>");
+    }
+    return (names[address_class]);
+}
+
+static int
+S_format_subnet(char * buf, int buf_size, const ShadowDecision * decision)
+{
+    char	net[INET_ADDRSTRLEN];
+
+    if (decision->subnet_mask.s_addr == 0) {
+	return (snprintf(buf, buf_size, "none"));
+    }
+    inet_ntop(AF_INET, &decision->subnet_net, net, sizeof(net));
+    return (snprintf(buf, buf_size, "%s/%d%s%s%s", net,
+		     ffs(ntohl(decision->subnet_mask.s_addr))
+		     ? 33 - ffs(ntohl(decision->subnet_mask.s_addr)) : 0,
+		     (decision->subnet_name != NULL) ? " (" : "",
+		     (decision->subnet_name != NULL)
+		     ? decision->subnet_name : "",
+		     (decision->subnet_name != NULL) ? ")" : ""));
+}
+
+static void
+S_record_sample(ShadowEvalRef eval, const ShadowRequest * request,
+		const ShadowDecision * active,
+		const ShadowDecision * candidate, uint32_t diff)
+{
+    char		a_subnet[64];
+    char		c_subnet[64];
+    char		hwstr[sizeof(request->chaddr) * 3];
+    int			i;
+    int			len;
+    char *		sample;
+    time_t		now;
+
+    hwstr[0] = '\0';
+    for (i = 0, len = 0; i < request->hwlen; i++) {
+	len += snprintf(hwstr + len, sizeof(hwstr) - len,
+			(i == 0) ? "%x" : ":%x", request->chaddr[i]);
+    }
+    sample = eval->samples[eval->samples_next];
+    len = snprintf(sample, SAMPLE_LENGTH, "%s %s %s:",
+		   (request->msgtype == dhcp_msgtype_none_e)
+		   ? "BOOTP" : dhcp_msgtype_names(request->msgtype),
+		   request->if_name, hwstr);
+    if ((diff & SHADOW_DIFF_RESPOND) != 0 && len < SAMPLE_LENGTH) {
+	len += snprintf(sample + len, SAMPLE_LENGTH - len,
+			" respond %s->%s",
+			active->respond ? "yes" : "no",
+			candidate->respond ? "yes" : "no");
+    }
+    if ((diff & SHADOW_DIFF_SUBNET) != 0 && len < SAMPLE_LENGTH) {
+	S_format_subnet(a_subnet, sizeof(a_subnet), active);
+	S_format_subnet(c_subnet, sizeof(c_subnet), candidate);
+	len += snprintf(sample + len, SAMPLE_LENGTH - len,
+			" subnet %s->%s", a_subnet, c_subnet);
+    }
+    if ((diff & SHADOW_DIFF_ADDRESS) != 0 && len < SAMPLE_LENGTH) {
+	len += snprintf(sample + len, SAMPLE_LENGTH - len,
+			" address %s->%s",
+			S_address_class_name(active->address_class),
+			S_address_class_name(candidate->address_class));
+    }
+    if ((diff & SHADOW_DIFF_OPTIONS) != 0 && len < SAMPLE_LENGTH) {
+	snprintf(sample + len, SAMPLE_LENGTH - len,
+		 " options %08x->%08x",
+		 active->options_hash, candidate->options_hash);
+    }
+    eval->samples_next = (eval->samples_next + 1) % SHADOW_SAMPLES_MAX;
+    if (eval->samples_count < SHADOW_SAMPLES_MAX) {
+	eval->samples_count++;
+    }
+
+    /* log one now and then, the rest are in the report */
+    now = (time_t)(S_now_nsecs() / NSECS_PER_SEC);
+    if (eval->sample_logged == 0
+	|| (now - eval->sample_logged) >= SHADOW_SAMPLE_INTERVAL_SECS) {
+	eval->sample_logged = now;
+	my_log(LOG_NOTICE, "shadow: %s", sample);
+    }
+    return;
+}
+
+static void
+S_evaluate(ShadowEvalRef eval, const ShadowRequest * request)
+{
+    ShadowDecision	active;
+    ShadowDecision	candidate;
+    uint32_t		diff;
+
+    ShadowConfigDecide(eval->active, request, &active);
+    ShadowConfigDecide(eval->candidate, request, &candidate);
+    diff = ShadowDecisionCompare(&active, &candidate);
+    eval->stats.evaluated++;
+    if (diff == 0) {
+	eval->stats.agreed++;
+	return;
+    }
+    if ((diff & SHADOW_DIFF_RESPOND) != 0) {
+	eval->stats.respond_diffs++;
+    }
+    if ((diff & SHADOW_DIFF_SUBNET) != 0) {
+	eval->stats.subnet_diffs++;
+    }
+    if ((diff & SHADOW_DIFF_ADDRESS) != 0) {
+	eval->stats.address_diffs++;
+    }
+    if ((diff & SHADOW_DIFF_OPTIONS) != 0) {
+	eval->stats.options_diffs++;
+    }
+    S_record_sample(eval, request, &active, &candidate, diff);
+    return;
+}
+
+bool
+ShadowEvalRun(ShadowEvalRef eval)
+{
+    int		n;
+    uint64_t	now;
+
+    now = S_now_nsecs();
+    for (n = 0; eval->count > 0 && n < SHADOW_RUN_MAX; n++) {
+	uint64_t	end;
+	uint64_t	elapsed;
+
+	if (S_budget_spent(eval, now)) {
+	    eval->stats.dropped_budget += eval->count;
+	    ShadowEvalDiscard(eval);
+	    break;
+	}
+	S_evaluate(eval, eval->queue + eval->head);
+	eval->head = (eval->head + 1) % SHADOW_QUEUE_MAX;
+	eval->count--;
+	end = S_now_nsecs();
+	elapsed = end - now;
+	eval->budget_used_nsecs += elapsed;
+	eval->stats.eval_nsecs += elapsed;
+	if (elapsed > eval->stats.eval_nsecs_max) {
+	    eval->stats.eval_nsecs_max = elapsed;
+	}
+	now = end;
+    }
+    return (eval->count > 0);
+}
+
+void
+ShadowEvalDiscard(ShadowEvalRef eval)
+{
+    eval->head = 0;
+    eval->count = 0;
+    return;
+}
+
+void
+ShadowEvalGetStats(ShadowEvalRef eval, ShadowEvalStats * stats)
+{
+    *stats = eval->stats;
+    stats->elapsed_nsecs = S_now_nsecs() - eval->start_nsecs;
+    return;
+}
+
+int
+ShadowEvalReport(ShadowEvalRef eval, char * buf, int buf_size)
+{
+    int			i;
+    int			len;
+    ShadowEvalStats	stats;
+
+    ShadowEvalGetStats(eval, &stats);
+    len = snprintf(buf, buf_size,
+		   "queued %llu dropped %llu (queue full) %llu (budget)\n"
+		   "evaluated %llu agreed %llu\n"
+		   "differ: respond %llu subnet %llu address %llu"
+		   " options %llu\n"
+		   "overhead: queue %.0f ns/request, evaluate %.1f us/request"
+		   " (max %.1f us), %.3f%% of elapsed time\n",
+		   (unsigned long long)stats.queued,
+		   (unsigned long long)stats.dropped_full,
+		   (unsigned long long)stats.dropped_budget,
+		   (unsigned long long)stats.evaluated,
+		   (unsigned long long)stats.agreed,
+		   (unsigned long long)stats.respond_diffs,
+		   (unsigned long long)stats.subnet_diffs,
+		   (unsigned long long)stats.address_diffs,
+		   (unsigned long long)stats.options_diffs,
+		   stats.queued
+		   ? (double)stats.queue_nsecs / stats.queued : 0.0,
+		   stats.evaluated
+		   ? (double)stats.eval_nsecs / stats.evaluated
+		   / NSECS_PER_USEC : 0.0,
+		   (double)stats.eval_nsecs_max / NSECS_PER_USEC,
+		   stats.elapsed_nsecs
+		   ? (double)(stats.queue_nsecs + stats.eval_nsecs) * 100
+		   / stats.elapsed_nsecs : 0.0);
+    /* oldest sample first */
+    for (i = 0; i < eval->samples_count && len < buf_size; i++) {
+	int	which;
+
+	which = (eval->samples_next - eval->samples_count + i
+		 + SHADOW_SAMPLES_MAX) % SHADOW_SAMPLES_MAX;
+	len += snprintf(buf + len, buf_size - len, "%s\n",
+			eval->samples[which]);
+    }
+    if (len >= buf_size) {
+	len = buf_size - 1;
+    }
+    return (len);
+}
+
+#ifdef TEST_SHADOW_CONFIG
+
+/*
+ * Evaluate a set of synthetic requests against a candidate that changes
+ * one subnet's router and shrinks another's pool, check the differences
+ * found, then measure what an evaluation costs.
+ */
+#include <unistd.h>
+
+static CFDictionaryRef
+S_subnet_create(const char * name, const char * net, const char * mask,
+		const char * start, const char * end, const char * router)
+{
+    CFMutableDictionaryRef	dict;
+    CFMutableArrayRef		array;
+    CFStringRef			str;
+
+    dict = CFDictionaryCreateMutable(NULL, 0,
+				     &kCFTypeDictionaryKeyCallBacks,
+				     &kCFTypeDictionaryValueCallBacks);
+    my_CFDictionarySetCString(dict, CFSTR(SUBNET_PROP_NAME), name);
+    my_CFDictionarySetCString(dict, CFSTR(SUBNET_PROP_NET_ADDRESS), net);
+    my_CFDictionarySetCString(dict, CFSTR(SUBNET_PROP_NET_MASK), mask);
+    array = CFArrayCreateMutable(NULL, 2, &kCFTypeArrayCallBacks);
+    str = CFStringCreateWithCString(NULL, start, kCFStringEncodingASCII);
+    CFArrayAppendValue(array, str);
+    CFRelease(str);
+    str = CFStringCreateWithCString(NULL, end, kCFStringEncodingASCII);
+    CFArrayAppendValue(array, str);
+    CFRelease(str);
+    CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_RANGE), array);
+    CFRelease(array);
+    my_CFDictionarySetCString(dict, CFSTR("dhcp_router"), router);
+    my_CFDictionarySetCString(dict, CFSTR("dhcp_domain_name"),
+			      "example.com");
+    CFDictionarySetValue(dict, CFSTR("allocate"), kCFBooleanTrue);
+    return (dict);
+}
+
+static void
+S_write_config(const char * path, bool candidate)
+{
+    CFMutableDictionaryRef	plist;
+    CFMutableArrayRef		subnets;
+    CFDictionaryRef		subnet;
+
+    plist = CFDictionaryCreateMutable(NULL, 0,
+				      &kCFTypeDictionaryKeyCallBacks,
+				      &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(plist, CFSTR(CFGPROP_DHCP_ENABLED),
+			 kCFBooleanTrue);
+    subnets = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    subnet = S_subnet_create("net10", "10.0.0.0", "255.255.255.0",
+			     "10.0.0.10", "10.0.0.200",
+			     candidate ? "10.0.0.254" : "10.0.0.1");
+    CFArrayAppendValue(subnets, subnet);
+    CFRelease(subnet);
+    subnet = S_subnet_create("net20", "10.0.1.0", "255.255.255.0",
+			     "10.0.1.10",
+			     candidate ? "10.0.1.99" : "10.0.1.200",
+			     "10.0.1.1");
+    CFArrayAppendValue(subnets, subnet);
+    CFRelease(subnet);
+    CFDictionarySetValue(plist, CFSTR("Subnets"), subnets);
+    CFRelease(subnets);
+    if (my_CFPropertyListWriteFile(plist, path, 0644) < 0) {
+	fprintf(stderr, "can't write %s\n", path);
+	exit(1);
+    }
+    CFRelease(plist);
+    return;
+}
+
+static void
+S_request_init(ShadowRequest * request, dhcp_msgtype_t msgtype, int i)
+{
+    static const uint8_t prl[] = {
+	dhcptag_subnet_mask_e,
+	dhcptag_router_e,
+	dhcptag_domain_name_server_e,
+	dhcptag_domain_name_e,
+    };
+
+    bzero(request, sizeof(*request));
+    strlcpy(request->if_name, "en0", sizeof(request->if_name));
+    request->if_addrs[0].s_addr = htonl(0x0a000001);	/* 10.0.0.1 */
+    request->if_addrs_count = 1;
+    request->msgtype = msgtype;
+    request->hwtype = ARPHRD_ETHER;
+    request->hwlen = ETHER_ADDR_LEN;
+    request->chaddr[3] = (i >> 16) & 0xff;
+    request->chaddr[4] = (i >> 8) & 0xff;
+    request->chaddr[5] = i & 0xff;
+    if ((i & 1) != 0) {
+	/* relayed from the second subnet */
+	request->giaddr.s_addr = htonl(0x0a000101);
+	request->requested_ip.s_addr = htonl(0x0a000100 + 10 + (i % 190));
+    }
+    else {
+	request->requested_ip.s_addr = htonl(0x0a000000 + 10 + (i % 190));
+    }
+    request->prl_present = true;
+    request->prl_count = sizeof(prl);
+    memcpy(request->prl, prl, sizeof(prl));
+    return;
+}
+
+static void
+usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [ -count <requests> ] [ -v ]\n", progname);
+    exit(1);
+}
+
+int
+main(int argc, char * argv[])
+{
+    char		active_path[] = "/tmp/shadow-active.XXXXXX";
+    char		buf[4096];
+    char		candidate_path[] = "/tmp/shadow-candidate.XXXXXX";
+    int			count = 100000;
+    ShadowEvalRef	eval;
+    int			fd;
+    int			i;
+    ShadowEvalStats	stats;
+
+    for (i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-count") == 0 && (i + 1) < argc) {
+	    count = atoi(argv[++i]);
+	}
+	else if (strcmp(argv[i], "-v") == 0) {
+	    S_test_verbose = true;
+	}
+	else {
+	    usage(argv[0]);
+	}
+    }
+    fd = mkstemp(active_path);
+    close(fd);
+    fd = mkstemp(candidate_path);
+    close(fd);
+    S_write_config(active_path, false);
+    S_write_config(candidate_path, true);
+
+    /* the active configuration never differs from itself */
+    eval = ShadowEvalCreate(ShadowConfigCreate(active_path, NULL, 0),
+			    ShadowConfigCreate(active_path, NULL, 0),
+			    UINT32_MAX);
+    for (i = 0; i < 1000; i++) {
+	S_request_init(S_queue_slot(eval, S_now_nsecs()),
+		       (i & 2) ? dhcp_msgtype_request_e
+		       : dhcp_msgtype_discover_e, i);
+	eval->count++;
+	ShadowEvalRun(eval);
+    }
+    ShadowEvalGetStats(eval, &stats);
+    if (stats.evaluated != 1000 || stats.agreed != stats.evaluated) {
+	fprintf(stderr, "identical configurations differ\n");
+	exit(1);
+    }
+    ShadowEvalFree(&eval);
+
+    /*
+     * The candidate changes net10's router, so every client on net10
+     * gets different options; it shrinks net20's pool, so half of the
+     * clients renewing on net20 lose their address.
+     */
+    eval = ShadowEvalCreate(ShadowConfigCreate(active_path, NULL, 0),
+			    ShadowConfigCreate(candidate_path, NULL, 0),
+			    UINT32_MAX);
+    if (eval->active == NULL || eval->candidate == NULL) {
+	fprintf(stderr, "can't load configurations\n");
+	exit(1);
+    }
+    for (i = 0; i < count; i++) {
+	ShadowRequest *	slot;
+
+	slot = S_queue_slot(eval, S_now_nsecs());
+	S_request_init(slot, dhcp_msgtype_request_e, i);
+	eval->count++;
+	if (eval->count == SHADOW_RUN_MAX) {
+	    while (ShadowEvalRun(eval)) {
+	    }
+	}
+    }
+    while (ShadowEvalRun(eval)) {
+    }
+    ShadowEvalReport(eval, buf, sizeof(buf));
+    printf("%d requests\n%s", count, buf);
+    ShadowEvalGetStats(eval, &stats);
+    if (stats.evaluated != count
+	|| stats.options_diffs < (uint64_t)count / 2
+	|| stats.address_diffs == 0
+	|| stats.address_diffs >= (uint64_t)count / 2) {
+	fprintf(stderr, "unexpected differences\n");
+	exit(1);
+    }
+    ShadowEvalFree(&eval);
+    unlink(active_path);
+    unlink(candidate_path);
+    exit(0);
+    return (0);
+}
+
+#endif /* TEST_SHADOW_CONFIG */
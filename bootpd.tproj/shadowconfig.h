@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * shadowconfig.h
+ * - evaluate a candidate configuration against live requests, without
+ *   acting on it, and count where it differs from the active one
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_SHADOWCONFIG_H
+#define _S_SHADOWCONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include "dhcp.h"
+#include "dhcp_options.h"
+#include "interfaces.h"
+
+/*
+ * The bootpd.plist properties that a decision depends on, besides
+ * Subnets, allow, and deny.
+ */
+#define CFGPROP_BOOTP_ENABLED		"bootp_enabled"
+#define CFGPROP_DHCP_ENABLED		"dhcp_enabled"
+#define CFGPROP_IGNORE_ALLOW_DENY	"ignore_allow_deny"
+#define CFGPROP_REPLY_THRESHOLD_SECONDS	"reply_threshold_seconds"
+#define CFGPROP_USE_SERVER_CONFIG_FOR_DHCP_OPTIONS "use_server_config_for_dhcp_options"
+
+/* services enabled on every interface by command-line flags */
+#define SHADOW_SERVICE_BOOTP		0x1
+#define SHADOW_SERVICE_DHCP		0x2
+#define SHADOW_SERVICE_IGNORE_ALLOW_DENY	0x4
+
+typedef struct ShadowConfig * ShadowConfigRef;
+
+/*
+ * Function: ShadowConfigCreate
+ * Purpose:
+ *   Load the configuration in path (see ConfigCacheLoad()).
+ *   Returns NULL if the file doesn't exist or can't be parsed.
+ */
+ShadowConfigRef
+ShadowConfigCreate(const char * path, const char * cache_path,
+		   uint32_t services);
+
+void
+ShadowConfigFree(ShadowConfigRef * config_p);
+
+/*
+ * Type: ShadowRequest
+ * Purpose:
+ *   The parts of a request that a decision depends on, copied from the
+ *   packet so that it can be evaluated after the reply has gone out.
+ */
+#define SHADOW_IF_ADDRS_MAX	4
+#define SHADOW_PRL_MAX		32
+
+typedef struct {
+    char		if_name[IFNAMSIZ];
+    struct in_addr	if_addrs[SHADOW_IF_ADDRS_MAX];
+    int			if_addrs_count;
+    dhcp_msgtype_t	msgtype;	/* dhcp_msgtype_none_e for BOOTP */
+    uint8_t		hwtype;
+    uint8_t		hwlen;
+    uint8_t		chaddr[16];
+    uint16_t		secs;
+    struct in_addr	ciaddr;
+    struct in_addr	giaddr;
+    struct in_addr	requested_ip;
+    bool		prl_present;
+    int			prl_count;
+    uint8_t		prl[SHADOW_PRL_MAX];
+} ShadowRequest;
+
+/*
+ * Function: ShadowRequestInit
+ * Purpose:
+ *   Fill in a ShadowRequest from a BOOTREQUEST.  Returns false if the
+ *   request is one that never gets a reply (RELEASE, DECLINE).
+ */
+bool
+ShadowRequestInit(ShadowRequest * request, interface_t * if_p,
+		  const struct dhcp * pkt, dhcpol_t * options,
+		  dhcp_msgtype_t msgtype);
+
+typedef enum {
+    kShadowAddressNone = 0,	/* nothing to offer */
+    kShadowAddressKeep,		/* the client's address stays */
+    kShadowAddressPool,		/* a new address from a pool */
+    kShadowAddressNak,		/* the client's address is refused */
+    kShadowAddressStatic,	/* BOOTP: the address in bootptab */
+    kShadowAddressInform,	/* INFORM: options only */
+} ShadowAddressClass;
+
+typedef struct {
+    bool		respond;
+    const char *	subnet_name;
+    struct in_addr	subnet_net;
+    struct in_addr	subnet_mask;
+    ShadowAddressClass	address_class;
+    uint32_t		options_hash;
+} ShadowDecision;
+
+#define SHADOW_DIFF_RESPOND	0x1
+#define SHADOW_DIFF_SUBNET	0x2
+#define SHADOW_DIFF_ADDRESS	0x4
+#define SHADOW_DIFF_OPTIONS	0x8
+
+/*
+ * Function: ShadowConfigDecide
+ * Purpose:
+ *   Decide how the configuration would answer the request: whether it
+ *   responds, the subnet chosen, the class of address offered, and a
+ *   hash of the options the subnet supplies.  Nothing is allocated or
+ *   changed; in particular no address is acquired.
+ *
+ *   Bindings in bootptab and in the lease database don't depend on
+ *   bootpd.plist, so they're left out: the client's address is the one
+ *   it asks for, and it keeps that address if a pool on its network
+ *   covers it.
+ */
+void
+ShadowConfigDecide(ShadowConfigRef config, const ShadowRequest * request,
+		   ShadowDecision * decision);
+
+/*
+ * Function: ShadowDecisionCompare
+ * Purpose:
+ *   Return the SHADOW_DIFF_* bits for the ways the decisions differ.
+ */
+uint32_t
+ShadowDecisionCompare(const ShadowDecision * active,
+		      const ShadowDecision * candidate);
+
+/*
+ * Type: ShadowEvalRef
+ * Purpose:
+ *   Holds the active and candidate configurations and a queue of
+ *   requests waiting to be evaluated against both.
+ *
+ *   Requests are queued while they're being handled, and evaluated later
+ *   by ShadowEvalRun().  Evaluation is limited to budget_usecs of each
+ *   second; requests that arrive when the queue is full or the budget is
+ *   spent are dropped and counted.
+ */
+#define SHADOW_QUEUE_MAX		256
+#define SHADOW_RUN_MAX			64
+#define SHADOW_BUDGET_USECS_DEFAULT	10000	/* 1% of a second */
+#define SHADOW_SAMPLES_MAX		8
+#define SHADOW_SAMPLE_INTERVAL_SECS	10
+
+typedef struct {
+    uint64_t		queued;
+    uint64_t		dropped_full;	/* queue was full */
+    uint64_t		dropped_budget;	/* budget was spent */
+    uint64_t		evaluated;
+    uint64_t		agreed;
+    uint64_t		respond_diffs;
+    uint64_t		subnet_diffs;
+    uint64_t		address_diffs;
+    uint64_t		options_diffs;
+    uint64_t		queue_nsecs;	/* time spent queueing requests */
+    uint64_t		eval_nsecs;	/* time spent evaluating */
+    uint64_t		eval_nsecs_max;	/* longest single evaluation */
+    uint64_t		elapsed_nsecs;	/* since the evaluation started */
+} ShadowEvalStats;
+
+typedef struct ShadowEval * ShadowEvalRef;
+
+/*
+ * Function: ShadowEvalCreate
+ * Purpose:
+ *   Create an evaluation of candidate against active.  Takes ownership
+ *   of both configurations.
+ */
+ShadowEvalRef
+ShadowEvalCreate(ShadowConfigRef active, ShadowConfigRef candidate,
+		 uint32_t budget_usecs);
+
+void
+ShadowEvalFree(ShadowEvalRef * eval_p);
+
+/*
+ * Function: ShadowEvalQueue
+ * Purpose:
+ *   Queue the request for evaluation.  Returns true if the queue was
+ *   empty, in which case the caller arranges for ShadowEvalRun() to be
+ *   called once the reply is on its way.
+ */
+bool
+ShadowEvalQueue(ShadowEvalRef eval, interface_t * if_p,
+		const struct dhcp * pkt, dhcpol_t * options,
+		dhcp_msgtype_t msgtype);
+
+/*
+ * Function: ShadowEvalRun
+ * Purpose:
+ *   Evaluate up to SHADOW_RUN_MAX queued requests.  Returns true if
+ *   requests remain queued, in which case the caller calls it again
+ *   later so as not to hold up other work.
+ */
+bool
+ShadowEvalRun(ShadowEvalRef eval);
+
+/*
+ * Function: ShadowEvalDiscard
+ * Purpose:
+ *   Drop the queued requests without evaluating them.
+ */
+void
+ShadowEvalDiscard(ShadowEvalRef eval);
+
+void
+ShadowEvalGetStats(ShadowEvalRef eval, ShadowEvalStats * stats);
+
+/*
+ * Function: ShadowEvalReport
+ * Purpose:
+ *   Format the counters, the overhead, and the most recent sampled
+ *   differences into buf.  Returns the length of the report, which is
+ *   truncated if it doesn't fit in buf_size.
+ */
+int
+ShadowEvalReport(ShadowEvalRef eval, char * buf, int buf_size);
+
+#endif /* _S_SHADOWCONFIG_H */
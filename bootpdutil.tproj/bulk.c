@@ -0,0 +1,2143 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * bulk.c
+ * - bulk import and export of reservations (/etc/bootptab) and leases
+ *   (/var/db/dhcpd_leases) as CSV or JSON Lines
+ *
+ * Import maps the input file, splits it into one chunk per thread at
+ * line boundaries, and parses and validates the chunks in parallel.
+ * Duplicate addresses and identifiers are then found using a hash table,
+ * the chunks are formatted in parallel, and the result is written to a
+ * temporary file that is renamed over the target, so bootpd never sees
+ * a partial file.  If any record is invalid, nothing is written.
+ *
+ * The records written are limited to what bootpd's readers accept:
+ * bootp_readtab() reads 255-byte lines with fixed-size fields, and
+ * PLCache_read() 1023-byte lines with 767-byte values.
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "bulk.h"
+
+#define BOOTPTAB_PATH		"/etc/bootptab"
+#define DHCP_LEASES_PATH	"/var/db/dhcpd_leases"
+
+/* bootp_readtab() field and line limits */
+#define BOOTPTAB_NAME_MAX	61
+#define BOOTPTAB_FIELD_MAX	62
+#define BOOTPTAB_BOOTFILE_MAX	125
+#define BOOTPTAB_LINE_MAX	254
+
+/* PLCache_read() value limit */
+#define LEASES_VALUE_MAX	767
+
+#define HWADDR_MAX		16	/* bootp chaddr */
+#define IDENTIFIER_MAX		255	/* DHCP option length */
+#define LEASE_INFINITE		((uint32_t)-1)
+
+#define BULK_THREADS_MAX	32
+#define BULK_CHUNK_ERRORS_MAX	10	/* errors remembered per chunk */
+#define BULK_ERRORS_SHOWN	20
+#define BULK_ERROR_LEN		128
+#define BULK_FIELDS_MAX		32	/* CSV columns, JSON keys per line */
+
+typedef enum {
+    kBulkKindReservations,
+    kBulkKindLeases,
+} BulkKind;
+
+typedef enum {
+    kBulkFormatCSV,
+    kBulkFormatJSONL,
+} BulkFormat;
+
+typedef enum {
+    kBulkFieldNone = -1,
+    kBulkFieldName = 0,
+    kBulkFieldHType,
+    kBulkFieldHWAddress,
+    kBulkFieldIPAddress,
+    kBulkFieldBootfile,
+    kBulkFieldIdentifier,
+    kBulkFieldLeaseExpiry,
+} BulkField;
+
+static const char * const	S_field_names[] = {
+    "name",
+    "htype",
+    "hw_address",
+    "ip_address",
+    "bootfile",
+    "identifier",
+    "lease_expiry",
+};
+
+#define BULK_FIELD_COUNT	(sizeof(S_field_names) / sizeof(S_field_names[0]))
+
+/*
+ * Type: BulkRecord
+ * Purpose:
+ *   A validated reservation or lease.  Strings point into the (private,
+ *   writable) mapping of the input file.
+ */
+typedef struct {
+    const char *	name;		/* NULL if none */
+    const char *	bootfile;	/* NULL if none */
+    const uint8_t *	id;		/* leases: client identifier */
+    struct in_addr	ip;
+    uint32_t		expiry;		/* leases */
+    uint32_t		line;		/* line number in the chunk */
+    uint16_t		id_len;
+    uint8_t		id_type;
+    uint8_t		htype;
+    uint8_t		hlen;
+    uint8_t		haddr[HWADDR_MAX];
+} BulkRecord, * BulkRecordRef;
+
+typedef struct {
+    uint32_t		line;		/* line number in the chunk */
+    char		message[BULK_ERROR_LEN];
+} BulkError;
+
+/*
+ * Type: BulkChunk
+ * Purpose:
+ *   The part of the input handled by one thread.
+ */
+typedef struct {
+    BulkKind		kind;
+    BulkFormat		format;
+    const BulkField *	columns;	/* CSV */
+    int			column_count;
+    char *		start;
+    char *		end;
+    uint32_t		first_line;	/* line number of start, from 1 */
+
+    BulkRecordRef	records;
+    uint32_t		count;
+    BulkError		errors[BULK_CHUNK_ERRORS_MAX];
+    uint32_t		error_count;
+
+    char *		out;		/* formatted records */
+    size_t		out_len;
+    size_t		out_size;
+} BulkChunk, * BulkChunkRef;
+
+typedef struct {
+    uint64_t		records;
+    uint64_t		bytes;
+    double		parse_secs;
+    double		total_secs;
+    int			threads;
+} BulkStats;
+
+static double
+S_elapsed(const struct timeval * start)
+{
+    struct timeval	now;
+
+    gettimeofday(&now, NULL);
+    return ((now.tv_sec - start->tv_sec)
+	    + (now.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+static BulkField
+S_field_lookup(const char * name)
+{
+    int		i;
+
+    for (i = 0; i < BULK_FIELD_COUNT; i++) {
+	if (strcmp(name, S_field_names[i]) == 0) {
+	    return ((BulkField)i);
+	}
+    }
+    return (kBulkFieldNone);
+}
+
+static void
+BulkChunkAddError(BulkChunkRef chunk, uint32_t line, const char * message)
+{
+    if (chunk->error_count < BULK_CHUNK_ERRORS_MAX) {
+	BulkError *	e = chunk->errors + chunk->error_count;
+
+	e->line = line;
+	strlcpy(e->message, message, sizeof(e->message));
+    }
+    chunk->error_count++;
+    return;
+}
+
+/**
+ ** Field parsing and validation
+ **/
+
+static int
+S_hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+	return (c - '0');
+    }
+    if (c >= 'a' && c <= 'f') {
+	return (c - 'a' + 10);
+    }
+    if (c >= 'A' && c <= 'F') {
+	return (c - 'A' + 10);
+    }
+    return (-1);
+}
+
+/*
+ * Function: S_hex_bytes_parse
+ * Purpose:
+ *   Parse a hardware address or identifier: hex digits, optionally
+ *   separated by ':', '-', or '.'.  A one-digit group is one byte, an
+ *   even-length group is as many bytes as it has digit pairs, so
+ *   "0:a:95:1:2:3", "00-0A-95-01-02-03", "000a.9501.0203" and
+ *   "000a95010203" are all the same address.
+ *   Returns the number of bytes, or -1 if the string is malformed.
+ */
+static int
+S_hex_bytes_parse(const char * str, uint8_t * buf, int buf_size)
+{
+    int		count = 0;
+
+    if (*str == '\0') {
+	return (-1);
+    }
+    while (true) {
+	int		digits;
+	const char *	scan;
+
+	for (scan = str; S_hex_value(*scan) >= 0; scan++) {
+	}
+	digits = (int)(scan - str);
+	if (digits == 0 || (digits > 2 && (digits % 2) != 0)) {
+	    return (-1);
+	}
+	if (digits <= 2) {
+	    if (count == buf_size) {
+		return (-1);
+	    }
+	    buf[count++] = (digits == 1)
+		? S_hex_value(str[0])
+		: (S_hex_value(str[0]) << 4) | S_hex_value(str[1]);
+	}
+	else {
+	    for (; str < scan; str += 2) {
+		if (count == buf_size) {
+		    return (-1);
+		}
+		buf[count++] = (S_hex_value(str[0]) << 4) | S_hex_value(str[1]);
+	    }
+	}
+	if (*scan == '\0') {
+	    break;
+	}
+	if (*scan != ':' && *scan != '-' && *scan != '.') {
+	    return (-1);
+	}
+	str = scan + 1;
+    }
+    return (count);
+}
+
+static bool
+S_string_is_token(const char * str, int max_len)
+{
+    int		len = 0;
+
+    for (; *str != '\0'; str++, len++) {
+	if (isspace((unsigned char)*str) || iscntrl((unsigned char)*str)) {
+	    return (false);
+	}
+    }
+    return (len > 0 && len <= max_len);
+}
+
+static bool
+S_string_is_printable(const char * str, int max_len)
+{
+    int		len = 0;
+
+    for (; *str != '\0'; str++, len++) {
+	if (iscntrl((unsigned char)*str)) {
+	    return (false);
+	}
+    }
+    return (len > 0 && len <= max_len);
+}
+
+static bool
+S_uint32_parse(const char * str, uint32_t * ret_val)
+{
+    char *		end;
+    unsigned long long	val;
+
+    if (*str == '\0' || *str == '-' || isspace((unsigned char)*str)) {
+	return (false);
+    }
+    errno = 0;
+    val = strtoull(str, &end, 0);
+    if (errno != 0 || *end != '\0' || val > UINT32_MAX) {
+	return (false);
+    }
+    *ret_val = (uint32_t)val;
+    return (true);
+}
+
+/*
+ * Function: BulkRecordSetField
+ * Purpose:
+ *   Validate a field value and store it in the record.  Identifiers are
+ *   decoded in place, which is safe because the decoded form is shorter.
+ */
+static bool
+BulkRecordSetField(BulkKind kind, BulkRecordRef record, BulkField field,
+		   char * value, char * err, int err_len)
+{
+    int		len;
+    uint32_t	val;
+
+    switch (field) {
+    case kBulkFieldName:
+	if (kind == kBulkKindReservations) {
+	    if (S_string_is_token(value, BOOTPTAB_NAME_MAX) == false
+		|| value[0] == '#' || value[0] == '%') {
+		snprintf(err, err_len, "invalid name '%.40s'", value);
+		return (false);
+	    }
+	}
+	else if (*value != '\0'
+		 && S_string_is_printable(value, LEASES_VALUE_MAX) == false) {
+	    snprintf(err, err_len, "invalid name '%.40s'", value);
+	    return (false);
+	}
+	record->name = (*value != '\0') ? value : NULL;
+	break;
+    case kBulkFieldHType:
+	if (S_uint32_parse(value, &val) == false || val == 0 || val > 255) {
+	    snprintf(err, err_len, "invalid htype '%.40s'", value);
+	    return (false);
+	}
+	record->htype = (uint8_t)val;
+	break;
+    case kBulkFieldHWAddress: {
+	const char *	comma = strchr(value, ',');
+	const char *	hw = value;
+
+	/* also accept the "<htype>,<hw>" form used in dhcpd_leases */
+	if (comma != NULL) {
+	    char	type_str[4];
+
+	    if ((comma - value) >= sizeof(type_str)) {
+		snprintf(err, err_len, "invalid hw_address '%.40s'", value);
+		return (false);
+	    }
+	    bcopy(value, type_str, comma - value);
+	    type_str[comma - value] = '\0';
+	    val = (uint32_t)strtoul(type_str, NULL, 16);
+	    if (val == 0 || val > 255) {
+		snprintf(err, err_len, "invalid hw_address '%.40s'", value);
+		return (false);
+	    }
+	    record->htype = (uint8_t)val;
+	    hw = comma + 1;
+	}
+	len = S_hex_bytes_parse(hw, record->haddr, sizeof(record->haddr));
+	if (len <= 0) {
+	    snprintf(err, err_len, "invalid hw_address '%.40s'", value);
+	    return (false);
+	}
+	record->hlen = (uint8_t)len;
+	break;
+    }
+    case kBulkFieldIPAddress:
+	if (inet_pton(AF_INET, value, &record->ip) != 1
+	    || record->ip.s_addr == 0
+	    || record->ip.s_addr == INADDR_BROADCAST) {
+	    snprintf(err, err_len, "invalid ip_address '%.40s'", value);
+	    return (false);
+	}
+	break;
+    case kBulkFieldBootfile:
+	if (*value == '\0') {
+	    record->bootfile = NULL;
+	    break;
+	}
+	if (S_string_is_token(value, BOOTPTAB_BOOTFILE_MAX) == false) {
+	    snprintf(err, err_len, "invalid bootfile '%.40s'", value);
+	    return (false);
+	}
+	record->bootfile = value;
+	break;
+    case kBulkFieldIdentifier: {
+	char *		comma;
+
+	if (*value == '\0') {
+	    break;
+	}
+	comma = strchr(value, ',');
+	if (comma == NULL || comma == value || (comma - value) > 2
+	    || S_hex_value(value[0]) < 0
+	    || (comma - value == 2 && S_hex_value(value[1]) < 0)) {
+	    snprintf(err, err_len, "invalid identifier '%.40s'", value);
+	    return (false);
+	}
+	val = (uint32_t)strtoul(value, NULL, 16);
+	/* the decoded bytes never overtake the digits being read */
+	len = S_hex_bytes_parse(comma + 1, (uint8_t *)value, IDENTIFIER_MAX);
+	if (len <= 0) {
+	    snprintf(err, err_len, "invalid identifier");
+	    return (false);
+	}
+	record->id_type = (uint8_t)val;
+	record->id = (const uint8_t *)value;
+	record->id_len = (uint16_t)len;
+	break;
+    }
+    case kBulkFieldLeaseExpiry:
+	if (strcmp(value, "infinite") == 0) {
+	    record->expiry = LEASE_INFINITE;
+	}
+	else if (S_uint32_parse(value, &record->expiry) == false) {
+	    snprintf(err, err_len, "invalid lease_expiry '%.40s'", value);
+	    return (false);
+	}
+	break;
+    default:
+	break;
+    }
+    return (true);
+}
+
+/*
+ * Function: BulkRecordFinish
+ * Purpose:
+ *   Check that the record is complete and fits in bootpd's files.
+ */
+static bool
+BulkRecordFinish(BulkKind kind, BulkRecordRef record, uint32_t present,
+		 char * err, int err_len)
+{
+    int		i;
+    bool	zero = true;
+
+    if ((present & (1 << kBulkFieldIPAddress)) == 0) {
+	snprintf(err, err_len, "missing ip_address");
+	return (false);
+    }
+    if ((present & (1 << kBulkFieldHWAddress)) == 0) {
+	snprintf(err, err_len, "missing hw_address");
+	return (false);
+    }
+    for (i = 0; i < record->hlen; i++) {
+	if (record->haddr[i] != 0) {
+	    zero = false;
+	    break;
+	}
+    }
+    if (zero) {
+	snprintf(err, err_len, "hw_address is all zeroes");
+	return (false);
+    }
+    if (record->htype == 1 && record->hlen != 6) {
+	snprintf(err, err_len, "ethernet hw_address must be 6 bytes");
+	return (false);
+    }
+    if (kind == kBulkKindReservations) {
+	int	line_len;
+
+	if (record->name == NULL) {
+	    snprintf(err, err_len, "missing name");
+	    return (false);
+	}
+	if (record->hlen * 3 - 1 > BOOTPTAB_FIELD_MAX) {
+	    snprintf(err, err_len, "hw_address too long for bootptab");
+	    return (false);
+	}
+	/* name htype hw ip bootfile */
+	line_len = (int)strlen(record->name) + 1 + 3 + 1
+	    + record->hlen * 3 - 1 + 1 + INET_ADDRSTRLEN - 1;
+	if (record->bootfile != NULL) {
+	    line_len += 1 + (int)strlen(record->bootfile);
+	}
+	if (line_len > BOOTPTAB_LINE_MAX) {
+	    snprintf(err, err_len, "entry too long for bootptab");
+	    return (false);
+	}
+    }
+    else {
+	if ((present & (1 << kBulkFieldLeaseExpiry)) == 0) {
+	    snprintf(err, err_len, "missing lease_expiry");
+	    return (false);
+	}
+	if (record->id == NULL) {
+	    /* no client identifier: dhcpd uses the hardware address */
+	    record->id = record->haddr;
+	    record->id_len = record->hlen;
+	    record->id_type = record->htype;
+	}
+	if (3 * (record->id_len + 1) > LEASES_VALUE_MAX) {
+	    snprintf(err, err_len, "identifier too long");
+	    return (false);
+	}
+    }
+    return (true);
+}
+
+/**
+ ** Line parsing
+ **/
+
+/*
+ * Function: S_csv_split
+ * Purpose:
+ *   Split a CSV line into fields in place, handling RFC 4180 quoting.
+ *   Returns the number of fields, or -1 if the line is malformed.
+ */
+static int
+S_csv_split(char * line, char * * fields, int max_fields)
+{
+    int		count = 0;
+    char *	scan = line;
+
+    while (true) {
+	char *	out = scan;
+
+	if (count == max_fields) {
+	    return (-1);
+	}
+	fields[count++] = out;
+	if (*scan == '"') {
+	    scan++;
+	    while (true) {
+		if (*scan == '\0') {
+		    return (-1);
+		}
+		if (*scan == '"') {
+		    if (scan[1] != '"') {
+			scan++;
+			break;
+		    }
+		    scan++;
+		}
+		*out++ = *scan++;
+	    }
+	    if (*scan != ',' && *scan != '\0') {
+		return (-1);
+	    }
+	}
+	else {
+	    while (*scan != ',' && *scan != '\0') {
+		if (*scan == '"') {
+		    return (-1);
+		}
+		*out++ = *scan++;
+	    }
+	}
+	if (*scan == '\0') {
+	    *out = '\0';
+	    break;
+	}
+	*out = '\0';
+	scan++;
+    }
+    return (count);
+}
+
+static char *
+S_json_skip_space(char * scan)
+{
+    while (*scan == ' ' || *scan == '\t') {
+	scan++;
+    }
+    return (scan);
+}
+
+/*
+ * Function: S_json_string_parse
+ * Purpose:
+ *   Decode the JSON string starting after the opening quote in place.
+ *   Returns a pointer past the closing quote, or NULL if malformed.
+ *   Only \u escapes for ASCII characters are accepted.
+ */
+static char *
+S_json_string_parse(char * scan)
+{
+    char *	out = scan;
+
+    while (*scan != '"') {
+	if (*scan == '\0' || (unsigned char)*scan < 0x20) {
+	    return (NULL);
+	}
+	if (*scan != '\\') {
+	    *out++ = *scan++;
+	    continue;
+	}
+	scan++;
+	switch (*scan) {
+	case '"':
+	case '\\':
+	case '/':
+	    *out++ = *scan;
+	    break;
+	case 'b':
+	    *out++ = '\b';
+	    break;
+	case 'f':
+	    *out++ = '\f';
+	    break;
+	case 'n':
+	    *out++ = '\n';
+	    break;
+	case 'r':
+	    *out++ = '\r';
+	    break;
+	case 't':
+	    *out++ = '\t';
+	    break;
+	case 'u': {
+	    int		i;
+	    int		val = 0;
+
+	    for (i = 1; i <= 4; i++) {
+		if (S_hex_value(scan[i]) < 0) {
+		    return (NULL);
+		}
+		val = (val << 4) | S_hex_value(scan[i]);
+	    }
+	    if (val == 0 || val > 0x7f) {
+		return (NULL);
+	    }
+	    *out++ = (char)val;
+	    scan += 4;
+	    break;
+	}
+	default:
+	    return (NULL);
+	}
+	scan++;
+    }
+    *out = '\0';
+    return (scan + 1);
+}
+
+/*
+ * Function: S_json_object_parse
+ * Purpose:
+ *   Parse a flat JSON object in place into key/value pairs.  Values are
+ *   strings, numbers, true, or false; null values are skipped.
+ *   Returns the number of pairs, or -1 if the line is malformed.
+ */
+static int
+S_json_object_parse(char * line, char * * keys, char * * values, int max)
+{
+    int		count = 0;
+    char *	scan;
+
+    scan = S_json_skip_space(line);
+    if (*scan++ != '{') {
+	return (-1);
+    }
+    scan = S_json_skip_space(scan);
+    if (*scan == '}') {
+	scan++;
+	goto done;
+    }
+    while (true) {
+	char *	key;
+	char *	value;
+
+	if (*scan++ != '"') {
+	    return (-1);
+	}
+	key = scan;
+	scan = S_json_string_parse(scan);
+	if (scan == NULL) {
+	    return (-1);
+	}
+	scan = S_json_skip_space(scan);
+	if (*scan++ != ':') {
+	    return (-1);
+	}
+	scan = S_json_skip_space(scan);
+	if (*scan == '"') {
+	    value = scan + 1;
+	    scan = S_json_string_parse(value);
+	    if (scan == NULL) {
+		return (-1);
+	    }
+	}
+	else {
+	    value = scan;
+	    while (*scan != ',' && *scan != '}' && *scan != ' '
+		   && *scan != '\t' && *scan != '\0') {
+		if (*scan == '{' || *scan == '[' || *scan == '"') {
+		    return (-1);
+		}
+		scan++;
+	    }
+	    if (scan == value) {
+		return (-1);
+	    }
+	    /* move the token back over the ':' to make room for the nul */
+	    if (*scan == ',' || *scan == '}') {
+		bcopy(value, value - 1, scan - value);
+		value--;
+		scan[-1] = '\0';
+	    }
+	    else {
+		*scan++ = '\0';
+	    }
+	    if (strcmp(value, "null") == 0) {
+		value = NULL;
+	    }
+	    else if (strcmp(value, "true") == 0
+		     || strcmp(value, "false") == 0) {
+		/* keep as is */
+	    }
+	    else if (*value != '-' && isdigit((unsigned char)*value) == 0) {
+		return (-1);
+	    }
+	}
+	if (value != NULL) {
+	    if (count == max) {
+		return (-1);
+	    }
+	    keys[count] = key;
+	    values[count] = value;
+	    count++;
+	}
+	scan = S_json_skip_space(scan);
+	if (*scan == ',') {
+	    scan = S_json_skip_space(scan + 1);
+	    continue;
+	}
+	if (*scan != '}') {
+	    return (-1);
+	}
+	scan++;
+	break;
+    }
+
+ done:
+    scan = S_json_skip_space(scan);
+    if (*scan != '\0') {
+	return (-1);
+    }
+    return (count);
+}
+
+/*
+ * Function: BulkChunkParseLine
+ * Purpose:
+ *   Parse one non-empty line into a record, recording an error if it
+ *   isn't valid.
+ */
+static void
+BulkChunkParseLine(BulkChunkRef chunk, char * line, uint32_t line_number)
+{
+    char		err[BULK_ERROR_LEN];
+    int			count;
+    char *		fields[BULK_FIELDS_MAX];
+    int			i;
+    char *		keys[BULK_FIELDS_MAX];
+    uint32_t		present = 0;
+    BulkRecordRef	record = chunk->records + chunk->count;
+
+    bzero(record, sizeof(*record));
+    record->htype = 1;
+    record->line = line_number;
+    if (chunk->format == kBulkFormatCSV) {
+	count = S_csv_split(line, fields, BULK_FIELDS_MAX);
+	if (count < 0) {
+	    BulkChunkAddError(chunk, line_number, "malformed CSV line");
+	    return;
+	}
+	if (count != chunk->column_count) {
+	    snprintf(err, sizeof(err), "%d fields, header has %d",
+		     count, chunk->column_count);
+	    BulkChunkAddError(chunk, line_number, err);
+	    return;
+	}
+	for (i = 0; i < count; i++) {
+	    BulkField	field = chunk->columns[i];
+
+	    if (field == kBulkFieldNone || *fields[i] == '\0') {
+		continue;
+	    }
+	    if (BulkRecordSetField(chunk->kind, record, field, fields[i],
+				   err, sizeof(err)) == false) {
+		BulkChunkAddError(chunk, line_number, err);
+		return;
+	    }
+	    present |= (1 << field);
+	}
+    }
+    else {
+	count = S_json_object_parse(line, keys, fields, BULK_FIELDS_MAX);
+	if (count < 0) {
+	    BulkChunkAddError(chunk, line_number, "malformed JSON object");
+	    return;
+	}
+	for (i = 0; i < count; i++) {
+	    BulkField	field = S_field_lookup(keys[i]);
+
+	    if (field == kBulkFieldNone) {
+		continue;
+	    }
+	    if (BulkRecordSetField(chunk->kind, record, field, fields[i],
+				   err, sizeof(err)) == false) {
+		BulkChunkAddError(chunk, line_number, err);
+		return;
+	    }
+	    present |= (1 << field);
+	}
+    }
+    if (BulkRecordFinish(chunk->kind, record, present,
+			 err, sizeof(err)) == false) {
+	BulkChunkAddError(chunk, line_number, err);
+	return;
+    }
+    chunk->count++;
+    return;
+}
+
+static void *
+BulkChunkParse(void * arg)
+{
+    BulkChunkRef	chunk = (BulkChunkRef)arg;
+    uint32_t		lines = 0;
+    char *		scan;
+
+    /* one record per line at most */
+    for (scan = chunk->start; scan < chunk->end; scan++) {
+	scan = memchr(scan, '\n', chunk->end - scan);
+	if (scan == NULL) {
+	    break;
+	}
+	lines++;
+    }
+    chunk->records = malloc((lines + 1) * sizeof(*chunk->records));
+    if (chunk->records == NULL) {
+	BulkChunkAddError(chunk, 0, "out of memory");
+	return (NULL);
+    }
+    lines = 0;
+    for (scan = chunk->start; scan < chunk->end; ) {
+	char *	eol;
+	char *	line = scan;
+
+	eol = memchr(scan, '\n', chunk->end - scan);
+	if (eol == NULL) {
+	    eol = chunk->end;
+	}
+	scan = eol + 1;
+	if (eol > line && eol[-1] == '\r') {
+	    eol--;
+	}
+	*eol = '\0';
+	lines++;
+	if (*line == '\0') {
+	    continue;
+	}
+	BulkChunkParseLine(chunk, line, lines);
+    }
+    return (NULL);
+}
+
+/**
+ ** Duplicate detection
+ **/
+
+static uint32_t
+S_hash_bytes(uint32_t hash, const void * data, size_t len)
+{
+    const uint8_t *	scan = (const uint8_t *)data;
+
+    for (; len > 0; len--, scan++) {
+	hash ^= *scan;
+	hash *= 16777619U;
+    }
+    return (hash);
+}
+
+typedef enum {
+    kBulkKeyIP,
+    kBulkKeyHW,
+    kBulkKeyID,
+} BulkKey;
+
+static uint32_t
+S_record_hash(BulkRecordRef record, BulkKey key)
+{
+    uint32_t	hash = 2166136261U;
+
+    switch (key) {
+    case kBulkKeyIP:
+	return (S_hash_bytes(hash, &record->ip, sizeof(record->ip)));
+    case kBulkKeyHW:
+	hash = S_hash_bytes(hash, &record->htype, 1);
+	return (S_hash_bytes(hash, record->haddr, record->hlen));
+    case kBulkKeyID:
+    default:
+	hash = S_hash_bytes(hash, &record->id_type, 1);
+	return (S_hash_bytes(hash, record->id, record->id_len));
+    }
+}
+
+static bool
+S_record_key_equal(BulkRecordRef a, BulkRecordRef b, BulkKey key)
+{
+    switch (key) {
+    case kBulkKeyIP:
+	return (a->ip.s_addr == b->ip.s_addr);
+    case kBulkKeyHW:
+	return (a->htype == b->htype && a->hlen == b->hlen
+		&& bcmp(a->haddr, b->haddr, a->hlen) == 0);
+    case kBulkKeyID:
+    default:
+	return (a->id_type == b->id_type && a->id_len == b->id_len
+		&& bcmp(a->id, b->id, a->id_len) == 0);
+    }
+}
+
+/*
+ * Function: S_find_duplicates
+ * Purpose:
+ *   Report records whose key is the same as an earlier record's.
+ */
+static uint32_t
+S_find_duplicates(BulkChunkRef chunks, int chunk_count, uint64_t total,
+		  BulkKey key, uint32_t * shown)
+{
+    int			c;
+    uint32_t		duplicates = 0;
+    uint64_t		mask;
+    uint64_t		size = 16;
+    BulkRecordRef *	table;
+
+    while (size < total * 2) {
+	size <<= 1;
+    }
+    mask = size - 1;
+    table = calloc(size, sizeof(*table));
+    if (table == NULL) {
+	fprintf(stderr, "out of memory\n");
+	return (1);
+    }
+    for (c = 0; c < chunk_count; c++) {
+	BulkChunkRef	chunk = chunks + c;
+	uint32_t	i;
+
+	for (i = 0; i < chunk->count; i++) {
+	    BulkRecordRef	record = chunk->records + i;
+	    uint64_t		slot;
+
+	    slot = S_record_hash(record, key) & mask;
+	    while (table[slot] != NULL) {
+		if (S_record_key_equal(table[slot], record, key)) {
+		    break;
+		}
+		slot = (slot + 1) & mask;
+	    }
+	    if (table[slot] == NULL) {
+		table[slot] = record;
+		continue;
+	    }
+	    duplicates++;
+	    if (*shown < BULK_ERRORS_SHOWN) {
+		(*shown)++;
+		fprintf(stderr, "line %u: duplicate %s\n",
+			chunk->first_line + record->line - 1,
+			(key == kBulkKeyIP) ? "ip_address"
+			: (key == kBulkKeyHW) ? "hw_address" : "identifier");
+	    }
+	}
+    }
+    free(table);
+    return (duplicates);
+}
+
+/**
+ ** Output
+ **/
+
+static bool
+BulkChunkReserve(BulkChunkRef chunk, size_t len)
+{
+    if (chunk->out_len + len > chunk->out_size) {
+	char *	out;
+	size_t	size = chunk->out_size * 2;
+
+	if (size < chunk->out_len + len) {
+	    size = chunk->out_len + len;
+	}
+	out = realloc(chunk->out, size);
+	if (out == NULL) {
+	    return (false);
+	}
+	chunk->out = out;
+	chunk->out_size = size;
+    }
+    return (true);
+}
+
+static int
+S_hex_bytes_format(char * buf, const uint8_t * bytes, int len, bool pad)
+{
+    static const char	hex[] = "0123456789abcdef";
+    int			i;
+    char *		out = buf;
+
+    for (i = 0; i < len; i++) {
+	if (i > 0) {
+	    *out++ = ':';
+	}
+	if (pad || bytes[i] >= 0x10) {
+	    *out++ = hex[bytes[i] >> 4];
+	}
+	*out++ = hex[bytes[i] & 0xf];
+    }
+    *out = '\0';
+    return ((int)(out - buf));
+}
+
+/*
+ * Function: BulkChunkFormat
+ * Purpose:
+ *   Format the chunk's records as bootptab lines or dhcpd_leases
+ *   entries, in the same form bootpd writes them.
+ */
+static void *
+BulkChunkFormat(void * arg)
+{
+    BulkChunkRef	chunk = (BulkChunkRef)arg;
+    char		hw[HWADDR_MAX * 3 + 1];
+    char		id[(IDENTIFIER_MAX + 1) * 3 + 1];
+    uint32_t		i;
+    char		ip[INET_ADDRSTRLEN];
+
+    chunk->out_size = (size_t)chunk->count * 64 + 1024;
+    chunk->out = malloc(chunk->out_size);
+    if (chunk->out == NULL) {
+	return (NULL);
+    }
+    for (i = 0; i < chunk->count; i++) {
+	BulkRecordRef	record = chunk->records + i;
+	size_t		len;
+
+	inet_ntop(AF_INET, &record->ip, ip, sizeof(ip));
+	if (chunk->kind == kBulkKindReservations) {
+	    S_hex_bytes_format(hw, record->haddr, record->hlen, true);
+	    len = strlen(record->name) + strlen(hw) + strlen(ip) + 16
+		+ ((record->bootfile != NULL) ? strlen(record->bootfile) : 0);
+	    if (BulkChunkReserve(chunk, len) == false) {
+		goto nomem;
+	    }
+	    chunk->out_len += snprintf(chunk->out + chunk->out_len, len,
+				       "%s\t%d\t%s\t%s%s%s\n",
+				       record->name, record->htype, hw, ip,
+				       (record->bootfile != NULL) ? "\t" : "",
+				       (record->bootfile != NULL)
+				       ? record->bootfile : "");
+	}
+	else {
+	    int		n;
+
+	    /* same encoding as identifierToString() */
+	    n = snprintf(hw, sizeof(hw), "%x,", record->htype);
+	    S_hex_bytes_format(hw + n, record->haddr, record->hlen, false);
+	    n = snprintf(id, sizeof(id), "%x,", record->id_type);
+	    S_hex_bytes_format(id + n, record->id, record->id_len, false);
+	    len = strlen(hw) + strlen(id) + strlen(ip) + 96
+		+ ((record->name != NULL) ? strlen(record->name) : 0);
+	    if (BulkChunkReserve(chunk, len) == false) {
+		goto nomem;
+	    }
+	    n = 0;
+	    if (record->name != NULL) {
+		n = snprintf(chunk->out + chunk->out_len, len,
+			     "{\n\tname=%s\n", record->name);
+	    }
+	    else {
+		n = snprintf(chunk->out + chunk->out_len, len, "{\n");
+	    }
+	    n += snprintf(chunk->out + chunk->out_len + n, len - n,
+			  "\tip_address=%s\n\thw_address=%s\n"
+			  "\tidentifier=%s\n\tlease=0x%x\n}\n",
+			  ip, hw, id, record->expiry);
+	    chunk->out_len += n;
+	}
+    }
+    return (NULL);
+
+ nomem:
+    free(chunk->out);
+    chunk->out = NULL;
+    return (NULL);
+}
+
+/*
+ * Function: S_write_atomically
+ * Purpose:
+ *   Write the header and the chunks' output to a temporary file in the
+ *   same directory as path, then rename it over path.
+ */
+static bool
+S_write_atomically(const char * path, const char * header,
+		   BulkChunkRef chunks, int chunk_count)
+{
+    int		c;
+    int		fd;
+    char	tmp_path[PATH_MAX];
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.import.XXXXXX", path);
+    fd = mkstemp(tmp_path);
+    if (fd < 0) {
+	fprintf(stderr, "can't create %s, %s\n", tmp_path, strerror(errno));
+	return (false);
+    }
+    if (header != NULL
+	&& write(fd, header, strlen(header)) != (ssize_t)strlen(header)) {
+	goto failed;
+    }
+    for (c = 0; c < chunk_count; c++) {
+	const char *	out = chunks[c].out;
+	size_t		left = chunks[c].out_len;
+
+	while (left > 0) {
+	    ssize_t	n;
+
+	    n = write(fd, out, left);
+	    if (n < 0) {
+		if (errno == EINTR) {
+		    continue;
+		}
+		goto failed;
+	    }
+	    out += n;
+	    left -= n;
+	}
+    }
+    if (fchmod(fd, 0644) != 0 || fsync(fd) != 0) {
+	goto failed;
+    }
+    if (close(fd) != 0) {
+	fd = -1;
+	goto failed;
+    }
+    fd = -1;
+    if (rename(tmp_path, path) != 0) {
+	goto failed;
+    }
+    return (true);
+
+ failed:
+    fprintf(stderr, "can't write %s, %s\n", path, strerror(errno));
+    if (fd >= 0) {
+	close(fd);
+    }
+    unlink(tmp_path);
+    return (false);
+}
+
+/**
+ ** Import
+ **/
+
+/*
+ * Function: S_map_file
+ * Purpose:
+ *   Map the file privately so that it can be parsed in place, or read
+ *   it into memory if it isn't a regular file (e.g. standard input).
+ */
+static char *
+S_map_file(const char * path, size_t * ret_size, bool * ret_mapped)
+{
+    char *	buf = NULL;
+    int		fd;
+    size_t	size = 0;
+    struct stat	sb;
+
+    *ret_mapped = false;
+    if (strcmp(path, "-") == 0) {
+	fd = STDIN_FILENO;
+    }
+    else {
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+	    fprintf(stderr, "can't open %s, %s\n", path, strerror(errno));
+	    return (NULL);
+	}
+    }
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+	size = (size_t)sb.st_size;
+	buf = mmap(NULL, size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		   fd, 0);
+	if (buf == MAP_FAILED) {
+	    buf = NULL;
+	}
+	else if ((size % getpagesize()) == 0) {
+	    /* no room for a terminating nul in the last page */
+	    munmap(buf, size + 1);
+	    buf = NULL;
+	}
+	else {
+	    buf[size] = '\0';
+	    *ret_mapped = true;
+	}
+    }
+    if (buf == NULL) {
+	size_t	buf_size = 1024 * 1024;
+	ssize_t	n;
+
+	size = 0;
+	buf = malloc(buf_size);
+	while (buf != NULL) {
+	    if (size + 1 == buf_size) {
+		char *	new_buf;
+
+		buf_size *= 2;
+		new_buf = realloc(buf, buf_size);
+		if (new_buf == NULL) {
+		    free(buf);
+		    buf = NULL;
+		    break;
+		}
+		buf = new_buf;
+	    }
+	    n = read(fd, buf + size, buf_size - size - 1);
+	    if (n < 0 && errno == EINTR) {
+		continue;
+	    }
+	    if (n <= 0) {
+		if (n < 0) {
+		    fprintf(stderr, "can't read %s, %s\n", path,
+			    strerror(errno));
+		    free(buf);
+		    buf = NULL;
+		}
+		break;
+	    }
+	    size += n;
+	}
+	if (buf != NULL) {
+	    buf[size] = '\0';
+	}
+    }
+    if (fd != STDIN_FILENO) {
+	close(fd);
+    }
+    *ret_size = size;
+    return (buf);
+}
+
+/*
+ * Function: S_csv_header_parse
+ * Purpose:
+ *   Map the CSV header's columns to fields.  Returns the number of
+ *   columns, or -1 if a required column is missing.
+ */
+static int
+S_csv_header_parse(BulkKind kind, char * line, BulkField * columns)
+{
+    int		count;
+    char *	fields[BULK_FIELDS_MAX];
+    int		i;
+    uint32_t	present = 0;
+    uint32_t	required;
+
+    count = S_csv_split(line, fields, BULK_FIELDS_MAX);
+    if (count < 0) {
+	fprintf(stderr, "line 1: malformed CSV header\n");
+	return (-1);
+    }
+    for (i = 0; i < count; i++) {
+	columns[i] = S_field_lookup(fields[i]);
+	if (columns[i] == kBulkFieldNone) {
+	    fprintf(stderr, "ignoring column '%s'\n", fields[i]);
+	}
+	else {
+	    present |= (1 << columns[i]);
+	}
+    }
+    required = (1 << kBulkFieldHWAddress) | (1 << kBulkFieldIPAddress);
+    if (kind == kBulkKindReservations) {
+	required |= (1 << kBulkFieldName);
+    }
+    else {
+	required |= (1 << kBulkFieldLeaseExpiry);
+    }
+    for (i = 0; i < BULK_FIELD_COUNT; i++) {
+	if ((required & (1 << i)) != 0 && (present & (1 << i)) == 0) {
+	    fprintf(stderr, "CSV header is missing '%s'\n", S_field_names[i]);
+	    return (-1);
+	}
+    }
+    return (count);
+}
+
+static int
+bulk_import(BulkKind kind, BulkFormat format, const char * input,
+	    const char * output, int threads, bool validate_only,
+	    BulkStats * stats)
+{
+    char *		buf;
+    BulkChunk		chunks[BULK_THREADS_MAX];
+    int			c;
+    BulkField		columns[BULK_FIELDS_MAX];
+    int			column_count = 0;
+    uint32_t		duplicates;
+    uint64_t		errors = 0;
+    uint32_t		first_line = 1;
+    bool		mapped;
+    int			ret = 1;
+    char *		scan;
+    uint32_t		shown = 0;
+    size_t		size;
+    struct timeval	start;
+    pthread_t		tids[BULK_THREADS_MAX];
+    uint64_t		total = 0;
+
+    bzero(stats, sizeof(*stats));
+    gettimeofday(&start, NULL);
+    buf = S_map_file(input, &size, &mapped);
+    if (buf == NULL) {
+	return (1);
+    }
+    stats->bytes = size;
+    scan = buf;
+    if (format == kBulkFormatCSV) {
+	char *	eol;
+
+	eol = strchr(scan, '\n');
+	if (eol != NULL) {
+	    *eol = '\0';
+	    if (eol > scan && eol[-1] == '\r') {
+		eol[-1] = '\0';
+	    }
+	}
+	column_count = S_csv_header_parse(kind, scan, columns);
+	if (column_count < 0) {
+	    goto done;
+	}
+	scan = (eol != NULL) ? (eol + 1) : (buf + size);
+	first_line = 2;
+    }
+
+    /* split the rest into one chunk per thread at line boundaries */
+    if (threads > BULK_THREADS_MAX) {
+	threads = BULK_THREADS_MAX;
+    }
+    if ((size_t)(buf + size - scan) < (size_t)threads * 65536) {
+	threads = (int)((buf + size - scan) / 65536) + 1;
+    }
+    bzero(chunks, sizeof(chunks[0]) * threads);
+    for (c = 0; c < threads; c++) {
+	BulkChunkRef	chunk = chunks + c;
+	char *		end;
+
+	chunk->kind = kind;
+	chunk->format = format;
+	chunk->columns = columns;
+	chunk->column_count = column_count;
+	chunk->start = scan;
+	if (c == threads - 1) {
+	    end = buf + size;
+	}
+	else {
+	    end = scan + (buf + size - scan) / (threads - c);
+	    end = memchr(end, '\n', buf + size - end);
+	    end = (end == NULL) ? (buf + size) : (end + 1);
+	}
+	chunk->end = end;
+	scan = end;
+    }
+    for (c = 0; c < threads; c++) {
+	pthread_create(tids + c, NULL, BulkChunkParse, chunks + c);
+    }
+    for (c = 0; c < threads; c++) {
+	char *	p;
+
+	pthread_join(tids[c], NULL);
+	chunks[c].first_line = first_line;
+	for (p = chunks[c].start; p < chunks[c].end; p++) {
+	    p = memchr(p, '\n', chunks[c].end - p);
+	    if (p == NULL) {
+		break;
+	    }
+	    first_line++;
+	}
+    }
+    stats->threads = threads;
+    for (c = 0; c < threads; c++) {
+	uint32_t	i;
+
+	for (i = 0; i < chunks[c].error_count; i++) {
+	    if (i < BULK_CHUNK_ERRORS_MAX && shown < BULK_ERRORS_SHOWN) {
+		shown++;
+		fprintf(stderr, "line %u: %s\n",
+			chunks[c].first_line + chunks[c].errors[i].line - 1,
+			chunks[c].errors[i].message);
+	    }
+	}
+	errors += chunks[c].error_count;
+	total += chunks[c].count;
+    }
+    duplicates = S_find_duplicates(chunks, threads, total, kBulkKeyIP, &shown);
+    duplicates += S_find_duplicates(chunks, threads, total,
+				    (kind == kBulkKindReservations)
+				    ? kBulkKeyHW : kBulkKeyID, &shown);
+    errors += duplicates;
+    stats->parse_secs = S_elapsed(&start);
+    stats->records = total;
+    if (errors != 0) {
+	fprintf(stderr, "%llu invalid record%s, nothing imported\n",
+		(unsigned long long)errors, (errors == 1) ? "" : "s");
+	goto done;
+    }
+    if (validate_only) {
+	ret = 0;
+	goto done;
+    }
+    for (c = 0; c < threads; c++) {
+	pthread_create(tids + c, NULL, BulkChunkFormat, chunks + c);
+    }
+    for (c = 0; c < threads; c++) {
+	pthread_join(tids[c], NULL);
+	if (chunks[c].out == NULL) {
+	    fprintf(stderr, "out of memory\n");
+	    goto done;
+	}
+    }
+    if (S_write_atomically(output,
+			   (kind == kBulkKindReservations)
+			   ? "# written by bootpdutil import\n%%\n" : NULL,
+			   chunks, threads)) {
+	ret = 0;
+    }
+
+ done:
+    for (c = 0; c < stats->threads; c++) {
+	free(chunks[c].records);
+	free(chunks[c].out);
+    }
+    if (mapped) {
+	munmap(buf, size + 1);
+    }
+    else {
+	free(buf);
+    }
+    stats->total_secs = S_elapsed(&start);
+    return (ret);
+}
+
+/**
+ ** Export
+ **/
+
+static void
+S_csv_put(FILE * out, const char * str, bool last)
+{
+    if (str == NULL) {
+	str = "";
+    }
+    if (strpbrk(str, ",\"\r\n") != NULL) {
+	fputc('"', out);
+	for (; *str != '\0'; str++) {
+	    if (*str == '"') {
+		fputc('"', out);
+	    }
+	    fputc(*str, out);
+	}
+	fputc('"', out);
+    }
+    else {
+	fputs(str, out);
+    }
+    fputc(last ? '\n' : ',', out);
+    return;
+}
+
+static void
+S_json_put(FILE * out, const char * key, const char * str, bool is_string,
+	   bool first)
+{
+    fprintf(out, "%s\"%s\":", first ? "{" : ",", key);
+    if (is_string == false) {
+	fputs(str, out);
+	return;
+    }
+    fputc('"', out);
+    for (; *str != '\0'; str++) {
+	unsigned char	c = (unsigned char)*str;
+
+	if (c == '"' || c == '\\') {
+	    fputc('\\', out);
+	    fputc(c, out);
+	}
+	else if (c < 0x20) {
+	    fprintf(out, "\\u%04x", c);
+	}
+	else {
+	    fputc(c, out);
+	}
+    }
+    fputc('"', out);
+    return;
+}
+
+/*
+ * Function: S_export_record
+ * Purpose:
+ *   Write one record; values are NULL when the record doesn't have
+ *   the corresponding field.
+ */
+static void
+S_export_record(FILE * out, BulkKind kind, BulkFormat format,
+		const char * values[BULK_FIELD_COUNT])
+{
+    static const BulkField	lease_fields[] = {
+	kBulkFieldIPAddress, kBulkFieldHType, kBulkFieldHWAddress,
+	kBulkFieldIdentifier, kBulkFieldLeaseExpiry, kBulkFieldName,
+    };
+    static const BulkField	reservation_fields[] = {
+	kBulkFieldName, kBulkFieldHType, kBulkFieldHWAddress,
+	kBulkFieldIPAddress, kBulkFieldBootfile,
+    };
+    const BulkField *		fields;
+    int				field_count;
+    bool			first = true;
+    int				i;
+
+    if (kind == kBulkKindReservations) {
+	fields = reservation_fields;
+	field_count = sizeof(reservation_fields) / sizeof(reservation_fields[0]);
+    }
+    else {
+	fields = lease_fields;
+	field_count = sizeof(lease_fields) / sizeof(lease_fields[0]);
+    }
+    for (i = 0; i < field_count; i++) {
+	BulkField	field = fields[i];
+	const char *	value = values[field];
+
+	if (format == kBulkFormatCSV) {
+	    S_csv_put(out, value, i == (field_count - 1));
+	    continue;
+	}
+	if (value == NULL) {
+	    continue;
+	}
+	S_json_put(out, S_field_names[field], value,
+		   field != kBulkFieldHType
+		   && (field != kBulkFieldLeaseExpiry
+		       || strcmp(value, "infinite") == 0),
+		   first);
+	first = false;
+    }
+    if (format == kBulkFormatJSONL) {
+	fputs(first ? "{}\n" : "}\n", out);
+    }
+    return;
+}
+
+static void
+S_export_header(FILE * out, BulkKind kind, BulkFormat format)
+{
+    if (format != kBulkFormatCSV) {
+	return;
+    }
+    if (kind == kBulkKindReservations) {
+	fputs("name,htype,hw_address,ip_address,bootfile\n", out);
+    }
+    else {
+	fputs("ip_address,htype,hw_address,identifier,lease_expiry,name\n",
+	      out);
+    }
+    return;
+}
+
+/*
+ * Function: S_export_hw
+ * Purpose:
+ *   Normalize a hardware address to colon-separated two-digit hex.
+ */
+static bool
+S_export_hw(const char * str, char * buf)
+{
+    uint8_t	haddr[HWADDR_MAX];
+    int		len;
+
+    len = S_hex_bytes_parse(str, haddr, sizeof(haddr));
+    if (len <= 0) {
+	return (false);
+    }
+    S_hex_bytes_format(buf, haddr, len, true);
+    return (true);
+}
+
+/*
+ * Function: S_export_reservations
+ * Purpose:
+ *   Export the entries of a bootptab file.  Like bootp_readtab(),
+ *   everything up to the line starting with '%' is skipped, as are
+ *   comments and lines starting with a space.
+ */
+static uint64_t
+S_export_reservations(char * buf, FILE * out, BulkFormat format)
+{
+    uint64_t	count = 0;
+    char *	scan = buf;
+    bool	skip_to_percent = true;
+
+    while (*scan != '\0') {
+	char		htype[4];
+	char		hw[HWADDR_MAX * 3 + 1];
+	char *		eol;
+	char *		fields[5];
+	int		field_count = 0;
+	char *		line = scan;
+	char *		p;
+	const char *	values[BULK_FIELD_COUNT];
+
+	eol = strchr(scan, '\n');
+	if (eol != NULL) {
+	    *eol = '\0';
+	    scan = eol + 1;
+	}
+	else {
+	    scan += strlen(scan);
+	}
+	if (line[0] == '#' || line[0] == '\0' || line[0] == ' ') {
+	    continue;
+	}
+	if (skip_to_percent) {
+	    if (line[0] == '%') {
+		skip_to_percent = false;
+	    }
+	    continue;
+	}
+	for (p = line; field_count < 5; ) {
+	    p += strspn(p, " \t\r");
+	    if (*p == '\0') {
+		break;
+	    }
+	    fields[field_count++] = p;
+	    p += strcspn(p, " \t\r");
+	    if (*p != '\0') {
+		*p++ = '\0';
+	    }
+	}
+	if (field_count < 4 || S_export_hw(fields[2], hw) == false) {
+	    fprintf(stderr, "skipping malformed entry '%.40s'\n", line);
+	    continue;
+	}
+	bzero(values, sizeof(values));
+	snprintf(htype, sizeof(htype), "%d", atoi(fields[1]) & 0xff);
+	values[kBulkFieldName] = fields[0];
+	values[kBulkFieldHType] = htype;
+	values[kBulkFieldHWAddress] = hw;
+	values[kBulkFieldIPAddress] = fields[3];
+	if (field_count > 4) {
+	    values[kBulkFieldBootfile] = fields[4];
+	}
+	S_export_record(out, kBulkKindReservations, format, values);
+	count++;
+    }
+    return (count);
+}
+
+/*
+ * Function: S_export_leases
+ * Purpose:
+ *   Export the entries of a dhcpd_leases file, in the format written by
+ *   PLCache_write().
+ */
+static uint64_t
+S_export_leases(char * buf, FILE * out, BulkFormat format)
+{
+    uint64_t	count = 0;
+    char	expiry[16];
+    char	htype[4];
+    char	hw[HWADDR_MAX * 3 + 1];
+    bool	in_entry = false;
+    char *	scan = buf;
+    const char *values[BULK_FIELD_COUNT];
+
+    bzero(values, sizeof(values));
+    while (*scan != '\0') {
+	char *	eol;
+	char *	line = scan;
+	char *	sep;
+
+	eol = strchr(scan, '\n');
+	if (eol != NULL) {
+	    *eol = '\0';
+	    scan = eol + 1;
+	}
+	else {
+	    scan += strlen(scan);
+	}
+	if (strcmp(line, "{") == 0) {
+	    in_entry = true;
+	    bzero(values, sizeof(values));
+	    continue;
+	}
+	if (strcmp(line, "}") == 0) {
+	    if (in_entry && values[kBulkFieldIPAddress] != NULL
+		&& values[kBulkFieldHWAddress] != NULL) {
+		S_export_record(out, kBulkKindLeases, format, values);
+		count++;
+	    }
+	    in_entry = false;
+	    continue;
+	}
+	if (in_entry == false) {
+	    continue;
+	}
+	line += strspn(line, " \t");
+	sep = strchr(line, '=');
+	if (sep == NULL) {
+	    continue;
+	}
+	*sep++ = '\0';
+	if (strcmp(line, "name") == 0) {
+	    values[kBulkFieldName] = sep;
+	}
+	else if (strcmp(line, "ip_address") == 0) {
+	    values[kBulkFieldIPAddress] = sep;
+	}
+	else if (strcmp(line, "identifier") == 0) {
+	    values[kBulkFieldIdentifier] = sep;
+	}
+	else if (strcmp(line, "hw_address") == 0) {
+	    char *	comma = strchr(sep, ',');
+
+	    if (comma != NULL && S_export_hw(comma + 1, hw)) {
+		snprintf(htype, sizeof(htype), "%d",
+			 (int)(strtoul(sep, NULL, 16) & 0xff));
+		values[kBulkFieldHType] = htype;
+		values[kBulkFieldHWAddress] = hw;
+	    }
+	}
+	else if (strcmp(line, "lease") == 0) {
+	    uint32_t	val;
+
+	    if (S_uint32_parse(sep, &val)) {
+		if (val == LEASE_INFINITE) {
+		    strlcpy(expiry, "infinite", sizeof(expiry));
+		}
+		else {
+		    snprintf(expiry, sizeof(expiry), "%u", val);
+		}
+		values[kBulkFieldLeaseExpiry] = expiry;
+	    }
+	}
+    }
+    return (count);
+}
+
+static int
+bulk_export(BulkKind kind, BulkFormat format, const char * input,
+	    FILE * out, BulkStats * stats)
+{
+    char *		buf;
+    bool		mapped;
+    size_t		size;
+    struct timeval	start;
+
+    bzero(stats, sizeof(*stats));
+    gettimeofday(&start, NULL);
+    buf = S_map_file(input, &size, &mapped);
+    if (buf == NULL) {
+	return (1);
+    }
+    S_export_header(out, kind, format);
+    if (kind == kBulkKindReservations) {
+	stats->records = S_export_reservations(buf, out, format);
+    }
+    else {
+	stats->records = S_export_leases(buf, out, format);
+    }
+    fflush(out);
+    stats->bytes = size;
+    stats->threads = 1;
+    stats->total_secs = S_elapsed(&start);
+    if (mapped) {
+	munmap(buf, size + 1);
+    }
+    else {
+	free(buf);
+    }
+    return (ferror(out) ? 1 : 0);
+}
+
+static void
+S_stats_print(const char * what, const BulkStats * stats)
+{
+    double	secs = (stats->total_secs > 0) ? stats->total_secs : 1e-6;
+
+    fprintf(stderr, "%s %llu records (%.1f MB) in %.3f secs:"
+	    " %.0f records/sec",
+	    what, (unsigned long long)stats->records,
+	    stats->bytes / (1024.0 * 1024.0), stats->total_secs,
+	    stats->records / secs);
+    if (stats->parse_secs != 0) {
+	fprintf(stderr, ", validated in %.3f secs using %d thread%s",
+		stats->parse_secs, stats->threads,
+		(stats->threads == 1) ? "" : "s");
+    }
+    fprintf(stderr, "\n");
+    return;
+}
+
+/**
+ ** Command line
+ **/
+
+static void
+bulk_usage(const char * progname)
+{
+    fprintf(stderr,
+	    "usage: %s import reservations|leases [ -f csv|jsonl ]"
+	    " [ -j <threads> ] [ -n ] [ -o <file> ] <input> | -\n"
+	    "       %s export reservations|leases [ -f csv|jsonl ]"
+	    " [ -i <file> ]\n"
+	    "reservations: name, htype, hw_address, ip_address, bootfile\n"
+	    "leases: ip_address, htype, hw_address, identifier,"
+	    " lease_expiry, name\n",
+	    progname, progname);
+    exit(1);
+}
+
+static int
+S_default_threads(void)
+{
+    long	ncpu;
+
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1) {
+	ncpu = 1;
+    }
+    else if (ncpu > BULK_THREADS_MAX) {
+	ncpu = BULK_THREADS_MAX;
+    }
+    return ((int)ncpu);
+}
+
+int
+bulk_main(const char * progname, int argc, char * argv[])
+{
+    int			ch;
+    bool		export;
+    BulkFormat		format = kBulkFormatCSV;
+    bool		format_set = false;
+    const char *	input = NULL;
+    BulkKind		kind;
+    const char *	output = NULL;
+    int			ret;
+    BulkStats		stats;
+    int			threads = S_default_threads();
+    bool		validate_only = false;
+
+    if (argc < 2) {
+	bulk_usage(progname);
+    }
+    export = (strcmp(argv[0], "export") == 0);
+    if (strcmp(argv[1], "reservations") == 0) {
+	kind = kBulkKindReservations;
+    }
+    else if (strcmp(argv[1], "leases") == 0) {
+	kind = kBulkKindLeases;
+    }
+    else {
+	bulk_usage(progname);
+    }
+    argc--;
+    argv++;
+    optind = 1;
+    while ((ch = getopt(argc, argv, "f:i:j:no:")) != -1) {
+	switch (ch) {
+	case 'f':
+	    if (strcmp(optarg, "csv") == 0) {
+		format = kBulkFormatCSV;
+	    }
+	    else if (strcmp(optarg, "jsonl") == 0) {
+		format = kBulkFormatJSONL;
+	    }
+	    else {
+		bulk_usage(progname);
+	    }
+	    format_set = true;
+	    break;
+	case 'i':
+	    input = optarg;
+	    break;
+	case 'j':
+	    threads = atoi(optarg);
+	    if (threads < 1) {
+		bulk_usage(progname);
+	    }
+	    break;
+	case 'n':
+	    validate_only = true;
+	    break;
+	case 'o':
+	    output = optarg;
+	    break;
+	default:
+	    bulk_usage(progname);
+	}
+    }
+    argc -= optind;
+    argv += optind;
+    if (export) {
+	if (argc != 0 || output != NULL || validate_only) {
+	    bulk_usage(progname);
+	}
+	if (input == NULL) {
+	    input = (kind == kBulkKindReservations)
+		? BOOTPTAB_PATH : DHCP_LEASES_PATH;
+	}
+	setvbuf(stdout, NULL, _IOFBF, 1024 * 1024);
+	ret = bulk_export(kind, format, input, stdout, &stats);
+	if (ret == 0) {
+	    S_stats_print("exported", &stats);
+	}
+	return (ret);
+    }
+    if (argc != 1 || input != NULL) {
+	bulk_usage(progname);
+    }
+    input = argv[0];
+    if (format_set == false) {
+	const char *	dot = strrchr(input, '.');
+
+	if (dot != NULL
+	    && (strcmp(dot, ".jsonl") == 0 || strcmp(dot, ".json") == 0)) {
+	    format = kBulkFormatJSONL;
+	}
+    }
+    if (output == NULL) {
+	output = (kind == kBulkKindReservations)
+	    ? BOOTPTAB_PATH : DHCP_LEASES_PATH;
+    }
+    ret = bulk_import(kind, format, input, output, threads, validate_only,
+		      &stats);
+    if (ret == 0) {
+	S_stats_print(validate_only ? "validated" : "imported", &stats);
+	if (validate_only == false) {
+	    fprintf(stderr, "send SIGHUP to bootpd to load %s\n", output);
+	}
+    }
+    return (ret);
+}
+
+#ifdef TEST_BULK
+
+/*
+ * Function: bench_generate
+ * Purpose:
+ *   Write count synthetic reservations or leases in the given format.
+ */
+static void
+bench_generate(const char * path, BulkKind kind, BulkFormat format,
+	       uint32_t count)
+{
+    FILE *	f;
+    uint32_t	i;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+	perror(path);
+	exit(1);
+    }
+    setvbuf(f, NULL, _IOFBF, 1024 * 1024);
+    if (format == kBulkFormatCSV) {
+	fputs((kind == kBulkKindReservations)
+	      ? "name,htype,hw_address,ip_address,bootfile\n"
+	      : "ip_address,htype,hw_address,identifier,lease_expiry,name\n",
+	      f);
+    }
+    for (i = 0; i < count; i++) {
+	char		hw[32];
+	char		ip[INET_ADDRSTRLEN];
+	struct in_addr	ip_addr;
+
+	snprintf(hw, sizeof(hw), "02:00:%02x:%02x:%02x:%02x",
+		 i >> 24, (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+	ip_addr.s_addr = htonl(0x0a000001 + i);
+	inet_ntop(AF_INET, &ip_addr, ip, sizeof(ip));
+	if (kind == kBulkKindReservations) {
+	    if (format == kBulkFormatCSV) {
+		fprintf(f, "host%u,1,%s,%s,\n", i, hw, ip);
+	    }
+	    else {
+		fprintf(f, "{\"name\":\"host%u\",\"htype\":1,"
+			"\"hw_address\":\"%s\",\"ip_address\":\"%s\"}\n",
+			i, hw, ip);
+	    }
+	}
+	else {
+	    if (format == kBulkFormatCSV) {
+		fprintf(f, "%s,1,%s,,%u,host%u\n", ip, hw, 1800000000 + i, i);
+	    }
+	    else {
+		fprintf(f, "{\"ip_address\":\"%s\",\"hw_address\":\"%s\","
+			"\"lease_expiry\":%u,\"name\":\"host%u\"}\n",
+			ip, hw, 1800000000 + i, i);
+	    }
+	}
+    }
+    fclose(f);
+    return;
+}
+
+static bool
+bench_files_equal(const char * path1, const char * path2)
+{
+    char	cmd[2 * PATH_MAX + 32];
+
+    snprintf(cmd, sizeof(cmd), "cmp -s '%s' '%s'", path1, path2);
+    return (system(cmd) == 0);
+}
+
+static void
+bench(uint32_t count, int threads)
+{
+    char	dir[] = "/tmp/bulk-bench.XXXXXX";
+    int		f;
+    int		k;
+    char	path_export[PATH_MAX];
+    char	path_in[PATH_MAX];
+    char	path_out[PATH_MAX];
+    char	path_out2[PATH_MAX];
+
+    if (mkdtemp(dir) == NULL) {
+	perror("mkdtemp");
+	exit(1);
+    }
+    for (k = 0; k < 2; k++) {
+	BulkKind	kind = (k == 0) ? kBulkKindReservations : kBulkKindLeases;
+	const char *	kind_name = (k == 0) ? "reservations" : "leases";
+
+	for (f = 0; f < 2; f++) {
+	    BulkFormat		format = (f == 0)
+		? kBulkFormatCSV : kBulkFormatJSONL;
+	    const char *	format_name = (f == 0) ? "csv" : "jsonl";
+	    FILE *		out;
+	    BulkStats		stats;
+
+	    snprintf(path_in, sizeof(path_in), "%s/%s.%s", dir, kind_name,
+		     format_name);
+	    snprintf(path_out, sizeof(path_out), "%s/%s.out", dir, kind_name);
+	    snprintf(path_out2, sizeof(path_out2), "%s/%s.out2", dir,
+		     kind_name);
+	    snprintf(path_export, sizeof(path_export), "%s/%s.export.%s",
+		     dir, kind_name, format_name);
+	    bench_generate(path_in, kind, format, count);
+	    fprintf(stderr, "%s %s:\n", kind_name, format_name);
+	    if (bulk_import(kind, format, path_in, path_out, threads,
+			    false, &stats) != 0) {
+		exit(1);
+	    }
+	    S_stats_print("  imported", &stats);
+	    out = fopen(path_export, "w");
+	    setvbuf(out, NULL, _IOFBF, 1024 * 1024);
+	    if (bulk_export(kind, format, path_out, out, &stats) != 0) {
+		exit(1);
+	    }
+	    fclose(out);
+	    S_stats_print("  exported", &stats);
+	    if (bulk_import(kind, format, path_export, path_out2, threads,
+			    false, &stats) != 0) {
+		exit(1);
+	    }
+	    fprintf(stderr, "  round trip %s\n",
+		   bench_files_equal(path_out, path_out2)
+		   ? "identical" : "DIFFERS");
+	    unlink(path_in);
+	    unlink(path_out);
+	    unlink(path_out2);
+	    unlink(path_export);
+	}
+    }
+    rmdir(dir);
+    return;
+}
+
+int
+main(int argc, char * argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "-bench") == 0) {
+	uint32_t	count = 1000000;
+	int		threads = S_default_threads();
+
+	if (argc > 2) {
+	    count = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+	    threads = atoi(argv[3]);
+	}
+	if (count == 0 || count > (1 << 24) - 1 || threads < 1) {
+	    fprintf(stderr, "usage: bulk -bench [ <count> [ <threads> ] ]\n");
+	    exit(1);
+	}
+	bench(count, threads);
+	exit(0);
+    }
+    if (argc < 3) {
+	bulk_usage(argv[0]);
+    }
+    exit(bulk_main(argv[0], argc - 1, argv + 1));
+}
+
+#endif /* TEST_BULK */
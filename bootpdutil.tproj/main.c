@@ -6,6 +6,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
 #include <CoreFoundation/CFDictionary.h>
 #include <CoreFoundation/CFNumber.h>
 #include <CoreFoundation/CFString.h>
@@ -16,6 +22,9 @@
 #include "subnets.h"
 #include "bootpd-plist.h"
 #include "cfutil.h"
+#include "DHCPLeaseHistory.h"
+#include "bulk.h"
+#include "bootpdcontrol.h"
 
 #define NIDIR_CONFIG_DHCP		"/config/dhcp"
 #define NIDIR_CONFIG_NETBOOTSERVER	"/config/NetBootServer"
@@ -645,8 +654,227 @@ config_dhcp_subnets_list_create(void * domain)
 
 }
 
+/**
+ ** Lease history queries
+ **/
+
+static void
+history_usage(const char * progname)
+{
+    fprintf(stderr,
+	    "usage: %s history [ -d <dir> ] ip <ip> [ <time> ]\n"
+	    "       %s history [ -d <dir> ] ip <ip> <start> <end>\n"
+	    "       %s history [ -d <dir> ] client <id> [ <start> <end> ]\n"
+	    "       %s history [ -d <dir> ] prune <days>\n"
+	    "<time> is seconds since the epoch or \"YYYY-MM-DD HH:MM:SS\"\n",
+	    progname, progname, progname, progname);
+    exit(1);
+}
+
+static bool
+history_time_parse(const char * str, uint32_t * ret_time)
+{
+    char *	end;
+    struct tm	tm;
+    time_t	t;
+    unsigned long val;
+
+    val = strtoul(str, &end, 10);
+    if (end != str && *end == '\0' && val <= UINT32_MAX) {
+	*ret_time = (uint32_t)val;
+	return (true);
+    }
+    bzero(&tm, sizeof(tm));
+    end = strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
+    if (end == NULL || *end != '\0') {
+	bzero(&tm, sizeof(tm));
+	end = strptime(str, "%Y-%m-%d", &tm);
+	if (end == NULL || *end != '\0') {
+	    return (false);
+	}
+    }
+    tm.tm_isdst = -1;
+    t = mktime(&tm);
+    if (t < 0) {
+	return (false);
+    }
+    *ret_time = (uint32_t)t;
+    return (true);
+}
+
+static void
+history_time_print(uint32_t t)
+{
+    char	buf[32];
+    time_t	tt = t;
+
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&tt));
+    printf("%s", buf);
+    return;
+}
+
+static void
+history_record_print(const DHCPLeaseHistoryRecord * record)
+{
+    history_time_print(record->time);
+    printf(" %-8s %-15s %s%s",
+	   DHCPLeaseHistoryEventGetName(record->event),
+	   inet_ntoa(record->ip), record->client_id,
+	   (record->flags & kDHCPLeaseHistoryRecordFlagClientIDTruncated)
+	   ? "..." : "");
+    if (record->event == kDHCPLeaseHistoryEventBind
+	|| record->event == kDHCPLeaseHistoryEventRenew) {
+	printf(" expires ");
+	if (record->expiry == DHCP_LEASE_HISTORY_INFINITE) {
+	    printf("never");
+	}
+	else {
+	    history_time_print(record->expiry);
+	}
+    }
+    printf("\n");
+    return;
+}
+
+static bool
+history_record_print_func(void * arg, const DHCPLeaseHistoryRecord * record)
+{
+    history_record_print(record);
+    return (true);
+}
+
+static int
+history_main(const char * progname, int argc, char * argv[])
+{
+    const char *	dir = DHCP_LEASE_HISTORY_DIR;
+    uint32_t		end = UINT32_MAX;
+    DHCPLeaseHistoryRef	history;
+    struct in_addr	ip;
+    int			ret = 0;
+    uint32_t		start = 0;
+
+    if (argc >= 2 && strcmp(argv[0], "-d") == 0) {
+	dir = argv[1];
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc < 2) {
+	history_usage(progname);
+    }
+    history = DHCPLeaseHistoryOpen(dir, strcmp(argv[0], "prune") == 0, 0);
+    if (history == NULL) {
+	fprintf(stderr, "can't open lease history %s\n", dir);
+	exit(1);
+    }
+    if (strcmp(argv[0], "ip") == 0) {
+	if (inet_aton(argv[1], &ip) == 0) {
+	    fprintf(stderr, "invalid IP address %s\n", argv[1]);
+	    exit(1);
+	}
+	if (argc == 2 || argc == 3) {
+	    DHCPLeaseHistoryRecord	record;
+	    uint32_t			when = (uint32_t)time(NULL);
+
+	    /* who had the address at the given time */
+	    if (argc == 3 && history_time_parse(argv[2], &when) == false) {
+		history_usage(progname);
+	    }
+	    if (DHCPLeaseHistoryLookupIP(history, ip, when, &record)) {
+		history_record_print(&record);
+	    }
+	    else {
+		printf("%s was not leased\n", inet_ntoa(ip));
+		ret = 1;
+	    }
+	}
+	else if (argc == 4) {
+	    if (history_time_parse(argv[2], &start) == false
+		|| history_time_parse(argv[3], &end) == false) {
+		history_usage(progname);
+	    }
+	    DHCPLeaseHistoryQueryIP(history, ip, start, end,
+				    history_record_print_func, NULL);
+	}
+	else {
+	    history_usage(progname);
+	}
+    }
+    else if (strcmp(argv[0], "client") == 0) {
+	if (argc == 4) {
+	    if (history_time_parse(argv[2], &start) == false
+		|| history_time_parse(argv[3], &end) == false) {
+		history_usage(progname);
+	    }
+	}
+	else if (argc != 2) {
+	    history_usage(progname);
+	}
+	DHCPLeaseHistoryQueryClient(history, argv[1], start, end,
+				    history_record_print_func, NULL);
+    }
+    else if (strcmp(argv[0], "prune") == 0) {
+	int		count;
+	uint32_t	days = (uint32_t)strtoul(argv[1], NULL, 0);
+	uint32_t	now = (uint32_t)time(NULL);
+
+	if (argc != 2 || days == 0) {
+	    history_usage(progname);
+	}
+	count = DHCPLeaseHistoryRemoveBefore(history,
+					     now - days
+					     * DHCP_LEASE_HISTORY_SEGMENT_SECS);
+	printf("removed %d segment%s\n", count, (count == 1) ? "" : "s");
+    }
+    else {
+	history_usage(progname);
+    }
+    DHCPLeaseHistoryClose(&history);
+    return (ret);
+}
+
+/**
+ ** Control socket queries
+ **/
+
+static int
+control_query(const char * query)
+{
+    char		buf[1024];
+    int			fd;
+    ssize_t		n;
+    char		request[BOOTPD_CONTROL_QUERY_MAX];
+    struct sockaddr_un	sun;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+	fprintf(stderr, "socket failed, %s\n", strerror(errno));
+	return (1);
+    }
+    bzero(&sun, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strlcpy(sun.sun_path, BOOTPD_CONTROL_SOCKET_PATH, sizeof(sun.sun_path));
+    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+	fprintf(stderr, "connect %s failed, %s"
+		" (is control_socket enabled in bootpd.plist?)\n",
+		BOOTPD_CONTROL_SOCKET_PATH, strerror(errno));
+	close(fd);
+	return (1);
+    }
+    n = snprintf(request, sizeof(request), "%s\n", query);
+    if (write(fd, request, n) != n) {
+	fprintf(stderr, "write failed, %s\n", strerror(errno));
+	close(fd);
+	return (1);
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+	fwrite(buf, n, 1, stdout);
+    }
+    close(fd);
+    return (0);
+}
+
 int
-main()
+main(int argc, char * argv[])
 {
     CFMutableDictionaryRef	config;
     CFDataRef			data;
@@ -655,6 +883,22 @@ main()
     void *			ni_local;
     ni_status			status;
 
+    if (argc > 1 && strcmp(argv[1], "history") == 0) {
+	exit(history_main(argv[0], argc - 2, argv + 2));
+    }
+    if (argc > 1
+	&& (strcmp(argv[1], "import") == 0 || strcmp(argv[1], "export") == 0)) {
+	exit(bulk_main(argv[0], argc - 1, argv + 1));
+    }
+    if (argc > 1 && strcmp(argv[1], "memory") == 0) {
+	exit(control_query(BOOTPD_CONTROL_QUERY_MEMORY));
+    }
+    if (argc > 1 && strcmp(argv[1], "shadow") == 0) {
+	exit(control_query(BOOTPD_CONTROL_QUERY_SHADOW));
+    }
+    if (argc > 1 && strcmp(argv[1], "http_boot") == 0) {
+	exit(control_query(BOOTPD_CONTROL_QUERY_HTTP_BOOT));
+    }
     status = ni_open(NULL, ".", &ni_local);
     if (status != NI_OK) {
 	fprintf(stderr, "ni_open . failed, %s\n", ni_error(status));
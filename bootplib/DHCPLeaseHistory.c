@@ -0,0 +1,1227 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * DHCPLeaseHistory.c
+ * - append-only history of DHCP lease events
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+/*
+ * The history is a directory of segments, each covering a fixed span
+ * of time. A segment is a data file holding a header followed by
+ * fixed-size records in append order:
+ *	<start>.lh
+ * Once the writer moves on to the next segment, the previous one is
+ * sealed by writing its index file:
+ *	<start>.lhi
+ * The index holds two arrays of (key, record index) entries sorted by
+ * key then record index, one keyed by IP address, the other by a hash
+ * of the client identifier. A query finds the run for its key with a
+ * binary search, so its cost depends on the number of matching
+ * events, not the size of the segment. The index for the (unsealed)
+ * current segment is built in memory when it is queried.
+ *
+ * Records are stored in host byte order; the files are not meant to
+ * be moved between machines.
+ *
+ * Client identifiers can be longer than the record's client_id field
+ * (e.g. DUID-based identifiers), so records are matched on a digest
+ * of the full identifier instead, and the client identifier index is
+ * keyed by the first 32 bits of the digest.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <CommonCrypto/CommonDigest.h>
+#include "DHCPLeaseHistory.h"
+#include "symbol_scope.h"
+
+#ifdef TEST_LEASE_HISTORY
+#define my_log(level, format, ...)					\
+    do {								\
+	fprintf(stderr, format "\n", ## __VA_ARGS__);			\
+    } while (0)
+#else
+#define my_log	syslog
+#endif
+
+#define SEGMENT_DATA_SUFFIX	".lh"
+#define SEGMENT_INDEX_SUFFIX	".lhi"
+
+#define SEGMENT_DATA_MAGIC	"DLHS"
+#define SEGMENT_INDEX_MAGIC	"DLHI"
+#define SEGMENT_VERSION		2
+
+/* records buffered by the writer before they are written out */
+#define WRITE_BUFFER_COUNT	256
+
+typedef struct {
+    char		magic[4];
+    uint32_t		version;
+    uint32_t		record_size;
+    uint32_t		start;
+} SegmentDataHeader;
+
+typedef struct {
+    char		magic[4];
+    uint32_t		version;
+    uint32_t		record_count;
+    uint32_t		reserved;
+} SegmentIndexHeader;
+
+typedef struct {
+    uint32_t		key;
+    uint32_t		index;
+} SegmentIndexEntry;
+
+typedef struct {
+    uint32_t				start;
+    bool				sealed;
+
+    /* data */
+    void *				data_map;
+    size_t				data_map_size;
+    const DHCPLeaseHistoryRecord *	records;
+    uint32_t				record_count;
+
+    /* index */
+    void *				index_map;
+    size_t				index_map_size;
+    SegmentIndexEntry *			index_buf;	/* built in memory */
+    const SegmentIndexEntry *		ip_index;
+    const SegmentIndexEntry *		client_index;
+} Segment, * SegmentRef;
+
+struct DHCPLeaseHistory {
+    char *			dir;
+    bool			writable;
+    uint32_t			segment_secs;
+    SegmentRef			segments;
+    int				segments_count;
+
+    /* writer state */
+    int				fd;		/* current segment */
+    DHCPLeaseHistoryRecord	buffer[WRITE_BUFFER_COUNT];
+    int				buffer_count;
+};
+
+PRIVATE_EXTERN const char *
+DHCPLeaseHistoryEventGetName(DHCPLeaseHistoryEvent event)
+{
+    static const char * names[] = {
+	"none",
+	"bind",
+	"renew",
+	"release",
+	"expire",
+	"decline",
+    };
+
+    if (event < sizeof(names) / sizeof(names[0])) {
+	return (names[event]);
+    }
+    return ("<unknown>");
+}
+
+/*
+ * Function: client_id_digest
+ * Purpose:
+ *   Compute the digest of the full client identifier: the leading
+ *   DHCP_LEASE_HISTORY_CLIENT_DIGEST_SIZE bytes of its SHA-256 hash.
+ */
+STATIC void
+client_id_digest(const char * client_id,
+		 uint8_t digest[DHCP_LEASE_HISTORY_CLIENT_DIGEST_SIZE])
+{
+    CC_SHA256_CTX	ctx;
+    uint8_t		hash[CC_SHA256_DIGEST_LENGTH];
+
+    CC_SHA256_Init(&ctx);
+    if (client_id != NULL) {
+	CC_SHA256_Update(&ctx, client_id, (CC_LONG)strlen(client_id));
+    }
+    CC_SHA256_Final(hash, &ctx);
+    memcpy(digest, hash, DHCP_LEASE_HISTORY_CLIENT_DIGEST_SIZE);
+    return;
+}
+
+/*
+ * Function: client_digest_key
+ * Purpose:
+ *   Return the client identifier index key for the digest.
+ */
+STATIC uint32_t
+client_digest_key(const uint8_t digest[DHCP_LEASE_HISTORY_CLIENT_DIGEST_SIZE])
+{
+    uint32_t	key;
+
+    memcpy(&key, digest, sizeof(key));
+    return (key);
+}
+
+STATIC void
+segment_path(DHCPLeaseHistoryRef history, uint32_t start,
+	     const char * suffix, char * path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/%010u%s", history->dir, start, suffix);
+    return;
+}
+
+STATIC void
+segment_unload(SegmentRef seg)
+{
+    if (seg->data_map != NULL) {
+	munmap(seg->data_map, seg->data_map_size);
+	seg->data_map = NULL;
+	seg->data_map_size = 0;
+    }
+    if (seg->index_map != NULL) {
+	munmap(seg->index_map, seg->index_map_size);
+	seg->index_map = NULL;
+	seg->index_map_size = 0;
+    }
+    if (seg->index_buf != NULL) {
+	free(seg->index_buf);
+	seg->index_buf = NULL;
+    }
+    seg->records = NULL;
+    seg->record_count = 0;
+    seg->ip_index = NULL;
+    seg->client_index = NULL;
+    return;
+}
+
+STATIC void *
+file_map(const char * path, size_t * ret_size)
+{
+    int		fd;
+    void *	map = NULL;
+    struct stat	sb;
+
+    *ret_size = 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+	return (NULL);
+    }
+    if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+	map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+	    map = NULL;
+	}
+	else {
+	    *ret_size = (size_t)sb.st_size;
+	}
+    }
+    close(fd);
+    return (map);
+}
+
+STATIC int
+index_entry_compare(const void * a, const void * b)
+{
+    const SegmentIndexEntry *	e1 = (const SegmentIndexEntry *)a;
+    const SegmentIndexEntry *	e2 = (const SegmentIndexEntry *)b;
+
+    if (e1->key != e2->key) {
+	return ((e1->key < e2->key) ? -1 : 1);
+    }
+    if (e1->index != e2->index) {
+	return ((e1->index < e2->index) ? -1 : 1);
+    }
+    return (0);
+}
+
+/*
+ * Function: index_create
+ * Purpose:
+ *   Build the IP address and client identifier indexes for the records.
+ *   Returns a buffer holding 2 * count entries: the IP index followed by
+ *   the client identifier index.
+ */
+STATIC SegmentIndexEntry *
+index_create(const DHCPLeaseHistoryRecord * records, uint32_t count)
+{
+    SegmentIndexEntry *	client_index;
+    uint32_t		i;
+    SegmentIndexEntry *	ip_index;
+
+    ip_index = (SegmentIndexEntry *)malloc(sizeof(*ip_index) * 2 * count + 1);
+    if (ip_index == NULL) {
+	return (NULL);
+    }
+    client_index = ip_index + count;
+    for (i = 0; i < count; i++) {
+	ip_index[i].key = ntohl(records[i].ip.s_addr);
+	ip_index[i].index = i;
+	client_index[i].key = client_digest_key(records[i].client_digest);
+	client_index[i].index = i;
+    }
+    qsort(ip_index, count, sizeof(*ip_index), index_entry_compare);
+    qsort(client_index, count, sizeof(*client_index), index_entry_compare);
+    return (ip_index);
+}
+
+/*
+ * Function: segment_load
+ * Purpose:
+ *   Map the segment's records and its index. The current segment keeps
+ *   growing, so it is re-loaded every time.
+ */
+STATIC bool
+segment_load(DHCPLeaseHistoryRef history, SegmentRef seg)
+{
+    const SegmentDataHeader *	header;
+    char			path[PATH_MAX];
+
+    if (seg->records != NULL) {
+	if (seg->sealed) {
+	    return (true);
+	}
+	segment_unload(seg);
+    }
+    segment_path(history, seg->start, SEGMENT_DATA_SUFFIX, path, sizeof(path));
+    seg->data_map = file_map(path, &seg->data_map_size);
+    if (seg->data_map == NULL || seg->data_map_size < sizeof(*header)) {
+	goto failed;
+    }
+    header = (const SegmentDataHeader *)seg->data_map;
+    if (memcmp(header->magic, SEGMENT_DATA_MAGIC, sizeof(header->magic)) != 0
+	|| header->version != SEGMENT_VERSION
+	|| header->record_size != sizeof(DHCPLeaseHistoryRecord)) {
+	my_log(LOG_NOTICE, "DHCPLeaseHistory: %s: invalid header", path);
+	goto failed;
+    }
+    seg->records = (const DHCPLeaseHistoryRecord *)(header + 1);
+    seg->record_count = (uint32_t)((seg->data_map_size - sizeof(*header))
+				   / sizeof(DHCPLeaseHistoryRecord));
+    if (seg->sealed) {
+	const SegmentIndexHeader *	index_header;
+	size_t				needed;
+
+	segment_path(history, seg->start, SEGMENT_INDEX_SUFFIX,
+		     path, sizeof(path));
+	seg->index_map = file_map(path, &seg->index_map_size);
+	if (seg->index_map == NULL) {
+	    goto build;
+	}
+	index_header = (const SegmentIndexHeader *)seg->index_map;
+	needed = sizeof(*index_header)
+	    + 2 * sizeof(SegmentIndexEntry) * (size_t)seg->record_count;
+	if (seg->index_map_size != needed
+	    || memcmp(index_header->magic, SEGMENT_INDEX_MAGIC,
+		      sizeof(index_header->magic)) != 0
+	    || index_header->version != SEGMENT_VERSION
+	    || index_header->record_count != seg->record_count) {
+	    my_log(LOG_NOTICE, "DHCPLeaseHistory: %s: invalid index", path);
+	    munmap(seg->index_map, seg->index_map_size);
+	    seg->index_map = NULL;
+	    seg->index_map_size = 0;
+	    goto build;
+	}
+	seg->ip_index = (const SegmentIndexEntry *)(index_header + 1);
+	seg->client_index = seg->ip_index + seg->record_count;
+	return (true);
+    }
+
+ build:
+    seg->index_buf = index_create(seg->records, seg->record_count);
+    if (seg->index_buf == NULL) {
+	goto failed;
+    }
+    seg->ip_index = seg->index_buf;
+    seg->client_index = seg->index_buf + seg->record_count;
+    return (true);
+
+ failed:
+    segment_unload(seg);
+    return (false);
+}
+
+/*
+ * Function: index_lower_bound
+ * Purpose:
+ *   Return the position of the first entry with the given key,
+ *   or count if there is none.
+ */
+STATIC uint32_t
+index_lower_bound(const SegmentIndexEntry * index, uint32_t count,
+		  uint32_t key)
+{
+    uint32_t	high = count;
+    uint32_t	low = 0;
+
+    while (low < high) {
+	uint32_t	mid = low + (high - low) / 2;
+
+	if (index[mid].key < key) {
+	    low = mid + 1;
+	}
+	else {
+	    high = mid;
+	}
+    }
+    if (low < count && index[low].key == key) {
+	return (low);
+    }
+    return (count);
+}
+
+STATIC int
+segment_compare(const void * a, const void * b)
+{
+    const Segment *	s1 = (const Segment *)a;
+    const Segment *	s2 = (const Segment *)b;
+
+    if (s1->start == s2->start) {
+	return (0);
+    }
+    return ((s1->start < s2->start) ? -1 : 1);
+}
+
+STATIC bool
+history_scan(DHCPLeaseHistoryRef history)
+{
+    DIR *		dir;
+    struct dirent *	ent;
+    int			size = 0;
+
+    dir = opendir(history->dir);
+    if (dir == NULL) {
+	return (false);
+    }
+    while ((ent = readdir(dir)) != NULL) {
+	char *		end;
+	char		path[PATH_MAX];
+	SegmentRef	seg;
+	unsigned long	start;
+	struct stat	sb;
+
+	start = strtoul(ent->d_name, &end, 10);
+	if (end == ent->d_name || strcmp(end, SEGMENT_DATA_SUFFIX) != 0
+	    || start > UINT32_MAX) {
+	    continue;
+	}
+	if (history->segments_count == size) {
+	    size = (size == 0) ? 32 : size * 2;
+	    history->segments = reallocf(history->segments,
+					 sizeof(*history->segments) * size);
+	    if (history->segments == NULL) {
+		history->segments_count = 0;
+		closedir(dir);
+		return (false);
+	    }
+	}
+	seg = history->segments + history->segments_count++;
+	bzero(seg, sizeof(*seg));
+	seg->start = (uint32_t)start;
+	segment_path(history, seg->start, SEGMENT_INDEX_SUFFIX,
+		     path, sizeof(path));
+	seg->sealed = (stat(path, &sb) == 0);
+    }
+    closedir(dir);
+    if (history->segments_count > 1) {
+	qsort(history->segments, history->segments_count,
+	      sizeof(*history->segments), segment_compare);
+    }
+    return (true);
+}
+
+/*
+ * Function: segment_seal
+ * Purpose:
+ *   Write the index file for the segment.
+ */
+STATIC bool
+segment_seal(DHCPLeaseHistoryRef history, SegmentRef seg)
+{
+    SegmentIndexHeader	header;
+    SegmentIndexEntry *	index;
+    char		path[PATH_MAX];
+    bool		ret = false;
+    size_t		size;
+    char		tmp_path[PATH_MAX];
+    FILE *		file;
+
+    if (seg->sealed) {
+	return (true);
+    }
+    if (segment_load(history, seg) == false) {
+	return (false);
+    }
+    index = seg->index_buf;
+    segment_path(history, seg->start, SEGMENT_INDEX_SUFFIX,
+		 path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s-", path);
+    file = fopen(tmp_path, "w");
+    if (file == NULL) {
+	my_log(LOG_NOTICE, "DHCPLeaseHistory: fopen(%s) failed, %s",
+	       tmp_path, strerror(errno));
+	goto done;
+    }
+    bzero(&header, sizeof(header));
+    memcpy(header.magic, SEGMENT_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SEGMENT_VERSION;
+    header.record_count = seg->record_count;
+    size = 2 * (size_t)seg->record_count;
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+	|| (size != 0 && fwrite(index, sizeof(*index), size, file) != size)) {
+	my_log(LOG_NOTICE, "DHCPLeaseHistory: write %s failed, %s",
+	       tmp_path, strerror(errno));
+	fclose(file);
+	unlink(tmp_path);
+	goto done;
+    }
+    fclose(file);
+    if (rename(tmp_path, path) < 0) {
+	unlink(tmp_path);
+	goto done;
+    }
+    seg->sealed = true;
+    ret = true;
+
+ done:
+    segment_unload(seg);
+    return (ret);
+}
+
+STATIC bool
+history_flush(DHCPLeaseHistoryRef history)
+{
+    size_t	size;
+
+    if (history->buffer_count == 0) {
+	return (true);
+    }
+    size = sizeof(history->buffer[0]) * history->buffer_count;
+    history->buffer_count = 0;
+    if (history->fd < 0 || write(history->fd, history->buffer, size) != size) {
+	my_log(LOG_NOTICE, "DHCPLeaseHistory: write failed, %s",
+	       strerror(errno));
+	return (false);
+    }
+    return (true);
+}
+
+/*
+ * Function: history_open_current
+ * Purpose:
+ *   Open the last segment for appending, dropping any partial record
+ *   left behind by an interrupted write.  A segment written with a
+ *   different record layout is not appended to.
+ */
+STATIC bool
+history_open_current(DHCPLeaseHistoryRef history)
+{
+    off_t		extra;
+    SegmentDataHeader	header;
+    char		path[PATH_MAX];
+    SegmentRef		seg;
+    struct stat		sb;
+
+    seg = history->segments + history->segments_count - 1;
+    segment_path(history, seg->start, SEGMENT_DATA_SUFFIX, path, sizeof(path));
+    history->fd = open(path, O_RDWR | O_APPEND);
+    if (history->fd < 0) {
+	return (false);
+    }
+    if (fstat(history->fd, &sb) < 0
+	|| sb.st_size < sizeof(SegmentDataHeader)) {
+	goto failed;
+    }
+    if (pread(history->fd, &header, sizeof(header), 0) != sizeof(header)
+	|| memcmp(header.magic, SEGMENT_DATA_MAGIC, sizeof(header.magic)) != 0
+	|| header.version != SEGMENT_VERSION
+	|| header.record_size != sizeof(DHCPLeaseHistoryRecord)) {
+	my_log(LOG_NOTICE, "DHCPLeaseHistory: %s: invalid header", path);
+	goto failed;
+    }
+    extra = (sb.st_size - sizeof(SegmentDataHeader))
+	% sizeof(DHCPLeaseHistoryRecord);
+    if (extra != 0 && ftruncate(history->fd, sb.st_size - extra) < 0) {
+	goto failed;
+    }
+    return (true);
+
+ failed:
+    close(history->fd);
+    history->fd = -1;
+    return (false);
+}
+
+STATIC bool
+history_start_segment(DHCPLeaseHistoryRef history, uint32_t start)
+{
+    SegmentDataHeader	header;
+    char		path[PATH_MAX];
+    SegmentRef		seg;
+
+    if (history->fd >= 0) {
+	close(history->fd);
+	history->fd = -1;
+    }
+    if (history->segments_count > 0) {
+	(void)segment_seal(history,
+			   history->segments + history->segments_count - 1);
+    }
+    segment_path(history, start, SEGMENT_DATA_SUFFIX, path, sizeof(path));
+    history->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0644);
+    if (history->fd < 0) {
+	my_log(LOG_NOTICE, "DHCPLeaseHistory: open(%s) failed, %s",
+	       path, strerror(errno));
+	return (false);
+    }
+    bzero(&header, sizeof(header));
+    memcpy(header.magic, SEGMENT_DATA_MAGIC, sizeof(header.magic));
+    header.version = SEGMENT_VERSION;
+    header.record_size = sizeof(DHCPLeaseHistoryRecord);
+    header.start = start;
+    if (write(history->fd, &header, sizeof(header)) != sizeof(header)) {
+	my_log(LOG_NOTICE, "DHCPLeaseHistory: write(%s) failed, %s",
+	       path, strerror(errno));
+	close(history->fd);
+	history->fd = -1;
+	unlink(path);
+	return (false);
+    }
+    history->segments = reallocf(history->segments,
+				 sizeof(*history->segments)
+				 * (history->segments_count + 1));
+    if (history->segments == NULL) {
+	history->segments_count = 0;
+	return (false);
+    }
+    seg = history->segments + history->segments_count++;
+    bzero(seg, sizeof(*seg));
+    seg->start = start;
+    return (true);
+}
+
+PRIVATE_EXTERN DHCPLeaseHistoryRef
+DHCPLeaseHistoryOpen(const char * dir, bool writable, uint32_t segment_secs)
+{
+    DHCPLeaseHistoryRef	history;
+    int			i;
+
+    if (writable) {
+	(void)mkdir(dir, 0755);
+    }
+    history = (DHCPLeaseHistoryRef)malloc(sizeof(*history));
+    bzero(history, sizeof(*history));
+    history->dir = strdup(dir);
+    history->writable = writable;
+    history->segment_secs = (segment_secs != 0)
+	? segment_secs : DHCP_LEASE_HISTORY_SEGMENT_SECS;
+    history->fd = -1;
+    if (history_scan(history) == false) {
+	goto failed;
+    }
+    if (writable && history->segments_count > 0) {
+	/* seal everything but the last segment, which we append to */
+	for (i = 0; i < history->segments_count - 1; i++) {
+	    (void)segment_seal(history, history->segments + i);
+	}
+	if (history->segments[history->segments_count - 1].sealed == false) {
+	    (void)history_open_current(history);
+	}
+    }
+    return (history);
+
+ failed:
+    DHCPLeaseHistoryClose(&history);
+    return (NULL);
+}
+
+PRIVATE_EXTERN void
+DHCPLeaseHistoryClose(DHCPLeaseHistoryRef * history_p)
+{
+    DHCPLeaseHistoryRef	history = *history_p;
+    int			i;
+
+    if (history == NULL) {
+	return;
+    }
+    if (history->writable) {
+	(void)history_flush(history);
+    }
+    if (history->fd >= 0) {
+	close(history->fd);
+    }
+    for (i = 0; i < history->segments_count; i++) {
+	segment_unload(history->segments + i);
+    }
+    if (history->segments != NULL) {
+	free(history->segments);
+    }
+    free(history->dir);
+    free(history);
+    *history_p = NULL;
+    return;
+}
+
+/*
+ * Function: DHCPLeaseHistoryAppend
+ * Purpose:
+ *   Add a lease event. Events are buffered; call
+ *   DHCPLeaseHistorySynchronize() to write them out.
+ */
+PRIVATE_EXTERN bool
+DHCPLeaseHistoryAppend(DHCPLeaseHistoryRef history, uint32_t time,
+		       DHCPLeaseHistoryEvent event, struct in_addr ip,
+		       uint32_t expiry, const char * client_id)
+{
+    DHCPLeaseHistoryRecord *	record;
+
+    if (history->writable == false) {
+	return (false);
+    }
+    if (history->fd < 0
+	|| time >= (history->segments[history->segments_count - 1].start
+		    + history->segment_secs)) {
+	/* start a new segment */
+	if (history_flush(history) == false) {
+	    /* keep going with the new segment */
+	}
+	if (history_start_segment(history,
+				  time - (time % history->segment_secs))
+	    == false) {
+	    return (false);
+	}
+    }
+    if (history->buffer_count == WRITE_BUFFER_COUNT
+	&& history_flush(history) == false) {
+	return (false);
+    }
+    record = history->buffer + history->buffer_count++;
+    bzero(record, sizeof(*record));
+    record->time = time;
+    record->ip = ip;
+    record->expiry = expiry;
+    record->event = (uint8_t)event;
+    client_id_digest(client_id, record->client_digest);
+    if (client_id != NULL
+	&& strlcpy(record->client_id, client_id, sizeof(record->client_id))
+	>= sizeof(record->client_id)) {
+	record->flags |= kDHCPLeaseHistoryRecordFlagClientIDTruncated;
+    }
+    return (true);
+}
+
+PRIVATE_EXTERN bool
+DHCPLeaseHistorySynchronize(DHCPLeaseHistoryRef history)
+{
+    if (history->writable == false) {
+	return (true);
+    }
+    return (history_flush(history));
+}
+
+/*
+ * Function: DHCPLeaseHistoryRemoveBefore
+ * Purpose:
+ *   Remove the segments holding only events older than the given time.
+ *   Returns the number of segments removed.
+ */
+PRIVATE_EXTERN int
+DHCPLeaseHistoryRemoveBefore(DHCPLeaseHistoryRef history, uint32_t time)
+{
+    int		count = 0;
+    int		i;
+
+    /* never remove the last segment, it may be the current one */
+    for (i = 0; i < history->segments_count - 1; i++) {
+	char		path[PATH_MAX];
+	SegmentRef	seg = history->segments + i;
+
+	if (history->segments[i + 1].start > time) {
+	    break;
+	}
+	segment_unload(seg);
+	segment_path(history, seg->start, SEGMENT_INDEX_SUFFIX,
+		     path, sizeof(path));
+	unlink(path);
+	segment_path(history, seg->start, SEGMENT_DATA_SUFFIX,
+		     path, sizeof(path));
+	if (unlink(path) < 0 && errno != ENOENT) {
+	    my_log(LOG_NOTICE, "DHCPLeaseHistory: unlink(%s) failed, %s",
+		   path, strerror(errno));
+	    break;
+	}
+	count++;
+    }
+    if (count != 0) {
+	history->segments_count -= count;
+	memmove(history->segments, history->segments + count,
+		sizeof(*history->segments) * history->segments_count);
+    }
+    return (count);
+}
+
+/*
+ * Function: segment_end
+ * Purpose:
+ *   Return the time at which the segment ends: the start of the next
+ *   segment, or the end of its time span for the last one.
+ */
+STATIC uint64_t
+segment_end(DHCPLeaseHistoryRef history, int i)
+{
+    if (i + 1 < history->segments_count) {
+	return (history->segments[i + 1].start);
+    }
+    return ((uint64_t)history->segments[i].start + history->segment_secs);
+}
+
+typedef enum {
+    query_key_ip = 0,
+    query_key_client,
+} query_key_t;
+
+typedef struct {
+    query_key_t		type;
+    uint32_t		key;
+    struct in_addr	ip;
+    uint8_t		client_digest[DHCP_LEASE_HISTORY_CLIENT_DIGEST_SIZE];
+} query_t;
+
+STATIC bool
+query_record_matches(const query_t * query,
+		     const DHCPLeaseHistoryRecord * record)
+{
+    if (query->type == query_key_ip) {
+	return (record->ip.s_addr == query->ip.s_addr);
+    }
+    return (memcmp(record->client_digest, query->client_digest,
+		   sizeof(record->client_digest)) == 0);
+}
+
+STATIC const SegmentIndexEntry *
+segment_query_index(SegmentRef seg, const query_t * query)
+{
+    return ((query->type == query_key_ip) ? seg->ip_index : seg->client_index);
+}
+
+STATIC int
+history_query(DHCPLeaseHistoryRef history, const query_t * query,
+	      uint32_t start, uint32_t end,
+	      DHCPLeaseHistoryQueryFunc * func, void * arg)
+{
+    int		count = 0;
+    int		i;
+
+    if (history->writable) {
+	(void)history_flush(history);
+    }
+    for (i = 0; i < history->segments_count; i++) {
+	const SegmentIndexEntry *	index;
+	uint32_t			pos;
+	SegmentRef			seg = history->segments + i;
+
+	if (seg->start > end) {
+	    break;
+	}
+	if (segment_end(history, i) <= start) {
+	    continue;
+	}
+	if (segment_load(history, seg) == false) {
+	    continue;
+	}
+	index = segment_query_index(seg, query);
+	for (pos = index_lower_bound(index, seg->record_count, query->key);
+	     pos < seg->record_count && index[pos].key == query->key;
+	     pos++) {
+	    const DHCPLeaseHistoryRecord *	record;
+
+	    record = seg->records + index[pos].index;
+	    if (record->time < start || record->time > end
+		|| query_record_matches(query, record) == false) {
+		continue;
+	    }
+	    count++;
+	    if ((*func)(arg, record) == false) {
+		return (count);
+	    }
+	}
+    }
+    return (count);
+}
+
+/*
+ * Function: DHCPLeaseHistoryQueryIP
+ * Purpose:
+ *   Call func for each event for the IP address between start and end
+ *   inclusive. Returns the number of events.
+ */
+PRIVATE_EXTERN int
+DHCPLeaseHistoryQueryIP(DHCPLeaseHistoryRef history, struct in_addr ip,
+			uint32_t start, uint32_t end,
+			DHCPLeaseHistoryQueryFunc * func, void * arg)
+{
+    query_t	query;
+
+    bzero(&query, sizeof(query));
+    query.type = query_key_ip;
+    query.key = ntohl(ip.s_addr);
+    query.ip = ip;
+    return (history_query(history, &query, start, end, func, arg));
+}
+
+/*
+ * Function: DHCPLeaseHistoryQueryClient
+ * Purpose:
+ *   Call func for each event for the client identifier between start
+ *   and end inclusive. Returns the number of events.
+ */
+PRIVATE_EXTERN int
+DHCPLeaseHistoryQueryClient(DHCPLeaseHistoryRef history,
+			    const char * client_id,
+			    uint32_t start, uint32_t end,
+			    DHCPLeaseHistoryQueryFunc * func, void * arg)
+{
+    query_t	query;
+
+    bzero(&query, sizeof(query));
+    query.type = query_key_client;
+    client_id_digest(client_id, query.client_digest);
+    query.key = client_digest_key(query.client_digest);
+    return (history_query(history, &query, start, end, func, arg));
+}
+
+/*
+ * Function: DHCPLeaseHistoryLookupIP
+ * Purpose:
+ *   Find the lease on the IP address in effect at the given time.
+ *
+ *   The most recent event for the address at or before that time
+ *   decides: if it was a bind or renew whose lease hadn't expired yet,
+ *   that is the lease, otherwise the address was not leased.
+ *   Segments are searched newest first, until one has an event for
+ *   the address.
+ */
+PRIVATE_EXTERN bool
+DHCPLeaseHistoryLookupIP(DHCPLeaseHistoryRef history, struct in_addr ip,
+			 uint32_t when, DHCPLeaseHistoryRecordRef ret_record)
+{
+    int		i;
+    uint32_t	key = ntohl(ip.s_addr);
+
+    if (history->writable) {
+	(void)history_flush(history);
+    }
+    for (i = history->segments_count - 1; i >= 0; i--) {
+	const DHCPLeaseHistoryRecord *	found = NULL;
+	uint32_t			pos;
+	SegmentRef			seg = history->segments + i;
+
+	if (seg->start > when) {
+	    continue;
+	}
+	if (segment_load(history, seg) == false) {
+	    continue;
+	}
+	for (pos = index_lower_bound(seg->ip_index, seg->record_count, key);
+	     pos < seg->record_count && seg->ip_index[pos].key == key;
+	     pos++) {
+	    const DHCPLeaseHistoryRecord *	record;
+
+	    record = seg->records + seg->ip_index[pos].index;
+	    if (record->time > when) {
+		continue;
+	    }
+	    if (found == NULL || record->time >= found->time) {
+		found = record;
+	    }
+	}
+	if (found == NULL) {
+	    continue;
+	}
+	if ((found->event == kDHCPLeaseHistoryEventBind
+	     || found->event == kDHCPLeaseHistoryEventRenew)
+	    && found->expiry > when) {
+	    if (ret_record != NULL) {
+		*ret_record = *found;
+	    }
+	    return (true);
+	}
+	return (false);
+    }
+    return (false);
+}
+
+#ifdef TEST_LEASE_HISTORY
+
+#include <sys/time.h>
+
+#define TEST_EVENTS_DEFAULT	(1000 * 1000)
+#define TEST_SPAN_SECS		(180 * 24 * 60 * 60)	/* six months */
+#define TEST_IP_COUNT		(64 * 1024)
+#define TEST_CLIENT_COUNT	(96 * 1024)
+#define TEST_LEASE_SECS		(4 * 60 * 60)
+#define TEST_QUERY_COUNT	1000
+#define TEST_START_TIME		1700000000U
+
+STATIC double
+timestamp(void)
+{
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+STATIC struct in_addr
+test_ip(uint32_t n)
+{
+    struct in_addr	ip;
+
+    ip.s_addr = htonl(0x0a000000 | (n % TEST_IP_COUNT));
+    return (ip);
+}
+
+STATIC void
+test_client_id(uint32_t n, char * id, size_t id_size)
+{
+    snprintf(id, id_size, "1,2:0:%x:%x:%x:%x", (n >> 24) & 0xff,
+	     (n >> 16) & 0xff, (n >> 8) & 0xff, n & 0xff);
+    return;
+}
+
+/*
+ * DUID-based client identifiers longer than the client_id field, that
+ * only differ past it.
+ */
+#define TEST_LONG_CLIENT_ID_PREFIX					\
+    "255,0:0:0:1:0:4:11:22:33:44:55:66:77:88:99:aa:bb:cc:dd:ee:ff:"
+
+STATIC void
+test_long_client_id(uint32_t n, char * id, size_t id_size)
+{
+    snprintf(id, id_size, TEST_LONG_CLIENT_ID_PREFIX "%x", n);
+    return;
+}
+
+STATIC bool
+long_id_func(void * arg, const DHCPLeaseHistoryRecord * record)
+{
+    struct in_addr *	ip = (struct in_addr *)arg;
+
+    if (record->ip.s_addr != ip->s_addr) {
+	fprintf(stderr, "long client id query matched another client\n");
+	exit(1);
+    }
+    if (strnlen(record->client_id, sizeof(record->client_id))
+	== sizeof(record->client_id)
+	|| (record->flags & kDHCPLeaseHistoryRecordFlagClientIDTruncated)
+	== 0) {
+	fprintf(stderr, "long client id not truncated properly\n");
+	exit(1);
+    }
+    return (true);
+}
+
+STATIC bool
+count_func(void * arg, const DHCPLeaseHistoryRecord * record)
+{
+    uint32_t *	last_time = (uint32_t *)arg;
+
+    if (record->time < *last_time) {
+	fprintf(stderr, "records out of order\n");
+	exit(1);
+    }
+    *last_time = record->time;
+    return (true);
+}
+
+int
+main(int argc, char * argv[])
+{
+    char		client_id[DHCP_LEASE_HISTORY_CLIENT_ID_SIZE];
+    const char *	dir;
+    uint32_t		end_time;
+    uint64_t		events = TEST_EVENTS_DEFAULT;
+    uint32_t		found = 0;
+    DHCPLeaseHistoryRef	history;
+    uint64_t		i;
+    char		long_client_id[128];
+    uint32_t		matched = 0;
+    DHCPLeaseHistoryRecord record;
+    uint32_t		removed;
+    double		start;
+    uint32_t		step;
+
+    if (argc < 2) {
+	fprintf(stderr, "usage: %s <dir> [ <event_count> ]\n", argv[0]);
+	exit(1);
+    }
+    dir = argv[1];
+    if (argc > 2) {
+	events = strtoull(argv[2], NULL, 0);
+    }
+    if (events == 0) {
+	events = 1;
+    }
+    step = (uint32_t)(((uint64_t)TEST_SPAN_SECS << 8) / events);
+
+    /* generate */
+    history = DHCPLeaseHistoryOpen(dir, true, 0);
+    if (history == NULL) {
+	fprintf(stderr, "DHCPLeaseHistoryOpen(%s) failed\n", dir);
+	exit(1);
+    }
+    if (history->segments_count != 0) {
+	fprintf(stderr, "%s already contains a history\n", dir);
+	exit(1);
+    }
+    start = timestamp();
+    for (i = 0; i < events; i++) {
+	DHCPLeaseHistoryEvent	event;
+	uint32_t		now;
+
+	now = TEST_START_TIME + (uint32_t)((i * step) >> 8);
+	switch (i % 8) {
+	case 0:
+	    event = kDHCPLeaseHistoryEventBind;
+	    break;
+	case 7:
+	    event = kDHCPLeaseHistoryEventRelease;
+	    break;
+	default:
+	    event = kDHCPLeaseHistoryEventRenew;
+	    break;
+	}
+	test_client_id((uint32_t)(i % TEST_CLIENT_COUNT), client_id,
+		       sizeof(client_id));
+	if (DHCPLeaseHistoryAppend(history, now, event,
+				   test_ip((uint32_t)(i * 2654435761U)),
+				   now + TEST_LEASE_SECS, client_id)
+	    == false) {
+	    fprintf(stderr, "DHCPLeaseHistoryAppend failed\n");
+	    exit(1);
+	}
+    }
+    end_time = TEST_START_TIME + (uint32_t)(((events - 1) * step) >> 8);
+    for (i = 0; i < 2; i++) {
+	test_long_client_id((uint32_t)i, long_client_id,
+			    sizeof(long_client_id));
+	if (DHCPLeaseHistoryAppend(history, end_time,
+				   kDHCPLeaseHistoryEventBind,
+				   test_ip((uint32_t)i),
+				   end_time + TEST_LEASE_SECS, long_client_id)
+	    == false) {
+	    fprintf(stderr, "DHCPLeaseHistoryAppend failed\n");
+	    exit(1);
+	}
+    }
+    DHCPLeaseHistorySynchronize(history);
+    printf("appended %llu events in %.2f seconds\n",
+	   (unsigned long long)events, timestamp() - start);
+    DHCPLeaseHistoryClose(&history);
+
+    /* re-open read-only and query */
+    start = timestamp();
+    history = DHCPLeaseHistoryOpen(dir, false, 0);
+    if (history == NULL) {
+	fprintf(stderr, "DHCPLeaseHistoryOpen(%s) read-only failed\n", dir);
+	exit(1);
+    }
+    printf("opened in %.3f ms\n", (timestamp() - start) * 1000);
+
+    start = timestamp();
+    for (i = 0; i < TEST_QUERY_COUNT; i++) {
+	uint32_t	when;
+
+	when = TEST_START_TIME + (uint32_t)(arc4random() % TEST_SPAN_SECS);
+	if (DHCPLeaseHistoryLookupIP(history,
+				     test_ip(arc4random() % TEST_IP_COUNT),
+				     when, &record)) {
+	    if (record.time > when || record.expiry <= when) {
+		fprintf(stderr, "lookup returned the wrong lease\n");
+		exit(1);
+	    }
+	    found++;
+	}
+    }
+    printf("%d point-in-time lookups: %.3f ms each, %u leased\n",
+	   TEST_QUERY_COUNT,
+	   (timestamp() - start) * 1000 / TEST_QUERY_COUNT, found);
+
+    start = timestamp();
+    for (i = 0; i < TEST_QUERY_COUNT; i++) {
+	uint32_t	last_time = 0;
+	uint32_t	when;
+
+	when = TEST_START_TIME + (uint32_t)(arc4random() % TEST_SPAN_SECS);
+	test_client_id(arc4random() % TEST_CLIENT_COUNT, client_id,
+		       sizeof(client_id));
+	matched += DHCPLeaseHistoryQueryClient(history, client_id,
+					       when, when + 7 * 24 * 60 * 60,
+					       count_func, &last_time);
+    }
+    printf("%d one-week client range queries: %.3f ms each, %u events\n",
+	   TEST_QUERY_COUNT,
+	   (timestamp() - start) * 1000 / TEST_QUERY_COUNT, matched);
+
+    /* long client identifiers with a common prefix stay distinct */
+    for (i = 0; i < 2; i++) {
+	struct in_addr	ip = test_ip((uint32_t)i);
+
+	test_long_client_id((uint32_t)i, long_client_id,
+			    sizeof(long_client_id));
+	if (DHCPLeaseHistoryQueryClient(history, long_client_id,
+					end_time, end_time,
+					long_id_func, &ip) != 1) {
+	    fprintf(stderr, "long client id query failed\n");
+	    exit(1);
+	}
+    }
+    printf("long client identifiers: PASSED\n");
+    DHCPLeaseHistoryClose(&history);
+
+    /* retention */
+    history = DHCPLeaseHistoryOpen(dir, true, 0);
+    removed = DHCPLeaseHistoryRemoveBefore(history,
+					   TEST_START_TIME
+					   + TEST_SPAN_SECS / 2);
+    printf("removed %u segments\n", removed);
+    DHCPLeaseHistoryClose(&history);
+    exit(0);
+    return (0);
+}
+
+#endif /* TEST_LEASE_HISTORY */
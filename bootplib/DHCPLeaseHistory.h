@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * DHCPLeaseHistory.h
+ * - append-only history of DHCP lease events, stored as time-based
+ *   segments, each indexed by IP address and by client identifier
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_DHCPLEASEHISTORY_H
+#define _S_DHCPLEASEHISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "symbol_scope.h"
+
+#define DHCP_LEASE_HISTORY_DIR		"/var/db/dhcpd_lease_history"
+
+/* default segment length: one day */
+#define DHCP_LEASE_HISTORY_SEGMENT_SECS	(60 * 60 * 24)
+
+/* lease expiration of an infinite lease */
+#define DHCP_LEASE_HISTORY_INFINITE	UINT32_MAX
+
+typedef enum {
+    kDHCPLeaseHistoryEventNone = 0,
+    kDHCPLeaseHistoryEventBind = 1,
+    kDHCPLeaseHistoryEventRenew = 2,
+    kDHCPLeaseHistoryEventRelease = 3,
+    kDHCPLeaseHistoryEventExpire = 4,
+    kDHCPLeaseHistoryEventDecline = 5,
+} DHCPLeaseHistoryEvent;
+
+const char *
+DHCPLeaseHistoryEventGetName(DHCPLeaseHistoryEvent event);
+
+#define DHCP_LEASE_HISTORY_CLIENT_ID_SIZE	48
+#define DHCP_LEASE_HISTORY_CLIENT_DIGEST_SIZE	16
+
+/* DHCPLeaseHistoryRecord.flags */
+#define kDHCPLeaseHistoryRecordFlagClientIDTruncated	0x01
+
+/*
+ * Type: DHCPLeaseHistoryRecord
+ * Purpose:
+ *   A single lease event, stored as is in the segment files.
+ *   The client is identified by client_digest, a digest of the full
+ *   client identifier.  client_id is a nul-terminated copy of the
+ *   identifier for display; if the identifier doesn't fit, it is
+ *   truncated and kDHCPLeaseHistoryRecordFlagClientIDTruncated is set.
+ */
+typedef struct {
+    uint32_t		time;		/* seconds since the epoch */
+    struct in_addr	ip;
+    uint32_t		expiry;		/* lease expiration time */
+    uint8_t		event;		/* DHCPLeaseHistoryEvent */
+    uint8_t		flags;
+    uint8_t		reserved[2];
+    uint8_t		client_digest[DHCP_LEASE_HISTORY_CLIENT_DIGEST_SIZE];
+    char		client_id[DHCP_LEASE_HISTORY_CLIENT_ID_SIZE];
+} DHCPLeaseHistoryRecord, * DHCPLeaseHistoryRecordRef;
+
+typedef struct DHCPLeaseHistory * DHCPLeaseHistoryRef;
+
+/*
+ * Type: DHCPLeaseHistoryQueryFunc
+ * Purpose:
+ *   Called for each matching record, in time order. Return false
+ *   to stop the query.
+ */
+typedef bool
+(DHCPLeaseHistoryQueryFunc)(void * arg, const DHCPLeaseHistoryRecord * record);
+
+DHCPLeaseHistoryRef
+DHCPLeaseHistoryOpen(const char * dir, bool writable, uint32_t segment_secs);
+
+void
+DHCPLeaseHistoryClose(DHCPLeaseHistoryRef * history_p);
+
+bool
+DHCPLeaseHistoryAppend(DHCPLeaseHistoryRef history, uint32_t time,
+		       DHCPLeaseHistoryEvent event, struct in_addr ip,
+		       uint32_t expiry, const char * client_id);
+
+bool
+DHCPLeaseHistorySynchronize(DHCPLeaseHistoryRef history);
+
+int
+DHCPLeaseHistoryRemoveBefore(DHCPLeaseHistoryRef history, uint32_t time);
+
+int
+DHCPLeaseHistoryQueryIP(DHCPLeaseHistoryRef history, struct in_addr ip,
+			uint32_t start, uint32_t end,
+			DHCPLeaseHistoryQueryFunc * func, void * arg);
+
+int
+DHCPLeaseHistoryQueryClient(DHCPLeaseHistoryRef history,
+			    const char * client_id,
+			    uint32_t start, uint32_t end,
+			    DHCPLeaseHistoryQueryFunc * func, void * arg);
+
+bool
+DHCPLeaseHistoryLookupIP(DHCPLeaseHistoryRef history, struct in_addr ip,
+			 uint32_t when, DHCPLeaseHistoryRecordRef ret_record);
+
+#endif /* _S_DHCPLEASEHISTORY_H */
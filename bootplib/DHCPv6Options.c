@@ -45,6 +45,7 @@
 #include <mach/boolean.h>
 #include <string.h>
 #include <errno.h>
+#include <CommonCrypto/CommonHMAC.h>
 #include "DHCPv6.h"
 #include "DHCPv6Options.h"
 #include "ptrlist.h"
@@ -843,6 +844,341 @@ DHCPv6OptionsDictionaryPrintToString(CFMutableStringRef str,
     return;
 }
 
+/**
+ ** DHCPv6OptionTable
+ **/
+typedef struct {
+    uint32_t		offset;
+    uint32_t		length;
+} DHCPv6OptionTableEntry;
+
+struct DHCPv6OptionTable {
+    int				count;
+    DHCPv6OptionCode		max_code;
+    DHCPv6OptionTableEntry *	entries;	/* max_code + 1 entries */
+    uint8_t *			encoded;
+    int				encoded_length;
+};
+
+/*
+ * Function: DHCPv6OptionTableCreate
+ * Purpose:
+ *   Compile a dictionary returned by DHCPv6OptionsDictionaryCreate() into
+ *   a buffer holding each option already encoded as code/length/data,
+ *   with a dense array indexed by option code pointing into the buffer.
+ *   A reply can then copy a requested option with a single bcopy().
+ */
+PRIVATE_EXTERN DHCPv6OptionTableRef
+DHCPv6OptionTableCreate(CFDictionaryRef options)
+{
+    CFIndex			count;
+    const void * * 		keys;
+    DHCPv6OptionCode		max_code = 0;
+    uint32_t			offset;
+    DHCPv6OptionTableRef	table = NULL;
+    int				total = 0;
+    const void * *		values;
+
+    if (options == NULL) {
+	return (NULL);
+    }
+    count = CFDictionaryGetCount(options);
+    if (count == 0) {
+	return (NULL);
+    }
+    keys = malloc(count * sizeof(*keys) * 2);
+    values = keys + count;
+    CFDictionaryGetKeysAndValues(options, keys, values);
+
+    /* size the code index and the encoded buffer */
+    for (CFIndex i = 0; i < count; i++) {
+	DHCPv6OptionCode	code;
+	CFIndex			length;
+
+	if (isA_CFNumber(keys[i]) == NULL || isA_CFData(values[i]) == NULL) {
+	    continue;
+	}
+	length = CFDataGetLength(values[i]);
+	if (length > UINT16_MAX) {
+	    continue;
+	}
+	CFNumberGetValue(keys[i], kCFNumberSInt16Type, &code);
+	if (code > max_code) {
+	    max_code = code;
+	}
+	total += offsetof(DHCPv6Option, data) + (int)length;
+    }
+    if (total == 0) {
+	goto done;
+    }
+    table = malloc(sizeof(*table));
+    bzero(table, sizeof(*table));
+    table->max_code = max_code;
+    table->entries = calloc(max_code + 1, sizeof(*table->entries));
+    table->encoded = malloc(total);
+    table->encoded_length = total;
+
+    /* encode each option */
+    offset = 0;
+    for (CFIndex i = 0; i < count; i++) {
+	DHCPv6OptionCode	code;
+	CFIndex			length;
+	DHCPv6OptionRef		opt;
+
+	if (isA_CFNumber(keys[i]) == NULL || isA_CFData(values[i]) == NULL) {
+	    continue;
+	}
+	length = CFDataGetLength(values[i]);
+	if (length > UINT16_MAX) {
+	    continue;
+	}
+	CFNumberGetValue(keys[i], kCFNumberSInt16Type, &code);
+	opt = (DHCPv6OptionRef)(table->encoded + offset);
+	DHCPv6OptionSetCode(opt, code);
+	DHCPv6OptionSetLength(opt, (DHCPv6OptionLength)length);
+	if (length > 0) {
+	    bcopy(CFDataGetBytePtr(values[i]), opt->data, length);
+	}
+	table->entries[code].offset = offset;
+	table->entries[code].length
+	    = (uint32_t)(offsetof(DHCPv6Option, data) + length);
+	offset += table->entries[code].length;
+	table->count++;
+    }
+
+ done:
+    free(keys);
+    return (table);
+}
+
+PRIVATE_EXTERN void
+DHCPv6OptionTableRelease(DHCPv6OptionTableRef * table_p)
+{
+    DHCPv6OptionTableRef	table = *table_p;
+
+    if (table == NULL) {
+	return;
+    }
+    free(table->entries);
+    free(table->encoded);
+    free(table);
+    *table_p = NULL;
+    return;
+}
+
+PRIVATE_EXTERN int
+DHCPv6OptionTableGetCount(DHCPv6OptionTableRef table)
+{
+    return ((table != NULL) ? table->count : 0);
+}
+
+PRIVATE_EXTERN bool
+DHCPv6OptionTableEqual(DHCPv6OptionTableRef table1,
+		       DHCPv6OptionTableRef table2)
+{
+    if (table1 == NULL || table2 == NULL) {
+	return (table1 == table2);
+    }
+    if (table1->count != table2->count
+	|| table1->max_code != table2->max_code
+	|| table1->encoded_length != table2->encoded_length) {
+	return (FALSE);
+    }
+    for (int code = 0; code <= table1->max_code; code++) {
+	DHCPv6OptionTableEntry *	entry1 = table1->entries + code;
+	DHCPv6OptionTableEntry *	entry2 = table2->entries + code;
+
+	if (entry1->length != entry2->length) {
+	    return (FALSE);
+	}
+	if (entry1->length != 0
+	    && bcmp(table1->encoded + entry1->offset,
+		    table2->encoded + entry2->offset,
+		    entry1->length) != 0) {
+	    return (FALSE);
+	}
+    }
+    return (TRUE);
+}
+
+PRIVATE_EXTERN const uint8_t *
+DHCPv6OptionTableGetEncodedOption(DHCPv6OptionTableRef table,
+				  DHCPv6OptionCode code, int * ret_length)
+{
+    DHCPv6OptionTableEntry *	entry;
+
+    if (table == NULL || code > table->max_code) {
+	return (NULL);
+    }
+    entry = table->entries + code;
+    if (entry->length == 0) {
+	return (NULL);
+    }
+    *ret_length = entry->length;
+    return (table->encoded + entry->offset);
+}
+
+PRIVATE_EXTERN bool
+DHCPv6OptionAreaAddEncodedOption(DHCPv6OptionAreaRef oa_p,
+				 const uint8_t * encoded, int encoded_length,
+				 DHCPv6OptionErrorString * err_p)
+{
+    int			left = oa_p->size - oa_p->used;
+
+    if (err_p != NULL) {
+	err_p->str[0] = '\0';
+    }
+    if (left < encoded_length) {
+	if (err_p != NULL) {
+	    DHCPv6OptionCode	code = net_uint16_get(encoded);
+
+	    snprintf(err_p->str, sizeof(err_p->str), 
+		     "No room for option %s (%d), %d < %d",
+		     DHCPv6OptionCodeGetName(code),
+		     code, left, encoded_length);
+	}
+	return (FALSE);
+    }
+    bcopy(encoded, oa_p->buf + oa_p->used, encoded_length);
+    oa_p->used += encoded_length;
+    return (TRUE);
+}
+
+/**
+ ** Reconfigure Key Authentication
+ **/
+PRIVATE_EXTERN bool
+DHCPv6OptionAreaAddReconfigureKey(DHCPv6OptionAreaRef oa_p,
+				  uint8_t key_type,
+				  uint64_t replay_detection,
+				  const uint8_t * key,
+				  DHCPv6OptionErrorString * err_p)
+{
+    uint8_t		buf[DHCPv6OptionAUTH_RECONFIGURE_KEY_LENGTH];
+    DHCPv6OptionAUTHRef	auth = (DHCPv6OptionAUTHRef)buf;
+
+    auth->protocol = kDHCPv6AuthProtocolReconfigureKey;
+    auth->algorithm = kDHCPv6AuthAlgorithmHMAC_MD5;
+    auth->rdm = kDHCPv6AuthRDMMonotonicCounter;
+    DHCPv6OptionAUTHSetReplayDetection(auth, replay_detection);
+    auth->auth_info[0] = key_type;
+    if (key != NULL) {
+	bcopy(key, auth->auth_info + 1, kDHCPv6ReconfigureKeyLength);
+    }
+    else {
+	/* HMAC is filled in by DHCPv6PacketSignReconfigure() */
+	bzero(auth->auth_info + 1, kDHCPv6ReconfigureKeyLength);
+    }
+    return (DHCPv6OptionAreaAddOption(oa_p, kDHCPv6OPTION_AUTH,
+				      sizeof(buf), buf, err_p));
+}
+
+/*
+ * Function: DHCPv6OptionListGetReconfigureKey
+ * Purpose:
+ *   Find a Reconfigure Key AUTH option with the given key type, and
+ *   return a pointer to its 16-byte value, NULL if there isn't one.
+ */
+PRIVATE_EXTERN const uint8_t *
+DHCPv6OptionListGetReconfigureKey(DHCPv6OptionListRef options,
+				  uint8_t key_type,
+				  uint64_t * ret_replay_detection)
+{
+    DHCPv6OptionAUTHRef	auth;
+    int			auth_len;
+    int			start = 0;
+
+    while ((auth = (DHCPv6OptionAUTHRef)
+	    DHCPv6OptionListGetOptionDataAndLength(options,
+						   kDHCPv6OPTION_AUTH,
+						   &auth_len,
+						   &start)) != NULL) {
+	if (auth_len == DHCPv6OptionAUTH_RECONFIGURE_KEY_LENGTH
+	    && auth->protocol == kDHCPv6AuthProtocolReconfigureKey
+	    && auth->algorithm == kDHCPv6AuthAlgorithmHMAC_MD5
+	    && auth->rdm == kDHCPv6AuthRDMMonotonicCounter
+	    && auth->auth_info[0] == key_type) {
+	    if (ret_replay_detection != NULL) {
+		*ret_replay_detection
+		    = DHCPv6OptionAUTHGetReplayDetection(auth);
+	    }
+	    return (auth->auth_info + 1);
+	}
+    }
+    return (NULL);
+}
+
+STATIC void
+reconfigure_hmac(const DHCPv6PacketRef pkt, int pkt_len, int digest_offset,
+		 const uint8_t * key, uint8_t * digest)
+{
+    uint8_t		buf[pkt_len];
+
+    /* the HMAC is computed with the HMAC field set to zero */
+    bcopy(pkt, buf, pkt_len);
+    bzero(buf + digest_offset, kDHCPv6ReconfigureKeyLength);
+    CCHmac(kCCHmacAlgMD5, key, kDHCPv6ReconfigureKeyLength,
+	   buf, pkt_len, digest);
+    return;
+}
+
+PRIVATE_EXTERN void
+DHCPv6PacketSignReconfigure(DHCPv6PacketRef pkt, int pkt_len,
+			    const uint8_t * key)
+{
+    uint8_t			digest[CC_MD5_DIGEST_LENGTH];
+    int				digest_offset;
+    DHCPv6OptionErrorString	err;
+    const uint8_t *		hmac;
+    DHCPv6OptionListRef		options;
+
+    options = DHCPv6OptionListCreateWithPacket(pkt, pkt_len, &err);
+    if (options == NULL) {
+	my_log(LOG_NOTICE, "%s: parse failed, %s", __func__, err.str);
+	return;
+    }
+    hmac = DHCPv6OptionListGetReconfigureKey(options,
+					     kDHCPv6ReconfigureKeyTypeHMAC_MD5,
+					     NULL);
+    if (hmac != NULL) {
+	digest_offset = (int)(hmac - (const uint8_t *)pkt);
+	reconfigure_hmac(pkt, pkt_len, digest_offset, key, digest);
+	bcopy(digest, (uint8_t *)pkt + digest_offset, sizeof(digest));
+    }
+    DHCPv6OptionListRelease(&options);
+    return;
+}
+
+/*
+ * Function: DHCPv6PacketVerifyReconfigure
+ * Purpose:
+ *   Verify the HMAC-MD5 in the Reconfigure Key AUTH option of a
+ *   RECONFIGURE message using the key the server gave us earlier.
+ *   The caller is responsible for checking the replay detection value.
+ */
+PRIVATE_EXTERN bool
+DHCPv6PacketVerifyReconfigure(const DHCPv6PacketRef pkt, int pkt_len,
+			      DHCPv6OptionListRef options,
+			      const uint8_t * key,
+			      uint64_t * ret_replay_detection)
+{
+    uint8_t			digest[CC_MD5_DIGEST_LENGTH];
+    const uint8_t *		hmac;
+
+    hmac = DHCPv6OptionListGetReconfigureKey(options,
+					     kDHCPv6ReconfigureKeyTypeHMAC_MD5,
+					     ret_replay_detection);
+    if (hmac == NULL
+	|| hmac < (const uint8_t *)pkt
+	|| (hmac + kDHCPv6ReconfigureKeyLength)
+	   > ((const uint8_t *)pkt + pkt_len)) {
+	return (FALSE);
+    }
+    reconfigure_hmac(pkt, pkt_len, (int)(hmac - (const uint8_t *)pkt),
+		     key, digest);
+    return (timingsafe_bcmp(digest, hmac, sizeof(digest)) == 0);
+}
+
 /**
  ** DHCPv6OptionIA_NA
  **/
@@ -1184,6 +1520,89 @@ run_tests(struct testbuf * list, bool verbose)
     return (TRUE);
 }
 
+/*
+ * Function: check_option_table
+ * Purpose:
+ *   Compile the options into a DHCPv6OptionTable, copy every option into
+ *   an option area, and verify that it parses back to the same values.
+ */
+STATIC bool
+check_option_table(CFDictionaryRef options)
+{
+    uint8_t			buf[1500];
+    CFIndex			count;
+    DHCPv6OptionErrorString 	err;
+    const void * * 		keys;
+    DHCPv6OptionListRef		list = NULL;
+    DHCPv6OptionArea		oa;
+    bool			success = FALSE;
+    DHCPv6OptionTableRef	table;
+    const void * *		values;
+
+    table = DHCPv6OptionTableCreate(options);
+    count = CFDictionaryGetCount(options);
+    if (DHCPv6OptionTableGetCount(table) != count) {
+	fprintf(stderr, "table has %d options, expected %d\n",
+		DHCPv6OptionTableGetCount(table), (int)count);
+	DHCPv6OptionTableRelease(&table);
+	return (FALSE);
+    }
+    keys = malloc(count * sizeof(*keys) * 2);
+    values = keys + count;
+    CFDictionaryGetKeysAndValues(options, keys, values);
+    DHCPv6OptionAreaInit(&oa, buf, sizeof(buf));
+    for (CFIndex i = 0; i < count; i++) {
+	DHCPv6OptionCode	code;
+	const uint8_t *		encoded;
+	int			encoded_length;
+
+	CFNumberGetValue(keys[i], kCFNumberSInt16Type, &code);
+	encoded = DHCPv6OptionTableGetEncodedOption(table, code,
+						    &encoded_length);
+	if (encoded == NULL) {
+	    fprintf(stderr, "table missing option %d\n", code);
+	    goto done;
+	}
+	if (!DHCPv6OptionAreaAddEncodedOption(&oa, encoded, encoded_length,
+					      &err)) {
+	    fprintf(stderr, "add option %d failed, %s\n", code, err.str);
+	    goto done;
+	}
+    }
+    if (DHCPv6OptionTableGetEncodedOption(table, 0, NULL) != NULL) {
+	fprintf(stderr, "table contains option 0\n");
+	goto done;
+    }
+    list = DHCPv6OptionListCreate(buf, DHCPv6OptionAreaGetUsedLength(&oa),
+				  &err);
+    if (list == NULL) {
+	fprintf(stderr, "parse encoded options failed, %s\n", err.str);
+	goto done;
+    }
+    for (CFIndex i = 0; i < count; i++) {
+	DHCPv6OptionCode	code;
+	const uint8_t *		data;
+	int			data_length;
+
+	CFNumberGetValue(keys[i], kCFNumberSInt16Type, &code);
+	data = DHCPv6OptionListGetOptionDataAndLength(list, code,
+						      &data_length, NULL);
+	if (data == NULL
+	    || data_length != CFDataGetLength(values[i])
+	    || bcmp(data, CFDataGetBytePtr(values[i]), data_length) != 0) {
+	    fprintf(stderr, "option %d doesn't match\n", code);
+	    goto done;
+	}
+    }
+    success = TRUE;
+
+ done:
+    free(keys);
+    DHCPv6OptionListRelease(&list);
+    DHCPv6OptionTableRelease(&table);
+    return (success);
+}
+
 STATIC bool
 run_config_tests(bool verbose)
 {
@@ -1239,6 +1658,9 @@ run_config_tests(bool verbose)
 	    if (!expect_success) {
 		test_success = FALSE;
 	    }
+	    else if (!check_option_table(options)) {
+		test_success = FALSE;
+	    }
 	}
 	printf("Config test %d [%s]\n", (int)i,
 	       test_success ? "SUCCESS" : "FAILURE");
@@ -1264,6 +1686,76 @@ run_config_tests(bool verbose)
     return (TRUE);
 }
 
+STATIC bool
+verify_reconfigure(DHCPv6PacketRef pkt, int pkt_len, const uint8_t * key)
+{
+    DHCPv6OptionErrorString 	err;
+    DHCPv6OptionListRef		options;
+    uint64_t			replay = 0;
+    bool			verified;
+
+    options = DHCPv6OptionListCreateWithPacket(pkt, pkt_len, &err);
+    if (options == NULL) {
+	return (FALSE);
+    }
+    verified = DHCPv6PacketVerifyReconfigure(pkt, pkt_len, options, key,
+					     &replay);
+    DHCPv6OptionListRelease(&options);
+    return (verified && replay == 0x0102030405060708ULL);
+}
+
+STATIC bool
+run_reconfigure_tests(void)
+{
+    char			buf[512];
+    DHCPv6OptionErrorString 	err;
+    uint8_t			key[kDHCPv6ReconfigureKeyLength];
+    DHCPv6OptionArea		oa;
+    DHCPv6PacketRef		pkt;
+    int				pkt_len;
+    uint8_t			msg_type = kDHCPv6MessageINFORMATION_REQUEST;
+    const uint8_t		duid[] = { DUID_LLT_1 };
+
+    for (int i = 0; i < sizeof(key); i++) {
+	key[i] = (uint8_t)(i * 7 + 1);
+    }
+    pkt = (DHCPv6PacketRef)buf;
+    DHCPv6PacketSetMessageType(pkt, kDHCPv6MessageRECONFIGURE);
+    DHCPv6PacketSetTransactionID(pkt, 0);
+    DHCPv6OptionAreaInit(&oa, pkt->options,
+			 sizeof(buf) - DHCPV6_PACKET_HEADER_LENGTH);
+    if (!DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_SERVERID,
+				   sizeof(duid), duid, &err)
+	|| !DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_RECONF_MSG,
+				      sizeof(msg_type), &msg_type, &err)
+	|| !DHCPv6OptionAreaAddReconfigureKey(&oa,
+					      kDHCPv6ReconfigureKeyTypeHMAC_MD5,
+					      0x0102030405060708ULL,
+					      NULL, &err)) {
+	fprintf(stderr, "failed to build RECONFIGURE, %s\n", err.str);
+	return (FALSE);
+    }
+    pkt_len = DHCPV6_PACKET_HEADER_LENGTH + DHCPv6OptionAreaGetUsedLength(&oa);
+    DHCPv6PacketSignReconfigure(pkt, pkt_len, key);
+    if (!verify_reconfigure(pkt, pkt_len, key)) {
+	fprintf(stderr, "signed RECONFIGURE doesn't verify\n");
+	return (FALSE);
+    }
+    key[0] ^= 1;
+    if (verify_reconfigure(pkt, pkt_len, key)) {
+	fprintf(stderr, "RECONFIGURE verified with the wrong key\n");
+	return (FALSE);
+    }
+    key[0] ^= 1;
+    pkt->options[4] ^= 1;
+    if (verify_reconfigure(pkt, pkt_len, key)) {
+	fprintf(stderr, "modified RECONFIGURE verified\n");
+	return (FALSE);
+    }
+    printf("Reconfigure test SUCCESS\n");
+    return (TRUE);
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -1271,6 +1763,10 @@ main(int argc, char * argv[])
 	fprintf(stderr, "TEST FAILED\n");
 	exit(1);
     }
+    if (run_reconfigure_tests() == FALSE) {
+	fprintf(stderr, "TEST FAILED\n");
+	exit(1);
+    }
     run_config_tests(argc > 1);
     exit(0);
     return (0);
@@ -240,6 +240,34 @@ DHCPv6OptionsDictionaryCreate(CFDictionaryRef dict);
 CFDataRef
 DHCPv6OptionsDictionaryGetOption(CFDictionaryRef dict, DHCPv6OptionCode code);
 
+/**
+ ** DHCPv6OptionTable
+ ** - a DHCPv6OptionsDictionary compiled into wire format, indexed by code
+ **/
+typedef struct DHCPv6OptionTable * DHCPv6OptionTableRef;
+
+DHCPv6OptionTableRef
+DHCPv6OptionTableCreate(CFDictionaryRef options);
+
+void
+DHCPv6OptionTableRelease(DHCPv6OptionTableRef * table_p);
+
+int
+DHCPv6OptionTableGetCount(DHCPv6OptionTableRef table);
+
+bool
+DHCPv6OptionTableEqual(DHCPv6OptionTableRef table1,
+		       DHCPv6OptionTableRef table2);
+
+const uint8_t *
+DHCPv6OptionTableGetEncodedOption(DHCPv6OptionTableRef table,
+				  DHCPv6OptionCode code, int * ret_length);
+
+bool
+DHCPv6OptionAreaAddEncodedOption(DHCPv6OptionAreaRef oa_p,
+				 const uint8_t * encoded, int encoded_length,
+				 DHCPv6OptionErrorStringRef err_p);
+
 
 /**
  ** IA_NA option
@@ -391,4 +419,68 @@ typedef struct {
 #define kDHCPv6OptionPREFERENCEMinValue		0
 #define kDHCPv6OptionPREFERENCEMaxValue		255
 
+/**
+ ** AUTH option
+ ** - only the Reconfigure Key Authentication Protocol (RFC 8415 20.4)
+ **/
+typedef struct {
+    uint8_t		protocol;
+    uint8_t		algorithm;
+    uint8_t		rdm;
+    uint8_t		replay_detection[8];
+    uint8_t		auth_info[1]; /* variable length */
+} DHCPv6OptionAUTH, * DHCPv6OptionAUTHRef;
+
+#define DHCPv6OptionAUTH_MIN_LENGTH	((int)offsetof(DHCPv6OptionAUTH, auth_info))
+
+enum {
+    kDHCPv6AuthProtocolReconfigureKey		= 3,
+    kDHCPv6AuthAlgorithmHMAC_MD5		= 1,
+    kDHCPv6AuthRDMMonotonicCounter		= 0,
+};
+
+enum {
+    kDHCPv6ReconfigureKeyTypeKey		= 1,
+    kDHCPv6ReconfigureKeyTypeHMAC_MD5		= 2,
+};
+
+#define kDHCPv6ReconfigureKeyLength		16
+#define DHCPv6OptionAUTH_RECONFIGURE_KEY_LENGTH	\
+    (DHCPv6OptionAUTH_MIN_LENGTH + 1 + kDHCPv6ReconfigureKeyLength)
+
+INLINE uint64_t
+DHCPv6OptionAUTHGetReplayDetection(DHCPv6OptionAUTHRef auth)
+{
+    return (((uint64_t)net_uint32_get(auth->replay_detection) << 32)
+	    | net_uint32_get(auth->replay_detection + 4));
+}
+
+INLINE void
+DHCPv6OptionAUTHSetReplayDetection(DHCPv6OptionAUTHRef auth, uint64_t val)
+{
+    net_uint32_set(auth->replay_detection, (uint32_t)(val >> 32));
+    net_uint32_set(auth->replay_detection + 4, (uint32_t)val);
+    return;
+}
+
+bool
+DHCPv6OptionAreaAddReconfigureKey(DHCPv6OptionAreaRef oa_p,
+				  uint8_t key_type,
+				  uint64_t replay_detection,
+				  const uint8_t * key,
+				  DHCPv6OptionErrorStringRef err_p);
+const uint8_t *
+DHCPv6OptionListGetReconfigureKey(DHCPv6OptionListRef options,
+				  uint8_t key_type,
+				  uint64_t * ret_replay_detection);
+
+void
+DHCPv6PacketSignReconfigure(DHCPv6PacketRef pkt, int pkt_len,
+			    const uint8_t * key);
+bool
+DHCPv6PacketVerifyReconfigure(const DHCPv6PacketRef pkt, int pkt_len,
+			      DHCPv6OptionListRef options,
+			      const uint8_t * key,
+			      uint64_t * ret_replay_detection);
+
 #endif /* _S_DHCPV6OPTIONS_H */
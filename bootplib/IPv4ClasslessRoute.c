@@ -40,6 +40,8 @@
 #include <mach/boolean.h>
 #include <stddef.h>
 #include <arpa/inet.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <CoreFoundation/CFData.h>
 #include "IPConfigurationLog.h"
 #include "IPv4ClasslessRoute.h"
 #include "symbol_scope.h"
@@ -464,6 +466,167 @@ IPv4ClasslessRouteListGetDefault(IPv4ClasslessRouteRef list, int list_count)
     return (NULL);
 }
 
+/**
+ ** IPv4ClasslessRouteListData
+ ** - compact, versioned encoding of a route list, prefixed with a digest
+ **   of its contents so that two lists can be compared without looking
+ **   at every route
+ **/
+
+#define ROUTELIST_DATA_VERSION		1
+#define ROUTELIST_DATA_DIGEST_LENGTH	CC_SHA256_DIGEST_LENGTH
+
+typedef struct {
+    uint8_t	version;
+    uint8_t	reserved;
+    uint8_t	count[2];	/* network byte order */
+    uint8_t	digest[ROUTELIST_DATA_DIGEST_LENGTH];
+} IPv4ClasslessRouteListDataHeader;
+
+typedef struct {
+    uint8_t	dest[4];
+    uint8_t	prefix_length;
+    uint8_t	gate[4];
+} IPv4ClasslessRouteListDataEntry;
+
+#define ROUTELIST_DATA_MAX_COUNT	UINT16_MAX
+
+STATIC const IPv4ClasslessRouteListDataHeader *
+IPv4ClasslessRouteListDataGetHeader(CFDataRef data, int * count_p)
+{
+    int					count;
+    const IPv4ClasslessRouteListDataHeader * header;
+    CFIndex				length;
+
+    if (data == NULL) {
+	return (NULL);
+    }
+    length = CFDataGetLength(data);
+    if (length < sizeof(*header)) {
+	return (NULL);
+    }
+    header = (const IPv4ClasslessRouteListDataHeader *)
+	CFDataGetBytePtr(data);
+    if (header->version != ROUTELIST_DATA_VERSION) {
+	return (NULL);
+    }
+    count = (header->count[0] << 8) | header->count[1];
+    if (length != (sizeof(*header)
+		   + count * sizeof(IPv4ClasslessRouteListDataEntry))) {
+	return (NULL);
+    }
+    if (count_p != NULL) {
+	*count_p = count;
+    }
+    return (header);
+}
+
+/*
+ * Function: IPv4ClasslessRouteListCreateData
+ * Purpose:
+ *   Encode the route list as a CFData. Destinations are masked with
+ *   their prefix length so that equivalent lists encode identically.
+ */
+PRIVATE_EXTERN CFDataRef
+IPv4ClasslessRouteListCreateData(IPv4ClasslessRouteRef list, int list_count)
+{
+    uint8_t *				buf;
+    int					buf_size;
+    CC_SHA256_CTX			ctx;
+    CFDataRef				data;
+    IPv4ClasslessRouteListDataEntry *	entry;
+    IPv4ClasslessRouteListDataHeader *	header;
+    int					i;
+
+    if (list_count < 0 || list_count > ROUTELIST_DATA_MAX_COUNT) {
+	return (NULL);
+    }
+    buf_size = sizeof(*header) + list_count * sizeof(*entry);
+    buf = malloc(buf_size);
+    header = (IPv4ClasslessRouteListDataHeader *)buf;
+    bzero(header, sizeof(*header));
+    header->version = ROUTELIST_DATA_VERSION;
+    header->count[0] = (uint8_t)(list_count >> 8);
+    header->count[1] = (uint8_t)list_count;
+    entry = (IPv4ClasslessRouteListDataEntry *)(header + 1);
+    for (i = 0; i < list_count; i++, entry++) {
+	struct in_addr		dest;
+	int			prefix_length = list[i].prefix_length;
+
+	if (prefix_length < 0 || prefix_length > 32) {
+	    prefix_length = 32;
+	}
+	dest = list[i].dest;
+	dest.s_addr &= htonl(prefix_to_mask32(prefix_length));
+	memcpy(entry->dest, &dest, sizeof(entry->dest));
+	entry->prefix_length = prefix_length;
+	memcpy(entry->gate, &list[i].gate, sizeof(entry->gate));
+    }
+    /* the digest covers the count and the routes */
+    CC_SHA256_Init(&ctx);
+    CC_SHA256_Update(&ctx, header->count, sizeof(header->count));
+    CC_SHA256_Update(&ctx, header + 1, (CC_LONG)(buf_size - sizeof(*header)));
+    CC_SHA256_Final(header->digest, &ctx);
+    data = CFDataCreateWithBytesNoCopy(NULL, buf, buf_size, kCFAllocatorMalloc);
+    return (data);
+}
+
+/*
+ * Function: IPv4ClasslessRouteListCreateWithData
+ * Purpose:
+ *   Decode data created by IPv4ClasslessRouteListCreateData().
+ *   Returns NULL if the data is invalid, or the list is empty.
+ */
+PRIVATE_EXTERN IPv4ClasslessRouteRef
+IPv4ClasslessRouteListCreateWithData(CFDataRef data, int * ret_count)
+{
+    int						count = 0;
+    const IPv4ClasslessRouteListDataEntry *	entry;
+    const IPv4ClasslessRouteListDataHeader *	header;
+    int						i;
+    IPv4ClasslessRouteRef			list = NULL;
+
+    header = IPv4ClasslessRouteListDataGetHeader(data, &count);
+    if (header == NULL || count == 0) {
+	goto done;
+    }
+    list = (IPv4ClasslessRouteRef)malloc(sizeof(*list) * count);
+    entry = (const IPv4ClasslessRouteListDataEntry *)(header + 1);
+    for (i = 0; i < count; i++, entry++) {
+	memcpy(&list[i].dest, entry->dest, sizeof(entry->dest));
+	list[i].prefix_length = entry->prefix_length;
+	memcpy(&list[i].gate, entry->gate, sizeof(entry->gate));
+    }
+
+ done:
+    *ret_count = (list != NULL) ? count : 0;
+    return (list);
+}
+
+/*
+ * Function: IPv4ClasslessRouteListDataEqual
+ * Purpose:
+ *   Compare two encoded route lists by their digests.
+ */
+PRIVATE_EXTERN bool
+IPv4ClasslessRouteListDataEqual(CFDataRef data1, CFDataRef data2)
+{
+    const IPv4ClasslessRouteListDataHeader *	header1;
+    const IPv4ClasslessRouteListDataHeader *	header2;
+
+    if (data1 == data2) {
+	return (data1 != NULL);
+    }
+    header1 = IPv4ClasslessRouteListDataGetHeader(data1, NULL);
+    header2 = IPv4ClasslessRouteListDataGetHeader(data2, NULL);
+    if (header1 == NULL || header2 == NULL) {
+	return (FALSE);
+    }
+    return (memcmp(header1->count, header2->count, sizeof(header1->count)) == 0
+	    && memcmp(header1->digest, header2->digest,
+		      sizeof(header1->digest)) == 0);
+}
+
 
 #ifdef TEST_IPV4ROUTE
 
@@ -565,6 +728,151 @@ STATIC TestBufEntry test_bufs[] = {
     { test_good_buf_1, sizeof(test_good_buf_1), "good 1", TRUE },
 };
 
+#define BENCH_ROUTE_COUNT	1000
+#define BENCH_ITERATIONS	100
+
+STATIC IPv4ClasslessRouteRef
+BenchRouteListCreate(int count)
+{
+    int				i;
+    IPv4ClasslessRouteRef	list;
+
+    list = (IPv4ClasslessRouteRef)malloc(sizeof(*list) * count);
+    for (i = 0; i < count; i++) {
+	list[i].dest.s_addr = htonl(0x0a000000 | (i << 8));
+	list[i].prefix_length = 24;
+	list[i].gate.s_addr = htonl(0xc0000101);
+    }
+    return (list);
+}
+
+STATIC CFArrayRef
+BenchRouteArrayCreate(IPv4ClasslessRouteRef list, int count)
+{
+    CFMutableArrayRef	array;
+    int			i;
+
+    array = CFArrayCreateMutable(NULL, count, &kCFTypeArrayCallBacks);
+    for (i = 0; i < count; i++) {
+	CFMutableDictionaryRef	dict;
+	struct in_addr		mask;
+	CFStringRef		str;
+
+	dict = CFDictionaryCreateMutable(NULL, 0,
+					 &kCFTypeDictionaryKeyCallBacks,
+					 &kCFTypeDictionaryValueCallBacks);
+	str = CFStringCreateWithFormat(NULL, NULL, CFSTR(IP_FORMAT),
+				       IP_LIST(&list[i].dest));
+	CFDictionarySetValue(dict, CFSTR("DestinationAddress"), str);
+	CFRelease(str);
+	mask.s_addr = htonl(prefix_to_mask32(list[i].prefix_length));
+	str = CFStringCreateWithFormat(NULL, NULL, CFSTR(IP_FORMAT),
+				       IP_LIST(&mask));
+	CFDictionarySetValue(dict, CFSTR("SubnetMask"), str);
+	CFRelease(str);
+	str = CFStringCreateWithFormat(NULL, NULL, CFSTR(IP_FORMAT),
+				       IP_LIST(&list[i].gate));
+	CFDictionarySetValue(dict, CFSTR("GatewayAddress"), str);
+	CFRelease(str);
+	CFArrayAppendValue(array, dict);
+	CFRelease(dict);
+    }
+    return (array);
+}
+
+STATIC void
+data_test(void)
+{
+    CFDataRef			data;
+    CFDataRef			data_copy;
+    int				i;
+    IPv4ClasslessRouteRef	list;
+    IPv4ClasslessRouteRef	list_copy;
+    int				list_copy_count;
+    int				list_count;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+	list_count = tests[i].count;
+	list = TestRouteCreateIPv4ClasslessRoute(tests[i].list, list_count);
+	data = IPv4ClasslessRouteListCreateData(list, list_count);
+	list_copy = IPv4ClasslessRouteListCreateWithData(data,
+							 &list_copy_count);
+	if (list_copy == NULL || list_copy_count != list_count) {
+	    fprintf(stderr, "data test %d: decode FAILED\n", i + 1);
+	    exit(1);
+	}
+	data_copy = IPv4ClasslessRouteListCreateData(list_copy,
+						     list_copy_count);
+	if (IPv4ClasslessRouteListDataEqual(data, data_copy) == FALSE) {
+	    fprintf(stderr, "data test %d: round-trip FAILED\n", i + 1);
+	    exit(1);
+	}
+	CFRelease(data_copy);
+	list_copy[list_copy_count - 1].gate.s_addr ^= htonl(1);
+	data_copy = IPv4ClasslessRouteListCreateData(list_copy,
+						     list_copy_count);
+	if (IPv4ClasslessRouteListDataEqual(data, data_copy)) {
+	    fprintf(stderr, "data test %d: change not detected\n", i + 1);
+	    exit(1);
+	}
+	printf("data test %d (%d routes, %ld bytes) SUCCESS\n", i + 1,
+	       list_count, CFDataGetLength(data));
+	CFRelease(data_copy);
+	CFRelease(data);
+	free(list_copy);
+	free(list);
+    }
+    return;
+}
+
+STATIC void
+data_bench(void)
+{
+    CFArrayRef			array;
+    CFArrayRef			array_prev;
+    CFDataRef			data;
+    CFDataRef			data_prev;
+    int				i;
+    IPv4ClasslessRouteRef	list;
+    CFAbsoluteTime		start;
+    double			t_array;
+    double			t_data;
+
+    list = BenchRouteListCreate(BENCH_ROUTE_COUNT);
+
+    /* unchanged renew: build the representation, compare with previous */
+    array_prev = BenchRouteArrayCreate(list, BENCH_ROUTE_COUNT);
+    start = CFAbsoluteTimeGetCurrent();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+	array = BenchRouteArrayCreate(list, BENCH_ROUTE_COUNT);
+	if (!CFEqual(array, array_prev)) {
+	    fprintf(stderr, "bench: array mismatch\n");
+	    exit(1);
+	}
+	CFRelease(array);
+    }
+    t_array = (CFAbsoluteTimeGetCurrent() - start) / BENCH_ITERATIONS;
+    CFRelease(array_prev);
+
+    data_prev = IPv4ClasslessRouteListCreateData(list, BENCH_ROUTE_COUNT);
+    start = CFAbsoluteTimeGetCurrent();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+	data = IPv4ClasslessRouteListCreateData(list, BENCH_ROUTE_COUNT);
+	if (IPv4ClasslessRouteListDataEqual(data, data_prev) == FALSE) {
+	    fprintf(stderr, "bench: data mismatch\n");
+	    exit(1);
+	}
+	CFRelease(data);
+    }
+    t_data = (CFAbsoluteTimeGetCurrent() - start) / BENCH_ITERATIONS;
+    printf("%d routes: dictionary array %.1f us, data %.1f us (%ld bytes)\n",
+	   BENCH_ROUTE_COUNT, t_array * 1e6, t_data * 1e6,
+	   CFDataGetLength(data_prev));
+    CFRelease(data_prev);
+    free(list);
+    return;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -641,6 +949,8 @@ main(int argc, char * argv[])
 	}
     }
 
+    data_test();
+    data_bench();
     exit(0);
     return (0);
 }
@@ -40,6 +40,7 @@
 #include <stdint.h>
 #include <netinet/in.h>
 #include <CoreFoundation/CFArray.h>
+#include <CoreFoundation/CFData.h>
 #include "symbol_scope.h"
 
 typedef struct {
@@ -64,5 +65,18 @@ IPv4ClasslessRouteRef
 IPv4ClasslessRouteListCreateWithArray(CFArrayRef string_list,
 				      int * ret_count);
 
+/*
+ * Compact binary encoding of a route list, carrying a digest of the routes
+ * so that an unchanged list can be detected with a single comparison.
+ */
+CFDataRef
+IPv4ClasslessRouteListCreateData(IPv4ClasslessRouteRef list, int list_count);
+
+IPv4ClasslessRouteRef
+IPv4ClasslessRouteListCreateWithData(CFDataRef data, int * ret_count);
+
+bool
+IPv4ClasslessRouteListDataEqual(CFDataRef data1, CFDataRef data2);
+
 #endif /* _S_IPV4CLASSLESSROUTE_H */
 
@@ -56,6 +56,7 @@
 #include "NICachePrivate.h"
 #include "util.h"
 #include "netinfo.h"
+#include "memaccount.h"
 #include "symbol_scope.h"
 
 #ifdef NICACHE_TEST
@@ -100,8 +101,9 @@ S_timestamp(char * msg)
 PRIVATE_EXTERN PLCacheEntry_t *
 PLCacheEntry_create(ni_proplist pl)
 {
-    PLCacheEntry_t * entry = malloc(sizeof(*entry));
+    PLCacheEntry_t * entry;
 
+    entry = memaccount_malloc(kMemAccountNICache, sizeof(*entry));
     if (entry == NULL)
 	return (NULL);
     entry->pl = ni_proplist_dup(pl);
@@ -114,7 +116,7 @@ PLCacheEntry_free(PLCacheEntry_t * ent)
 {
     ni_proplist_free(&ent->pl);
     bzero(ent, sizeof(*ent));
-    free(ent);
+    memaccount_free(kMemAccountNICache, ent);
     return;
 }
 
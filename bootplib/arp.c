@@ -80,6 +80,7 @@
 #include <sys/socket.h>
 #include <sys/sysctl.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
 
 #include <net/if.h>
 #include <net/if_dl.h>
@@ -442,14 +443,17 @@ arp_get_next_seq(void)
     return (++rtm_seq);
 }
 
-static int
-route_get(int s, route_msg * msg_p, struct in_addr iaddr, int if_index)
+/*
+ * Function: arp_get_request_init
+ * Purpose:
+ *   Fill in an RTM_GET_SILENT request for the given address, and return
+ *   its length. The sequence number is in msg_p->m_rtm.rtm_seq.
+ */
+int
+arp_get_request_init(route_msg * msg_p, struct in_addr iaddr, int if_index)
 {
-    ssize_t			n;
-    int 			pid = getpid();
     struct rt_msghdr *		rtm = &(msg_p->m_rtm);
     struct sockaddr_inarp *	sin;
-    int 			rtm_seq;
 
     bzero((char *)rtm, sizeof(*rtm));
     rtm->rtm_flags = RTF_LLINFO;
@@ -462,9 +466,22 @@ route_get(int s, route_msg * msg_p, struct in_addr iaddr, int if_index)
     sin = (struct sockaddr_inarp *)(rtm + 1);
     *sin = blank_sin;
     sin->sin_addr = iaddr;
-    n = rtm->rtm_msglen = sizeof(*rtm) + sizeof(*sin);
-    rtm->rtm_seq = rtm_seq = arp_get_next_seq();
+    rtm->rtm_msglen = sizeof(*rtm) + sizeof(*sin);
+    rtm->rtm_seq = arp_get_next_seq();
     rtm->rtm_type = RTM_GET_SILENT;
+    return (rtm->rtm_msglen);
+}
+
+static int
+route_get(int s, route_msg * msg_p, struct in_addr iaddr, int if_index)
+{
+    ssize_t			n;
+    int 			pid = getpid();
+    struct rt_msghdr *		rtm = &(msg_p->m_rtm);
+    int 			rtm_seq;
+
+    n = arp_get_request_init(msg_p, iaddr, if_index);
+    rtm_seq = rtm->rtm_seq;
     if (write(s, (char *)msg_p, n) != n) {
 	return (ARP_RETURN_WRITE_FAILED);
     }
@@ -497,18 +514,19 @@ is_arp_sdl_type(int sdl_type)
     return (0);
 }
 
+/*
+ * Function: arp_get_reply_check
+ * Purpose:
+ *   Check whether an RTM_GET reply contains an ARP entry for the address.
+ */
 int
-arp_get(int s, route_msg * msg_p, struct in_addr iaddr, int if_index)
+arp_get_reply_check(route_msg * msg_p, struct in_addr iaddr)
 {
     int				ret;
     struct rt_msghdr *		rtm = &(msg_p->m_rtm);
     struct sockaddr_inarp *	sin;
     struct sockaddr_dl *	sdl;
 
-    ret = route_get(s, msg_p, iaddr, if_index);
-    if (ret) {
-	goto done;
-    }
 #define WHICH_RTA	(RTA_DST | RTA_GATEWAY)
     ret = ARP_RETURN_HOST_NOT_FOUND;
     if ((rtm->rtm_addrs & (WHICH_RTA)) != WHICH_RTA
@@ -531,6 +549,53 @@ arp_get(int s, route_msg * msg_p, struct in_addr iaddr, int if_index)
     return (ret);
 }
 
+/*
+ * Function: arp_get_reply_link_address
+ * Purpose:
+ *   Copy the link-layer address out of an ARP entry returned by the
+ *   kernel. Returns its length, or 0 if the entry is incomplete or has
+ *   expired.
+ * Assumes:
+ *   arp_get_reply_check() returned ARP_RETURN_SUCCESS for msg_p.
+ */
+int
+arp_get_reply_link_address(route_msg * msg_p, void * hwaddr, int hwaddr_size)
+{
+    struct rt_msghdr *		rtm = &(msg_p->m_rtm);
+    struct sockaddr_inarp *	sin;
+    struct sockaddr_dl *	sdl;
+    struct timeval		tv;
+
+    sin = (struct sockaddr_inarp *)msg_p->m_space;
+    /* ALIGN: msg_p->m_space is aligned sufficiently to dereference 
+     * sdl safely */
+    sdl = (struct sockaddr_dl *)(void *)(sin->sin_len + (char *)sin);
+    if (sdl->sdl_alen == 0 || sdl->sdl_alen > hwaddr_size) {
+	return (0);
+    }
+    if (rtm->rtm_rmx.rmx_expire != 0) {
+	/* rmx_expire is wall-clock time, 0 means permanent */
+	gettimeofday(&tv, NULL);
+	if (rtm->rtm_rmx.rmx_expire <= tv.tv_sec) {
+	    return (0);
+	}
+    }
+    bcopy(LLADDR(sdl), hwaddr, sdl->sdl_alen);
+    return (sdl->sdl_alen);
+}
+
+int
+arp_get(int s, route_msg * msg_p, struct in_addr iaddr, int if_index)
+{
+    int				ret;
+
+    ret = route_get(s, msg_p, iaddr, if_index);
+    if (ret) {
+	return (ret);
+    }
+    return (arp_get_reply_check(msg_p, iaddr));
+}
+
 /*
  * Function: arp_delete
  *
@@ -56,5 +56,11 @@ int 		arp_delete(int s, struct in_addr iaddr, int if_index);
 int		arp_flush(int s, int all, int if_index);
 int		arp_open_routing_socket(void);
 int		arp_get_next_seq(void);
+int		arp_get_request_init(route_msg * msg_p, struct in_addr iaddr,
+				     int if_index);
+int		arp_get_reply_check(route_msg * msg_p, struct in_addr iaddr);
+int		arp_get_reply_link_address(route_msg * msg_p, void * hwaddr,
+					   int hwaddr_size);
+const char *	arp_strerror(int err);
 
 #endif /* _S_ARP_H */
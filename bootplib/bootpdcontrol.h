@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * bootpdcontrol.h
+ * - the bootpd control socket
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_BOOTPDCONTROL_H
+#define _S_BOOTPDCONTROL_H
+
+/*
+ * When control_socket is enabled in bootpd.plist, bootpd listens on a
+ * local stream socket that only root can connect to.  A client writes
+ * a single query terminated by a newline, and bootpd writes the text
+ * reply and closes the connection.
+ */
+#define BOOTPD_CONTROL_SOCKET_PATH	"/var/run/bootpd.control"
+
+/* the largest query, including the newline */
+#define BOOTPD_CONTROL_QUERY_MAX	128
+
+/* per-subsystem memory: live bytes, objects, high-water mark */
+#define BOOTPD_CONTROL_QUERY_MEMORY	"memory"
+
+/* shadow evaluation of shadow_config: counters, overhead, sampled diffs */
+#define BOOTPD_CONTROL_QUERY_SHADOW	"shadow"
+
+/* HTTP boot server: connections, requests, responses, bytes sent */
+#define BOOTPD_CONTROL_QUERY_HTTP_BOOT	"http_boot"
+
+#endif /* _S_BOOTPDCONTROL_H */
@@ -1204,21 +1204,272 @@ dhcpoa_vendor_add(dhcpoa_t * oa_p, dhcpoa_t * vendor_oa_p,
 }
 
 
+/*
+ * Function: dhcpoa_encoded_length
+ *
+ * Purpose:
+ *   Return the space required to hold an option of the given length.
+ *   Options longer than DHCP_OPTION_SIZE_MAX are split into several
+ *   consecutive instances of the same tag (RFC 3396).
+ */
+STATIC int
+dhcpoa_encoded_length(int len)
+{
+    int		count;
+
+    count = (len + DHCP_OPTION_SIZE_MAX - 1) / DHCP_OPTION_SIZE_MAX;
+    if (count == 0) {
+	count = 1;
+    }
+    return (len + count * OPTION_OFFSET);
+}
+
+/*
+ * Function: dhcpoa_capacity
+ *
+ * Purpose:
+ *   Return how many bytes of option data fit in the given space.
+ */
+STATIC int
+dhcpoa_capacity(int space)
+{
+    int		capacity = 0;
+
+    while (space > OPTION_OFFSET) {
+	int	chunk = space - OPTION_OFFSET;
+
+	if (chunk > DHCP_OPTION_SIZE_MAX) {
+	    chunk = DHCP_OPTION_SIZE_MAX;
+	}
+	capacity += chunk;
+	space -= chunk + OPTION_OFFSET;
+    }
+    return (capacity);
+}
+
+/*
+ * Function: dhcpoa_encode
+ *
+ * Purpose:
+ *   Write up to max_len bytes of the option into buf, using as many
+ *   instances as needed, but not more than space bytes.
+ *   Returns the number of option bytes written, and the space consumed
+ *   in *used_p.
+ */
+STATIC int
+dhcpoa_encode(uint8_t * buf, int space, dhcptag_t tag, int len,
+	      const uint8_t * option, int * used_p)
+{
+    int		used = 0;
+    int		written = 0;
+
+    do {
+	int	chunk = len - written;
+
+	if (chunk > DHCP_OPTION_SIZE_MAX) {
+	    chunk = DHCP_OPTION_SIZE_MAX;
+	}
+	if (chunk > (space - used - OPTION_OFFSET)) {
+	    chunk = space - used - OPTION_OFFSET;
+	}
+	if (chunk < 0 || (chunk == 0 && len != 0)) {
+	    break;
+	}
+	buf[used + TAG_OFFSET] = tag;
+	buf[used + LEN_OFFSET] = chunk;
+	if (chunk != 0) {
+	    bcopy(option + written, buf + used + OPTION_OFFSET, chunk);
+	}
+	used += chunk + OPTION_OFFSET;
+	written += chunk;
+    } while (written < len);
+    *used_p = used;
+    return (written);
+}
+
+STATIC int
+dhcpoa_overload_reserve(dhcpoa_t * oa_p)
+{
+    /* room for the option overload option, until it's been added */
+    if (oa_p->oa_overload != 0 && oa_p->oa_overload_used == 0) {
+	return (OPTION_OFFSET + 1);
+    }
+    return (0);
+}
+
+STATIC void
+dhcpoa_overload_mark_used(dhcpoa_t * oa_p, int which)
+{
+    uint8_t *	buf = (uint8_t *)oa_p->oa_buffer;
+
+    if (oa_p->oa_overload_used == 0) {
+	/* use the space that dhcpoa_overload_reserve() set aside */
+	oa_p->oa_overload_offset = oa_p->oa_offset;
+	buf[oa_p->oa_offset + TAG_OFFSET] = dhcptag_option_overload_e;
+	buf[oa_p->oa_offset + LEN_OFFSET] = 1;
+	oa_p->oa_offset += OPTION_OFFSET + 1;
+    }
+    oa_p->oa_overload_used |= which;
+    buf[oa_p->oa_overload_offset + OPTION_OFFSET] = oa_p->oa_overload_used;
+    return;
+}
+
+/*
+ * Function: dhcpoa_add_overload
+ *
+ * Purpose:
+ *   Place an option that doesn't fit in the option area into the
+ *   file and/or sname fields. An option that fits in a single instance
+ *   is placed whole in the first field with enough room. A long option
+ *   is spread across the option area, file, and sname, in the order
+ *   that the receiver concatenates them.
+ */
+STATIC dhcpoa_ret_t
+dhcpoa_add_overload(dhcpoa_t * oa_p, dhcptag_t tag, int len,
+		    const uint8_t * option)
+{
+    struct {
+	int		which;
+	uint8_t *	buf;
+	int *		offset_p;
+	int		space;
+    } areas[3];
+    int		areas_count = 0;
+    int		capacity;
+    int		i;
+    int		main_space;
+    int		needed = dhcpoa_encoded_length(len);
+    int		written;
+
+    main_space = oa_p->oa_size - oa_p->oa_offset - oa_p->oa_reserve
+	- dhcpoa_overload_reserve(oa_p);
+    if ((oa_p->oa_size - oa_p->oa_offset - oa_p->oa_reserve)
+	< dhcpoa_overload_reserve(oa_p)) {
+	/* no room left for the option overload option itself */
+	return (dhcpoa_full_e);
+    }
+    if ((oa_p->oa_overload & DHCP_OVERLOAD_FILE) != 0) {
+	areas[areas_count].which = DHCP_OVERLOAD_FILE;
+	areas[areas_count].buf = oa_p->oa_file;
+	areas[areas_count].offset_p = &oa_p->oa_file_offset;
+	/* leave room for the end tag */
+	areas[areas_count].space = sizeof(((struct dhcp *)0)->dp_file)
+	    - oa_p->oa_file_offset - 1;
+	areas_count++;
+    }
+    if ((oa_p->oa_overload & DHCP_OVERLOAD_SNAME) != 0) {
+	areas[areas_count].which = DHCP_OVERLOAD_SNAME;
+	areas[areas_count].buf = oa_p->oa_sname;
+	areas[areas_count].offset_p = &oa_p->oa_sname_offset;
+	areas[areas_count].space = sizeof(((struct dhcp *)0)->dp_sname)
+	    - oa_p->oa_sname_offset - 1;
+	areas_count++;
+    }
+    if (len <= DHCP_OPTION_SIZE_MAX) {
+	for (i = 0; i < areas_count; i++) {
+	    int		used;
+
+	    if (areas[i].space < needed) {
+		continue;
+	    }
+	    dhcpoa_overload_mark_used(oa_p, areas[i].which);
+	    (void)dhcpoa_encode(areas[i].buf + *areas[i].offset_p,
+				areas[i].space, tag, len, option, &used);
+	    *areas[i].offset_p += used;
+	    return (dhcpoa_success_e);
+	}
+	return (dhcpoa_full_e);
+    }
+
+    /* make sure the entire option fits before writing any of it */
+    capacity = dhcpoa_capacity(main_space);
+    for (i = 0; i < areas_count; i++) {
+	capacity += dhcpoa_capacity(areas[i].space);
+    }
+    if (capacity < len) {
+	return (dhcpoa_full_e);
+    }
+    written = 0;
+    if (main_space > OPTION_OFFSET) {
+	int		used;
+
+	written = dhcpoa_encode((uint8_t *)oa_p->oa_buffer + oa_p->oa_offset,
+				main_space, tag, len, option, &used);
+	oa_p->oa_prev_last = oa_p->oa_last;
+	oa_p->oa_last = oa_p->oa_offset;
+	oa_p->oa_offset += used;
+    }
+    for (i = 0; i < areas_count && written < len; i++) {
+	int		used;
+
+	if (areas[i].space <= OPTION_OFFSET) {
+	    continue;
+	}
+	/* option 52 goes in the space set aside in the option area */
+	dhcpoa_overload_mark_used(oa_p, areas[i].which);
+	written += dhcpoa_encode(areas[i].buf + *areas[i].offset_p,
+				 areas[i].space, tag, len - written,
+				 option + written, &used);
+	*areas[i].offset_p += used;
+    }
+    return (dhcpoa_success_e);
+}
+
+/*
+ * Function: dhcpoa_set_overload
+ *
+ * Purpose:
+ *   Allow options that don't fit in the option area to be placed in
+ *   the file and/or sname fields of pkt, as specified by which
+ *   (DHCP_OVERLOAD_{FILE, SNAME, BOTH}). The fields are cleared.
+ *   The option overload option is added to the option area only if
+ *   one of the fields ends up being used.
+ * Note:
+ *   Call this before any option has spilled over, and don't write
+ *   to the fields afterwards.
+ */
+PRIVATE_EXTERN void
+dhcpoa_set_overload(dhcpoa_t * oa_p, struct dhcp * pkt, int which)
+{
+    if (oa_p->oa_overload_used != 0) {
+	return;
+    }
+    oa_p->oa_overload = which & DHCP_OVERLOAD_BOTH;
+    oa_p->oa_file = NULL;
+    oa_p->oa_sname = NULL;
+    oa_p->oa_file_offset = 0;
+    oa_p->oa_sname_offset = 0;
+    if ((which & DHCP_OVERLOAD_FILE) != 0) {
+	oa_p->oa_file = pkt->dp_file;
+	bzero(pkt->dp_file, sizeof(pkt->dp_file));
+    }
+    if ((which & DHCP_OVERLOAD_SNAME) != 0) {
+	oa_p->oa_sname = pkt->dp_sname;
+	bzero(pkt->dp_sname, sizeof(pkt->dp_sname));
+    }
+    return;
+}
+
 /*
  * Function: dhcpoa_add
  *
  * Purpose:
  *   Add an option to the option area.
+ *   An option longer than DHCP_OPTION_SIZE_MAX is encoded as multiple
+ *   instances (RFC 3396). If the option area is full, and overload was
+ *   enabled with dhcpoa_set_overload(), the option is placed in the
+ *   file/sname fields.
  */
 PRIVATE_EXTERN dhcpoa_ret_t
 dhcpoa_add(dhcpoa_t * oa_p, dhcptag_t tag, int len, const void * option)
 {
+    int		needed;
 
     oa_p->oa_err.str[0] = '\0';
 
-    if (len > DHCP_OPTION_SIZE_MAX) {
+    if (len < 0) {
 	snprintf(oa_p->oa_err.str, sizeof(oa_p->oa_err.str), 
-		 "tag %d option %d > %d", tag, len, DHCP_OPTION_SIZE_MAX);
+		 "tag %d option length %d invalid", tag, len);
 	return (dhcpoa_failed_e);
     }
 
@@ -1246,6 +1497,14 @@ dhcpoa_add(dhcpoa_t * oa_p, dhcptag_t tag, int len, const void * option)
 	((uint8_t *)oa_p->oa_buffer)[oa_p->oa_offset + TAG_OFFSET] = tag;
 	oa_p->oa_offset++;
 	oa_p->oa_end_tag = TRUE;
+
+	/* terminate the overloaded fields too, space was set aside */
+	if ((oa_p->oa_overload_used & DHCP_OVERLOAD_FILE) != 0) {
+	    oa_p->oa_file[oa_p->oa_file_offset++] = tag;
+	}
+	if ((oa_p->oa_overload_used & DHCP_OVERLOAD_SNAME) != 0) {
+	    oa_p->oa_sname[oa_p->oa_sname_offset++] = tag;
+	}
 	break;
 
       case dhcptag_pad_e:
@@ -1261,29 +1520,86 @@ dhcpoa_add(dhcpoa_t * oa_p, dhcptag_t tag, int len, const void * option)
 	break;
 
       default:
-	/* 2 for tag/len */
-	if ((oa_p->oa_offset + len + 2 + oa_p->oa_reserve) > oa_p->oa_size) {
+	needed = dhcpoa_encoded_length(len);
+	if ((oa_p->oa_offset + needed + oa_p->oa_reserve
+	     + dhcpoa_overload_reserve(oa_p)) > oa_p->oa_size) {
+	    if (oa_p->oa_overload != 0
+		&& dhcpoa_add_overload(oa_p, tag, len, option)
+		== dhcpoa_success_e) {
+		break;
+	    }
 	    snprintf(oa_p->oa_err.str, sizeof(oa_p->oa_err.str),
 		     "can't add tag %d (%d > %d)", tag,
-		     oa_p->oa_offset + len + 2 + oa_p->oa_reserve, 
+		     oa_p->oa_offset + needed + oa_p->oa_reserve, 
 		     oa_p->oa_size);
 	    return (dhcpoa_full_e);
 	}
-	((uint8_t *)oa_p->oa_buffer)[oa_p->oa_offset + TAG_OFFSET] = tag;
-	((uint8_t *)oa_p->oa_buffer)[oa_p->oa_offset + LEN_OFFSET] = len;
-	if (len) {
-	    bcopy(option, (u_char *)oa_p->oa_buffer 
-		  + (OPTION_OFFSET + oa_p->oa_offset), len);
+	{
+	    int		used;
+
+	    (void)dhcpoa_encode((uint8_t *)oa_p->oa_buffer + oa_p->oa_offset,
+				needed, tag, len, option, &used);
+	    oa_p->oa_prev_last = oa_p->oa_last;
+	    oa_p->oa_last = oa_p->oa_offset;
+	    oa_p->oa_offset += used;
 	}
-	oa_p->oa_prev_last = oa_p->oa_last;
-	oa_p->oa_last = oa_p->oa_offset;
-	oa_p->oa_offset += len + OPTION_OFFSET;
 	break;
     }
     oa_p->oa_option_count++;
     return (dhcpoa_success_e);
 }
 
+/*
+ * Function: dhcpoa_reserve_last
+ *
+ * Purpose:
+ *   Set aside room in the option area for an option of the given length
+ *   that must be the last one in it, like the relay agent information
+ *   option (RFC 3046). Options added afterwards with dhcpoa_add() don't
+ *   use the room; the option itself is added with dhcpoa_add_last().
+ */
+PRIVATE_EXTERN dhcpoa_ret_t
+dhcpoa_reserve_last(dhcpoa_t * oa_p, int len)
+{
+    int		needed;
+
+    oa_p->oa_err.str[0] = '\0';
+    if (len < 0) {
+	snprintf(oa_p->oa_err.str, sizeof(oa_p->oa_err.str),
+		 "option length %d invalid", len);
+	return (dhcpoa_failed_e);
+    }
+    needed = dhcpoa_encoded_length(len);
+    if ((oa_p->oa_offset + needed + oa_p->oa_reserve) > oa_p->oa_size) {
+	snprintf(oa_p->oa_err.str, sizeof(oa_p->oa_err.str),
+		 "can't reserve %d bytes (%d > %d)", needed,
+		 oa_p->oa_offset + needed + oa_p->oa_reserve,
+		 oa_p->oa_size);
+	return (dhcpoa_full_e);
+    }
+    oa_p->oa_reserve += needed;
+    oa_p->oa_reserve_last += needed;
+    return (dhcpoa_success_e);
+}
+
+/*
+ * Function: dhcpoa_add_last
+ *
+ * Purpose:
+ *   Add the last option, using the room set aside by dhcpoa_reserve_last().
+ *   The option always goes in the option area, never in the file/sname
+ *   fields, and only the end tag may follow it.
+ */
+PRIVATE_EXTERN dhcpoa_ret_t
+dhcpoa_add_last(dhcpoa_t * oa_p, dhcptag_t tag, int len, const void * option)
+{
+    oa_p->oa_reserve -= oa_p->oa_reserve_last;
+    oa_p->oa_reserve_last = 0;
+    /* nothing spills over after this, so option 52 needs no room */
+    oa_p->oa_overload = 0;
+    return (dhcpoa_add(oa_p, tag, len, option));
+}
+
 /*
  * Function: dhcpoa_add_from_strlist
  *
@@ -1366,7 +1682,8 @@ dhcpoa_freespace(dhcpoa_t * oa_p)
     if (oa_p == NULL || oa_p->oa_magic != DHCPOA_MAGIC) {
 	return 0;
     }
-    freespace = oa_p->oa_size - oa_p->oa_offset - oa_p->oa_reserve;
+    freespace = oa_p->oa_size - oa_p->oa_offset - oa_p->oa_reserve
+	- dhcpoa_overload_reserve(oa_p);
     if (freespace < 0) {
 	freespace = 0;
     }
@@ -1474,6 +1791,165 @@ char test_string_253[253] = "test string 253 characters long (zero padded)";
 STATIC char buf[2048];
 STATIC char vend_buf[255];
 
+/*
+ * Function: long_option_test
+ * Purpose:
+ *   Build a reply of at most max_size bytes containing a long option,
+ *   optionally allowing overload, then parse it with dhcpol_parse_packet()
+ *   and check that the option comes back intact.
+ */
+STATIC boolean_t
+long_option_test(const char * name, int option_len, int max_size,
+		 int overload, boolean_t should_fit)
+{
+    dhcpo_err_str_t	err;
+    int			i;
+    uint8_t		option[1024];
+    dhcpoa_t		opts;
+    dhcpol_t		options;
+    struct dhcp *	pkt = (struct dhcp *)buf;
+    boolean_t		passed = FALSE;
+    dhcpoa_ret_t	ret;
+    void *		result = NULL;
+    int			result_len;
+    int			size;
+
+    printf("\nLong option test: %s: ", name);
+    for (i = 0; i < option_len; i++) {
+	option[i] = (uint8_t)i;
+    }
+    bzero(buf, sizeof(buf));
+    bcopy(rfc_magic, pkt->dp_options, RFC_MAGIC_SIZE);
+    dhcpoa_init(&opts, pkt->dp_options + RFC_MAGIC_SIZE,
+		max_size - sizeof(*pkt) - RFC_MAGIC_SIZE);
+    if (overload != 0) {
+	dhcpoa_set_overload(&opts, pkt, overload);
+    }
+    if (dhcpoa_add_dhcpmsg(&opts, dhcp_msgtype_ack_e) != dhcpoa_success_e) {
+	printf("FAILED\ncouldn't add message type, %s\n", dhcpoa_err(&opts));
+	return (FALSE);
+    }
+    ret = dhcpoa_add(&opts, dhcptag_classless_static_route_e, option_len,
+		     option);
+    if (ret != dhcpoa_success_e) {
+	if (should_fit) {
+	    printf("FAILED\ncouldn't add option, %s\n", dhcpoa_err(&opts));
+	}
+	else {
+	    printf("PASSED\n");
+	    passed = TRUE;
+	}
+	return (passed);
+    }
+    if (!should_fit) {
+	printf("FAILED\noption should not have fit\n");
+	return (FALSE);
+    }
+    if (dhcpoa_add(&opts, dhcptag_end_e, 0, NULL) != dhcpoa_success_e) {
+	printf("FAILED\ncouldn't add end tag, %s\n", dhcpoa_err(&opts));
+	return (FALSE);
+    }
+    size = sizeof(*pkt) + RFC_MAGIC_SIZE + dhcpoa_used(&opts);
+    if (size > max_size) {
+	printf("FAILED\npacket size %d > %d\n", size, max_size);
+	return (FALSE);
+    }
+    if (dhcpol_parse_packet(&options, pkt, size, &err) == FALSE) {
+	printf("FAILED\nparse failed, %s\n", err.str);
+	return (FALSE);
+    }
+    result = dhcpol_option_copy(&options, dhcptag_classless_static_route_e,
+				&result_len);
+    if (result == NULL || result_len != option_len
+	|| bcmp(result, option, option_len) != 0) {
+	printf("FAILED\noption mismatch (length %d != %d)\n",
+	       result_len, option_len);
+    }
+    else if (dhcpol_find(&options, dhcptag_dhcp_message_type_e,
+			 NULL, NULL) == NULL) {
+	printf("FAILED\nmessage type missing\n");
+    }
+    else {
+	printf("PASSED (size %d, overload %d)\n", size,
+	       opts.oa_overload_used);
+	passed = TRUE;
+    }
+    if (result != NULL) {
+	free(result);
+    }
+    dhcpol_free(&options);
+    return (passed);
+}
+
+/*
+ * Function: last_option_test
+ * Purpose:
+ *   Reserve room for the relay agent information option in a small
+ *   option area that overloads the file field, fill the area so that
+ *   another option has to spill over, and check that the relay agent
+ *   information ends up last in the option area.
+ */
+STATIC boolean_t
+last_option_test(void)
+{
+    dhcpo_err_str_t	err;
+    uint8_t		filler[48];
+    int			last;
+    dhcpoa_t		opts;
+    dhcpol_t		options;
+    struct dhcp *	pkt = (struct dhcp *)buf;
+    boolean_t		passed = FALSE;
+    uint8_t		rai[10];
+    int			size;
+
+    printf("\nLast option test: ");
+    memset(filler, 1, sizeof(filler));
+    memset(rai, 2, sizeof(rai));
+    bzero(buf, sizeof(buf));
+    bcopy(rfc_magic, pkt->dp_options, RFC_MAGIC_SIZE);
+    dhcpoa_init(&opts, pkt->dp_options + RFC_MAGIC_SIZE, 64);
+    dhcpoa_set_overload(&opts, pkt, DHCP_OVERLOAD_FILE);
+    if (dhcpoa_reserve_last(&opts, sizeof(rai)) != dhcpoa_success_e
+	|| dhcpoa_add_dhcpmsg(&opts, dhcp_msgtype_ack_e) != dhcpoa_success_e
+	|| dhcpoa_add(&opts, dhcptag_classless_static_route_e,
+		      sizeof(filler), filler) != dhcpoa_success_e
+	|| dhcpoa_add_last(&opts, dhcptag_relay_agent_information_e,
+			   sizeof(rai), rai) != dhcpoa_success_e
+	|| dhcpoa_add(&opts, dhcptag_end_e, 0, NULL) != dhcpoa_success_e) {
+	printf("FAILED\ncouldn't add options, %s\n", dhcpoa_err(&opts));
+	return (FALSE);
+    }
+    last = opts.oa_last;
+    if (opts.oa_overload_used != DHCP_OVERLOAD_FILE) {
+	printf("FAILED\nfiller didn't spill into the file field\n");
+	return (FALSE);
+    }
+    if (((uint8_t *)opts.oa_buffer)[last + TAG_OFFSET]
+	!= dhcptag_relay_agent_information_e
+	|| ((uint8_t *)opts.oa_buffer)[last + OPTION_OFFSET + sizeof(rai)]
+	!= dhcptag_end_e) {
+	printf("FAILED\nrelay agent information isn't last\n");
+	return (FALSE);
+    }
+    size = sizeof(*pkt) + RFC_MAGIC_SIZE + dhcpoa_used(&opts);
+    if (dhcpol_parse_packet(&options, pkt, size, &err) == FALSE) {
+	printf("FAILED\nparse failed, %s\n", err.str);
+	return (FALSE);
+    }
+    if (dhcpol_find(&options, dhcptag_classless_static_route_e,
+		    NULL, NULL) == NULL
+	|| dhcpol_find(&options, dhcptag_relay_agent_information_e,
+		       NULL, NULL) == NULL) {
+	printf("FAILED\noption missing\n");
+    }
+    else {
+	printf("PASSED\n");
+	passed = TRUE;
+    }
+    dhcpol_free(&options);
+    return (passed);
+}
+
 int
 main()
 {
@@ -1532,6 +2008,51 @@ main()
 	dhcpol_free(&options);
     }
 
+    {
+	boolean_t	all_passed = TRUE;
+
+	/* RFC 3396 split, fits in the option area */
+	if (!long_option_test("split 600", 600, 1500, 0, TRUE)) {
+	    all_passed = FALSE;
+	}
+	/* exactly one instance */
+	if (!long_option_test("single 255", 255, 1500, 0, TRUE)) {
+	    all_passed = FALSE;
+	}
+	/* doesn't fit in a 576 byte packet without overload */
+	if (!long_option_test("no overload 400", 400, DHCP_PACKET_MIN, 0,
+			      FALSE)) {
+	    all_passed = FALSE;
+	}
+	/* spills into the file field */
+	if (!long_option_test("overload file 400", 400, DHCP_PACKET_MIN,
+			      DHCP_OVERLOAD_FILE, TRUE)) {
+	    all_passed = FALSE;
+	}
+	/* needs both file and sname */
+	if (!long_option_test("overload both 480", 480, DHCP_PACKET_MIN,
+			      DHCP_OVERLOAD_BOTH, TRUE)) {
+	    all_passed = FALSE;
+	}
+	/* a single instance placed whole in the file field */
+	if (!long_option_test("overload short", 120,
+			      sizeof(struct dhcp) + RFC_MAGIC_SIZE + 64,
+			      DHCP_OVERLOAD_FILE, TRUE)) {
+	    all_passed = FALSE;
+	}
+	/* too big even with overload */
+	if (!long_option_test("overload too big", 700, DHCP_PACKET_MIN,
+			      DHCP_OVERLOAD_BOTH, FALSE)) {
+	    all_passed = FALSE;
+	}
+	if (!last_option_test()) {
+	    all_passed = FALSE;
+	}
+	if (!all_passed) {
+	    exit(1);
+	}
+    }
+
     printf("\nTesting dhcpoa\n");
     {
 	struct in_addr	iaddr;
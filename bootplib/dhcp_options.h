@@ -85,7 +85,16 @@ struct dhcpoa_s {
     int		oa_prev_last;	/* the offset of the option previous to last */
     int		oa_option_count;/* number of options present */
     dhcpo_err_str_t oa_err;	/* error string */
-    int		oa_reserve; 	/* space to reserve, either 0 or 1 */
+    int		oa_reserve; 	/* space to reserve, end tag and reserve_last */
+    int		oa_reserve_last;/* space set aside for the option added last */
+    /* option overload (RFC 2131 option 52) */
+    int		oa_overload;	/* DHCP_OVERLOAD_* areas we may spill into */
+    int		oa_overload_used; /* DHCP_OVERLOAD_* areas holding options */
+    int		oa_overload_offset; /* offset of option 52 in oa_buffer */
+    uint8_t *	oa_file;	/* pkt->dp_file */
+    int		oa_file_offset;
+    uint8_t *	oa_sname;	/* pkt->dp_sname */
+    int		oa_sname_offset;
 };
 
 /*
@@ -114,9 +123,18 @@ dhcpoa_init(dhcpoa_t * opt, void * buffer, int size);
 void
 dhcpoa_init_no_end(dhcpoa_t * opt, void * buffer, int size);
 
+void
+dhcpoa_set_overload(dhcpoa_t * oa_p, struct dhcp * pkt, int which);
+
 dhcpoa_ret_t
 dhcpoa_add(dhcpoa_t * oa_p, dhcptag_t tag, int len, const void * option);
 
+dhcpoa_ret_t
+dhcpoa_reserve_last(dhcpoa_t * oa_p, int len);
+
+dhcpoa_ret_t
+dhcpoa_add_last(dhcpoa_t * oa_p, dhcptag_t tag, int len, const void * option);
+
 dhcpoa_ret_t
 dhcpoa_add_from_strlist(dhcpoa_t * oa_p, dhcptag_t tag, 
 			const char * * strlist, int strlist_len);
@@ -108,7 +108,7 @@ static const dhcptag_info_t dhcptag_info_table[] = {
   /*  79 */ { dhcptype_opaque_e   , "slp_service_scope" },
   /*  80 */ { dhcptype_opaque_e   , "option_80" },
   /*  81 */ { dhcptype_opaque_e   , "option_81" },
-  /*  82 */ { dhcptype_opaque_e   , "option_82" },
+  /*  82 */ { dhcptype_opaque_e   , "relay_agent_information" },
   /*  83 */ { dhcptype_opaque_e   , "option_83" },
   /*  84 */ { dhcptype_opaque_e   , "option_84" },
   /*  85 */ { dhcptype_opaque_e   , "option_85" },
@@ -119,7 +119,7 @@ static const dhcptag_info_t dhcptag_info_table[] = {
   /*  90 */ { dhcptype_opaque_e   , "option_90" },
   /*  91 */ { dhcptype_opaque_e   , "option_91" },
   /*  92 */ { dhcptype_opaque_e   , "option_92" },
-  /*  93 */ { dhcptype_opaque_e   , "option_93" },
+  /*  93 */ { dhcptype_uint16_mult_e, "client_system_architecture" },
   /*  94 */ { dhcptype_opaque_e   , "option_94" },
   /*  95 */ { dhcptype_string_e   , "ldap_url" },
   /*  96 */ { dhcptype_opaque_e   , "option_96" },
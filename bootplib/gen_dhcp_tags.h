@@ -120,6 +120,12 @@ enum {
     dhcptag_tftp_server_name_e         	= 66,
     dhcptag_bootfile_name_e            	= 67,
 
+    /* relay agent information (RFC 3046) */
+    dhcptag_relay_agent_information_e  	= 82,
+
+    /* client system architecture (RFC 4578) */
+    dhcptag_client_system_architecture_e	= 93,
+
     /* IPv6-only preferred (RFC 8925) */
     dhcptag_ipv6_only_preferred_e      	= 108,
 
@@ -148,7 +154,6 @@ enum {
     dhcptag_77_e                       	= 77,
     dhcptag_80_e                       	= 80,
     dhcptag_81_e                       	= 81,
-    dhcptag_82_e                       	= 82,
     dhcptag_83_e                       	= 83,
     dhcptag_84_e                       	= 84,
     dhcptag_85_e                       	= 85,
@@ -159,7 +164,6 @@ enum {
     dhcptag_90_e                       	= 90,
     dhcptag_91_e                       	= 91,
     dhcptag_92_e                       	= 92,
-    dhcptag_93_e                       	= 93,
     dhcptag_94_e                       	= 94,
     dhcptag_96_e                       	= 96,
     dhcptag_97_e                       	= 97,
@@ -397,6 +401,8 @@ enum {
 #define DHCPTAG_CLIENT_IDENTIFIER          	"client_identifier"
 #define DHCPTAG_TFTP_SERVER_NAME           	"tftp_server_name"
 #define DHCPTAG_BOOTFILE_NAME              	"bootfile_name"
+#define DHCPTAG_RELAY_AGENT_INFORMATION    	"relay_agent_information"
+#define DHCPTAG_CLIENT_SYSTEM_ARCHITECTURE 	"client_system_architecture"
 #define DHCPTAG_IPV6_ONLY_PREFERRED        	"ipv6_only_preferred"
 #define DHCPTAG_NETINFO_SERVER_ADDRESS     	"netinfo_server_address"
 #define DHCPTAG_NETINFO_SERVER_TAG         	"netinfo_server_tag"
@@ -412,7 +418,6 @@ enum {
 #define DHCPTAG_77                         	"77"
 #define DHCPTAG_80                         	"80"
 #define DHCPTAG_81                         	"81"
-#define DHCPTAG_82                         	"82"
 #define DHCPTAG_83                         	"83"
 #define DHCPTAG_84                         	"84"
 #define DHCPTAG_85                         	"85"
@@ -423,7 +428,6 @@ enum {
 #define DHCPTAG_90                         	"90"
 #define DHCPTAG_91                         	"91"
 #define DHCPTAG_92                         	"92"
-#define DHCPTAG_93                         	"93"
 #define DHCPTAG_94                         	"94"
 #define DHCPTAG_96                         	"96"
 #define DHCPTAG_97                         	"97"
@@ -185,6 +185,10 @@ struct {
     { 61,	"uint8_mult",	"client_identifier" },
     { 66,	"ip_mult",	"tftp_server_name" },
     { 67,	"string",	"bootfile_name" },
+    { COMMENT, "/* relay agent information (RFC 3046) */", 0 },
+    { 82,	"opaque",	"relay_agent_information" },
+    { COMMENT, "/* client system architecture (RFC 4578) */", 0 },
+    { 93,	"uint16_mult",	"client_system_architecture" },
     { COMMENT, "/* IPv6-only preferred (RFC 8925) */", 0 },
     { 108,	"uint32",	"ipv6_only_preferred" },
     { COMMENT, "/* netinfo parent tags: 112, 113 */", 0 },
@@ -51,6 +51,7 @@
 #include <sys/uio.h>
 #include <syslog.h>
 #include "hostlist.h"
+#include "memaccount.h"
 
 void
 hostinsert(struct hosts * * hosts, struct hosts * hp)
@@ -92,14 +93,14 @@ hostfree(struct hosts * * hosts,
 {
     hostremove(hosts, hp);
     if (hp->hostname) {
-	free(hp->hostname);
+	memaccount_free(kMemAccountHosts, hp->hostname);
 	hp->hostname = NULL;
     }
     if (hp->bootfile) {
-	free(hp->bootfile);
+	memaccount_free(kMemAccountHosts, hp->bootfile);
 	hp->bootfile = NULL;
     }
-    free((char *)hp);
+    memaccount_free(kMemAccountHosts, hp);
 }
 
 struct hosts * 
@@ -109,7 +110,7 @@ hostadd(struct hosts * * hosts, struct timeval * tv_p, int htype,
 {
     struct hosts * hp;
 
-    hp = (struct hosts *)malloc(sizeof(*hp));
+    hp = (struct hosts *)memaccount_malloc(kMemAccountHosts, sizeof(*hp));
     if (!hp)
 	return (NULL);
     bzero(hp, sizeof(*hp));
@@ -124,9 +125,9 @@ hostadd(struct hosts * * hosts, struct timeval * tv_p, int htype,
     if (iaddr_p)
 	hp->iaddr = *iaddr_p;
     if (hostname)
-	hp->hostname = strdup(hostname);
+	hp->hostname = memaccount_strdup(kMemAccountHosts, hostname);
     if (bootfile)
-	hp->bootfile = strdup(bootfile);
+	hp->bootfile = memaccount_strdup(kMemAccountHosts, bootfile);
     hostinsert(hosts, hp);
     return (hp);
 }
@@ -673,6 +673,43 @@ if_inet_match_subnet(interface_t * if_p, struct in_addr match)
     return (INDEX_BAD);
 }
 
+/*
+ * Function: if_inet_equal
+ * Purpose:
+ *   Return whether the two interfaces have the same list of IPv4 addresses,
+ *   in the same order.
+ */
+PRIVATE_EXTERN boolean_t
+if_inet_equal(interface_t * a, interface_t * b)
+{
+    int count = if_inet_count(a);
+    int i;
+
+    if (count != if_inet_count(b)) {
+	return (FALSE);
+    }
+    for (i = 0; i < count; i++) {
+	if (bcmp(if_inet_addr_at(a, i), if_inet_addr_at(b, i),
+		 sizeof(inet_addrinfo_t)) != 0) {
+	    return (FALSE);
+	}
+    }
+    return (TRUE);
+}
+
+/*
+ * Function: if_inet_copy
+ * Purpose:
+ *   Replace the IPv4 address list of dest with a copy of the one in source.
+ */
+PRIVATE_EXTERN void
+if_inet_copy(interface_t * dest, interface_t * source)
+{
+    dynarray_free(&dest->inet);
+    (void)dynarray_dup(&dest->inet, &source->inet);
+    return;
+}
+
 PRIVATE_EXTERN void
 if_link_copy(interface_t * dest, const interface_t * source)
 {
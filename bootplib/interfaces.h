@@ -150,6 +150,9 @@ boolean_t		if_inet_valid(interface_t * if_p);
 inet_addrinfo_t *	if_inet_addr_at(interface_t * if_p, int i);
 int			if_inet_match_subnet(interface_t * if_p,
 					     struct in_addr match);
+boolean_t		if_inet_equal(interface_t * a, interface_t * b);
+void			if_inet_copy(interface_t * dest,
+				     interface_t * source);
 static inline struct in_addr
 if_inet_addr_best_match(interface_t * if_p, struct in_addr match)
 {
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * memaccount.c
+ * - count the heap memory held by each subsystem
+ * - the wrappers add a few counter updates to each malloc and free; the
+ *   size of a block being freed comes from malloc_size(), so nothing is
+ *   stored alongside the block
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc/malloc.h>
+#include "memaccount.h"
+#include "symbol_scope.h"
+
+STATIC const char *	S_tag_names[kMemAccountCount] = {
+    "netinfo",
+    "nicache",
+    "subnets",
+    "hosts",
+    "nbimages",
+    "directory",
+};
+
+STATIC MemAccountStats	S_stats[kMemAccountCount];
+STATIC uint64_t		S_live_bytes;
+STATIC uint64_t		S_high_water_bytes;
+
+PRIVATE_EXTERN void
+memaccount_note_alloc(MemAccountTag tag, size_t size)
+{
+    MemAccountStats *	stats = S_stats + tag;
+
+    stats->allocs++;
+    stats->live_objects++;
+    stats->live_bytes += size;
+    if (stats->live_bytes > stats->high_water_bytes) {
+	stats->high_water_bytes = stats->live_bytes;
+    }
+    S_live_bytes += size;
+    if (S_live_bytes > S_high_water_bytes) {
+	S_high_water_bytes = S_live_bytes;
+    }
+    return;
+}
+
+PRIVATE_EXTERN void
+memaccount_note_free(MemAccountTag tag, size_t size)
+{
+    MemAccountStats *	stats = S_stats + tag;
+
+    stats->frees++;
+    if (stats->live_objects > 0) {
+	stats->live_objects--;
+    }
+    /* don't wrap if something was freed that wasn't counted */
+    if (size > stats->live_bytes) {
+	size = stats->live_bytes;
+    }
+    stats->live_bytes -= size;
+    S_live_bytes -= size;
+    return;
+}
+
+PRIVATE_EXTERN void *
+memaccount_malloc(MemAccountTag tag, size_t size)
+{
+    void *	ptr;
+
+    ptr = malloc(size);
+    if (ptr != NULL) {
+	memaccount_note_alloc(tag, malloc_size(ptr));
+    }
+    return (ptr);
+}
+
+PRIVATE_EXTERN void *
+memaccount_realloc(MemAccountTag tag, void * ptr, size_t size)
+{
+    size_t	old_size;
+    void *	new_ptr;
+
+    if (ptr == NULL) {
+	return (memaccount_malloc(tag, size));
+    }
+    old_size = malloc_size(ptr);
+    new_ptr = realloc(ptr, size);
+    if (new_ptr != NULL) {
+	MemAccountStats *	stats = S_stats + tag;
+	size_t			new_size = malloc_size(new_ptr);
+
+	/* the same object, resized */
+	memaccount_note_free(tag, old_size);
+	memaccount_note_alloc(tag, new_size);
+	stats->allocs--;
+	stats->frees--;
+    }
+    else if (size == 0) {
+	/* realloc() may free the block instead of shrinking it */
+	memaccount_note_free(tag, old_size);
+    }
+    return (new_ptr);
+}
+
+PRIVATE_EXTERN char *
+memaccount_strdup(MemAccountTag tag, const char * str)
+{
+    size_t	len = strlen(str) + 1;
+    char *	ret;
+
+    ret = memaccount_malloc(tag, len);
+    if (ret != NULL) {
+	memcpy(ret, str, len);
+    }
+    return (ret);
+}
+
+PRIVATE_EXTERN void
+memaccount_free(MemAccountTag tag, void * ptr)
+{
+    if (ptr == NULL) {
+	return;
+    }
+    memaccount_note_free(tag, malloc_size(ptr));
+    free(ptr);
+    return;
+}
+
+PRIVATE_EXTERN const char *
+memaccount_tag_name(MemAccountTag tag)
+{
+    if (tag < 0 || tag >= kMemAccountCount) {
+	return ("<unknown>");
+    }
+    return (S_tag_names[tag]);
+}
+
+PRIVATE_EXTERN void
+memaccount_get_stats(MemAccountTag tag, MemAccountStats * stats)
+{
+    *stats = S_stats[tag];
+    return;
+}
+
+PRIVATE_EXTERN int
+memaccount_report(char * buf, int buf_size)
+{
+    int			i;
+    int			len;
+    int			n;
+    uint64_t		objects = 0;
+
+    len = snprintf(buf, buf_size, "%-10s %14s %12s %14s %12s %12s\n",
+		   "subsystem", "live_bytes", "objects", "high_water",
+		   "allocs", "frees");
+    for (i = 0; i < kMemAccountCount; i++) {
+	MemAccountStats *	stats = S_stats + i;
+
+	objects += stats->live_objects;
+	n = snprintf(buf + len, (len < buf_size) ? buf_size - len : 0,
+		     "%-10s %14llu %12llu %14llu %12llu %12llu\n",
+		     S_tag_names[i],
+		     (unsigned long long)stats->live_bytes,
+		     (unsigned long long)stats->live_objects,
+		     (unsigned long long)stats->high_water_bytes,
+		     (unsigned long long)stats->allocs,
+		     (unsigned long long)stats->frees);
+	len += n;
+    }
+    n = snprintf(buf + len, (len < buf_size) ? buf_size - len : 0,
+		 "%-10s %14llu %12llu %14llu\n", "total",
+		 (unsigned long long)S_live_bytes,
+		 (unsigned long long)objects,
+		 (unsigned long long)S_high_water_bytes);
+    len += n;
+    if (len >= buf_size) {
+	len = buf_size - 1;
+    }
+    return (len);
+}
+
+#ifdef TEST_MEMACCOUNT
+
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "netinfo.h"
+#include "NICache.h"
+#include "NICachePrivate.h"
+#include "hostlist.h"
+
+/*
+ * Build the lease list of a server with the given number of bound
+ * clients, each lease shaped like the ones dhcpd creates, and report
+ * what each subsystem holds.
+ */
+static void
+usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [ -leases <count> ] [ -hosts <count> ]\n",
+	    progname);
+    exit(1);
+}
+
+int
+main(int argc, char * argv[])
+{
+    char		buf[2048];
+    int			host_count = 0;
+    struct hosts *	hosts = NULL;
+    int			i;
+    int			lease_count = 1000000;
+    PLCache_t		leases;
+    MemAccountStats	stats;
+    uint64_t		total;
+
+    for (i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-leases") == 0 && (i + 1) < argc) {
+	    lease_count = atoi(argv[++i]);
+	}
+	else if (strcmp(argv[i], "-hosts") == 0 && (i + 1) < argc) {
+	    host_count = atoi(argv[++i]);
+	}
+	else {
+	    usage(argv[0]);
+	}
+    }
+    PLCache_init(&leases);
+    PLCache_set_max(&leases, lease_count);
+    for (i = 0; i < lease_count; i++) {
+	char		hwstr[32];
+	char		idstr[32];
+	struct in_addr	iaddr;
+	char		lease_str[32];
+	char		name[32];
+	ni_proplist	pl;
+
+	iaddr.s_addr = htonl(0x0a000000 + i);
+	snprintf(hwstr, sizeof(hwstr), "0:50:56:%x:%x:%x",
+		 (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+	snprintf(idstr, sizeof(idstr), "1,%s", hwstr);
+	snprintf(name, sizeof(name), "client-%d", i);
+	snprintf(lease_str, sizeof(lease_str), "0x%x", 0x70000000 + i);
+	NI_INIT(&pl);
+	ni_proplist_addprop(&pl, NIPROP_NAME, name);
+	ni_proplist_addprop(&pl, NIPROP_IPADDR, inet_ntoa(iaddr));
+	ni_proplist_addprop(&pl, NIPROP_HWADDR, hwstr);
+	ni_proplist_addprop(&pl, NIPROP_IDENTIFIER, idstr);
+	ni_proplist_addprop(&pl, NIPROP_DHCP_LEASE, lease_str);
+	PLCache_append(&leases, PLCacheEntry_create(pl));
+	ni_proplist_free(&pl);
+    }
+    for (i = 0; i < host_count; i++) {
+	uint8_t		hwaddr[6] = { 0, 0x50, 0x56, 0, 0, 0 };
+	struct in_addr	iaddr;
+
+	hwaddr[3] = (i >> 16) & 0xff;
+	hwaddr[4] = (i >> 8) & 0xff;
+	hwaddr[5] = i & 0xff;
+	iaddr.s_addr = htonl(0x0b000000 + i);
+	hostadd(&hosts, NULL, 1, (char *)hwaddr, sizeof(hwaddr), &iaddr,
+		"host", NULL);
+    }
+    memaccount_report(buf, sizeof(buf));
+    printf("%d leases, %d hosts\n%s", lease_count, host_count, buf);
+    if (lease_count > 0) {
+	/* a lease is a cache entry and its property list */
+	memaccount_get_stats(kMemAccountNICache, &stats);
+	total = stats.live_bytes;
+	memaccount_get_stats(kMemAccountNetInfo, &stats);
+	total += stats.live_bytes;
+	printf("%.1f bytes per lease\n", (double)total / lease_count);
+    }
+
+    /* everything counted must be released again */
+    PLCache_free(&leases);
+    while (hosts != NULL) {
+	hostfree(&hosts, hosts);
+    }
+    for (i = 0; i < kMemAccountCount; i++) {
+	memaccount_get_stats(i, &stats);
+	if (stats.live_bytes != 0 || stats.live_objects != 0) {
+	    fprintf(stderr, "%s: %llu bytes %llu objects still live\n",
+		    memaccount_tag_name(i),
+		    (unsigned long long)stats.live_bytes,
+		    (unsigned long long)stats.live_objects);
+	    exit(1);
+	}
+    }
+    printf("all released\n");
+    exit(0);
+    return (0);
+}
+
+#endif /* TEST_MEMACCOUNT */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * memaccount.h
+ * - count the heap memory held by each subsystem
+ */
+
+/*
+ * Modification History
+ *
+ * October 18, 2026
+ * - created
+ */
+
+#ifndef _S_MEMACCOUNT_H
+#define _S_MEMACCOUNT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    kMemAccountNetInfo = 0,	/* ni_proplist names, values and arrays */
+    kMemAccountNICache,		/* lease and client cache entries */
+    kMemAccountSubnets,		/* subnet entries and their option data */
+    kMemAccountHosts,		/* struct hosts entries */
+    kMemAccountNetBootImages,	/* NetBoot image entries */
+    kMemAccountDirectory,	/* copies of directory user records */
+    kMemAccountCount
+} MemAccountTag;
+
+typedef struct {
+    uint64_t		live_bytes;
+    uint64_t		live_objects;
+    uint64_t		high_water_bytes;
+    uint64_t		allocs;
+    uint64_t		frees;
+} MemAccountStats;
+
+/*
+ * The byte counts are the sizes of the malloc blocks, as returned by
+ * malloc_size(), so they include the allocator's rounding.  The counters
+ * aren't locked: each program using them allocates on a single thread.
+ */
+void *
+memaccount_malloc(MemAccountTag tag, size_t size);
+
+void *
+memaccount_realloc(MemAccountTag tag, void * ptr, size_t size);
+
+char *
+memaccount_strdup(MemAccountTag tag, const char * str);
+
+void
+memaccount_free(MemAccountTag tag, void * ptr);
+
+/*
+ * Function: memaccount_note_alloc, memaccount_note_free
+ * Purpose:
+ *   Count memory the subsystem didn't allocate through the wrappers above.
+ */
+void
+memaccount_note_alloc(MemAccountTag tag, size_t size);
+
+void
+memaccount_note_free(MemAccountTag tag, size_t size);
+
+const char *
+memaccount_tag_name(MemAccountTag tag);
+
+void
+memaccount_get_stats(MemAccountTag tag, MemAccountStats * stats);
+
+/*
+ * Function: memaccount_report
+ * Purpose:
+ *   Format a line per subsystem and a total line into buf.
+ *   Returns the length of the report, which is truncated if it doesn't
+ *   fit in buf_size.
+ */
+int
+memaccount_report(char * buf, int buf_size);
+
+#endif /* _S_MEMACCOUNT_H */
@@ -45,6 +45,7 @@
 #include "util.h"
 #include "NetBootServer.h"
 #include "NetBootImageInfo.h"
+#include "memaccount.h"
 
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -265,6 +266,13 @@ NBImageList_elementWithID(NBImageListRef image_list, bsdp_image_id_t image_id)
     return (NULL);
 }
 
+static void
+NBImageEntry_free(void * entry)
+{
+    memaccount_free(kMemAccountNetBootImages, entry);
+    return;
+}
+
 void
 NBImageList_free(NBImageListRef * l)
 {
@@ -278,7 +286,7 @@ NBImageList_free(NBImageListRef * l)
 	return;
     }
     dynarray_free(&image_list->list);
-    free(image_list);
+    memaccount_free(kMemAccountNetBootImages, image_list);
     *l = NULL;
     return;
 }
@@ -911,7 +919,8 @@ NBImageEntry_create(NBSPEntryRef sharepoint, char * dir_name,
 	break;
     }
 
-    entry = (NBImageEntryRef)malloc(sizeof(*entry) + tail_space);
+    entry = (NBImageEntryRef)memaccount_malloc(kMemAccountNetBootImages,
+					       sizeof(*entry) + tail_space);
     if (entry == NULL) {
 	goto failed;
     }
@@ -1079,7 +1088,7 @@ NBImageEntry_create(NBSPEntryRef sharepoint, char * dir_name,
 
  failed:
     if (entry != NULL) {
-	free(entry);
+	memaccount_free(kMemAccountNetBootImages, entry);
 	entry = NULL;
     }
     my_CFRelease(&plist);
@@ -1187,7 +1196,7 @@ NBImageList_add_entry(NBImageListRef image_list, NBImageEntryRef entry)
 		"Ignoring image with non-unique image index %d:\n",
 		bsdp_image_index(entry->image_id));
 	NBImageEntry_print(entry);
-	free(entry);
+	memaccount_free(kMemAccountNetBootImages, entry);
 	return;
     }
     if (entry->is_default) {
@@ -1275,12 +1284,13 @@ NBImageList_init(NBSPListRef sharepoints, boolean_t allow_diskless)
     int				i;
     NBImageListRef		image_list = NULL;
 
-    image_list = (NBImageListRef)malloc(sizeof(*image_list));
+    image_list = (NBImageListRef)memaccount_malloc(kMemAccountNetBootImages,
+						   sizeof(*image_list));
     if (image_list == NULL) {
 	goto done;
     }
     bzero(image_list, sizeof(*image_list));
-    dynarray_init(&image_list->list, free, NULL);
+    dynarray_init(&image_list->list, NBImageEntry_free, NULL);
 
     count = NBSPList_count(sharepoints);
     for (i = 0; i < count; i++) {
@@ -1292,7 +1302,7 @@ NBImageList_init(NBSPListRef sharepoints, boolean_t allow_diskless)
     if (image_list != NULL) {
 	if (dynarray_count(&image_list->list) == 0) {
 	    dynarray_free(&image_list->list);
-	    free(image_list);
+	    memaccount_free(kMemAccountNetBootImages, image_list);
 	    image_list = NULL;
 	}
     }
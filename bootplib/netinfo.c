@@ -55,6 +55,7 @@
 #include <stdio.h>
 #include "host_identifier.h"
 #include "netinfo.h"
+#include "memaccount.h"
 #include "symbol_scope.h"
 
 /*
@@ -62,9 +63,10 @@
  */
 #define  mm_used() mstats()
 
-#define MM_ALLOC(obj) obj = ((void *)malloc(sizeof(*(obj))))
+#define MM_ALLOC(obj) \
+	obj = ((void *)memaccount_malloc(kMemAccountNetInfo, sizeof(*(obj))))
 
-#define MM_FREE(obj)  free((void *)(obj))
+#define MM_FREE(obj)  memaccount_free(kMemAccountNetInfo, (void *)(obj))
 
 #define MM_ZERO(obj)  bzero((void *)(obj), sizeof(*(obj)))
 
@@ -75,20 +77,22 @@
 				   (unsigned)(size)) == 0)
 
 #define MM_ALLOC_ARRAY(obj, len)  \
-	obj = ((void *)malloc(sizeof(*(obj)) * (len)))
+	obj = ((void *)memaccount_malloc(kMemAccountNetInfo, \
+					 sizeof(*(obj)) * (len)))
 
 #define MM_ZERO_ARRAY(obj, len) bzero((void *)(obj), sizeof(*obj) * len)
 
-#define MM_FREE_ARRAY(obj, len) free((void *)(obj))
+#define MM_FREE_ARRAY(obj, len) \
+	memaccount_free(kMemAccountNetInfo, (void *)(obj))
 
 #define MM_GROW_ARRAY(obj, len) \
 	((obj == NULL) ? (MM_ALLOC_ARRAY((obj), (len) + 1)) : \
-	 (obj = (void *)realloc((void *)(obj), \
-				sizeof(*(obj)) * ((len) + 1))))
+	 (obj = (void *)memaccount_realloc(kMemAccountNetInfo, (void *)(obj), \
+					   sizeof(*(obj)) * ((len) + 1))))
 
 #define MM_SHRINK_ARRAY(obj, len) \
-	obj = (void *)realloc((void *)(obj), \
-			      sizeof(*(obj)) * ((len) - 1))
+	obj = (void *)memaccount_realloc(kMemAccountNetInfo, (void *)(obj), \
+					 sizeof(*(obj)) * ((len) - 1))
 
 PRIVATE_EXTERN void
 ni_proplist_insert(
@@ -220,7 +224,7 @@ ni_name_dup(
 	 ni_name_const nm
 	 )
 {
-	return (strdup(nm));
+	return (memaccount_strdup(kMemAccountNetInfo, nm));
 }
 
 
@@ -230,7 +234,7 @@ ni_name_free(
 	     )
 {
 	if (*nm != NULL) {
-		free(*nm);
+		memaccount_free(kMemAccountNetInfo, *nm);
 		*nm = NULL;
 	}
 }
@@ -84,6 +84,7 @@
 #define NIPROP_DHCP_RELEASED	"released"
 #define NIPROP_DHCP_DECLINED	"declined"
 #define NIPROP_DHCP_LEASE	"lease"
+#define NIPROP_DHCP_PROVISIONAL	"provisional"
 #define	NIPROP_ENADDR		"en_address"
 #define	NIPROP_HWADDR		"hw_address"
 #define NIPROP_IDENTIFIER	"identifier"
@@ -64,6 +64,7 @@
 #include "DNSNameList.h"
 #include "IPv4ClasslessRoute.h"
 #include "cfutil.h"
+#include "memaccount.h"
 
 #ifdef TEST_SUBNETS
 #define my_log(level, format, ...)					\
@@ -80,8 +81,26 @@
 
 #define MAX_ERR_LEN 		256
 
+/* probe count histogram buckets: 1, 2, 3-4, 5-8, ..., 65-128, >128 */
+#define PROBE_HISTOGRAM_SIZE	9
+
+typedef struct {
+    uint32_t		allocations;
+    uint32_t		failures;
+    uint64_t		probes;		/* addresses considered */
+    uint64_t		checks;		/* calls to the in-use function */
+    uint32_t		probes_max;
+    uint32_t		histogram[PROBE_HISTOGRAM_SIZE];
+
+    /* pool selection among supernet siblings */
+    uint32_t		selected;	/* chosen, and had an address */
+    uint32_t		skipped_full;	/* passed over because it was full */
+} AllocationStats, * AllocationStatsRef;
+
 struct _SubnetList {
-    dynarray_t		list;
+    dynarray_t			list;
+    SubnetAllocationPolicy	policy;
+    uint32_t			generation;	/* of the current acquire */
 };
 
 typedef struct _OptionTLV {
@@ -107,6 +126,22 @@ struct _Subnet {
     const char *	supernet;
     OptionTLVRef	options;
     int			options_count;
+
+    /* hashed allocation */
+    bool		hashed;
+    uint32_t		probe_mask;	/* power of 2 >= range size, - 1 */
+
+    /* addresses known to be in use: a hint, func has the final say */
+    uint32_t *		in_use;		/* bitmap, one bit per address */
+    uint32_t		in_use_count;	/* bits set in in_use */
+
+    /* addresses with a committed binding, also set in in_use */
+    uint32_t *		bound;		/* bitmap, one bit per address */
+    uint32_t		bound_count;	/* bits set in bound */
+    uint32_t		size;		/* addresses in net_range */
+    uint32_t		weight;		/* share of a supernet's allocations */
+    uint32_t		generation;	/* last acquire that tried this one */
+    AllocationStats	stats;
 };
 
 typedef struct _Subnet Subnet;
@@ -188,10 +223,14 @@ SubnetPrintCFString(CFMutableStringRef str, SubnetRef subnet)
     STRING_APPEND(str, "/%s\n", inet_ntoa(subnet->net_mask));
     STRING_APPEND(str, "\tRange: %s..", inet_ntoa(subnet->net_range.start));
     STRING_APPEND(str, "%s\n", inet_ntoa(subnet->net_range.end));
-    STRING_APPEND(str, "\tAllocate: %s\n", (subnet->allocate) ? "yes" : "no");
+    STRING_APPEND(str, "\tAllocate: %s%s\n", (subnet->allocate) ? "yes" : "no",
+		  (subnet->allocate && subnet->hashed) ? " (hashed)" : "");
     if (subnet->allocate) {
 	STRING_APPEND(str, "\tLease Min: %d   Lease Max: %d\n", 
 		      subnet->lease_min, subnet->lease_max);
+	if (subnet->supernet != NULL) {
+	    STRING_APPEND(str, "\tAllocation Weight: %u\n", subnet->weight);
+	}
     }
     if (subnet->options_count != 0) {
 	int 	i;
@@ -255,35 +294,372 @@ SubnetDoesAllocate(SubnetRef subnet)
     return (subnet->allocate);
 }
 
+static void
+AllocationStatsRecord(AllocationStatsRef stats, uint32_t probes,
+		      uint32_t checks, bool success)
+{
+    int		bucket;
+
+    stats->checks += checks;
+    if (success == FALSE) {
+	stats->failures++;
+	return;
+    }
+    stats->allocations++;
+    stats->probes += probes;
+    if (probes > stats->probes_max) {
+	stats->probes_max = probes;
+    }
+    for (bucket = 0;
+	 bucket < (PROBE_HISTOGRAM_SIZE - 1) && probes > (1 << bucket);
+	 bucket++) {
+    }
+    stats->histogram[bucket]++;
+    return;
+}
+
+static void
+AllocationStatsPrintCFString(CFMutableStringRef str, AllocationStatsRef stats)
+{
+    int		i;
+
+    STRING_APPEND(str, "allocated %u failed %u probes avg %.2f max %u"
+		  " checks avg %.2f\n",
+		  stats->allocations, stats->failures,
+		  (stats->allocations != 0)
+		  ? (double)stats->probes / stats->allocations : 0.0,
+		  stats->probes_max,
+		  (stats->allocations + stats->failures != 0)
+		  ? (double)stats->checks
+		  / (stats->allocations + stats->failures) : 0.0);
+    STRING_APPEND(str, "\tprobes:");
+    for (i = 0; i < PROBE_HISTOGRAM_SIZE; i++) {
+	if (i == 0) {
+	    STRING_APPEND(str, " 1:");
+	}
+	else if (i == (PROBE_HISTOGRAM_SIZE - 1)) {
+	    STRING_APPEND(str, " >%d:", 1 << (i - 1));
+	}
+	else if (i == 1) {
+	    STRING_APPEND(str, " 2:");
+	}
+	else {
+	    STRING_APPEND(str, " %d-%d:", (1 << (i - 1)) + 1, 1 << i);
+	}
+	STRING_APPEND(str, "%u", stats->histogram[i]);
+    }
+    STRING_APPEND(str, "\n");
+    return;
+}
+
+static __inline__ bool
+bitmap_is_set(const uint32_t * bitmap, uint32_t i)
+{
+    return ((bitmap[i / 32] & (1U << (i % 32))) != 0);
+}
+
+static __inline__ void
+bitmap_set(uint32_t * bitmap, uint32_t i)
+{
+    bitmap[i / 32] |= (1U << (i % 32));
+}
+
+static __inline__ void
+bitmap_clear(uint32_t * bitmap, uint32_t i)
+{
+    bitmap[i / 32] &= ~(1U << (i % 32));
+}
+
+/*
+ * Function: bitmap_find_clear
+ * Purpose:
+ *   Returns the first clear bit in [lo, hi], or UINT32_MAX if there
+ *   isn't one.  Skips words that are all set.
+ */
+static uint32_t
+bitmap_find_clear(const uint32_t * bitmap, uint32_t lo, uint32_t hi)
+{
+    uint32_t	i;
+
+    for (i = lo; i <= hi; ) {
+	if ((i % 32) == 0 && bitmap[i / 32] == 0xffffffff) {
+	    i += 32;
+	    continue;
+	}
+	if (bitmap_is_set(bitmap, i) == FALSE) {
+	    return (i);
+	}
+	i++;
+    }
+    return (UINT32_MAX);
+}
+
+static void
+SubnetMarkInUse(SubnetRef subnet, uint32_t slot)
+{
+    if (bitmap_is_set(subnet->in_use, slot) == FALSE) {
+	bitmap_set(subnet->in_use, slot);
+	subnet->in_use_count++;
+    }
+    return;
+}
+
+/*
+ * Function: SubnetMarkFree
+ * Purpose:
+ *   Forget that the address is in use, unless it's bound.
+ */
+static void
+SubnetMarkFree(SubnetRef subnet, uint32_t slot)
+{
+    if (bitmap_is_set(subnet->bound, slot)) {
+	return;
+    }
+    if (bitmap_is_set(subnet->in_use, slot)) {
+	bitmap_clear(subnet->in_use, slot);
+	subnet->in_use_count--;
+    }
+    return;
+}
+
+static void
+SubnetMarkBound(SubnetRef subnet, uint32_t slot)
+{
+    if (bitmap_is_set(subnet->bound, slot) == FALSE) {
+	bitmap_set(subnet->bound, slot);
+	subnet->bound_count++;
+    }
+    SubnetMarkInUse(subnet, slot);
+    return;
+}
+
+static void
+SubnetMarkUnbound(SubnetRef subnet, uint32_t slot)
+{
+    if (bitmap_is_set(subnet->bound, slot)) {
+	bitmap_clear(subnet->bound, slot);
+	subnet->bound_count--;
+    }
+    SubnetMarkFree(subnet, slot);
+    return;
+}
+
+static __inline__ bool
+SubnetIsFull(SubnetRef subnet)
+{
+    return (subnet->in_use_count >= subnet->size);
+}
+
+/*
+ * Function: SubnetAcquireAddressSequential
+ * Purpose:
+ *   Allocate the next free address after the last one allocated,
+ *   wrapping around to the start of the range.
+ *
+ *   Like SubnetAcquireAddressHashed(), the first pass only considers
+ *   addresses that the in_use bitmap doesn't mark as in use, and the
+ *   second pass re-checks every address, so a failure means that the
+ *   range is full.
+ */
+static bool
+SubnetAcquireAddressSequential(SubnetRef subnet,
+			       SubnetIsAddressInUseFuncRef func, void * arg,
+			       struct in_addr * ret_addr)
+{
+    uint32_t	checks = 0;
+    in_addr_t	first;
+    int		pass;
+    uint32_t	probes = 0;
+    uint32_t	slot;
+    uint32_t	start;
+
+    first = iptohl(subnet->net_range.start);
+    start = iptohl(subnet->nextip) - first;
+    if (start >= subnet->size) { /* previously exhausted ip range */
+	start = 0;
+    }
+    for (pass = 0; pass < 2; pass++) {
+	int		segment;
+
+	/* [start, size - 1], then [0, start - 1] */
+	for (segment = 0; segment < 2; segment++) {
+	    uint32_t	hi;
+
+	    if (segment == 0) {
+		slot = start;
+		hi = subnet->size - 1;
+	    }
+	    else if (start == 0) {
+		break;
+	    }
+	    else {
+		slot = 0;
+		hi = start - 1;
+	    }
+	    for (; slot <= hi; slot++) {
+		struct in_addr	ip;
+
+		if (pass == 0) {
+		    slot = bitmap_find_clear(subnet->in_use, slot, hi);
+		    if (slot == UINT32_MAX) {
+			break;
+		    }
+		}
+		probes++;
+		checks++;
+		ip = hltoip(first + slot);
+		if (func == NULL || (*func)(arg, ip) == FALSE) {
+		    *ret_addr = ip;
+		    subnet->nextip = ip;
+		    SubnetMarkInUse(subnet, slot);
+		    AllocationStatsRecord(&subnet->stats, probes, checks,
+					  TRUE);
+		    return (TRUE);
+		}
+		SubnetMarkInUse(subnet, slot);
+	    }
+	}
+    }
+    subnet->nextip = hltoip(first + subnet->size);
+    AllocationStatsRecord(&subnet->stats, probes, checks, FALSE);
+    return (FALSE);
+}
+
+/*
+ * Function: S_client_key_hash
+ * Purpose:
+ *   FNV-1a hash of the client key, with a final mixing step so that
+ *   similar keys (e.g. consecutive MAC addresses) spread out.
+ */
+static uint32_t
+S_client_key_hash(const char * key)
+{
+    uint32_t	hash = 2166136261U;
+
+    for (; *key != '\0'; key++) {
+	hash ^= (uint8_t)*key;
+	hash *= 16777619U;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return (hash);
+}
+
+/*
+ * Function: SubnetAcquireAddressHashed
+ * Purpose:
+ *   Allocate an address starting at the client's preferred position in
+ *   the range, derived from a hash of its key.  The range is probed
+ *   using triangular steps (1, 2, 3, ...) modulo the next power of 2,
+ *   which visits each position once; positions past the end of the
+ *   range are skipped.
+ *
+ *   The in_use bitmap remembers addresses found to be in use so that
+ *   later probes don't need to call func again.  It's only a hint: the
+ *   preferred address is always checked, so that a returning client
+ *   gets its address back, and if the first pass fails, a second pass
+ *   re-checks every address.  Addresses that aren't bound are cleared
+ *   when their offer is dropped, or by SubnetListForgetAddressesInUse().
+ */
+static bool
+SubnetAcquireAddressHashed(SubnetRef subnet,
+			   SubnetIsAddressInUseFuncRef func, void * arg,
+			   const char * client_key, struct in_addr * ret_addr)
+{
+    uint32_t	checks = 0;
+    in_addr_t	first;
+    int		pass;
+    uint32_t	probes = 0;
+    uint32_t	size;
+
+    first = iptohl(subnet->net_range.start);
+    size = iptohl(subnet->net_range.end) - first + 1;
+    for (pass = 0; pass < 2; pass++) {
+	uint32_t	i;
+	uint32_t	slot;
+
+	slot = S_client_key_hash(client_key) % size;
+	for (i = 0; i <= subnet->probe_mask; i++) {
+	    if (slot < size) {
+		probes++;
+		if (i == 0 || pass != 0
+		    || bitmap_is_set(subnet->in_use, slot) == FALSE) {
+		    struct in_addr	ip = hltoip(first + slot);
+
+		    checks++;
+		    if (func == NULL || (*func)(arg, ip) == FALSE) {
+			SubnetMarkInUse(subnet, slot);
+			*ret_addr = ip;
+			AllocationStatsRecord(&subnet->stats, probes, checks,
+					      TRUE);
+			return (TRUE);
+		    }
+		    SubnetMarkInUse(subnet, slot);
+		}
+	    }
+	    slot = (slot + i + 1) & subnet->probe_mask;
+	}
+    }
+    AllocationStatsRecord(&subnet->stats, probes, checks, FALSE);
+    return (FALSE);
+}
+
 static bool
 SubnetAcquireAddress(SubnetRef subnet,
 		     SubnetIsAddressInUseFuncRef func, void * arg,
-		     struct in_addr * ret_addr)
+		     const char * client_key, struct in_addr * ret_addr)
 {
-    in_addr_t 	end;
-    in_addr_t 	i;
-
     if (SubnetDoesAllocate(subnet) == FALSE) {
 	return (FALSE);
     }
-    end = iptohl(subnet->net_range.end);
-    i = iptohl(subnet->nextip);
-    if (i == (end + 1)) { /* previously exhausted ip range */
-	i = iptohl(subnet->net_range.start);
+    if (subnet->hashed && client_key != NULL) {
+	return (SubnetAcquireAddressHashed(subnet, func, arg, client_key,
+					   ret_addr));
     }
-    for (; i <= end; i++) {
-	if (func == NULL
-	    || (*func)(arg, hltoip(i)) == FALSE) {
-	    *ret_addr = hltoip(i);
-	    subnet->nextip = hltoip(i);
-	    return (TRUE);
-	}
+    return (SubnetAcquireAddressSequential(subnet, func, arg, ret_addr));
+}
+
+static void
+SubnetReleaseAddress(SubnetRef subnet, struct in_addr ip)
+{
+    if (subnet->in_use != NULL) {
+	SubnetMarkUnbound(subnet,
+			  iptohl(ip) - iptohl(subnet->net_range.start));
     }
-    subnet->nextip = hltoip(end + 1);
-    return (FALSE);
+    return;
+}
+
+static void
+SubnetClearAddressInUse(SubnetRef subnet, struct in_addr ip)
+{
+    if (subnet->in_use != NULL) {
+	SubnetMarkFree(subnet, iptohl(ip) - iptohl(subnet->net_range.start));
+    }
+    return;
+}
+
+static void
+SubnetNoteAddressBound(SubnetRef subnet, struct in_addr ip)
+{
+    if (subnet->in_use != NULL) {
+	SubnetMarkBound(subnet, iptohl(ip) - iptohl(subnet->net_range.start));
+    }
+    return;
 }
 
-static const char *
+static void
+SubnetNoteAddressInUse(SubnetRef subnet, struct in_addr ip)
+{
+    if (subnet->in_use != NULL) {
+	SubnetMarkInUse(subnet, iptohl(ip) - iptohl(subnet->net_range.start));
+    }
+    return;
+}
+
+const char *
 SubnetGetName(SubnetRef subnet)
 {
     return (subnet->name);
@@ -816,6 +1192,9 @@ SubnetCreateWithDictionary(CFDictionaryRef plist, char * err, int err_len)
     ip_range_t		net_range;
     CFArrayRef		net_range_prop;
     CFStringRef		name_prop;
+    bool		allocate;
+    bool		hashed;
+    int			in_use_space = 0;
     int			name_space = 0;
     char *		offset;
     CFArrayRef 		option_list = NULL;
@@ -965,22 +1344,60 @@ SubnetCreateWithDictionary(CFDictionaryRef plist, char * err, int err_len)
 	tail_space += name_space;
     }
 
+    allocate = S_get_plist_boolean(plist, CFSTR("allocate"), FALSE);
+    hashed = S_get_plist_boolean(plist, CFSTR(SUBNET_PROP_HASHED_ALLOCATION),
+				 FALSE);
+    if (allocate || hashed) {
+	uint32_t	size;
+
+	size = iptohl(net_range.end) - iptohl(net_range.start) + 1;
+	in_use_space = roundup(howmany(size, 32) * sizeof(uint32_t),
+			       sizeof(char *));
+	tail_space += 2 * in_use_space;	/* in_use, bound */
+    }
+
     option_list = createOptionsDataArrayFromDictionary(plist, &option_space);
     if (option_list != NULL) {
 	option_space = roundup(option_space, sizeof(char *))
 	    + (int)CFArrayGetCount(option_list) * sizeof(OptionTLV);
 	tail_space += option_space;
     }
-    subnet = malloc(sizeof(*subnet) + tail_space);
+    subnet = memaccount_malloc(kMemAccountSubnets,
+			       sizeof(*subnet) + tail_space);
     bzero(subnet, sizeof(*subnet));
     SubnetSetLeaseMaxMin(subnet, plist);
     subnet->net_address = net_address;
     subnet->net_mask = net_mask;
     subnet->net_range = net_range;
-    subnet->allocate = S_get_plist_boolean(plist, CFSTR("allocate"), FALSE);
+    subnet->allocate = allocate;
+    subnet->size = iptohl(net_range.end) - iptohl(net_range.start) + 1;
+    if (my_CFTypeToNumber(CFDictionaryGetValue(plist,
+				       CFSTR(SUBNET_PROP_ALLOCATION_WEIGHT)),
+			  &subnet->weight) == FALSE
+	|| subnet->weight == 0) {
+	subnet->weight = 1;
+    }
 
     offset = (char *)(subnet + 1);
 
+    /* in-use and bound bitmaps */
+    if (in_use_space != 0) {
+	/* ALIGN: offset aligned (from malloc), cast safe. */
+	subnet->in_use = (uint32_t *)(void *)offset;
+	bzero(offset, in_use_space);
+	offset += in_use_space;
+	subnet->bound = (uint32_t *)(void *)offset;
+	bzero(offset, in_use_space);
+	offset += in_use_space;
+    }
+    if (hashed) {
+	subnet->hashed = TRUE;
+	subnet->probe_mask = 0;
+	while (subnet->probe_mask < (subnet->size - 1)) {
+	    subnet->probe_mask = (subnet->probe_mask << 1) | 1;
+	}
+    }
+
     /* copy the options */
     if (option_list != NULL) {
 	char *		route_list_opt;
@@ -1096,7 +1513,7 @@ SubnetListAddSubnet(SubnetListRef subnets, SubnetRef new_entry)
 static void
 SubnetFree(SubnetRef subnet)
 {
-    free(subnet);
+    memaccount_free(kMemAccountSubnets, subnet);
     return;
 }
 
@@ -1112,7 +1529,8 @@ SubnetListCreateWithArray(CFArrayRef list)
 	my_log(LOG_NOTICE, "subnets: type is not an array");
 	return (NULL);
     }
-    subnets = (SubnetListRef)malloc(sizeof(*subnets));
+    subnets = (SubnetListRef)memaccount_malloc(kMemAccountSubnets,
+					       sizeof(*subnets));
     if (subnets == NULL) {
 	return (NULL);
     }
@@ -1154,7 +1572,7 @@ SubnetListFree(SubnetListRef * subnets_p)
 	return;
     }
     dynarray_free(&subnets->list);
-    free(subnets);
+    memaccount_free(kMemAccountSubnets, subnets);
     *subnets_p = NULL;
     return;
 }
@@ -1188,6 +1606,349 @@ SubnetListPrint(SubnetListRef subnets)
     return;
 }
 
+/**
+ ** SubnetList image
+ **/
+
+/*
+ * Type: SubnetImageRecord
+ * Purpose:
+ *   Describes a subnet in a subnet list image.  The record is followed
+ *   by the nul-terminated name, the nul-terminated supernet (if any),
+ *   and then the options, each encoded as a SubnetImageOption followed
+ *   by the option data.  Records are padded to a multiple of 4 bytes.
+ *
+ *   The image is only meant to be read back on the same host, so
+ *   values are stored in host byte order.
+ */
+typedef struct {
+    uint32_t		size;		/* record size, including this header */
+    struct in_addr	net_address;
+    struct in_addr	net_mask;
+    struct in_addr	range_start;
+    struct in_addr	range_end;
+    uint32_t		lease_min;
+    uint32_t		lease_max;
+    uint8_t		allocate;
+    uint8_t		hashed;
+    uint16_t		options_count;
+    uint16_t		name_length;	/* including nul */
+    uint16_t		supernet_length;/* including nul, 0 if none */
+    uint32_t		options_length;	/* encoded options, in bytes */
+    uint32_t		weight;
+} SubnetImageRecord, * SubnetImageRecordRef;
+
+typedef struct {
+    uint16_t		tag;
+    uint16_t		length;
+} SubnetImageOption, * SubnetImageOptionRef;
+
+typedef struct {
+    uint32_t		count;
+} SubnetImageHeader, * SubnetImageHeaderRef;
+
+static uint32_t
+SubnetImageRecordSize(SubnetRef subnet, uint32_t * ret_options_length)
+{
+    int		i;
+    uint32_t	options_length = 0;
+    uint32_t	size;
+
+    for (i = 0; i < subnet->options_count; i++) {
+	options_length += sizeof(SubnetImageOption)
+	    + subnet->options[i].length;
+    }
+    size = sizeof(SubnetImageRecord) + (uint32_t)strlen(subnet->name) + 1;
+    if (subnet->supernet != NULL) {
+	size += (uint32_t)strlen(subnet->supernet) + 1;
+    }
+    size += options_length;
+    *ret_options_length = options_length;
+    return (roundup(size, sizeof(uint32_t)));
+}
+
+static uint8_t *
+SubnetCopyImageRecord(SubnetRef subnet, uint8_t * buf)
+{
+    int				i;
+    uint32_t			len;
+    uint8_t *			offset;
+    uint32_t			options_length;
+    SubnetImageRecordRef	record;
+
+    /* ALIGN: buf is aligned to sizeof(uint32_t), cast safe. */
+    record = (SubnetImageRecordRef)(void *)buf;
+    bzero(record, sizeof(*record));
+    record->size = SubnetImageRecordSize(subnet, &options_length);
+    record->net_address = subnet->net_address;
+    record->net_mask = subnet->net_mask;
+    record->range_start = subnet->net_range.start;
+    record->range_end = subnet->net_range.end;
+    record->lease_min = subnet->lease_min;
+    record->lease_max = subnet->lease_max;
+    record->allocate = subnet->allocate ? 1 : 0;
+    record->hashed = subnet->hashed ? 1 : 0;
+    record->weight = subnet->weight;
+    record->options_count = subnet->options_count;
+    record->options_length = options_length;
+    offset = (uint8_t *)(record + 1);
+    len = (uint32_t)strlen(subnet->name) + 1;
+    record->name_length = len;
+    bcopy(subnet->name, offset, len);
+    offset += len;
+    if (subnet->supernet != NULL) {
+	len = (uint32_t)strlen(subnet->supernet) + 1;
+	record->supernet_length = len;
+	bcopy(subnet->supernet, offset, len);
+	offset += len;
+    }
+    for (i = 0; i < subnet->options_count; i++) {
+	SubnetImageOption	opt;
+
+	opt.tag = subnet->options[i].tag;
+	opt.length = subnet->options[i].length;
+	bcopy(&opt, offset, sizeof(opt));
+	offset += sizeof(opt);
+	bcopy(subnet->options[i].value, offset, opt.length);
+	offset += opt.length;
+    }
+    return (buf + record->size);
+}
+
+/*
+ * Function: SubnetCreateWithImageRecord
+ * Purpose:
+ *   Create a subnet from a SubnetImageRecord.  The memory layout of the
+ *   subnet is the same as the one SubnetCreateWithDictionary() creates.
+ *   Returns NULL if the record is malformed.
+ */
+static SubnetRef
+SubnetCreateWithImageRecord(const uint8_t * buf, uint32_t buf_size)
+{
+    int				i;
+    int				in_use_space = 0;
+    const uint8_t *		data;
+    uint32_t			data_size;
+    char *			offset;
+    int				option_space = 0;
+    SubnetImageRecord		record;
+    uint32_t			size;
+    SubnetRef			subnet;
+    int				tail_space;
+
+    if (buf_size < sizeof(record)) {
+	return (NULL);
+    }
+    bcopy(buf, &record, sizeof(record));
+    if (record.size < sizeof(record) || record.size > buf_size
+	|| record.name_length == 0) {
+	return (NULL);
+    }
+    data = buf + sizeof(record);
+    data_size = record.size - sizeof(record);
+    if (((uint32_t)record.name_length + record.supernet_length
+	 + record.options_length) > data_size) {
+	return (NULL);
+    }
+    if (data[record.name_length - 1] != '\0'
+	|| (record.supernet_length != 0
+	    && data[record.name_length + record.supernet_length - 1] != '\0')) {
+	return (NULL);
+    }
+    if (record.options_length
+	< record.options_count * sizeof(SubnetImageOption)) {
+	return (NULL);
+    }
+    if (iptohl(record.range_start) > iptohl(record.range_end)) {
+	return (NULL);
+    }
+    size = iptohl(record.range_end) - iptohl(record.range_start) + 1;
+    if (record.allocate || record.hashed) {
+	in_use_space = roundup(howmany(size, 32) * sizeof(uint32_t),
+			       sizeof(char *));
+    }
+    if (record.options_count != 0) {
+	option_space = roundup(record.options_length
+			       - record.options_count
+			       * sizeof(SubnetImageOption),
+			       sizeof(char *))
+	    + record.options_count * sizeof(OptionTLV);
+    }
+    tail_space = 2 * in_use_space + option_space + record.name_length
+	+ record.supernet_length;
+    subnet = memaccount_malloc(kMemAccountSubnets,
+			       sizeof(*subnet) + tail_space);
+    bzero(subnet, sizeof(*subnet));
+    subnet->net_address = record.net_address;
+    subnet->net_mask = record.net_mask;
+    subnet->net_range.start = record.range_start;
+    subnet->net_range.end = record.range_end;
+    subnet->nextip = record.range_start;
+    subnet->lease_min = record.lease_min;
+    subnet->lease_max = record.lease_max;
+    subnet->allocate = (record.allocate != 0);
+    subnet->size = size;
+    subnet->weight = (record.weight != 0) ? record.weight : 1;
+    offset = (char *)(subnet + 1);
+
+    /* in-use and bound bitmaps */
+    if (in_use_space != 0) {
+	/* ALIGN: offset aligned (from malloc), cast safe. */
+	subnet->in_use = (uint32_t *)(void *)offset;
+	bzero(offset, in_use_space);
+	offset += in_use_space;
+	subnet->bound = (uint32_t *)(void *)offset;
+	bzero(offset, in_use_space);
+	offset += in_use_space;
+    }
+    if (record.hashed) {
+	subnet->hashed = TRUE;
+	subnet->probe_mask = 0;
+	while (subnet->probe_mask < (size - 1)) {
+	    subnet->probe_mask = (subnet->probe_mask << 1) | 1;
+	}
+    }
+
+    /* copy the options */
+    if (record.options_count != 0) {
+	const uint8_t *	opt_data;
+	uint32_t	opt_left;
+	char *		opt_value;
+
+	/* ALIGN: offset aligned (from malloc), cast safe. */
+	subnet->options = (OptionTLVRef)(void *)offset;
+	subnet->options_count = record.options_count;
+	opt_value = offset + record.options_count * sizeof(OptionTLV);
+	opt_data = data + record.name_length + record.supernet_length;
+	opt_left = record.options_length;
+	for (i = 0; i < record.options_count; i++) {
+	    SubnetImageOption	opt;
+
+	    if (opt_left < sizeof(opt)) {
+		goto failed;
+	    }
+	    bcopy(opt_data, &opt, sizeof(opt));
+	    opt_data += sizeof(opt);
+	    opt_left -= sizeof(opt);
+	    if (opt_left < opt.length) {
+		goto failed;
+	    }
+	    subnet->options[i].tag = opt.tag;
+	    subnet->options[i].length = opt.length;
+	    subnet->options[i].value = opt_value;
+	    bcopy(opt_data, opt_value, opt.length);
+	    opt_value += opt.length;
+	    opt_data += opt.length;
+	    opt_left -= opt.length;
+	}
+	offset += option_space;
+    }
+
+    /* copy the name */
+    subnet->name = offset;
+    bcopy(data, offset, record.name_length);
+    offset += record.name_length;
+
+    /* copy the supernet */
+    if (record.supernet_length != 0) {
+	subnet->supernet = offset;
+	bcopy(data + record.name_length, offset, record.supernet_length);
+    }
+    return (subnet);
+
+ failed:
+    memaccount_free(kMemAccountSubnets, subnet);
+    return (NULL);
+}
+
+/*
+ * Function: SubnetListCopyImage
+ * Purpose:
+ *   Return a flat, pointer-free encoding of the subnet list that can be
+ *   stored and turned back into a subnet list by
+ *   SubnetListCreateWithImage() without re-parsing the configuration.
+ *   The caller must free() the returned buffer.
+ */
+void *
+SubnetListCopyImage(SubnetListRef subnets, size_t * ret_size)
+{
+    uint8_t *		buf;
+    int			count;
+    SubnetImageHeader	header;
+    int			i;
+    uint8_t *		offset;
+    size_t		size;
+
+    count = SubnetListCount(subnets);
+    size = sizeof(header);
+    for (i = 0; i < count; i++) {
+	uint32_t	options_length;
+
+	size += SubnetImageRecordSize(SubnetListElement(subnets, i),
+				      &options_length);
+    }
+    buf = malloc(size);
+    header.count = count;
+    bcopy(&header, buf, sizeof(header));
+    offset = buf + sizeof(header);
+    for (i = 0; i < count; i++) {
+	offset = SubnetCopyImageRecord(SubnetListElement(subnets, i), offset);
+    }
+    *ret_size = size;
+    return (buf);
+}
+
+/*
+ * Function: SubnetListCreateWithImage
+ * Purpose:
+ *   Create a subnet list from an image returned by SubnetListCopyImage().
+ *   The subnets are already sorted and were checked for overlap when the
+ *   image was created, so no further validation beyond bounds checking
+ *   is done here.
+ */
+SubnetListRef
+SubnetListCreateWithImage(const void * image, size_t image_size)
+{
+    const uint8_t *	buf = (const uint8_t *)image;
+    SubnetImageHeader	header;
+    uint32_t		i;
+    size_t		left;
+    SubnetListRef	subnets;
+
+    if (image_size < sizeof(header)) {
+	return (NULL);
+    }
+    bcopy(buf, &header, sizeof(header));
+    buf += sizeof(header);
+    left = image_size - sizeof(header);
+    subnets = (SubnetListRef)memaccount_malloc(kMemAccountSubnets,
+					       sizeof(*subnets));
+    if (subnets == NULL) {
+	return (NULL);
+    }
+    bzero(subnets, sizeof(*subnets));
+    dynarray_init(&subnets->list, (void *)SubnetFree, NULL);
+    for (i = 0; i < header.count; i++) {
+	SubnetRef	entry;
+	uint32_t	size;
+
+	entry = SubnetCreateWithImageRecord(buf, (uint32_t)left);
+	if (entry == NULL) {
+	    my_log(LOG_NOTICE, "subnets: image record %d is invalid", i);
+	    goto failed;
+	}
+	dynarray_add(&subnets->list, entry);
+	bcopy(buf, &size, sizeof(size));
+	buf += size;
+	left -= size;
+    }
+    return (subnets);
+
+ failed:
+    SubnetListFree(&subnets);
+    return (NULL);
+}
+
 /*
  * Function: SubnetListAcquireAddress
  *
@@ -1198,27 +1959,142 @@ SubnetListPrint(SubnetListRef subnets)
 SubnetRef
 SubnetListAcquireAddress(SubnetListRef subnets, struct in_addr * addr,
 			 SubnetIsAddressInUseFuncRef func, void * arg)
+{
+    return (SubnetListAcquireAddressForClient(subnets, addr, func, arg, NULL));
+}
+
+void
+SubnetListSetAllocationPolicy(SubnetListRef subnets,
+			      SubnetAllocationPolicy policy)
+{
+    subnets->policy = policy;
+    return;
+}
+
+static bool
+SubnetIsSibling(SubnetRef subnet, SubnetRef entry, struct in_addr addr)
+{
+    return (subnet == entry
+	    || SubnetIsAddressOnSubnet(subnet, addr)
+	    || SubnetSameSupernetAsSubnet(subnet, entry));
+}
+
+/*
+ * Function: SubnetIsPreferred
+ * Purpose:
+ *   Returns whether the policy prefers pool a over pool b.  Utilization
+ *   only counts bound addresses, not offers or probe results.  Ties go
+ *   to the pool that comes first in the configuration.
+ */
+static bool
+SubnetIsPreferred(SubnetAllocationPolicy policy, SubnetRef a, SubnetRef b)
+{
+    switch (policy) {
+    case kSubnetAllocationPolicyLeastUtilized:
+	/* a->bound_count / a->size < b->bound_count / b->size */
+	return ((uint64_t)a->bound_count * b->size
+		< (uint64_t)b->bound_count * a->size);
+    case kSubnetAllocationPolicyWeighted:
+	/* a->bound_count / a->weight < b->bound_count / b->weight */
+	return ((uint64_t)a->bound_count * b->weight
+		< (uint64_t)b->bound_count * a->weight);
+    case kSubnetAllocationPolicyOrdered:
+    default:
+	break;
+    }
+    return (FALSE);
+}
+
+/*
+ * Function: SubnetListChoosePool
+ * Purpose:
+ *   Choose the pool among entry's siblings that hasn't been tried yet in
+ *   this acquire, has room, and is preferred by the policy.  Pools that
+ *   are full according to their in-use count are skipped without being
+ *   scanned.
+ */
+static SubnetRef
+SubnetListChoosePool(SubnetListRef subnets, SubnetRef entry,
+		     struct in_addr addr, bool count_skipped)
+{
+    SubnetRef		best = NULL;
+    int			count;
+    int			i;
+
+    count = SubnetListCount(subnets);
+    for (i = 0; i < count; i++) {
+	SubnetRef	this_entry = SubnetListElement(subnets, i);
+
+	if (this_entry->allocate == FALSE
+	    || this_entry->generation == subnets->generation
+	    || SubnetIsSibling(this_entry, entry, addr) == FALSE) {
+	    continue;
+	}
+	if (SubnetIsFull(this_entry)) {
+	    if (count_skipped) {
+		this_entry->stats.skipped_full++;
+	    }
+	    continue;
+	}
+	if (best == NULL || SubnetIsPreferred(subnets->policy, this_entry, best)) {
+	    best = this_entry;
+	}
+    }
+    return (best);
+}
+
+/*
+ * Function: SubnetListAcquireAddressForClient
+ *
+ * Purpose:
+ *   Like SubnetListAcquireAddress(), but for subnets using hashed
+ *   allocation, start looking at the client's preferred address,
+ *   derived from client_key.
+ *
+ *   The pool is chosen among the subnets on the same subnet or supernet
+ *   according to the list's allocation policy.  The in-use counts are
+ *   only hints, so if the pools with room don't have an address after
+ *   all, the ones that appear full are scanned as well.
+ */
+SubnetRef
+SubnetListAcquireAddressForClient(SubnetListRef subnets, struct in_addr * addr,
+				  SubnetIsAddressInUseFuncRef func, void * arg,
+				  const char * client_key)
 {
     int			count;
     SubnetRef		entry;
     int 		i;
+    SubnetRef		pool;
     struct in_addr	subnet_address = *addr;
 
     entry = SubnetListGetSubnetForAddress(subnets, subnet_address, FALSE);
     if (entry == NULL) {
 	return (NULL);
     }
+    subnets->generation++;
+    for (i = 0; ; i++) {
+	pool = SubnetListChoosePool(subnets, entry, subnet_address, (i == 0));
+	if (pool == NULL) {
+	    break;
+	}
+	pool->generation = subnets->generation;
+	if (SubnetAcquireAddress(pool, func, arg, client_key, addr)) {
+	    pool->stats.selected++;
+	    return (pool);
+	}
+    }
 
+    /* try the pools that appear full */
     count = SubnetListCount(subnets);
     for (i = 0; i < count; i++) {
-	SubnetRef	this_entry = SubnetListElement(subnets, i);
-
-	if (this_entry == entry
-	    || SubnetIsAddressOnSubnet(this_entry, subnet_address)
-	    || SubnetSameSupernetAsSubnet(this_entry, entry)) {
-	    if (SubnetAcquireAddress(this_entry, func, arg, addr)) {
-		return (this_entry);
-	    }
+	pool = SubnetListElement(subnets, i);
+	if (pool->generation == subnets->generation
+	    || SubnetIsSibling(pool, entry, subnet_address) == FALSE) {
+	    continue;
+	}
+	if (SubnetAcquireAddress(pool, func, arg, client_key, addr)) {
+	    pool->stats.selected++;
+	    return (pool);
 	}
     }
     return (NULL);
@@ -1244,6 +2120,142 @@ SubnetListGetSubnetForAddress(SubnetListRef subnets, struct in_addr addr,
     return (NULL);
 }
 
+/*
+ * Function: SubnetListNoteAddressInUse
+ *
+ * Purpose:
+ *   Let the subnet know that the address is in use without being bound
+ *   e.g. set aside by a tombstone, or declined.
+ */
+void
+SubnetListNoteAddressInUse(SubnetListRef subnets, struct in_addr addr)
+{
+    SubnetRef	subnet;
+
+    subnet = SubnetListGetSubnetForAddress(subnets, addr, TRUE);
+    if (subnet != NULL) {
+	SubnetNoteAddressInUse(subnet, addr);
+    }
+    return;
+}
+
+/*
+ * Function: SubnetListNoteAddressBound
+ *
+ * Purpose:
+ *   Let the subnet know that the address has a committed binding, which
+ *   counts towards the pool's utilization.
+ */
+void
+SubnetListNoteAddressBound(SubnetListRef subnets, struct in_addr addr)
+{
+    SubnetRef	subnet;
+
+    subnet = SubnetListGetSubnetForAddress(subnets, addr, TRUE);
+    if (subnet != NULL) {
+	SubnetNoteAddressBound(subnet, addr);
+    }
+    return;
+}
+
+/*
+ * Function: SubnetListClearAddressInUse
+ *
+ * Purpose:
+ *   Let the subnet know that the address is no longer held by an offer
+ *   or other transient use.  A bound address stays in use.
+ */
+void
+SubnetListClearAddressInUse(SubnetListRef subnets, struct in_addr addr)
+{
+    SubnetRef	subnet;
+
+    subnet = SubnetListGetSubnetForAddress(subnets, addr, TRUE);
+    if (subnet != NULL) {
+	SubnetClearAddressInUse(subnet, addr);
+    }
+    return;
+}
+
+/*
+ * Function: SubnetListForgetAddressesInUse
+ *
+ * Purpose:
+ *   Forget the addresses found to be in use that aren't bound, since
+ *   the probes that found them may be stale.  Addresses still in use
+ *   are found again by the next allocation that checks them.
+ */
+void
+SubnetListForgetAddressesInUse(SubnetListRef subnets)
+{
+    int		count;
+    int		i;
+
+    count = SubnetListCount(subnets);
+    for (i = 0; i < count; i++) {
+	SubnetRef	subnet = SubnetListElement(subnets, i);
+
+	if (subnet->in_use == NULL) {
+	    continue;
+	}
+	bcopy(subnet->bound, subnet->in_use,
+	      howmany(subnet->size, 32) * sizeof(uint32_t));
+	subnet->in_use_count = subnet->bound_count;
+    }
+    return;
+}
+
+/*
+ * Function: SubnetListReleaseAddress
+ *
+ * Purpose:
+ *   Let the subnet know that the address is no longer in use, and no
+ *   longer bound.
+ */
+void
+SubnetListReleaseAddress(SubnetListRef subnets, struct in_addr addr)
+{
+    SubnetRef	subnet;
+
+    subnet = SubnetListGetSubnetForAddress(subnets, addr, TRUE);
+    if (subnet != NULL) {
+	SubnetReleaseAddress(subnet, addr);
+    }
+    return;
+}
+
+void
+SubnetListPrintAllocationStatsCFString(CFMutableStringRef str,
+				       SubnetListRef subnets)
+{
+    int			count;
+    int			i;
+
+    count = SubnetListCount(subnets);
+    for (i = 0; i < count; i++) {
+	SubnetRef	entry = SubnetListElement(subnets, i);
+
+	if (entry->allocate == FALSE) {
+	    continue;
+	}
+	STRING_APPEND(str, "Subnet '%s'%s: ", SubnetGetName(entry),
+		      entry->hashed ? " (hashed)" : "");
+	AllocationStatsPrintCFString(str, &entry->stats);
+	STRING_APPEND(str, "\tbound %u/%u (%.1f%%) in use %u",
+		      entry->bound_count, entry->size,
+		      entry->bound_count * 100.0 / entry->size,
+		      entry->in_use_count);
+	if (entry->supernet != NULL) {
+	    STRING_APPEND(str, " supernet %s weight %u selected %u"
+			  " skipped full %u",
+			  entry->supernet, entry->weight,
+			  entry->stats.selected, entry->stats.skipped_full);
+	}
+	STRING_APPEND(str, "\n");
+    }
+    return;
+}
+
 bool
 SubnetListAreAddressesOnSameSupernet(SubnetListRef subnets,
 				     struct in_addr addr1,
@@ -1279,6 +2291,395 @@ SubnetPrint(SubnetRef subnet)
     CFRelease(str);
 }
 
+#define PROBE_TEST_ROUNDS	10000
+
+typedef struct {
+    uint32_t *		in_use;
+    in_addr_t		first;
+} probe_test_pool_t;
+
+static bool
+probe_test_in_use(void * arg, struct in_addr ip)
+{
+    probe_test_pool_t *	pool = (probe_test_pool_t *)arg;
+
+    return (bitmap_is_set(pool->in_use, iptohl(ip) - pool->first));
+}
+
+static SubnetListRef
+probe_test_subnets_create(uint32_t size, bool hashed)
+{
+    CFMutableDictionaryRef	dict;
+    CFArrayRef			list;
+    CFStringRef			range[2];
+    CFArrayRef			range_list;
+    SubnetListRef		subnets;
+
+    dict = CFDictionaryCreateMutable(NULL, 0,
+				     &kCFTypeDictionaryKeyCallBacks,
+				     &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_ADDRESS),
+			 CFSTR("10.0.0.0"));
+    CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_MASK),
+			 CFSTR("255.0.0.0"));
+    range[0] = CFSTR("10.0.0.1");
+    range[1] = CFStringCreateWithFormat(NULL, NULL, CFSTR("10.%d.%d.%d"),
+					(size >> 16) & 0xff,
+					(size >> 8) & 0xff, size & 0xff);
+    range_list = CFArrayCreate(NULL, (const void * *)range, 2,
+			       &kCFTypeArrayCallBacks);
+    CFRelease(range[1]);
+    CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_RANGE), range_list);
+    CFRelease(range_list);
+    CFDictionarySetValue(dict, CFSTR("allocate"), kCFBooleanTrue);
+    CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_HASHED_ALLOCATION),
+			 hashed ? kCFBooleanTrue : kCFBooleanFalse);
+    list = CFArrayCreate(NULL, (const void * *)&dict, 1,
+			 &kCFTypeArrayCallBacks);
+    CFRelease(dict);
+    subnets = SubnetListCreateWithArray(list);
+    CFRelease(list);
+    return (subnets);
+}
+
+/*
+ * Function: probe_test
+ * Purpose:
+ *   Fill a pool to the given percentage, then measure the number of
+ *   probes needed to allocate an address while clients come and go at
+ *   that fill level.  Also check that a client that gives up its
+ *   address gets the same one back.
+ */
+static void
+probe_test(uint32_t size, int fill_percent, bool hashed)
+{
+    struct in_addr *	addrs;
+    char		client_key[32];
+    uint32_t *		clients;
+    uint32_t		count;
+    uint32_t		fill;
+    struct in_addr	ip;
+    uint32_t		next_client = 0;
+    probe_test_pool_t	pool;
+    int			round;
+    uint32_t		stable = 0;
+    SubnetRef		subnet;
+    SubnetListRef	subnets;
+
+    subnets = probe_test_subnets_create(size, hashed);
+    if (subnets == NULL) {
+	fprintf(stderr, "failed to create subnet\n");
+	exit(1);
+    }
+    subnet = SubnetListElement(subnets, 0);
+    pool.first = iptohl(subnet->net_range.start);
+    pool.in_use = calloc(howmany(size, 32), sizeof(uint32_t));
+    clients = calloc(size, sizeof(*clients));
+    addrs = calloc(size, sizeof(*addrs));
+    fill = (uint32_t)((uint64_t)size * fill_percent / 100);
+    for (count = 0; count < fill; count++) {
+	snprintf(client_key, sizeof(client_key), "1,0:a:b:%x", next_client);
+	ip.s_addr = htonl(pool.first);
+	if (SubnetListAcquireAddressForClient(subnets, &ip, probe_test_in_use,
+					      &pool, client_key) == NULL) {
+	    fprintf(stderr, "pool full at %u\n", count);
+	    exit(1);
+	}
+	bitmap_set(pool.in_use, iptohl(ip) - pool.first);
+	SubnetListNoteAddressBound(subnets, ip);
+	clients[count] = next_client++;
+	addrs[count] = ip;
+    }
+    bzero(&subnet->stats, sizeof(subnet->stats));
+
+    /* clients come and go at the fill level */
+    for (round = 0; round < PROBE_TEST_ROUNDS; round++) {
+	uint32_t	which = arc4random_uniform(count);
+
+	bitmap_clear(pool.in_use, iptohl(addrs[which]) - pool.first);
+	SubnetListReleaseAddress(subnets, addrs[which]);
+	snprintf(client_key, sizeof(client_key), "1,0:a:b:%x", next_client);
+	ip.s_addr = htonl(pool.first);
+	(void)SubnetListAcquireAddressForClient(subnets, &ip,
+						probe_test_in_use,
+						&pool, client_key);
+	bitmap_set(pool.in_use, iptohl(ip) - pool.first);
+	SubnetListNoteAddressBound(subnets, ip);
+	clients[which] = next_client++;
+	addrs[which] = ip;
+    }
+    printf("%-10s %3d%%: ", hashed ? "hashed" : "sequential", fill_percent);
+    {
+	CFMutableStringRef	str;
+
+	str = CFStringCreateMutable(NULL, 0);
+	AllocationStatsPrintCFString(str, &subnet->stats);
+	my_CFStringPrint(stdout, str);
+	CFRelease(str);
+    }
+
+    /* a client gives up its address, then asks for a new one */
+    for (round = 0; round < PROBE_TEST_ROUNDS; round++) {
+	uint32_t	which = arc4random_uniform(count);
+
+	bitmap_clear(pool.in_use, iptohl(addrs[which]) - pool.first);
+	SubnetListReleaseAddress(subnets, addrs[which]);
+	snprintf(client_key, sizeof(client_key), "1,0:a:b:%x",
+		 clients[which]);
+	ip.s_addr = htonl(pool.first);
+	(void)SubnetListAcquireAddressForClient(subnets, &ip,
+						probe_test_in_use,
+						&pool, client_key);
+	if (ip.s_addr == addrs[which].s_addr) {
+	    stable++;
+	}
+	bitmap_set(pool.in_use, iptohl(ip) - pool.first);
+	SubnetListNoteAddressBound(subnets, ip);
+	addrs[which] = ip;
+    }
+    printf("\treturning clients given the same address: %.1f%%\n",
+	   stable * 100.0 / PROBE_TEST_ROUNDS);
+    free(addrs);
+    free(clients);
+    free(pool.in_use);
+    SubnetListFree(&subnets);
+    return;
+}
+
+/*
+ * Function: offer_test
+ * Purpose:
+ *   A client is offered an address while another host is using its
+ *   preferred address.  The client doesn't accept the offer, the other
+ *   host goes away, and the offer expires.  Check that no address is left
+ *   marked in use, and that the client gets its preferred address when
+ *   it comes back.
+ */
+static void
+offer_test(uint32_t size)
+{
+    const char *	client_key = "1,0:a:b:c:d:e";
+    uint32_t		count;
+    struct in_addr	ip;
+    struct in_addr	offer;
+    probe_test_pool_t	pool;
+    struct in_addr	preferred;
+    SubnetRef		subnet;
+    SubnetListRef	subnets;
+
+    subnets = probe_test_subnets_create(size, TRUE);
+    if (subnets == NULL) {
+	fprintf(stderr, "failed to create subnet\n");
+	exit(1);
+    }
+    subnet = SubnetListElement(subnets, 0);
+    pool.first = iptohl(subnet->net_range.start);
+    pool.in_use = calloc(howmany(size, 32), sizeof(uint32_t));
+
+    /* find the client's preferred address */
+    preferred.s_addr = htonl(pool.first);
+    (void)SubnetListAcquireAddressForClient(subnets, &preferred,
+					    probe_test_in_use, &pool,
+					    client_key);
+    SubnetListClearAddressInUse(subnets, preferred);
+
+    /* another host has it, and half the pool is bound */
+    bitmap_set(pool.in_use, iptohl(preferred) - pool.first);
+    for (count = 0; count < size / 2; count++) {
+	char	key[32];
+
+	snprintf(key, sizeof(key), "1,0:a:b:%x", count);
+	ip.s_addr = htonl(pool.first);
+	if (SubnetListAcquireAddressForClient(subnets, &ip, probe_test_in_use,
+					      &pool, key) == NULL) {
+	    fprintf(stderr, "pool full at %u\n", count);
+	    exit(1);
+	}
+	bitmap_set(pool.in_use, iptohl(ip) - pool.first);
+	SubnetListNoteAddressBound(subnets, ip);
+    }
+
+    /* so the offer is for a different address */
+    offer.s_addr = htonl(pool.first);
+    (void)SubnetListAcquireAddressForClient(subnets, &offer,
+					    probe_test_in_use, &pool,
+					    client_key);
+    if (offer.s_addr == preferred.s_addr
+	|| subnet->in_use_count != subnet->bound_count + 2) {
+	fprintf(stderr, "offer: expected %u in use, %u\n",
+		subnet->bound_count + 2, subnet->in_use_count);
+	exit(1);
+    }
+
+    /* the other host leaves, the offer expires, the probe is stale */
+    bitmap_clear(pool.in_use, iptohl(preferred) - pool.first);
+    SubnetListClearAddressInUse(subnets, offer);
+    SubnetListForgetAddressesInUse(subnets);
+    if (subnet->in_use_count != subnet->bound_count
+	|| subnet->bound_count != size / 2) {
+	fprintf(stderr, "expired: %u in use, %u bound, expected %u\n",
+		subnet->in_use_count, subnet->bound_count, size / 2);
+	exit(1);
+    }
+
+    /* the client comes back */
+    ip.s_addr = htonl(pool.first);
+    (void)SubnetListAcquireAddressForClient(subnets, &ip,
+					    probe_test_in_use, &pool,
+					    client_key);
+    if (ip.s_addr != preferred.s_addr) {
+	fprintf(stderr, "returning client given %s", inet_ntoa(ip));
+	fprintf(stderr, ", expected %s\n", inet_ntoa(preferred));
+	exit(1);
+    }
+    printf("offer test passed\n");
+    free(pool.in_use);
+    SubnetListFree(&subnets);
+    return;
+}
+
+#define SUPERNET_TEST_POOLS	4
+
+/*
+ * Function: supernet_test_subnets_create
+ * Purpose:
+ *   Create SUPERNET_TEST_POOLS pools of the given size on the same
+ *   supernet: pool i is 10.i.0.0/16, with allocation_weight i + 1.
+ */
+static SubnetListRef
+supernet_test_subnets_create(uint32_t size)
+{
+    CFMutableArrayRef		list;
+    int				i;
+    SubnetListRef		subnets;
+
+    list = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    for (i = 0; i < SUPERNET_TEST_POOLS; i++) {
+	CFMutableDictionaryRef	dict;
+	CFStringRef		str;
+	CFStringRef		range[2];
+	CFArrayRef		range_list;
+	CFNumberRef		weight;
+	int			weight_val = i + 1;
+
+	dict = CFDictionaryCreateMutable(NULL, 0,
+					 &kCFTypeDictionaryKeyCallBacks,
+					 &kCFTypeDictionaryValueCallBacks);
+	str = CFStringCreateWithFormat(NULL, NULL, CFSTR("10.%d.0.0"), i);
+	CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_ADDRESS), str);
+	CFRelease(str);
+	CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_MASK),
+			     CFSTR("255.255.0.0"));
+	range[0] = CFStringCreateWithFormat(NULL, NULL, CFSTR("10.%d.0.1"), i);
+	range[1] = CFStringCreateWithFormat(NULL, NULL, CFSTR("10.%d.%d.%d"),
+					    i, (size >> 8) & 0xff, size & 0xff);
+	range_list = CFArrayCreate(NULL, (const void * *)range, 2,
+				   &kCFTypeArrayCallBacks);
+	CFRelease(range[0]);
+	CFRelease(range[1]);
+	CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_NET_RANGE), range_list);
+	CFRelease(range_list);
+	CFDictionarySetValue(dict, CFSTR("allocate"), kCFBooleanTrue);
+	CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_SUPERNET),
+			     CFSTR("supernet_test"));
+	weight = CFNumberCreate(NULL, kCFNumberIntType, &weight_val);
+	CFDictionarySetValue(dict, CFSTR(SUBNET_PROP_ALLOCATION_WEIGHT),
+			     weight);
+	CFRelease(weight);
+	CFArrayAppendValue(list, dict);
+	CFRelease(dict);
+    }
+    subnets = SubnetListCreateWithArray(list);
+    CFRelease(list);
+    return (subnets);
+}
+
+/*
+ * Function: supernet_test
+ * Purpose:
+ *   Fill the supernet to the given percentage, then measure the time
+ *   to allocate an address while clients come and go at that fill level,
+ *   and show how the addresses are spread across the pools.
+ */
+static void
+supernet_test(uint32_t size, int fill_percent, SubnetAllocationPolicy policy)
+{
+    struct in_addr *	addrs;
+    uint32_t		count;
+    uint32_t		fill;
+    int			i;
+    struct in_addr	ip;
+    probe_test_pool_t	pool;
+    const char *	policy_names[] = {
+	"ordered", "least_utilized", "weighted"
+    };
+    int			round;
+    struct timeval	start;
+    struct timeval	end;
+    SubnetListRef	subnets;
+    uint32_t		total;
+    double		usecs;
+
+    subnets = supernet_test_subnets_create(size);
+    if (subnets == NULL) {
+	fprintf(stderr, "failed to create subnets\n");
+	exit(1);
+    }
+    SubnetListSetAllocationPolicy(subnets, policy);
+    total = size * SUPERNET_TEST_POOLS;
+    pool.first = iptohl(SubnetListElement(subnets, 0)->net_address);
+    pool.in_use = calloc(howmany(SUPERNET_TEST_POOLS << 16, 32),
+			 sizeof(uint32_t));
+    addrs = calloc(total, sizeof(*addrs));
+    fill = (uint32_t)((uint64_t)total * fill_percent / 100);
+    for (count = 0; count < fill; count++) {
+	ip = SubnetListElement(subnets, 0)->net_range.start;
+	if (SubnetListAcquireAddress(subnets, &ip, probe_test_in_use,
+				     &pool) == NULL) {
+	    fprintf(stderr, "supernet full at %u\n", count);
+	    exit(1);
+	}
+	bitmap_set(pool.in_use, iptohl(ip) - pool.first);
+	SubnetListNoteAddressBound(subnets, ip);
+	addrs[count] = ip;
+    }
+    for (i = 0; i < SUPERNET_TEST_POOLS; i++) {
+	bzero(&SubnetListElement(subnets, i)->stats, sizeof(AllocationStats));
+    }
+
+    /* clients come and go at the fill level */
+    gettimeofday(&start, NULL);
+    for (round = 0; round < PROBE_TEST_ROUNDS; round++) {
+	uint32_t	which = arc4random_uniform(count);
+
+	bitmap_clear(pool.in_use, iptohl(addrs[which]) - pool.first);
+	SubnetListReleaseAddress(subnets, addrs[which]);
+	ip = SubnetListElement(subnets, 0)->net_range.start;
+	(void)SubnetListAcquireAddress(subnets, &ip, probe_test_in_use,
+				       &pool);
+	bitmap_set(pool.in_use, iptohl(ip) - pool.first);
+	SubnetListNoteAddressBound(subnets, ip);
+	addrs[which] = ip;
+    }
+    gettimeofday(&end, NULL);
+    usecs = (end.tv_sec - start.tv_sec) * 1000000.0
+	+ (end.tv_usec - start.tv_usec);
+    printf("%-14s %3d%%: %.0f ns per allocation\n", policy_names[policy],
+	   fill_percent, usecs * 1000 / PROBE_TEST_ROUNDS);
+    {
+	CFMutableStringRef	str;
+
+	str = CFStringCreateMutable(NULL, 0);
+	SubnetListPrintAllocationStatsCFString(str, subnets);
+	my_CFStringPrint(stdout, str);
+	CFRelease(str);
+    }
+    free(addrs);
+    free(pool.in_use);
+    SubnetListFree(&subnets);
+    return;
+}
+
 int
 main(int argc, const char * argv[])
 {
@@ -1286,8 +2687,43 @@ main(int argc, const char * argv[])
     SubnetListRef	subnets;
     CFDictionaryRef	plist;
 
+    if (argc >= 2 && strcmp(argv[1], "-supernet") == 0) {
+	int		fill[] = { 50, 90, 99 };
+	int		i;
+	uint32_t	size = 4000;
+
+	if (argc > 2) {
+	    size = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+	if (size == 0 || size > 65000) {
+	    fprintf(stderr, "pool size must be between 1 and 65000\n");
+	    exit(1);
+	}
+	for (i = 0; i < sizeof(fill) / sizeof(fill[0]); i++) {
+	    supernet_test(size, fill[i], kSubnetAllocationPolicyOrdered);
+	    supernet_test(size, fill[i], kSubnetAllocationPolicyLeastUtilized);
+	    supernet_test(size, fill[i], kSubnetAllocationPolicyWeighted);
+	}
+	exit(0);
+    }
+    if (argc >= 2 && strcmp(argv[1], "-probe") == 0) {
+	int		fill[] = { 50, 75, 90, 95, 99 };
+	int		i;
+	uint32_t	size = 4000;
+
+	if (argc > 2) {
+	    size = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+	for (i = 0; i < sizeof(fill) / sizeof(fill[0]); i++) {
+	    probe_test(size, fill[i], FALSE);
+	    probe_test(size, fill[i], TRUE);
+	}
+	offer_test(size);
+	exit(0);
+    }
     if (argc != 2) {
-	fprintf(stderr, "Usage: subnets <file>\n");
+	fprintf(stderr, "Usage: subnets <file> | -probe [ <pool_size> ]"
+		" | -supernet [ <pool_size> ]\n");
 	exit(1);
     }
     plist = my_CFPropertyListCreateFromFile(argv[1]);
@@ -52,6 +52,23 @@
 #define SUBNET_PROP_SUPERNET		"supernet"
 #define SUBNET_PROP_LEASE_MIN		"lease_min"
 #define SUBNET_PROP_LEASE_MAX		"lease_max"
+#define SUBNET_PROP_HASHED_ALLOCATION	"hashed_allocation"
+#define SUBNET_PROP_ALLOCATION_WEIGHT	"allocation_weight"
+
+/*
+ * Type: SubnetAllocationPolicy
+ * Purpose:
+ *   How to choose among pools on the same supernet.
+ *   Ordered:		the first pool in the configuration with room
+ *   LeastUtilized:	the pool with the smallest fraction in use
+ *   Weighted:		the pool with the fewest addresses in use relative
+ *			to its allocation_weight
+ */
+typedef enum {
+    kSubnetAllocationPolicyOrdered = 0,
+    kSubnetAllocationPolicyLeastUtilized = 1,
+    kSubnetAllocationPolicyWeighted = 2,
+} SubnetAllocationPolicy;
 
 
 typedef bool (SubnetIsAddressInUseFunc)(void * private, struct in_addr ip);
@@ -67,6 +84,30 @@ SubnetRef
 SubnetListAcquireAddress(SubnetListRef list, struct in_addr * addr,
 			 SubnetIsAddressInUseFuncRef func, void * arg);
 
+SubnetRef
+SubnetListAcquireAddressForClient(SubnetListRef list, struct in_addr * addr,
+				  SubnetIsAddressInUseFuncRef func, void * arg,
+				  const char * client_key);
+
+void
+SubnetListReleaseAddress(SubnetListRef list, struct in_addr addr);
+
+void
+SubnetListNoteAddressInUse(SubnetListRef list, struct in_addr addr);
+
+void
+SubnetListClearAddressInUse(SubnetListRef list, struct in_addr addr);
+
+void
+SubnetListNoteAddressBound(SubnetListRef list, struct in_addr addr);
+
+void
+SubnetListForgetAddressesInUse(SubnetListRef list);
+
+void
+SubnetListSetAllocationPolicy(SubnetListRef list,
+			      SubnetAllocationPolicy policy);
+
 SubnetRef
 SubnetListGetSubnetForAddress(SubnetListRef list, struct in_addr addr,
 			      bool in_range);
@@ -79,6 +120,12 @@ SubnetListAreAddressesOnSameSupernet(SubnetListRef list,
 SubnetListRef
 SubnetListCreateWithArray(CFArrayRef list);
 
+SubnetListRef
+SubnetListCreateWithImage(const void * image, size_t image_size);
+
+void *
+SubnetListCopyImage(SubnetListRef subnets, size_t * ret_size);
+
 void
 SubnetListFree(SubnetListRef * subnets);
 
@@ -88,6 +135,10 @@ SubnetListPrint(SubnetListRef subnets);
 void
 SubnetListPrintCFString(CFMutableStringRef str, SubnetListRef subnets);
 
+void
+SubnetListPrintAllocationStatsCFString(CFMutableStringRef str,
+				       SubnetListRef subnets);
+
 /**
  ** SubnetRef API's
  **/
@@ -104,6 +155,9 @@ SubnetGetOptionPtrAndLength(SubnetRef subnet, dhcptag_t tag,
 struct in_addr
 SubnetGetMask(SubnetRef subnet);
 
+const char *
+SubnetGetName(SubnetRef subnet);
+
 bool
 SubnetDoesAllocate(SubnetRef subnet);
 
@@ -33,6 +33,9 @@
  * March 31, 2016	Dieter Siegmund (dieter@apple.com)
  * - renamed bootp_transmit.c => udp_transmit.c,
  *   bootp_transmit() => udpv4_transmit()
+ *
+ * October 18, 2026
+ * - added the optional BPF descriptor cache
  */
 
 #include <stdlib.h>
@@ -103,6 +106,92 @@ get_bpf_fd(const char * if_name)
     return (bpf_fd);
 }
 
+/*
+ * BPF descriptor cache
+ * - opening a BPF device and attaching it to the interface costs a scan
+ *   of /dev/bpf* and several system calls, and used to be paid for every
+ *   frame sent; a server that sends many replies to clients without an
+ *   address keeps the descriptor for each interface open instead
+ * - a descriptor whose interface went away fails with ENXIO and is
+ *   closed, so it is reopened when the interface comes back
+ */
+#define BPF_CACHE_MAX		32
+
+typedef struct {
+    char	if_name[IFNAMSIZ];
+    int		fd;
+} bpf_cache_entry_t;
+
+STATIC bpf_cache_entry_t	S_bpf_cache[BPF_CACHE_MAX];
+STATIC int			S_bpf_cache_count;
+STATIC int			S_bpf_cache_enabled;
+
+PRIVATE_EXTERN void
+udpv4_transmit_flush_bpf_cache(void)
+{
+    int		i;
+
+    for (i = 0; i < S_bpf_cache_count; i++) {
+	bpf_dispose(S_bpf_cache[i].fd);
+    }
+    S_bpf_cache_count = 0;
+    return;
+}
+
+PRIVATE_EXTERN void
+udpv4_transmit_set_bpf_cache(int enable)
+{
+    if (enable == 0) {
+	udpv4_transmit_flush_bpf_cache();
+    }
+    S_bpf_cache_enabled = enable;
+    return;
+}
+
+STATIC int
+bpf_cache_lookup(const char * if_name, int * cached)
+{
+    int		fd;
+    int		i;
+
+    *cached = 0;
+    if (S_bpf_cache_enabled == 0) {
+	return (get_bpf_fd(if_name));
+    }
+    for (i = 0; i < S_bpf_cache_count; i++) {
+	if (strncmp(S_bpf_cache[i].if_name, if_name,
+		    sizeof(S_bpf_cache[i].if_name)) == 0) {
+	    *cached = 1;
+	    return (S_bpf_cache[i].fd);
+	}
+    }
+    fd = get_bpf_fd(if_name);
+    if (fd >= 0 && S_bpf_cache_count < BPF_CACHE_MAX) {
+	strncpy(S_bpf_cache[S_bpf_cache_count].if_name, if_name,
+		sizeof(S_bpf_cache[S_bpf_cache_count].if_name));
+	S_bpf_cache[S_bpf_cache_count].fd = fd;
+	S_bpf_cache_count++;
+	*cached = 1;
+    }
+    return (fd);
+}
+
+STATIC void
+bpf_cache_remove(int fd)
+{
+    int		i;
+
+    for (i = 0; i < S_bpf_cache_count; i++) {
+	if (S_bpf_cache[i].fd == fd) {
+	    S_bpf_cache_count--;
+	    S_bpf_cache[i] = S_bpf_cache[S_bpf_cache_count];
+	    break;
+	}
+    }
+    bpf_dispose(fd);
+    return;
+}
+
 PRIVATE_EXTERN int
 udpv4_transmit(int sockfd, void * sendbuf,
 	       const char * if_name, int hwtype, const void * hwaddr,
@@ -115,6 +204,7 @@ udpv4_transmit(int sockfd, void * sendbuf,
     static int	first = 1;
     static int 	ip_id = 0;
     int		bpf_fd = -1;
+    int		cached = 0;
     int 	status = 0;
 
     if (first) {
@@ -125,7 +215,7 @@ udpv4_transmit(int sockfd, void * sendbuf,
     if ((hwtype == ARPHRD_ETHER || hwtype == ARPHRD_IEEE1394)
 	&& (ntohl(dest_ip.s_addr) == INADDR_BROADCAST
 	    || hwaddr != NULL)) {
-	bpf_fd = get_bpf_fd(if_name);
+	bpf_fd = bpf_cache_lookup(if_name, &cached);
 	if (bpf_fd < 0) {
 	    status = -1;
 	}
@@ -215,6 +305,11 @@ udpv4_transmit(int sockfd, void * sendbuf,
 		IPConfigLogFL(LOG_ERR, 
 			      "bpf_write(%s) failed: %s (%d)",
 			      if_name, strerror(errno), errno);
+		if (cached && errno == ENXIO) {
+		    /* the interface went away, reopen next time */
+		    bpf_cache_remove(bpf_fd);
+		    bpf_fd = -1;
+		}
 	    }
 	}
     }
@@ -238,7 +333,7 @@ udpv4_transmit(int sockfd, void * sendbuf,
 	IPConfigLogFL(LOG_ERR, "neither bpf nor socket send available");
     }
 
-    if (bpf_fd >= 0) {
+    if (bpf_fd >= 0 && cached == 0) {
 	bpf_dispose(bpf_fd);
     }
     return (status);
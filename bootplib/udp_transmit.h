@@ -46,5 +46,22 @@ udpv4_transmit(int sockfd, void * sendbuf,
 	       u_short src_port,
 	       const void * data, int len);
 
+/*
+ * Function: udpv4_transmit_set_bpf_cache
+ * Purpose:
+ *   Keep the BPF descriptor used to send on each interface open between
+ *   calls, instead of opening and closing one for each frame.
+ */
+void
+udpv4_transmit_set_bpf_cache(int enable);
+
+/*
+ * Function: udpv4_transmit_flush_bpf_cache
+ * Purpose:
+ *   Close the cached BPF descriptors, e.g. when the interfaces change.
+ */
+void
+udpv4_transmit_flush_bpf_cache(void);
+
 
 #endif /* _S_UDP_TRANSMIT_H */
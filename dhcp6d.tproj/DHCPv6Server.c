@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/errno.h>
@@ -54,6 +55,7 @@
 #include <arpa/inet.h>
 #include <net/if_types.h>
 #include <net/if_dl.h>
+#include <ifaddrs.h>
 #include <SystemConfiguration/SystemConfiguration.h>
 #include <SystemConfiguration/SCPrivate.h>
 #include "DHCPDUID.h"
@@ -103,6 +105,21 @@ STATIC const CFStringRef kDHCPv6ServerDUID = CFSTR("DUID");
  * - Each element of the array is a string corresponding to the interface name,
  *   e.g. "bridge100" or "en0".
  *
+ * "interface_profiles" <dict>
+ * - Each key is an interface name, and each value is a <dict> containing
+ *   an "options" <dict> in the same format as the top-level "options".
+ *   The options override the global options on that interface.
+ *
+ * "prefix_profiles" <array> of <dict>
+ * - Each element contains a "prefix" <string> e.g. "2001:db8:1::/64", and
+ *   an "options" <dict>. The profile applies to an enabled interface that
+ *   has an IPv6 address within the prefix; if several match, the longest
+ *   prefix wins. An interface profile overrides a prefix profile.
+ *
+ * "reconfigure" <bool>
+ * - boolean enables/disables sending RECONFIGURE to clients that sent
+ *   RECONF_ACCEPT when their options change, default is enabled
+ *
  * "verbose" <bool>
  * - boolean enables/disables verbose logging
  */
@@ -112,6 +129,10 @@ STATIC const char * kDHCPv6ServerConfigurationFile = DHCP6D_CONFIG_FILE;
 STATIC const CFStringRef kDHCPv6ServerEnabledInterfaces = CFSTR("enabled_interfaces");
 STATIC const CFStringRef kDHCPv6ServerOptions = CFSTR("options");
 STATIC const CFStringRef kDHCPv6ServerVerbose = CFSTR("verbose");
+STATIC const CFStringRef kDHCPv6ServerInterfaceProfiles = CFSTR("interface_profiles");
+STATIC const CFStringRef kDHCPv6ServerPrefixProfiles = CFSTR("prefix_profiles");
+STATIC const CFStringRef kDHCPv6ServerProfilePrefix = CFSTR("prefix");
+STATIC const CFStringRef kDHCPv6ServerReconfigure = CFSTR("reconfigure");
 
 /*
  * Globals
@@ -134,6 +155,155 @@ STATIC const struct sockaddr_in6 blank_sin6 = {
 
 typedef unsigned int	IFIndex;
 
+/*
+ * DHCPv6OptionProfiles
+ * - the compiled option table for each enabled interface, indexed by
+ *   interface index so that the receive path never consults a dictionary
+ */
+typedef struct {
+    IFIndex			if_index_max;
+    DHCPv6OptionTableRef *	tables;		/* if_index_max + 1 entries */
+} DHCPv6OptionProfiles, * DHCPv6OptionProfilesRef;
+
+/*
+ * StatelessClientTable
+ * - clients that sent RECONF_ACCEPT in an INFORMATION-REQUEST; when the
+ *   options for their interface change, they are sent an authenticated
+ *   RECONFIGURE instead of waiting for them to ask again
+ */
+#define kStatelessClientTableCapacity		4096
+#define kStatelessClientLifetime		(24 * 60 * 60)
+#define kReconfigureBatchInterval		(100 * NSEC_PER_MSEC)
+#define kReconfigureBatchSize			16
+
+typedef struct {
+    CFDataRef		duid;
+    struct in6_addr	addr;		/* link-local source address */
+    IFIndex		if_index;
+    uint8_t		key[kDHCPv6ReconfigureKeyLength];
+    CFAbsoluteTime	last_seen;
+    CFAbsoluteTime	reconfigure_time;	/* 0 if none pending */
+    int			reconfigure_tries;
+} StatelessClient, * StatelessClientRef;
+
+typedef struct {
+    StatelessClientRef		list;
+    int				count;
+    CFMutableDictionaryRef	index;		/* DUID -> position + 1 */
+    int				pending;
+    dispatch_source_t		timer;
+} StatelessClientTable, * StatelessClientTableRef;
+
+STATIC void
+StatelessClientTableInit(StatelessClientTableRef table)
+{
+    bzero(table, sizeof(*table));
+    table->list = malloc(sizeof(*table->list) * kStatelessClientTableCapacity);
+    table->index = CFDictionaryCreateMutable(NULL, 0,
+					     &kCFTypeDictionaryKeyCallBacks,
+					     NULL);
+    return;
+}
+
+STATIC StatelessClientRef
+StatelessClientTableLookup(StatelessClientTableRef table,
+			   const uint8_t * duid, int duid_len)
+{
+    CFDataRef		key;
+    const void *	position;
+    StatelessClientRef	ret = NULL;
+
+    key = CFDataCreateWithBytesNoCopy(NULL, duid, duid_len, kCFAllocatorNull);
+    if (CFDictionaryGetValueIfPresent(table->index, key, &position)) {
+	ret = table->list + ((uintptr_t)position - 1);
+    }
+    CFRelease(key);
+    return (ret);
+}
+
+STATIC void
+StatelessClientTableRemoveAtIndex(StatelessClientTableRef table, int i)
+{
+    StatelessClientRef	client = table->list + i;
+    int			last = table->count - 1;
+
+    if (client->reconfigure_time != 0) {
+	table->pending--;
+    }
+    CFDictionaryRemoveValue(table->index, client->duid);
+    CFRelease(client->duid);
+    if (i != last) {
+	/* keep the list dense by moving the last entry into the hole */
+	*client = table->list[last];
+	CFDictionarySetValue(table->index, client->duid,
+			     (const void *)(uintptr_t)(i + 1));
+    }
+    table->count--;
+    return;
+}
+
+STATIC void
+StatelessClientTableRemoveExpired(StatelessClientTableRef table,
+				  CFAbsoluteTime now)
+{
+    for (int i = table->count - 1; i >= 0; i--) {
+	if ((table->list[i].last_seen + kStatelessClientLifetime) < now) {
+	    StatelessClientTableRemoveAtIndex(table, i);
+	}
+    }
+    return;
+}
+
+STATIC StatelessClientRef
+StatelessClientTableAdd(StatelessClientTableRef table,
+			const uint8_t * duid, int duid_len,
+			CFAbsoluteTime now)
+{
+    StatelessClientRef	client;
+
+    if (table->count == kStatelessClientTableCapacity) {
+	int	oldest = 0;
+
+	/* make room by forgetting the client we heard from least recently */
+	for (int i = 1; i < table->count; i++) {
+	    if (table->list[i].last_seen < table->list[oldest].last_seen) {
+		oldest = i;
+	    }
+	}
+	StatelessClientTableRemoveAtIndex(table, oldest);
+    }
+    client = table->list + table->count;
+    bzero(client, sizeof(*client));
+    client->duid = CFDataCreate(NULL, duid, duid_len);
+    arc4random_buf(client->key, sizeof(client->key));
+    client->last_seen = now;
+    table->count++;
+    CFDictionarySetValue(table->index, client->duid,
+			 (const void *)(uintptr_t)table->count);
+    return (client);
+}
+
+STATIC void
+StatelessClientTableFree(StatelessClientTableRef table)
+{
+    if (table->timer != NULL) {
+	dispatch_source_cancel(table->timer);
+	dispatch_release(table->timer);
+	table->timer = NULL;
+    }
+    for (int i = 0; i < table->count; i++) {
+	CFRelease(table->list[i].duid);
+    }
+    if (table->list != NULL) {
+	free(table->list);
+	table->list = NULL;
+    }
+    my_CFRelease(&table->index);
+    table->count = 0;
+    table->pending = 0;
+    return;
+}
+
 struct DHCPv6Server {
     int			sock_fd;
     dispatch_source_t	sock_source;
@@ -141,8 +311,17 @@ struct DHCPv6Server {
     CFDataRef		duid;
     char *		config_file;
 
-    /* global options */
+    /* global options, and per-interface and per-prefix overrides */
     CFDictionaryRef	options;
+    CFDictionaryRef	interface_profiles;
+    CFArrayRef		prefix_profiles;
+
+    /* the above compiled for each enabled interface */
+    DHCPv6OptionProfilesRef	profiles;
+
+    /* clients that accept RECONFIGURE */
+    bool			reconfigure_enabled;
+    StatelessClientTable	clients;
 
     /* keep a copy so that we can re-evaluate when the interface list changes */
     CFArrayRef		enabled_interfaces;
@@ -159,6 +338,9 @@ struct DHCPv6Server {
 STATIC void
 DHCPv6ServerSetEnabledInterfaces(DHCPv6ServerRef server,
 				 CFArrayRef enabled_interfaces);
+STATIC void
+DHCPv6ServerCompileProfiles(DHCPv6ServerRef server);
+
 STATIC int
 DHCPv6ServerTransmit(DHCPv6ServerRef server,
 		     IFIndex if_index,
@@ -290,6 +472,223 @@ DHCPv6ServerGetEnabledInterfaceName(DHCPv6ServerRef server, IFIndex if_index)
     return (server->if_names[which]);
 }
 
+STATIC DHCPv6OptionTableRef
+DHCPv6ServerGetOptionTable(DHCPv6ServerRef server, IFIndex if_index)
+{
+    DHCPv6OptionProfilesRef	profiles = server->profiles;
+
+    if (profiles == NULL || if_index > profiles->if_index_max) {
+	return (NULL);
+    }
+    return (profiles->tables[if_index]);
+}
+
+STATIC uint64_t
+DHCPv6ServerNextReplayDetection(void)
+{
+    STATIC uint64_t	S_replay_detection;
+
+    if (S_replay_detection == 0) {
+	/* keep the counter increasing across restarts */
+	S_replay_detection = ((uint64_t)time(NULL)) << 32;
+    }
+    return (++S_replay_detection);
+}
+
+/*
+ * Function: DHCPv6ServerNoteStatelessClient
+ * Purpose:
+ *   Remember a client that is willing to accept RECONFIGURE, and return
+ *   its entry so that the reply can carry the client's reconfigure key.
+ *   A request from a client with a RECONFIGURE pending means the client
+ *   already got it, so stop retransmitting.
+ */
+STATIC StatelessClientRef
+DHCPv6ServerNoteStatelessClient(DHCPv6ServerRef server,
+				DHCPv6OptionListRef options,
+				DHCPDUIDRef client_id, int client_id_len,
+				const struct sockaddr_in6 * from_p,
+				IFIndex if_index)
+{
+    StatelessClientRef	client;
+    CFAbsoluteTime	now;
+    int			option_len;
+
+    if (!server->reconfigure_enabled
+	|| client_id == NULL
+	|| !IN6_IS_ADDR_LINKLOCAL(&from_p->sin6_addr)) {
+	return (NULL);
+    }
+    if (DHCPv6OptionListGetOptionDataAndLength(options,
+					       kDHCPv6OPTION_RECONF_ACCEPT,
+					       &option_len, NULL) == NULL) {
+	return (NULL);
+    }
+    now = CFAbsoluteTimeGetCurrent();
+    client = StatelessClientTableLookup(&server->clients,
+					(const uint8_t *)client_id,
+					client_id_len);
+    if (client == NULL) {
+	client = StatelessClientTableAdd(&server->clients,
+					 (const uint8_t *)client_id,
+					 client_id_len, now);
+    }
+    else if (client->reconfigure_time != 0) {
+	client->reconfigure_time = 0;
+	server->clients.pending--;
+    }
+    client->addr = from_p->sin6_addr;
+    client->if_index = if_index;
+    client->last_seen = now;
+    return (client);
+}
+
+STATIC void
+DHCPv6ServerSendReconfigure(DHCPv6ServerRef server, StatelessClientRef client)
+{
+    char			buf[1500];
+    DHCPv6OptionErrorString 	err;
+    uint8_t			msg_type = kDHCPv6MessageINFORMATION_REQUEST;
+    DHCPv6OptionArea		oa;
+    DHCPv6PacketRef		pkt;
+    int				pkt_len;
+
+    pkt = (DHCPv6PacketRef)buf;
+    DHCPv6PacketSetMessageType(pkt, kDHCPv6MessageRECONFIGURE);
+    DHCPv6PacketSetTransactionID(pkt, 0);
+    DHCPv6OptionAreaInit(&oa, pkt->options, 
+			 sizeof(buf) - DHCPV6_PACKET_HEADER_LENGTH);
+    if (!DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_SERVERID,
+				   CFDataGetLength(server->duid),
+				   CFDataGetBytePtr(server->duid), &err)
+	|| !DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_CLIENTID,
+				      CFDataGetLength(client->duid),
+				      CFDataGetBytePtr(client->duid), &err)
+	|| !DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_RECONF_MSG,
+				      sizeof(msg_type), &msg_type, &err)
+	|| !DHCPv6OptionAreaAddReconfigureKey(&oa,
+					      kDHCPv6ReconfigureKeyTypeHMAC_MD5,
+					      DHCPv6ServerNextReplayDetection(),
+					      NULL, &err)) {
+	my_log(LOG_NOTICE, "failed to build RECONFIGURE, %s", err.str);
+	return;
+    }
+    pkt_len = DHCPV6_PACKET_HEADER_LENGTH + DHCPv6OptionAreaGetUsedLength(&oa);
+    DHCPv6PacketSignReconfigure(pkt, pkt_len, client->key);
+    (void)DHCPv6ServerTransmit(server, client->if_index, &client->addr,
+			       pkt, pkt_len);
+    return;
+}
+
+STATIC void
+DHCPv6ServerStopReconfigureTimer(DHCPv6ServerRef server)
+{
+    if (server->clients.timer != NULL) {
+	dispatch_source_cancel(server->clients.timer);
+	dispatch_release(server->clients.timer);
+	server->clients.timer = NULL;
+    }
+    return;
+}
+
+/*
+ * Function: DHCPv6ServerReconfigureTimer
+ * Purpose:
+ *   Send at most kReconfigureBatchSize RECONFIGURE messages per tick to
+ *   clients whose (re)transmit time has arrived, doubling the retransmit
+ *   time from REC_TIMEOUT until REC_MAX_RC attempts have been made.
+ */
+STATIC void
+DHCPv6ServerReconfigureTimer(DHCPv6ServerRef server)
+{
+    StatelessClientTableRef	clients = &server->clients;
+    CFAbsoluteTime		now = CFAbsoluteTimeGetCurrent();
+    int				sent = 0;
+
+    StatelessClientTableRemoveExpired(clients, now);
+    for (int i = 0; i < clients->count && sent < kReconfigureBatchSize; i++) {
+	StatelessClientRef	client = clients->list + i;
+
+	if (client->reconfigure_time == 0 || client->reconfigure_time > now) {
+	    continue;
+	}
+	DHCPv6ServerSendReconfigure(server, client);
+	sent++;
+	client->reconfigure_tries++;
+	if (client->reconfigure_tries >= DHCPv6_REC_MAX_RC) {
+	    client->reconfigure_time = 0;
+	    clients->pending--;
+	}
+	else {
+	    client->reconfigure_time = now
+		+ DHCPv6_REC_TIMEOUT * (1 << (client->reconfigure_tries - 1));
+	}
+    }
+    if (clients->pending == 0) {
+	DHCPv6ServerStopReconfigureTimer(server);
+    }
+    return;
+}
+
+STATIC void
+DHCPv6ServerStartReconfigureTimer(DHCPv6ServerRef server)
+{
+    dispatch_source_t	timer;
+
+    if (server->clients.timer != NULL) {
+	return;
+    }
+    timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+				   dispatch_get_main_queue());
+    dispatch_source_set_timer(timer, DISPATCH_TIME_NOW,
+			      kReconfigureBatchInterval,
+			      kReconfigureBatchInterval / 10);
+    dispatch_source_set_event_handler(timer, ^{
+	    DHCPv6ServerReconfigureTimer(server);
+	});
+    dispatch_resume(timer);
+    server->clients.timer = timer;
+    return;
+}
+
+/*
+ * Function: DHCPv6ServerScheduleReconfigure
+ * Purpose:
+ *   The options for the interface changed, queue a RECONFIGURE for each
+ *   client we know about on that interface.
+ */
+STATIC void
+DHCPv6ServerScheduleReconfigure(DHCPv6ServerRef server, IFIndex if_index)
+{
+    StatelessClientTableRef	clients = &server->clients;
+    int				count = 0;
+    CFAbsoluteTime		now = CFAbsoluteTimeGetCurrent();
+
+    if (!server->reconfigure_enabled) {
+	return;
+    }
+    for (int i = 0; i < clients->count; i++) {
+	StatelessClientRef	client = clients->list + i;
+
+	if (client->if_index != if_index) {
+	    continue;
+	}
+	if (client->reconfigure_time == 0) {
+	    clients->pending++;
+	}
+	client->reconfigure_time = now;
+	client->reconfigure_tries = 0;
+	count++;
+    }
+    if (count != 0) {
+	my_log(LOG_NOTICE, "[%s] Scheduling RECONFIGURE for %d client%s",
+	       DHCPv6ServerGetEnabledInterfaceName(server, if_index),
+	       count, (count == 1) ? "" : "s");
+	DHCPv6ServerStartReconfigureTimer(server);
+    }
+    return;
+}
+
 STATIC void
 DHCPv6ServerProcessRequest(DHCPv6ServerRef server,
 			   const struct sockaddr_in6 * from_p,
@@ -308,6 +707,8 @@ DHCPv6ServerProcessRequest(DHCPv6ServerRef server,
     DHCPv6PacketRef		reply_pkt;
     const void *		requested_options;
     DHCPDUIDRef			server_id;
+    StatelessClientRef		stateless_client;
+    DHCPv6OptionTableRef	table;
 
     if_name = DHCPv6ServerGetEnabledInterfaceName(server, if_index);
     if (if_name == NULL) {
@@ -391,6 +792,10 @@ DHCPv6ServerProcessRequest(DHCPv6ServerRef server,
 	    goto done;
 	}
     }
+    stateless_client
+	= DHCPv6ServerNoteStatelessClient(server, options,
+					  client_id, option_len,
+					  from_p, if_index);
 
     /* add our ServerIdentifier */
     if (!DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_SERVERID,
@@ -407,22 +812,24 @@ DHCPv6ServerProcessRequest(DHCPv6ServerRef server,
 	DHCPv6OptionListGetOptionDataAndLength(options,
 					       kDHCPv6OPTION_ORO,
 					       &option_len, NULL);
-    if (requested_options != NULL && server->options != NULL) {
+    table = DHCPv6ServerGetOptionTable(server, if_index);
+    if (requested_options != NULL && table != NULL) {
 	const void *	scan;
 
 	scan = requested_options;
 	for (int i = 0; i < (option_len / sizeof(DHCPv6OptionLength));
 	     i++, scan += sizeof(DHCPv6OptionLength)) {
-	    CFDataRef		data;
 	    DHCPv6OptionCode	code;
+	    const uint8_t *	encoded;
+	    int			encoded_length;
 
 	    code = net_uint16_get(scan);
-	    data = DHCPv6OptionsDictionaryGetOption(server->options, code);
-	    if (data != NULL) {
-		if (!DHCPv6OptionAreaAddOption(&oa, code,
-					       CFDataGetLength(data),
-					       CFDataGetBytePtr(data),
-					       &err)) {
+	    encoded = DHCPv6OptionTableGetEncodedOption(table, code,
+							&encoded_length);
+	    if (encoded != NULL) {
+		if (!DHCPv6OptionAreaAddEncodedOption(&oa, encoded,
+						      encoded_length,
+						      &err)) {
 		    my_log(LOG_NOTICE, "failed to add %s, %s",
 			   DHCPv6OptionCodeGetName(code),
 			   err.str);
@@ -432,6 +839,21 @@ DHCPv6ServerProcessRequest(DHCPv6ServerRef server,
 	}
     }
 
+    /* give the client the key to authenticate a future RECONFIGURE */
+    if (stateless_client != NULL) {
+	if (!DHCPv6OptionAreaAddOption(&oa, kDHCPv6OPTION_RECONF_ACCEPT,
+				       0, NULL, &err)
+	    || !DHCPv6OptionAreaAddReconfigureKey(&oa,
+						  kDHCPv6ReconfigureKeyTypeKey,
+						  DHCPv6ServerNextReplayDetection(),
+						  stateless_client->key,
+						  &err)) {
+	    my_log(LOG_NOTICE, "failed to add reconfigure key, %s",
+		   err.str);
+	    goto done;
+	}
+    }
+
     /* send a reply */
     error = DHCPv6ServerTransmit(server, if_index, &from_p->sin6_addr,
 				 reply_pkt,
@@ -453,8 +875,14 @@ DHCPv6ServerProcessRequest(DHCPv6ServerRef server,
     return;
 }
 
-STATIC void
-DHCPv6ServerReceive(DHCPv6ServerRef server)
+/*
+ * Function: DHCPv6ServerReceiveOne
+ * Purpose:
+ *   Receive and process a single packet.  Returns false if no packet
+ *   was received.
+ */
+STATIC bool
+DHCPv6ServerReceiveOne(DHCPv6ServerRef server, int flags)
 {
     struct cmsghdr *	cm;
     char		cmsgbuf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
@@ -476,19 +904,19 @@ DHCPv6ServerReceive(DHCPv6ServerRef server)
     mhdr.msg_controllen = sizeof(cmsgbuf);
 
     /* get message */
-    n = recvmsg(server->sock_fd, &mhdr, 0);
+    n = recvmsg(server->sock_fd, &mhdr, flags);
     if (n < 0) {
 	if (errno != EAGAIN) {
 	    my_log(LOG_ERR, "DHCPv6SocketRead: recvfrom failed %s (%d)",
 		   strerror(errno), errno);
 	}
-	return;
+	return (false);
     }
     if (n < DHCPV6_PACKET_HEADER_LENGTH) {
 	my_log(LOG_NOTICE,
 	       "DHCPv6SocketRead: packet too short %ld < %d",
 	       n, DHCPV6_PACKET_HEADER_LENGTH);
-	return;
+	return (true);
     }
 
     /* get the control message that has the interface index */
@@ -517,11 +945,35 @@ DHCPv6ServerReceive(DHCPv6ServerRef server)
     if (pktinfo == NULL) {
 	my_log(LOG_NOTICE,
 	       "DHCPv6SocketRead: missing IPV6_PKTINFO");
-	return;
+	return (true);
     }
     DHCPv6ServerProcessRequest(server, &from,
 			       (DHCPv6PacketRef)receive_buf, (int)n,
 			       pktinfo->ipi6_ifindex);
+    return (true);
+}
+
+#define DHCPV6_RECEIVE_BATCH_MAX	64
+
+/*
+ * Function: DHCPv6ServerReceive
+ * Purpose:
+ *   Read event handler: process the packets already queued on the
+ *   socket, up to DHCPV6_RECEIVE_BATCH_MAX, rather than returning to
+ *   the dispatch source for each one.  The source fires again for any
+ *   that remain.
+ */
+STATIC void
+DHCPv6ServerReceive(DHCPv6ServerRef server)
+{
+    int		i;
+
+    for (i = 0; i < DHCPV6_RECEIVE_BATCH_MAX; i++) {
+	if (DHCPv6ServerReceiveOne(server, (i == 0) ? 0 : MSG_DONTWAIT)
+	    == false) {
+	    break;
+	}
+    }
     return;
 }
 
@@ -625,6 +1077,8 @@ DHCPv6ServerHandleNotification(SCDynamicStoreRef session,
 
     DHCPv6ServerSetEnabledInterfaces(server,
 				     server->enabled_interfaces);
+    /* interface indices and prefixes may have changed */
+    DHCPv6ServerCompileProfiles(server);
     return;
 }
 
@@ -683,6 +1137,7 @@ DHCPv6ServerCreate(const char * config_file)
     }
     server->duid = duid;
     server->sock_fd = sock_fd;
+    StatelessClientTableInit(&server->clients);
     server->sock_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,
 						 sock_fd,
 						 0UL,
@@ -842,28 +1297,322 @@ DHCPv6ServerSetEnabledInterfaces(DHCPv6ServerRef server,
     return;
 }
 
+/*
+ * DHCPv6OptionProfiles
+ */
 STATIC void
-DHCPv6ServerSetGlobalOptions(DHCPv6ServerRef server, CFDictionaryRef options)
+DHCPv6OptionProfilesRelease(DHCPv6OptionProfilesRef * profiles_p)
 {
-    CFDictionaryRef	new_options = NULL;
+    DHCPv6OptionProfilesRef	profiles = *profiles_p;
 
-    if (options != NULL) {
-	new_options = DHCPv6OptionsDictionaryCreate(options);
-	if (new_options == NULL) {
-	    my_log(LOG_NOTICE, "Failed to create DHCPv6OptionsDictionary");
+    if (profiles == NULL) {
+	return;
+    }
+    for (IFIndex i = 0; i <= profiles->if_index_max; i++) {
+	DHCPv6OptionTableRelease(&profiles->tables[i]);
+    }
+    free(profiles->tables);
+    free(profiles);
+    *profiles_p = NULL;
+    return;
+}
+
+typedef struct {
+    struct in6_addr	prefix;
+    int			prefix_length;
+    CFDictionaryRef	options;
+} PrefixProfile, * PrefixProfileRef;
+
+STATIC bool
+in6_prefix_match(const struct in6_addr * addr, const struct in6_addr * prefix,
+		 int prefix_length)
+{
+    int		bits = prefix_length % 8;
+    int		bytes = prefix_length / 8;
+
+    if (bcmp(addr, prefix, bytes) != 0) {
+	return (FALSE);
+    }
+    if (bits != 0) {
+	uint8_t		mask = (uint8_t)(0xff << (8 - bits));
+
+	if (((addr->s6_addr[bytes] ^ prefix->s6_addr[bytes]) & mask) != 0) {
+	    return (FALSE);
 	}
     }
+    return (TRUE);
+}
+
+STATIC bool
+PrefixProfileInit(PrefixProfileRef profile, CFDictionaryRef dict)
+{
+    char		buf[INET6_ADDRSTRLEN + 5];
+    CFDictionaryRef	options;
+    CFStringRef		prefix;
+    char *		slash;
+    unsigned long	prefix_length;
+
+    prefix = CFDictionaryGetValue(dict, kDHCPv6ServerProfilePrefix);
+    options = CFDictionaryGetValue(dict, kDHCPv6ServerOptions);
+    if (isA_CFString(prefix) == NULL || isA_CFDictionary(options) == NULL) {
+	my_log(LOG_NOTICE, "Ignoring invalid prefix profile %@", dict);
+	return (FALSE);
+    }
+    if (my_CFStringToCStringAndLength(prefix, buf, sizeof(buf)) == 0) {
+	goto invalid;
+    }
+    slash = strchr(buf, '/');
+    if (slash == NULL) {
+	goto invalid;
+    }
+    *slash = '\0';
+    prefix_length = strtoul(slash + 1, NULL, 10);
+    if (prefix_length == 0 || prefix_length > 128
+	|| inet_pton(AF_INET6, buf, &profile->prefix) != 1) {
+	goto invalid;
+    }
+    profile->prefix_length = (int)prefix_length;
+    profile->options = options;
+    return (TRUE);
+
+ invalid:
+    my_log(LOG_NOTICE, "Ignoring prefix profile with invalid prefix '%@'",
+	   prefix);
+    return (FALSE);
+}
+
+/*
+ * Function: find_prefix_options
+ * Purpose:
+ *   Return the options of the longest prefix profile that contains one
+ *   of the interface's global IPv6 addresses, NULL if there isn't one.
+ */
+STATIC CFDictionaryRef
+find_prefix_options(struct ifaddrs * ifap, const char * if_name,
+		    PrefixProfileRef prefixes, int prefix_count)
+{
+    PrefixProfileRef	best = NULL;
+
+    for (struct ifaddrs * scan = ifap; scan != NULL; scan = scan->ifa_next) {
+	const struct in6_addr *	addr;
+
+	if (scan->ifa_addr == NULL
+	    || scan->ifa_addr->sa_family != AF_INET6
+	    || strcmp(scan->ifa_name, if_name) != 0) {
+	    continue;
+	}
+	addr = &((struct sockaddr_in6 *)(void *)scan->ifa_addr)->sin6_addr;
+	if (IN6_IS_ADDR_LINKLOCAL(addr)) {
+	    continue;
+	}
+	for (int i = 0; i < prefix_count; i++) {
+	    PrefixProfileRef	profile = prefixes + i;
+
+	    if ((best == NULL || profile->prefix_length > best->prefix_length)
+		&& in6_prefix_match(addr, &profile->prefix,
+				    profile->prefix_length)) {
+		best = profile;
+	    }
+	}
+    }
+    return ((best != NULL) ? best->options : NULL);
+}
+
+STATIC void
+merge_options(CFMutableDictionaryRef dict, CFDictionaryRef overrides)
+{
+    CFIndex		count;
+    const void * * 	keys;
+    const void * *	values;
+
+    if (overrides == NULL) {
+	return;
+    }
+    count = CFDictionaryGetCount(overrides);
+    if (count == 0) {
+	return;
+    }
+    keys = malloc(count * sizeof(*keys) * 2);
+    values = keys + count;
+    CFDictionaryGetKeysAndValues(overrides, keys, values);
+    for (CFIndex i = 0; i < count; i++) {
+	CFDictionarySetValue(dict, keys[i], values[i]);
+    }
+    free(keys);
+    return;
+}
+
+STATIC DHCPv6OptionTableRef
+DHCPv6ServerCreateOptionTable(DHCPv6ServerRef server, const char * if_name,
+			      CFDictionaryRef prefix_options)
+{
+    CFMutableDictionaryRef	merged;
+    CFDictionaryRef		options;
+    DHCPv6OptionTableRef	table;
+
+    merged = CFDictionaryCreateMutable(NULL, 0,
+				       &kCFTypeDictionaryKeyCallBacks,
+				       &kCFTypeDictionaryValueCallBacks);
+    merge_options(merged, server->options);
+    merge_options(merged, prefix_options);
+    if (server->interface_profiles != NULL) {
+	CFDictionaryRef		profile;
+	CFStringRef		name;
+
+	name = CFStringCreateWithCString(NULL, if_name, kCFStringEncodingUTF8);
+	profile = CFDictionaryGetValue(server->interface_profiles, name);
+	CFRelease(name);
+	if (isA_CFDictionary(profile) != NULL) {
+	    options = CFDictionaryGetValue(profile, kDHCPv6ServerOptions);
+	    merge_options(merged, isA_CFDictionary(options));
+	}
+    }
+    options = NULL;
+    if (CFDictionaryGetCount(merged) != 0) {
+	options = DHCPv6OptionsDictionaryCreate(merged);
+	if (options == NULL) {
+	    my_log(LOG_NOTICE,
+		   "[%s] Failed to create DHCPv6OptionsDictionary", if_name);
+	}
+    }
+    CFRelease(merged);
+    table = DHCPv6OptionTableCreate(options);
+    my_CFRelease(&options);
+    return (table);
+}
+
+/*
+ * Function: DHCPv6ServerCompileProfiles
+ * Purpose:
+ *   Compile the global, prefix, and interface options into a table for
+ *   each enabled interface, then replace the server's tables in one step.
+ */
+STATIC void
+DHCPv6ServerCompileProfiles(DHCPv6ServerRef server)
+{
+    struct ifaddrs *		ifap = NULL;
+    IFIndex			if_index_max = 0;
+    DHCPv6OptionProfilesRef	old_profiles;
+    int				prefix_count = 0;
+    PrefixProfileRef		prefixes = NULL;
+    DHCPv6OptionProfilesRef	profiles;
+
+    for (int i = 0; i < server->if_count; i++) {
+	if (server->if_indices[i] > if_index_max) {
+	    if_index_max = server->if_indices[i];
+	}
+    }
+    if (server->prefix_profiles != NULL) {
+	CFIndex		count;
+
+	count = CFArrayGetCount(server->prefix_profiles);
+	prefixes = malloc(sizeof(*prefixes) * (count + 1));
+	for (CFIndex i = 0; i < count; i++) {
+	    CFDictionaryRef	dict;
+
+	    dict = CFArrayGetValueAtIndex(server->prefix_profiles, i);
+	    if (isA_CFDictionary(dict) != NULL
+		&& PrefixProfileInit(prefixes + prefix_count, dict)) {
+		prefix_count++;
+	    }
+	}
+	if (prefix_count != 0 && getifaddrs(&ifap) != 0) {
+	    my_log(LOG_NOTICE, "getifaddrs failed, %s", strerror(errno));
+	    prefix_count = 0;
+	}
+    }
+    profiles = malloc(sizeof(*profiles));
+    profiles->if_index_max = if_index_max;
+    profiles->tables = calloc(if_index_max + 1, sizeof(*profiles->tables));
+    for (int i = 0; i < server->if_count; i++) {
+	IFIndex		if_index = server->if_indices[i];
+	const char *	if_name = server->if_names[i];
+	CFDictionaryRef	prefix_options = NULL;
+
+	if (if_index == 0) {
+	    continue;
+	}
+	if (prefix_count != 0) {
+	    prefix_options = find_prefix_options(ifap, if_name,
+						 prefixes, prefix_count);
+	}
+	DHCPv6OptionTableRelease(&profiles->tables[if_index]);
+	profiles->tables[if_index]
+	    = DHCPv6ServerCreateOptionTable(server, if_name, prefix_options);
+	if (S_verbose) {
+	    my_log(LOG_NOTICE, "[%s] %d options%s", if_name,
+		   DHCPv6OptionTableGetCount(profiles->tables[if_index]),
+		   (prefix_options != NULL) ? " (prefix profile)" : "");
+	}
+    }
+    if (ifap != NULL) {
+	freeifaddrs(ifap);
+    }
+    if (prefixes != NULL) {
+	free(prefixes);
+    }
+
+    /* replace the tables used by the receive path */
+    old_profiles = server->profiles;
+    server->profiles = profiles;
+
+    /* tell clients on interfaces whose options changed */
+    if (old_profiles != NULL) {
+	for (int i = 0; i < server->if_count; i++) {
+	    IFIndex		if_index = server->if_indices[i];
+	    DHCPv6OptionTableRef old_table = NULL;
+
+	    if (if_index == 0) {
+		continue;
+	    }
+	    if (if_index <= old_profiles->if_index_max) {
+		old_table = old_profiles->tables[if_index];
+	    }
+	    if (!DHCPv6OptionTableEqual(old_table,
+					profiles->tables[if_index])) {
+		DHCPv6ServerScheduleReconfigure(server, if_index);
+	    }
+	}
+    }
+    DHCPv6OptionProfilesRelease(&old_profiles);
+    return;
+}
+
+STATIC void
+DHCPv6ServerSetOptions(DHCPv6ServerRef server, CFDictionaryRef options,
+		       CFDictionaryRef interface_profiles,
+		       CFArrayRef prefix_profiles)
+{
+    if (options != NULL) {
+	CFRetain(options);
+    }
     my_CFRelease(&server->options);
-    server->options = new_options;
+    server->options = options;
+    if (interface_profiles != NULL) {
+	CFRetain(interface_profiles);
+    }
+    my_CFRelease(&server->interface_profiles);
+    server->interface_profiles = interface_profiles;
+    if (prefix_profiles != NULL) {
+	CFRetain(prefix_profiles);
+    }
+    my_CFRelease(&server->prefix_profiles);
+    server->prefix_profiles = prefix_profiles;
+    DHCPv6ServerCompileProfiles(server);
+    return;
 }
 
 STATIC void
 DHCPv6ServerSetConfiguration(DHCPv6ServerRef server, CFDictionaryRef plist)
 {
     CFArrayRef		enabled_interfaces = NULL;
+    CFDictionaryRef	interface_profiles = NULL;
     CFDictionaryRef	options = NULL;
+    CFArrayRef		prefix_profiles = NULL;
+    bool		reconfigure = TRUE;
 
     if (plist != NULL) {
+	CFBooleanRef	reconfigure_cf;
 	CFBooleanRef	verbose;
 
 	enabled_interfaces
@@ -871,6 +1620,16 @@ DHCPv6ServerSetConfiguration(DHCPv6ServerRef server, CFDictionaryRef plist)
 	enabled_interfaces = isA_CFArray(enabled_interfaces);
 	options = CFDictionaryGetValue(plist, kDHCPv6ServerOptions);
 	options = isA_CFDictionary(options);
+	interface_profiles
+	    = CFDictionaryGetValue(plist, kDHCPv6ServerInterfaceProfiles);
+	interface_profiles = isA_CFDictionary(interface_profiles);
+	prefix_profiles
+	    = CFDictionaryGetValue(plist, kDHCPv6ServerPrefixProfiles);
+	prefix_profiles = isA_CFArray(prefix_profiles);
+	reconfigure_cf = CFDictionaryGetValue(plist, kDHCPv6ServerReconfigure);
+	if (isA_CFBoolean(reconfigure_cf) != NULL) {
+	    reconfigure = CFBooleanGetValue(reconfigure_cf);
+	}
 	verbose = CFDictionaryGetValue(plist, kDHCPv6ServerVerbose);
 	if (isA_CFBoolean(verbose) != NULL) {
 	    Boolean	new_verbose;
@@ -883,8 +1642,10 @@ DHCPv6ServerSetConfiguration(DHCPv6ServerRef server, CFDictionaryRef plist)
 	    }
 	}
     }
+    server->reconfigure_enabled = reconfigure;
     DHCPv6ServerSetEnabledInterfaces(server, enabled_interfaces);
-    DHCPv6ServerSetGlobalOptions(server, options);
+    DHCPv6ServerSetOptions(server, options, interface_profiles,
+			   prefix_profiles);
     return;
 }
 
@@ -921,6 +1682,10 @@ DHCPv6ServerRelease(DHCPv6ServerRef * server_p)
 	server->config_file = NULL;
     }
     my_CFRelease(&server->options);
+    my_CFRelease(&server->interface_profiles);
+    my_CFRelease(&server->prefix_profiles);
+    DHCPv6OptionProfilesRelease(&server->profiles);
+    StatelessClientTableFree(&server->clients);
     my_CFRelease(&server->enabled_interfaces);
     if (server->if_indices != NULL) {
 	free(server->if_indices);